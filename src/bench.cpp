@@ -0,0 +1,490 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/*
+Micro-benchmarks of the B+ tree index and the buffer manager. Builds a relation of RECORD tuples keyed on RECORD.i,
+indexes it by bulk loading and/or by inserting every tuple, then times point lookups and range scans, and range
+scans that fetch their tuples, in key order and through a HeapFetch in page order. Every phase reports its latency
+percentiles and the BufStats counters it moved.
+
+Usage: badgerdb_bench [-n tuples] [-d forward|backward|random|sparse|zipf] [-z theta] [-b frames]
+                      [-m bulk|insert|both] [-l lookups] [-s scans] [-w width] [-f fetches] [-r seed]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "btree.h"
+#include "heap_fetch.h"
+#include "key_distribution.h"
+#include "page.h"
+#include "buf_stats.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+
+using namespace badgerdb;
+
+// -----------------------------------------------------------------------------
+// Globals
+// -----------------------------------------------------------------------------
+const std::string relationName = "benchRel";
+
+typedef struct tuple
+{
+	int i;
+	double d;
+	char s[64];
+} RECORD;
+
+/**
+ * What one run of the benchmark does.
+ */
+struct BenchOptions
+{
+	int tuples;
+	std::string distribution;
+	double zipfTheta;
+	std::uint32_t frames;
+	std::string buildMode;
+	int lookups;
+	int scans;
+	int scanWidth;
+	int fetches;
+	unsigned seed;
+
+	BenchOptions()
+		: tuples(1000000), distribution("random"), zipfTheta(0.99), frames(1000), buildMode("both"),
+		  lookups(100000), scans(10000), scanWidth(100), fetches(100), seed(1)
+	{
+	}
+};
+
+typedef std::chrono::steady_clock Clock;
+
+// -----------------------------------------------------------------------------
+// Relation building
+// -----------------------------------------------------------------------------
+
+/**
+ * Writes the relation straight to its file, bypassing the buffer pool.
+ */
+void createRelation(const std::vector<int> &keys)
+{
+	try
+	{
+		File::remove(relationName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	PageFile file = PageFile::create(relationName);
+	RECORD record;
+	memset(&record, 0, sizeof(record));
+	memset(record.s, ' ', sizeof(record.s));
+	PageId pageNumber;
+	Page page = file.allocatePage(pageNumber);
+	for (std::size_t i = 0; i < keys.size(); i++)
+	{
+		sprintf(record.s, "%05d string record", keys[i]);
+		record.i = keys[i];
+		record.d = (double)keys[i];
+		std::string data(reinterpret_cast<char *>(&record), sizeof(record));
+
+		while (1)
+		{
+			try
+			{
+				page.insertRecord(data);
+				break;
+			}
+			catch (const InsufficientSpaceException &e)
+			{
+				file.writePage(pageNumber, page);
+				page = file.allocatePage(pageNumber);
+			}
+		}
+	}
+	file.writePage(pageNumber, page);
+}
+
+void removeFile(const std::string &name)
+{
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Reporting
+// -----------------------------------------------------------------------------
+
+double secondsSince(const Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::uint64_t nanosSince(const Clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+/**
+ * Prints what the buffer pool did between two snapshots.
+ */
+void printBufStatsDelta(const BufStats &before, const BufStats &after)
+{
+	const std::uint64_t accesses = after.accesses - before.accesses;
+	const std::uint64_t hits = after.hits - before.hits;
+	printf("  buffer: accesses=%llu hits=%llu misses=%llu hitRatio=%.4f diskreads=%llu diskwrites=%llu "
+		   "evictions=%llu dirtyEvictions=%llu pinWaits=%llu\n",
+		   (unsigned long long)accesses, (unsigned long long)hits,
+		   (unsigned long long)(after.misses - before.misses),
+		   accesses == 0 ? 0.0 : (double)hits / accesses,
+		   (unsigned long long)(after.diskreads - before.diskreads),
+		   (unsigned long long)(after.diskwrites - before.diskwrites),
+		   (unsigned long long)(after.evictions - before.evictions),
+		   (unsigned long long)(after.dirtyEvictions - before.dirtyEvictions),
+		   (unsigned long long)(after.pinWaits - before.pinWaits));
+}
+
+/**
+ * Prints the percentiles of a histogram of nanoseconds. Each is the upper bound of its power-of-two bucket.
+ */
+void printLatency(const Histogram &latency, const double seconds)
+{
+	const std::uint64_t count = latency.count();
+	printf("  ops=%llu total=%.3fs ops/s=%.0f latency(ns) p50<=%llu p90<=%llu p99<=%llu p99.9<=%llu max<=%llu\n",
+		   (unsigned long long)count, seconds, seconds > 0 ? count / seconds : 0.0,
+		   (unsigned long long)latency.percentile(0.50), (unsigned long long)latency.percentile(0.90),
+		   (unsigned long long)latency.percentile(0.99), (unsigned long long)latency.percentile(0.999),
+		   (unsigned long long)latency.percentile(1.0));
+}
+
+void printTreeStats(const BTreeStats &stats)
+{
+	printf("  tree: height=%d leafPages=%llu nonLeafPages=%llu entries=%llu leafFill=%.3f nonLeafFill=%.3f "
+		   "leafSplits=%llu nonLeafSplits=%llu insertNodeVisits=%llu insertRetries=%llu\n",
+		   stats.height, (unsigned long long)stats.leafPages, (unsigned long long)stats.nonLeafPages,
+		   (unsigned long long)stats.entries, stats.leafFill, stats.nonLeafFill,
+		   (unsigned long long)stats.leafSplits, (unsigned long long)stats.nonLeafSplits,
+		   (unsigned long long)stats.insertNodeVisits, (unsigned long long)stats.insertRetries);
+}
+
+// -----------------------------------------------------------------------------
+// Phases
+// -----------------------------------------------------------------------------
+
+/**
+ * Builds the index, by bulk loading or by inserting every tuple, and reports how long it took.
+ */
+BTreeIndex *buildIndex(BufMgr *bufMgr, const bool bulkLoad, std::string &indexName)
+{
+	BTreeOptions options;
+	options.bulkLoad = bulkLoad;
+	const BufStats before = bufMgr->getBufStats();
+	const Clock::time_point start = Clock::now();
+	BTreeIndex *index = new BTreeIndex(relationName, indexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+	const double seconds = secondsSince(start);
+	const BTreeStats stats = index->getStats();
+
+	printf("%s: %.3fs", bulkLoad ? "bulk load" : "insert build", seconds);
+	if (!bulkLoad)
+		printf(" inserts/s=%.0f", seconds > 0 ? stats.inserts / seconds : 0.0);
+	printf("\n");
+	printTreeStats(stats);
+	printBufStatsDelta(before, bufMgr->getBufStats());
+	return index;
+}
+
+/**
+ * Looks up single keys with BTreeIndex::lookup(), drawn like the keys of the relation.
+ */
+void pointLookups(BufMgr *bufMgr, BTreeIndex *index, const BenchOptions &options, const std::vector<int> &keys,
+				  std::mt19937_64 &rng)
+{
+	Histogram latency;
+	std::uniform_int_distribution<std::size_t> pick(0, keys.size() - 1);
+	const std::size_t maxMatches = 64;
+	std::vector<RecordId> rids(maxMatches);
+	std::uint64_t found = 0;
+	const BufStats before = bufMgr->getBufStats();
+	const Clock::time_point start = Clock::now();
+	for (int i = 0; i < options.lookups; i++)
+	{
+		const int key = keys[pick(rng)];
+		const Clock::time_point opStart = Clock::now();
+		found += index->lookup(&key, &rids[0], maxMatches);
+		latency.buckets[Histogram::bucketOf(nanosSince(opStart))]++;
+	}
+	const double seconds = secondsSince(start);
+
+	printf("point lookups: found=%llu\n", (unsigned long long)found);
+	printLatency(latency, seconds);
+	printBufStatsDelta(before, bufMgr->getBufStats());
+}
+
+/**
+ * Scans ranges of scanWidth keys starting at uniformly drawn points of the key space.
+ */
+void rangeScans(BufMgr *bufMgr, BTreeIndex *index, const BenchOptions &options, const std::vector<int> &keys,
+				std::mt19937_64 &rng)
+{
+	const int minKey = *std::min_element(keys.begin(), keys.end());
+	const int maxKey = *std::max_element(keys.begin(), keys.end());
+	// the same expected number of tuples per range whether the keys are dense or sparse
+	const double keysPerTuple = (double(maxKey) - minKey + 1) / keys.size();
+	const int span = std::max(1, static_cast<int>(options.scanWidth * keysPerTuple));
+	std::uniform_int_distribution<int> pick(minKey, maxKey);
+	Histogram latency;
+	std::uint64_t found = 0;
+	const std::size_t batchSize = 256;
+	std::vector<RecordId> rids(batchSize);
+	const BufStats before = bufMgr->getBufStats();
+	const Clock::time_point start = Clock::now();
+	for (int i = 0; i < options.scans; i++)
+	{
+		const int low = pick(rng);
+		const int high = low > maxKey - span ? maxKey : low + span - 1;
+		const Clock::time_point opStart = Clock::now();
+		try
+		{
+			index->startScan(&low, GTE, &high, LTE);
+			while (1)
+				found += index->scanNextBatch(&rids[0], batchSize);
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+			index->endScan();
+		}
+		catch (const NoSuchKeyFoundException &e)
+		{
+		}
+		latency.buckets[Histogram::bucketOf(nanosSince(opStart))]++;
+	}
+	const double seconds = secondsSince(start);
+
+	printf("range scans: width=%d found=%llu\n", options.scanWidth, (unsigned long long)found);
+	printLatency(latency, seconds);
+	printBufStatsDelta(before, bufMgr->getBufStats());
+}
+
+/**
+ * Fetches the tuples of the entries of a range, in page order through fetch, or in key order with a page read per
+ * entry if fetch is NULL. Returns the number of tuples fetched.
+ */
+std::uint64_t fetchRange(BufMgr *bufMgr, PageFile *file, HeapFetch *fetch, BTreeIndex *index, const int low,
+						 const int high)
+{
+	IndexScanCursor cursor(index);
+	try
+	{
+		cursor.startScan(&low, GTE, &high, LTE);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		return 0;
+	}
+
+	std::uint64_t found = 0;
+	std::uint64_t checksum = 0;
+	if (fetch != NULL)
+	{
+		fetch->clear();
+		fetch->addScan(cursor);
+		try
+		{
+			RecordId rid;
+			while (1)
+			{
+				fetch->fetchNext(rid);
+				checksum += fetch->viewRecord().data[0];
+				found++;
+			}
+		}
+		catch (const EndOfFileException &e)
+		{
+		}
+	}
+	else
+	{
+		const std::size_t batchSize = 256;
+		std::vector<RecordId> rids(batchSize);
+		try
+		{
+			while (1)
+			{
+				const std::size_t count = cursor.scanNextBatch(&rids[0], batchSize);
+				for (std::size_t i = 0; i < count; i++)
+				{
+					Page *page;
+					bufMgr->readPage(file, rids[i].page_number, page);
+					checksum += page->viewRecord(rids[i]).data[0];
+					bufMgr->unPinPage(file, rids[i].page_number, false);
+				}
+				found += count;
+			}
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+			cursor.endScan();
+		}
+	}
+	// keeps the record reads from being optimized away
+	return found + (checksum & 0);
+}
+
+/**
+ * Scans ranges of 10 * scanWidth tuples and fetches the tuples of every entry, once in key order and once in page
+ * order through a HeapFetch, over the same ranges.
+ */
+void heapFetches(BufMgr *bufMgr, BTreeIndex *index, const BenchOptions &options, const std::vector<int> &keys,
+				 std::mt19937_64 &rng)
+{
+	const int minKey = *std::min_element(keys.begin(), keys.end());
+	const int maxKey = *std::max_element(keys.begin(), keys.end());
+	const double keysPerTuple = (double(maxKey) - minKey + 1) / keys.size();
+	const int span = std::max(1, static_cast<int>(10 * options.scanWidth * keysPerTuple));
+	std::uniform_int_distribution<int> pick(minKey, maxKey);
+	std::vector<int> lows(options.fetches);
+	for (int i = 0; i < options.fetches; i++)
+		lows[i] = pick(rng);
+
+	for (int byPage = 0; byPage < 2; byPage++)
+	{
+		// every pass reads the heap through a file of its own, so it starts with none of its pages in the pool
+		PageFile file(relationName, false);
+		HeapFetch fetch(relationName, bufMgr);
+		Histogram latency;
+		std::uint64_t found = 0;
+		const BufStats before = bufMgr->getBufStats();
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < options.fetches; i++)
+		{
+			const int high = lows[i] > maxKey - span ? maxKey : lows[i] + span - 1;
+			const Clock::time_point opStart = Clock::now();
+			found += fetchRange(bufMgr, &file, byPage ? &fetch : NULL, index, lows[i], high);
+			latency.buckets[Histogram::bucketOf(nanosSince(opStart))]++;
+		}
+		const double seconds = secondsSince(start);
+
+		printf("%s fetches: width=%d found=%llu\n", byPage ? "page-order" : "key-order", 10 * options.scanWidth,
+			   (unsigned long long)found);
+		printLatency(latency, seconds);
+		printBufStatsDelta(before, bufMgr->getBufStats());
+		bufMgr->flushFile(&file);
+	}
+}
+
+void runIndex(const BenchOptions &options, const std::vector<int> &keys, const bool bulkLoad, std::mt19937_64 &rng)
+{
+	// a fresh pool for every build, so one run does not warm the next
+	BufMgr *bufMgr = new BufMgr(options.frames);
+	std::string indexName;
+	BTreeIndex *index = buildIndex(bufMgr, bulkLoad, indexName);
+	pointLookups(bufMgr, index, options, keys, rng);
+	rangeScans(bufMgr, index, options, keys, rng);
+	if (options.fetches > 0)
+		heapFetches(bufMgr, index, options, keys, rng);
+	delete index;
+	delete bufMgr;
+	removeFile(indexName);
+}
+
+void usage(const char *program)
+{
+	std::cerr << "Usage: " << program
+			  << " [-n tuples] [-d forward|backward|random|sparse|zipf] [-z theta] [-b frames]"
+				 " [-m bulk|insert|both] [-l lookups] [-s scans] [-w width] [-f fetches] [-r seed]"
+			  << std::endl;
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	BenchOptions options;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:d:z:b:m:l:s:w:f:r:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			options.tuples = atoi(optarg);
+			break;
+		case 'd':
+			options.distribution = optarg;
+			break;
+		case 'z':
+			options.zipfTheta = atof(optarg);
+			break;
+		case 'b':
+			options.frames = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			options.buildMode = optarg;
+			break;
+		case 'l':
+			options.lookups = atoi(optarg);
+			break;
+		case 's':
+			options.scans = atoi(optarg);
+			break;
+		case 'w':
+			options.scanWidth = atoi(optarg);
+			break;
+		case 'f':
+			options.fetches = atoi(optarg);
+			break;
+		case 'r':
+			options.seed = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (options.tuples <= 0 || options.frames == 0 || options.scanWidth <= 0 ||
+		(options.buildMode != "bulk" && options.buildMode != "insert" && options.buildMode != "both") ||
+		(options.distribution == "zipf" && (options.zipfTheta <= 0 || options.zipfTheta >= 1.0)))
+		usage(argv[0]);
+
+	std::mt19937_64 rng(options.seed);
+	printf("tuples=%d distribution=%s frames=%u build=%s lookups=%d scans=%d width=%d fetches=%d page=%u\n",
+		   options.tuples, options.distribution.c_str(), options.frames, options.buildMode.c_str(), options.lookups,
+		   options.scans, options.scanWidth, options.fetches, (unsigned)Page::SIZE);
+
+	const Clock::time_point start = Clock::now();
+	std::vector<int> keys;
+	if (!generateKeys(options.distribution, options.tuples, options.zipfTheta, rng, keys))
+	{
+		std::cerr << "Unknown key distribution " << options.distribution << std::endl;
+		exit(1);
+	}
+	createRelation(keys);
+	printf("relation: %.3fs\n", secondsSince(start));
+
+	if (options.buildMode != "insert")
+		runIndex(options, keys, true, rng);
+	if (options.buildMode != "bulk")
+		runIndex(options, keys, false, rng);
+
+	removeFile(relationName);
+	return 0;
+}
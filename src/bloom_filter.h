@@ -0,0 +1,268 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace badgerdb
+{
+
+  /**
+   * @brief Default number of filter bits per key of a BloomFilter, which gives about 1% false positives.
+   */
+  const int BLOOM_BITS_PER_KEY = 10;
+
+  /**
+   * @brief Blocked Bloom filter over keys given as byte strings. mayContain() is false only for keys that were
+   * never added; a key that was not added is reported present with a probability that shrinks as the bits per
+   * key grow.
+   *
+   * The filter is an array of cache-line-sized blocks. A key hashes to one block and sets 8 bits in it, one in
+   * each of 8 pairs of 32-bit words, so a probe reads a single cache line. With AVX2 (e.g. make
+   * ARCH_FLAGS=-mavx2) the 8 bits are computed and tested with a few vector instructions; otherwise a loop does
+   * the same. add() sets the bits atomically, so keys may be added while other threads add and probe.
+   *
+   * Equal keys must be handed over as equal bytes, so keys with several encodings of one value (-0.0 and 0.0) are
+   * to be brought to one of them first.
+   */
+  class BloomFilter
+  {
+  public:
+    /**
+     * Size of a block in bytes, one cache line.
+     */
+    static const std::size_t BLOCK_SIZE = 64;
+
+    /**
+     * Constructs an empty filter that reports every key present.
+     */
+    BloomFilter() : words(NULL), numBlocks(0)
+    {
+    }
+
+    /**
+     * Constructs a filter sized for the given number of keys.
+     *
+     * @param expectedKeys  Number of keys that will be added.
+     * @param bitsPerKey    Number of bits of the filter per key.
+     */
+    BloomFilter(const std::size_t expectedKeys, const int bitsPerKey) : words(NULL), numBlocks(0)
+    {
+      allocate(std::max<std::size_t>(1, (expectedKeys * bitsPerKey + BLOCK_SIZE * 8 - 1) / (BLOCK_SIZE * 8)));
+    }
+
+    BloomFilter(const BloomFilter &other) : words(NULL), numBlocks(0)
+    {
+      allocate(other.numBlocks);
+      if (numBlocks > 0)
+      {
+        memcpy(words, other.words, numBlocks * BLOCK_SIZE);
+      }
+    }
+
+    BloomFilter &operator=(const BloomFilter &other)
+    {
+      if (this != &other)
+      {
+        BloomFilter copy(other);
+        std::swap(words, copy.words);
+        std::swap(numBlocks, copy.numBlocks);
+      }
+      return *this;
+    }
+
+    ~BloomFilter()
+    {
+      free(words);
+    }
+
+    /**
+     * Returns a filter of the given number of blocks with no key in it, e.g. to read a saved filter into.
+     */
+    static BloomFilter withBlocks(const std::size_t blocks)
+    {
+      BloomFilter filter;
+      filter.allocate(blocks);
+      return filter;
+    }
+
+    /**
+     * Returns the 64-bit hash of a key that addHash() and mayContainHash() take.
+     */
+    static std::uint64_t hash(const void *key, const std::size_t size)
+    {
+      // FNV-1a, with the bits mixed so that the high half is as good as the low one
+      const unsigned char *bytes = (const unsigned char *)key;
+      std::uint64_t h = 14695981039346656037ULL;
+      for (std::size_t i = 0; i < size; i++)
+      {
+        h = (h ^ bytes[i]) * 1099511628211ULL;
+      }
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      return h;
+    }
+
+    /**
+     * Add a key to the filter.
+     */
+    void add(const void *key, const std::size_t size)
+    {
+      addHash(hash(key, size));
+    }
+
+    /**
+     * Add the key with the given hash to the filter.
+     */
+    void addHash(const std::uint64_t h)
+    {
+      if (numBlocks == 0)
+      {
+        return;
+      }
+      std::uint32_t *block = words + blockOf(h) * WORDS_PER_BLOCK;
+      const std::uint32_t key = (std::uint32_t)h;
+      for (int i = 0; i < 8; i++)
+      {
+        const std::uint32_t v = key * salt(i);
+        __atomic_fetch_or(&block[wordOf(v, i)], 1u << (v >> 27), __ATOMIC_RELAXED);
+      }
+    }
+
+    /**
+     * Returns false if the key was certainly never added, true if it may have been.
+     */
+    bool mayContain(const void *key, const std::size_t size) const
+    {
+      return mayContainHash(hash(key, size));
+    }
+
+    /**
+     * Returns false if the key with the given hash was certainly never added, true if it may have been.
+     */
+    bool mayContainHash(const std::uint64_t h) const
+    {
+      if (numBlocks == 0)
+      {
+        return true;
+      }
+      const std::uint32_t *block = words + blockOf(h) * WORDS_PER_BLOCK;
+      const std::uint32_t key = (std::uint32_t)h;
+#if defined(__AVX2__)
+      // word i of the low half of the block or word i of the high half, as bit 26 of the product says
+      const __m256i v = _mm256_mullo_epi32(_mm256_set1_epi32(key),
+                                           _mm256_setr_epi32(salt(0), salt(1), salt(2), salt(3),
+                                                             salt(4), salt(5), salt(6), salt(7)));
+      const __m256i bits = _mm256_sllv_epi32(_mm256_set1_epi32(1), _mm256_srli_epi32(v, 27));
+      const __m256i high = _mm256_sub_epi32(_mm256_setzero_si256(),
+                                            _mm256_and_si256(_mm256_srli_epi32(v, 26), _mm256_set1_epi32(1)));
+      const __m256i lowHalf = _mm256_load_si256((const __m256i *)block);
+      const __m256i highHalf = _mm256_load_si256((const __m256i *)(block + 8));
+      return _mm256_testc_si256(lowHalf, _mm256_andnot_si256(high, bits)) &&
+             _mm256_testc_si256(highHalf, _mm256_and_si256(high, bits));
+#else
+      for (int i = 0; i < 8; i++)
+      {
+        const std::uint32_t v = key * salt(i);
+        if ((block[wordOf(v, i)] & (1u << (v >> 27))) == 0)
+        {
+          return false;
+        }
+      }
+      return true;
+#endif
+    }
+
+    /**
+     * Returns the number of blocks, 0 for a filter that reports every key present.
+     */
+    std::size_t blocks() const
+    {
+      return numBlocks;
+    }
+
+    /**
+     * Returns the blocks, blocks() * BLOCK_SIZE bytes, e.g. to save them.
+     */
+    const char *data() const
+    {
+      return (const char *)words;
+    }
+
+    /**
+     * Returns the blocks, e.g. to read a saved filter into.
+     */
+    char *data()
+    {
+      return (char *)words;
+    }
+
+  private:
+    static const std::size_t WORDS_PER_BLOCK = BLOCK_SIZE / sizeof(std::uint32_t);
+
+    /**
+     * Returns the i-th of the odd multipliers that spread a key over the 8 words it sets a bit in, those of the
+     * split block Bloom filters of Impala and Parquet.
+     */
+    static std::uint32_t salt(const int i)
+    {
+      static const std::uint32_t SALTS[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                             0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+      return SALTS[i];
+    }
+
+    /**
+     * Allocate the given number of zeroed blocks, aligned to a cache line.
+     */
+    void allocate(const std::size_t blocks)
+    {
+      if (blocks == 0)
+      {
+        return;
+      }
+      void *memory;
+      if (posix_memalign(&memory, BLOCK_SIZE, blocks * BLOCK_SIZE) != 0)
+      {
+        throw std::bad_alloc();
+      }
+      memset(memory, 0, blocks * BLOCK_SIZE);
+      words = (std::uint32_t *)memory;
+      numBlocks = blocks;
+    }
+
+    /**
+     * Returns the block the key with the given hash maps to, from the high half of the hash.
+     */
+    std::size_t blockOf(const std::uint64_t h) const
+    {
+      return (std::size_t)(((h >> 32) * numBlocks) >> 32);
+    }
+
+    /**
+     * Returns the word of the block that the i-th bit of a key goes to: word i of the low or of the high half.
+     */
+    static int wordOf(const std::uint32_t v, const int i)
+    {
+      return i + 8 * ((v >> 26) & 1);
+    }
+
+    std::uint32_t *words;
+    std::size_t numBlocks;
+  };
+
+}
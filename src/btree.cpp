@@ -6,7 +6,11 @@
  */
 
 #include "btree.h"
+#include <algorithm>
+#include <queue>
+#include <thread>
 #include "filescan.h"
+#include "trace.h"
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
@@ -15,752 +19,5101 @@
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/read_only_file_exception.h"
 
 //#define DEBUG
 
 namespace badgerdb
 {
 
+	// -----------------------------------------------------------------------------
+	// Leaf node access
+	// -----------------------------------------------------------------------------
+	// Leaves are LeafNode<T>, with a posting list per distinct key, for DOUBLE and COMPOSITE keys,
+	// LeafNodePacked, with keys and page numbers packed by frame of reference, for INTEGER keys and prefix
+	// compressed LeafNodeString for STRING keys.
+	// The BTreeIndex templates only go through the functions below to read and change leaf entries.
+
+	/**
+	 * Entries of one or two leaves decoded to split, merge or rebalance them, with the bytes each prefix of them
+	 * takes.
+	 */
+	template <class T>
+	struct LeafScratch
+	{
+		std::vector<RIDKeyPair<T> > pairs;
+		std::vector<char> payloads;
+		std::vector<int> bytes;
+	};
+
+	/**
+	 * Returns the emptied scratch entries of the calling thread. They keep their memory from one use to the next,
+	 * so the splits of a thread only allocate while the leaves it decodes still grow.
+	 */
+	template <class T>
+	static LeafScratch<T> &leafScratch()
+	{
+		static thread_local LeafScratch<T> scratch;
+		scratch.pairs.clear();
+		scratch.payloads.clear();
+		scratch.bytes.clear();
+		return scratch;
+	}
+
+	/**
+	 * Orders record ids by page, then by slot.
+	 */
+	static bool ridLess(const RecordId &a, const RecordId &b)
+	{
+		return a.page_number < b.page_number || (a.page_number == b.page_number && a.slot_number < b.slot_number);
+	}
+
+	template <class T>
+	static T *postingKeys(LeafNode<T> *node)
+	{
+		return (T *)node->data;
+	}
+
+	template <class T>
+	static const T *postingKeys(const LeafNode<T> *node)
+	{
+		return (const T *)node->data;
+	}
+
+	template <class T>
+	static std::uint16_t *postingStarts(LeafNode<T> *node)
+	{
+		return (std::uint16_t *)(node->data + node->numLists * sizeof(T));
+	}
+
+	template <class T>
+	static const std::uint16_t *postingStarts(const LeafNode<T> *node)
+	{
+		return (const std::uint16_t *)(node->data + node->numLists * sizeof(T));
+	}
+
+	/**
+	 * Packed rid and payload of entry i, i from -1 (the end of data) to numKeys.
+	 */
+	template <class T>
+	static char *postingRid(LeafNode<T> *node, const int i)
+	{
+		return node->data + NodeCapacity<T>::LEAF_DATA - (i + 1) * (LEAFRIDSIZE + node->payloadSize);
+	}
+
+	template <class T>
+	static const char *postingRid(const LeafNode<T> *node, const int i)
+	{
+		return node->data + NodeCapacity<T>::LEAF_DATA - (i + 1) * (LEAFRIDSIZE + node->payloadSize);
+	}
+
+	/**
+	 * Bytes of data taken by the given numbers of lists and entries.
+	 */
+	template <class T>
+	static int postingBytes(const int numLists, const int numKeys, const int payloadSize)
+	{
+		return numLists * (sizeof(T) + sizeof(std::uint16_t)) + numKeys * (LEAFRIDSIZE + payloadSize);
+	}
+
+	/**
+	 * Returns the list entry i belongs to.
+	 */
+	template <class T>
+	static int postingListOf(const LeafNode<T> *node, const int i)
+	{
+		// 0 for positions a torn read put before the first list
+		return std::max(0, keyUpperBound(postingStarts(node), node->numLists, (std::uint16_t)i) - 1);
+	}
+
+	template <class T>
+	static void leafInit(LeafNode<T> *node, const int payloadSize)
+	{
+		node->numKeys = 0;
+		node->numLists = 0;
+		node->payloadSize = payloadSize;
+		node->rightSibPageNo = Page::INVALID_NUMBER;
+	}
+
+	template <class T>
+	static int leafLowerBound(const LeafNode<T> *node, const T &key)
+	{
+		const int list = keyLowerBound(postingKeys(node), node->numLists, key);
+		return list < node->numLists ? postingStarts(node)[list] : node->numKeys;
+	}
+
+	template <class T>
+	static int leafUpperBound(const LeafNode<T> *node, const T &key)
+	{
+		const int list = keyUpperBound(postingKeys(node), node->numLists, key);
+		return list < node->numLists ? postingStarts(node)[list] : node->numKeys;
+	}
+
+	template <class T>
+	static T leafKey(const LeafNode<T> *node, const int i)
+	{
+		return postingKeys(node)[postingListOf(node, i)];
+	}
+
+	template <class T>
+	static RecordId leafRid(const LeafNode<T> *node, const int i)
+	{
+		RecordId rid;
+		const char *packed = postingRid(node, i);
+		memcpy(&rid.page_number, packed, sizeof(PageId));
+		memcpy(&rid.slot_number, packed + sizeof(PageId), sizeof(SlotId));
+		rid.padding = 0;
+		return rid;
+	}
+
+	template <class T>
+	static const char *leafPayload(const LeafNode<T> *node, const int i)
+	{
+		return postingRid(node, i) + LEAFRIDSIZE;
+	}
+
+	/**
+	 * Returns where the pair goes: into the posting list of its key before the first entry with a greater rid, so
+	 * that lists stay sorted by page and slot, or where a new list for the key starts.
+	 */
+	template <class T>
+	static int leafInsertPosition(const LeafNode<T> *node, const RIDKeyPair<T> &pair)
+	{
+		int low = leafLowerBound(node, pair.key);
+		int high = leafUpperBound(node, pair.key);
+		while (low < high)
+		{
+			const int mid = low + (high - low) / 2;
+			if (ridLess(pair.rid, leafRid(node, mid)))
+			{
+				high = mid;
+			}
+			else
+			{
+				low = mid + 1;
+			}
+		}
+		return low;
+	}
+
+	/**
+	 * Insert the pair and its payload at the given position, shifting later entries right. Returns false if the
+	 * leaf is full.
+	 */
+	template <class T>
+	static bool leafInsert(LeafNode<T> *node, const int pos, const RIDKeyPair<T> &pair, const char *payload)
+	{
+		// the entry joins the list of an equal key next to it, or starts a new list at pos
+		int list;
+		bool newList = false;
+		if (pos > 0 && leafKey(node, pos - 1) == pair.key)
+		{
+			list = postingListOf(node, pos - 1);
+		}
+		else if (pos < node->numKeys && leafKey(node, pos) == pair.key)
+		{
+			list = postingListOf(node, pos);
+		}
+		else
+		{
+			list = (pos == node->numKeys) ? node->numLists : postingListOf(node, pos);
+			newList = true;
+		}
+		if (postingBytes<T>(node->numLists + newList, node->numKeys + 1, node->payloadSize) > NodeCapacity<T>::LEAF_DATA)
+		{
+			return false;
+		}
+
+		if (newList)
+		{
+			// the list positions move up by one key to make room for it, the ones from list on by one more
+			const int numLists = node->numLists;
+			char *oldStarts = (char *)postingStarts(node);
+			char *newStarts = oldStarts + sizeof(T);
+			memmove(newStarts + (list + 1) * sizeof(std::uint16_t), oldStarts + list * sizeof(std::uint16_t),
+					(numLists - list) * sizeof(std::uint16_t));
+			memmove(newStarts, oldStarts, list * sizeof(std::uint16_t));
+			T *keys = postingKeys(node);
+			memmove(keys + list + 1, keys + list, (numLists - list) * sizeof(T));
+			keys[list] = pair.key;
+			node->numLists++;
+			postingStarts(node)[list] = pos;
+		}
+		std::uint16_t *starts = postingStarts(node);
+		for (int i = list + 1; i < node->numLists; i++)
+		{
+			starts[i]++;
+		}
+
+		// the rids from pos on move one place towards the middle
+		const int stride = LEAFRIDSIZE + node->payloadSize;
+		memmove(postingRid(node, node->numKeys), postingRid(node, node->numKeys - 1), (node->numKeys - pos) * stride);
+		char *packed = postingRid(node, pos);
+		memcpy(packed, &pair.rid.page_number, sizeof(PageId));
+		memcpy(packed + sizeof(PageId), &pair.rid.slot_number, sizeof(SlotId));
+		if (node->payloadSize > 0)
+		{
+			memcpy(packed + LEAFRIDSIZE, payload, node->payloadSize);
+		}
+		node->numKeys++;
+		return true;
+	}
+
+	/**
+	 * Append the pair, not smaller than any key of the leaf, unless the leaf is already filled to fillFactor.
+	 * An empty leaf always takes the pair.
+	 */
+	template <class T>
+	static bool leafAppend(LeafNode<T> *node, const RIDKeyPair<T> &pair, const char *payload, const double fillFactor)
+	{
+		if (node->numKeys > 0)
+		{
+			const bool newList = !(leafKey(node, node->numKeys - 1) == pair.key);
+			if (postingBytes<T>(node->numLists + newList, node->numKeys + 1, node->payloadSize) >
+				(int)(NodeCapacity<T>::LEAF_DATA * fillFactor))
+			{
+				return false;
+			}
+		}
+		return leafInsert(node, node->numKeys, pair, payload);
+	}
+
+	/**
+	 * Remove the entry at the given position, shifting later entries left.
+	 */
+	template <class T>
+	static void leafRemove(LeafNode<T> *node, const int pos)
+	{
+		const int list = postingListOf(node, pos);
+		std::uint16_t *starts = postingStarts(node);
+		const int listEnd = (list + 1 < node->numLists) ? starts[list + 1] : node->numKeys;
+		const bool emptied = (listEnd - starts[list] == 1);
+
+		memmove(postingRid(node, node->numKeys - 2), postingRid(node, node->numKeys - 1),
+				(node->numKeys - pos - 1) * (LEAFRIDSIZE + node->payloadSize));
+		node->numKeys--;
+
+		int next = list + 1;
+		if (emptied)
+		{
+			// drop the key and position of the list, the positions move down by one key
+			const int numLists = node->numLists;
+			T *keys = postingKeys(node);
+			memmove(keys + list, keys + list + 1, (numLists - list - 1) * sizeof(T));
+			char *oldStarts = (char *)starts;
+			char *newStarts = oldStarts - sizeof(T);
+			memmove(newStarts, oldStarts, list * sizeof(std::uint16_t));
+			memmove(newStarts + list * sizeof(std::uint16_t), oldStarts + (list + 1) * sizeof(std::uint16_t),
+					(numLists - list - 1) * sizeof(std::uint16_t));
+			node->numLists--;
+			starts = postingStarts(node);
+			next = list;
+		}
+		for (int i = next; i < node->numLists; i++)
+		{
+			starts[i]--;
+		}
+	}
+
+	/**
+	 * Append the entries of the leaf to pairs and their payloads to payloads.
+	 */
+	template <class T>
+	static void postingLeafDecode(const LeafNode<T> *node, std::vector<RIDKeyPair<T> > &pairs, std::vector<char> &payloads)
+	{
+		const T *keys = postingKeys(node);
+		const std::uint16_t *starts = postingStarts(node);
+		for (int list = 0; list < node->numLists; list++)
+		{
+			const int end = (list + 1 < node->numLists) ? starts[list + 1] : node->numKeys;
+			for (int i = starts[list]; i < end; i++)
+			{
+				RIDKeyPair<T> pair;
+				pair.set(leafRid(node, i), keys[list]);
+				pairs.push_back(pair);
+				payloads.insert(payloads.end(), leafPayload(node, i), leafPayload(node, i) + node->payloadSize);
+			}
+		}
+	}
+
+	/**
+	 * Returns true if the sorted pairs fit in one leaf with payloads of the given size.
+	 */
+	template <class T>
+	static bool postingLeafFits(const RIDKeyPair<T> *pairs, const int count, const int payloadSize)
+	{
+		int numLists = 0;
+		for (int i = 0; i < count; i++)
+		{
+			if (i == 0 || !(pairs[i].key == pairs[i - 1].key))
+			{
+				numLists++;
+			}
+		}
+		return postingBytes<T>(numLists, count, payloadSize) <= NodeCapacity<T>::LEAF_DATA;
+	}
+
+	/**
+	 * Overwrite the leaf with the sorted pairs and their payloads, which must fit. The sibling pointer is kept.
+	 */
+	template <class T>
+	static void postingLeafEncode(LeafNode<T> *node, const RIDKeyPair<T> *pairs, const char *payloads, const int count)
+	{
+		node->numKeys = 0;
+		node->numLists = 0;
+		for (int i = 0; i < count; i++)
+		{
+			leafInsert(node, i, pairs[i], payloads + i * node->payloadSize);
+		}
+	}
+
+	/**
+	 * Write the sorted pairs, at least two and too many for one leaf, to the leaves left and right, split at the
+	 * middle of their bytes.
+	 */
+	template <class T>
+	static void postingLeafDivide(LeafNode<T> *left, LeafNode<T> *right, LeafScratch<T> &scratch)
+	{
+		// every list adds its key to the half it starts in
+		const std::vector<RIDKeyPair<T> > &pairs = scratch.pairs;
+		const std::vector<char> &payloads = scratch.payloads;
+		const int payloadSize = left->payloadSize;
+		const int total = pairs.size();
+		std::vector<int> &bytes = scratch.bytes;
+		bytes.assign(total + 1, 0);
+		for (int i = 0; i < total; i++)
+		{
+			const bool newList = (i == 0 || !(pairs[i].key == pairs[i - 1].key));
+			bytes[i + 1] = bytes[i] + postingBytes<T>(newList, 1, payloadSize);
+		}
+		int leftCount = 1;
+		while (leftCount < total - 1 && 2 * bytes[leftCount] < bytes[total])
+		{
+			leftCount++;
+		}
+
+		// the halves may not fit if a list is split and its key stored twice; move the split point until they do
+		for (int d = 0; d < total; d++)
+		{
+			const int below = leftCount - d;
+			const int above = leftCount + d;
+			if (below >= 1 && postingLeafFits(&pairs[0], below, payloadSize) &&
+				postingLeafFits(&pairs[below], total - below, payloadSize))
+			{
+				leftCount = below;
+				break;
+			}
+			if (above < total && postingLeafFits(&pairs[0], above, payloadSize) &&
+				postingLeafFits(&pairs[above], total - above, payloadSize))
+			{
+				leftCount = above;
+				break;
+			}
+		}
+
+		const char *leftPayloads = payloads.empty() ? NULL : &payloads[0];
+		postingLeafEncode(left, &pairs[0], leftPayloads, leftCount);
+		postingLeafEncode(right, &pairs[leftCount], leftPayloads + leftCount * payloadSize, total - leftCount);
+	}
+
+	/**
+	 * Split the full leaf left in two halves while inserting the pair and its payload at the given position.
+	 * The upper half moves to the empty leaf right. Sibling pointers are left to the caller.
+	 */
+	template <class T>
+	static void leafSplit(LeafNode<T> *left, LeafNode<T> *right, const int pos, const RIDKeyPair<T> &pair,
+						  const char *payload)
+	{
+		LeafScratch<T> &scratch = leafScratch<T>();
+		std::vector<RIDKeyPair<T> > &pairs = scratch.pairs;
+		std::vector<char> &payloads = scratch.payloads;
+		postingLeafDecode(left, pairs, payloads);
+		pairs.insert(pairs.begin() + pos, pair);
+		payloads.insert(payloads.begin() + pos * left->payloadSize, payload, payload + left->payloadSize);
+		postingLeafDivide(left, right, scratch);
+	}
+
+	/**
+	 * Append the entries of right to its left sibling left, leaving right as it is. Returns false, changing
+	 * nothing, if they do not all fit. Sibling pointers are left to the caller.
+	 */
+	template <class T>
+	static bool leafMerge(LeafNode<T> *left, const LeafNode<T> *right)
+	{
+		LeafScratch<T> &scratch = leafScratch<T>();
+		std::vector<RIDKeyPair<T> > &pairs = scratch.pairs;
+		std::vector<char> &payloads = scratch.payloads;
+		postingLeafDecode(left, pairs, payloads);
+		postingLeafDecode(right, pairs, payloads);
+		if (pairs.empty())
+		{
+			return true;
+		}
+		if (!postingLeafFits(&pairs[0], pairs.size(), left->payloadSize))
+		{
+			return false;
+		}
+		postingLeafEncode(left, &pairs[0], payloads.empty() ? NULL : &payloads[0], pairs.size());
+		return true;
+	}
+
+	/**
+	 * Share the entries of left and its right sibling right, too many for one leaf, evenly between left and the
+	 * empty leaf newRight, leaving right as it is. Sibling pointers are left to the caller.
+	 */
+	template <class T>
+	static void leafRedistribute(LeafNode<T> *left, const LeafNode<T> *right, LeafNode<T> *newRight)
+	{
+		LeafScratch<T> &scratch = leafScratch<T>();
+		std::vector<RIDKeyPair<T> > &pairs = scratch.pairs;
+		std::vector<char> &payloads = scratch.payloads;
+		postingLeafDecode(left, pairs, payloads);
+		postingLeafDecode(right, pairs, payloads);
+		postingLeafDivide(left, newRight, scratch);
+	}
+
+	/**
+	 * Returns true if the header of a leaf read without its latch keeps searches within the node. A torn read
+	 * that fails this is caught by validating the latch.
+	 */
+	template <class T>
+	static bool leafInBounds(const LeafNode<T> *node)
+	{
+		return node->numKeys >= 0 && node->numLists >= 0 && node->numLists <= node->numKeys &&
+			   node->payloadSize >= 0 && node->payloadSize <= MAX_PAYLOAD_SIZE &&
+			   node->numKeys <= NodeCapacity<T>::LEAF_DATA / LEAFRIDSIZE &&
+			   postingBytes<T>(node->numLists, node->numKeys, node->payloadSize) <= NodeCapacity<T>::LEAF_DATA;
+	}
+
+	/**
+	 * Fraction of the room for entries of the leaf in use.
+	 */
+	template <class T>
+	static double leafFill(const LeafNode<T> *node)
+	{
+		return (double)postingBytes<T>(node->numLists, node->numKeys, node->payloadSize) / NodeCapacity<T>::LEAF_DATA;
+	}
+
+	/**
+	 * Bytes taken by one entry of a STRING leaf whose keys share prefixLen bytes.
+	 */
+	static int stringLeafStride(const int prefixLen, const int payloadSize)
+	{
+		return STRINGSIZE - prefixLen + sizeof(RecordId) + payloadSize;
+	}
+
+	static char *stringLeafEntry(LeafNodeString *node, const int i)
+	{
+		return node->entries + i * stringLeafStride(node->prefixLen, node->payloadSize);
+	}
+
+	static const char *stringLeafEntry(const LeafNodeString *node, const int i)
+	{
+		return node->entries + i * stringLeafStride(node->prefixLen, node->payloadSize);
+	}
+
+	/**
+	 * Number of leading bytes, at most len, that a and b have in common.
+	 */
+	static int commonPrefixLen(const char *a, const char *b, const int len)
+	{
+		int i = 0;
+		while (i < len && a[i] == b[i])
+		{
+			i++;
+		}
+		return i;
+	}
+
+	/**
+	 * Returns true if count entries of the sorted pairs fit in one STRING leaf with payloads of the given size.
+	 */
+	static bool stringLeafFits(const RIDKeyPair<StringKey> *pairs, const int count, const int payloadSize)
+	{
+		// the keys are sorted, so the prefix shared by all of them is the one shared by the first and last
+		const int prefixLen = commonPrefixLen(pairs[0].key.data, pairs[count - 1].key.data, STRINGSIZE);
+		return count * stringLeafStride(prefixLen, payloadSize) <= STRINGLEAFDATASIZE;
+	}
+
+	static void stringLeafWrite(LeafNodeString *node, const int i, const RIDKeyPair<StringKey> &pair, const char *payload)
+	{
+		char *entry = stringLeafEntry(node, i);
+		const int suffixLen = STRINGSIZE - node->prefixLen;
+		memcpy(entry, pair.key.data + node->prefixLen, suffixLen);
+		memcpy(entry + suffixLen, &pair.rid, sizeof(RecordId));
+		if (node->payloadSize > 0)
+		{
+			memcpy(entry + suffixLen + sizeof(RecordId), payload, node->payloadSize);
+		}
+	}
+
+	/**
+	 * Rewrite the leaf for a shorter shared prefix, moving the dropped prefix bytes into every entry.
+	 */
+	static void stringLeafShrinkPrefix(LeafNodeString *node, const int newPrefixLen)
+	{
+		const int oldStride = stringLeafStride(node->prefixLen, node->payloadSize);
+		const int newStride = stringLeafStride(newPrefixLen, node->payloadSize);
+		const int moved = node->prefixLen - newPrefixLen;
+		// entries only grow, so rewrite them back to front to never overwrite one not yet read
+		for (int i = node->numKeys - 1; i >= 0; i--)
+		{
+			char entry[STRINGSIZE + sizeof(RecordId) + MAX_PAYLOAD_SIZE];
+			memcpy(entry, node->prefix + newPrefixLen, moved);
+			memcpy(entry + moved, node->entries + i * oldStride, oldStride);
+			memcpy(node->entries + i * newStride, entry, newStride);
+		}
+		node->prefixLen = newPrefixLen;
+	}
+
+	/**
+	 * Fill the leaf with count sorted pairs and their payloads, sharing as long a prefix as they allow.
+	 */
+	static void stringLeafEncode(LeafNodeString *node, const RIDKeyPair<StringKey> *pairs, const char *payloads,
+								 const int count)
+	{
+		node->prefixLen = commonPrefixLen(pairs[0].key.data, pairs[count - 1].key.data, STRINGSIZE);
+		memcpy(node->prefix, pairs[0].key.data, STRINGSIZE);
+		node->numKeys = count;
+		for (int i = 0; i < count; i++)
+		{
+			stringLeafWrite(node, i, pairs[i], payloads + i * node->payloadSize);
+		}
+	}
+
+	static void leafInit(LeafNodeString *node, const int payloadSize)
+	{
+		node->numKeys = 0;
+		node->rightSibPageNo = Page::INVALID_NUMBER;
+		node->prefixLen = 0;
+		node->payloadSize = payloadSize;
+	}
+
+	static int leafLowerBound(const LeafNodeString *node, const StringKey &key)
+	{
+		// compare against the shared prefix once, then binary search on the suffixes alone
+		const int prefixCmp = memcmp(key.data, node->prefix, node->prefixLen);
+		if (node->numKeys == 0 || prefixCmp < 0)
+		{
+			return 0;
+		}
+		if (prefixCmp > 0)
+		{
+			return node->numKeys;
+		}
+		const char *suffix = key.data + node->prefixLen;
+		const int suffixLen = STRINGSIZE - node->prefixLen;
+		int low = 0;
+		int high = node->numKeys;
+		while (low < high)
+		{
+			const int mid = (low + high) / 2;
+			if (memcmp(stringLeafEntry(node, mid), suffix, suffixLen) < 0)
+			{
+				low = mid + 1;
+			}
+			else
+			{
+				high = mid;
+			}
+		}
+		return low;
+	}
+
+	static int leafUpperBound(const LeafNodeString *node, const StringKey &key)
+	{
+		const int prefixCmp = memcmp(key.data, node->prefix, node->prefixLen);
+		if (node->numKeys == 0 || prefixCmp < 0)
+		{
+			return 0;
+		}
+		if (prefixCmp > 0)
+		{
+			return node->numKeys;
+		}
+		const char *suffix = key.data + node->prefixLen;
+		const int suffixLen = STRINGSIZE - node->prefixLen;
+		int low = 0;
+		int high = node->numKeys;
+		while (low < high)
+		{
+			const int mid = (low + high) / 2;
+			if (memcmp(stringLeafEntry(node, mid), suffix, suffixLen) <= 0)
+			{
+				low = mid + 1;
+			}
+			else
+			{
+				high = mid;
+			}
+		}
+		return low;
+	}
+
+	/**
+	 * Returns where the pair goes: after the entries of equal keys, which keep their insertion order.
+	 */
+	static int leafInsertPosition(const LeafNodeString *node, const RIDKeyPair<StringKey> &pair)
+	{
+		return leafUpperBound(node, pair.key);
+	}
+
+	static StringKey leafKey(const LeafNodeString *node, const int i)
+	{
+		StringKey key;
+		memcpy(key.data, node->prefix, node->prefixLen);
+		memcpy(key.data + node->prefixLen, stringLeafEntry(node, i), STRINGSIZE - node->prefixLen);
+		return key;
+	}
+
+	static RecordId leafRid(const LeafNodeString *node, const int i)
+	{
+		RecordId rid;
+		memcpy(&rid, stringLeafEntry(node, i) + STRINGSIZE - node->prefixLen, sizeof(RecordId));
+		return rid;
+	}
+
+	static const char *leafPayload(const LeafNodeString *node, const int i)
+	{
+		return stringLeafEntry(node, i) + STRINGSIZE - node->prefixLen + sizeof(RecordId);
+	}
+
+	static bool leafInsert(LeafNodeString *node, const int pos, const RIDKeyPair<StringKey> &pair, const char *payload)
+	{
+		// a key not sharing the whole prefix shortens it, which makes every entry longer
+		const int prefixLen = (node->numKeys == 0) ? STRINGSIZE : commonPrefixLen(node->prefix, pair.key.data, node->prefixLen);
+		const int stride = stringLeafStride(prefixLen, node->payloadSize);
+		if ((node->numKeys + 1) * stride > STRINGLEAFDATASIZE)
+		{
+			return false;
+		}
+		if (node->numKeys == 0)
+		{
+			memcpy(node->prefix, pair.key.data, STRINGSIZE);
+			node->prefixLen = STRINGSIZE;
+		}
+		else if (prefixLen < node->prefixLen)
+		{
+			stringLeafShrinkPrefix(node, prefixLen);
+		}
+		memmove(node->entries + (pos + 1) * stride, node->entries + pos * stride, (node->numKeys - pos) * stride);
+		stringLeafWrite(node, pos, pair, payload);
+		node->numKeys++;
+		return true;
+	}
+
+	static bool leafAppend(LeafNodeString *node, const RIDKeyPair<StringKey> &pair, const char *payload,
+						   const double fillFactor)
+	{
+		if (node->numKeys > 0)
+		{
+			const int prefixLen = commonPrefixLen(node->prefix, pair.key.data, node->prefixLen);
+			if ((node->numKeys + 1) * stringLeafStride(prefixLen, node->payloadSize) > (int)(STRINGLEAFDATASIZE * fillFactor))
+			{
+				return false;
+			}
+		}
+		return leafInsert(node, node->numKeys, pair, payload);
+	}
+
+	static bool leafInBounds(const LeafNodeString *node)
+	{
+		return node->prefixLen >= 0 && node->prefixLen <= STRINGSIZE && node->numKeys >= 0 &&
+			   node->payloadSize >= 0 && node->payloadSize <= MAX_PAYLOAD_SIZE &&
+			   node->numKeys <= STRINGLEAFDATASIZE / stringLeafStride(node->prefixLen, node->payloadSize);
+	}
+
+	static double leafFill(const LeafNodeString *node)
+	{
+		return (double)(node->numKeys * stringLeafStride(node->prefixLen, node->payloadSize)) / STRINGLEAFDATASIZE;
+	}
+
+	/**
+	 * Append the entries of the leaf to pairs and their payloads to payloads.
+	 */
+	static void stringLeafDecode(const LeafNodeString *node, std::vector<RIDKeyPair<StringKey> > &pairs,
+								 std::vector<char> &payloads)
+	{
+		for (int i = 0; i < node->numKeys; i++)
+		{
+			RIDKeyPair<StringKey> pair;
+			pair.set(leafRid(node, i), leafKey(node, i));
+			pairs.push_back(pair);
+			payloads.insert(payloads.end(), leafPayload(node, i), leafPayload(node, i) + node->payloadSize);
+		}
+	}
+
+	/**
+	 * Write the sorted pairs, at least two and too many for one leaf, to the leaves left and right, split so that
+	 * both halves fit.
+	 */
+	static void stringLeafDivide(LeafNodeString *left, LeafNodeString *right, const LeafScratch<StringKey> &scratch)
+	{
+		const std::vector<RIDKeyPair<StringKey> > &pairs = scratch.pairs;
+		const std::vector<char> &payloads = scratch.payloads;
+		// Split in the middle if both halves fit. The halves can share shorter prefixes than the full
+		// leaf did, so otherwise move the split point toward the ends until they do. For a leaf split,
+		// splitting right before or after the new entry always works, since the old entries fit together
+		// and a new entry that shortens the prefix sorts before or after all of them; for the entries of
+		// two leaves, splitting between them does.
+		const int payloadSize = left->payloadSize;
+		const int total = pairs.size();
+		int leftCount = (total + 1) / 2;
+		for (int d = 0; d < total; d++)
+		{
+			const int below = leftCount - d;
+			const int above = leftCount + d;
+			if (below >= 1 && stringLeafFits(&pairs[0], below, payloadSize) &&
+				stringLeafFits(&pairs[below], total - below, payloadSize))
+			{
+				leftCount = below;
+				break;
+			}
+			if (above < total && stringLeafFits(&pairs[0], above, payloadSize) &&
+				stringLeafFits(&pairs[above], total - above, payloadSize))
+			{
+				leftCount = above;
+				break;
+			}
+		}
+
+		const char *leftPayloads = payloads.empty() ? NULL : &payloads[0];
+		stringLeafEncode(left, &pairs[0], leftPayloads, leftCount);
+		stringLeafEncode(right, &pairs[leftCount], leftPayloads + leftCount * payloadSize, total - leftCount);
+	}
+
+	static void leafSplit(LeafNodeString *left, LeafNodeString *right, const int pos, const RIDKeyPair<StringKey> &pair,
+						  const char *payload)
+	{
+		// decode the numKeys + 1 entries the leaf would hold
+		LeafScratch<StringKey> &scratch = leafScratch<StringKey>();
+		std::vector<RIDKeyPair<StringKey> > &pairs = scratch.pairs;
+		std::vector<char> &payloads = scratch.payloads;
+		stringLeafDecode(left, pairs, payloads);
+		pairs.insert(pairs.begin() + pos, pair);
+		payloads.insert(payloads.begin() + pos * left->payloadSize, payload, payload + left->payloadSize);
+
+		stringLeafDivide(left, right, scratch);
+	}
+
+	static void leafRemove(LeafNodeString *node, const int pos)
+	{
+		// the remaining keys still share the prefix, which is kept as it is
+		const int stride = stringLeafStride(node->prefixLen, node->payloadSize);
+		memmove(node->entries + pos * stride, node->entries + (pos + 1) * stride, (node->numKeys - pos - 1) * stride);
+		node->numKeys--;
+	}
+
+	static bool leafMerge(LeafNodeString *left, const LeafNodeString *right)
+	{
+		LeafScratch<StringKey> &scratch = leafScratch<StringKey>();
+		std::vector<RIDKeyPair<StringKey> > &pairs = scratch.pairs;
+		std::vector<char> &payloads = scratch.payloads;
+		stringLeafDecode(left, pairs, payloads);
+		stringLeafDecode(right, pairs, payloads);
+		if (pairs.empty())
+		{
+			return true;
+		}
+		if (!stringLeafFits(&pairs[0], pairs.size(), left->payloadSize))
+		{
+			return false;
+		}
+		stringLeafEncode(left, &pairs[0], payloads.empty() ? NULL : &payloads[0], pairs.size());
+		return true;
+	}
+
+	static void leafRedistribute(LeafNodeString *left, const LeafNodeString *right, LeafNodeString *newRight)
+	{
+		LeafScratch<StringKey> &scratch = leafScratch<StringKey>();
+		std::vector<RIDKeyPair<StringKey> > &pairs = scratch.pairs;
+		std::vector<char> &payloads = scratch.payloads;
+		stringLeafDecode(left, pairs, payloads);
+		stringLeafDecode(right, pairs, payloads);
+		stringLeafDivide(left, newRight, scratch);
+	}
+
+	/**
+	 * Returns the number of bytes, 1, 2 or 4, that hold distances up to range.
+	 */
+	static int packedWidth(const std::uint32_t range)
+	{
+		return range <= 0xff ? 1 : (range <= 0xffff ? 2 : 4);
+	}
+
+	/**
+	 * Returns the largest distance width bytes hold.
+	 */
+	static std::uint32_t packedMaxDistance(const int width)
+	{
+		return width == 1 ? 0xff : (width == 2 ? 0xffff : 0xffffffff);
+	}
+
+	static std::uint32_t packedRead(const char *src, const int width)
+	{
+		if (width == 1)
+		{
+			return (unsigned char)src[0];
+		}
+		if (width == 2)
+		{
+			std::uint16_t value;
+			memcpy(&value, src, sizeof(value));
+			return value;
+		}
+		std::uint32_t value;
+		memcpy(&value, src, sizeof(value));
+		return value;
+	}
+
+	static void packedWrite(char *dst, const int width, const std::uint32_t value)
+	{
+		if (width == 1)
+		{
+			dst[0] = (char)value;
+		}
+		else if (width == 2)
+		{
+			const std::uint16_t narrow = value;
+			memcpy(dst, &narrow, sizeof(narrow));
+		}
+		else
+		{
+			memcpy(dst, &value, sizeof(value));
+		}
+	}
+
+	/**
+	 * Bytes taken by the row of one entry: page distance, slot number and payload.
+	 */
+	static int packedRowSize(const int pageWidth, const int payloadSize)
+	{
+		return pageWidth + sizeof(SlotId) + payloadSize;
+	}
+
+	/**
+	 * Bytes of data taken by count entries packed with the given widths.
+	 */
+	static int packedBytes(const int count, const int keyWidth, const int pageWidth, const int payloadSize)
+	{
+		return count * (keyWidth + packedRowSize(pageWidth, payloadSize));
+	}
+
+	/**
+	 * Row of entry i, i from -1 (the end of data) to numKeys.
+	 */
+	static char *packedRow(LeafNodePacked *node, const int i)
+	{
+		return node->data + PACKEDLEAFDATASIZE - (i + 1) * packedRowSize(node->pageWidth, node->payloadSize);
+	}
+
+	static const char *packedRow(const LeafNodePacked *node, const int i)
+	{
+		return node->data + PACKEDLEAFDATASIZE - (i + 1) * packedRowSize(node->pageWidth, node->payloadSize);
+	}
+
+	/**
+	 * Returns the distance of key from the base of the leaf, which must not be greater than key.
+	 */
+	static std::uint32_t packedDistance(const LeafNodePacked *node, const int key)
+	{
+		return (std::uint32_t)key - (std::uint32_t)node->keyBase;
+	}
+
+	/**
+	 * Returns the position of the first key distance in the count of width bytes at keys not less than distance.
+	 */
+	static int packedLowerBound(const char *keys, const int width, const int count, const std::uint32_t distance)
+	{
+		if (width == 1)
+		{
+			return keyLowerBound((const std::uint8_t *)keys, count, (std::uint8_t)distance);
+		}
+		if (width == 2)
+		{
+			return keyLowerBound((const std::uint16_t *)keys, count, (std::uint16_t)distance);
+		}
+		return keyLowerBound((const std::uint32_t *)keys, count, distance);
+	}
+
+	/**
+	 * Returns the position of the first key distance in the count of width bytes at keys greater than distance.
+	 */
+	static int packedUpperBound(const char *keys, const int width, const int count, const std::uint32_t distance)
+	{
+		if (width == 1)
+		{
+			return keyUpperBound((const std::uint8_t *)keys, count, (std::uint8_t)distance);
+		}
+		if (width == 2)
+		{
+			return keyUpperBound((const std::uint16_t *)keys, count, (std::uint16_t)distance);
+		}
+		return keyUpperBound((const std::uint32_t *)keys, count, distance);
+	}
+
+	/**
+	 * Write the keys of the count entries starting at entry from to keys, widening the distances with vector
+	 * instructions where the build has them.
+	 */
+	static void packedLeafKeys(const LeafNodePacked *node, const int from, const int count, int *keys)
+	{
+		const int width = node->keyWidth;
+		const char *distances = node->data + from * width;
+		int i = 0;
+#if defined(__AVX2__)
+		const __m256i base = _mm256_set1_epi32(node->keyBase);
+		if (width == 1)
+		{
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256i wide = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(distances + i)));
+				_mm256_storeu_si256((__m256i *)(keys + i), _mm256_add_epi32(base, wide));
+			}
+		}
+		else if (width == 2)
+		{
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(distances + 2 * i)));
+				_mm256_storeu_si256((__m256i *)(keys + i), _mm256_add_epi32(base, wide));
+			}
+		}
+#elif defined(__SSE2__)
+		const __m128i base = _mm_set1_epi32(node->keyBase);
+		const __m128i zero = _mm_setzero_si128();
+		if (width == 1)
+		{
+			for (; i + 4 <= count; i += 4)
+			{
+				int bytes;
+				memcpy(&bytes, distances + i, sizeof(bytes));
+				const __m128i narrow = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+				_mm_storeu_si128((__m128i *)(keys + i), _mm_add_epi32(base, _mm_unpacklo_epi16(narrow, zero)));
+			}
+		}
+		else if (width == 2)
+		{
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i narrow = _mm_loadl_epi64((const __m128i *)(distances + 2 * i));
+				_mm_storeu_si128((__m128i *)(keys + i), _mm_add_epi32(base, _mm_unpacklo_epi16(narrow, zero)));
+			}
+		}
+#endif
+		for (; i < count; i++)
+		{
+			keys[i] = (int)((std::uint32_t)node->keyBase + packedRead(distances + i * width, width));
+		}
+	}
+
+	static void leafInit(LeafNodePacked *node, const int payloadSize)
+	{
+		node->numKeys = 0;
+		node->rightSibPageNo = Page::INVALID_NUMBER;
+		node->payloadSize = payloadSize;
+		node->keyBase = 0;
+		node->pageBase = 0;
+		node->pageTop = 0;
+		node->keyWidth = 1;
+		node->pageWidth = 1;
+		node->unused[0] = node->unused[1] = 0;
+	}
+
+	static int leafLowerBound(const LeafNodePacked *node, const int &key)
+	{
+		if (node->numKeys == 0 || key <= node->keyBase)
+		{
+			return 0;
+		}
+		const std::uint32_t distance = packedDistance(node, key);
+		if (distance > packedMaxDistance(node->keyWidth))
+		{
+			return node->numKeys;
+		}
+		return packedLowerBound(node->data, node->keyWidth, node->numKeys, distance);
+	}
+
+	static int leafUpperBound(const LeafNodePacked *node, const int &key)
+	{
+		if (node->numKeys == 0 || key < node->keyBase)
+		{
+			return 0;
+		}
+		const std::uint32_t distance = packedDistance(node, key);
+		if (distance > packedMaxDistance(node->keyWidth))
+		{
+			return node->numKeys;
+		}
+		return packedUpperBound(node->data, node->keyWidth, node->numKeys, distance);
+	}
+
+	/**
+	 * Returns where the pair goes: after the entries of equal keys, which keep their insertion order.
+	 */
+	static int leafInsertPosition(const LeafNodePacked *node, const RIDKeyPair<int> &pair)
+	{
+		return leafUpperBound(node, pair.key);
+	}
+
+	static int leafKey(const LeafNodePacked *node, const int i)
+	{
+		const int width = node->keyWidth;
+		return (int)((std::uint32_t)node->keyBase + packedRead(node->data + i * width, width));
+	}
+
+	static RecordId leafRid(const LeafNodePacked *node, const int i)
+	{
+		RecordId rid;
+		const char *row = packedRow(node, i);
+		rid.page_number = node->pageBase + packedRead(row, node->pageWidth);
+		memcpy(&rid.slot_number, row + node->pageWidth, sizeof(SlotId));
+		rid.padding = 0;
+		return rid;
+	}
+
+	static const char *leafPayload(const LeafNodePacked *node, const int i)
+	{
+		return packedRow(node, i) + node->pageWidth + sizeof(SlotId);
+	}
+
+	/**
+	 * Append the entries of the leaf to pairs and their payloads to payloads.
+	 */
+	static void packedLeafDecode(const LeafNodePacked *node, std::vector<RIDKeyPair<int> > &pairs, std::vector<char> &payloads)
+	{
+		// the keys are widened a chunk at a time on the stack
+		const int CHUNK = 64;
+		int keys[CHUNK];
+		for (int from = 0; from < node->numKeys; from += CHUNK)
+		{
+			const int count = std::min(CHUNK, node->numKeys - from);
+			packedLeafKeys(node, from, count, keys);
+			for (int i = 0; i < count; i++)
+			{
+				RIDKeyPair<int> pair;
+				pair.set(leafRid(node, from + i), keys[i]);
+				pairs.push_back(pair);
+				payloads.insert(payloads.end(), leafPayload(node, from + i), leafPayload(node, from + i) + node->payloadSize);
+			}
+		}
+	}
+
+	/**
+	 * Bases and widths that pack a set of pairs.
+	 */
+	struct PackedFormat
+	{
+		int keyBase;
+		PageId pageBase;
+		PageId pageTop;
+		int keyWidth;
+		int pageWidth;
+
+		/**
+		 * Sets the format to the narrowest one for count sorted pairs, at least one.
+		 */
+		void fit(const RIDKeyPair<int> *pairs, const int count)
+		{
+			keyBase = pairs[0].key;
+			pageBase = pageTop = pairs[0].rid.page_number;
+			for (int i = 1; i < count; i++)
+			{
+				pageBase = std::min(pageBase, pairs[i].rid.page_number);
+				pageTop = std::max(pageTop, pairs[i].rid.page_number);
+			}
+			keyWidth = packedWidth((std::uint32_t)pairs[count - 1].key - (std::uint32_t)keyBase);
+			pageWidth = packedWidth(pageTop - pageBase);
+		}
+	};
+
+	/**
+	 * Returns true if count sorted pairs fit in one INTEGER leaf with payloads of the given size.
+	 */
+	static bool packedLeafFits(const RIDKeyPair<int> *pairs, const int count, const int payloadSize)
+	{
+		PackedFormat format;
+		format.fit(pairs, count);
+		return packedBytes(count, format.keyWidth, format.pageWidth, payloadSize) <= PACKEDLEAFDATASIZE;
+	}
+
+	/**
+	 * Overwrite the leaf with count sorted pairs, at least one, and their payloads, which must fit, packed as
+	 * narrow as they allow. The sibling pointer is kept.
+	 */
+	static void packedLeafEncode(LeafNodePacked *node, const RIDKeyPair<int> *pairs, const char *payloads, const int count)
+	{
+		PackedFormat format;
+		format.fit(pairs, count);
+		node->keyBase = format.keyBase;
+		node->pageBase = format.pageBase;
+		node->pageTop = format.pageTop;
+		node->keyWidth = format.keyWidth;
+		node->pageWidth = format.pageWidth;
+		node->numKeys = count;
+		for (int i = 0; i < count; i++)
+		{
+			packedWrite(node->data + i * node->keyWidth, node->keyWidth, packedDistance(node, pairs[i].key));
+			char *row = packedRow(node, i);
+			packedWrite(row, node->pageWidth, pairs[i].rid.page_number - node->pageBase);
+			memcpy(row + node->pageWidth, &pairs[i].rid.slot_number, sizeof(SlotId));
+			if (node->payloadSize > 0)
+			{
+				memcpy(row + node->pageWidth + sizeof(SlotId), payloads + i * node->payloadSize, node->payloadSize);
+			}
+		}
+	}
+
+	/**
+	 * Sets format to the bases and widths the leaf needs to take the pair as well as its entries.
+	 */
+	static void packedWiden(const LeafNodePacked *node, const RIDKeyPair<int> &pair, PackedFormat &format)
+	{
+		if (node->numKeys == 0)
+		{
+			format.fit(&pair, 1);
+			return;
+		}
+		const int keyTop = std::max(leafKey(node, node->numKeys - 1), pair.key);
+		format.keyBase = std::min(node->keyBase, pair.key);
+		format.pageBase = std::min(node->pageBase, pair.rid.page_number);
+		format.pageTop = std::max(node->pageTop, pair.rid.page_number);
+		format.keyWidth = std::max<int>(node->keyWidth, packedWidth((std::uint32_t)keyTop - (std::uint32_t)format.keyBase));
+		format.pageWidth = std::max<int>(node->pageWidth, packedWidth(format.pageTop - format.pageBase));
+	}
+
+	static bool leafInsert(LeafNodePacked *node, const int pos, const RIDKeyPair<int> &pair, const char *payload)
+	{
+		PackedFormat format;
+		packedWiden(node, pair, format);
+		if (packedBytes(node->numKeys + 1, format.keyWidth, format.pageWidth, node->payloadSize) > PACKEDLEAFDATASIZE)
+		{
+			return false;
+		}
+		if (node->numKeys > 0 && (format.keyBase != node->keyBase || format.keyWidth != node->keyWidth ||
+								  format.pageBase != node->pageBase || format.pageWidth != node->pageWidth))
+		{
+			// the pair is out of reach of the bases or widths, so the leaf is packed again with it
+			LeafScratch<int> &scratch = leafScratch<int>();
+			std::vector<RIDKeyPair<int> > &pairs = scratch.pairs;
+			std::vector<char> &payloads = scratch.payloads;
+			packedLeafDecode(node, pairs, payloads);
+			pairs.insert(pairs.begin() + pos, pair);
+			payloads.insert(payloads.begin() + pos * node->payloadSize, payload, payload + node->payloadSize);
+			packedLeafEncode(node, &pairs[0], payloads.empty() ? NULL : &payloads[0], pairs.size());
+			return true;
+		}
+		if (node->numKeys == 0)
+		{
+			node->keyBase = format.keyBase;
+			node->pageBase = format.pageBase;
+			node->keyWidth = format.keyWidth;
+			node->pageWidth = format.pageWidth;
+		}
+		node->pageTop = format.pageTop;
+
+		// the key distances from pos on move one place right, the rows one place towards the middle
+		const int keyWidth = node->keyWidth;
+		memmove(node->data + (pos + 1) * keyWidth, node->data + pos * keyWidth, (node->numKeys - pos) * keyWidth);
+		packedWrite(node->data + pos * keyWidth, keyWidth, packedDistance(node, pair.key));
+		const int rowSize = packedRowSize(node->pageWidth, node->payloadSize);
+		memmove(packedRow(node, node->numKeys), packedRow(node, node->numKeys - 1), (node->numKeys - pos) * rowSize);
+		char *row = packedRow(node, pos);
+		packedWrite(row, node->pageWidth, pair.rid.page_number - node->pageBase);
+		memcpy(row + node->pageWidth, &pair.rid.slot_number, sizeof(SlotId));
+		if (node->payloadSize > 0)
+		{
+			memcpy(row + node->pageWidth + sizeof(SlotId), payload, node->payloadSize);
+		}
+		node->numKeys++;
+		return true;
+	}
+
+	static bool leafAppend(LeafNodePacked *node, const RIDKeyPair<int> &pair, const char *payload, const double fillFactor)
+	{
+		if (node->numKeys > 0)
+		{
+			PackedFormat format;
+			packedWiden(node, pair, format);
+			if (packedBytes(node->numKeys + 1, format.keyWidth, format.pageWidth, node->payloadSize) >
+				(int)(PACKEDLEAFDATASIZE * fillFactor))
+			{
+				return false;
+			}
+		}
+		return leafInsert(node, node->numKeys, pair, payload);
+	}
+
+	static void leafRemove(LeafNodePacked *node, const int pos)
+	{
+		// the bases and widths still cover the remaining entries, so they are kept
+		const int keyWidth = node->keyWidth;
+		memmove(node->data + pos * keyWidth, node->data + (pos + 1) * keyWidth, (node->numKeys - pos - 1) * keyWidth);
+		memmove(packedRow(node, node->numKeys - 2), packedRow(node, node->numKeys - 1),
+				(node->numKeys - pos - 1) * packedRowSize(node->pageWidth, node->payloadSize));
+		node->numKeys--;
+	}
+
+	static bool leafInBounds(const LeafNodePacked *node)
+	{
+		return node->numKeys >= 0 && node->payloadSize >= 0 && node->payloadSize <= MAX_PAYLOAD_SIZE &&
+			   (node->keyWidth == 1 || node->keyWidth == 2 || node->keyWidth == 4) &&
+			   (node->pageWidth == 1 || node->pageWidth == 2 || node->pageWidth == 4) &&
+			   node->numKeys <= PACKEDLEAFDATASIZE / (2 + (int)sizeof(SlotId)) &&
+			   packedBytes(node->numKeys, node->keyWidth, node->pageWidth, node->payloadSize) <= PACKEDLEAFDATASIZE;
+	}
+
+	static double leafFill(const LeafNodePacked *node)
+	{
+		return (double)packedBytes(node->numKeys, node->keyWidth, node->pageWidth, node->payloadSize) / PACKEDLEAFDATASIZE;
+	}
+
+	/**
+	 * Write the sorted pairs, at least two and too many for one leaf, to the leaves left and right, split near
+	 * the middle so that both halves fit.
+	 */
+	static void packedLeafDivide(LeafNodePacked *left, LeafNodePacked *right, const LeafScratch<int> &scratch)
+	{
+		const std::vector<RIDKeyPair<int> > &pairs = scratch.pairs;
+		const std::vector<char> &payloads = scratch.payloads;
+		// the halves may pack narrower than the whole, so the middle usually fits; otherwise move the split point
+		// until both halves do, as a split right before or after an entry that widened the leaf always does
+		const int payloadSize = left->payloadSize;
+		const int total = pairs.size();
+		int leftCount = total / 2;
+		for (int d = 0; d < total; d++)
+		{
+			const int below = leftCount - d;
+			const int above = leftCount + d;
+			if (below >= 1 && packedLeafFits(&pairs[0], below, payloadSize) &&
+				packedLeafFits(&pairs[below], total - below, payloadSize))
+			{
+				leftCount = below;
+				break;
+			}
+			if (above < total && packedLeafFits(&pairs[0], above, payloadSize) &&
+				packedLeafFits(&pairs[above], total - above, payloadSize))
+			{
+				leftCount = above;
+				break;
+			}
+		}
+
+		const char *leftPayloads = payloads.empty() ? NULL : &payloads[0];
+		packedLeafEncode(left, &pairs[0], leftPayloads, leftCount);
+		packedLeafEncode(right, &pairs[leftCount], leftPayloads + leftCount * payloadSize, total - leftCount);
+	}
+
+	static void leafSplit(LeafNodePacked *left, LeafNodePacked *right, const int pos, const RIDKeyPair<int> &pair,
+						  const char *payload)
+	{
+		LeafScratch<int> &scratch = leafScratch<int>();
+		std::vector<RIDKeyPair<int> > &pairs = scratch.pairs;
+		std::vector<char> &payloads = scratch.payloads;
+		packedLeafDecode(left, pairs, payloads);
+		pairs.insert(pairs.begin() + pos, pair);
+		payloads.insert(payloads.begin() + pos * left->payloadSize, payload, payload + left->payloadSize);
+		packedLeafDivide(left, right, scratch);
+	}
+
+	static bool leafMerge(LeafNodePacked *left, const LeafNodePacked *right)
+	{
+		LeafScratch<int> &scratch = leafScratch<int>();
+		std::vector<RIDKeyPair<int> > &pairs = scratch.pairs;
+		std::vector<char> &payloads = scratch.payloads;
+		packedLeafDecode(left, pairs, payloads);
+		packedLeafDecode(right, pairs, payloads);
+		if (pairs.empty())
+		{
+			return true;
+		}
+		if (!packedLeafFits(&pairs[0], pairs.size(), left->payloadSize))
+		{
+			return false;
+		}
+		packedLeafEncode(left, &pairs[0], payloads.empty() ? NULL : &payloads[0], pairs.size());
+		return true;
+	}
+
+	static void leafRedistribute(LeafNodePacked *left, const LeafNodePacked *right, LeafNodePacked *newRight)
+	{
+		LeafScratch<int> &scratch = leafScratch<int>();
+		std::vector<RIDKeyPair<int> > &pairs = scratch.pairs;
+		std::vector<char> &payloads = scratch.payloads;
+		packedLeafDecode(left, pairs, payloads);
+		packedLeafDecode(right, pairs, payloads);
+		packedLeafDivide(left, newRight, scratch);
+	}
+
+	// -----------------------------------------------------------------------------
+	// Non-leaf node access
+	// -----------------------------------------------------------------------------
+	// Searches go through blockKeys to the one block of keyArray the key is in. Whatever changes keyArray or
+	// numKeys calls nonLeafSummarize() before letting go of the node.
+
+	/**
+	 * Set blockKeys to the last key of every block of keyArray in use.
+	 */
+	template <class T>
+	static void nonLeafSummarize(NonLeafNode<T> *node)
+	{
+		const int block = NodeCapacity<T>::NONLEAF_BLOCK;
+		const int numKeys = node->numKeys;
+		for (int b = 0; b * block < numKeys; b++)
+		{
+			node->blockKeys[b] = node->keyArray[std::min((b + 1) * block, numKeys) - 1];
+		}
+	}
+
+	/**
+	 * Returns the position of the first key of the node not less than key.
+	 */
+	template <class T>
+	static int nonLeafLowerBound(const NonLeafNode<T> *node, const T &key)
+	{
+		const int block = NodeCapacity<T>::NONLEAF_BLOCK;
+		const int numKeys = node->numKeys;
+		// the first block whose last key is not less than key holds the position, unless no block does
+		const int b = keyLowerBound(node->blockKeys, (numKeys + block - 1) / block, key);
+		const int first = b * block;
+		if (first >= numKeys)
+		{
+			return numKeys;
+		}
+		return first + keyLowerBound(node->keyArray + first, std::min(block, numKeys - first), key);
+	}
+
+	/**
+	 * Returns the position of the first key of the node greater than key.
+	 */
+	template <class T>
+	static int nonLeafUpperBound(const NonLeafNode<T> *node, const T &key)
+	{
+		const int block = NodeCapacity<T>::NONLEAF_BLOCK;
+		const int numKeys = node->numKeys;
+		const int b = keyUpperBound(node->blockKeys, (numKeys + block - 1) / block, key);
+		const int first = b * block;
+		if (first >= numKeys)
+		{
+			return numKeys;
+		}
+		return first + keyUpperBound(node->keyArray + first, std::min(block, numKeys - first), key);
+	}
+
+	/**
+	 * Number of bytes the included attributes take together in every entry.
+	 */
+	static int includedSize(const std::vector<IndexAttribute> &included)
+	{
+		int size = 0;
+		for (std::size_t i = 0; i < included.size(); i++)
+		{
+			size += attributeSize(included[i].attrType);
+		}
+		return size;
+	}
+
+	/**
+	 * Write the attribute at src in size bytes that compare with memcmp the way the values compare: integers
+	 * and doubles go big endian, with the sign bit flipped so negative values sort first, and all bits of
+	 * negative doubles flipped so larger magnitudes sort lower. Strings are compared bytewise already.
+	 *
+	 * @return  Number of bytes written, attributeSize(type).
+	 */
+	static int encodeKeyAttribute(const char *src, const Datatype type, unsigned char *dst)
+	{
+		std::uint64_t bits;
+		int size;
+		if (type == INTEGER)
+		{
+			const int value = loadKey<int>(src);
+			bits = (std::uint32_t)value ^ 0x80000000u;
+			size = sizeof(int);
+		}
+		else if (type == DOUBLE)
+		{
+			// -0.0 equals 0.0, so it must encode the same
+			const double value = loadKey<double>(src) == 0.0 ? 0.0 : loadKey<double>(src);
+			memcpy(&bits, &value, sizeof(double));
+			bits = (bits >> 63) ? ~bits : bits | (1ULL << 63);
+			size = sizeof(double);
+		}
+		else
+		{
+			const StringKey key = loadKey<StringKey>(src);
+			memcpy(dst, key.data, STRINGSIZE);
+			return STRINGSIZE;
+		}
+		for (int i = 0; i < size; i++)
+		{
+			dst[i] = (unsigned char)(bits >> (8 * (size - 1 - i)));
+		}
+		return size;
+	}
+
+	template <class T>
+	T BTreeIndex::keyFrom(const void *key) const
+	{
+		return loadKey<T>(key);
+	}
+
+	template <>
+	CompositeKey BTreeIndex::keyFrom<CompositeKey>(const void *key) const
+	{
+		CompositeKey composite;
+		memset(composite.data, 0, COMPOSITESIZE);
+		unsigned char *dst = (unsigned char *)composite.data;
+		for (std::size_t i = 0; i < keyAttributes.size(); i++)
+		{
+			dst += encodeKeyAttribute((const char *)key + keyAttributes[i].attrByteOffset, keyAttributes[i].attrType, dst);
+		}
+		return composite;
+	}
+
+	/**
+	 * Returns the hash of a key the Bloom filter of an index is probed with.
+	 */
+	template <class T>
+	static std::uint64_t bloomHash(const T &key)
+	{
+		return BloomFilter::hash(&key, sizeof(key));
+	}
+
+	/**
+	 * -0.0 and 0.0 are equal keys, so they hash alike.
+	 */
+	static std::uint64_t bloomHash(const double &key)
+	{
+		const double value = (key == 0.0) ? 0.0 : key;
+		return BloomFilter::hash(&value, sizeof(value));
+	}
+
 	// -----------------------------------------------------------------------------
 	// BTreeIndex::BTreeIndex -- Constructor
 	// -----------------------------------------------------------------------------
 
-	BTreeIndex::BTreeIndex(const std::string &relationName,
-						   std::string &outIndexName,
-						   BufMgr *bufMgrIn,
-						   const int attrByteOffset,
-						   const Datatype attrType)
+	BTreeIndex::BTreeIndex(const std::string &relationName,
+						   std::string &outIndexName,
+						   BufMgr *bufMgrIn,
+						   const int attrByteOffset,
+						   const Datatype attrType,
+						   const BTreeOptions &options)
+		: scanCursor(this)
+	{
+		std::ostringstream idxStr;
+		idxStr << relationName << '.' << attrByteOffset;
+		outIndexName = idxStr.str();
+		open(relationName, outIndexName, bufMgrIn, attrByteOffset, attrType, std::vector<IndexAttribute>(), options, NULL);
+	}
+
+	BTreeIndex::BTreeIndex(const std::string &relationName,
+						   std::string &outIndexName,
+						   BufMgr *bufMgrIn,
+						   const std::vector<IndexAttribute> &keyAttrs,
+						   const BTreeOptions &options)
+		: scanCursor(this)
+	{
+		if (keyAttrs.empty() || keyAttrs.size() > (std::size_t)MAX_KEY_ATTRIBUTES)
+		{
+			throw BadIndexInfoException("A composite key needs 1 to MAX_KEY_ATTRIBUTES attributes");
+		}
+		int keySize = 0;
+		for (std::size_t i = 0; i < keyAttrs.size(); i++)
+		{
+			if (keyAttrs[i].attrType != INTEGER && keyAttrs[i].attrType != DOUBLE && keyAttrs[i].attrType != STRING)
+			{
+				throw BadIndexInfoException("Bad type of a composite key attribute");
+			}
+			keySize += attributeSize(keyAttrs[i].attrType);
+		}
+		if (keySize > COMPOSITESIZE)
+		{
+			throw BadIndexInfoException("Composite key too large");
+		}
+
+		// the attributes sit at their own offsets, so the key is read from the start of the record
+		std::ostringstream idxStr;
+		idxStr << relationName << '.' << keyAttrs[0].attrByteOffset;
+		for (std::size_t i = 1; i < keyAttrs.size(); i++)
+		{
+			idxStr << '_' << keyAttrs[i].attrByteOffset;
+		}
+		outIndexName = idxStr.str();
+		open(relationName, outIndexName, bufMgrIn, 0, COMPOSITE, keyAttrs, options, NULL);
+	}
+
+	BTreeIndex::BTreeIndex(const std::string &relationName,
+						   const std::string &indexName,
+						   BufMgr *bufMgrIn,
+						   const int attrByteOffset,
+						   const Datatype attrType,
+						   SortedEntrySource &source,
+						   const BTreeOptions &options)
+		: scanCursor(this)
+	{
+		if (!options.included.empty())
+		{
+			throw BadIndexInfoException("A sorted source provides no included attributes");
+		}
+		std::string outIndexName = indexName;
+		open(relationName, outIndexName, bufMgrIn, attrByteOffset, attrType, std::vector<IndexAttribute>(), options, &source);
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::open
+	// -----------------------------------------------------------------------------
+
+	void BTreeIndex::open(const std::string &relationName,
+						  std::string &outIndexName,
+						  BufMgr *bufMgrIn,
+						  const int attrByteOffset,
+						  const Datatype attrType,
+						  const std::vector<IndexAttribute> &keyAttrs,
+						  const BTreeOptions &options,
+						  SortedEntrySource *source)
+	{
+		// initialize
+		this->bufMgr = bufMgrIn;
+		this->attrByteOffset = attrByteOffset;
+		this->attributeType = attrType;
+		this->keyAttributes = keyAttrs;
+
+		this->rootPageNum = Page::INVALID_NUMBER;
+		this->headerPageNum = Page::INVALID_NUMBER;
+		this->rootIsLeaf = false;
+		this->pinnedLevels = options.pinnedLevels;
+		this->pinnedPageLimit = options.pinnedPageLimit;
+		this->prefetchDepth = options.prefetchDepth;
+		this->pinnedNodesStale = false;
+		this->mergeThreshold = options.mergeThreshold;
+		this->deltaCapacity = options.deltaBufferSize;
+		this->deltaCount = 0;
+		this->bloomBitsPerKey = 0;
+		this->bloomPageNum = Page::INVALID_NUMBER;
+		std::atomic_store(&bloom, std::shared_ptr<BloomFilter>());
+		bool bloomValid = false;
+		std::uint32_t bloomBlocks = 0;
+
+		if (this->attributeType == INTEGER)
+		{
+			this->nodeOccupancy = INTARRAYNONLEAFSIZE;
+			this->leafOccupancy = INTARRAYLEAFSIZE;
+		}
+		else if (this->attributeType == DOUBLE)
+		{
+			this->nodeOccupancy = DOUBLEARRAYNONLEAFSIZE;
+			this->leafOccupancy = DOUBLEARRAYLEAFSIZE;
+		}
+		else if (this->attributeType == STRING)
+		{
+			this->nodeOccupancy = STRINGARRAYNONLEAFSIZE;
+			this->leafOccupancy = STRINGARRAYLEAFSIZE;
+		}
+		else
+		{
+			this->nodeOccupancy = COMPOSITEARRAYNONLEAFSIZE;
+			this->leafOccupancy = COMPOSITEARRAYLEAFSIZE;
+		}
+
+		// Check to see if the corresponding index file exists. If so, open the file.
+		// If not, create it
+		if (BlobFile::exists(outIndexName) == true)
+		{
+			// File found, so use it
+			file = new BlobFile(outIndexName, false);
+			headerPageNum = file->getFirstPageNo();
+			// get page by pageNum and store in headerPage, which should be a META INFO page; the guard unpins
+			// it, not dirty because we only READ from it
+			PageGuard headerPage(bufMgr, bufMgr->readPage(file, headerPageNum));
+			IndexMetaInfo *metaInfoPage = (IndexMetaInfo *)headerPage.page();
+			rootPageNum = metaInfoPage->rootPageNo;
+			rootIsLeaf = metaInfoPage->isRootALeaf;
+			this->included.assign(metaInfoPage->included, metaInfoPage->included + metaInfoPage->numIncluded);
+			this->payloadSize = includedSize(included);
+			bloomBitsPerKey = metaInfoPage->bloomBitsPerKey;
+			bloomPageNum = metaInfoPage->bloomPageNo;
+			bloomBlocks = metaInfoPage->bloomBlocks;
+			bloomValid = metaInfoPage->bloomValid;
+		}
+		else
+		{
+			// the included attributes are checked before anything is written, so a bad request leaves no file behind
+			if (options.included.size() > (std::size_t)MAX_INCLUDED_ATTRIBUTES)
+			{
+				throw BadIndexInfoException("Too many included attributes");
+			}
+			if (includedSize(options.included) > MAX_PAYLOAD_SIZE)
+			{
+				throw BadIndexInfoException("Included attributes too large");
+			}
+			this->included = options.included;
+			this->payloadSize = includedSize(included);
+			this->bloomBitsPerKey = std::max(0, options.bloomBitsPerKey);
+
+			// File not found, so create it
+			file = new BlobFile(outIndexName, true);
+			if (options.compressPages)
+			{
+				file->setCompression(true);
+			}
+			{
+				PageGuard headerPage(bufMgr, bufMgrIn->allocPage(file, headerPageNum));
+				// insert metadata in header page
+				IndexMetaInfo *metaInfoPage = (IndexMetaInfo *)headerPage.page();
+
+				// copy relationName into the metaInfoPage
+				strcpy(metaInfoPage->relationName, relationName.c_str());
+				metaInfoPage->attrByteOffset = attrByteOffset;
+				metaInfoPage->attrType = attrType;
+				metaInfoPage->rootPageNo = rootPageNum;
+				metaInfoPage->isRootALeaf = rootIsLeaf;
+				metaInfoPage->numIncluded = included.size();
+				std::copy(included.begin(), included.end(), metaInfoPage->included);
+				metaInfoPage->numKeyAttributes = keyAttributes.size();
+				std::copy(keyAttributes.begin(), keyAttributes.end(), metaInfoPage->keyAttributes);
+				metaInfoPage->bloomBitsPerKey = bloomBitsPerKey;
+				metaInfoPage->bloomPageNo = Page::INVALID_NUMBER;
+				metaInfoPage->bloomBlocks = 0;
+				metaInfoPage->bloomValid = false;
+
+				// unpinned dirty because we wrote the meta info to the header page
+				headerPage.markDirty();
+			}
+
+			if (attributeType == INTEGER)
+			{
+				buildIndex<int>(relationName, options, source);
+			}
+			else if (attributeType == DOUBLE)
+			{
+				buildIndex<double>(relationName, options, source);
+			}
+			else if (attributeType == STRING)
+			{
+				buildIndex<StringKey>(relationName, options, source);
+			}
+			else
+			{
+				buildIndex<CompositeKey>(relationName, options, source);
+			}
+
+			// record where the root ended up
+			{
+				PageGuard headerPage(bufMgr, bufMgr->readPage(file, headerPageNum));
+				IndexMetaInfo *metaInfoPage = (IndexMetaInfo *)headerPage.page();
+				metaInfoPage->rootPageNo = rootPageNum;
+				metaInfoPage->isRootALeaf = rootIsLeaf;
+				headerPage.markDirty();
+			}
+
+			// the build is not logged, so it is made durable before logged changes build on it
+			if (bufMgr->getRedoLog() != NULL)
+			{
+				bufMgr->checkpoint();
+			}
+		}
+
+		// a filter that was not saved on a clean close may lack keys, so it is built again from the leaves
+		if (bloomBitsPerKey > 0 && !(bloomValid && loadBloom(bloomBlocks)))
+		{
+			if (attributeType == INTEGER)
+			{
+				buildBloom<int>();
+			}
+			else if (attributeType == DOUBLE)
+			{
+				buildBloom<double>();
+			}
+			else if (attributeType == STRING)
+			{
+				buildBloom<StringKey>();
+			}
+			else
+			{
+				buildBloom<CompositeKey>();
+			}
+		}
+		if (bloomValid && !options.readOnly)
+		{
+			// inserts change the filter from now on, so the saved one stops counting until the index is closed
+			{
+				PageGuard headerPage(bufMgr, bufMgr->readPage(file, headerPageNum));
+				((IndexMetaInfo *)headerPage.page())->bloomValid = false;
+				headerPage.markDirty();
+			}
+			bufMgr->flushFile(file);
+		}
+
+		if (options.readOnly)
+		{
+			// write out what is cached so the mapping sees the whole index, then serve nodes from the mapping
+			bufMgr->flushFile(file);
+			static_cast<BlobFile *>(file)->mapReadOnly();
+		}
+
+		if (attributeType == INTEGER)
+		{
+			pinUpperLevels<int>();
+		}
+		else if (attributeType == DOUBLE)
+		{
+			pinUpperLevels<double>();
+		}
+		else if (attributeType == STRING)
+		{
+			pinUpperLevels<StringKey>();
+		}
+		else
+		{
+			pinUpperLevels<CompositeKey>();
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::pinUpperLevels
+	// -----------------------------------------------------------------------------
+
+	/**
+	 * Orders handles by page number.
+	 */
+	static bool handlePageNoLess(const PageHandle &lhs, const PageHandle &rhs)
+	{
+		return lhs.pageNo < rhs.pageNo;
+	}
+
+	template <class T>
+	void BTreeIndex::pinUpperLevels()
+	{
+		pinnedNodesStale = false;
+		std::shared_ptr<PinnedSet> pinned;
+		bool isLeaf;
+		std::uint64_t version;
+		const PageId root = readRoot(isLeaf, version);
+		if (pinnedLevels > 0 && !isLeaf)
+		{
+			pinned.reset(new PinnedSet);
+			pinned->bufMgr = bufMgr;
+
+			// breadth first from the root, one level per round, never going down to the leaves
+			std::vector<PageId> levelPages(1, root);
+			for (int depth = 0; depth < pinnedLevels && !levelPages.empty(); depth++)
+			{
+				std::vector<PageId> nextLevelPages;
+				for (std::size_t i = 0; i < levelPages.size() && (int)pinned->nodes.size() < pinnedPageLimit; i++)
+				{
+					const PageHandle handle = bufMgr->readPage(file, levelPages[i]);
+					pinned->nodes.push_back(handle);
+
+					// inserts may be splitting the node, so read its children under its latch
+					const NonLeafNode<T> *node = (const NonLeafNode<T> *)handle.page;
+					OptimisticLatch &latch = latches.latchFor(handle.pageNo);
+					std::vector<PageId> children;
+					while (true)
+					{
+						const std::uint64_t nodeVersion = latch.readLock();
+						children.clear();
+						if (node->level > 1)
+						{
+							children.assign(node->pageNoArray, node->pageNoArray + node->numKeys + 1);
+						}
+						if (latch.validate(nodeVersion))
+						{
+							break;
+						}
+					}
+					nextLevelPages.insert(nextLevelPages.end(), children.begin(), children.end());
+				}
+				levelPages.swap(nextLevelPages);
+			}
+			std::sort(pinned->nodes.begin(), pinned->nodes.end(), handlePageNoLess);
+		}
+		std::atomic_store(&pinnedNodes, std::shared_ptr<const PinnedSet>(pinned));
+	}
+
+	void BTreeIndex::unpinUpperLevels()
+	{
+		std::atomic_store(&pinnedNodes, std::shared_ptr<const PinnedSet>());
+	}
+
+	BTreeIndex::PinnedSet::~PinnedSet()
+	{
+		for (std::size_t i = 0; i < nodes.size(); i++)
+		{
+			try
+			{
+				bufMgr->unPinPage(nodes[i], false);
+			}
+			catch (BadgerDbException &e)
+			{
+			}
+		}
+	}
+
+	const PageHandle *BTreeIndex::PinnedSet::find(const PageId pageNo) const
+	{
+		PageHandle key;
+		key.pageNo = pageNo;
+		std::vector<PageHandle>::const_iterator it = std::lower_bound(nodes.begin(), nodes.end(), key, handlePageNoLess);
+		return (it != nodes.end() && it->pageNo == pageNo) ? &*it : NULL;
+	}
+
+	PageHandle BTreeIndex::readNode(const PinnedSet *pinned, const PageId pageNo)
+	{
+		const PageHandle *handle = (pinned != NULL) ? pinned->find(pageNo) : NULL;
+		if (handle != NULL)
+		{
+			return *handle;
+		}
+		return bufMgr->readPage(file, pageNo);
+	}
+
+	void BTreeIndex::unPinNode(const PinnedSet *pinned, const PageHandle &node, const bool dirty)
+	{
+		if (pinned != NULL && pinned->find(node.pageNo) != NULL)
+		{
+			// stays pinned, so tell the buffer manager it is dirty right away
+			if (dirty)
+			{
+				bufMgr->markDirty(node);
+			}
+			return;
+		}
+		bufMgr->unPinPage(node, dirty);
+	}
+
+	PageId BTreeIndex::readRoot(bool &isLeaf, std::uint64_t &version)
+	{
+		OptimisticLatch &metaLatch = latches.latchFor(headerPageNum);
+		while (true)
+		{
+			version = metaLatch.readLock();
+			const PageId root = rootPageNum;
+			isLeaf = rootIsLeaf;
+			if (metaLatch.validate(version))
+			{
+				return root;
+			}
+		}
+	}
+
+	void BTreeIndex::copyLeaf(const PageId pageNo, Page &leaf)
+	{
+		// only scans copy leaves out, so the replacement policy may evict them before the inner nodes
+		PageGuard page(bufMgr, bufMgr->readPage(file, pageNo, SEQUENTIAL_ACCESS));
+		OptimisticLatch &latch = latches.latchFor(pageNo);
+		while (true)
+		{
+			const std::uint64_t version = latch.readLock();
+			leaf = *page.page();
+			if (latch.validate(version))
+			{
+				return;
+			}
+		}
+	}
+
+	void BTreeIndex::copySnapshotNode(const IndexSnapshot &snapshot, const PageId pageNo, Page &node,
+									  const AccessPattern pattern)
+	{
+		// an image saved after the snapshot is never replaced by an older one, so it can be taken without the latch
+		if (versions.read(pageNo, snapshot.epoch, node))
+		{
+			return;
+		}
+		PageGuard page(bufMgr, bufMgr->readPage(file, pageNo, pattern));
+		OptimisticLatch &latch = latches.latchFor(pageNo);
+		while (true)
+		{
+			// writers save the image before changing the node, so a copy that validates without one being saved
+			// is the node as the snapshot saw it
+			const std::uint64_t version = latch.readLock();
+			if (versions.read(pageNo, snapshot.epoch, node))
+			{
+				return;
+			}
+			node = *page.page();
+			if (latch.validate(version))
+			{
+				return;
+			}
+		}
+	}
+
+	void BTreeIndex::changeNode(RedoGroup &group, const PageHandle &node)
+	{
+		versions.preserve(node.pageNo, *node.page);
+		group.track(node);
+	}
+
+	void BTreeIndex::openSnapshot(IndexSnapshot &snapshot)
+	{
+		flushDelta();
+		// counted before the root is read, so that no page of the tree it leads to is freed
+		snapshot.operationStripe = operations.enter();
+		std::lock_guard<std::mutex> guard(compactLatch);
+		writers.close();
+		// no writer is in, so every change so far is in the snapshot and every later one in a later epoch
+		std::uint64_t version;
+		snapshot.rootPageNum = readRoot(snapshot.rootIsLeaf, version);
+		snapshot.epoch = versions.openSnapshot();
+		writers.open();
+	}
+
+	void BTreeIndex::closeSnapshot(IndexSnapshot &snapshot)
+	{
+		versions.closeSnapshot(snapshot.epoch);
+		operations.leave(snapshot.operationStripe);
+		freeRetiredPages();
+	}
+
+	/**
+	 * NextPageFn handed to the buffer manager for scan read-ahead. The leaf is read without its latch; a torn
+	 * sibling link only sends the read-ahead to the wrong page.
+	 */
+	template <class T>
+	static PageId leafRightSibling(const Page &page)
+	{
+		return ((const typename LeafNodeOf<T>::type *)&page)->rightSibPageNo;
+	}
+
+	template <class T>
+	void BTreeIndex::enterLeaf(IndexScanCursor &cursor, const PageId pageNo)
+	{
+		if (cursor.snapshot != NULL)
+		{
+			copySnapshotNode(*cursor.snapshot, pageNo, cursor.currentLeaf, SEQUENTIAL_ACCESS);
+		}
+		else
+		{
+			copyLeaf(pageNo, cursor.currentLeaf);
+		}
+		if (prefetchDepth <= 0)
+		{
+			return;
+		}
+
+		// ask for the next prefetchDepth siblings whenever half of the previous batch has been walked
+		if (cursor.prefetchAhead > 0)
+		{
+			cursor.prefetchAhead--;
+		}
+		const PageId rightSibPageNo = ((typename LeafNodeOf<T>::type *)&cursor.currentLeaf)->rightSibPageNo;
+		if (cursor.prefetchAhead <= prefetchDepth / 2 && rightSibPageNo != Page::INVALID_NUMBER)
+		{
+			bufMgr->prefetchPages(file, rightSibPageNo, prefetchDepth, &leafRightSibling<T>);
+			cursor.prefetchAhead = prefetchDepth;
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::buildIndex
+	// -----------------------------------------------------------------------------
+
+	void BTreeIndex::extractPayload(const char *record, char *payload) const
+	{
+		for (std::size_t i = 0; i < included.size(); i++)
+		{
+			const int size = attributeSize(included[i].attrType);
+			memcpy(payload, record + included[i].attrByteOffset, size);
+			payload += size;
+		}
+	}
+
+	/**
+	 * A pair sorted by a covering bulk load, carried along with its included attributes.
+	 */
+	template <class T>
+	struct CoveredPair
+	{
+		RIDKeyPair<T> pair;
+		char payload[MAX_PAYLOAD_SIZE];
+
+		bool operator<(const CoveredPair &rhs) const
+		{
+			return pair < rhs.pair;
+		}
+	};
+
+	template <class T>
+	static void sortEntrySet(RIDKeyPair<T> &entry, const RIDKeyPair<T> &pair, const char *payload)
+	{
+		entry = pair;
+	}
+
+	template <class T>
+	static void sortEntrySet(CoveredPair<T> &entry, const RIDKeyPair<T> &pair, const char *payload)
+	{
+		entry.pair = pair;
+		memcpy(entry.payload, payload, MAX_PAYLOAD_SIZE);
+	}
+
+	template <class T>
+	static const RIDKeyPair<T> &sortEntryPair(const RIDKeyPair<T> &entry)
+	{
+		return entry;
+	}
+
+	template <class T>
+	static const RIDKeyPair<T> &sortEntryPair(const CoveredPair<T> &entry)
+	{
+		return entry.pair;
+	}
+
+	template <class T>
+	static const char *sortEntryPayload(const RIDKeyPair<T> &entry)
+	{
+		return NULL;
+	}
+
+	template <class T>
+	static const char *sortEntryPayload(const CoveredPair<T> &entry)
+	{
+		return entry.payload;
+	}
+
+	/**
+	 * Head of one of the sorted streams merged by the parallel bulk loader. Ordered so that a priority_queue
+	 * returns the smallest entry first.
+	 */
+	template <class Entry>
+	struct SortedSource
+	{
+		Entry entry;
+		std::size_t source;
+
+		bool operator<(const SortedSource &other) const
+		{
+			return other.entry < entry;
+		}
+	};
+
+	/**
+	 * Open one scan per build thread over consecutive ranges of the pages of the base relation. Fewer scans are
+	 * returned if the relation has fewer pages than threads, none if it is empty.
+	 */
+	static std::vector<FileScan *> openBuildScans(const std::string &relationName, BufMgr *bufMgr, const BTreeOptions &options)
+	{
+		std::vector<FileScan *> scanners;
+		if (options.buildThreads <= 1)
+		{
+			scanners.push_back(new FileScan(relationName, bufMgr, options.buildRingSize));
+			return scanners;
+		}
+		const std::vector<PageId> starts = FileScan::partition(relationName, options.buildThreads);
+		for (std::size_t k = 0; k < starts.size(); k++)
+		{
+			const PageId end = (k + 1 < starts.size()) ? starts[k + 1] : Page::INVALID_NUMBER;
+			scanners.push_back(new FileScan(relationName, bufMgr, starts[k], end, options.buildRingSize));
+		}
+		return scanners;
+	}
+
+	/**
+	 * Wait for the build threads, close their scans and rethrow the first exception a thread stored.
+	 */
+	static void joinBuildThreads(std::vector<std::thread> &workers, std::vector<FileScan *> &scanners,
+								 const std::vector<std::exception_ptr> &errors)
+	{
+		for (std::size_t k = 0; k < workers.size(); k++)
+		{
+			workers[k].join();
+		}
+		for (std::size_t k = 0; k < scanners.size(); k++)
+		{
+			delete scanners[k];
+		}
+		for (std::size_t k = 0; k < errors.size(); k++)
+		{
+			if (errors[k])
+			{
+				std::rethrow_exception(errors[k]);
+			}
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::buildIndex(const std::string &relationName, const BTreeOptions &options, SortedEntrySource *source)
+	{
+		if (source != NULL)
+		{
+			bulkLoadSorted<T>(*source, options);
+			return;
+		}
+		if (options.bulkLoad)
+		{
+			if (payloadSize > 0)
+			{
+				bulkLoad<T, CoveredPair<T> >(relationName, options);
+			}
+			else
+			{
+				bulkLoad<T, RIDKeyPair<T> >(relationName, options);
+			}
+			return;
+		}
+
+		// the tree starts out as a single empty leaf
+		{
+			PageGuard rootPage(bufMgr, bufMgr->allocPage(file, rootPageNum));
+			leafInit((typename LeafNodeOf<T>::type *)rootPage.page(), payloadSize);
+			rootPage.markDirty();
+		}
+		rootIsLeaf = true;
+
+		// insert entries for every tuple in the base relation using FileScan class, one scan per build thread
+		std::vector<FileScan *> scanners = openBuildScans(relationName, bufMgr, options);
+		std::vector<std::exception_ptr> errors(scanners.size());
+		std::vector<std::thread> workers;
+		for (std::size_t k = 1; k < scanners.size(); k++)
+		{
+			workers.push_back(std::thread(&BTreeIndex::buildInsert<T>, this, scanners[k], &errors[k]));
+		}
+		if (!scanners.empty())
+		{
+			buildInsert<T>(scanners[0], &errors[0]);
+		}
+		joinBuildThreads(workers, scanners, errors);
+	}
+
+	template <class T>
+	void BTreeIndex::buildInsert(FileScan *scanner, std::exception_ptr *error)
+	{
+		try
+		{
+			RecordId recordId;
+			while (true)
+			{
+				try
+				{
+					scanner->scanNext(recordId);
+				}
+				catch (EndOfFileException &e)
+				{
+					break;
+				}
+				const RecordView currRecord = scanner->viewRecord();
+				RIDKeyPair<T> pair;
+				pair.set(recordId, keyFrom<T>(currRecord.data + attrByteOffset));
+				char payload[MAX_PAYLOAD_SIZE];
+				extractPayload(currRecord.data, payload);
+				std::size_t done;
+				insertRun(&pair, payload, 1, done);
+			}
+		}
+		catch (...)
+		{
+			*error = std::current_exception();
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::bulkLoad
+	// -----------------------------------------------------------------------------
+
+	template <class T, class Entry>
+	void BTreeIndex::bulkLoad(const std::string &relationName, const BTreeOptions &options)
+	{
+		// extract every <rid, key> pair of the base relation, one range of pages and one sorter per build thread,
+		// spilling sorted runs once they outgrow memory
+		std::vector<FileScan *> scanners = openBuildScans(relationName, bufMgr, options);
+		const std::size_t runSize = std::max<std::size_t>(1, options.sortRunSize / std::max<std::size_t>(1, scanners.size()));
+		std::vector<ExternalSort<Entry> *> sorters;
+		for (std::size_t k = 0; k < std::max<std::size_t>(1, scanners.size()); k++)
+		{
+			std::ostringstream tempName;
+			tempName << file->filename() << ".sort";
+			if (k > 0)
+			{
+				tempName << '.' << k;
+			}
+			sorters.push_back(new ExternalSort<Entry>(bufMgr, tempName.str(), runSize));
+		}
+		std::vector<std::exception_ptr> errors(scanners.size());
+		std::vector<std::thread> workers;
+		for (std::size_t k = 1; k < scanners.size(); k++)
+		{
+			workers.push_back(std::thread(&BTreeIndex::bulkLoadExtract<T, Entry>, this, scanners[k], sorters[k], &errors[k]));
+		}
+		if (!scanners.empty())
+		{
+			bulkLoadExtract<T, Entry>(scanners[0], sorters[0], &errors[0]);
+		}
+		else
+		{
+			sorters[0]->finish();
+		}
+		try
+		{
+			joinBuildThreads(workers, scanners, errors);
+		}
+		catch (...)
+		{
+			for (std::size_t k = 0; k < sorters.size(); k++)
+			{
+				delete sorters[k];
+			}
+			throw;
+		}
+
+		// merge the sorted streams of the threads and pack them into the leaf level as they come out
+		std::priority_queue<SortedSource<Entry> > heads;
+		for (std::size_t k = 0; k < sorters.size(); k++)
+		{
+			SortedSource<Entry> head;
+			head.source = k;
+			if (sorters[k]->next(head.entry))
+			{
+				heads.push(head);
+			}
+		}
+		std::vector<PageKeyPair<T> > children;
+		bulkLoadBegin(options.fillFactor);
+		while (!heads.empty())
+		{
+			SortedSource<Entry> head = heads.top();
+			heads.pop();
+			bulkLoadAppend(sortEntryPair(head.entry), sortEntryPayload(head.entry), children);
+			if (sorters[head.source]->next(head.entry))
+			{
+				heads.push(head);
+			}
+		}
+		bulkLoadFinish(children);
+		for (std::size_t k = 0; k < sorters.size(); k++)
+		{
+			delete sorters[k];
+		}
+	}
+
+	template <class T, class Entry>
+	void BTreeIndex::bulkLoadExtract(FileScan *scanner, ExternalSort<Entry> *sorter, std::exception_ptr *error)
+	{
+		try
+		{
+			RecordId recordId;
+			while (true)
+			{
+				try
+				{
+					scanner->scanNext(recordId);
+				}
+				catch (EndOfFileException &e)
+				{
+					break;
+				}
+				const RecordView currRecord = scanner->viewRecord();
+				RIDKeyPair<T> pair;
+				pair.set(recordId, keyFrom<T>(currRecord.data + attrByteOffset));
+				char payload[MAX_PAYLOAD_SIZE] = {};
+				extractPayload(currRecord.data, payload);
+				Entry entry;
+				sortEntrySet(entry, pair, payload);
+				sorter->add(entry);
+			}
+			sorter->finish();
+		}
+		catch (...)
+		{
+			*error = std::current_exception();
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::bulkLoadSorted(SortedEntrySource &source, const BTreeOptions &options)
+	{
+		std::vector<PageKeyPair<T> > children;
+		bulkLoadBegin(options.fillFactor);
+		T key;
+		RecordId rid;
+		while (source.next(&key, rid))
+		{
+			RIDKeyPair<T> pair;
+			pair.set(rid, key);
+			bulkLoadAppend(pair, NULL, children);
+		}
+		bulkLoadFinish(children);
+	}
+
+	void BTreeIndex::bulkLoadBegin(const double fillFactor)
+	{
+		bulkFillFactor = fillFactor;
+		bulkNodeCapacity = std::min(nodeOccupancy, std::max(1, (int)(nodeOccupancy * fillFactor)));
+		bulkLeaf = PageHandle();
+	}
+
+	template <class T>
+	void BTreeIndex::bulkLoadNewLeaf(const T &firstKey, std::vector<PageKeyPair<T> > &children)
+	{
+		// keep the leaf level in runs of consecutive pages
+		PageId newPageNum;
+		const PageHandle newLeaf = bufMgr->allocPage(file, newPageNum, bulkLeaf.page != NULL ? bulkLeaf.pageNo : Page::INVALID_NUMBER);
+		leafInit((typename LeafNodeOf<T>::type *)newLeaf.page, payloadSize);
+
+		// link the previous leaf to the new one; it will not be touched again
+		if (bulkLeaf.page != NULL)
+		{
+			((typename LeafNodeOf<T>::type *)bulkLeaf.page)->rightSibPageNo = newPageNum;
+			bufMgr->unPinPage(bulkLeaf, true);
+		}
+		bulkLeaf = newLeaf;
+
+		PageKeyPair<T> child;
+		child.set(newPageNum, firstKey);
+		children.push_back(child);
+	}
+
+	template <class T>
+	void BTreeIndex::bulkLoadAppend(const RIDKeyPair<T> &pair, const char *payload, std::vector<PageKeyPair<T> > &children)
+	{
+		if (bulkLeaf.page == NULL ||
+			!leafAppend((typename LeafNodeOf<T>::type *)bulkLeaf.page, pair, payload, bulkFillFactor))
+		{
+			// a new leaf always takes its first entry
+			bulkLoadNewLeaf(pair.key, children);
+			leafAppend((typename LeafNodeOf<T>::type *)bulkLeaf.page, pair, payload, bulkFillFactor);
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::bulkLoadFinish(std::vector<PageKeyPair<T> > &children)
+	{
+		if (bulkLeaf.page == NULL)
+		{
+			// empty relation, the root is a single empty leaf
+			bulkLoadNewLeaf(T(), children);
+		}
+		bufMgr->unPinPage(bulkLeaf, true);
+		bulkLeaf = PageHandle();
+
+		std::vector<PageKeyPair<T> > level;
+		level.swap(children);
+		int levelNum = 1;
+		while (level.size() > 1)
+		{
+			level = bulkLoadNonLeafLevel(level, levelNum);
+			levelNum++;
+		}
+
+		// compact() builds a tree while readers are on the old one
+		OptimisticLatch &metaLatch = latches.latchFor(headerPageNum);
+		metaLatch.writeLock();
+		rootPageNum = level[0].pageNo;
+		rootIsLeaf = (levelNum == 1);
+		metaLatch.writeUnlock();
+	}
+
+	template <class T>
+	std::vector<PageKeyPair<T> > BTreeIndex::bulkLoadNonLeafLevel(const std::vector<PageKeyPair<T> > &children, const int level)
+	{
+		std::vector<PageKeyPair<T> > parents;
+
+		// spread the children evenly so the last node on the level is not left nearly empty
+		const int perNode = bulkNodeCapacity + 1;
+		const int numChildren = children.size();
+		const int numNodes = (numChildren + perNode - 1) / perNode;
+		const int base = numChildren / numNodes;
+		const int extra = numChildren % numNodes;
+
+		int next = 0;
+		for (int n = 0; n < numNodes; n++)
+		{
+			const int count = base + (n < extra ? 1 : 0);
+
+			PageId newPageNum;
+			PageGuard newPage(bufMgr, bufMgr->allocPage(file, newPageNum));
+			newPage.markDirty();
+			NonLeafNode<T> *node = (NonLeafNode<T> *)newPage.page();
+			node->level = level;
+			node->numKeys = count - 1;
+
+			// keyArray[i] is the smallest key under pageNoArray[i + 1]
+			node->pageNoArray[0] = children[next].pageNo;
+			for (int i = 1; i < count; i++)
+			{
+				node->keyArray[i - 1] = children[next + i].key;
+				node->pageNoArray[i] = children[next + i].pageNo;
+			}
+			nonLeafSummarize(node);
+
+			PageKeyPair<T> parent;
+			parent.set(newPageNum, children[next].key);
+			parents.push_back(parent);
+			next += count;
+		}
+
+		return parents;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::~BTreeIndex -- destructor
+	// -----------------------------------------------------------------------------
+
+	BTreeIndex::~BTreeIndex()
+	{
+		try
+		{
+			if (scanCursor.isScanning())
+			{
+				scanCursor.endScan();
+			}
+			flushDelta();
+			freeRetiredPages();
+			unpinUpperLevels();
+			if (std::atomic_load(&bloom) && !file->isMapped())
+			{
+				saveBloom();
+			}
+			bufMgr->flushFile(file);
+		}
+		catch (BadgerDbException &e)
+		{
+		}
+		delete file;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::insertEntry
+	// -----------------------------------------------------------------------------
+	/**
+	 * Insert a new entry using the pair <value,rid>.
+	 * Start from root to recursively find out the leaf to insert the entry in. The insertion may cause splitting of leaf node.
+	 * This splitting will require addition of new leaf page number entry into the parent non-leaf, which may in-turn get split.
+	 * This may continue all the way upto the root causing the root to get split. If root gets split, metapage needs to be changed accordingly.
+	 * Make sure to unpin pages as soon as you can.
+	 * @param key			Key to insert, pointer to integer/double/char string
+	 * @param rid			Record ID of a record whose entry is getting inserted into the index.
+	 * @param payload		Included attributes of the record, or NULL to store zeroes.
+	 **/
+	void BTreeIndex::insertEntry(const void *_key, const RecordId rid, const void *payload)
+	{
+		if (file->isMapped())
+		{
+			throw ReadOnlyFileException(file->filename());
+		}
+
+		char entryPayload[MAX_PAYLOAD_SIZE] = {};
+		if (payload != NULL)
+		{
+			memcpy(entryPayload, payload, payloadSize);
+		}
+
+		// set up the RID-Key pair for insertion
+		if (attributeType == INTEGER)
+		{
+			RIDKeyPair<int> pair;
+			pair.set(rid, keyFrom<int>(_key));
+			insertPair(pair, entryPayload);
+		}
+		else if (attributeType == DOUBLE)
+		{
+			RIDKeyPair<double> pair;
+			pair.set(rid, keyFrom<double>(_key));
+			insertPair(pair, entryPayload);
+		}
+		else if (attributeType == STRING)
+		{
+			RIDKeyPair<StringKey> pair;
+			pair.set(rid, keyFrom<StringKey>(_key));
+			insertPair(pair, entryPayload);
+		}
+		else if (attributeType == COMPOSITE)
+		{
+			RIDKeyPair<CompositeKey> pair;
+			pair.set(rid, keyFrom<CompositeKey>(_key));
+			insertPair(pair, entryPayload);
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::insertPair(const RIDKeyPair<T> &pair, const char *payload)
+	{
+		if (deltaCapacity != 0)
+		{
+			bufferPair(pair, payload);
+			return;
+		}
+		std::size_t done;
+		insertRun(&pair, payload, 1, done);
+	}
+
+	template <class T>
+	void BTreeIndex::insertRun(const RIDKeyPair<T> *pairs, const char *payloads, const std::size_t count, std::size_t &done)
+	{
+		WriterGuard writer(writers);
+		OperationGuard operation(operations);
+		// added while compact() is kept out, so that the filter it builds cannot miss these keys
+		const std::shared_ptr<BloomFilter> filter = std::atomic_load(&bloom);
+		if (filter)
+		{
+			for (std::size_t i = 0; i < count; i++)
+			{
+				filter->addHash(bloomHash(pairs[i].key));
+			}
+		}
+		std::uint64_t visits = 0;
+		std::uint64_t retries = 0;
+		done = 0;
+		while (done < count)
+		{
+			// hold on to the pinned nodes of this attempt even if another insert replaces them
+			const std::shared_ptr<const PinnedSet> pinned = std::atomic_load(&pinnedNodes);
+			const std::size_t inserted = tryInsert(pairs + done, payloads + done * payloadSize, count - done,
+												   pinned.get(), visits);
+			if (inserted == 0)
+			{
+				retries++;
+			}
+			done += inserted;
+		}
+		counters.inserts.fetch_add(count, std::memory_order_relaxed);
+		counters.insertNodeVisits.fetch_add(visits, std::memory_order_relaxed);
+		BADGERDB_TRACE(TRACE_INDEX_DESCENT, this, Page::INVALID_NUMBER, visits, 0);
+		if (retries > 0)
+		{
+			counters.insertRetries.fetch_add(retries, std::memory_order_relaxed);
+		}
+		if (pinnedNodesStale.exchange(false))
+		{
+			pinUpperLevels<T>();
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex delta buffer
+	// -----------------------------------------------------------------------------
+
+	/**
+	 * Orders the positions of buffered entries by the keys of the entries.
+	 */
+	template <class T>
+	struct DeltaKeyOrder
+	{
+		const RIDKeyPair<T> *pairs;
+
+		explicit DeltaKeyOrder(const RIDKeyPair<T> *pairs) : pairs(pairs)
+		{
+		}
+
+		bool operator()(const std::size_t a, const std::size_t b) const
+		{
+			return pairs[a].key < pairs[b].key;
+		}
+	};
+
+	template <class T>
+	void BTreeIndex::bufferPair(const RIDKeyPair<T> &pair, const char *payload)
+	{
+		std::lock_guard<std::mutex> deltaGuard(deltaLatch);
+		const char *bytes = reinterpret_cast<const char *>(&pair);
+		deltaPairs.insert(deltaPairs.end(), bytes, bytes + sizeof(pair));
+		if (payloadSize > 0)
+		{
+			deltaPayloads.insert(deltaPayloads.end(), payload, payload + payloadSize);
+		}
+		if (++deltaCount >= deltaCapacity)
+		{
+			applyDelta<T>();
+		}
+	}
+
+	void BTreeIndex::flushDelta()
+	{
+		if (deltaCount == 0)
+		{
+			return;
+		}
+		std::lock_guard<std::mutex> deltaGuard(deltaLatch);
+		if (attributeType == INTEGER)
+		{
+			applyDelta<int>();
+		}
+		else if (attributeType == DOUBLE)
+		{
+			applyDelta<double>();
+		}
+		else if (attributeType == STRING)
+		{
+			applyDelta<StringKey>();
+		}
+		else
+		{
+			applyDelta<CompositeKey>();
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::applyDelta()
+	{
+		const std::size_t count = deltaCount;
+		if (count == 0)
+		{
+			return;
+		}
+
+		// equal keys keep the order they were inserted in, as they do in the leaves
+		const RIDKeyPair<T> *buffered = reinterpret_cast<const RIDKeyPair<T> *>(deltaPairs.data());
+		std::vector<std::size_t> order(count);
+		for (std::size_t i = 0; i < count; i++)
+		{
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), DeltaKeyOrder<T>(buffered));
+		std::vector<RIDKeyPair<T> > pairs(count);
+		std::vector<char> payloads(count * payloadSize + 1);
+		for (std::size_t i = 0; i < count; i++)
+		{
+			pairs[i] = buffered[order[i]];
+			// without included attributes there are no payloads, and deltaPayloads is empty
+			if (payloadSize > 0)
+			{
+				memcpy(&payloads[i * payloadSize], deltaPayloads.data() + order[i] * payloadSize, payloadSize);
+			}
+		}
+
+		std::size_t done = 0;
+		try
+		{
+			insertRun(pairs.data(), payloads.data(), count, done);
+		}
+		catch (...)
+		{
+			// keep what did not go in, so that neither the next apply inserts an entry twice nor one is lost
+			const char *bytes = reinterpret_cast<const char *>(pairs.data() + done);
+			deltaPairs.assign(bytes, bytes + (count - done) * sizeof(RIDKeyPair<T>));
+			deltaPayloads.assign(payloads.begin() + done * payloadSize, payloads.begin() + count * payloadSize);
+			deltaCount = count - done;
+			throw;
+		}
+		deltaPairs.clear();
+		deltaPayloads.clear();
+		deltaCount = 0;
+		counters.deltaFlushes.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	template <class T>
+	std::size_t BTreeIndex::tryInsert(const RIDKeyPair<T> *pairs, const char *payloads, const std::size_t count,
+									  const PinnedSet *pinned, std::uint64_t &visits)
+	{
+		const RIDKeyPair<T> &pair = pairs[0];
+		// keys below the bound belong in the same leaf as the first one
+		bool bounded = false;
+		T bound = T();
+		// the meta page latch guards the root the way a node's latch guards its children
+		OptimisticLatch *parentLatch = &latches.latchFor(headerPageNum);
+		std::uint64_t parentVersion;
+		bool isLeaf;
+		PageId pageNo = readRoot(isLeaf, parentVersion);
+		PageHandle parent;
+		int parentIndex = 0;
+		RedoGroup group(bufMgr);
+
+		while (!isLeaf)
+		{
+			const PageHandle node = readNode(pinned, pageNo);
+			visits++;
+			NonLeafNode<T> *currNonLeafNode = (NonLeafNode<T> *)node.page;
+			OptimisticLatch &latch = latches.latchFor(pageNo);
+			const std::uint64_t version = latch.readLock();
+
+			if (currNonLeafNode->numKeys >= nodeOccupancy)
+			{
+				// split the full node now, so that a split further down never has to go past its parent
+				bool split = false;
+				if (parentLatch->upgrade(parentVersion))
+				{
+					if (latch.upgrade(version))
+					{
+						try
+						{
+							changeNode(group, node);
+							if (parent.page != NULL)
+							{
+								changeNode(group, parent);
+							}
+							PageKeyPair<T> newChild;
+							const int level = currNonLeafNode->level;
+							splitNonLeaf(currNonLeafNode, newChild, group);
+							if (parent.page == NULL)
+							{
+								growRoot(newChild, level + 1, group);
+							}
+							else
+							{
+								sortedNonLeafEntry((NonLeafNode<T> *)parent.page, parentIndex, newChild);
+							}
+							group.log();
+						}
+						catch (...)
+						{
+							latch.writeUnlock();
+							parentLatch->writeUnlock();
+							unPinNode(pinned, node, true);
+							if (parent.page != NULL)
+							{
+								unPinNode(pinned, parent, true);
+							}
+							throw;
+						}
+						split = true;
+						// the new sibling belongs in the pinned levels too
+						if (pinned != NULL && pinned->find(pageNo) != NULL)
+						{
+							pinnedNodesStale = true;
+						}
+						latch.writeUnlock();
+					}
+					parentLatch->writeUnlock();
+				}
+				unPinNode(pinned, node, split);
+				if (parent.page != NULL)
+				{
+					unPinNode(pinned, parent, split);
+				}
+				group.commit();
+				// start over whether or not the split happened; the next attempt sees the new shape
+				return 0;
+			}
+
+			const int index = nonLeafUpperBound(currNonLeafNode, pair.key);
+			const PageId childPageNo = currNonLeafNode->pageNoArray[index];
+			if (index < currNonLeafNode->numKeys)
+			{
+				bounded = true;
+				bound = currNonLeafNode->keyArray[index];
+			}
+			const bool childIsLeaf = (currNonLeafNode->level == 1);
+			const bool valid = parentLatch->validate(parentVersion) && latch.validate(version);
+			if (parent.page != NULL)
+			{
+				unPinNode(pinned, parent, false);
+			}
+			if (!valid)
+			{
+				// a writer got in between, the child read may not be the right one
+				unPinNode(pinned, node, false);
+				return 0;
+			}
+			parent = node;
+			parentLatch = &latch;
+			parentVersion = version;
+			parentIndex = index;
+			pageNo = childPageNo;
+			isLeaf = childIsLeaf;
+		}
+
+		const PageHandle leaf = bufMgr->readPage(file, pageNo);
+		visits++;
+		typename LeafNodeOf<T>::type *currLeafNode = (typename LeafNodeOf<T>::type *)leaf.page;
+		OptimisticLatch &latch = latches.latchFor(pageNo);
+		const std::uint64_t version = latch.readLock();
+		std::size_t inserted = 0;
+		bool parentDirty = false;
+		if (parentLatch->validate(parentVersion) && latch.upgrade(version))
+		{
+			changeNode(group, leaf);
+			// posting lists keep their rids in order, the other leaves their equal keys in insertion order
+			const char *payload = payloads;
+			const int pos = leafInsertPosition(currLeafNode, pair);
+			if (leafInsert(currLeafNode, pos, pair, payload))
+			{
+				// the rest of the run for this leaf goes in while it is latched, up to the first that does not fit
+				inserted = 1;
+				while (inserted < count && (!bounded || pairs[inserted].key < bound) &&
+					   leafInsert(currLeafNode, leafInsertPosition(currLeafNode, pairs[inserted]), pairs[inserted],
+								  payloads + inserted * payloadSize))
+				{
+					inserted++;
+				}
+			}
+			else if (parentLatch->upgrade(parentVersion))
+			{
+				// the parent was not full when we passed it and has not changed since, so it has room
+				try
+				{
+					if (parent.page != NULL)
+					{
+						changeNode(group, parent);
+					}
+					PageKeyPair<T> newChild;
+					splitLeaf(currLeafNode, pageNo, pos, pair, payload, newChild, group);
+					if (parent.page == NULL)
+					{
+						growRoot(newChild, 1, group);
+					}
+					else
+					{
+						sortedNonLeafEntry((NonLeafNode<T> *)parent.page, parentIndex, newChild);
+					}
+					group.log();
+				}
+				catch (...)
+				{
+					parentLatch->writeUnlock();
+					latch.writeUnlock();
+					bufMgr->unPinPage(leaf, true);
+					if (parent.page != NULL)
+					{
+						unPinNode(pinned, parent, true);
+					}
+					throw;
+				}
+				parentLatch->writeUnlock();
+				inserted = 1;
+				parentDirty = true;
+			}
+			// logged while the leaf is latched, so that the groups changing it are logged in order
+			group.log();
+			latch.writeUnlock();
+		}
+
+		// Unpin and flush to disk
+		bufMgr->unPinPage(leaf, inserted != 0);
+		if (parent.page != NULL)
+		{
+			unPinNode(pinned, parent, parentDirty);
+		}
+		group.commit();
+		return inserted;
+	}
+
+	template <class T>
+	void BTreeIndex::sortedNonLeafEntry(NonLeafNode<T> *currNode, const int pos, const PageKeyPair<T> &entry)
+	{
+		// shift all right values one place to the right
+		for (int i = currNode->numKeys; i > pos; i--)
+		{
+			currNode->keyArray[i] = currNode->keyArray[i - 1];
+			currNode->pageNoArray[i + 1] = currNode->pageNoArray[i];
+		}
+		currNode->keyArray[pos] = entry.key;
+		currNode->pageNoArray[pos + 1] = entry.pageNo;
+		currNode->numKeys++;
+		nonLeafSummarize(currNode);
+	}
+
+	template <class T>
+	void BTreeIndex::splitLeaf(typename LeafNodeOf<T>::type *currNode, const PageId pageNo, const int pos, const RIDKeyPair<T> &pair,
+							   const char *payload, PageKeyPair<T> &newChild, RedoGroup &group)
+	{
+		// alloc new page for the right half, in the same extent as the left half if there is room
+		PageId newPageNum;
+		const PageHandle newHandle = bufMgr->allocPage(file, newPageNum, pageNo);
+		PageGuard newPage(bufMgr, newHandle);
+		newPage.markDirty();
+		group.trackNew(newHandle);
+		typename LeafNodeOf<T>::type *newNode = (typename LeafNodeOf<T>::type *)newPage.page();
+		leafInit(newNode, payloadSize);
+		leafSplit(currNode, newNode, pos, pair, payload);
+
+		// connect new leaf into the sibling chain
+		newNode->rightSibPageNo = currNode->rightSibPageNo;
+		currNode->rightSibPageNo = newPageNum;
+
+		// copy up leftmost key on new node
+		newChild.set(newPageNum, leafKey(newNode, 0));
+		counters.leafSplits.fetch_add(1, std::memory_order_relaxed);
+		BADGERDB_TRACE(TRACE_INDEX_LEAF_SPLIT, this, newPageNum, 1, 0);
+	}
+
+	template <class T>
+	void BTreeIndex::splitNonLeaf(NonLeafNode<T> *currNode, PageKeyPair<T> &newChild, RedoGroup &group)
+	{
+		// alloc new page for the right half
+		PageId newPageNum;
+		const PageHandle newHandle = bufMgr->allocPage(file, newPageNum);
+		PageGuard newPage(bufMgr, newHandle);
+		newPage.markDirty();
+		group.trackNew(newHandle);
+		NonLeafNode<T> *newNode = (NonLeafNode<T> *)newPage.page();
+		newNode->level = currNode->level;
+
+		// the key at mid moves up, the keys after it and the children right of it go to the new node
+		const int numKeys = currNode->numKeys;
+		const int mid = numKeys / 2;
+		const T pushedUp = currNode->keyArray[mid];
+		for (int i = mid + 1; i < numKeys; i++)
+		{
+			newNode->keyArray[i - mid - 1] = currNode->keyArray[i];
+		}
+		for (int i = mid + 1; i <= numKeys; i++)
+		{
+			newNode->pageNoArray[i - mid - 1] = currNode->pageNoArray[i];
+		}
+		newNode->numKeys = numKeys - mid - 1;
+		currNode->numKeys = mid;
+		nonLeafSummarize(newNode);
+		nonLeafSummarize(currNode);
+
+		newChild.set(newPageNum, pushedUp);
+		counters.nonLeafSplits.fetch_add(1, std::memory_order_relaxed);
+		BADGERDB_TRACE(TRACE_INDEX_NONLEAF_SPLIT, this, newPageNum, 1, 0);
+	}
+
+	template <class T>
+	void BTreeIndex::growRoot(const PageKeyPair<T> &newChild, const int level, RedoGroup &group)
+	{
+		PageId newRootPageNum;
+		{
+			const PageHandle newRootHandle = bufMgr->allocPage(file, newRootPageNum);
+			PageGuard newRootPage(bufMgr, newRootHandle);
+			group.trackNew(newRootHandle);
+			NonLeafNode<T> *newRoot = (NonLeafNode<T> *)newRootPage.page();
+			newRoot->level = level;
+			newRoot->numKeys = 1;
+			newRoot->keyArray[0] = newChild.key;
+			newRoot->pageNoArray[0] = rootPageNum;
+			newRoot->pageNoArray[1] = newChild.pageNo;
+			nonLeafSummarize(newRoot);
+			newRootPage.markDirty();
+		}
+
+		rootPageNum = newRootPageNum;
+		rootIsLeaf = false;
+		counters.rootSplits.fetch_add(1, std::memory_order_relaxed);
+		BADGERDB_TRACE(TRACE_INDEX_ROOT_SPLIT, this, newRootPageNum, 1, 0);
+		if (pinnedLevels > 0)
+		{
+			pinnedNodesStale = true;
+		}
+
+		// the root moved, so the metapage needs to be changed accordingly
+		const PageHandle headerHandle = bufMgr->readPage(file, headerPageNum);
+		PageGuard headerPage(bufMgr, headerHandle);
+		group.track(headerHandle);
+		IndexMetaInfo *metaInfo = (IndexMetaInfo *)headerPage.page();
+		metaInfo->rootPageNo = rootPageNum;
+		metaInfo->isRootALeaf = false;
+		headerPage.markDirty();
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::deleteEntry
+	// -----------------------------------------------------------------------------
+
+	bool BTreeIndex::deleteEntry(const void *_key, const RecordId rid)
+	{
+		if (file->isMapped())
+		{
+			throw ReadOnlyFileException(file->filename());
+		}
+		flushDelta();
+
+		bool deleted = false;
+		if (attributeType == INTEGER)
+		{
+			RIDKeyPair<int> pair;
+			pair.set(rid, keyFrom<int>(_key));
+			deleted = deletePair(pair);
+		}
+		else if (attributeType == DOUBLE)
+		{
+			RIDKeyPair<double> pair;
+			pair.set(rid, keyFrom<double>(_key));
+			deleted = deletePair(pair);
+		}
+		else if (attributeType == STRING)
+		{
+			RIDKeyPair<StringKey> pair;
+			pair.set(rid, keyFrom<StringKey>(_key));
+			deleted = deletePair(pair);
+		}
+		else if (attributeType == COMPOSITE)
+		{
+			RIDKeyPair<CompositeKey> pair;
+			pair.set(rid, keyFrom<CompositeKey>(_key));
+			deleted = deletePair(pair);
+		}
+
+		// only once the delete is done, or it would keep the pages it retired itself
+		freeRetiredPages();
+		return deleted;
+	}
+
+	template <class T>
+	bool BTreeIndex::deletePair(const RIDKeyPair<T> &pair)
+	{
+		WriterGuard writer(writers);
+		OperationGuard operation(operations);
+		std::uint64_t visits = 0;
+		std::uint64_t retries = 0;
+		bool deleted = false;
+		while (true)
+		{
+			const std::shared_ptr<const PinnedSet> pinned = std::atomic_load(&pinnedNodes);
+			if (tryDelete(pair, pinned.get(), visits, deleted))
+			{
+				break;
+			}
+			retries++;
+		}
+		counters.deletes.fetch_add(1, std::memory_order_relaxed);
+		counters.deleteNodeVisits.fetch_add(visits, std::memory_order_relaxed);
+		BADGERDB_TRACE(TRACE_INDEX_DESCENT, this, Page::INVALID_NUMBER, visits, 0);
+		if (retries > 0)
+		{
+			counters.deleteRetries.fetch_add(retries, std::memory_order_relaxed);
+		}
+		return deleted;
+	}
+
+	template <class T>
+	bool BTreeIndex::tryDelete(const RIDKeyPair<T> &pair, const PinnedSet *pinned, std::uint64_t &visits, bool &deleted)
+	{
+		OptimisticLatch *parentLatch = &latches.latchFor(headerPageNum);
+		std::uint64_t parentVersion;
+		bool isLeaf;
+		PageId pageNo = readRoot(isLeaf, parentVersion);
+		PageHandle parent;
+		int parentIndex = 0;
+
+		while (!isLeaf)
+		{
+			const PageHandle node = readNode(pinned, pageNo);
+			visits++;
+			NonLeafNode<T> *currNonLeafNode = (NonLeafNode<T> *)node.page;
+			OptimisticLatch &latch = latches.latchFor(pageNo);
+			const std::uint64_t version = latch.readLock();
+			// equal keys may sit left of a separator equal to them, so go left on equality like a search does
+			const int index = nonLeafLowerBound(currNonLeafNode, pair.key);
+			const PageId childPageNo = currNonLeafNode->pageNoArray[index];
+			const bool childIsLeaf = (currNonLeafNode->level == 1);
+			const bool valid = parentLatch->validate(parentVersion) && latch.validate(version);
+			if (parent.page != NULL)
+			{
+				unPinNode(pinned, parent, false);
+			}
+			if (!valid)
+			{
+				unPinNode(pinned, node, false);
+				return false;
+			}
+			parent = node;
+			parentLatch = &latch;
+			parentVersion = version;
+			parentIndex = index;
+			pageNo = childPageNo;
+			isLeaf = childIsLeaf;
+		}
+
+		deleted = false;
+		bool firstLeaf = true;
+		RedoGroup group(bufMgr);
+		while (true)
+		{
+			const PageHandle leaf = bufMgr->readPage(file, pageNo);
+			visits++;
+			typename LeafNodeOf<T>::type *currLeafNode = (typename LeafNodeOf<T>::type *)leaf.page;
+			OptimisticLatch &latch = latches.latchFor(pageNo);
+			bool latched;
+			if (firstLeaf)
+			{
+				const std::uint64_t version = latch.readLock();
+				latched = parentLatch->validate(parentVersion) && latch.upgrade(version);
+			}
+			else
+			{
+				// reached through a sibling link read before; a leaf merged away since must not change any more
+				latch.writeLock();
+				latched = !isRetired(pageNo);
+				if (!latched)
+				{
+					latch.writeUnlock();
+				}
+			}
+			if (!latched)
+			{
+				bufMgr->unPinPage(leaf, false);
+				if (parent.page != NULL)
+				{
+					unPinNode(pinned, parent, false);
+				}
+				return false;
+			}
+
+			changeNode(group, leaf);
+			// the entries of the key up to the one with the rid
+			int pos = leafLowerBound(currLeafNode, pair.key);
+			while (pos < currLeafNode->numKeys && !(pair.key < leafKey(currLeafNode, pos)) &&
+				   !(leafRid(currLeafNode, pos) == pair.rid))
+			{
+				pos++;
+			}
+			const bool found = pos < currLeafNode->numKeys && !(pair.key < leafKey(currLeafNode, pos));
+			PageId nextPageNo = Page::INVALID_NUMBER;
+			bool parentDirty = false;
+			if (found)
+			{
+				leafRemove(currLeafNode, pos);
+				deleted = true;
+				// only the leaf the descent ended in has its parent at hand
+				if (parent.page != NULL && (currLeafNode->numKeys == 0 || leafFill(currLeafNode) < mergeThreshold))
+				{
+					try
+					{
+						parentDirty = rebalanceLeaf<T>(currLeafNode, pageNo, parent, parentLatch, parentVersion, parentIndex,
+													   group);
+					}
+					catch (...)
+					{
+						latch.writeUnlock();
+						bufMgr->unPinPage(leaf, true);
+						unPinNode(pinned, parent, false);
+						throw;
+					}
+				}
+			}
+			else if (pos == currLeafNode->numKeys)
+			{
+				// the leaf ended before a larger key did, so the entry may be in the right sibling
+				nextPageNo = currLeafNode->rightSibPageNo;
+			}
+			group.log();
+			latch.writeUnlock();
+			bufMgr->unPinPage(leaf, found);
+			if (parent.page != NULL)
+			{
+				unPinNode(pinned, parent, parentDirty);
+				parent = PageHandle();
+			}
+			if (found || nextPageNo == Page::INVALID_NUMBER)
+			{
+				group.commit();
+				return true;
+			}
+			pageNo = nextPageNo;
+			firstLeaf = false;
+		}
+	}
+
+	template <class T>
+	bool BTreeIndex::rebalanceLeaf(typename LeafNodeOf<T>::type *leafNode, const PageId pageNo, const PageHandle &parent,
+								   OptimisticLatch *parentLatch, const std::uint64_t parentVersion, const int childIndex,
+								   RedoGroup &group)
+	{
+		typedef typename LeafNodeOf<T>::type Leaf;
+		NonLeafNode<T> *parentNode = (NonLeafNode<T> *)parent.page;
+
+		// a parent changed since the descent read it is left as it is; a later delete gets to it
+		if (!parentLatch->upgrade(parentVersion))
+		{
+			return false;
+		}
+		if (parentNode->numKeys == 0)
+		{
+			// an only child has no sibling under its parent
+			parentLatch->writeUnlock();
+			return false;
+		}
+
+		// the leaf and its right sibling, or its left sibling and the leaf if it is the last child
+		const bool leafIsLeft = (childIndex < parentNode->numKeys);
+		const int rightIndex = leafIsLeft ? childIndex + 1 : childIndex;
+		const PageId siblingPageNo = parentNode->pageNoArray[leafIsLeft ? childIndex + 1 : childIndex - 1];
+		const PageId rightPageNo = leafIsLeft ? siblingPageNo : pageNo;
+		bool rebalanced = false;
+		try
+		{
+			const PageHandle siblingHandle = bufMgr->readPage(file, siblingPageNo);
+			PageGuard sibling(bufMgr, siblingHandle);
+			OptimisticLatch &siblingLatch = latches.latchFor(siblingPageNo);
+			// another writer on the sibling wins, the leaf stays as it is
+			if (siblingLatch.upgrade(siblingLatch.readLock()))
+			{
+				changeNode(group, parent);
+				if (!leafIsLeft)
+				{
+					changeNode(group, siblingHandle);
+				}
+				Leaf *left = leafIsLeft ? leafNode : (Leaf *)sibling.page();
+				const Leaf *right = leafIsLeft ? (const Leaf *)sibling.page() : leafNode;
+				try
+				{
+					if (leafMerge(left, right))
+					{
+						left->rightSibPageNo = right->rightSibPageNo;
+						removeNonLeafEntry(parentNode, rightIndex);
+						counters.leafMerges.fetch_add(1, std::memory_order_relaxed);
+					}
+					else
+					{
+						// the right leaf is replaced rather than changed, like a merged one
+						PageId newPageNum;
+						const PageHandle newHandle = bufMgr->allocPage(file, newPageNum, rightPageNo);
+						PageGuard newPage(bufMgr, newHandle);
+						newPage.markDirty();
+						group.trackNew(newHandle);
+						Leaf *newNode = (Leaf *)newPage.page();
+						leafInit(newNode, payloadSize);
+						leafRedistribute(left, right, newNode);
+						newNode->rightSibPageNo = right->rightSibPageNo;
+						left->rightSibPageNo = newPageNum;
+						parentNode->pageNoArray[rightIndex] = newPageNum;
+						parentNode->keyArray[rightIndex - 1] = leafKey(newNode, 0);
+						nonLeafSummarize(parentNode);
+						counters.leafBorrows.fetch_add(1, std::memory_order_relaxed);
+					}
+					retirePage(rightPageNo);
+					group.log();
+				}
+				catch (...)
+				{
+					siblingLatch.writeUnlock();
+					throw;
+				}
+				rebalanced = true;
+				if (!leafIsLeft)
+				{
+					sibling.markDirty();
+				}
+				siblingLatch.writeUnlock();
+			}
+		}
+		catch (...)
+		{
+			parentLatch->writeUnlock();
+			throw;
+		}
+		parentLatch->writeUnlock();
+		return rebalanced;
+	}
+
+	template <class T>
+	void BTreeIndex::removeNonLeafEntry(NonLeafNode<T> *currNode, const int childIndex)
+	{
+		// shift all right values one place to the left
+		for (int i = childIndex; i < currNode->numKeys; i++)
+		{
+			currNode->keyArray[i - 1] = currNode->keyArray[i];
+			currNode->pageNoArray[i] = currNode->pageNoArray[i + 1];
+		}
+		currNode->numKeys--;
+		nonLeafSummarize(currNode);
+	}
+
+	void BTreeIndex::retirePage(const PageId pageNo)
+	{
+		// the page is unlinked already, so only operations of this epoch or earlier can still reach it
+		const std::uint64_t epoch = operations.currentEpoch();
+		std::lock_guard<std::mutex> guard(retiredLatch);
+		retiredPages[pageNo] = epoch;
+	}
+
+	bool BTreeIndex::isRetired(const PageId pageNo)
+	{
+		std::lock_guard<std::mutex> guard(retiredLatch);
+		return retiredPages.find(pageNo) != retiredPages.end();
+	}
+
+	void BTreeIndex::freeRetiredPages()
+	{
+		std::vector<PageId> pages;
+		{
+			std::lock_guard<std::mutex> guard(retiredLatch);
+			if (retiredPages.empty())
+			{
+				return;
+			}
+			// an operation running since before a page was retired may still read it
+			const std::uint64_t safe = operations.safeEpoch();
+			std::unordered_map<PageId, std::uint64_t>::iterator it = retiredPages.begin();
+			while (it != retiredPages.end())
+			{
+				if (it->second <= safe)
+				{
+					pages.push_back(it->first);
+					it = retiredPages.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+		}
+		// in page order, as the free list of the file would hand them out
+		std::sort(pages.begin(), pages.end());
+		for (std::size_t i = 0; i < pages.size(); i++)
+		{
+			bufMgr->disposePage(file, pages[i]);
+		}
+		counters.freedPages.fetch_add(pages.size(), std::memory_order_relaxed);
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::compact
+	// -----------------------------------------------------------------------------
+
+	void BTreeIndex::compact(const double fillFactor)
+	{
+		if (file->isMapped())
+		{
+			throw ReadOnlyFileException(file->filename());
+		}
+
+		// buffered inserts go into the old tree first, so that the copy holds them
+		flushDelta();
+		{
+			std::lock_guard<std::mutex> guard(compactLatch);
+			writers.close();
+			try
+			{
+				if (attributeType == INTEGER)
+				{
+					compactTree<int>(fillFactor);
+				}
+				else if (attributeType == DOUBLE)
+				{
+					compactTree<double>(fillFactor);
+				}
+				else if (attributeType == STRING)
+				{
+					compactTree<StringKey>(fillFactor);
+				}
+				else
+				{
+					compactTree<CompositeKey>(fillFactor);
+				}
+				// the new tree is not logged, so it is made durable before logged changes build on it
+				if (bufMgr->getRedoLog() != NULL)
+				{
+					bufMgr->checkpoint();
+				}
+			}
+			catch (...)
+			{
+				writers.open();
+				throw;
+			}
+			writers.open();
+		}
+		counters.compactions.fetch_add(1, std::memory_order_relaxed);
+
+		// frees the old tree right away unless lookups or scans are still on it
+		freeRetiredPages();
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::warmUp
+	// -----------------------------------------------------------------------------
+
+	std::size_t BTreeIndex::warmUp(const std::string &pageList)
+	{
+		return bufMgr->warmUp(pageList, std::vector<File *>(1, file));
+	}
+
+	template <class T>
+	void BTreeIndex::compactTree(const double fillFactor)
+	{
+		// with the writers kept out the old tree holds still, so it is read without its latches
+		bool isLeaf;
+		std::uint64_t version;
+		PageId pageNo = readRoot(isLeaf, version);
+		std::vector<PageId> oldPages;
+
+		// the non-leaf levels top down, to find the leftmost leaf and every page to retire
+		std::vector<PageId> levelPages;
+		if (!isLeaf)
+		{
+			levelPages.push_back(pageNo);
+		}
+		while (!levelPages.empty())
+		{
+			std::vector<PageId> nextLevelPages;
+			bool aboveLeaves = false;
+			for (std::size_t i = 0; i < levelPages.size(); i++)
+			{
+				PageGuard page(bufMgr, bufMgr->readPage(file, levelPages[i], SEQUENTIAL_ACCESS));
+				const NonLeafNode<T> *node = (const NonLeafNode<T> *)page.page();
+				if (i == 0)
+				{
+					pageNo = node->pageNoArray[0];
+				}
+				aboveLeaves = (node->level == 1);
+				nextLevelPages.insert(nextLevelPages.end(), node->pageNoArray, node->pageNoArray + node->numKeys + 1);
+				oldPages.push_back(levelPages[i]);
+			}
+			if (aboveLeaves)
+			{
+				break;
+			}
+			levelPages.swap(nextLevelPages);
+		}
+
+		// the leaves are in key order along the sibling links, so they feed the bulk loader as they are read
+		std::vector<PageKeyPair<T> > children;
+		bulkLoadBegin(fillFactor);
+		while (pageNo != Page::INVALID_NUMBER)
+		{
+			PageGuard page(bufMgr, bufMgr->readPage(file, pageNo, SEQUENTIAL_ACCESS));
+			const typename LeafNodeOf<T>::type *leaf = (const typename LeafNodeOf<T>::type *)page.page();
+			for (int i = 0; i < leaf->numKeys; i++)
+			{
+				RIDKeyPair<T> pair;
+				pair.set(leafRid(leaf, i), leafKey(leaf, i));
+				bulkLoadAppend(pair, leafPayload(leaf, i), children);
+			}
+			oldPages.push_back(pageNo);
+			pageNo = leaf->rightSibPageNo;
+		}
+		bulkLoadFinish(children);
+
+		// the filter is sized anew for the keys there are now; the saved one is dropped with the old tree
+		if (bloomBitsPerKey > 0)
+		{
+			buildBloom<T>();
+			retireBloomPages();
+		}
+
+		PageGuard headerPage(bufMgr, bufMgr->readPage(file, headerPageNum));
+		IndexMetaInfo *metaInfo = (IndexMetaInfo *)headerPage.page();
+		metaInfo->rootPageNo = rootPageNum;
+		metaInfo->isRootALeaf = rootIsLeaf;
+		metaInfo->bloomPageNo = bloomPageNum;
+		headerPage.markDirty();
+
+		if (pinnedLevels > 0)
+		{
+			pinUpperLevels<T>();
+		}
+		for (std::size_t i = 0; i < oldPages.size(); i++)
+		{
+			retirePage(oldPages[i]);
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::buildBloom
+	// -----------------------------------------------------------------------------
+
+	template <class T>
+	void BTreeIndex::buildBloom()
+	{
+		// down the leftmost children to the first leaf
+		bool isLeaf;
+		std::uint64_t version;
+		PageId pageNo = readRoot(isLeaf, version);
+		while (!isLeaf)
+		{
+			PageGuard page(bufMgr, bufMgr->readPage(file, pageNo));
+			const NonLeafNode<T> *node = (const NonLeafNode<T> *)page.page();
+			isLeaf = (node->level == 1);
+			pageNo = node->pageNoArray[0];
+		}
+
+		// the keys are in order along the leaves, so each distinct key is hashed once and the filter sized for them
+		std::vector<std::uint64_t> hashes;
+		T lastKey = T();
+		while (pageNo != Page::INVALID_NUMBER)
+		{
+			PageGuard page(bufMgr, bufMgr->readPage(file, pageNo, SEQUENTIAL_ACCESS));
+			const typename LeafNodeOf<T>::type *leaf = (const typename LeafNodeOf<T>::type *)page.page();
+			for (int i = 0; i < leaf->numKeys; i++)
+			{
+				const T key = leafKey(leaf, i);
+				if (hashes.empty() || !(key == lastKey))
+				{
+					hashes.push_back(bloomHash(key));
+					lastKey = key;
+				}
+			}
+			pageNo = leaf->rightSibPageNo;
+		}
+
+		std::shared_ptr<BloomFilter> filter(new BloomFilter(hashes.size(), bloomBitsPerKey));
+		for (std::size_t i = 0; i < hashes.size(); i++)
+		{
+			filter->addHash(hashes[i]);
+		}
+		std::atomic_store(&bloom, filter);
+	}
+
+	bool BTreeIndex::loadBloom(const std::uint32_t blocks)
+	{
+		std::shared_ptr<BloomFilter> filter(new BloomFilter(BloomFilter::withBlocks(blocks)));
+		std::uint32_t done = 0;
+		PageId pageNo = bloomPageNum;
+		while (pageNo != Page::INVALID_NUMBER && done < blocks)
+		{
+			PageGuard page(bufMgr, bufMgr->readPage(file, pageNo, SEQUENTIAL_ACCESS));
+			const BloomPage *bloomPage = (const BloomPage *)page.page();
+			const std::uint32_t pageBlocks = std::min<std::uint32_t>(bloomPage->numBlocks, blocks - done);
+			memcpy(filter->data() + (std::size_t)done * BloomFilter::BLOCK_SIZE, bloomPage->blocks,
+				   (std::size_t)pageBlocks * BloomFilter::BLOCK_SIZE);
+			done += pageBlocks;
+			pageNo = bloomPage->nextPageNo;
+		}
+		if (done < blocks || blocks == 0)
+		{
+			return false;
+		}
+		std::atomic_store(&bloom, filter);
+		return true;
+	}
+
+	void BTreeIndex::saveBloom()
+	{
+		const std::shared_ptr<BloomFilter> filter = std::atomic_load(&bloom);
+		const std::uint32_t blocks = filter->blocks();
+
+		// the filter goes over the chain it was read from, with pages added for the blocks the chain does not hold
+		std::vector<PageId> pages;
+		PageId pageNo = bloomPageNum;
+		while (pageNo != Page::INVALID_NUMBER)
+		{
+			PageGuard page(bufMgr, bufMgr->readPage(file, pageNo));
+			pages.push_back(pageNo);
+			pageNo = ((const BloomPage *)page.page())->nextPageNo;
+		}
+		while (pages.size() * BLOOM_PAGE_BLOCKS < blocks)
+		{
+			PageGuard page(bufMgr, bufMgr->allocPage(file, pageNo));
+			pages.push_back(pageNo);
+		}
+
+		std::uint32_t done = 0;
+		for (std::size_t i = 0; i < pages.size(); i++)
+		{
+			PageGuard page(bufMgr, bufMgr->readPage(file, pages[i]));
+			BloomPage *bloomPage = (BloomPage *)page.page();
+			bloomPage->nextPageNo = (i + 1 < pages.size()) ? pages[i + 1] : Page::INVALID_NUMBER;
+			bloomPage->numBlocks = std::min<std::uint32_t>(BLOOM_PAGE_BLOCKS, blocks - done);
+			memcpy(bloomPage->blocks, filter->data() + (std::size_t)done * BloomFilter::BLOCK_SIZE,
+				   (std::size_t)bloomPage->numBlocks * BloomFilter::BLOCK_SIZE);
+			done += bloomPage->numBlocks;
+			page.markDirty();
+		}
+		bloomPageNum = pages[0];
+
+		// the blocks are on disk before the meta page says they hold every key
+		bufMgr->flushFile(file);
+		PageGuard headerPage(bufMgr, bufMgr->readPage(file, headerPageNum));
+		IndexMetaInfo *metaInfo = (IndexMetaInfo *)headerPage.page();
+		metaInfo->bloomPageNo = bloomPageNum;
+		metaInfo->bloomBlocks = blocks;
+		metaInfo->bloomValid = true;
+		headerPage.markDirty();
+	}
+
+	void BTreeIndex::retireBloomPages()
+	{
+		PageId pageNo = bloomPageNum;
+		while (pageNo != Page::INVALID_NUMBER)
+		{
+			PageGuard page(bufMgr, bufMgr->readPage(file, pageNo));
+			retirePage(pageNo);
+			pageNo = ((const BloomPage *)page.page())->nextPageNo;
+		}
+		bloomPageNum = Page::INVALID_NUMBER;
+	}
+
+	template <class T>
+	bool BTreeIndex::bloomRejects(const T &key)
+	{
+		const std::shared_ptr<BloomFilter> filter = std::atomic_load(&bloom);
+		if (filter && !filter->mayContainHash(bloomHash(key)))
+		{
+			counters.bloomRejects.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::getStats
+	// -----------------------------------------------------------------------------
+
+	void BTreeIndex::OperationCounters::clear()
+	{
+		inserts = insertNodeVisits = insertRetries = 0;
+		leafSplits = nonLeafSplits = rootSplits = 0;
+		scans = scanNodeVisits = scanNexts = scanNextNodeVisits = 0;
+		lookups = lookupNodeVisits = lookupYields = 0;
+		deletes = deleteNodeVisits = deleteRetries = 0;
+		leafMerges = leafBorrows = freedPages = 0;
+		compactions = deltaFlushes = bloomRejects = 0;
+	}
+
+	BTreeStats BTreeIndex::getStats()
+	{
+		flushDelta();
+		BTreeStats stats;
+		{
+			OperationGuard operation(operations);
+			if (attributeType == INTEGER)
+			{
+				measureTree<int>(stats);
+			}
+			else if (attributeType == DOUBLE)
+			{
+				measureTree<double>(stats);
+			}
+			else if (attributeType == STRING)
+			{
+				measureTree<StringKey>(stats);
+			}
+			else
+			{
+				measureTree<CompositeKey>(stats);
+			}
+		}
+		stats.inserts = counters.inserts;
+		stats.insertNodeVisits = counters.insertNodeVisits;
+		stats.insertRetries = counters.insertRetries;
+		stats.leafSplits = counters.leafSplits;
+		stats.nonLeafSplits = counters.nonLeafSplits;
+		stats.rootSplits = counters.rootSplits;
+		stats.scans = counters.scans;
+		stats.scanNodeVisits = counters.scanNodeVisits;
+		stats.scanNexts = counters.scanNexts;
+		stats.scanNextNodeVisits = counters.scanNextNodeVisits;
+		stats.lookups = counters.lookups;
+		stats.lookupNodeVisits = counters.lookupNodeVisits;
+		stats.lookupYields = counters.lookupYields;
+		stats.deletes = counters.deletes;
+		stats.deleteNodeVisits = counters.deleteNodeVisits;
+		stats.deleteRetries = counters.deleteRetries;
+		stats.leafMerges = counters.leafMerges;
+		stats.leafBorrows = counters.leafBorrows;
+		stats.freedPages = counters.freedPages;
+		stats.compactions = counters.compactions;
+		stats.deltaFlushes = counters.deltaFlushes;
+		stats.bloomRejects = counters.bloomRejects;
+		stats.snapshotImages = versions.size();
+		return stats;
+	}
+
+	template <class T>
+	void BTreeIndex::measureTree(BTreeStats &stats)
+	{
+		bool isLeaf;
+		std::uint64_t version;
+		PageId leftmostLeaf = readRoot(isLeaf, version);
+
+		// the non-leaf levels top down; a walk does not make the nodes any hotter for the replacement policy
+		std::vector<PageId> levelPages;
+		if (!isLeaf)
+		{
+			levelPages.push_back(leftmostLeaf);
+		}
+		double nonLeafKeys = 0;
+		while (!levelPages.empty())
+		{
+			std::vector<PageId> nextLevelPages;
+			bool aboveLeaves = false;
+			for (std::size_t i = 0; i < levelPages.size(); i++)
+			{
+				PageGuard page(bufMgr, bufMgr->readPage(file, levelPages[i], SEQUENTIAL_ACCESS));
+				const NonLeafNode<T> *node = (const NonLeafNode<T> *)page.page();
+				OptimisticLatch &latch = latches.latchFor(levelPages[i]);
+				std::vector<PageId> children;
+				int numKeys;
+				int level;
+				while (true)
+				{
+					const std::uint64_t nodeVersion = latch.readLock();
+					numKeys = node->numKeys;
+					level = node->level;
+					children.assign(node->pageNoArray, node->pageNoArray + numKeys + 1);
+					if (latch.validate(nodeVersion))
+					{
+						break;
+					}
+				}
+				if (i == 0 && stats.height == 0)
+				{
+					stats.height = level + 1;
+				}
+				stats.nonLeafPages++;
+				nonLeafKeys += numKeys;
+				aboveLeaves = (level == 1);
+				if (i == 0)
+				{
+					leftmostLeaf = children[0];
+				}
+				nextLevelPages.insert(nextLevelPages.end(), children.begin(), children.end());
+			}
+			if (aboveLeaves)
+			{
+				break;
+			}
+			levelPages.swap(nextLevelPages);
+		}
+		if (stats.height == 0)
+		{
+			stats.height = 1;
+		}
+		if (stats.nonLeafPages > 0)
+		{
+			stats.nonLeafFill = nonLeafKeys / (stats.nonLeafPages * nodeOccupancy);
+		}
+
+		// the leaves left to right along the sibling links
+		double fill = 0;
+		Page leaf;
+		PageId pageNo = leftmostLeaf;
+		while (pageNo != Page::INVALID_NUMBER)
+		{
+			copyLeaf(pageNo, leaf);
+			const typename LeafNodeOf<T>::type *node = (const typename LeafNodeOf<T>::type *)&leaf;
+			stats.leafPages++;
+			stats.entries += node->numKeys;
+			fill += leafFill(node);
+			pageNo = node->rightSibPageNo;
+		}
+		stats.leafFill = fill / stats.leafPages;
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::startScan
+	// -----------------------------------------------------------------------------
+	/**
+	 * Begin a filtered scan of the index.  For instance, if the method is called
+	 * using ("a",GT,"d",LTE) then we should seek all entries with a value
+	 * greater than "a" and less than or equal to "d".
+	 * If another scan is already executing, that needs to be ended here.
+	 * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
+	 * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
+	 * @param lowVal	Low value of range, pointer to integer / double / char string
+	 * @param lowOp		Low operator (GT/GTE)
+	 * @param highVal	High value of range, pointer to integer / double / char string
+	 * @param highOp	High operator (LT/LTE)
+	 * @param scanOptions	Residual predicate on the keys and limit on the number of entries returned
+	 * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+	 * @throws  BadScanrangeException If lowVal > highval
+	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+	 **/
+
+	void BTreeIndex::startScan(const void *lowValParm,
+							   const Operator lowOpParm,
+							   const void *highValParm,
+							   const Operator highOpParm,
+							   const ScanOptions &scanOptions)
+	{
+		scanCursor.startScan(lowValParm, lowOpParm, highValParm, highOpParm, scanOptions);
+	}
+
+	void BTreeIndex::scanNext(RecordId &outRid)
+	{
+		scanCursor.scanNext(outRid);
+	}
+
+	std::size_t BTreeIndex::scanNextBatch(RecordId *outRids, const std::size_t maxRids)
+	{
+		return scanCursor.scanNextBatch(outRids, maxRids);
+	}
+
+	std::size_t BTreeIndex::scanNextCovered(RecordId *outRids, void *outPayloads, const std::size_t maxRids)
+	{
+		return scanCursor.scanNextCovered(outRids, outPayloads, maxRids);
+	}
+
+	void BTreeIndex::endScan()
+	{
+		scanCursor.endScan();
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::lookup
+	// -----------------------------------------------------------------------------
+
+	std::size_t BTreeIndex::lookup(const void *key, RecordId *outRids, const std::size_t maxRids)
+	{
+		flushDelta();
+		if (attributeType == INTEGER)
+		{
+			return lookupKey(keyFrom<int>(key), outRids, maxRids);
+		}
+		else if (attributeType == DOUBLE)
+		{
+			return lookupKey(keyFrom<double>(key), outRids, maxRids);
+		}
+		else if (attributeType == STRING)
+		{
+			return lookupKey(keyFrom<StringKey>(key), outRids, maxRids);
+		}
+		return lookupKey(keyFrom<CompositeKey>(key), outRids, maxRids);
+	}
+
+	/**
+	 * Record ids found by leafMatches(), in an array of fixed size.
+	 */
+	struct ArrayMatches
+	{
+		RecordId *rids;
+		std::size_t maxRids;
+		std::size_t count;
+
+		ArrayMatches(RecordId *rids, const std::size_t maxRids) : rids(rids), maxRids(maxRids), count(0)
+		{
+		}
+
+		std::size_t size() const
+		{
+			return count;
+		}
+
+		bool full() const
+		{
+			return count >= maxRids;
+		}
+
+		void add(const RecordId &rid)
+		{
+			rids[count++] = rid;
+		}
+
+		void truncate(const std::size_t size)
+		{
+			count = size;
+		}
+	};
+
+	/**
+	 * Record ids found by leafMatches(), appended to a vector.
+	 */
+	struct VectorMatches
+	{
+		std::vector<RecordId> &rids;
+
+		explicit VectorMatches(std::vector<RecordId> &rids) : rids(rids)
+		{
+		}
+
+		std::size_t size() const
+		{
+			return rids.size();
+		}
+
+		bool full() const
+		{
+			return false;
+		}
+
+		void add(const RecordId &rid)
+		{
+			rids.push_back(rid);
+		}
+
+		void truncate(const std::size_t size)
+		{
+			rids.resize(size);
+		}
+	};
+
+	template <class T, class Matches>
+	std::size_t BTreeIndex::leafMatches(const PageId pageNo, const Page *page, const T &key, Matches &matches, PageId &nextPageNum)
+	{
+		OptimisticLatch &latch = latches.latchFor(pageNo);
+		const std::size_t start = matches.size();
+		while (true)
+		{
+			// read the leaf in place; a writer changing it meanwhile makes the matches copied so far
+			// worthless, so they are copied again from the start of the leaf
+			const std::uint64_t version = latch.readLock();
+			const typename LeafNodeOf<T>::type *currentNode = (const typename LeafNodeOf<T>::type *)page;
+			matches.truncate(start);
+			nextPageNum = Page::INVALID_NUMBER;
+			if (leafInBounds(currentNode))
+			{
+				int i = leafLowerBound(currentNode, key);
+				while (i < currentNode->numKeys && !matches.full() && !(key < leafKey(currentNode, i)))
+				{
+					matches.add(leafRid(currentNode, i));
+					i++;
+				}
+				// the leaf ended before a larger key did, so matches may go on in the right sibling
+				if (i == currentNode->numKeys)
+				{
+					nextPageNum = currentNode->rightSibPageNo;
+				}
+			}
+			if (latch.validate(version))
+			{
+				return matches.size() - start;
+			}
+		}
+	}
+
+	template <class T>
+	std::size_t BTreeIndex::lookupKey(const T &key, RecordId *outRids, const std::size_t maxRids)
+	{
+		counters.lookups.fetch_add(1, std::memory_order_relaxed);
+		if (maxRids == 0 || bloomRejects(key))
+		{
+			return 0;
+		}
+
+		OperationGuard operation(operations);
+		std::uint64_t visits = 0;
+		PageId pageNum = findLeaf(key, visits);
+		ArrayMatches matches(outRids, maxRids);
+		while (!matches.full() && pageNum != Page::INVALID_NUMBER)
+		{
+			PageGuard page(bufMgr, bufMgr->readPage(file, pageNum));
+			visits++;
+			leafMatches(pageNum, page.page(), key, matches, pageNum);
+		}
+		counters.lookupNodeVisits.fetch_add(visits, std::memory_order_relaxed);
+		BADGERDB_TRACE(TRACE_INDEX_DESCENT, this, Page::INVALID_NUMBER, visits, 0);
+		return matches.size();
+	}
+
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::lookupBatch
+	// -----------------------------------------------------------------------------
+
+	template <class T>
+	std::vector<T> BTreeIndex::keysFrom(const void *const *keys, const std::size_t numKeys) const
+	{
+		std::vector<T> probes(numKeys);
+		for (std::size_t i = 0; i < numKeys; i++)
+		{
+			probes[i] = keyFrom<T>(keys[i]);
+		}
+		return probes;
+	}
+
+	void BTreeIndex::lookupBatch(const void *const *keys, const std::size_t numKeys, std::vector<RecordId> &outRids,
+								 std::vector<std::size_t> &outOffsets)
+	{
+		flushDelta();
+		if (attributeType == INTEGER)
+		{
+			lookupFiltered(keysFrom<int>(keys, numKeys), outRids, outOffsets, 0, false);
+		}
+		else if (attributeType == DOUBLE)
+		{
+			lookupFiltered(keysFrom<double>(keys, numKeys), outRids, outOffsets, 0, false);
+		}
+		else if (attributeType == STRING)
+		{
+			lookupFiltered(keysFrom<StringKey>(keys, numKeys), outRids, outOffsets, 0, false);
+		}
+		else
+		{
+			lookupFiltered(keysFrom<CompositeKey>(keys, numKeys), outRids, outOffsets, 0, false);
+		}
+	}
+
+	template <class T>
+	void BTreeIndex::lookupFiltered(const std::vector<T> &probes, std::vector<RecordId> &outRids, std::vector<std::size_t> &outOffsets,
+									const std::size_t groupSize, const bool interleaved)
+	{
+		const std::shared_ptr<BloomFilter> filter = std::atomic_load(&bloom);
+		std::vector<T> passed;
+		std::vector<std::size_t> passedIndex;
+		for (std::size_t i = 0; i < probes.size(); i++)
+		{
+			if (!filter || filter->mayContainHash(bloomHash(probes[i])))
+			{
+				passed.push_back(probes[i]);
+				passedIndex.push_back(i);
+			}
+		}
+		const std::size_t rejected = probes.size() - passed.size();
+		counters.lookups.fetch_add(rejected, std::memory_order_relaxed);
+		counters.bloomRejects.fetch_add(rejected, std::memory_order_relaxed);
+
+		std::vector<std::size_t> passedOffsets;
+		if (interleaved)
+		{
+			lookupProbes(passed, outRids, passedOffsets, groupSize);
+		}
+		else
+		{
+			lookupKeys(passed, outRids, passedOffsets);
+		}
+
+		// a rejected key gets the empty range where the matches of the next passed key begin
+		outOffsets.assign(probes.size() + 1, 0);
+		std::size_t next = 0;
+		for (std::size_t i = 0; i < probes.size(); i++)
+		{
+			outOffsets[i] = passedOffsets[next];
+			if (next < passedIndex.size() && passedIndex[next] == i)
+			{
+				next++;
+			}
+		}
+		outOffsets[probes.size()] = passedOffsets[passed.size()];
+	}
+
+	/**
+	 * Orders the positions of probes by their keys.
+	 */
+	template <class T>
+	struct ProbeLess
 	{
-		std::ostringstream idxStr;
-		idxStr << relationName << '.' << attrByteOffset;
-		outIndexName = idxStr.str();
+		const std::vector<T> &probes;
 
-		// initialize
-		this->bufMgr = bufMgrIn;
-		this->attrByteOffset = attrByteOffset;
-		this->attributeType = attrType;
+		explicit ProbeLess(const std::vector<T> &probes) : probes(probes)
+		{
+		}
 
-		this->currentPageData = new Page;
-		this->currentPageNum = Page::INVALID_NUMBER;
-		this->rootPageNum = Page::INVALID_NUMBER;
-		this->headerPageNum = Page::INVALID_NUMBER;
-		this->scanExecuting = false;
-		this->nextEntry = -1;
+		bool operator()(const std::size_t a, const std::size_t b) const
+		{
+			return probes[a] < probes[b];
+		}
+	};
 
-		if (this->attributeType == INTEGER)
+	template <class T>
+	PageId BTreeIndex::descendPath(std::vector<PathLevel<T> > &path, const T &key, std::uint64_t &visits, bool &fenced, T &fence)
+	{
+		// climb to the deepest node whose range still holds the key
+		while (!path.empty() && path.back().bounded && path.back().fence < key)
 		{
-			this->nodeOccupancy = INTARRAYNONLEAFSIZE;
-			this->leafOccupancy = INTARRAYLEAFSIZE;
+			path.pop_back();
 		}
 
-		// Check to see if the corresponding index file exists. If so, open the file.
-		// If not, create it
-		if (BlobFile::exists(outIndexName) == true)
+		const std::shared_ptr<const PinnedSet> pinned = std::atomic_load(&pinnedNodes);
+		while (true)
 		{
-			// File found, so use it
-			file = new BlobFile(outIndexName, false);
-			headerPageNum = file->getFirstPageNo();
-			// init page to store in
-			Page *headerPage;
-			// get page by pageNum and store in headerPage, which should be a META INFO page
-			bufMgr->readPage(file, headerPageNum, headerPage);
-			IndexMetaInfo *metaInfoPage = (IndexMetaInfo *)headerPage;
-			rootPageNum = metaInfoPage->rootPageNo;
-			// unpin page, and its not dirty because we only READ from it
-			bufMgr->unPinPage(file, headerPageNum, false);
+			PathLevel<T> level;
+			bool isLeaf = false;
+			if (path.empty())
+			{
+				std::uint64_t rootVersion;
+				level.pageNo = readRoot(isLeaf, rootVersion);
+				level.bounded = false;
+			}
+			else
+			{
+				level = path.back();
+				path.pop_back();
+			}
+
+			bool valid = true;
+			while (!isLeaf)
+			{
+				const PageHandle node = readNode(pinned.get(), level.pageNo);
+				visits++;
+				OptimisticLatch &latch = latches.latchFor(level.pageNo);
+				const std::uint64_t version = latch.readLock();
+				NonLeafNode<T> *currentNode = (NonLeafNode<T> *)node.page;
+				const int index = nonLeafLowerBound(currentNode, key);
+				PathLevel<T> child;
+				child.pageNo = currentNode->pageNoArray[index];
+				// the child's range ends at the key right of its pointer, which duplicates of it may straddle,
+				// or where the node's own range ends
+				child.bounded = level.bounded || index < currentNode->numKeys;
+				child.fence = (index < currentNode->numKeys) ? currentNode->keyArray[index] : level.fence;
+				const bool childIsLeaf = (currentNode->level == 1);
+				valid = latch.validate(version);
+				unPinNode(pinned.get(), node, false);
+				if (!valid)
+				{
+					break;
+				}
+				path.push_back(level);
+				level = child;
+				isLeaf = childIsLeaf;
+			}
+			if (valid)
+			{
+				fenced = level.bounded;
+				fence = level.fence;
+				return level.pageNo;
+			}
+			// a writer changed a node while we read it, start over from the root
+			path.clear();
 		}
-		else
+	}
+
+	template <class T>
+	void BTreeIndex::lookupKeys(const std::vector<T> &probes, std::vector<RecordId> &outRids, std::vector<std::size_t> &outOffsets)
+	{
+		OperationGuard operation(operations);
+		const std::size_t numKeys = probes.size();
+		outRids.clear();
+		outOffsets.assign(numKeys + 1, 0);
+		counters.lookups.fetch_add(numKeys, std::memory_order_relaxed);
+		if (numKeys == 0)
 		{
-			// File not found, so create it
-			file = new BlobFile(outIndexName, true);
-			Page *headerPage;
-			bufMgrIn->allocPage(file, headerPageNum, headerPage);
-			// insert metadata in header page
-			IndexMetaInfo *metaInfoPage = (IndexMetaInfo *)headerPage;
-
-			// copy relationName into the metaInfoPage
-			strcpy(metaInfoPage->relationName, relationName.c_str());
-			metaInfoPage->attrByteOffset = attrByteOffset;
-			metaInfoPage->attrType = attrType;
-			metaInfoPage->rootPageNo = rootPageNum;
-
-			// unpin page, and mark dirty because we wrote the meta info to the header page
-			bufMgr->unPinPage(file, headerPageNum, true);
-
-			// init root page for use
-			Page *rootPage;
-			bufMgrIn->allocPage(file, rootPageNum, rootPage);
-
-			// initialize root
-			NonLeafNodeInt *root = (NonLeafNodeInt *)rootPage;
-			for (int i = 0; i < nodeOccupancy; i++) {
-				root->keyArray[i] = INT32_MAX; // Piazza @381
-				root->pageNoArray[i] = Page::INVALID_NUMBER;
-			}
-
-			// insert entries for every tuple in the base relation using FileScan class.
-			FileScan *scanner = new FileScan(relationName, bufMgrIn);
-			std::string currRecord = scanner->getRecord();
-			RecordId recordId;
-			while (true)
+			return;
+		}
+
+		// look the keys up in ascending order, collecting the matches of each probe in that order
+		std::vector<std::size_t> order(numKeys);
+		for (std::size_t i = 0; i < numKeys; i++)
+		{
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), ProbeLess<T>(probes));
+		std::vector<RecordId> found;
+		VectorMatches matches(found);
+		std::vector<std::size_t> first(numKeys);
+		std::vector<std::size_t> count(numKeys);
+
+		std::vector<PathLevel<T> > path;
+		std::uint64_t visits = 0;
+		bool fenced;
+		T fence;
+		PageId pageNum = descendPath(path, probes[order[0]], visits, fenced, fence);
+		std::size_t next = 0;
+		// true while the matches of the current probe go on into the next leaf
+		bool continuing = false;
+		while (next < numKeys)
+		{
+			PageGuard leaf(bufMgr, bufMgr->readPage(file, pageNum));
+			visits++;
+			while (next < numKeys)
 			{
-				try
+				const std::size_t probe = order[next];
+				const T &key = probes[probe];
+				if (!continuing)
 				{
-					scanner->scanNext(recordId);
-					const char *currRecordStr = currRecord.c_str();
-					// cast to INT to make key compatible in the future
-					int *key = (int *)(currRecordStr + attrByteOffset);
-					insertEntry(key, recordId);
+					if (next > 0 && !(probes[order[next - 1]] < key))
+					{
+						// same key as the previous probe
+						first[probe] = first[order[next - 1]];
+						count[probe] = count[order[next - 1]];
+						next++;
+						continue;
+					}
+					first[probe] = matches.size();
+					count[probe] = 0;
 				}
-				catch (EndOfFileException &e)
+
+				PageId nextPageNum;
+				const std::size_t leafCount = leafMatches(pageNum, leaf.page(), key, matches, nextPageNum);
+				count[probe] += leafCount;
+				if (nextPageNum == Page::INVALID_NUMBER)
 				{
-					scanExecuting = false;
-					break;
+					// done with the key; the next one starts in the same leaf
+					continuing = false;
+					next++;
+					continue;
+				}
+				if (leafCount > 0 || continuing)
+				{
+					// duplicates of the key go on in the right sibling
+					continuing = true;
+					fenced = false;
+					pageNum = nextPageNum;
+				}
+				else if (fenced && !(fence < key))
+				{
+					// the key is larger than all entries of this leaf but within its range, so it can only be
+					// in the right sibling, as a duplicate of the fence or moved there by a split
+					fenced = false;
+					pageNum = nextPageNum;
+				}
+				else
+				{
+					pageNum = descendPath(path, key, visits, fenced, fence);
 				}
+				break;
 			}
-			// unpin page, and its not dirty because we only READ from it
-			bufMgr->unPinPage(file, rootPageNum, false);
 		}
+		counters.lookupNodeVisits.fetch_add(visits, std::memory_order_relaxed);
+		BADGERDB_TRACE(TRACE_INDEX_DESCENT, this, Page::INVALID_NUMBER, visits, 0);
+
+		// hand the matches out in the order of the probes
+		outRids.reserve(found.size());
+		for (std::size_t i = 0; i < numKeys; i++)
+		{
+			outOffsets[i] = outRids.size();
+			outRids.insert(outRids.end(), found.begin() + first[i], found.begin() + first[i] + count[i]);
+		}
+		outOffsets[numKeys] = outRids.size();
 	}
 
 	// -----------------------------------------------------------------------------
-	// BTreeIndex::~BTreeIndex -- destructor
+	// BTreeIndex::lookupInterleaved
 	// -----------------------------------------------------------------------------
 
-	BTreeIndex::~BTreeIndex()
+	bool BTreeIndex::tryReadNode(const PinnedSet *pinned, const PageId pageNo, PageHandle &node)
 	{
-		scanExecuting = false;
-		bufMgr->flushFile(file);
-		delete file;
+		const PageHandle *handle = (pinned != NULL) ? pinned->find(pageNo) : NULL;
+		if (handle != NULL)
+		{
+			node = *handle;
+			return true;
+		}
+		return bufMgr->tryReadPage(file, pageNo, node);
 	}
 
-	// -----------------------------------------------------------------------------
-	// BTreeIndex::insertEntry
-	// -----------------------------------------------------------------------------
 	/**
-	 * Insert a new entry using the pair <value,rid>.
-	 * Start from root to recursively find out the leaf to insert the entry in. The insertion may cause splitting of leaf node.
-	 * This splitting will require addition of new leaf page number entry into the parent non-leaf, which may in-turn get split.
-	 * This may continue all the way upto the root causing the root to get split. If root gets split, metapage needs to be changed accordingly.
-	 * Make sure to unpin pages as soon as you can.
-	 * @param key			Key to insert, pointer to integer/double/char string
-	 * @param rid			Record ID of a record whose entry is getting inserted into the index.
-	 **/
-	void BTreeIndex::insertEntry(const void *_key, const RecordId rid)
+	 * NextPageFn that ends read-ahead after the first page.
+	 */
+	static PageId noNextPage(const Page &)
 	{
-		// set up the RID-Key pair for insertion
-		// RIDKeyPair<int> pair;
-		// pair.set(rid, (*((int *)_key)));
+		return Page::INVALID_NUMBER;
+	}
+
+	/**
+	 * Ask the CPU to load the parts of a node a search reads first: the header and the middle of the entries.
+	 */
+	static void prefetchNode(const Page *page)
+	{
+		const char *node = (const char *)page;
+		__builtin_prefetch(node);
+		__builtin_prefetch(node + Page::SIZE / 4);
+		__builtin_prefetch(node + Page::SIZE / 2);
+		__builtin_prefetch(node + 3 * Page::SIZE / 4);
+	}
+
+	/**
+	 * State of one descent of an interleaved lookup.
+	 */
+	struct InterleavedProbe
+	{
+		/**
+		 * Position of the key among the probes, NO_PROBE once the group has run out of keys.
+		 */
+		std::size_t probe;
+
+		/**
+		 * Node to search next.
+		 */
+		PageId pageNo;
+
+		bool isLeaf;
+
+		/**
+		 * pageNo pinned and prefetched, or a handle to no page if it still has to be pinned.
+		 */
+		PageHandle node;
 
-		Page *headerPage;
-		bufMgr->readPage(file, headerPageNum, headerPage);
-		IndexMetaInfo *metaInfo = (IndexMetaInfo *)headerPage;
+		/**
+		 * True once pageNo was asked for in the background.
+		 */
+		bool requested;
+	};
 
-		bool isRootALeaf = metaInfo->isRootALeaf;
-		if (isRootALeaf == true)
+	static const std::size_t NO_PROBE = (std::size_t)-1;
+
+	void BTreeIndex::lookupInterleaved(const void *const *keys, const std::size_t numKeys, std::vector<RecordId> &outRids,
+									   std::vector<std::size_t> &outOffsets, const std::size_t groupSize)
+	{
+		flushDelta();
+		if (attributeType == INTEGER)
+		{
+			lookupFiltered(keysFrom<int>(keys, numKeys), outRids, outOffsets, groupSize, true);
+		}
+		else if (attributeType == DOUBLE)
 		{
-			insertToLeaf(_key, rid, rootPageNum);
+			lookupFiltered(keysFrom<double>(keys, numKeys), outRids, outOffsets, groupSize, true);
+		}
+		else if (attributeType == STRING)
+		{
+			lookupFiltered(keysFrom<StringKey>(keys, numKeys), outRids, outOffsets, groupSize, true);
 		}
 		else
 		{
-			insertToNonLeaf(_key, rid, rootPageNum);
+			lookupFiltered(keysFrom<CompositeKey>(keys, numKeys), outRids, outOffsets, groupSize, true);
 		}
-		// Unpin and flush to disk
-		bufMgr->unPinPage(file, rootPageNum, true);
 	}
 
-	/**
-	 * @brief
-	 *
-	 * @param key		Key to insert, pointer to integer/double/char string
-	 * @param rid		Record ID of a record whose entry is getting inserted into the index.
-	 * @param isLeaf 	boolean if dealing with leaf or not
-	 * @param pageNo 	page number to work with
-	 */
-	void BTreeIndex::insertEntry(const void *_key, const RecordId rid, bool isLeaf, PageId pageNo)
+	template <class T>
+	void BTreeIndex::lookupProbes(const std::vector<T> &probes, std::vector<RecordId> &outRids, std::vector<std::size_t> &outOffsets,
+								  const std::size_t groupSize)
 	{
-		if (isLeaf == true)
+		OperationGuard operation(operations);
+		const std::size_t numKeys = probes.size();
+		outRids.clear();
+		outOffsets.assign(numKeys + 1, 0);
+		counters.lookups.fetch_add(numKeys, std::memory_order_relaxed);
+		if (numKeys == 0)
 		{
-			insertToLeaf(_key, rid, pageNo);
+			return;
 		}
-		else
+
+		const std::shared_ptr<const PinnedSet> pinned = std::atomic_load(&pinnedNodes);
+		// the matches of a key are gathered apart from the others, which go on meanwhile, and added to
+		// found once the key is done
+		std::vector<RecordId> found;
+		std::vector<std::size_t> first(numKeys);
+		std::vector<std::size_t> count(numKeys);
+		std::vector<std::vector<RecordId> > gathered(std::max<std::size_t>(1, std::min(groupSize, numKeys)));
+		std::vector<InterleavedProbe> group(std::max<std::size_t>(1, std::min(groupSize, numKeys)));
+		std::size_t nextProbe = 0;
+		std::size_t active = 0;
+		std::uint64_t visits = 0;
+		std::uint64_t yields = 0;
+		std::uint64_t rootVersion;
+		for (std::size_t g = 0; g < group.size(); g++)
+		{
+			group[g].probe = nextProbe++;
+			group[g].pageNo = readRoot(group[g].isLeaf, rootVersion);
+			group[g].requested = false;
+			active++;
+		}
+
+		try
+		{
+			// false after a round in which every descent waited for the disk; one of them then waits in readNode()
+			bool progressed = true;
+			while (active > 0)
+			{
+				bool mayWait = !progressed;
+				progressed = false;
+				for (std::size_t g = 0; g < group.size(); g++)
+				{
+					InterleavedProbe &state = group[g];
+					if (state.probe == NO_PROBE)
+					{
+						continue;
+					}
+
+					// search the node pinned and prefetched last round, which finds the next node or ends the descent
+					if (state.node.page != NULL)
+					{
+						const T &key = probes[state.probe];
+						progressed = true;
+						if (state.isLeaf)
+						{
+							VectorMatches matches(gathered[g]);
+							PageId nextPageNum;
+							leafMatches(state.pageNo, state.node.page, key, matches, nextPageNum);
+							unPinNode(pinned.get(), state.node, false);
+							state.node = PageHandle();
+							if (nextPageNum != Page::INVALID_NUMBER)
+							{
+								state.pageNo = nextPageNum;
+							}
+							else
+							{
+								// the key is done, start on the next one
+								first[state.probe] = found.size();
+								count[state.probe] = gathered[g].size();
+								found.insert(found.end(), gathered[g].begin(), gathered[g].end());
+								gathered[g].clear();
+								if (nextProbe == numKeys)
+								{
+									state.probe = NO_PROBE;
+									active--;
+									continue;
+								}
+								state.probe = nextProbe++;
+								state.pageNo = readRoot(state.isLeaf, rootVersion);
+							}
+						}
+						else
+						{
+							OptimisticLatch &latch = latches.latchFor(state.pageNo);
+							const std::uint64_t version = latch.readLock();
+							NonLeafNode<T> *currentNode = (NonLeafNode<T> *)state.node.page;
+							const int index = nonLeafLowerBound(currentNode, key);
+							const PageId nextNodePageNum = currentNode->pageNoArray[index];
+							const bool childIsLeaf = (currentNode->level == 1);
+							const bool valid = latch.validate(version);
+							unPinNode(pinned.get(), state.node, false);
+							state.node = PageHandle();
+							if (valid)
+							{
+								state.pageNo = nextNodePageNum;
+								state.isLeaf = childIsLeaf;
+							}
+							else
+							{
+								// a writer changed the node while we read it, start over from the root
+								state.pageNo = readRoot(state.isLeaf, rootVersion);
+							}
+						}
+					}
+
+					// pin the next node and prefetch it, then yield to the next descent before touching it
+					if (!tryReadNode(pinned.get(), state.pageNo, state.node))
+					{
+						if (!mayWait)
+						{
+							if (!state.requested)
+							{
+								bufMgr->prefetchPages(file, state.pageNo, 1, &noNextPage);
+								state.requested = true;
+							}
+							yields++;
+							continue;
+						}
+						state.node = readNode(pinned.get(), state.pageNo);
+						mayWait = false;
+					}
+					visits++;
+					progressed = true;
+					state.requested = false;
+					prefetchNode(state.node.page);
+				}
+			}
+		}
+		catch (...)
+		{
+			for (std::size_t g = 0; g < group.size(); g++)
+			{
+				if (group[g].node.page != NULL)
+				{
+					unPinNode(pinned.get(), group[g].node, false);
+				}
+			}
+			throw;
+		}
+		counters.lookupNodeVisits.fetch_add(visits, std::memory_order_relaxed);
+		BADGERDB_TRACE(TRACE_INDEX_DESCENT, this, Page::INVALID_NUMBER, visits, 0);
+		counters.lookupYields.fetch_add(yields, std::memory_order_relaxed);
+
+		outRids.reserve(found.size());
+		for (std::size_t i = 0; i < numKeys; i++)
 		{
-			insertToNonLeaf(_key, rid, pageNo);
+			outOffsets[i] = outRids.size();
+			outRids.insert(outRids.end(), found.begin() + first[i], found.begin() + first[i] + count[i]);
 		}
+		outOffsets[numKeys] = outRids.size();
 	}
 
-	/**
-	 * @brief Insert given <rid, key> pair into a leaf at the given pageNo
-	 *
-	 * @param key		Key to insert, pointer to integer/double/char string
-	 * @param rid		Record ID of a record whose entry is getting inserted into the index.
-	 * @param pageNo 	page number where the leaf node is located
-	 */
-	void BTreeIndex::insertToLeaf(const void *_key, const RecordId rid, PageId pageNo)
+	// -----------------------------------------------------------------------------
+	// IndexSnapshot
+	// -----------------------------------------------------------------------------
+
+	IndexSnapshot::IndexSnapshot(BTreeIndex *index)
+		: index(index), epoch(0), rootPageNum(Page::INVALID_NUMBER), rootIsLeaf(false), operationStripe(0)
 	{
-		Page *currPage;
-		bufMgr->readPage(file, pageNo, currPage);
-		LeafNodeInt *currLeafNode = (LeafNodeInt *)currPage;
+		index->openSnapshot(*this);
+	}
 
-		// set up the RID-Key pair for insertion
-		RIDKeyPair<int> pair;
-		int key = (*((int *)_key));
-		pair.set(rid, key);
+	IndexSnapshot::~IndexSnapshot()
+	{
+		try
+		{
+			index->closeSnapshot(*this);
+		}
+		catch (BadgerDbException &e)
+		{
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// IndexScanCursor
+	// -----------------------------------------------------------------------------
+
+	IndexScanCursor::IndexScanCursor(BTreeIndex *index)
+		: index(index), snapshot(NULL), scanExecuting(false), nextEntry(-1), predicate(NULL), predicateArg(NULL), remaining(0), prefetchAhead(0),
+		  operationStripe(0)
+	{
+	}
+
+	IndexScanCursor::IndexScanCursor(const IndexSnapshot &snapshot)
+		: index(snapshot.index), snapshot(&snapshot), scanExecuting(false), nextEntry(-1), predicate(NULL), predicateArg(NULL),
+		  remaining(0), prefetchAhead(0), operationStripe(0)
+	{
+	}
+
+	IndexScanCursor::~IndexScanCursor()
+	{
+		if (scanExecuting)
+		{
+			endScan();
+		}
+	}
+
+	void IndexScanCursor::startScan(const void *lowValParm,
+								   const Operator lowOpParm,
+								   const void *highValParm,
+								   const Operator highOpParm,
+								   const ScanOptions &scanOptions)
+	{
+		// end current scan and get ready to start a new scan
+		if (scanExecuting == true)
+		{
+			endScan();
+		}
+		
+		if ((highOpParm != LTE && highOpParm != LT) || (lowOpParm != GTE && lowOpParm != GT))
+		{
+			throw BadOpcodesException();
+		}
+		// entries buffered since a snapshot was taken are not in it anyway
+		if (snapshot == NULL)
+		{
+			index->flushDelta();
+		}
+		this->lowOp = lowOpParm;
+		this->highOp = highOpParm;
+		this->predicate = scanOptions.predicate;
+		this->predicateArg = scanOptions.predicateArg;
+		this->remaining = (scanOptions.limit == 0) ? (std::size_t)-1 : scanOptions.limit;
 
-		int indexToInsertAt = 0;
-		// make sure index is less than leaf occupancy limit
-		// check if KEY is larger than the current one we are at
-		// check if the page_number is valid for that entry at that index
-		while (indexToInsertAt < leafOccupancy && key > currLeafNode->keyArray[indexToInsertAt] && currLeafNode->ridArray[indexToInsertAt].page_number != Page::INVALID_NUMBER)
+		// store scan settings into instance
+		if (index->attributeType == INTEGER)
 		{
-			// increment until we find a spot to insert our <rid, key> pair
-			indexToInsertAt++;
+			this->lowValInt = *((int *)lowValParm);
+			this->highValInt = *((int *)highValParm);
+
+			// If lowValue > highValue, throw the exception BadScanrangeException.
+			if (this->lowValInt > this->highValInt)
+			{
+				throw BadScanrangeException();
+			}
 		}
 
-		// start checking every index afterwards to find the end
-		int lastIndex = indexToInsertAt;
-		while (lastIndex < leafOccupancy && currLeafNode->ridArray[lastIndex].page_number != Page::INVALID_NUMBER)
+		else if (index->attributeType == DOUBLE)
 		{
-			// increment till we find an OPEN spot in the arrays
-			lastIndex++;
+			this->lowValDouble = *((double *)lowValParm);
+			this->highValDouble = *((double *)highValParm);
+
+			// If lowValue > highValue, throw the exception BadScanrangeException.
+			if (this->lowValDouble > this->highValDouble)
+			{
+				throw BadScanrangeException();
+			}
 		}
+		else if (index->attributeType == STRING)
+		{
+			this->lowValString = index->keyFrom<StringKey>(lowValParm);
+			this->highValString = index->keyFrom<StringKey>(highValParm);
 
-		if (lastIndex < leafOccupancy)
+			// If lowValue > highValue, throw the exception BadScanrangeException.
+			if (this->highValString < this->lowValString)
+			{
+				throw BadScanrangeException();
+			}
+		}
+		else if (index->attributeType == COMPOSITE)
 		{
-			// insert normally because this means there is room for our entry
-			for (int i = lastIndex; indexToInsertAt < i; i--)
+			this->lowValComposite = index->keyFrom<CompositeKey>(lowValParm);
+			this->highValComposite = index->keyFrom<CompositeKey>(highValParm);
+
+			// If lowValue > highValue, throw the exception BadScanrangeException.
+			if (this->highValComposite < this->lowValComposite)
 			{
-				// move each element one index ahead to make room for our entry
-				currLeafNode->keyArray[i] = currLeafNode->keyArray[i - 1];
-				currLeafNode->ridArray[i] = currLeafNode->ridArray[i - 1];
+				throw BadScanrangeException();
 			}
-			// insert rid and key info into the respective arrays in the current leaf node
-			currLeafNode->keyArray[indexToInsertAt] = key;
-			currLeafNode->ridArray[indexToInsertAt] = rid;
 		}
-		else
+
+		// Both the high and low values are in a binary form, i.e., for integer
+		// keys, these point to the address of an integer.
+		if (index->attributeType == INTEGER)
+		{
+			index->findFirstEntry<int>(*this);
+		}
+		else if (index->attributeType == DOUBLE)
+		{
+			index->findFirstEntry<double>(*this);
+		}
+		else if (index->attributeType == STRING)
+		{
+			index->findFirstEntry<StringKey>(*this);
+		}
+		else if (index->attributeType == COMPOSITE)
 		{
-			// need to split leaf to make room
-			splitLeaf(currLeafNode, pageNo, pair);
+			index->findFirstEntry<CompositeKey>(*this);
 		}
+	}
 
-		// Unpin and flush to disk
-		bufMgr->unPinPage(file, pageNo, true);
+	template <class T>
+	PageId BTreeIndex::findLeaf(const T &key, std::uint64_t &visits)
+	{
+		const std::shared_ptr<const PinnedSet> pinned = std::atomic_load(&pinnedNodes);
+		PageId pageNum;
+		bool descended = false;
+		while (!descended)
+		{
+			bool isLeaf;
+			std::uint64_t rootVersion;
+			pageNum = readRoot(isLeaf, rootVersion);
+			descended = true;
+
+			// use the key to find the start of the range in the B-Tree
+			// this works because you can only use GT or GTE with the low end of a range
+			while (!isLeaf)
+			{
+				const PageHandle node = readNode(pinned.get(), pageNum);
+				visits++;
+				OptimisticLatch &latch = latches.latchFor(pageNum);
+				const std::uint64_t version = latch.readLock();
+				NonLeafNode<T> *currentNode = (NonLeafNode<T> *)node.page;
+				// keyArray[index] is the smallest key under pageNoArray[index + 1], so go right
+				// past every key smaller than the one looked for
+				const int index = nonLeafLowerBound(currentNode, key);
+				const PageId nextNodePageNum = currentNode->pageNoArray[index];
+				const bool childIsLeaf = (currentNode->level == 1);
+				const bool valid = latch.validate(version);
+				unPinNode(pinned.get(), node, false);
+				if (!valid)
+				{
+					// a writer changed the node while we read it, start over from the root
+					descended = false;
+					break;
+				}
+				// the child may split before we get to it; splits only move keys right, and the
+				// leaf level is walked to the right by the callers, so nothing is missed
+				pageNum = nextNodePageNum;
+				isLeaf = childIsLeaf;
+			}
+		}
+		return pageNum;
 	}
 
-	/**
-	 * @brief Find page to insert given <rid, key> pair from the given pageNo
-	 *
-	 * @param key		Key to insert, pointer to integer/double/char string
-	 * @param rid		Record ID of a record whose entry is getting inserted into the index.
-	 * @param pageNo 	page number where the current node is located
-	 */
-	void BTreeIndex::insertToNonLeaf(const void *_key, const RecordId rid, PageId pageNo)
+	template <class T>
+	PageId BTreeIndex::findSnapshotLeaf(const IndexSnapshot &snapshot, const T &key, std::uint64_t &visits)
 	{
-		Page *currPage;
-		bufMgr->readPage(file, pageNo, currPage);
-		NonLeafNodeInt *currNonLeafNode = (NonLeafNodeInt *)currPage;
+		// the tree as the snapshot saw it has no split half done, so the leaf found holds the key if any does
+		Page node;
+		PageId pageNum = snapshot.rootPageNum;
+		bool isLeaf = snapshot.rootIsLeaf;
+		while (!isLeaf)
+		{
+			copySnapshotNode(snapshot, pageNum, node, RANDOM_ACCESS);
+			visits++;
+			const NonLeafNode<T> *currentNode = (const NonLeafNode<T> *)&node;
+			isLeaf = (currentNode->level == 1);
+			pageNum = currentNode->pageNoArray[nonLeafLowerBound(currentNode, key)];
+		}
+		return pageNum;
+	}
 
-		// set up the RID-Key pair for insertion
-		// RIDKeyPair<int> pair;
-		int key = (*((int *)_key));
-		// pair.set(rid, key);
+	template <class T>
+	void BTreeIndex::findFirstEntry(IndexScanCursor &cursor)
+	{
+		const T &lowVal = cursor.scanLowVal<T>();
 
-		int indexToInsertAt = 0;
-		// make sure index is less than leaf occupancy limit
-		// check if KEY is larger than the current one we are at
-		// check if the page_number is valid for that entry at that index
-		while (indexToInsertAt < leafOccupancy && key > currNonLeafNode->keyArray[indexToInsertAt] && currNonLeafNode->pageNoArray[indexToInsertAt] != Page::INVALID_NUMBER)
+		// an equality scan of a key the filter rules out finds nothing; a snapshot may still hold a key that compact()
+		// left out of the filter since
+		if (cursor.snapshot == NULL && cursor.lowOp == GTE && cursor.highOp == LTE && !(lowVal < cursor.scanHighVal<T>()) && bloomRejects(lowVal))
 		{
-			// increment until we find a spot to insert our <rid, key> pair
-			indexToInsertAt++;
+			counters.scans.fetch_add(1, std::memory_order_relaxed);
+			throw NoSuchKeyFoundException();
 		}
 
-		if (currNonLeafNode->level == 1)
+		// Start from root to find out the leaf page that contains the first RecordID
+		// that satisfies the scan parameters. Keep a copy of that page.
+		// the scan counts as running until endScan(), since the cursor holds on to sibling links in between
+		cursor.operationStripe = operations.enter();
+		try
 		{
-			// next level is all leaf nodes
-			BTreeIndex::insertEntry(_key, rid, true, currNonLeafNode->pageNoArray[indexToInsertAt]);
+			std::uint64_t visits = 0;
+			const PageId pageNum = (cursor.snapshot != NULL) ? findSnapshotLeaf(*cursor.snapshot, lowVal, visits)
+															 : findLeaf(lowVal, visits);
+			counters.scans.fetch_add(1, std::memory_order_relaxed);
+			counters.scanNodeVisits.fetch_add(visits + 1, std::memory_order_relaxed);
+			BADGERDB_TRACE(TRACE_INDEX_DESCENT, this, pageNum, visits + 1, 0);
+			cursor.prefetchAhead = 0;
+			enterLeaf<T>(cursor, pageNum);
 		}
-		else
+		catch (...)
 		{
-			BTreeIndex::insertEntry(_key, rid, false, currNonLeafNode->pageNoArray[indexToInsertAt]);
+			operations.leave(cursor.operationStripe);
+			throw;
 		}
+		cursor.scanExecuting = true;
 
-		// Unpin and flush to disk
-		bufMgr->unPinPage(file, pageNo, true);
-	}
-
-	void BTreeIndex::sortedLeafEntry(LeafNodeInt *currNode, RIDKeyPair<int> pair)
-	{
-		// Insert new key in ascending order
-		int i = 0;
-		while (i < leafOccupancy && currNode->keyArray[i] < pair.key)
+		// find the first entry satisfying the low end of the range, moving right if needed
+		while (true)
 		{
-			i++;
+			typename LeafNodeOf<T>::type *currentNode = (typename LeafNodeOf<T>::type *)&cursor.currentLeaf;
+			cursor.nextEntry = (cursor.lowOp == GTE) ? leafLowerBound(currentNode, lowVal) : leafUpperBound(currentNode, lowVal);
+			if (cursor.nextEntry < currentNode->numKeys)
+			{
+				break;
+			}
+			if (currentNode->rightSibPageNo == Page::INVALID_NUMBER)
+			{
+				cursor.endScan();
+				throw NoSuchKeyFoundException();
+			}
+			counters.scanNodeVisits.fetch_add(1, std::memory_order_relaxed);
+			enterLeaf<T>(cursor, currentNode->rightSibPageNo);
 		}
-		// shift all right values one place to the right
-		for (int j = i + 1; j < leafOccupancy; j++)
+
+		// If there is no key in the B+ tree that satisfies the scan criteria,
+		// throw the exception NoSuchKeyFoundException.
+		if (!cursor.satisfiesHigh<T>(leafKey((typename LeafNodeOf<T>::type *)&cursor.currentLeaf, cursor.nextEntry)))
 		{
-			currNode->keyArray[j] = currNode->keyArray[j - 1];
+			cursor.endScan();
+			throw NoSuchKeyFoundException();
 		}
-		currNode->keyArray[i] = pair.key;
-		currNode->ridArray[i] = pair.rid;
 	}
 
-	void BTreeIndex::sortedNonLeafEntry(NonLeafNodeInt *currNode, int key)
+	// -----------------------------------------------------------------------------
+	// IndexScanCursor::scanNext
+	//	 * Fetch the record id of the next index entry that matches the scan.
+	//	 * Return the next record from current page being scanned. If current page has been scanned to its entirety,
+	//   move on to the right sibling of current page, if any exists, to start scanning that page.
+	//   Make sure to unpin any pages that are no longer required.
+	//   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+	// -----------------------------------------------------------------------------
+
+	void IndexScanCursor::scanNext(RecordId &outRid)
 	{
-		// insert into available page in node
-		int i = 0;
-		while (i < nodeOccupancy && currNode->keyArray[i] < key)
+		if (!scanExecuting)
 		{
-			i++;
+			throw ScanNotInitializedException();
 		}
-		// shift all right values one place to the right
-		for (int j = i + 1; j < nodeOccupancy; j++)
+
+		if (index->attributeType == INTEGER)
 		{
-			currNode->keyArray[j] = currNode->keyArray[j - 1];
+			index->scanNextEntry<int>(*this, outRid, NULL);
 		}
-		currNode->keyArray[i] = key;
-	}
-
-	void BTreeIndex::insertToLeaf(LeafNodeInt *currNode, PageId pageid, RIDKeyPair<int> pair)
-	{
-		// int occupancy = sizeof(currNode->keyArray) / sizeof(currNode->keyArray[0]);
-		
-		Page *currPage;
-		bufMgr->readPage(file, pageid, currPage);
-		LeafNodeInt *currNodeLeaf = (LeafNodeInt *)currPage;
-
-		int occupancy = 0;
-		// make sure index is less than leaf occupancy limit
-		// check if the page_number is valid for that entry at that index
-		while (occupancy <= leafOccupancy && currNodeLeaf->ridArray[occupancy].page_number != Page::INVALID_NUMBER)
+		else if (index->attributeType == DOUBLE)
 		{
-			occupancy++;
+			index->scanNextEntry<double>(*this, outRid, NULL);
 		}
-
-		if (occupancy == leafOccupancy) // if leaf full
+		else if (index->attributeType == STRING)
 		{
-			// split leaf
-			splitLeaf(currNode, pageid, pair);
-			currNode->rightSibPageNo = pageid; // attach new node to current node
+			index->scanNextEntry<StringKey>(*this, outRid, NULL);
 		}
-		else
+		else if (index->attributeType == COMPOSITE)
 		{
-			// else, insert into existing leaf
-			sortedLeafEntry(currNode, pair);
+			index->scanNextEntry<CompositeKey>(*this, outRid, NULL);
 		}
 	}
 
-	void BTreeIndex::insertToNonLeaf(NonLeafNodeInt *currNode, PageId pageid, int key)
+	void IndexScanCursor::scanNext(RecordId &outRid, void *outKey)
 	{
-		// int occupancy = sizeof(currNode->keyArray) / sizeof(currNode->keyArray[0]);
-
-		Page *currPage;
-		bufMgr->readPage(file, pageid, currPage);
-		NonLeafNodeInt *currNonLeafNode = (NonLeafNodeInt *)currPage;
-		
-		int occupancy = 0;
-		// make sure index is less than leaf occupancy limit
-		// check if the page_number is valid for that entry at that index
-		while (occupancy <= leafOccupancy && currNonLeafNode->pageNoArray[occupancy] != Page::INVALID_NUMBER)
+		if (!scanExecuting)
 		{
-			occupancy++;
+			throw ScanNotInitializedException();
 		}
 
-		if (occupancy == nodeOccupancy) // if full
+		if (index->attributeType == INTEGER)
 		{
-			// split node
-			splitNonLeaf(currNode, pageid, key);
+			index->scanNextEntry<int>(*this, outRid, outKey);
 		}
-		else
+		else if (index->attributeType == DOUBLE)
 		{
-			// else, insert into existing node
-			sortedNonLeafEntry(currNode, key);
+			index->scanNextEntry<double>(*this, outRid, outKey);
 		}
-	}
-
-	void BTreeIndex::splitLeaf(LeafNodeInt *currNode, PageId pageid, RIDKeyPair<int> pair)
-	{
-
-		// create new leafNode
-		LeafNodeInt *newNode = new LeafNodeInt;
-
-		// insert in sorted order
-		sortedLeafEntry(currNode, pair);
-
-		// Now, copy half the keys from previous node to this one
-		bool insertedNewEntry = false;
-		int i = leafOccupancy / 2;
-		while (i < leafOccupancy)
+		else if (index->attributeType == STRING)
 		{
-			if (insertedNewEntry)
-			{
-				break;
-			}
-			if (pair.key <= currNode->keyArray[i])
-			{ // if key < current key in node, insert it first
-				newNode->keyArray[i] = pair.key;
-				newNode->ridArray[i] = pair.rid;
-				insertedNewEntry = true;
-			}
-			else
-			{ // else keep inserting from currNode
-				newNode->keyArray[i] = currNode->keyArray[i];
-				newNode->ridArray[i] = currNode->ridArray[i];
-			}
-			i++;
+			index->scanNextEntry<StringKey>(*this, outRid, outKey);
+		}
+		else if (index->attributeType == COMPOSITE)
+		{
+			index->scanNextEntry<CompositeKey>(*this, outRid, outKey);
 		}
-		// create new root which will be a Non leaf node
-		NonLeafNodeInt *newInternalNode = new NonLeafNodeInt;
-		newInternalNode->level = 1;
-
-		// alloc new page for new non leaf node
-		Page *newPage;
-		PageId newPageId;
-		bufMgr->allocPage(file, newPageId, newPage);
-
-		// connect curr node to new leaf node
-		currNode->rightSibPageNo = newPageId;
-		int leftmostKey = newNode->keyArray[0];
-
-		// copy up leftmost key on new node up to the root
-		insertToNonLeaf(newInternalNode, newPageId, leftmostKey);
-		
-		// unpin pages
-		bufMgr->unPinPage(file, newPageId, true);
 	}
 
-	void BTreeIndex::splitNonLeaf(NonLeafNodeInt *currNode, PageId pageid, int key)
+	template <class T>
+	void BTreeIndex::scanNextEntry(IndexScanCursor &cursor, RecordId &outRid, void *outKey)
 	{
-		// create new non leafNode
-		NonLeafNodeInt *newNode = new NonLeafNodeInt;
-
-		// insert new key into current node in sorted order first
-		sortedNonLeafEntry(currNode, key);
+		typename LeafNodeOf<T>::type *currentNode = (typename LeafNodeOf<T>::type *)&cursor.currentLeaf;
+		counters.scanNexts.fetch_add(1, std::memory_order_relaxed);
+		if (cursor.remaining == 0)
+		{
+			throw IndexScanCompletedException();
+		}
 
-		// copy half the keys from previous node to this one
-		bool insertedNewEntry = false; // currently, not being used/checked
-		int i = nodeOccupancy / 2;
-		while (i < leafOccupancy)
+		// skip the entries the predicate rejects
+		while (true)
 		{
-			if (insertedNewEntry)
+			// current leaf exhausted, move on to its right sibling
+			while (cursor.nextEntry >= currentNode->numKeys)
 			{
-				break;
+				if (currentNode->rightSibPageNo == Page::INVALID_NUMBER)
+				{
+					throw IndexScanCompletedException();
+				}
+				counters.scanNextNodeVisits.fetch_add(1, std::memory_order_relaxed);
+				enterLeaf<T>(cursor, currentNode->rightSibPageNo);
+				cursor.nextEntry = 0;
 			}
-			if (key <= currNode->keyArray[i])
+
+			const T key = leafKey(currentNode, cursor.nextEntry);
+			if (!cursor.satisfiesHigh<T>(key))
 			{
-				newNode->keyArray[i] = key;
-				insertedNewEntry = true;
+				throw IndexScanCompletedException();
 			}
-			else
+			if (cursor.satisfiesPredicate<T>(key))
 			{
-				newNode->keyArray[i] = currNode->keyArray[i];
-				newNode->pageNoArray[i] = currNode->pageNoArray[i];
+				if (outKey != NULL)
+				{
+					memcpy(outKey, &key, sizeof(T));
+				}
+				break;
 			}
-			i++;
+			cursor.nextEntry++;
 		}
 
-		// create new root which will be a Non leaf node
-		NonLeafNodeInt *newInternalNode = new NonLeafNodeInt;
-		newInternalNode->level = currNode->level + 1;
-		// alloc new page for new non leaf node
-		Page *newPage;
-		PageId newPageId;
-		bufMgr->allocPage(file, newPageId, newPage);
-		int leftmostKey = newNode->keyArray[0];
-
-		// copy up leftmost key on new node up to the root
-		insertToNonLeaf(newInternalNode, newPageId, leftmostKey);
-		// UNPIN HERE?
-		bufMgr->unPinPage(file, newPageId, true);
+		outRid = leafRid(currentNode, cursor.nextEntry);
+		cursor.nextEntry++;
+		cursor.remaining--;
 	}
 
 	// -----------------------------------------------------------------------------
-	// BTreeIndex::startScan
+	// IndexScanCursor::scanNextBatch
 	// -----------------------------------------------------------------------------
-	/**
-	 * Begin a filtered scan of the index.  For instance, if the method is called
-	 * using ("a",GT,"d",LTE) then we should seek all entries with a value
-	 * greater than "a" and less than or equal to "d".
-	 * If another scan is already executing, that needs to be ended here.
-	 * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
-	 * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
-	 * @param lowVal	Low value of range, pointer to integer / double / char string
-	 * @param lowOp		Low operator (GT/GTE)
-	 * @param highVal	High value of range, pointer to integer / double / char string
-	 * @param highOp	High operator (LT/LTE)
-	 * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
-	 * @throws  BadScanrangeException If lowVal > highval
-	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
-	 **/
 
-	void BTreeIndex::startScan(const void *lowValParm,
-							   const Operator lowOpParm,
-							   const void *highValParm,
-							   const Operator highOpParm)
+	std::size_t IndexScanCursor::scanNextBatch(RecordId *outRids, const std::size_t maxRids)
 	{
-		// end current scan and get ready to start a new scan
-		if (scanExecuting == true)
+		if (!scanExecuting)
 		{
-			endScan();
+			throw ScanNotInitializedException();
 		}
-		
-		if ((highOpParm != LTE && highOpParm != LT) || (lowOpParm != GTE && lowOpParm != GT))
+
+		if (index->attributeType == INTEGER)
 		{
-			throw BadOpcodesException();
+			return index->scanNextEntries<int>(*this, outRids, NULL, NULL, maxRids);
 		}
-		this->lowOp = lowOpParm;
-		this->highOp = highOpParm;
-
-		// store scan settings into instance
-		if (this->attributeType == INTEGER)
+		else if (index->attributeType == DOUBLE)
 		{
-			this->lowValInt = *((int *)lowValParm);
-			this->highValInt = *((int *)highValParm);
-
-			// If lowValue > highValue, throw the exception BadScanrangeException.
-			if (this->lowValInt > this->highValInt)
-			{
-				throw BadScanrangeException();
-			}
+			return index->scanNextEntries<double>(*this, outRids, NULL, NULL, maxRids);
+		}
+		else if (index->attributeType == STRING)
+		{
+			return index->scanNextEntries<StringKey>(*this, outRids, NULL, NULL, maxRids);
 		}
+		return index->scanNextEntries<CompositeKey>(*this, outRids, NULL, NULL, maxRids);
+	}
 
-		else if (this->attributeType == DOUBLE)
+	// -----------------------------------------------------------------------------
+	// IndexScanCursor::scanNextCovered
+	// -----------------------------------------------------------------------------
+
+	std::size_t IndexScanCursor::scanNextCovered(RecordId *outRids, void *outPayloads, const std::size_t maxRids)
+	{
+		if (!scanExecuting)
 		{
-			this->lowValDouble = *((double *)lowValParm);
-			this->highValDouble = *((double *)highValParm);
+			throw ScanNotInitializedException();
+		}
 
-			// If lowValue > highValue, throw the exception BadScanrangeException.
-			if (this->lowValDouble > this->highValDouble)
-			{
-				throw BadScanrangeException();
-			}
+		char *payloads = (char *)outPayloads;
+		if (index->attributeType == INTEGER)
+		{
+			return index->scanNextEntries<int>(*this, outRids, payloads, NULL, maxRids);
 		}
-		else if (this->attributeType == STRING)
+		else if (index->attributeType == DOUBLE)
 		{
-			this->lowValString = (char *)lowValParm;
-			this->highValString = (char *)highValParm;
-
-			// If lowValue > highValue, throw the exception BadScanrangeException.
-			if (this->lowValString.compare(this->highValString) > 0)
-			{
-				throw BadScanrangeException();
-			}
+			return index->scanNextEntries<double>(*this, outRids, payloads, NULL, maxRids);
+		}
+		else if (index->attributeType == STRING)
+		{
+			return index->scanNextEntries<StringKey>(*this, outRids, payloads, NULL, maxRids);
 		}
+		return index->scanNextEntries<CompositeKey>(*this, outRids, payloads, NULL, maxRids);
+	}
 
-		// Both the high and low values are in a binary form, i.e., for integer
-		// keys, these point to the address of an integer.
+	template <class T>
+	std::size_t BTreeIndex::scanNextEntries(IndexScanCursor &cursor, RecordId *outRids, char *outPayloads, char *outKeys,
+											const std::size_t maxRids)
+	{
+		typename LeafNodeOf<T>::type *currentNode = (typename LeafNodeOf<T>::type *)&cursor.currentLeaf;
+		const T &highVal = cursor.scanHighVal<T>();
+		counters.scanNexts.fetch_add(1, std::memory_order_relaxed);
 
-		// Start from root to find out the leaf page that contains the first RecordID
-		// that satisfies the scan parameters. Keep that page pinned in the buffer pool.
-		// currentPageNum = rootPageNum;
-		// bufMgr->readPage(file, rootPageNum, currentPageData);
-		// bufMgr->unPinPage(file, currentPageNum, true);
-		scanExecuting = true;
-		// Start from root to find out the leaf page that contains the first RecordID
-		// that satisfies the scan parameters. Keep that page pinned in the buffer pool.
-		bufMgr->readPage(file, rootPageNum, currentPageData);
-		currentPageNum = rootPageNum;
-		bufMgr->unPinPage(file, currentPageNum, false);
-		// currentNode should start at the ROOT, which should be a NonLeafNode
-		NonLeafNodeInt *currentNode = (NonLeafNodeInt *)currentPageData;
-
-		// use the lowValParm to find the start of the range in the B-Tree
-		// this works because you can only use GT or GTE with the lowValParm
-		while (currentNode->level != 1)
-		{
-			int index = 0;
-			while (true)
+		// the limit ends the scan like the end of the range does
+		const std::size_t wanted = std::min(maxRids, cursor.remaining);
+		std::size_t filled = 0;
+		while (filled < wanted)
+		{
+			if (cursor.nextEntry >= currentNode->numKeys)
 			{
-				// index is past at or past the limit
-				if (index >= nodeOccupancy)
-				{
-					break;
-				}
-				// check if page is valid
-				//                       index or index+1
-				if (currentNode->pageNoArray[index] == Page::INVALID_NUMBER)
+				if (currentNode->rightSibPageNo == Page::INVALID_NUMBER)
 				{
 					break;
 				}
-				// check if the lowVal is less than the current key at the index
-				// currrent only works with INTEGERS
-				if (this->lowValInt < currentNode->keyArray[index])
-				{
-					break;
-				}
-				// increment and run again
-				index++;
+				counters.scanNextNodeVisits.fetch_add(1, std::memory_order_relaxed);
+				enterLeaf<T>(cursor, currentNode->rightSibPageNo);
+				cursor.nextEntry = 0;
+				continue;
 			}
-			// Use the index we found to get the pageNo
-			PageId nextNodePageNum = currentNode->pageNoArray[index];
-			bufMgr->readPage(file, nextNodePageNum, currentPageData);
-			bufMgr->unPinPage(file, nextNodePageNum, false);
-			currentPageNum = nextNodePageNum;
-
-			// go to next node
-			currentNode = (NonLeafNodeInt *)currentPageData;
-		}
-
-		// TODO: (ANDY) still need to find LEAF and INDEX of starting position
 
-		while (true)
-		{
-			int loop = 0;
-			LeafNodeInt *currentNode = (LeafNodeInt *)currentPageData;
-			for (int i = 0; i < leafOccupancy; i++)
+			// entries up to the first one past the high end of the range qualify, copy as many as fit; a skipTo()
+			// past the end of the range may have left the scan beyond it
+			const int end = std::max(cursor.nextEntry, (cursor.highOp == LT) ? leafLowerBound(currentNode, highVal)
+																			  : leafUpperBound(currentNode, highVal));
+			int last = end;
+			if (cursor.predicate == NULL && wanted - filled < (std::size_t)(end - cursor.nextEntry))
 			{
-				int key = currentNode->keyArray[i];
-				if ((this->lowOp == GTE && this->highOp == LTE) && (key >= this->lowOp && key <= this->highOp))
-				{
-					scanExecuting = true;
-					loop = 1;
-					nextEntry = i;
-					break;
-				}
-				else if ((this->lowOp == GTE && this->highOp == LT) && (key >= this->lowOp && key < this->highOp))
-				{
-					scanExecuting = true;
-					loop = 1;
-					nextEntry = i;
-					break;
-				}
-				else if ((this->lowOp == GT && this->highOp == LTE) && (key > this->lowOp && key <= this->highOp))
-				{
-					scanExecuting = true;
-					loop = 1;
-					nextEntry = i;
-					break;
-				}
-				else if ((this->lowOp == GT && this->highOp == LT) && (key >= this->lowOp && key <= this->highOp))
-				{
-					scanExecuting = true;
-					loop = 1;
-					nextEntry = i;
-					break;
-				}
-				else if ((this->lowOp == GTE && this->highOp == LT) && (key >= this->lowOp && key < this->highOp))
+				last = cursor.nextEntry + (int)(wanted - filled);
+			}
+			int i = cursor.nextEntry;
+			for (; i < last && filled < wanted; i++)
+			{
+				if (cursor.predicate != NULL && !cursor.satisfiesPredicate<T>(leafKey(currentNode, i)))
 				{
-					scanExecuting = true;
-					loop = 1;
-					break;
+					continue;
 				}
-				else if ((this->lowOp == GT && this->highOp == LTE) && (key > this->lowOp && key <= this->highOp))
+				if (outPayloads != NULL)
 				{
-					scanExecuting = true;
-					loop = 1;
-					break;
+					memcpy(outPayloads + filled * payloadSize, leafPayload(currentNode, i), payloadSize);
 				}
-				else if ((this->lowOp == GT && this->highOp == LT) && (key >= this->lowOp && key <= this->highOp))
+				if (outKeys != NULL)
 				{
-					scanExecuting = true;
-					loop = 1;
-					break;
-				}
-				// Need to check which attributeType we are working with and then use that compare method properly
-				// else if ((this->highOp == LT && key >= this->h) || (this->highOp == LTE && key > highValParm))
-				// {
-				// 	bufMgr->unPinPage(file, currentPageNum, false);
-				// 	throw NoSuchKeyFoundException();
-				// }
-				// when i is the last one and still not out of loop so its not found in the node
-				if (i == leafOccupancy - 1)
-				{
-					bufMgr->unPinPage(file, currentPageNum, false);
-					if (currentNode->rightSibPageNo != 0)
-					{
-						currentPageNum = currentNode->rightSibPageNo;
-						bufMgr->readPage(file, currentPageNum, currentPageData);
-					}
-					else
-					{
-						throw NoSuchKeyFoundException();
-					}
+					const T key = leafKey(currentNode, i);
+					memcpy(outKeys + filled * sizeof(T), &key, sizeof(T));
 				}
+				outRids[filled++] = leafRid(currentNode, i);
 			}
-			if (loop == 1)
+			cursor.nextEntry = i;
+			if (i < currentNode->numKeys)
 			{
+				// either the batch is full or the range ends in this leaf
 				break;
 			}
 		}
+		cursor.remaining -= filled;
 
-		// // If there is no key in the B+ tree that satisfies the scan criteria,
-		// // throw the exception NoSuchKeyFoundException.
-		// if () {
-		// 	throw NoSuchKeyFoundException();
-		// }
+		if (filled == 0 && maxRids > 0)
+		{
+			throw IndexScanCompletedException();
+		}
+		return filled;
 	}
+
 	// -----------------------------------------------------------------------------
-	// BTreeIndex::scanNext
-	//	 * Fetch the record id of the next index entry that matches the scan.
-	//	 * Return the next record from current page being scanned. If current page has been scanned to its entirety,
-	//   move on to the right sibling of current page, if any exists, to start scanning that page.
-	//   Make sure to unpin any pages that are no longer required.
-	//   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+	// IndexScanCursor::scanNextKeys
 	// -----------------------------------------------------------------------------
 
-	void BTreeIndex::scanNext(RecordId &outRid)
+	std::size_t IndexScanCursor::scanNextKeys(RecordId *outRids, void *outKeys, const std::size_t maxRids)
+	{
+		if (!scanExecuting)
+		{
+			throw ScanNotInitializedException();
+		}
+
+		char *keys = (char *)outKeys;
+		if (index->attributeType == INTEGER)
+		{
+			return index->scanNextEntries<int>(*this, outRids, NULL, keys, maxRids);
+		}
+		else if (index->attributeType == DOUBLE)
+		{
+			return index->scanNextEntries<double>(*this, outRids, NULL, keys, maxRids);
+		}
+		else if (index->attributeType == STRING)
+		{
+			return index->scanNextEntries<StringKey>(*this, outRids, NULL, keys, maxRids);
+		}
+		return index->scanNextEntries<CompositeKey>(*this, outRids, NULL, keys, maxRids);
+	}
+
+	// -----------------------------------------------------------------------------
+	// IndexScanCursor::skipTo
+	// -----------------------------------------------------------------------------
+
+	void IndexScanCursor::skipTo(const void *key)
 	{
 		if (!scanExecuting)
 		{
 			throw ScanNotInitializedException();
 		}
-		bufMgr->readPage(file, currentPageNum, currentPageData);
-		LeafNodeInt *currentNode = (LeafNodeInt *)currentPageData;
 
-		if (nextEntry == leafOccupancy)
+		if (index->attributeType == INTEGER)
+		{
+			index->skipEntries<int>(*this, *((const int *)key));
+		}
+		else if (index->attributeType == DOUBLE)
+		{
+			index->skipEntries<double>(*this, *((const double *)key));
+		}
+		else if (index->attributeType == STRING)
+		{
+			index->skipEntries<StringKey>(*this, index->keyFrom<StringKey>(key));
+		}
+		else if (index->attributeType == COMPOSITE)
+		{
+			index->skipEntries<CompositeKey>(*this, index->keyFrom<CompositeKey>(key));
+		}
+	}
+
+	/**
+	 * Returns the first entry from start on whose key is not smaller than key, or numKeys if there is none. Probes
+	 * the entries 1, 2, 4, ... past start until one is not smaller, then binary searches the last gap, so the cost
+	 * grows with the log of the distance skipped rather than with the size of the leaf.
+	 */
+	template <class LeafNodeT, class T>
+	static int leafGallop(LeafNodeT *node, const int start, const T &key)
+	{
+		if (start >= node->numKeys || !(leafKey(node, start) < key))
+		{
+			return start;
+		}
+		// the key at lo is smaller than key; the first one that is not lies in (lo, hi]
+		int lo = start;
+		int step = 1;
+		int hi = start + 1;
+		while (hi < node->numKeys && leafKey(node, hi) < key)
+		{
+			lo = hi;
+			step *= 2;
+			hi = lo + step;
+		}
+		if (hi > node->numKeys)
+		{
+			hi = node->numKeys;
+		}
+		while (lo + 1 < hi)
 		{
-			bufMgr->unPinPage(file, currentPageNum, false);
-			if (currentNode->rightSibPageNo == 0)
+			const int mid = lo + (hi - lo) / 2;
+			if (leafKey(node, mid) < key)
 			{
-				throw IndexScanCompletedException();
+				lo = mid;
 			}
 			else
 			{
-				currentPageNum = currentNode->rightSibPageNo;
-				bufMgr->readPage(file, currentPageNum, currentPageData);
-				currentNode = (LeafNodeInt *)currentPageData;
-				nextEntry = 0;
+				hi = mid;
 			}
 		}
+		return hi;
+	}
 
-		int key = currentNode->keyArray[nextEntry];
-		if ((this->lowOp == GTE && this->highOp == LTE) && (key >= this->lowOp && key <= this->highOp))
+	template <class T>
+	void BTreeIndex::skipEntries(IndexScanCursor &cursor, const T &key)
+	{
+		typename LeafNodeOf<T>::type *currentNode = (typename LeafNodeOf<T>::type *)&cursor.currentLeaf;
+		// an empty leaf says nothing about where the key is, leave it to the scan to walk past it
+		if (cursor.remaining == 0 || currentNode->numKeys == 0 || !(leafKey(currentNode, currentNode->numKeys - 1) < key))
 		{
-			outRid = currentNode->ridArray[nextEntry];
+			cursor.nextEntry = leafGallop(currentNode, cursor.nextEntry, key);
+			return;
 		}
-		else if ((this->lowOp == GTE && this->highOp == LT) && (key >= this->lowOp && key < this->highOp))
+		if (currentNode->rightSibPageNo == Page::INVALID_NUMBER)
 		{
-			outRid = currentNode->ridArray[nextEntry];
+			cursor.nextEntry = currentNode->numKeys;
+			return;
 		}
-		else if ((this->lowOp == GT && this->highOp == LTE) && (key > this->lowOp && key <= this->highOp))
+
+		// the key is often on the next leaf, which the scan has asked to be read ahead already
+		counters.scanNextNodeVisits.fetch_add(1, std::memory_order_relaxed);
+		enterLeaf<T>(cursor, currentNode->rightSibPageNo);
+		cursor.nextEntry = 0;
+		if (currentNode->numKeys == 0 || !(leafKey(currentNode, currentNode->numKeys - 1) < key))
 		{
-			outRid = currentNode->ridArray[nextEntry];
+			cursor.nextEntry = leafGallop(currentNode, 0, key);
+			return;
 		}
-		else if ((this->lowOp == GT && this->highOp == LT) && (key >= this->lowOp && key <= this->highOp))
+
+		// further away, descend to it instead of walking the leaves in between; every key left of the leaf found
+		// is smaller than key, so no entry the scan returned is returned again
+		std::uint64_t visits = 0;
+		const PageId pageNum = (cursor.snapshot != NULL) ? findSnapshotLeaf(*cursor.snapshot, key, visits)
+														 : findLeaf(key, visits);
+		counters.scanNodeVisits.fetch_add(visits + 1, std::memory_order_relaxed);
+		BADGERDB_TRACE(TRACE_INDEX_DESCENT, this, pageNum, visits + 1, 0);
+		cursor.prefetchAhead = 0;
+		enterLeaf<T>(cursor, pageNum);
+		cursor.nextEntry = leafLowerBound(currentNode, key);
+	}
+
+	// -----------------------------------------------------------------------------
+	// IndexScanCursor::keyType
+	// -----------------------------------------------------------------------------
+
+	Datatype IndexScanCursor::keyType() const
+	{
+		return index->attributeType;
+	}
+
+	std::size_t IndexScanCursor::keySize() const
+	{
+		if (index->attributeType == INTEGER)
 		{
-			outRid = currentNode->ridArray[nextEntry];
+			return sizeof(int);
 		}
-		else
+		else if (index->attributeType == DOUBLE)
 		{
-			throw IndexScanCompletedException();
+			return sizeof(double);
 		}
-
-		if (currentNode->rightSibPageNo == 0)
+		else if (index->attributeType == STRING)
 		{
-
-			throw IndexScanCompletedException();
+			return sizeof(StringKey);
 		}
-
-		nextEntry++;
+		return sizeof(CompositeKey);
 	}
 
 	// -----------------------------------------------------------------------------
-	// BTreeIndex::endScan
+	// IndexScanCursor::endScan
 	// -----------------------------------------------------------------------------
-	//
-	void BTreeIndex::endScan()
+
+	void IndexScanCursor::endScan()
 	{
 		if (scanExecuting == false)
 		{
@@ -769,14 +5122,9 @@ namespace badgerdb
 		}
 		// terminates the current scan
 		scanExecuting = false;
+		index->operations.leave(operationStripe);
 
-		// unpins all the pages that have been pinned for the purpose of the scan
-		bufMgr->unPinPage(file, currentPageNum, false);
-
-		// reset scan data to NULL
-		currentPageData = nullptr;
-		PageId nullPage = -1;
-		currentPageNum = nullPage;
+		// the scan works on copies of the leaves, so no pages are pinned for it
 		nextEntry = -1;
 	}
 }
@@ -11,11 +11,22 @@
 #include <string>
 #include "string.h"
 #include <sstream>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include "types.h"
 #include "page.h"
 #include "file.h"
 #include "buffer.h"
+#include "bloom_filter.h"
+#include "external_sort.h"
+#include "key_search.h"
+#include "node_latch.h"
+#include "node_versions.h"
 
 namespace badgerdb
 {
@@ -27,7 +38,8 @@ namespace badgerdb
   {
     INTEGER = 0,
     DOUBLE = 1,
-    STRING = 2
+    STRING = 2,
+    COMPOSITE = 3 /* several attributes, see BTreeIndex's constructor taking key attributes */
   };
 
   /**
@@ -42,263 +54,2295 @@ namespace badgerdb
   };
 
   /**
-   * @brief Number of key slots in B+Tree leaf for INTEGER key.
+   * @brief Number of bytes of a STRING attribute used as the key. Longer strings are indexed by their first
+   * STRINGSIZE bytes, shorter ones are padded with NUL bytes.
    */
-  //                                                  sibling ptr             key               rid
-  const int INTARRAYLEAFSIZE = (Page::SIZE - sizeof(PageId)) / (sizeof(int) + sizeof(RecordId));
+  const int STRINGSIZE = 10;
+
+  /**
+   * @brief Key type used for STRING attributes: the first STRINGSIZE bytes of the string, compared bytewise.
+   * Unlike a plain char array it can be copied and compared like the INTEGER and DOUBLE keys.
+   */
+  struct StringKey
+  {
+    char data[STRINGSIZE];
+
+    StringKey()
+    {
+      memset(data, 0, STRINGSIZE);
+    }
+
+    /**
+     * Constructs a key from a NUL-terminated (or at least STRINGSIZE bytes long) string.
+     */
+    explicit StringKey(const char *str)
+    {
+      int i = 0;
+      for (; i < STRINGSIZE && str[i] != '\0'; i++)
+      {
+        data[i] = str[i];
+      }
+      memset(data + i, 0, STRINGSIZE - i);
+    }
+
+    bool operator<(const StringKey &rhs) const
+    {
+      return memcmp(data, rhs.data, STRINGSIZE) < 0;
+    }
+
+    bool operator==(const StringKey &rhs) const
+    {
+      return memcmp(data, rhs.data, STRINGSIZE) == 0;
+    }
+
+    bool operator!=(const StringKey &rhs) const
+    {
+      return !(*this == rhs);
+    }
+  };
+
+  /**
+   * @brief Reads a key of type T out of the bytes of a record or a key passed to the index. The bytes need not be aligned.
+   */
+  template <class T>
+  inline T loadKey(const void *src)
+  {
+    T key;
+    memcpy(&key, src, sizeof(T));
+    return key;
+  }
+
+  template <>
+  inline StringKey loadKey<StringKey>(const void *src)
+  {
+    return StringKey((const char *)src);
+  }
+
+  /**
+   * @brief Maximum number of attributes a composite key is made of.
+   */
+  const int MAX_KEY_ATTRIBUTES = 4;
+
+  /**
+   * @brief Number of bytes of a composite key. The encoded attributes take the first bytes, the rest is zero.
+   */
+  const int COMPOSITESIZE = 24;
+
+  /**
+   * @brief Key type used for COMPOSITE indexes: the attributes of the key, each encoded so that comparing the
+   * encodings bytewise orders them like their values, one after the other. Comparing two keys is then a
+   * single memcmp, whatever attributes they are made of. BTreeIndex builds them from records.
+   */
+  struct CompositeKey
+  {
+    char data[COMPOSITESIZE];
+
+    bool operator<(const CompositeKey &rhs) const
+    {
+      return memcmp(data, rhs.data, COMPOSITESIZE) < 0;
+    }
+
+    bool operator==(const CompositeKey &rhs) const
+    {
+      return memcmp(data, rhs.data, COMPOSITESIZE) == 0;
+    }
+
+    bool operator!=(const CompositeKey &rhs) const
+    {
+      return !(*this == rhs);
+    }
+  };
+
+  /**
+   * @brief Number of bytes a RecordId takes in a leaf of INTEGER or DOUBLE keys: its page and slot numbers,
+   * without the padding.
+   */
+  const int LEAFRIDSIZE = sizeof(PageId) + sizeof(SlotId);
+
+  /**
+   * @brief Number of key slots in B+Tree leaf and non-leaf nodes for keys of type T.
+   */
+  template <class T>
+  struct NodeCapacity
+  {
+    /**
+     * Number of bytes of a leaf holding the keys, the positions of their rid lists, the rids and their payloads.
+     */
+    //                                      numKeys, numLists, payloadSize   sibling ptr
+    static const int LEAF_DATA = BlobFile::DATA_SIZE - 3 * sizeof(int) - sizeof(PageId);
+
+    /**
+     * Number of entries of a leaf whose keys are all distinct and which carry no payload. Leaves holding duplicates
+     * store each key once and hold more entries, up to LEAF_DATA / (sizeof(T) + sizeof(std::uint16_t) + LEAFRIDSIZE)
+     * of them.
+     */
+    //                                key              list position           rid
+    static const int LEAF = LEAF_DATA / (sizeof(T) + sizeof(std::uint16_t) + LEAFRIDSIZE);
+
+    /**
+     * Number of keys of a non-leaf node in a cache line. keyArray is searched in blocks of that many keys, through
+     * a copy of the last key of each block.
+     */
+    static const int NONLEAF_BLOCK = (sizeof(T) < 64) ? 64 / sizeof(T) : 1;
+
+    //                                                             level, numKeys     extra pageNo   last block key
+    static const int NONLEAF = NONLEAF_BLOCK * (BlobFile::DATA_SIZE - 2 * sizeof(int) - sizeof(PageId) - sizeof(T)) /
+    //                                         key       pageNo        block key per key
+                               (NONLEAF_BLOCK * (sizeof(T) + sizeof(PageId)) + sizeof(T));
+
+    /**
+     * Number of blocks of keyArray of a full non-leaf node.
+     */
+    static const int NONLEAF_BLOCKS = (NONLEAF + NONLEAF_BLOCK - 1) / NONLEAF_BLOCK;
+  };
+
+  /**
+   * @brief Number of bytes of an INTEGER leaf holding the packed keys, rids and payloads.
+   */
+  //                              numKeys, payloadSize, keyBase  sibling ptr, pageBase, pageTop   widths
+  const int PACKEDLEAFDATASIZE = BlobFile::DATA_SIZE - 3 * sizeof(int) - 3 * sizeof(PageId) - 4 * sizeof(std::uint8_t);
+
+  /**
+   * @brief Number of entries of a B+Tree leaf for INTEGER key that needs all 4 bytes for its keys and page numbers
+   * and carries no payload. Leaves whose keys or page numbers lie closer together hold more.
+   */
+  const int INTARRAYLEAFSIZE = PACKEDLEAFDATASIZE / (sizeof(int) + LEAFRIDSIZE);
 
   /**
    * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
    */
-  //                                                     level     extra pageNo                  key       pageNo
-  const int INTARRAYNONLEAFSIZE = (Page::SIZE - sizeof(int) - sizeof(PageId)) / (sizeof(int) + sizeof(PageId));
+  const int INTARRAYNONLEAFSIZE = NodeCapacity<int>::NONLEAF;
+
+  /**
+   * @brief Number of key slots in B+Tree leaf for DOUBLE key.
+   */
+  const int DOUBLEARRAYLEAFSIZE = NodeCapacity<double>::LEAF;
+
+  /**
+   * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+   */
+  const int DOUBLEARRAYNONLEAFSIZE = NodeCapacity<double>::NONLEAF;
+
+  /**
+   * @brief Number of bytes of a STRING leaf holding the key suffixes and rids.
+   */
+  //                              numKeys, prefixLen, payloadSize   sibling ptr      prefix
+  const int STRINGLEAFDATASIZE = BlobFile::DATA_SIZE - 3 * sizeof(int) - sizeof(PageId) - STRINGSIZE;
+
+  /**
+   * @brief Number of key slots in B+Tree leaf for STRING key whose keys share no prefix and which carry no payload.
+   * Leaves whose keys share a prefix hold more entries, up to STRINGLEAFDATASIZE / sizeof(RecordId).
+   */
+  const int STRINGARRAYLEAFSIZE = STRINGLEAFDATASIZE / (STRINGSIZE + sizeof(RecordId));
+
+  /**
+   * @brief Number of key slots in B+Tree non-leaf for STRING key.
+   */
+  const int STRINGARRAYNONLEAFSIZE = NodeCapacity<StringKey>::NONLEAF;
+
+  /**
+   * @brief Number of key slots in B+Tree leaf for COMPOSITE key whose keys are all distinct.
+   */
+  const int COMPOSITEARRAYLEAFSIZE = NodeCapacity<CompositeKey>::LEAF;
+
+  /**
+   * @brief Number of key slots in B+Tree non-leaf for COMPOSITE key.
+   */
+  const int COMPOSITEARRAYNONLEAFSIZE = NodeCapacity<CompositeKey>::NONLEAF;
+
+  /**
+   * @brief Default fraction of key slots filled in each node written by the bulk loader.
+   * Leaving some room free lets later inserts land without splitting every page.
+   */
+  const double BULKLOAD_FILL_FACTOR = 0.9;
+
+  /**
+   * @brief Default maximum number of upper-level nodes a BTreeIndex keeps pinned when BTreeOptions::pinnedLevels is set.
+   */
+  const int PINNED_PAGE_LIMIT = 32;
+
+  /**
+   * @brief Default number of leaves a range scan reads ahead along the right sibling links.
+   */
+  const int PREFETCH_DEPTH = 4;
+
+  /**
+   * @brief Default number of descents BTreeIndex::lookupInterleaved() walks at once.
+   */
+  const std::size_t PROBE_GROUP_SIZE = 8;
+
+  /**
+   * @brief Default fraction of the room for entries of a leaf below which a delete merges the leaf with a sibling,
+   * or borrows entries from it if they do not fit together.
+   */
+  const double MERGE_THRESHOLD = 0.25;
+
+  /**
+   * @brief Maximum number of attributes a covering index stores with each entry besides the key.
+   */
+  const int MAX_INCLUDED_ATTRIBUTES = 4;
+
+  /**
+   * @brief Maximum number of bytes the included attributes of one entry may take together.
+   */
+  const int MAX_PAYLOAD_SIZE = 32;
+
+  /**
+   * @brief An attribute of the base relation that is part of a composite key or copied into the leaves of a
+   * covering index, see BTreeOptions::included.
+   */
+  struct IndexAttribute
+  {
+    /**
+     * Offset of the attribute inside records.
+     */
+    int attrByteOffset;
+
+    /**
+     * Type of the attribute, INTEGER, DOUBLE or STRING. It takes sizeof(int), sizeof(double) or STRINGSIZE bytes
+     * of the payload or composite key.
+     */
+    Datatype attrType;
+  };
+
+  /**
+   * @brief Returns the number of bytes an attribute of the given type takes as a key or in a payload.
+   */
+  inline int attributeSize(const Datatype type)
+  {
+    return type == INTEGER ? sizeof(int) : type == DOUBLE ? sizeof(double) : STRINGSIZE;
+  }
+
+  /**
+   * @brief Options controlling how a BTreeIndex is built. Passed to the BTreeIndex constructor.
+   */
+  struct BTreeOptions
+  {
+    /**
+     * If true, a new index is built bottom-up from the sorted entries of the base relation,
+     * writing each node exactly once. Otherwise every tuple is inserted through insertEntry().
+     */
+    bool bulkLoad;
+
+    /**
+     * Fraction, in (0, 1], of the key slots filled in each leaf and non-leaf node written by the bulk loader.
+     */
+    double fillFactor;
+
+    /**
+     * Maximum number of entries the bulk loader sorts in memory. Larger inputs are spilled as sorted runs
+     * to a temporary file and merged.
+     */
+    std::size_t sortRunSize;
+
+    /**
+     * Number of levels of non-leaf nodes, starting at the root, kept pinned in the buffer pool for the lifetime
+     * of the index. Descents read those nodes through pointers cached in the index instead of the buffer
+     * manager. 0 disables the cache.
+     */
+    int pinnedLevels;
+
+    /**
+     * Maximum number of nodes kept pinned for pinnedLevels. Levels are pinned breadth first until the limit is hit.
+     */
+    int pinnedPageLimit;
+
+    /**
+     * Number of right siblings of the current leaf a range scan asks the buffer manager to read in the background,
+     * so that moving on to the next leaf does not wait for the disk. 0 disables read-ahead.
+     */
+    int prefetchDepth;
+
+    /**
+     * If true, the index file is mapped read-only into memory once it is opened (or built), and nodes are read in
+     * place from the mapping rather than copied into the buffer pool. insertEntry() is refused. No other index
+     * may have the file open for writing at the same time.
+     */
+    bool readOnly;
+
+    /**
+     * If not 0, the scan of the base relation that builds a new index reads its pages through a BufferRing of
+     * that many frames, so the build evicts no more than that many pages of the pool.
+     */
+    std::uint32_t buildRingSize;
+
+    /**
+     * Fraction, in [0, 1], of the room for entries of a leaf below which deleteEntry() merges the leaf with a sibling
+     * under the same parent, or borrows entries from the sibling if the two do not fit in one leaf. Leaves above it
+     * are left as they are however few entries they hold; a leaf that becomes empty is always merged. 0 only
+     * merges empty leaves.
+     */
+    double mergeThreshold;
+
+    /**
+     * Attributes stored in the leaves with every entry, which makes the index covering: IndexScanCursor::scanNextCovered()
+     * returns them, packed in this order, without reading the base relation. At most MAX_INCLUDED_ATTRIBUTES of them,
+     * taking at most MAX_PAYLOAD_SIZE bytes together. Only used when a new index is built; an index that is opened
+     * again keeps the attributes recorded in its meta page.
+     */
+    std::vector<IndexAttribute> included;
+
+    /**
+     * Number of threads that build a new index. The pages of the base relation are split into that many ranges,
+     * each scanned by its own thread. When bulk loading, every thread sorts the entries of its range and the sorted
+     * streams are merged into the leaves, which are still written one after the other in key order. Otherwise the
+     * threads insert their tuples into the tree concurrently. 1 builds on the calling thread.
+     */
+    int buildThreads;
+
+    /**
+     * If not 0, insertEntry() adds entries to an in-memory buffer of that many entries instead of the leaves. A full
+     * buffer is sorted and applied to the leaves as one batch, so that entries landing in the same leaf change it
+     * under one latch and one log record. Lookups, scans, deletes and compact() apply the buffer first, so they see
+     * every entry inserted before them. Entries still buffered when the process dies are lost, whatever redo log
+     * the buffer manager has.
+     */
+    std::size_t deltaBufferSize;
+
+    /**
+     * If not 0, a new index keeps a blocked Bloom filter over its keys with that many bits per entry, which
+     * lookup(), lookupBatch(), lookupInterleaved() and equality scans consult first, so a key that is not in the
+     * index is turned away without reading the tree. Inserts add their keys to the filter; compact() sizes it
+     * again for the entries there are. The filter is saved in the index file when the index is closed and
+     * rebuilt from the leaves if it was not. Only used when a new index is built; an index that is opened again
+     * keeps the setting recorded in its meta page.
+     */
+    int bloomBitsPerKey;
+
+    /**
+     * If true, a new index file stores its nodes compressed on disk, see File::setCompression(). Sorted keys and
+     * runs of record ids on the same page compress well, so a scan that is not cached reads fewer bytes, for the
+     * cost of decompressing every node read into the pool. Only used when a new index is built; an index file
+     * that was built compressed stays compressed when it is opened again.
+     */
+    bool compressPages;
+
+    BTreeOptions()
+        : bulkLoad(true), fillFactor(BULKLOAD_FILL_FACTOR), sortRunSize(SORT_RUN_SIZE),
+          pinnedLevels(0), pinnedPageLimit(PINNED_PAGE_LIMIT), prefetchDepth(PREFETCH_DEPTH), readOnly(false),
+          buildRingSize(0), mergeThreshold(MERGE_THRESHOLD), buildThreads(1), deltaBufferSize(0), bloomBitsPerKey(0),
+          compressPages(false)
+    {
+    }
+  };
+
+  /**
+   * @brief Shape of a BTreeIndex and counts of the work its operations did, as returned by BTreeIndex::getStats().
+   */
+  struct BTreeStats
+  {
+    /**
+     * Number of levels, 1 if the root is a leaf.
+     */
+    int height;
+
+    /**
+     * Number of leaf pages.
+     */
+    std::uint64_t leafPages;
+
+    /**
+     * Number of non-leaf pages.
+     */
+    std::uint64_t nonLeafPages;
+
+    /**
+     * Number of entries in the leaves.
+     */
+    std::uint64_t entries;
+
+    /**
+     * Average fraction of the room for entries in use in the leaves, in [0, 1].
+     */
+    double leafFill;
+
+    /**
+     * Average fraction of the key slots in use in the non-leaf nodes, in [0, 1]; 0 without non-leaf nodes.
+     */
+    double nonLeafFill;
+
+    /**
+     * Number of insertEntry() calls, including the inserts of a build without bulk loading.
+     */
+    std::uint64_t inserts;
+
+    /**
+     * Number of nodes inserts read, counting every attempt.
+     */
+    std::uint64_t insertNodeVisits;
+
+    /**
+     * Number of insert attempts started over, because of a split on the way down or another thread getting in between.
+     */
+    std::uint64_t insertRetries;
+
+    /**
+     * Number of leaf splits.
+     */
+    std::uint64_t leafSplits;
+
+    /**
+     * Number of non-leaf node splits.
+     */
+    std::uint64_t nonLeafSplits;
+
+    /**
+     * Number of splits that gave the tree a new root.
+     */
+    std::uint64_t rootSplits;
+
+    /**
+     * Number of scans started, on the index and on cursors.
+     */
+    std::uint64_t scans;
+
+    /**
+     * Number of nodes starting the scans read, down to and along the leaves up to the first entry.
+     */
+    std::uint64_t scanNodeVisits;
+
+    /**
+     * Number of scanNext() and scanNextBatch() calls.
+     */
+    std::uint64_t scanNexts;
+
+    /**
+     * Number of leaves scanNext() and scanNextBatch() moved on to.
+     */
+    std::uint64_t scanNextNodeVisits;
+
+    /**
+     * Number of lookup() calls.
+     */
+    std::uint64_t lookups;
+
+    /**
+     * Number of nodes the lookups read, down to and along the leaves.
+     */
+    std::uint64_t lookupNodeVisits;
+
+    /**
+     * Number of times an interleaved lookup set a probe aside because its next node was not in the buffer pool.
+     */
+    std::uint64_t lookupYields;
+
+    /**
+     * Number of deleteEntry() calls, whether or not they found the entry.
+     */
+    std::uint64_t deletes;
+
+    /**
+     * Number of nodes deletes read, counting every attempt.
+     */
+    std::uint64_t deleteNodeVisits;
+
+    /**
+     * Number of delete attempts started over because another thread got in between.
+     */
+    std::uint64_t deleteRetries;
+
+    /**
+     * Number of leaves merged into their left sibling.
+     */
+    std::uint64_t leafMerges;
+
+    /**
+     * Number of times a leaf below the merge threshold took entries from a sibling instead.
+     */
+    std::uint64_t leafBorrows;
+
+    /**
+     * Number of pages of merged-away leaves and of trees replaced by compact() handed back to the buffer manager.
+     */
+    std::uint64_t freedPages;
+
+    /**
+     * Number of compact() calls.
+     */
+    std::uint64_t compactions;
+
+    /**
+     * Number of times the buffered inserts of BTreeOptions::deltaBufferSize were applied to the leaves.
+     */
+    std::uint64_t deltaFlushes;
+
+    /**
+     * Number of lookups and equality scans the Bloom filter answered without reading the tree.
+     */
+    std::uint64_t bloomRejects;
+
+    /**
+     * Number of node images kept for the IndexSnapshots open on the index.
+     */
+    std::uint64_t snapshotImages;
+
+    BTreeStats()
+        : height(0), leafPages(0), nonLeafPages(0), entries(0), leafFill(0), nonLeafFill(0), inserts(0),
+          insertNodeVisits(0), insertRetries(0), leafSplits(0), nonLeafSplits(0), rootSplits(0), scans(0),
+          scanNodeVisits(0), scanNexts(0), scanNextNodeVisits(0), lookups(0), lookupNodeVisits(0),
+          lookupYields(0), deletes(0), deleteNodeVisits(0), deleteRetries(0), leafMerges(0), leafBorrows(0),
+          freedPages(0), compactions(0), deltaFlushes(0), bloomRejects(0), snapshotImages(0)
+    {
+    }
+  };
+
+  /**
+   * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that
+   * add to or make changes to the leaf node pages of the tree. Is templated for the key member.
+   */
+  template <class T>
+  class RIDKeyPair
+  {
+  public:
+    RecordId rid;
+    T key;
+    void set(RecordId r, T k)
+    {
+      rid = r;
+      key = k;
+    }
+  };
+
+  /**
+   * @brief Structure to store a key page pair which is used to pass the key and page to functions that make
+   * any modifications to the non leaf pages of the tree.
+   */
+  template <class T>
+  class PageKeyPair
+  {
+  public:
+    PageId pageNo;
+    T key;
+    void set(int p, T k)
+    {
+      pageNo = p;
+      key = k;
+    }
+  };
+
+  /**
+   * @brief Overloaded operator to compare the key values of two rid-key pairs
+   * and if they are the same compares to see if the first pair has
+   * a smaller rid.pageNo value, then a smaller rid.slot_number value.
+   */
+  template <class T>
+  bool operator<(const RIDKeyPair<T> &r1, const RIDKeyPair<T> &r2)
+  {
+    if (r1.key != r2.key)
+      return r1.key < r2.key;
+    else if (r1.rid.page_number != r2.rid.page_number)
+      return r1.rid.page_number < r2.rid.page_number;
+    else
+      return r1.rid.slot_number < r2.rid.slot_number;
+  }
+
+  /**
+   * @brief Returns the number of keys in the sorted array that are smaller than key, i.e. the position of the
+   * first key not less than key. Dispatches to the KeySearch policy selected at compile time.
+   *
+   * @param keys      Sorted keys.
+   * @param numKeys   Number of keys in use.
+   * @param key       Key to search for.
+   */
+  template <class T>
+  inline int keyLowerBound(const T *keys, const int numKeys, const T &key)
+  {
+    return KeySearch::lowerBound(keys, numKeys, key);
+  }
+
+  /**
+   * @brief Returns the number of keys in the sorted array that are not greater than key, i.e. the position of the
+   * first key greater than key. Dispatches to the KeySearch policy selected at compile time.
+   *
+   * @param keys      Sorted keys.
+   * @param numKeys   Number of keys in use.
+   * @param key       Key to search for.
+   */
+  template <class T>
+  inline int keyUpperBound(const T *keys, const int numKeys, const T &key)
+  {
+    return KeySearch::upperBound(keys, numKeys, key);
+  }
+
+  /**
+   * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
+   * to the following structure to store or retrieve information from it.
+   * Contains the relation name for which the index is created, the byte offset
+   * of the key value on which the index is made, the type of the key and the page no
+   * of the root page. Root page starts as page 2 but since a split can occur
+   * at the root the root page may get moved up and get a new page no.
+   */
+  struct IndexMetaInfo
+  {
+    /**
+     * Name of base relation.
+     */
+    char relationName[20];
+
+    /**
+     * Offset of attribute, over which index is built, inside the record stored in pages.
+     */
+    int attrByteOffset;
+
+    /**
+     * Type of the attribute over which index is built.
+     */
+    Datatype attrType;
+
+    /**
+     * Page number of root page of the B+ Tree inside the file index file.
+     */
+    PageId rootPageNo;
+
+    /**
+     *
+     * @brief boolean to indicate whether or not the root node is a leaf or not.
+     *
+     * Piazza post @377
+     */
+    bool isRootALeaf;
+
+    /**
+     * Number of attributes stored with every entry.
+     */
+    int numIncluded;
+
+    /**
+     * The attributes stored with every entry, in payload order.
+     */
+    IndexAttribute included[MAX_INCLUDED_ATTRIBUTES];
+
+    /**
+     * Number of attributes of a COMPOSITE key, 0 for other indexes.
+     */
+    int numKeyAttributes;
+
+    /**
+     * The attributes of a COMPOSITE key, most significant first.
+     */
+    IndexAttribute keyAttributes[MAX_KEY_ATTRIBUTES];
+
+    /**
+     * Bits per entry of the Bloom filter of the index, 0 if it has none.
+     */
+    int bloomBitsPerKey;
+
+    /**
+     * First BloomPage of the saved filter, Page::INVALID_NUMBER if none was saved.
+     */
+    PageId bloomPageNo;
+
+    /**
+     * Number of blocks of the saved filter.
+     */
+    std::uint32_t bloomBlocks;
+
+    /**
+     * True if the saved filter holds every key of the index. Cleared while the index is open for writing, so a
+     * filter left behind by a crash is rebuilt rather than trusted.
+     */
+    bool bloomValid;
+  };
+
+  /**
+   * @brief Number of Bloom filter blocks a BloomPage holds.
+   */
+  const int BLOOM_PAGE_BLOCKS = (BlobFile::DATA_SIZE - 2 * sizeof(std::uint32_t)) / BloomFilter::BLOCK_SIZE;
+
+  /**
+   * @brief Page of the Bloom filter of an index saved in the index file. The pages of a filter form a chain,
+   * each holding the next blocks of the filter.
+   */
+  struct BloomPage
+  {
+    /**
+     * Next page of the filter, Page::INVALID_NUMBER for the last one.
+     */
+    PageId nextPageNo;
+
+    /**
+     * Number of blocks on this page.
+     */
+    std::uint32_t numBlocks;
+
+    /**
+     * The blocks.
+     */
+    char blocks[BLOOM_PAGE_BLOCKS * BloomFilter::BLOCK_SIZE];
+  };
+
+  /*
+  Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
+  These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of
+  node they are. The level member of each non leaf structure seen below is set to 1 if the nodes
+  at this level are just above the leaf nodes and counts up towards the root.
+  Entries occupy the first numKeys slots of each node, in ascending key order. keyArray[i] of a non-leaf node is the
+  smallest key under pageNoArray[i + 1] when it is set; deletes may leave it smaller than every key still there, but
+  never larger, and never smaller than a key under pageNoArray[i].
+  */
+
+  /**
+   * @brief Structure for all non-leaf nodes with keys of type T.
+   *
+   * keyArray is split into blocks of NodeCapacity<T>::NONLEAF_BLOCK keys, a cache line each, and blockKeys holds
+   * the last key of every block in use. A search finds the block in blockKeys, a few cache lines, and then the key
+   * within that one block, rather than probing across the whole of keyArray.
+   */
+  template <class T>
+  struct NonLeafNode
+  {
+    /**
+     * Level of the node in the tree.
+     */
+    int level;
+
+    /**
+     * Number of keys in use. The node has numKeys + 1 children.
+     */
+    int numKeys;
+
+    /**
+     * Last key of each block of keyArray, (numKeys + NONLEAF_BLOCK - 1) / NONLEAF_BLOCK of them. Kept up to date
+     * by every change to keyArray.
+     */
+    T blockKeys[NodeCapacity<T>::NONLEAF_BLOCKS];
+
+    /**
+     * Stores keys.
+     */
+    T keyArray[NodeCapacity<T>::NONLEAF];
+
+    /**
+     * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
+     */
+    PageId pageNoArray[NodeCapacity<T>::NONLEAF + 1];
+  };
+
+  /**
+   * @brief Structure for all leaf nodes with keys of type T, for INTEGER and DOUBLE keys.
+   *
+   * Entries with equal keys share one posting list: the key is stored once and followed by the rids of all of
+   * its entries, sorted by page and slot. data starts with the numLists distinct keys in ascending order, so they
+   * can be searched like the keys of a non-leaf node, followed by the position of the first entry of each list as
+   * a std::uint16_t. The rids are packed into LEAFRIDSIZE bytes each, followed by the payloadSize bytes of
+   * included attributes of their entry, at the end of data, entry 0 last, so both ends grow towards the free space
+   * in the middle. Entry i is the ith rid and has the key of the last list starting at or before i.
+   *
+   * A list too long for one leaf goes on in the next ones along the sibling links, the way runs of equal keys
+   * already do. A bulk load sorts such a list across its leaves, but an insert goes to the last leaf holding the
+   * key, as the non-leaf keys do not tell rids apart, and is sorted into the part of the list in that leaf only.
+   */
+  template <class T>
+  struct LeafNode
+  {
+    /**
+     * Number of <key, rid> entries in use.
+     */
+    int numKeys;
+
+    /**
+     * Page number of the leaf on the right side.
+     * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+     */
+    PageId rightSibPageNo;
+
+    /**
+     * Number of distinct keys, i.e. of posting lists.
+     */
+    int numLists;
+
+    /**
+     * Number of bytes of included attributes stored after each rid, the same in every leaf of an index. Also keeps
+     * data aligned for DOUBLE keys.
+     */
+    int payloadSize;
+
+    /**
+     * Keys, list positions, rids and payloads, as described above.
+     */
+    char data[NodeCapacity<T>::LEAF_DATA];
+  };
+
+  /**
+   * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+   */
+  typedef NonLeafNode<int> NonLeafNodeInt;
+
+  /**
+   * @brief Structure for leaf nodes of INTEGER keys, with keys and page numbers packed by frame of reference.
+   *
+   * Each key is stored as its distance from keyBase, the smallest key of the leaf, in keyWidth bytes, and each rid
+   * page number as its distance from pageBase in pageWidth bytes, where a width is 1, 2 or 4, the fewest that hold
+   * the largest distance. Dense keys and rids of records stored close together, the common case, so take 1 or 2
+   * bytes instead of 4. data starts with the numKeys key distances in key order, so they can be searched where they
+   * are; the rows of page distance, slot number and payload are packed at the end of data, entry 0 last, so both
+   * ends grow towards the free space in the middle. Entries with equal keys are in insertion order. An entry that
+   * does not fit the widths and bases makes the leaf be packed again for all of its entries.
+   */
+  struct LeafNodePacked
+  {
+    /**
+     * Number of <key, rid> entries in use.
+     */
+    int numKeys;
+
+    /**
+     * Page number of the leaf on the right side.
+     */
+    PageId rightSibPageNo;
+
+    /**
+     * Number of bytes of included attributes stored after each rid, the same in every leaf of an index.
+     */
+    int payloadSize;
+
+    /**
+     * Key the stored key distances are taken from, not greater than any key of the leaf.
+     */
+    int keyBase;
+
+    /**
+     * Page number the stored page distances are taken from, not greater than any rid page number of the leaf.
+     */
+    PageId pageBase;
+
+    /**
+     * Largest rid page number stored since the leaf was last packed, not smaller than any of the leaf.
+     */
+    PageId pageTop;
+
+    /**
+     * Bytes per key distance, 1, 2 or 4.
+     */
+    std::uint8_t keyWidth;
+
+    /**
+     * Bytes per page distance, 1, 2 or 4.
+     */
+    std::uint8_t pageWidth;
+
+    /**
+     * Unused, zero.
+     */
+    std::uint8_t unused[2];
+
+    /**
+     * Key distances followed by free space and the rows, see above.
+     */
+    char data[PACKEDLEAFDATASIZE];
+  };
+
+  /**
+   * @brief Structure for all leaf nodes when the key is of INTEGER type.
+   */
+  typedef LeafNodePacked LeafNodeInt;
+
+  /**
+   * @brief Structure for all non-leaf nodes when the key is of DOUBLE type.
+   */
+  typedef NonLeafNode<double> NonLeafNodeDouble;
+
+  /**
+   * @brief Structure for all leaf nodes when the key is of DOUBLE type.
+   */
+  typedef LeafNode<double> LeafNodeDouble;
+
+  /**
+   * @brief Structure for all non-leaf nodes when the key is of STRING type.
+   */
+  typedef NonLeafNode<StringKey> NonLeafNodeString;
+
+  /**
+   * @brief Structure for all non-leaf nodes when the key is COMPOSITE.
+   */
+  typedef NonLeafNode<CompositeKey> NonLeafNodeComposite;
+
+  /**
+   * @brief Structure for all leaf nodes when the key is COMPOSITE.
+   */
+  typedef LeafNode<CompositeKey> LeafNodeComposite;
+
+  /**
+   * @brief Structure for all leaf nodes when the key is of STRING type.
+   *
+   * Keys are prefix compressed: the first prefixLen bytes, shared by every key of the leaf, are stored once
+   * and each entry only holds the remaining STRINGSIZE - prefixLen bytes of its key followed by its rid and the
+   * payloadSize bytes of its included attributes. Entries are packed in ascending key order with a fixed stride, so
+   * the leaf holds STRINGLEAFDATASIZE / (STRINGSIZE - prefixLen + sizeof(RecordId) + payloadSize) of them and can
+   * still be binary searched.
+   * A search key is compared against the prefix once and then only against the stored suffixes.
+   */
+  struct LeafNodeString
+  {
+    /**
+     * Number of <key, rid> entries in use.
+     */
+    int numKeys;
+
+    /**
+     * Page number of the leaf on the right side.
+     */
+    PageId rightSibPageNo;
+
+    /**
+     * Number of leading bytes shared by all keys of the leaf.
+     */
+    int prefixLen;
+
+    /**
+     * Number of bytes of included attributes stored after each rid, the same in every leaf of an index.
+     */
+    int payloadSize;
+
+    /**
+     * The shared leading bytes. Only the first prefixLen are meaningful.
+     */
+    char prefix[STRINGSIZE];
+
+    /**
+     * numKeys entries of STRINGSIZE - prefixLen key bytes followed by a RecordId and the payload, unaligned.
+     */
+    char entries[STRINGLEAFDATASIZE];
+  };
+
+  /**
+   * @brief Maps a key type to the structure of its leaf nodes.
+   */
+  template <class T>
+  struct LeafNodeOf
+  {
+    typedef LeafNode<T> type;
+  };
+
+  template <>
+  struct LeafNodeOf<int>
+  {
+    typedef LeafNodePacked type;
+  };
+
+  template <>
+  struct LeafNodeOf<StringKey>
+  {
+    typedef LeafNodeString type;
+  };
+
+  static_assert(sizeof(NonLeafNodeInt) <= BlobFile::DATA_SIZE && sizeof(LeafNodeInt) <= BlobFile::DATA_SIZE, "INTEGER nodes must leave room for the page checksum");
+  static_assert(sizeof(NonLeafNodeDouble) <= BlobFile::DATA_SIZE && sizeof(LeafNodeDouble) <= BlobFile::DATA_SIZE, "DOUBLE nodes must leave room for the page checksum");
+  static_assert(sizeof(NonLeafNodeString) <= BlobFile::DATA_SIZE && sizeof(LeafNodeString) <= BlobFile::DATA_SIZE, "STRING nodes must leave room for the page checksum");
+  static_assert(sizeof(NonLeafNodeComposite) <= BlobFile::DATA_SIZE && sizeof(LeafNodeComposite) <= BlobFile::DATA_SIZE, "COMPOSITE nodes must leave room for the page checksum");
+
+  class BTreeIndex;
+  class FileScan;
+
+  /**
+   * @brief Residual predicate on the keys of a scan, see ScanOptions::predicate.
+   *
+   * @param key  Key of the entry: an int, a double, the STRINGSIZE bytes of a STRING key, or the CompositeKey
+   *             encoding of a COMPOSITE key.
+   * @param arg  ScanOptions::predicateArg.
+   * @return  True if the entry is to be returned.
+   */
+  typedef bool (*KeyPredicate)(const void *key, void *arg);
+
+  /**
+   * @brief Options of a range scan beyond its range. Passed to BTreeIndex::startScan().
+   */
+  struct ScanOptions
+  {
+    /**
+     * Checked on the key of every entry in the range, inside the leaf, before the entry is returned. Entries it
+     * rejects are skipped without counting against the limit. NULL returns every entry in the range.
+     */
+    KeyPredicate predicate;
+
+    /**
+     * Handed to every call of the predicate.
+     */
+    void *predicateArg;
+
+    /**
+     * Number of entries after which the scan completes, as if its range ended there; no leaf past the one holding
+     * the last of them is read. 0 for no limit.
+     */
+    std::size_t limit;
+
+    ScanOptions() : predicate(NULL), predicateArg(NULL), limit(0)
+    {
+    }
+  };
+
+  /**
+   * @brief The entries of a BTreeIndex as they were when the snapshot was taken. An IndexScanCursor constructed on
+   * the snapshot scans them, not seeing the inserts and deletes made since, however long it runs; inserts and
+   * deletes are not held up by it. Taking a snapshot waits for the inserts and deletes running at the time.
+   *
+   * While a snapshot is open, a node changed for the first time since the newest snapshot was taken is saved as it
+   * was before the change, and pages unlinked from the tree are not freed. The saved nodes are dropped as the
+   * snapshots that read them are closed, so a snapshot should not be held longer than its scans run.
+   *
+   * @warning A snapshot must not outlive its index, nor the cursors constructed on it outlive the snapshot.
+   */
+  class IndexSnapshot
+  {
+  public:
+    /**
+     * Takes a snapshot of the index. Entries held back by BTreeOptions::deltaBufferSize are applied first, so the
+     * snapshot holds every entry inserted before it.
+     *
+     * @param index   Index to take the snapshot of.
+     */
+    explicit IndexSnapshot(BTreeIndex *index);
+
+    /**
+     * Closes the snapshot.
+     */
+    ~IndexSnapshot();
+
+  private:
+    IndexSnapshot(const IndexSnapshot &);
+    IndexSnapshot &operator=(const IndexSnapshot &);
+
+    /**
+     * Index the snapshot is of.
+     */
+    BTreeIndex *index;
+
+    /**
+     * Epoch of the snapshot in the index's NodeVersionTable.
+     */
+    std::uint64_t epoch;
+
+    /**
+     * Root of the tree when the snapshot was taken.
+     */
+    PageId rootPageNum;
+
+    /**
+     * True if that root was a leaf.
+     */
+    bool rootIsLeaf;
+
+    /**
+     * Counter of the index's OperationTracker the snapshot is counted in, so that the pages it may read are not
+     * freed while it is open.
+     */
+    std::uint32_t operationStripe;
+
+    friend class BTreeIndex;
+    friend class IndexScanCursor;
+  };
+
+  /**
+   * @brief State of one range scan over a BTreeIndex. A cursor is bound to an index when it is constructed and
+   * can run one scan at a time; independent cursors on the same index do not affect each other. The cursor keeps
+   * a copy of the leaf it is on, so it holds no pins between calls.
+   *
+   * @warning A cursor must only be used by one thread at a time, and not after its index has been destroyed.
+   */
+  class IndexScanCursor
+  {
+  public:
+    /**
+     * Constructs a cursor over the given index. No scan is started.
+     *
+     * @param index   Index to scan.
+     */
+    explicit IndexScanCursor(BTreeIndex *index);
+
+    /**
+     * Constructs a cursor over a snapshot of an index. Its scans return the entries the index held when the
+     * snapshot was taken. No scan is started.
+     *
+     * @param snapshot  Snapshot to scan.
+     */
+    explicit IndexScanCursor(const IndexSnapshot &snapshot);
+
+    /**
+     * Ends the cursor's scan, if it is running.
+     */
+    ~IndexScanCursor();
+
+    /**
+     * Begin a filtered scan of the index on this cursor, ending any scan the cursor was running.
+     * @see BTreeIndex::startScan
+     */
+    void startScan(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp,
+                   const ScanOptions &scanOptions = ScanOptions());
+
+    /**
+     * Fetch the record id of the next index entry that matches the cursor's scan.
+     * @see BTreeIndex::scanNext
+     */
+    void scanNext(RecordId &outRid);
+
+    /**
+     * Like scanNext(), but also copies the key of the entry to outKey, in the form a KeyPredicate gets it, e.g. to
+     * merge the entries of several scans in key order.
+     * @see BTreeIndex::scanNext
+     */
+    void scanNext(RecordId &outRid, void *outKey);
+
+    /**
+     * Fetch the record ids of up to maxRids next index entries that match the cursor's scan.
+     * @see BTreeIndex::scanNextBatch
+     */
+    std::size_t scanNextBatch(RecordId *outRids, const std::size_t maxRids);
+
+    /**
+     * Fetch the record ids and included attributes of up to maxRids next index entries that match the cursor's scan.
+     * @see BTreeIndex::scanNextCovered
+     */
+    std::size_t scanNextCovered(RecordId *outRids, void *outPayloads, const std::size_t maxRids);
+
+    /**
+     * Like scanNextBatch(), but also copies the keys of the entries to outKeys, one after the other, keySize()
+     * bytes each, in the form a KeyPredicate gets them.
+     * @see BTreeIndex::scanNextBatch
+     */
+    std::size_t scanNextKeys(RecordId *outRids, void *outKeys, const std::size_t maxRids);
+
+    /**
+     * Move the scan forward to the first entry whose key is not smaller than key, so that the next entry returned
+     * is the first one there that matches. Skipped entries do not count against the limit. The current leaf is
+     * searched by galloping from the entry the scan is on, probing 1, 2, 4, ... entries ahead before searching
+     * the last gap, so a short skip costs little; a key past the right sibling of the leaf is found by a descent
+     * from the root rather than by walking the leaves in between. Entries already returned are never returned
+     * again, so a key behind the scan leaves it where it is.
+     *
+     * @param key  Key in the form a KeyPredicate gets it.
+     * @throws ScanNotInitializedException If no scan has been initialized on the cursor.
+     */
+    void skipTo(const void *key);
+
+    /**
+     * Returns the type of the keys of the index the cursor is bound to.
+     */
+    Datatype keyType() const;
+
+    /**
+     * Returns the size in bytes of a key in the form a KeyPredicate gets it.
+     */
+    std::size_t keySize() const;
+
+    /**
+     * Terminate the cursor's scan.
+     * @throws ScanNotInitializedException If no scan has been initialized on the cursor.
+     */
+    void endScan();
+
+    /**
+     * Returns true if a scan has been started on the cursor and not ended.
+     */
+    bool isScanning() const
+    {
+      return scanExecuting;
+    }
+
+  private:
+    IndexScanCursor(const IndexScanCursor &);
+    IndexScanCursor &operator=(const IndexScanCursor &);
+
+    /**
+     * Index being scanned.
+     */
+    BTreeIndex *index;
+
+    /**
+     * Snapshot the cursor scans, NULL to scan the index as it is.
+     */
+    const IndexSnapshot *snapshot;
+
+    /**
+     * True if a scan has been started on the cursor.
+     */
+    bool scanExecuting;
+
+    /**
+     * Index of next entry to be scanned in current leaf being scanned.
+     */
+    int nextEntry;
+
+    /**
+     * Residual predicate of the scan, NULL if there is none.
+     */
+    KeyPredicate predicate;
+
+    /**
+     * Argument handed to the predicate.
+     */
+    void *predicateArg;
+
+    /**
+     * Number of entries the scan may still return before its limit. Starts out at (std::size_t)-1 if it has none.
+     */
+    std::size_t remaining;
+
+    /**
+     * Copy of the leaf being scanned. Taken under the leaf's latch, so inserts into the leaf do not disturb the scan.
+     */
+    Page currentLeaf;
+
+    /**
+     * Number of leaves right of currentLeaf that were handed to the buffer manager for read-ahead.
+     */
+    int prefetchAhead;
+
+    /**
+     * Counter of the index's OperationTracker the running scan is counted in. A scan counts as one operation from
+     * startScan() to endScan(), since the page numbers in currentLeaf must stay valid in between.
+     */
+    std::uint32_t operationStripe;
+
+    /**
+     * Low INTEGER value for scan.
+     */
+    int lowValInt;
+
+    /**
+     * Low DOUBLE value for scan.
+     */
+    double lowValDouble;
+
+    /**
+     * Low STRING value for scan.
+     */
+    StringKey lowValString;
+
+    /**
+     * Low COMPOSITE value for scan.
+     */
+    CompositeKey lowValComposite;
+
+    /**
+     * High INTEGER value for scan.
+     */
+    int highValInt;
+
+    /**
+     * High DOUBLE value for scan.
+     */
+    double highValDouble;
+
+    /**
+     * High STRING value for scan.
+     */
+    StringKey highValString;
+
+    /**
+     * High COMPOSITE value for scan.
+     */
+    CompositeKey highValComposite;
+
+    /**
+     * Low Operator. Can only be GT(>) or GTE(>=).
+     */
+    Operator lowOp;
+
+    /**
+     * High Operator. Can only be LT(<) or LTE(<=).
+     */
+    Operator highOp;
+
+    /**
+     * Returns the low value of the scan for keys of type T.
+     */
+    template <class T>
+    const T &scanLowVal() const;
+
+    /**
+     * Returns the high value of the scan for keys of type T.
+     */
+    template <class T>
+    const T &scanHighVal() const;
+
+    /**
+     * Returns true if the key satisfies the low end of the scan range.
+     */
+    template <class T>
+    bool satisfiesLow(const T &key) const
+    {
+      return lowOp == GT ? scanLowVal<T>() < key : !(key < scanLowVal<T>());
+    }
+
+    /**
+     * Returns true if the key passes the residual predicate of the scan.
+     */
+    template <class T>
+    bool satisfiesPredicate(const T &key) const
+    {
+      return predicate == NULL || predicate(&key, predicateArg);
+    }
+
+    /**
+     * Returns true if the key satisfies the high end of the scan range.
+     */
+    template <class T>
+    bool satisfiesHigh(const T &key) const
+    {
+      return highOp == LT ? key < scanHighVal<T>() : !(scanHighVal<T>() < key);
+    }
+
+    friend class BTreeIndex;
+  };
+
+  template <>
+  inline const int &IndexScanCursor::scanLowVal<int>() const
+  {
+    return lowValInt;
+  }
+
+  template <>
+  inline const int &IndexScanCursor::scanHighVal<int>() const
+  {
+    return highValInt;
+  }
+
+  template <>
+  inline const double &IndexScanCursor::scanLowVal<double>() const
+  {
+    return lowValDouble;
+  }
+
+  template <>
+  inline const double &IndexScanCursor::scanHighVal<double>() const
+  {
+    return highValDouble;
+  }
+
+  template <>
+  inline const StringKey &IndexScanCursor::scanLowVal<StringKey>() const
+  {
+    return lowValString;
+  }
+
+  template <>
+  inline const StringKey &IndexScanCursor::scanHighVal<StringKey>() const
+  {
+    return highValString;
+  }
+
+  template <>
+  inline const CompositeKey &IndexScanCursor::scanLowVal<CompositeKey>() const
+  {
+    return lowValComposite;
+  }
+
+  template <>
+  inline const CompositeKey &IndexScanCursor::scanHighVal<CompositeKey>() const
+  {
+    return highValComposite;
+  }
+
+  /**
+   * @brief Stream of index entries in ascending key order that a new BTreeIndex is bulk loaded from instead of a base
+   * relation, e.g. a sorted run of an LsmIndex.
+   */
+  class SortedEntrySource
+  {
+  public:
+    virtual ~SortedEntrySource()
+    {
+    }
+
+    /**
+     * Fetch the next entry. Entries must come in ascending key order.
+     *
+     * @param outKey  Receives the key, in the form a KeyPredicate gets it: an int, a double or the STRINGSIZE bytes
+     *                of a STRING key. NULL if only the record id is wanted.
+     * @param outRid  Receives the record id of the entry.
+     * @return  False once there are no more entries.
+     */
+    virtual bool next(void *outKey, RecordId &outRid) = 0;
+  };
+
+  /**
+   * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
+   * relation, or on a composite key over several of them. Any number of scans can run on it at once, each in its own IndexScanCursor; startScan(),
+   * scanNext() and endScan() drive a cursor built into the index.
+   *
+   * Inserts may run concurrently with each other and with the scan. Every node page has an OptimisticLatch:
+   * descents read nodes without latching them and validate the node's version before following a child pointer,
+   * starting over from the root if a writer got in between. Full non-leaf nodes are split on the way down, so a
+   * leaf split only has to latch the leaf and its parent. The latch of the meta page guards rootPageNum and
+   * rootIsLeaf. Scans copy each leaf under its latch and follow right sibling links, so a leaf splitting under a
+   * scan neither hides nor repeats the entries it held when it was copied. A cursor itself is used by one thread
+   * at a time.
+   *
+   * Deletes run concurrently with all of the above. A leaf left below the merge threshold is rebalanced with a
+   * sibling under the latches of both leaves and their parent: the right one of the two is merged into the left
+   * one or, if they do not fit in one leaf, replaced by a new page taking half of the entries of both. The page
+   * left out is not changed, so an operation that got to it through a link
+   * read before sees the entries it held, as if it had read it before the merge. Its page is only freed once every
+   * operation that was running when it was unlinked, scans included, has finished. compact() keeps inserts and
+   * deletes out while it copies the tree, then retires the old tree the same way.
+   *
+   * An IndexSnapshot lets scans read the tree as it was when the snapshot was taken. Writers save a node in the
+   * NodeVersionTable, under its latch, before changing it in place; a scan on the snapshot descends from the root
+   * the snapshot recorded and reads each node as the oldest image saved after the snapshot, or as it is if there is
+   * none, validating the copy against the node's latch like other scans do.
+   */
+  class BTreeIndex
+  {
+
+  private:
+    /**
+     * File object for the index file.
+     */
+    File *file;
+
+    /**
+     * Buffer Manager Instance.
+     */
+    BufMgr *bufMgr;
+
+    /**
+     * Page number of meta page.
+     */
+    PageId headerPageNum;
+
+    /**
+     * page number of root page of B+ tree inside index file. Changes only with the latch of headerPageNum held.
+     */
+    PageId rootPageNum;
+
+    /**
+     * Datatype of attribute over which index is built.
+     */
+    Datatype attributeType;
+
+    /**
+     * Offset of attribute, over which index is built, inside records.
+     */
+    int attrByteOffset;
+
+    /**
+     * Number of keys in leaf node, depending upon the type of key.
+     */
+    int leafOccupancy;
+
+    /**
+     * Number of keys in non-leaf node, depending upon the type of key.
+     */
+    int nodeOccupancy;
+
+    /**
+     * Attributes stored with every entry, as recorded in the meta page. Empty unless the index is covering.
+     */
+    std::vector<IndexAttribute> included;
+
+    /**
+     * Attributes a COMPOSITE key is made of, most significant first, as recorded in the meta page. Empty for
+     * other indexes.
+     */
+    std::vector<IndexAttribute> keyAttributes;
+
+    /**
+     * Number of bytes the included attributes of an entry take together.
+     */
+    int payloadSize;
+
+    /**
+     * True if the root page is a leaf, i.e. the whole tree fits in one node. Mirrors IndexMetaInfo::isRootALeaf.
+     */
+    bool rootIsLeaf;
+
+    /**
+     * Latches of the pages of the index file.
+     */
+    NodeLatchTable latches;
+
+    /**
+     * @brief Operation counters of BTreeStats, updated without ordering.
+     */
+    struct OperationCounters
+    {
+      std::atomic<std::uint64_t> inserts;
+      std::atomic<std::uint64_t> insertNodeVisits;
+      std::atomic<std::uint64_t> insertRetries;
+      std::atomic<std::uint64_t> leafSplits;
+      std::atomic<std::uint64_t> nonLeafSplits;
+      std::atomic<std::uint64_t> rootSplits;
+      std::atomic<std::uint64_t> scans;
+      std::atomic<std::uint64_t> scanNodeVisits;
+      std::atomic<std::uint64_t> scanNexts;
+      std::atomic<std::uint64_t> scanNextNodeVisits;
+      std::atomic<std::uint64_t> lookups;
+      std::atomic<std::uint64_t> lookupNodeVisits;
+      std::atomic<std::uint64_t> lookupYields;
+      std::atomic<std::uint64_t> deletes;
+      std::atomic<std::uint64_t> deleteNodeVisits;
+      std::atomic<std::uint64_t> deleteRetries;
+      std::atomic<std::uint64_t> leafMerges;
+      std::atomic<std::uint64_t> leafBorrows;
+      std::atomic<std::uint64_t> freedPages;
+      std::atomic<std::uint64_t> compactions;
+      std::atomic<std::uint64_t> deltaFlushes;
+      std::atomic<std::uint64_t> bloomRejects;
+
+      OperationCounters()
+      {
+        clear();
+      }
+
+      /**
+       * Sets all counters to 0.
+       */
+      void clear();
+    };
+
+    /**
+     * Counts of the work operations on the index did.
+     */
+    OperationCounters counters;
+
+    // MEMBERS SPECIFIC TO THE DELTA BUFFER
+
+    /**
+     * Number of entries the delta buffer holds before it is applied; 0 if inserts go straight to the leaves.
+     */
+    std::size_t deltaCapacity;
+
+    /**
+     * RIDKeyPair of the key type of each buffered entry, in the order they were inserted.
+     */
+    std::vector<char> deltaPairs;
+
+    /**
+     * payloadSize bytes of included attributes of each buffered entry, in the order of deltaPairs.
+     */
+    std::vector<char> deltaPayloads;
+
+    /**
+     * Number of buffered entries. Read without deltaLatch to skip flushDelta() when there are none.
+     */
+    std::atomic<std::size_t> deltaCount;
+
+    /**
+     * Guards the delta buffer, and is held while it is applied.
+     */
+    std::mutex deltaLatch;
+
+    // MEMBERS SPECIFIC TO THE BLOOM FILTER
+
+    /**
+     * Bits per entry of the Bloom filter, as recorded in the meta page; 0 if the index has no filter.
+     */
+    int bloomBitsPerKey;
+
+    /**
+     * The Bloom filter over the keys of the index, NULL if it has none. Replaced as a whole by compact(), so
+     * readers take their own reference with std::atomic_load.
+     */
+    std::shared_ptr<BloomFilter> bloom;
+
+    /**
+     * First page of the filter saved in the index file, Page::INVALID_NUMBER if there is none.
+     */
+    PageId bloomPageNum;
+
+    // MEMBERS SPECIFIC TO DELETES
+
+    /**
+     * Fraction of a leaf in use below which a delete merges it with a sibling.
+     */
+    double mergeThreshold;
+
+    /**
+     * Operations running on the tree, scans included.
+     */
+    OperationTracker operations;
+
+    /**
+     * Guards retiredPages.
+     */
+    std::mutex retiredLatch;
+
+    /**
+     * Pages unlinked from the tree by merges and by compact() that are not freed yet, with the epoch of operations
+     * they were retired in.
+     */
+    std::unordered_map<PageId, std::uint64_t> retiredPages;
+
+    /**
+     * Inserts and deletes go through it; compact() closes it while it copies the tree.
+     */
+    WriterGate writers;
+
+    /**
+     * Serializes compact() calls.
+     */
+    std::mutex compactLatch;
+
+    /**
+     * Images of the nodes changed while IndexSnapshots are open.
+     */
+    NodeVersionTable versions;
+
+    // MEMBERS SPECIFIC TO PINNED UPPER LEVELS
+
+    /**
+     * @brief Non-leaf nodes kept pinned, as built by one call of pinUpperLevels(). Operations on the tree hold on to
+     * the set they started with, so a rebuilt set can replace it while they run; the pages are unpinned when the
+     * last holder lets go of the set.
+     */
+    struct PinnedSet
+    {
+      /**
+       * Buffer manager the nodes are pinned through.
+       */
+      BufMgr *bufMgr;
+
+      /**
+       * Handles of the pinned nodes, sorted by page number.
+       */
+      std::vector<PageHandle> nodes;
+
+      /**
+       * Unpins the nodes.
+       */
+      ~PinnedSet();
+
+      /**
+       * Returns the handle of the pinned node with the given page number, NULL if it is not pinned.
+       */
+      const PageHandle *find(const PageId pageNo) const;
+    };
+
+    /**
+     * Number of levels from the root kept pinned, 0 if none.
+     */
+    int pinnedLevels;
+
+    /**
+     * Maximum number of nodes kept pinned.
+     */
+    int pinnedPageLimit;
+
+    /**
+     * Number of leaves scans read ahead, 0 if none.
+     */
+    int prefetchDepth;
+
+    /**
+     * Current set of pinned nodes, NULL if none. Read and replaced with std::atomic_load and std::atomic_store.
+     */
+    std::shared_ptr<const PinnedSet> pinnedNodes;
+
+    /**
+     * True if the upper levels changed shape since they were pinned, so pinnedNodes must be rebuilt.
+     */
+    std::atomic<bool> pinnedNodesStale;
+
+    // MEMBERS SPECIFIC TO BULK LOADING
+
+    /**
+     * Leaf currently being filled by the bulk loader. Kept pinned until its right sibling is allocated.
+     */
+    PageHandle bulkLeaf;
+
+    /**
+     * Fraction of each leaf the bulk loader fills.
+     */
+    double bulkFillFactor;
+
+    /**
+     * Number of keys the bulk loader puts into each non-leaf node.
+     */
+    int bulkNodeCapacity;
+
+    /**
+     * Cursor used by startScan(), scanNext() and endScan().
+     */
+    IndexScanCursor scanCursor;
+
+    /**
+     * Pin the top pinnedLevels levels of non-leaf nodes, breadth first from the root and up to pinnedPageLimit nodes,
+     * and make them the current set of pinned nodes.
+     */
+    template <class T>
+    void pinUpperLevels();
+
+    /**
+     * Drop the current set of pinned nodes. Its pages are unpinned once no operation uses it any more.
+     */
+    void unpinUpperLevels();
+
+    /**
+     * Read a non-leaf node, from the pinned upper levels if it is one of them and otherwise through the buffer manager.
+     * Must be paired with unPinNode().
+     *
+     * @param pinned  Set of pinned nodes the operation started with, may be NULL.
+     * @param pageNo  Page number of the node.
+     * @return  Handle to the node.
+     */
+    PageHandle readNode(const PinnedSet *pinned, const PageId pageNo);
+
+    /**
+     * Read a node like readNode(), but only if that does not wait for the disk.
+     * Must be paired with unPinNode() if it returns true.
+     *
+     * @param pinned  Set of pinned nodes the operation started with, may be NULL.
+     * @param pageNo  Page number of the node.
+     * @param node    Handle to the node is returned in this.
+     * @return  False if the node is not in the buffer pool.
+     */
+    bool tryReadNode(const PinnedSet *pinned, const PageId pageNo, PageHandle &node);
+
+    /**
+     * Release a node obtained with readNode().
+     *
+     * @param pinned  Set of pinned nodes passed to readNode().
+     * @param node    Handle returned by readNode().
+     * @param dirty   True if the node was changed.
+     */
+    void unPinNode(const PinnedSet *pinned, const PageHandle &node, const bool dirty);
+
+    /**
+     * Reads the root page number, and whether the root is a leaf, under the latch of the meta page.
+     *
+     * @param isLeaf  True is returned in this if the root is a leaf.
+     * @param version Version of the meta page latch the values were read at is returned in this.
+     * @return  Page number of the root.
+     */
+    PageId readRoot(bool &isLeaf, std::uint64_t &version);
+
+    /**
+     * Copy the leaf at the given page, retrying until no insert changed it during the copy.
+     *
+     * @param pageNo  Page number of the leaf.
+     * @param leaf    The copy is returned in this.
+     */
+    void copyLeaf(const PageId pageNo, Page &leaf);
+
+    /**
+     * Copy a node as a snapshot saw it.
+     *
+     * @param snapshot  Open snapshot.
+     * @param pageNo    Page number of the node.
+     * @param node      The copy is returned in this.
+     * @param pattern   How the node is read, SEQUENTIAL_ACCESS for leaves like copyLeaf().
+     */
+    void copySnapshotNode(const IndexSnapshot &snapshot, const PageId pageNo, Page &node,
+                          const AccessPattern pattern);
+
+    /**
+     * Called with the node latched for writing before changing it in place: saves its image for the open
+     * snapshots and adds it to the redo group.
+     *
+     * @param group   Redo group of the change.
+     * @param node    The node.
+     */
+    void changeNode(RedoGroup &group, const PageHandle &node);
+
+    /**
+     * Takes a snapshot: applies the buffered inserts, then records the root and starts a new epoch while no
+     * writer is in.
+     *
+     * @param snapshot  Snapshot being constructed.
+     */
+    void openSnapshot(IndexSnapshot &snapshot);
+
+    /**
+     * Closes a snapshot and frees the pages unlinked while it was open if nothing else still reads them.
+     *
+     * @param snapshot  Snapshot being destroyed.
+     */
+    void closeSnapshot(IndexSnapshot &snapshot);
+
+    /**
+     * Move the cursor onto the leaf at the given page and keep the read-ahead of its right siblings going.
+     *
+     * @param cursor  Cursor of a running scan.
+     * @param pageNo  Page number of the leaf.
+     */
+    template <class T>
+    void enterLeaf(IndexScanCursor &cursor, const PageId pageNo);
+
+    /**
+     * Walks the tree level by level and fills in the shape fields of the stats.
+     */
+    template <class T>
+    void measureTree(BTreeStats &stats);
+
+    /**
+     * Open the index file, or create it and build the index, for either constructor.
+     *
+     * @param relationName    Name of the base relation.
+     * @param outIndexName    Returns the name of the index file.
+     * @param bufMgrIn        Buffer Manager Instance.
+     * @param attrByteOffset  Offset of the key attribute, 0 for a COMPOSITE index.
+     * @param attrType        Datatype of the key.
+     * @param keyAttrs        Attributes of a COMPOSITE key, empty otherwise.
+     * @param options         Build options.
+     * @param source          Entries a new index is bulk loaded from, NULL to build it from the base relation.
+     */
+    void open(const std::string &relationName, std::string &outIndexName, BufMgr *bufMgrIn, const int attrByteOffset,
+              const Datatype attrType, const std::vector<IndexAttribute> &keyAttrs, const BTreeOptions &options,
+              SortedEntrySource *source);
+
+    /**
+     * Reads a key of type T out of a key passed to the index or out of the bytes of a record at attrByteOffset.
+     * COMPOSITE keys are encoded from the attributes at their offsets.
+     */
+    template <class T>
+    T keyFrom(const void *key) const;
+
+    /**
+     * keyFrom() for each of the keys.
+     */
+    template <class T>
+    std::vector<T> keysFrom(const void *const *keys, const std::size_t numKeys) const;
+
+    /*
+    The methods below are templated over the key type T (int, double, StringKey or CompositeKey). The public methods
+    dispatch to the instantiation matching attributeType; nodes of the tree are LeafNodeOf<T>::type and NonLeafNode<T>.
+    */
+
+    /**
+     * Build a new index over the base relation, either with bulkLoad() or by inserting every tuple
+     * into an initially empty leaf, as the options say, or bulk load it from the source if there is one.
+     * Sets rootPageNum and rootIsLeaf.
+     *
+     * @param relationName  Name of the base relation.
+     * @param options       Build options.
+     * @param source        Sorted entries to build from instead of the base relation, or NULL.
+     */
+    template <class T>
+    void buildIndex(const std::string &relationName, const BTreeOptions &options, SortedEntrySource *source);
+
+    /**
+     * Build the index bottom-up from entries that already come in key order, at the fill factor given in the options.
+     *
+     * @param source    Sorted entries.
+     * @param options   Build options.
+     */
+    template <class T>
+    void bulkLoadSorted(SortedEntrySource &source, const BTreeOptions &options);
+
+    /**
+     * Build the index from the base relation bottom-up: extract every <key, rid> pair with a FileScan,
+     * sort them with an ExternalSort and stream the sorted pairs into leaves and non-leaf nodes at the
+     * fill factor given in the options.
+     *
+     * Entry is what gets sorted: the RIDKeyPair<T> itself, or the pair together with its included attributes
+     * for a covering index.
+     *
+     * @param relationName  Name of the base relation.
+     * @param options       Build options.
+     */
+    template <class T, class Entry>
+    void bulkLoad(const std::string &relationName, const BTreeOptions &options);
 
-  /**
-   * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that
-   * add to or make changes to the leaf node pages of the tree. Is templated for the key member.
-   */
-  template <class T>
-  class RIDKeyPair
-  {
-  public:
-    RecordId rid;
-    T key;
-    void set(RecordId r, T k)
-    {
-      rid = r;
-      key = k;
-    }
-  };
+    /**
+     * Body of a build thread of bulkLoad(): add the entry of every tuple the scanner returns to the sorter, then
+     * finish the sorter. An exception thrown on the way is stored in error rather than let out of the thread.
+     *
+     * @param scanner  Scan over the thread's range of the base relation.
+     * @param sorter   Sorter of the thread's entries.
+     * @param error    Set to the exception that ended the thread early, if any.
+     */
+    template <class T, class Entry>
+    void bulkLoadExtract(FileScan *scanner, ExternalSort<Entry> *sorter, std::exception_ptr *error);
 
-  /**
-   * @brief Structure to store a key page pair which is used to pass the key and page to functions that make
-   * any modifications to the non leaf pages of the tree.
-   */
-  template <class T>
-  class PageKeyPair
-  {
-  public:
-    PageId pageNo;
-    T key;
-    void set(int p, T k)
-    {
-      pageNo = p;
-      key = k;
-    }
-  };
+    /**
+     * Body of a build thread of buildIndex() without bulk loading: insert the entry of every tuple the scanner
+     * returns into the tree. An exception thrown on the way is stored in error rather than let out of the thread.
+     *
+     * @param scanner  Scan over the thread's range of the base relation.
+     * @param error    Set to the exception that ended the thread early, if any.
+     */
+    template <class T>
+    void buildInsert(FileScan *scanner, std::exception_ptr *error);
 
-  /**
-   * @brief Overloaded operator to compare the key values of two rid-key pairs
-   * and if they are the same compares to see if the first pair has
-   * a smaller rid.pageNo value.
-   */
-  template <class T>
-  bool operator<(const RIDKeyPair<T> &r1, const RIDKeyPair<T> &r2)
-  {
-    if (r1.key != r2.key)
-      return r1.key < r2.key;
-    else
-      return r1.rid.page_number < r2.rid.page_number;
-  }
+    /**
+     * Copy the included attributes of a record of the base relation into payload, packed in order.
+     *
+     * @param record   The record.
+     * @param payload  Room for payloadSize bytes.
+     */
+    void extractPayload(const char *record, char *payload) const;
 
-  /**
-   * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
-   * to the following structure to store or retrieve information from it.
-   * Contains the relation name for which the index is created, the byte offset
-   * of the key value on which the index is made, the type of the key and the page no
-   * of the root page. Root page starts as page 2 but since a split can occur
-   * at the root the root page may get moved up and get a new page no.
-   */
-  struct IndexMetaInfo
-  {
     /**
-     * Name of base relation.
+     * Prepare the bulk loader for a new build.
+     *
+     * @param fillFactor    Fraction of key slots to fill in each node.
      */
-    char relationName[20];
+    void bulkLoadBegin(const double fillFactor);
 
     /**
-     * Offset of attribute, over which index is built, inside the record stored in pages.
+     * Allocate and initialize the next leaf of the level being built and link the previous leaf to it.
+     *
+     * @param firstKey  Smallest key that will be stored in the new leaf.
+     * @param children  Smallest key and page number of every leaf written so far; the new leaf is appended.
      */
-    int attrByteOffset;
+    template <class T>
+    void bulkLoadNewLeaf(const T &firstKey, std::vector<PageKeyPair<T> > &children);
 
     /**
-     * Type of the attribute over which index is built.
+     * Append the next pair, in ascending key order, to the leaf level being built. Starts a new leaf
+     * (and links it as the right sibling of the previous one) when the current leaf is full.
+     *
+     * @param pair      <rid, key> pair to append.
+     * @param payload   payloadSize bytes of included attributes of the pair.
+     * @param children  Smallest key and page number of every leaf written so far.
      */
-    Datatype attrType;
+    template <class T>
+    void bulkLoadAppend(const RIDKeyPair<T> &pair, const char *payload, std::vector<PageKeyPair<T> > &children);
 
     /**
-     * Page number of root page of the B+ Tree inside the file index file.
+     * Finish the leaf level and build the non-leaf levels above it up to a single root.
+     * Sets rootPageNum and rootIsLeaf.
+     *
+     * @param children  Smallest key and page number of every leaf, in key order.
      */
-    PageId rootPageNo;
+    template <class T>
+    void bulkLoadFinish(std::vector<PageKeyPair<T> > &children);
 
     /**
+     * Pack one level of non-leaf nodes over the given children, spreading the children evenly across nodes.
      *
-     * @brief boolean to indicate whether or not the root node is a leaf or not.
+     * @param children  Smallest key and page number of every node on the level below, in key order.
+     * @param level     Level of the nodes being written (1 if the children are leaves).
+     * @return  Smallest key and page number of every node written, in key order.
+     */
+    template <class T>
+    std::vector<PageKeyPair<T> > bulkLoadNonLeafLevel(const std::vector<PageKeyPair<T> > &children, const int level);
+
+    /**
+     * Insert the pair into the tree, or into the delta buffer if the index has one.
      *
-     * Piazza post @377
+     * @param pair     <rid, key> pair to insert.
+     * @param payload  payloadSize bytes of included attributes of the pair.
      */
-    bool isRootALeaf;
-  };
+    template <class T>
+    void insertPair(const RIDKeyPair<T> &pair, const char *payload);
 
-  /*
-  Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
-  These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of
-  node they are. The level memeber of each non leaf structure seen below is set to 1 if the nodes
-  at this level are just above the leaf nodes. Otherwise set to 0.
-  */
+    /**
+     * Insert pairs sorted by key into the tree, starting over until an attempt is not disturbed by another
+     * thread, and rebuild the pinned upper levels if the inserts changed their shape.
+     *
+     * @param pairs     <rid, key> pairs to insert, in key order if there are more than one.
+     * @param payloads  payloadSize bytes of included attributes of each pair, one after the other.
+     * @param count     Number of pairs.
+     * @param done      Number of pairs inserted, from the first on; set even if an exception is thrown.
+     */
+    template <class T>
+    void insertRun(const RIDKeyPair<T> *pairs, const char *payloads, const std::size_t count, std::size_t &done);
 
-  /**
-   * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
-   */
-  struct NonLeafNodeInt
-  {
     /**
-     * Level of the node in the tree.
+     * One attempt at inserting the first of the pairs. Descends from the root without latching. A full non-leaf
+     * node met on the way is split under its own and its parent's latch, after which the attempt gives up so the
+     * next one sees the new shape. At the leaf, the leaf is latched, and its parent too if the leaf has to be split.
+     * The pairs after the first that belong in the same leaf go in under the same latch while it has room.
+     *
+     * @param pairs    <rid, key> pairs to insert, in key order.
+     * @param payloads payloadSize bytes of included attributes of each pair, one after the other.
+     * @param count    Number of pairs, at least 1.
+     * @param pinned   Set of pinned nodes to read non-leaf nodes from, may be NULL.
+     * @param visits   Number of nodes the attempt read is added to this.
+     * @return  Number of pairs inserted from the first on, 0 if the attempt has to start over.
      */
-    int level;
+    template <class T>
+    std::size_t tryInsert(const RIDKeyPair<T> *pairs, const char *payloads, const std::size_t count,
+                          const PinnedSet *pinned, std::uint64_t &visits);
 
     /**
-     * Stores keys.
+     * Add the pair to the delta buffer, and apply the buffer if that fills it.
+     *
+     * @param pair     <rid, key> pair to insert.
+     * @param payload  payloadSize bytes of included attributes of the pair.
      */
-    int keyArray[INTARRAYNONLEAFSIZE];
+    template <class T>
+    void bufferPair(const RIDKeyPair<T> &pair, const char *payload);
 
     /**
-     * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
+     * Apply the delta buffer to the leaves if it holds any entries, so that an operation reading the tree sees them.
      */
-    PageId pageNoArray[INTARRAYNONLEAFSIZE + 1];
-  };
+    void flushDelta();
 
-  /**
-   * @brief Structure for all leaf nodes when the key is of INTEGER type.
-   */
-  struct LeafNodeInt
-  {
     /**
-     * Stores keys.
+     * Sort the entries of the delta buffer by key and insert them as one run. The caller holds deltaLatch. Entries
+     * that could not be inserted stay in the buffer.
      */
-    int keyArray[INTARRAYLEAFSIZE];
+    template <class T>
+    void applyDelta();
 
     /**
-     * Stores RecordIds.
+     * Insert the key at the given position of a non-leaf node that has room for it, with entry.pageNo
+     * becoming the child to the right of the key.
      */
-    RecordId ridArray[INTARRAYLEAFSIZE];
+    template <class T>
+    void sortedNonLeafEntry(NonLeafNode<T> *currNode, const int pos, const PageKeyPair<T> &entry);
 
     /**
-     * Page number of the leaf on the right side.
-     * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+     * Split a full leaf in two while inserting the pair at the given position.
+     * The new leaf becomes the right sibling of currNode.
+     *
+     * @param currNode  Full leaf, pinned.
+     * @param pageNo    Page number of currNode.
+     * @param pos       Position at which the pair belongs in currNode.
+     * @param pair      <rid, key> pair to insert.
+     * @param payload   payloadSize bytes of included attributes of the pair.
+     * @param newChild  Smallest key and page number of the new leaf are returned in this.
+     * @param group     Redo group the new leaf is logged in.
      */
-    PageId rightSibPageNo;
-  };
+    template <class T>
+    void splitLeaf(typename LeafNodeOf<T>::type *currNode, const PageId pageNo, const int pos, const RIDKeyPair<T> &pair,
+                   const char *payload, PageKeyPair<T> &newChild, RedoGroup &group);
 
-  /**
-   * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
-   * relation. This index supports only one scan at a time.
-   */
-  class BTreeIndex
-  {
+    /**
+     * Split a full non-leaf node in two. The middle key moves up and the keys after it go to the new right node.
+     *
+     * @param currNode  Full non-leaf node, pinned and latched.
+     * @param newChild  Key pushed up and page number of the new right node are returned in this.
+     * @param group     Redo group the new node is logged in.
+     */
+    template <class T>
+    void splitNonLeaf(NonLeafNode<T> *currNode, PageKeyPair<T> &newChild, RedoGroup &group);
 
-  private:
     /**
-     * File object for the index file.
+     * Make a new root over the old root and the node split off it, and record it in the meta page.
+     * The latch of the meta page must be held.
+     *
+     * @param newChild  Key and page number of the node split off the old root.
+     * @param level     Level of the new root.
+     * @param group     Redo group the new root and the meta page are logged in.
      */
-    File *file;
+    template <class T>
+    void growRoot(const PageKeyPair<T> &newChild, const int level, RedoGroup &group);
 
     /**
-     * Buffer Manager Instance.
+     * Delete the pair from the tree, starting over until an attempt is not disturbed by another thread.
+     *
+     * @param pair  <rid, key> pair to delete.
+     * @return  True if the pair was found and deleted.
      */
-    BufMgr *bufMgr;
+    template <class T>
+    bool deletePair(const RIDKeyPair<T> &pair);
 
     /**
-     * Page number of meta page.
+     * One attempt at deleting the pair. Descends from the root without latching to the leftmost leaf that may hold
+     * the key, latches it and removes the pair; if the leaf falls below the merge threshold, it is rebalanced with
+     * a sibling under its parent. Equal keys may go on in right siblings, which are searched one at a time under
+     * their own latch but not rebalanced.
+     *
+     * @param pair     <rid, key> pair to delete.
+     * @param pinned   Set of pinned nodes to read non-leaf nodes from, may be NULL.
+     * @param visits   Number of nodes the attempt read is added to this.
+     * @param deleted  Set to true if the pair was deleted, false if it is not in the tree.
+     * @return  True if the attempt finished, false if it has to start over.
      */
-    PageId headerPageNum;
+    template <class T>
+    bool tryDelete(const RIDKeyPair<T> &pair, const PinnedSet *pinned, std::uint64_t &visits, bool &deleted);
 
     /**
-     * page number of root page of B+ tree inside index file.
+     * Merge a leaf with its left or right sibling under the same parent, or move half of their entries to a new
+     * page replacing the right one if they do not fit in one leaf. The leaf must be latched; the parent latch is
+     * taken from the given version and the sibling's latch from its current one, and nothing is done if either
+     * fails. The right leaf of the two is unlinked and retired, but not changed.
+     *
+     * @param leafNode       The latched leaf, pinned.
+     * @param pageNo         Page number of the leaf.
+     * @param parent         Handle of the parent of the leaf, pinned.
+     * @param parentLatch    Latch of the parent.
+     * @param parentVersion  Version of parentLatch the parent was read at.
+     * @param childIndex     Position of the leaf in the parent's pageNoArray.
+     * @param group          Redo group the leaf is tracked in; the changes are logged before the latches are let go.
+     * @return  True if the leaf was rebalanced, changing the parent.
      */
-    PageId rootPageNum;
+    template <class T>
+    bool rebalanceLeaf(typename LeafNodeOf<T>::type *leafNode, const PageId pageNo, const PageHandle &parent,
+                       OptimisticLatch *parentLatch, const std::uint64_t parentVersion, const int childIndex,
+                       RedoGroup &group);
 
     /**
-     * Datatype of attribute over which index is built.
+     * Remove the child at the given position, at least 1, of a non-leaf node together with the key left of it.
      */
-    Datatype attributeType;
+    template <class T>
+    void removeNonLeafEntry(NonLeafNode<T> *currNode, const int childIndex);
 
     /**
-     * Offset of attribute, over which index is built, inside records.
+     * Record a leaf unlinked from the tree, to be freed once no operation can reach it.
+     * Must be called before the latch of the leaf is released.
      */
-    int attrByteOffset;
+    void retirePage(const PageId pageNo);
 
     /**
-     * Number of keys in leaf node, depending upon the type of key.
+     * Returns true if the page is retired.
      */
-    int leafOccupancy;
+    bool isRetired(const PageId pageNo);
 
     /**
-     * Number of keys in non-leaf node, depending upon the type of key.
+     * Hand back to the buffer manager with BufMgr::disposePage() the retired pages that no operation running
+     * started before, while others wait for the operations that may still read them. Must not be called from
+     * within an operation.
      */
-    int nodeOccupancy;
+    void freeRetiredPages();
 
-    // MEMBERS SPECIFIC TO SCANNING
+    /**
+     * Rewrite the leaves of the tree, left to right, into new pages filled to the given fraction, build new non-leaf
+     * levels over them and make the result the tree. The old tree is retired page by page. Writers must be kept out.
+     */
+    template <class T>
+    void compactTree(const double fillFactor);
 
     /**
-     * True if an index scan has been started.
+     * Build the Bloom filter over the keys in the leaves, sized for the distinct keys there are, and make it the
+     * filter of the index. Writers must be kept out.
      */
-    bool scanExecuting;
+    template <class T>
+    void buildBloom();
 
     /**
-     * Index of next entry to be scanned in current leaf being scanned.
+     * Read the Bloom filter of the given number of blocks saved in the chain of pages starting at bloomPageNum.
+     *
+     * @return  False if the chain holds fewer blocks, which leaves the filter as it was.
      */
-    int nextEntry;
+    bool loadBloom(const std::uint32_t blocks);
 
     /**
-     * Page number of current page being scanned.
+     * Write the Bloom filter to its chain of pages, allocating the chain if there is none, and mark it valid in
+     * the meta page.
      */
-    PageId currentPageNum;
+    void saveBloom();
 
     /**
-     * Current Page being scanned.
+     * Hand the pages of the saved Bloom filter to retirePage(), as the filter no longer matches them.
      */
-    Page *currentPageData;
+    void retireBloomPages();
 
     /**
-     * Low INTEGER value for scan.
+     * Returns true if the Bloom filter rules the key out, counting the lookup as rejected if so.
      */
-    int lowValInt;
+    template <class T>
+    bool bloomRejects(const T &key);
 
     /**
-     * Low DOUBLE value for scan.
+     * Look up the probes the Bloom filter does not rule out with lookupKeys(), or lookupProbes() if interleaved,
+     * and give the others no matches.
      */
-    double lowValDouble;
+    template <class T>
+    void lookupFiltered(const std::vector<T> &probes, std::vector<RecordId> &outRids, std::vector<std::size_t> &outOffsets,
+                        const std::size_t groupSize, const bool interleaved);
 
     /**
-     * Low STRING value for scan.
+     * Descend from the root to the leaf the first entry not smaller than the key is in, or would be inserted in.
+     * A split racing the descent may have moved that entry to a right sibling of the leaf returned.
+     *
+     * @param key     Key to look for.
+     * @param visits  Incremented by the number of non-leaf nodes read.
+     * @return  Page number of the leaf.
      */
-    std::string lowValString;
+    template <class T>
+    PageId findLeaf(const T &key, std::uint64_t &visits);
 
     /**
-     * High INTEGER value for scan.
+     * Like findLeaf(), but descends the tree as a snapshot saw it.
+     *
+     * @param snapshot  Open snapshot.
+     * @param key       Key to look for.
+     * @param visits    Incremented by the number of non-leaf nodes read.
+     * @return  Page number of the leaf.
      */
-    int highValInt;
+    template <class T>
+    PageId findSnapshotLeaf(const IndexSnapshot &snapshot, const T &key, std::uint64_t &visits);
 
     /**
-     * High DOUBLE value for scan.
+     * Non-leaf node on the path of a batched lookup, with the upper end of the key range under it.
      */
-    double highValDouble;
+    template <class T>
+    struct PathLevel
+    {
+      PageId pageNo;
+
+      /**
+       * False if the range is unbounded, for the root and the rightmost nodes below it.
+       */
+      bool bounded;
+
+      /**
+       * No key under the node is larger than this one, if bounded.
+       */
+      T fence;
+    };
 
     /**
-     * High STRING value for scan.
+     * Descend to the leaf of a key from the deepest node of the path whose range still holds the key.
+     * The probes of a batched lookup come in ascending order, so only the upper ends of the ranges are checked.
+     * The path is left holding the non-leaf nodes read.
+     *
+     * @param path    Path of the previous descent, empty to start at the root.
+     * @param key     Key to look for.
+     * @param visits  Incremented by the number of non-leaf nodes read.
+     * @param fenced  Set to true if the range of the leaf returned is bounded.
+     * @param fence   Set to the largest key the leaf returned may hold, if bounded.
+     * @return  Page number of the leaf.
      */
-    std::string highValString;
+    template <class T>
+    PageId descendPath(std::vector<PathLevel<T> > &path, const T &key, std::uint64_t &visits, bool &fenced, T &fence);
 
     /**
-     * Low Operator. Can only be GT(>) or GTE(>=).
+     * Copy the record ids of the entries of a pinned leaf whose key equals the given one, reading the leaf in place
+     * under its optimistic latch.
+     *
+     * @param pageNo        Page number of the leaf.
+     * @param page          The pinned leaf.
+     * @param key           Key to look for.
+     * @param matches       Takes the record ids found, until it is full.
+     * @param nextPageNum   Set to the right sibling if the leaf ended before a larger key did, so that matches may
+     *                      go on there, otherwise to Page::INVALID_NUMBER.
+     * @return  Number of record ids added to matches.
      */
-    Operator lowOp;
+    template <class T, class Matches>
+    std::size_t leafMatches(const PageId pageNo, const Page *page, const T &key, Matches &matches, PageId &nextPageNum);
 
     /**
-     * High Operator. Can only be LT(<) or LTE(<=).
+     * @see BTreeIndex::lookup
      */
-    Operator highOp;
+    template <class T>
+    std::size_t lookupKey(const T &key, RecordId *outRids, const std::size_t maxRids);
+
+    /**
+     * @see BTreeIndex::lookupBatch
+     */
+    template <class T>
+    void lookupKeys(const std::vector<T> &probes, std::vector<RecordId> &outRids, std::vector<std::size_t> &outOffsets);
+
+    /**
+     * @see BTreeIndex::lookupInterleaved
+     */
+    template <class T>
+    void lookupProbes(const std::vector<T> &probes, std::vector<RecordId> &outRids, std::vector<std::size_t> &outOffsets,
+                      const std::size_t groupSize);
+
+    /**
+     * Descend to the leaf holding the first entry of the cursor's scan range and copy it into the cursor.
+     *
+     * @param cursor  Cursor whose scan is starting.
+     * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+     */
+    template <class T>
+    void findFirstEntry(IndexScanCursor &cursor);
+
+    /**
+     * @see IndexScanCursor::scanNext. outKey may be NULL.
+     */
+    template <class T>
+    void scanNextEntry(IndexScanCursor &cursor, RecordId &outRid, void *outKey);
+
+    /**
+     * @see IndexScanCursor::scanNextBatch, IndexScanCursor::scanNextCovered and IndexScanCursor::scanNextKeys.
+     * outPayloads and outKeys may be NULL.
+     */
+    template <class T>
+    std::size_t scanNextEntries(IndexScanCursor &cursor, RecordId *outRids, char *outPayloads, char *outKeys,
+                                const std::size_t maxRids);
+
+    /**
+     * @see IndexScanCursor::skipTo
+     */
+    template <class T>
+    void skipEntries(IndexScanCursor &cursor, const T &key);
 
   public:
     /**
@@ -311,10 +2355,51 @@ namespace badgerdb
      * @param bufMgrIn						Buffer Manager Instance
      * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
      * @param attrType						Datatype of attribute over which index is built
+     * @param options         Build options, e.g. whether to bulk load a new index and at which fill factor
      * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
+     * @throws  BadIndexInfoException     If a new index is to include more than MAX_INCLUDED_ATTRIBUTES attributes, or more than MAX_PAYLOAD_SIZE bytes of them.
      */
     BTreeIndex(const std::string &relationName, std::string &outIndexName,
-               BufMgr *bufMgrIn, const int attrByteOffset, const Datatype attrType);
+               BufMgr *bufMgrIn, const int attrByteOffset, const Datatype attrType,
+               const BTreeOptions &options = BTreeOptions());
+
+    /**
+     * BTreeIndex Constructor for a COMPOSITE key over several attributes of the record, such as (i, d) or (s, i).
+     * Entries are ordered by the first attribute, then by the second and so on. The index file is named after the
+     * relation and the offsets of all the attributes.
+     *
+     * Keys passed to the methods of a COMPOSITE index, to insertEntry(), startScan() or lookup() for instance,
+     * point to a record, or to any buffer holding the key attributes at their offsets in the record.
+     *
+     * @param relationName        Name of file.
+     * @param outIndexName        Return the name of index file.
+     * @param bufMgrIn						Buffer Manager Instance
+     * @param keyAttrs				Attributes of the key, most significant first
+     * @param options         Build options
+     * @throws  BadIndexInfoException     If there are no key attributes, more than MAX_KEY_ATTRIBUTES or more than
+     *					COMPOSITESIZE bytes of them, or one of them is not INTEGER, DOUBLE or STRING.
+     * @throws  BadIndexInfoException     If a new index is to include more than MAX_INCLUDED_ATTRIBUTES attributes, or more than MAX_PAYLOAD_SIZE bytes of them.
+     */
+    BTreeIndex(const std::string &relationName, std::string &outIndexName, BufMgr *bufMgrIn,
+               const std::vector<IndexAttribute> &keyAttrs, const BTreeOptions &options = BTreeOptions());
+
+    /**
+     * BTreeIndex Constructor for an index over entries that do not come from a scan of the base relation, such as a
+     * sorted run of an LsmIndex. If the index file does not exist, it is created and bulk loaded from the source at
+     * BTreeOptions::fillFactor; otherwise it is opened and the source is not read.
+     *
+     * @param relationName        Name of the base relation, recorded in the meta page.
+     * @param indexName           Name of the index file.
+     * @param bufMgrIn						Buffer Manager Instance
+     * @param attrByteOffset			Offset of the key attribute in the records of the base relation
+     * @param attrType						Datatype of the key, INTEGER, DOUBLE or STRING
+     * @param source              Entries of the new index in ascending key order
+     * @param options         Build options
+     * @throws  BadIndexInfoException     If the options include attributes, which the source does not provide.
+     */
+    BTreeIndex(const std::string &relationName, const std::string &indexName, BufMgr *bufMgrIn,
+               const int attrByteOffset, const Datatype attrType, SortedEntrySource &source,
+               const BTreeOptions &options = BTreeOptions());
 
     /**
      * BTreeIndex Destructor.
@@ -330,52 +2415,48 @@ namespace badgerdb
      * This splitting will require addition of new leaf page number entry into the parent non-leaf, which may in-turn get split.
      * This may continue all the way upto the root causing the root to get split. If root gets split, metapage needs to be changed accordingly.
      * Make sure to unpin pages as soon as you can.
-     * @param _key			Key to insert, pointer to integer/double/char string
+     * @param _key			Key to insert, pointer to integer/double/char string, or to the record for a COMPOSITE key
      * @param rid			Record ID of a record whose entry is getting inserted into the index.
+     * @param payload		Values of the included attributes of the record, packed in the order of BTreeOptions::included
+     *					into getPayloadSize() bytes. May be NULL, which stores zero bytes, and is ignored if the index
+     *					is not covering.
+     * @throws  ReadOnlyFileException If the index was opened with BTreeOptions::readOnly.
      **/
-    void insertEntry(const void *_key, const RecordId rid);
+    void insertEntry(const void *_key, const RecordId rid, const void *payload = NULL);
 
     /**
-     * @brief
-     *
-     * @param key		Key to insert, pointer to integer/double/char string
-     * @param rid		Record ID of a record whose entry is getting inserted into the index.
-     * @param isLeaf 	boolean if dealing with leaf or not
-     * @param pageNo 	page number to work with
-     */
-    void insertEntry(const void *_key, const RecordId rid, bool isLeaf, PageId pageNo);
-
-    void splitLeaf(LeafNodeInt *currNode, PageId pageid, RIDKeyPair<int> pair);
-
-    void splitNonLeaf(NonLeafNodeInt *currNode, PageId pageid, int key);
+     * Delete the entry of the pair <value,rid>, one of them if it was inserted more than once.
+     * The slot of the entry is compacted away at once. A leaf that ends up below BTreeOptions::mergeThreshold is
+     * merged with a sibling under the same parent, or takes entries from it if both do not fit in one leaf; leaves
+     * above the threshold are left alone, and non-leaf nodes are never merged. Pages of merged-away leaves are
+     * freed through BufMgr::disposePage() once no operation running when they were unlinked may still read them.
+     * @param _key			Key of the entry, pointer to integer/double/char string, or to the record for a COMPOSITE key
+     * @param rid			Record ID of the entry.
+     * @return  True if the entry was found and deleted, false if it is not in the index.
+     * @throws  ReadOnlyFileException If the index was opened with BTreeOptions::readOnly.
+     **/
+    bool deleteEntry(const void *_key, const RecordId rid);
 
     /**
-     * @brief Insert given <rid, key> pair into a leaf at the given pageNo
-     *
-     * @param key		Key to insert, pointer to integer/double/char string
-     * @param rid		Record ID of a record whose entry is getting inserted into the index.
-     * @param pageNo 	page number where the leaf node is located
-     */
-    void insertToLeaf(const void *_key, const RecordId rid, PageId pageNo);
-
-    void insertToLeaf(LeafNodeInt *currNode, PageId pageid, RIDKeyPair<int> pair);
+     * Rebuild the tree in place, online. The entries are copied in key order into new leaves filled to fillFactor,
+     * with new non-leaf levels over them, and the root in the meta page is switched to the new tree in one step.
+     * Each new leaf is allocated near the one before it, from pages freed by earlier deletes where there are some,
+     * so the leaves are not necessarily in consecutive pages.
+     * Inserts and deletes wait while the tree is copied. Lookups and scans go on, and the ones that started on the
+     * old tree finish on it; its pages are freed once they are done.
+     * @param fillFactor	Fraction, in (0, 1], of the key slots filled in each new node
+     * @throws  ReadOnlyFileException If the index was opened with BTreeOptions::readOnly.
+     **/
+    void compact(const double fillFactor = BULKLOAD_FILL_FACTOR);
 
     /**
-     * @brief Find page to insert given <rid, key> pair from the given pageNo
-     *
-     * @param key		Key to insert, pointer to integer/double/char string
-     * @param rid		Record ID of a record whose entry is getting inserted into the index.
-     * @param pageNo 	page number where the current node is located
-     */
-    void insertToNonLeaf(const void *_key, const RecordId rid, PageId pageNo);
-
-    void insertToNonLeaf(NonLeafNodeInt *currNode, PageId pageid, int key);
-
-    void sortedLeafEntry(LeafNodeInt *currNode, RIDKeyPair<int> pair);
-
-    void sortedNonLeafEntry(NonLeafNodeInt *currNode, int key);
-
-    void splitChild(LeafNodeInt *currNode, PageId pageid, RIDKeyPair<int> pair);
+     * Read the pages of the index named in a page list saved by BufMgr::savePageList() back into the buffer pool,
+     * e.g. right after the index is opened on startup, so that the first lookups do not wait for the upper levels
+     * of the tree to come back from disk. See BufMgr::warmUp().
+     * @param pageList	Name of the page list
+     * @return	Number of pages read.
+     **/
+    std::size_t warmUp(const std::string &pageList);
 
     /**
      * Begin a filtered scan of the index.  For instance, if the method is called
@@ -388,11 +2469,13 @@ namespace badgerdb
      * @param lowOp		Low operator (GT/GTE)
      * @param highVal	High value of range, pointer to integer / double / char string
      * @param highOp	High operator (LT/LTE)
+     * @param scanOptions	Residual predicate on the keys and limit on the number of entries returned
      * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
      * @throws  BadScanrangeException If lowVal > highval
      * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
      **/
-    void startScan(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp);
+    void startScan(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp,
+                   const ScanOptions &scanOptions = ScanOptions());
 
     /**
      * Fetch the record id of the next index entry that matches the scan.
@@ -404,11 +2487,111 @@ namespace badgerdb
      **/
     void scanNext(RecordId &outRid); // returned record id
 
+    /**
+     * Fetch the record ids of the next index entries that match the scan, up to maxRids of them.
+     * Entries are copied a leaf at a time, moving on to right siblings as needed. Fewer than maxRids
+     * entries are returned only when the scan reaches the end of its range.
+     * @param outRids	Array of at least maxRids record ids the entries found are returned in
+     * @param maxRids	Maximum number of record ids to return
+     * @return  Number of record ids written to outRids.
+     * @throws ScanNotInitializedException If no scan has been initialized.
+     * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+     **/
+    std::size_t scanNextBatch(RecordId *outRids, const std::size_t maxRids);
+
+    /**
+     * Like scanNextBatch(), but also copies the included attributes of every entry, getPayloadSize() bytes each, to
+     * outPayloads, so an index-only scan needs no page of the base relation.
+     * @param outRids		Array of at least maxRids record ids the entries found are returned in
+     * @param outPayloads	Room for at least maxRids payloads; entry i's goes to outPayloads + i * getPayloadSize()
+     * @param maxRids		Maximum number of entries to return
+     * @return  Number of entries returned.
+     * @throws ScanNotInitializedException If no scan has been initialized.
+     * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+     **/
+    std::size_t scanNextCovered(RecordId *outRids, void *outPayloads, const std::size_t maxRids);
+
+    /**
+     * Returns the attributes stored with every entry, empty unless the index is covering.
+     */
+    const std::vector<IndexAttribute> &includedAttributes() const
+    {
+      return included;
+    }
+
+    /**
+     * Returns the number of bytes of included attributes stored with every entry.
+     */
+    int getPayloadSize() const
+    {
+      return payloadSize;
+    }
+
     /**
      * Terminate the current scan. Unpin any pinned pages. Reset scan specific variables.
      * @throws ScanNotInitializedException If no scan has been initialized.
      **/
     void endScan();
+
+    /**
+     * Find the record ids of the entries whose key equals the given one, up to maxRids of them.
+     * Unlike a scan from the key to itself, the lookup keeps no scan state, leaves the scan of the index alone,
+     * reads the leaves in place instead of copying them and throws no exception when nothing matches.
+     * It can run concurrently with scans, inserts and other lookups.
+     * @param key	Key to look for, pointer to integer / double / char string
+     * @param outRids	Array of at least maxRids record ids the entries found are returned in
+     * @param maxRids	Maximum number of record ids to return
+     * @return  Number of record ids written to outRids, 0 if the key is not in the index.
+     **/
+    std::size_t lookup(const void *key, RecordId *outRids, const std::size_t maxRids);
+
+    /**
+     * Find the record ids of the entries matching each of many keys, e.g. the probes of an index nested-loop join.
+     * The keys are looked up in ascending order: a key goes on from the leaf the previous one ended in while it is
+     * in that leaf, and otherwise only descends again from the lowest node on the path whose range holds it, so
+     * probes close to each other share their descent and their leaves are read in order.
+     * @param keys	Array of numKeys pointers to the keys, integer / double / char string, in any order
+     * @param numKeys	Number of keys
+     * @param outRids	Filled with the record ids found, those of each key together, in the order of keys
+     * @param outOffsets	Filled with numKeys + 1 offsets; the matches of keys[i] are outRids[outOffsets[i]]
+     *                  up to but not including outRids[outOffsets[i + 1]]
+     **/
+    void lookupBatch(const void *const *keys, const std::size_t numKeys, std::vector<RecordId> &outRids,
+                     std::vector<std::size_t> &outOffsets);
+
+    /**
+     * Find the record ids of the entries matching each of many keys, like lookupBatch(), by walking the descents
+     * of groupSize keys at once instead of one after the other. Each step of a descent pins the next node, asks the
+     * CPU to prefetch it and moves on to the next descent, so the cache misses of the group overlap; a node that
+     * is not in the buffer pool is read in the background meanwhile. Suits keys that share little of their
+     * descents, e.g. random probes into a large index.
+     * @param keys	Array of numKeys pointers to the keys, integer / double / char string, in any order
+     * @param numKeys	Number of keys
+     * @param outRids	Filled with the record ids found, those of each key together, in the order of keys
+     * @param outOffsets	Filled with numKeys + 1 offsets; the matches of keys[i] are outRids[outOffsets[i]]
+     *                  up to but not including outRids[outOffsets[i + 1]]
+     * @param groupSize	Number of descents walked at once
+     **/
+    void lookupInterleaved(const void *const *keys, const std::size_t numKeys, std::vector<RecordId> &outRids,
+                           std::vector<std::size_t> &outOffsets, const std::size_t groupSize = PROBE_GROUP_SIZE);
+
+    /**
+     * Returns the shape of the tree and the counts of the work done on it since the index was opened or
+     * clearStats() was called. The shape is measured by walking every node; inserts running at the same time
+     * may leave it a few entries or pages off.
+     */
+    BTreeStats getStats();
+
+    /**
+     * Sets the operation counts back to 0.
+     */
+    void clearStats()
+    {
+      counters.clear();
+    }
+
+    friend class IndexScanCursor;
+    friend class IndexSnapshot;
   };
 
 }
\ No newline at end of file
@@ -7,108 +7,131 @@
 
 #include <memory>
 #include <iostream>
+#include <cstdint>
 #include "buffer.h"
 #include "bufHashTbl.h"
 #include "exceptions/hash_already_present_exception.h"
 #include "exceptions/hash_not_found_exception.h"
-#include "exceptions/hash_table_exception.h"
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
+std::uint64_t BufHashTbl::mix(const File* file, const PageId pageNo)
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
+  // mix the file pointer and the page number so that consecutive pages of a file, and the same page
+  // of different files, land in unrelated slots (finalizer of MurmurHash3)
+  std::uint64_t value = (std::uint64_t)(std::uintptr_t)file ^ ((std::uint64_t)pageNo * 0x9E3779B97F4A7C15ULL);
+  value ^= value >> 33;
+  value *= 0xFF51AFD7ED558CCDULL;
+  value ^= value >> 33;
+  value *= 0xC4CEB9FE1A85EC53ULL;
+  value ^= value >> 33;
   return value;
 }
 
+std::size_t BufHashTbl::hash(const File* file, const PageId pageNo) const
+{
+  return (std::size_t)mix(file, pageNo) & mask;
+}
+
 BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
+	: HTSIZE(1), numEntries(0)
 {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  // at least twice as many slots as entries, rounded up to a power of two
+  while (HTSIZE < 2 * (std::size_t)(htSize > 0 ? htSize : 1))
+    HTSIZE <<= 1;
+  mask = HTSIZE - 1;
+
+  ht = new hashBucket[HTSIZE];
+  for(std::size_t i = 0; i < HTSIZE; i++)
+    ht[i].file = NULL;
 }
 
 BufHashTbl::~BufHashTbl()
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
-  }
   delete [] ht;
 }
 
-void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+void BufHashTbl::grow()
 {
-  int index = hash(file, pageNo);
-
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+  hashBucket* old = ht;
+  const std::size_t oldSize = HTSIZE;
+  HTSIZE <<= 1;
+  mask = HTSIZE - 1;
+  ht = new hashBucket[HTSIZE];
+  for (std::size_t i = 0; i < HTSIZE; i++)
+    ht[i].file = NULL;
+
+  for (std::size_t i = 0; i < oldSize; i++)
+  {
+    if (old[i].file == NULL)
+      continue;
+    std::size_t index = hash(old[i].file, old[i].pageNo);
+    while (ht[index].file != NULL)
+      index = (index + 1) & mask;
+    ht[index] = old[i];
   }
+  delete [] old;
+}
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-  	throw HashTableException();
+void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  // a pool that grew past the size the table was made for would make probe sequences long
+  if (2 * (numEntries + 1) > HTSIZE)
+    grow();
+
+  std::size_t index = hash(file, pageNo);
+  while (ht[index].file != NULL) {
+    if (ht[index].file == file && ht[index].pageNo == pageNo)
+  		throw HashAlreadyPresentException(ht[index].file->filename(), ht[index].pageNo, ht[index].frameNo);
+    index = (index + 1) & mask;
+  }
 
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+  ht[index].file = (File*) file;
+  ht[index].pageNo = pageNo;
+  ht[index].frameNo = frameNo;
+  numEntries++;
 }
 
-void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
+bool BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) const
 {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+  std::size_t index = hash(file, pageNo);
+  while (ht[index].file != NULL) {
+    if (ht[index].file == file && ht[index].pageNo == pageNo)
     {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
+      frameNo = ht[index].frameNo; // return frameNo by reference
+      return true;
     }
-    tmpBuc = tmpBuc->next;
+    index = (index + 1) & mask;
   }
-
-  throw HashNotFoundException(file->filename(), pageNo);
+  return false;
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
-
-  while (tmpBuc)
-	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
-
-      delete tmpBuc;
-      return;
-    }
-		else
-		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
+  std::size_t index = hash(file, pageNo);
+  while (ht[index].file != NULL && !(ht[index].file == file && ht[index].pageNo == pageNo))
+    index = (index + 1) & mask;
+
+  if (ht[index].file == NULL)
+    throw HashNotFoundException(file->filename(), pageNo);
+
+  // Close the hole: walk the rest of the probe sequence and move back every entry whose home slot
+  // does not lie between the hole and its current slot, since lookups for it would stop at the hole.
+  std::size_t hole = index;
+  std::size_t next = (hole + 1) & mask;
+  while (ht[next].file != NULL)
+  {
+    const std::size_t home = hash(ht[next].file, ht[next].pageNo);
+    const bool staysPut = (hole <= next) ? (hole < home && home <= next) : (hole < home || home <= next);
+    if (!staysPut)
+    {
+      ht[hole] = ht[next];
+      hole = next;
     }
+    next = (next + 1) & mask;
   }
-
-  throw HashNotFoundException(file->filename(), pageNo);
+  ht[hole].file = NULL;
+  numEntries--;
 }
 
 }
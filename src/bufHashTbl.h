@@ -7,12 +7,14 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include "file.h"
 
 namespace badgerdb {
 
 /**
-* @brief Declarations for buffer pool hash table
+* @brief Declarations for buffer pool hash table. One slot of the open addressing table; a slot is empty when file is NULL.
 */
 struct hashBucket {
 	/**
@@ -29,30 +31,42 @@ struct hashBucket {
 	 * frame number of page in the buffer pool
 	 */
 	FrameId frameNo;
-
-	/**
-	 * Next node in the hash table
-	 */
-	hashBucket*   next;
 };
 
 
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
+* Entries live in one flat array probed linearly from the slot the key hashes to, so a lookup touches a
+* few adjacent slots and never allocates. The array has a power of two number of slots, at least twice the
+* requested size, which keeps probe sequences short; once more than half of the slots are in use, insert()
+* doubles the array and rehashes the entries. Removal shifts later entries of the probe sequence back instead of
+* leaving tombstones.
+*
 * @warning This class is not threadsafe.
 */
 class BufHashTbl
 {
  private:
 	/**
-	 *	Size of Hash Table
+	 *	Number of slots of the hash table, a power of two
 	 */
-  int HTSIZE;
+  std::size_t HTSIZE;
+
+	/**
+	 *	HTSIZE - 1, masks a hash value to a slot
+	 */
+  std::size_t mask;
+
+	/**
+	 *	Number of entries in use
+	 */
+  std::size_t numEntries;
+
 	/**
 	 * Actual Hash table object
 	 */
-  hashBucket**  ht;
+  hashBucket*  ht;
 
 	/**
 	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
@@ -61,11 +75,28 @@ class BufHashTbl
 	 * @param pageNo  Page number in the file
 	 * @return  			Hash value.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  std::size_t hash(const File* file, const PageId pageNo) const;
+
+	/**
+	 * Doubles the number of slots and moves every entry to its slot in the larger table
+	 */
+  void grow();
 
  public:
 	/**
+	 * Mixes file and pageNo into a 64 bit value whose bits are all well distributed. The table uses the low bits;
+	 * callers spreading pages over several tables can use the high bits to pick one.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			Mixed value.
+	 */
+  static std::uint64_t mix(const File* file, const PageId pageNo);
+
+	/**
    * Constructor of BufHashTbl class
+	 *
+	 * @param htSize	Expected number of entries
 	 */
 	BufHashTbl(const int htSize);  // constructor
 
@@ -81,7 +112,6 @@ class BufHashTbl
 	 * @param pageNo 	Page number in the file
 	 * @param frameNo Frame number assigned to that page of the file
    * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as running of memory
 	 */
   void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
@@ -91,10 +121,10 @@ class BufHashTbl
 	 *
 	 * @param file  	File object
 	 * @param pageNo	Page number in the file
-	 * @param frameNo Frame number reference
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+	 * @param frameNo Frame number reference, set if the page is found
+	 * @return  True if the page is in the hash table
 	 */
-  void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
+  bool lookup(const File* file, const PageId pageNo, FrameId &frameNo) const;
 
 	/**
    * Delete entry (file,pageNo) from hash table.
@@ -0,0 +1,304 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "buf_stats.h"
+
+#include <map>
+
+#include "file.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Hands out the stripes to threads in turn.
+ */
+std::atomic<std::uint32_t> nextStripe(0);
+
+}
+
+void Histogram::clear() {
+  for (std::uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    buckets[i] = 0;
+  }
+}
+
+std::uint32_t Histogram::bucketOf(const std::uint64_t value) {
+  if (value == 0) {
+    return 0;
+  }
+  const std::uint32_t bits = 64 - __builtin_clzll(value);
+  return bits < HISTOGRAM_BUCKETS ? bits : HISTOGRAM_BUCKETS - 1;
+}
+
+std::uint64_t Histogram::count() const {
+  std::uint64_t total = 0;
+  for (std::uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    total += buckets[i];
+  }
+  return total;
+}
+
+std::uint64_t Histogram::percentile(const double fraction) const {
+  const std::uint64_t total = count();
+  if (total == 0) {
+    return 0;
+  }
+  const double wanted = fraction * total;
+  std::uint64_t seen = 0;
+  for (std::uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += buckets[i];
+    if (seen >= wanted) {
+      return i == 0 ? 0 : (std::uint64_t(1) << i) - 1;
+    }
+  }
+  return (std::uint64_t(1) << (HISTOGRAM_BUCKETS - 1)) - 1;
+}
+
+void BufStats::clear() {
+  accesses = hits = misses = diskreads = diskwrites = 0;
+  evictions = dirtyEvictions = pinWaits = logFlushWaits = 0;
+  sweepLengths.clear();
+  readLatency.clear();
+  writeLatency.clear();
+  files.clear();
+}
+
+void BufStatsCollector::Buckets::add(const std::uint64_t value) {
+  counts[Histogram::bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void BufStatsCollector::Stripe::clear() {
+  hits = misses = diskreads = diskwrites = 0;
+  evictions = dirtyEvictions = pinWaits = logFlushWaits = 0;
+  for (std::uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    sweepLengths.counts[i] = 0;
+    readLatency.counts[i] = 0;
+    writeLatency.counts[i] = 0;
+  }
+  // files keep their slots, which snapshot() leaves out while they count
+  // nothing
+  for (std::uint32_t i = 0; i < BUF_STATS_FILE_SLOTS; i++) {
+    fileSlots[i].hits = 0;
+    fileSlots[i].misses = 0;
+  }
+  std::lock_guard<std::mutex> guard(latch);
+  overflow.clear();
+}
+
+BufStatsCollector::Stripe& BufStatsCollector::local() {
+  // the same stripe in every collector, so a thread touches one cache line
+  // per counter wherever it counts
+  static thread_local std::uint32_t stripe =
+      nextStripe.fetch_add(1) % BUF_STATS_STRIPES;
+  return stripes_[stripe];
+}
+
+bool BufStatsCollector::countInSlot(Stripe& stripe, const File* file,
+                                    const bool hit) {
+  const std::uint64_t id = file->id();
+  const std::uint32_t home = static_cast<std::uint32_t>(
+      (id * 0x9E3779B97F4A7C15ull) >> 32);
+  for (std::uint32_t probe = 0; probe < BUF_STATS_FILE_SLOTS; probe++) {
+    FileSlot& slot = stripe.fileSlots[(home + probe) % BUF_STATS_FILE_SLOTS];
+    std::uint64_t slotId = slot.id.load(std::memory_order_acquire);
+    if (slotId == 0 || slotId == TOMBSTONE) {
+      // name the file before it can be counted, so that snapshot() finds a
+      // name for every slot it sees taken; threads of the same stripe may
+      // take two slots for one file, which then add up
+      {
+        std::lock_guard<std::mutex> guard(stripe.latch);
+        stripe.names[id] = file->filename();
+      }
+      if (slot.id.compare_exchange_strong(slotId, id,
+                                          std::memory_order_acq_rel)) {
+        slotId = id;
+      }
+    }
+    if (slotId == id) {
+      (hit ? slot.hits : slot.misses).fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void BufStatsCollector::countFile(const File* file, const bool hit) {
+  Stripe& stripe = local();
+  if (countInSlot(stripe, file, hit)) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(stripe.latch);
+  FileStats& counts = stripe.overflow[file->id()];
+  counts.filename = file->filename();
+  if (hit) {
+    counts.hits++;
+  } else {
+    counts.misses++;
+  }
+}
+
+void BufStatsCollector::forget(const File* file) {
+  const std::uint64_t id = file->id();
+  FileStats counts;
+  counts.filename = file->filename();
+  counts.hits = counts.misses = 0;
+  for (std::uint32_t s = 0; s < BUF_STATS_STRIPES; s++) {
+    Stripe& stripe = stripes_[s];
+    for (std::uint32_t i = 0; i < BUF_STATS_FILE_SLOTS; i++) {
+      FileSlot& slot = stripe.fileSlots[i];
+      if (slot.id.load(std::memory_order_acquire) != id) {
+        continue;
+      }
+      // the file is no longer read through the pool, so nothing counts in
+      // the slot while it is emptied
+      counts.hits += slot.hits.exchange(0, std::memory_order_relaxed);
+      counts.misses += slot.misses.exchange(0, std::memory_order_relaxed);
+      slot.id.store(TOMBSTONE, std::memory_order_release);
+    }
+    std::lock_guard<std::mutex> guard(stripe.latch);
+    stripe.names.erase(id);
+    std::unordered_map<std::uint64_t, FileStats>::iterator it =
+        stripe.overflow.find(id);
+    if (it != stripe.overflow.end()) {
+      counts.hits += it->second.hits;
+      counts.misses += it->second.misses;
+      stripe.overflow.erase(it);
+    }
+  }
+  if (counts.hits == 0 && counts.misses == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(closedLatch_);
+  FileStats& total = closed_[counts.filename];
+  total.filename = counts.filename;
+  total.hits += counts.hits;
+  total.misses += counts.misses;
+}
+
+void BufStatsCollector::hit(const File* file) {
+  local().hits.fetch_add(1, std::memory_order_relaxed);
+  countFile(file, true);
+}
+
+void BufStatsCollector::miss(const File* file) {
+  local().misses.fetch_add(1, std::memory_order_relaxed);
+  countFile(file, false);
+}
+
+void BufStatsCollector::pinWaited() {
+  local().pinWaits.fetch_add(1, std::memory_order_relaxed);
+}
+
+void BufStatsCollector::logFlushWaited() {
+  local().logFlushWaits.fetch_add(1, std::memory_order_relaxed);
+}
+
+void BufStatsCollector::evicted(const bool dirty) {
+  Stripe& stripe = local();
+  stripe.evictions.fetch_add(1, std::memory_order_relaxed);
+  if (dirty) {
+    stripe.dirtyEvictions.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void BufStatsCollector::swept(const std::uint32_t candidates) {
+  local().sweepLengths.add(candidates);
+}
+
+void BufStatsCollector::read(const std::uint64_t micros,
+                             const std::uint32_t pages) {
+  Stripe& stripe = local();
+  stripe.diskreads.fetch_add(pages, std::memory_order_relaxed);
+  stripe.readLatency.add(micros);
+}
+
+void BufStatsCollector::written(const std::uint32_t pages,
+                                const std::uint64_t micros) {
+  Stripe& stripe = local();
+  stripe.diskwrites.fetch_add(pages, std::memory_order_relaxed);
+  stripe.writeLatency.add(micros);
+}
+
+BufStats BufStatsCollector::snapshot() const {
+  BufStats stats;
+  // files reopened under the same name add up
+  std::map<std::string, FileStats> files;
+  for (std::uint32_t s = 0; s < BUF_STATS_STRIPES; s++) {
+    const Stripe& stripe = stripes_[s];
+    stats.hits += stripe.hits;
+    stats.misses += stripe.misses;
+    stats.diskreads += stripe.diskreads;
+    stats.diskwrites += stripe.diskwrites;
+    stats.evictions += stripe.evictions;
+    stats.dirtyEvictions += stripe.dirtyEvictions;
+    stats.pinWaits += stripe.pinWaits;
+    stats.logFlushWaits += stripe.logFlushWaits;
+    for (std::uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+      stats.sweepLengths.buckets[i] += stripe.sweepLengths.counts[i];
+      stats.readLatency.buckets[i] += stripe.readLatency.counts[i];
+      stats.writeLatency.buckets[i] += stripe.writeLatency.counts[i];
+    }
+
+    std::lock_guard<std::mutex> guard(stripe.latch);
+    for (std::uint32_t i = 0; i < BUF_STATS_FILE_SLOTS; i++) {
+      const FileSlot& slot = stripe.fileSlots[i];
+      const std::uint64_t id = slot.id.load(std::memory_order_acquire);
+      const std::uint64_t hits = slot.hits.load(std::memory_order_relaxed);
+      const std::uint64_t misses = slot.misses.load(std::memory_order_relaxed);
+      if (id == 0 || id == TOMBSTONE || (hits == 0 && misses == 0)) {
+        continue;
+      }
+      std::unordered_map<std::uint64_t, std::string>::const_iterator name =
+          stripe.names.find(id);
+      if (name == stripe.names.end()) {
+        // forgotten since the slot was looked at
+        continue;
+      }
+      FileStats& counts = files[name->second];
+      counts.filename = name->second;
+      counts.hits += hits;
+      counts.misses += misses;
+    }
+    for (std::unordered_map<std::uint64_t, FileStats>::const_iterator it =
+             stripe.overflow.begin();
+         it != stripe.overflow.end(); ++it) {
+      FileStats& counts = files[it->second.filename];
+      counts.filename = it->second.filename;
+      counts.hits += it->second.hits;
+      counts.misses += it->second.misses;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> guard(closedLatch_);
+    for (std::unordered_map<std::string, FileStats>::const_iterator it =
+             closed_.begin();
+         it != closed_.end(); ++it) {
+      FileStats& counts = files[it->first];
+      counts.filename = it->first;
+      counts.hits += it->second.hits;
+      counts.misses += it->second.misses;
+    }
+  }
+  stats.accesses = stats.hits + stats.misses;
+  for (std::map<std::string, FileStats>::const_iterator it = files.begin();
+       it != files.end(); ++it) {
+    stats.files.push_back(it->second);
+  }
+  return stats;
+}
+
+void BufStatsCollector::clear() {
+  for (std::uint32_t s = 0; s < BUF_STATS_STRIPES; s++) {
+    stripes_[s].clear();
+  }
+  std::lock_guard<std::mutex> guard(closedLatch_);
+  closed_.clear();
+}
+
+}
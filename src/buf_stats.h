@@ -0,0 +1,370 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace badgerdb {
+
+class File;
+
+/**
+ * @brief Number of buckets of a Histogram.
+ */
+const std::uint32_t HISTOGRAM_BUCKETS = 32;
+
+/**
+ * @brief Number of sets of counters BufStatsCollector spreads the threads
+ *        over.
+ */
+const std::uint32_t BUF_STATS_STRIPES = 16;
+
+/**
+ * @brief Number of files every set of counters of a BufStatsCollector counts
+ *        the hits and misses of without taking a latch, a power of two.
+ */
+const std::uint32_t BUF_STATS_FILE_SLOTS = 64;
+
+/**
+ * @brief Counts of values in power-of-two buckets.
+ *
+ * Bucket 0 counts the value 0 and bucket i the values from 2^(i-1) to
+ * 2^i - 1; the last bucket also counts everything larger.
+ */
+struct Histogram {
+  /**
+   * Count of every bucket.
+   */
+  std::uint64_t buckets[HISTOGRAM_BUCKETS];
+
+  Histogram() { clear(); }
+
+  /**
+   * Sets all counts to 0.
+   */
+  void clear();
+
+  /**
+   * Returns the bucket a value is counted in.
+   */
+  static std::uint32_t bucketOf(const std::uint64_t value);
+
+  /**
+   * Returns the number of values counted.
+   */
+  std::uint64_t count() const;
+
+  /**
+   * Returns an upper bound of the smallest value at least the given fraction
+   * of the values are no larger than, e.g. 0.99 for the 99th percentile: the
+   * largest value of its bucket. 0 if nothing was counted.
+   */
+  std::uint64_t percentile(const double fraction) const;
+};
+
+/**
+ * @brief Number of times pages of one file were found in the buffer pool or
+ *        had to be read in.
+ */
+struct FileStats {
+  /**
+   * Name of the file.
+   */
+  std::string filename;
+
+  /**
+   * Pages found in the pool.
+   */
+  std::uint64_t hits;
+
+  /**
+   * Pages read or allocated into a frame.
+   */
+  std::uint64_t misses;
+};
+
+/**
+ * @brief Statistics of buffer usage, as returned by BufMgr::getBufStats().
+ */
+struct BufStats {
+  /**
+   * Total number of pages read or allocated through the buffer pool
+   */
+  std::uint64_t accesses;
+
+  /**
+   * Number of accesses that found the page in the pool, or of a mapped file
+   */
+  std::uint64_t hits;
+
+  /**
+   * Number of accesses that had to take a frame for the page
+   */
+  std::uint64_t misses;
+
+  /**
+   * Number of pages read from disk
+   */
+  std::uint64_t diskreads;
+
+  /**
+   * Number of pages written back to disk
+   */
+  std::uint64_t diskwrites;
+
+  /**
+   * Number of pages evicted to free their frame
+   */
+  std::uint64_t evictions;
+
+  /**
+   * Number of evicted pages that were dirty and had to be written back first
+   */
+  std::uint64_t dirtyEvictions;
+
+  /**
+   * Number of accesses that found the page being read in by another thread
+   * and waited for it
+   */
+  std::uint64_t pinWaits;
+
+  /**
+   * Number of times writing pages back had to flush the redo log first
+   */
+  std::uint64_t logFlushWaits;
+
+  /**
+   * Number of candidates the replacement policy offered before a frame was
+   * found, once per frame taken
+   */
+  Histogram sweepLengths;
+
+  /**
+   * Time, in microseconds, reading a page from its file took
+   */
+  Histogram readLatency;
+
+  /**
+   * Time, in microseconds, writing a page or a run of pages to its file took
+   */
+  Histogram writeLatency;
+
+  /**
+   * Hits and misses of every file accessed, sorted by name
+   */
+  std::vector<FileStats> files;
+
+  /**
+   * Returns the share of accesses that were hits, 0 without accesses.
+   */
+  double hitRatio() const {
+    return accesses == 0 ? 0 : static_cast<double>(hits) / accesses;
+  }
+
+  /**
+   * Clear all values
+   */
+  void clear();
+
+  /**
+   * Constructor of BufStats class
+   */
+  BufStats() { clear(); }
+};
+
+/**
+ * @brief Collects the statistics of a BufMgr.
+ *
+ * Each thread counts in one of BUF_STATS_STRIPES sets of counters, picked
+ * when it first counts something, so threads rarely write the same cache
+ * lines; snapshot() adds the sets up. Hits and misses by file are counted in
+ * slots found by hashing File::id(), which is never reused the way the
+ * address of a File is, so counting them takes no latch either. Counts are not synchronized with each
+ * other, so a snapshot taken while the pool is busy may be a few events off
+ * between fields.
+ */
+class BufStatsCollector {
+ public:
+  BufStatsCollector() {}
+
+  /**
+   * Counts an access that found the page of a file in the pool.
+   */
+  void hit(const File* file);
+
+  /**
+   * Counts an access that had to take a frame for the page of a file.
+   */
+  void miss(const File* file);
+
+  /**
+   * Counts an access that waited for another thread to read the page in.
+   */
+  void pinWaited();
+
+  /**
+   * Counts a write back that flushed the redo log first.
+   */
+  void logFlushWaited();
+
+  /**
+   * Counts a page evicted from its frame.
+   *
+   * @param dirty   True if it had to be written back first.
+   */
+  void evicted(const bool dirty);
+
+  /**
+   * Adds the hits and misses of a file that is about to be closed to those of
+   * the files closed before under its name, and frees its counters for other
+   * files.
+   */
+  void forget(const File* file);
+
+  /**
+   * Counts a frame taken after the given number of candidates.
+   */
+  void swept(const std::uint32_t candidates);
+
+  /**
+   * Counts a run of pages, one by default, read from disk in the given time.
+   */
+  void read(const std::uint64_t micros, const std::uint32_t pages = 1);
+
+  /**
+   * Counts pages written to disk together in the given time.
+   */
+  void written(const std::uint32_t pages, const std::uint64_t micros);
+
+  /**
+   * Returns the counts so far.
+   */
+  BufStats snapshot() const;
+
+  /**
+   * Sets all counts back to 0.
+   */
+  void clear();
+
+ private:
+  BufStatsCollector(const BufStatsCollector&);
+  BufStatsCollector& operator=(const BufStatsCollector&);
+
+  /**
+   * Atomic version of Histogram.
+   */
+  struct Buckets {
+    std::atomic<std::uint64_t> counts[HISTOGRAM_BUCKETS];
+
+    void add(const std::uint64_t value);
+  };
+
+  /**
+   * Hits and misses of the file with the given File::id(). The id is 0 while
+   * the slot is free and TOMBSTONE once the file was forgotten.
+   */
+  struct FileSlot {
+    std::atomic<std::uint64_t> id;
+    std::atomic<std::uint64_t> hits;
+    std::atomic<std::uint64_t> misses;
+  };
+
+  /**
+   * Id of a slot that was freed, which lookups probe past.
+   */
+  static const std::uint64_t TOMBSTONE = ~std::uint64_t(0);
+
+  /**
+   * Counters of the threads counting in it.
+   */
+  struct Stripe {
+    std::atomic<std::uint64_t> hits;
+    std::atomic<std::uint64_t> misses;
+    std::atomic<std::uint64_t> diskreads;
+    std::atomic<std::uint64_t> diskwrites;
+    std::atomic<std::uint64_t> evictions;
+    std::atomic<std::uint64_t> dirtyEvictions;
+    std::atomic<std::uint64_t> pinWaits;
+    std::atomic<std::uint64_t> logFlushWaits;
+    Buckets sweepLengths;
+    Buckets readLatency;
+    Buckets writeLatency;
+
+    /**
+     * Hits and misses by file, found by hashing File::id() and probing the
+     * slots that follow.
+     */
+    FileSlot fileSlots[BUF_STATS_FILE_SLOTS];
+
+    /**
+     * Guards names and overflow.
+     */
+    mutable std::mutex latch;
+
+    /**
+     * Names of the files that have a slot, by File::id(). Written once when a
+     * file takes a slot, so counting never takes the latch after that.
+     */
+    std::unordered_map<std::uint64_t, std::string> names;
+
+    /**
+     * Hits and misses of the files that found every slot taken, by
+     * File::id().
+     */
+    std::unordered_map<std::uint64_t, FileStats> overflow;
+
+    /**
+     * Keeps the next stripe off the cache line of the last counters.
+     */
+    char padding[64];
+
+    Stripe() {
+      for (std::uint32_t i = 0; i < BUF_STATS_FILE_SLOTS; i++) {
+        fileSlots[i].id = 0;
+      }
+      clear();
+    }
+
+    void clear();
+  };
+
+  /**
+   * Returns the stripe of the calling thread.
+   */
+  Stripe& local();
+
+  /**
+   * Counts a hit or miss of a file in the stripe of the calling thread.
+   */
+  void countFile(const File* file, const bool hit);
+
+  /**
+   * Counts a hit or miss of a file in a slot of the stripe, taking a free one
+   * if the file has none yet. Returns false if every slot is taken.
+   */
+  static bool countInSlot(Stripe& stripe, const File* file, const bool hit);
+
+  Stripe stripes_[BUF_STATS_STRIPES];
+
+  /**
+   * Guards closed_.
+   */
+  mutable std::mutex closedLatch_;
+
+  /**
+   * Hits and misses of the files forgotten, by name.
+   */
+  std::unordered_map<std::string, FileStats> closed_;
+};
+
+}
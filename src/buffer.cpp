@@ -5,43 +5,115 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
 #include <memory>
 #include <iostream>
 #include "buffer.h"
+#include "trace.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/read_only_file_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/io_error_exception.h"
 
-namespace badgerdb { 
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Returns the microseconds passed since a point in time
+ */
+std::uint64_t microsSince(const std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
 
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
-	bufDescTable = new BufDesc[bufs];
+BufMgr::BufMgr(std::uint32_t bufs, std::uint32_t numPartitions, ReplacementPolicy* policy,
+               const PoolOptions& poolOptions)
+	: numBufs(bufs), maxBufs(std::max(bufs, poolOptions.maxFrames)), policy(policy != NULL ? policy : new ClockPolicy()), prefetchActiveFile(NULL), prefetchStop(false),
+	  writerRunning(false), writerStop(false), writerBatch(WRITER_BATCH_SIZE), writerInterval(WRITER_INTERVAL_MS),
+	  writerCheckpointBytes(CHECKPOINT_LOG_BYTES), pageListInterval(0) {
+  redoLog = NULL;
+  secondaryCache = NULL;
+	bufDescTable = new BufDesc[maxBufs];
 
-  for (FrameId i = 0; i < bufs; i++) 
+  for (FrameId i = 0; i < maxBufs; i++)
   {
   	bufDescTable[i].frameNo = i;
   	bufDescTable[i].valid = false;
   }
 
-  bufPool = new Page[bufs];
+  pagePool = new PagePool(bufs, poolOptions);
+  bufPool = pagePool->pages();
 
+  // every partition gets room for its share of the pages and then some, so an uneven spread does not fill it
+  this->numPartitions = std::max<std::uint32_t>(1, std::min(numPartitions, bufs));
   int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+  partitions = new BufPartition[this->numPartitions];
+  for (std::uint32_t i = 0; i < this->numPartitions; i++)
+  {
+    partitions[i].hashTable = new BufHashTbl (2 * htsize / this->numPartitions + 16);  // allocate the buffer hash table
+  }
 
-  clockHand = bufs - 1;
+  this->policy->reset(bufs, maxBufs);
 }
 
 
 BufMgr::~BufMgr() {
-  //Flush out all unwritten pages
-  for (std::uint32_t i = 0; i < numBufs; i++) 
+  stopWriter();
+
+  {
+    std::lock_guard<std::mutex> prefetchGuard(prefetchLatch);
+    prefetchStop = true;
+  }
+  prefetchCond.notify_all();
+  if (prefetcher.joinable())
+    prefetcher.join();
+
+  // the list is only a hint for the next start
+  if (!pageListName.empty())
+  {
+    try
+    {
+      savePageList(pageListName);
+    }
+    catch (const BadgerDbException &)
+    {
+    }
+  }
+
+  //Flush out all unwritten pages, after the log records of their changes
+  bool writePages = true;
+  RedoLog* log = redoLog;
+  if (log != NULL)
+  {
+    try
+    {
+      log->flush(log->endLsn());
+    }
+    catch (const BadgerDbException &)
+    {
+      // the pages must not get ahead of the log, so they are left to recovery
+      writePages = false;
+    }
+  }
+  for (std::uint32_t i = 0; writePages && i < numBufs; i++)
   {
   	BufDesc* tmpbuf = &(bufDescTable[i]);
   	if (tmpbuf->valid == true && tmpbuf->dirty == true)
@@ -50,113 +122,381 @@ BufMgr::~BufMgr() {
   	}
   }
 
-	delete hashTable;
+  for (std::uint32_t i = 0; i < numPartitions; i++)
+  {
+		delete partitions[i].hashTable;
+  }
+  delete [] partitions;
   delete [] bufDescTable;
-  delete [] bufPool;
+  delete pagePool;
+  delete policy;
 }
 
-void BufMgr::allocBuf(FrameId & frame) 
+void BufMgr::allocBuf(FrameId & frame)
 {
-  // perform first part of clock algorithm to search for 
-  // open buffer frame
-  // Assumes non-concurrent access to buffer manager
+  // Every thread asks the policy for candidates on its own and only latches the frame it got
   std::uint32_t numScanned = 0;
-  bool found = 0;
 
-  while (numScanned < 2*numBufs)	//Need to scn twice
+  // twice around the pool for a clock sweep, plus the frames a policy may hand out from its queues first
+  const std::uint32_t maxScanned = 3*numBufs;
+  while (numScanned < maxScanned)
   {
-    // advance the clock
-    advanceClock();
+    const FrameId candidate = policy->nextVictim();
     numScanned++;
+    BufDesc* tmpbuf = &bufDescTable[candidate];
 
-    // if invalid, use frame
-    if (! bufDescTable[clockHand].valid)
+    // skip frames another thread is filling, evicting or flushing
+    if (!tmpbuf->latch.try_lock())
     {
-      break;
+      continue;
     }
 
-    // is valid, check referenced bit
-    if (! bufDescTable[clockHand].refbit)
+    // the pool was shrunk since the policy handed out the frame
+    if (candidate >= numBufs)
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
+      tmpbuf->latch.unlock();
+      continue;
+    }
+
+    // if invalid, use frame, unless a thread that waited on a failed read still holds a pin on it
+    if (! tmpbuf->valid)
+    {
+      if (tmpbuf->pinCnt == 0)
       {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        found = true;
-        break;
+        tmpbuf->Clear();
+        bufStats.swept(numScanned);
+        frame = candidate;
+        return;
       }
     }
-    else
+    // is valid, ask the policy whether to keep it for now
+    else if (! policy->spare(candidate))
     {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
+      // hasn't been referenced, use it unless someone has it pinned; a failed write back leaves it dirty and
+      // unlatched
+      bool evicted;
+      try
+      {
+        evicted = evictFrame(tmpbuf);
+      }
+      catch (...)
+      {
+        tmpbuf->latch.unlock();
+        throw;
+      }
+      if (evicted)
+      {
+        bufStats.swept(numScanned);
+        frame = candidate;
+        return;
+      }
     }
+    // else it has been referenced, the policy cleared its bit
+    tmpbuf->latch.unlock();
   }
-  
-  // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+
+  // buffer pool is full
+  throw BufferExceededException();
+} // end allocBuf
+
+bool BufMgr::evictFrame(BufDesc* tmpbuf)
+{
+  // check to see if someone has it pinned
+  if (tmpbuf->pinCnt != 0)
+    return false;
+
+  // pages are only pinned with their partition latched, so the check is final once it is held
+  BufPartition& part = partitionOf(tmpbuf->file, tmpbuf->pageNo);
+  std::lock_guard<std::mutex> partGuard(part.latch);
+  if (tmpbuf->pinCnt != 0)
+    return false;
+
+  // flush any existing changes to disk if necessary, before the page can be found missing and read again
+  const bool dirty = tmpbuf->dirty;
+  if (dirty)
   {
-    throw BufferExceededException();
+    // the background writer fell behind; a wake-up it misses only delays it until its next round
+    if (writerRunning)
+      writerCond.notify_one();
+    writeBack(tmpbuf);
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
+  else
   {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    SecondaryCache* cache = secondaryCache;
+    if (cache != NULL)
+    {
+      // the page is still in its file, so it is only lost to the cache if this fails
+      try
+      {
+        cache->admit(tmpbuf->file, tmpbuf->pageNo, bufPool[tmpbuf->frameNo], tmpbuf->scanned);
+      }
+      catch (const BadgerDbException &)
+      {
+      }
+    }
   }
 
-	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+  BADGERDB_TRACE(TRACE_BUFFER_EVICT, tmpbuf->file, tmpbuf->pageNo, 1, dirty ? Page::SIZE : 0);
 
-  // return new frame number
-  frame = clockHand;
-} // end allocBuf
+  // remove previous entry from hash table
+  part.hashTable->remove(tmpbuf->file, tmpbuf->pageNo);
 
-	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+  //Reset all the BufDesc entry for the frame before returning the frame
+  tmpbuf->Clear();
+  policy->evicted(tmpbuf->frameNo);
+  bufStats.evicted(dirty);
+  return true;
+}
+
+bool BufMgr::reuseRingFrame(BufferRing& ring, FrameId& frame)
 {
-  // check to see if it is already in the buffer pool
-  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
-  FrameId frameNo = 0;
-	try
-	{
-  	hashTable->lookup(file, pageNo, frameNo);
+  const BufferRing::Slot& slot = ring.slots[ring.next];
+  if (slot.file == NULL)
+    return false;
+
+  BufDesc* tmpbuf = &bufDescTable[slot.frameNo];
+  if (!tmpbuf->latch.try_lock())
+    return false;
+
+  // the frame may have been flushed or evicted and taken by another page since the scan read into it
+  bool evicted = false;
+  try
+  {
+    evicted = tmpbuf->valid && tmpbuf->file == slot.file && tmpbuf->pageNo == slot.pageNo && evictFrame(tmpbuf);
+  }
+  catch (...)
+  {
+    tmpbuf->latch.unlock();
+    throw;
+  }
+  if (evicted)
+  {
+    frame = slot.frameNo;
+    return true;
+  }
+  tmpbuf->latch.unlock();
+  return false;
+}
+
+bool BufMgr::awaitFrame(const FrameId frameNo)
+{
+  BufDesc* tmpbuf = &bufDescTable[frameNo];
+  if (tmpbuf->loading)
+  {
+    bufStats.pinWaited();
+    // the reading thread holds the latch until the page is in
+    tmpbuf->latch.lock();
+    tmpbuf->latch.unlock();
+  }
+  if (!tmpbuf->valid)
+  {
+    tmpbuf->pinCnt--;
+    return false;
+  }
+  return true;
+}
+
+PageHandle BufMgr::makeHandle(File* file, const PageId pageNo, const FrameId frameNo)
+{
+  PageHandle handle;
+  handle.file = file;
+  handle.pageNo = pageNo;
+  handle.frameNo = frameNo;
+  handle.page = &bufPool[frameNo];
+  return handle;
+}
+
+
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, const AccessPattern pattern)
+{
+  page = fetchPage(file, pageNo, pattern, NULL).page;
+}
 
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
+
+PageHandle BufMgr::readPage(File* file, const PageId pageNo, const AccessPattern pattern)
+{
+  return fetchPage(file, pageNo, pattern, NULL);
+}
+
+
+PageHandle BufMgr::readPage(File* file, const PageId pageNo, BufferRing& ring)
+{
+  return fetchPage(file, pageNo, SEQUENTIAL_ACCESS, &ring);
+}
+
+
+bool BufMgr::tryReadPage(File* file, const PageId pageNo, PageHandle& handle, const AccessPattern pattern)
+{
+  Page* mapped = file->mappedPage(pageNo);
+  if (mapped != NULL)
+  {
+    handle = readPage(file, pageNo, pattern);
+    return true;
+  }
+
+  BufPartition& part = partitionOf(file, pageNo);
+  FrameId frameNo = 0;
+  {
+    std::lock_guard<std::mutex> partGuard(part.latch);
+    // a page still being read in counts as not there
+    if (!part.hashTable->lookup(file, pageNo, frameNo) || bufDescTable[frameNo].loading)
+      return false;
+    policy->pinned(frameNo, false, pattern);
     bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
+    if (pattern == RANDOM_ACCESS)
+      bufDescTable[frameNo].scanned = false;
   }
-  catch(const HashNotFoundException &e) //not in the buffer pool, must allocate a new page
+  if (!awaitFrame(frameNo))
+    return false;
+  bufStats.hit(file);
+  BADGERDB_TRACE(TRACE_BUFFER_HIT, file, pageNo, 1, 0);
+  handle = makeHandle(file, pageNo, frameNo);
+  return true;
+}
+
+PageHandle BufMgr::fetchPage(File* file, const PageId pageNo, const AccessPattern pattern, BufferRing* ring)
+{
+  // pages of a mapped file are used where they are, there is nothing to pin
+  Page* mapped = file->mappedPage(pageNo);
+  if (mapped != NULL)
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    bufStats.hit(file);
+    BADGERDB_TRACE(TRACE_BUFFER_HIT, file, pageNo, 1, 0);
+    PageHandle handle;
+    handle.file = file;
+    handle.pageNo = pageNo;
+    handle.frameNo = MAPPED_FRAME;
+    handle.page = mapped;
+    return handle;
+  }
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+  BufPartition& part = partitionOf(file, pageNo);
+  while (true)
+  {
+    // check to see if it is already in the buffer pool
+    FrameId frameNo = 0;
+    bool found;
+    {
+      std::lock_guard<std::mutex> partGuard(part.latch);
+      found = part.hashTable->lookup(file, pageNo, frameNo);
+      if (found)
+      {
+        // tell the policy it was referenced
+        policy->pinned(frameNo, false, pattern);
+        bufDescTable[frameNo].pinCnt++;
+        if (pattern == RANDOM_ACCESS)
+          bufDescTable[frameNo].scanned = false;
+      }
+    }
+    if (found)
+    {
+      if (awaitFrame(frameNo))
+      {
+        bufStats.hit(file);
+        BADGERDB_TRACE(TRACE_BUFFER_HIT, file, pageNo, 1, 0);
+        return makeHandle(file, pageNo, frameNo);
+      }
+      // the thread reading it in failed, try again ourselves
+      continue;
+    }
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+    //not in the buffer pool, must allocate a new page; a scan with a ring recycles its own frames once it is full
+    FrameId newFrameNo;
+    if (ring == NULL || !reuseRingFrame(*ring, newFrameNo))
+      allocBuf(newFrameNo);
+    BufDesc* tmpbuf = &bufDescTable[newFrameNo];
+    {
+      // another thread may have read the page in while we were looking for a frame
+      std::lock_guard<std::mutex> partGuard(part.latch);
+      found = part.hashTable->lookup(file, pageNo, frameNo);
+      if (found)
+      {
+        policy->pinned(frameNo, false, pattern);
+        bufDescTable[frameNo].pinCnt++;
+        if (pattern == RANDOM_ACCESS)
+          bufDescTable[frameNo].scanned = false;
+      }
+      else
+      {
+        // set up the entry properly and publish it; readers of the page wait until it is in
+        tmpbuf->Set(file, pageNo);
+        tmpbuf->scanned = (pattern == SEQUENTIAL_ACCESS);
+        policy->pinned(newFrameNo, true, pattern);
+        tmpbuf->loading = true;
+        part.hashTable->insert(file, pageNo, newFrameNo);
+      }
+    }
+    if (found)
+    {
+      tmpbuf->latch.unlock();
+      if (awaitFrame(frameNo))
+      {
+        bufStats.hit(file);
+        BADGERDB_TRACE(TRACE_BUFFER_HIT, file, pageNo, 1, 0);
+        return makeHandle(file, pageNo, frameNo);
+      }
+      continue;
+    }
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+    // read the page into the new frame, from the secondary cache if it has it
+    try
+    {
+      SecondaryCache* cache = secondaryCache;
+      if (cache == NULL || !cache->read(file, pageNo, &bufPool[newFrameNo]))
+      {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        file->readPageInto(pageNo, &bufPool[newFrameNo]);
+        bufStats.read(microsSince(start));
+      }
+    }
+    catch (...)
+    {
+      {
+        std::lock_guard<std::mutex> partGuard(part.latch);
+        part.hashTable->remove(file, pageNo);
+      }
+      // threads waiting for the page see it invalid and drop their pins
+      policy->evicted(newFrameNo);
+      tmpbuf->valid = false;
+      tmpbuf->file = NULL;
+      tmpbuf->pageNo = Page::INVALID_NUMBER;
+      tmpbuf->pinCnt--;
+      tmpbuf->loading = false;
+      tmpbuf->latch.unlock();
+      throw;
+    }
+    bufStats.miss(file);
+    BADGERDB_TRACE(TRACE_BUFFER_MISS, file, pageNo, 1, 0);
+    tmpbuf->loading = false;
+    tmpbuf->latch.unlock();
+    if (ring != NULL)
+    {
+      BufferRing::Slot& slot = ring->slots[ring->next];
+      slot.file = file;
+      slot.pageNo = pageNo;
+      slot.frameNo = newFrameNo;
+      ring->next = (ring->next + 1) % ring->slots.size();
+    }
+    return makeHandle(file, pageNo, newFrameNo);
   }
 }
 
 
-void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) 
+void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
 {
+  if (file->isMapped())
+  {
+    if (dirty)
+      throw ReadOnlyFileException(file->filename());
+    return;
+  }
+
   // lookup in hashtable
+  BufPartition& part = partitionOf(file, pageNo);
+  std::lock_guard<std::mutex> partGuard(part.latch);
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  if (!part.hashTable->lookup(file, pageNo, frameNo))
+    throw HashNotFoundException(file->filename(), pageNo);
 
   if (dirty == true) bufDescTable[frameNo].dirty = dirty;
 
@@ -168,76 +508,861 @@ void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
   else bufDescTable[frameNo].pinCnt--;
 }
 
-void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
+void BufMgr::unPinPage(const PageHandle& handle, const bool dirty)
+{
+  if (handle.frameNo == MAPPED_FRAME)
+  {
+    if (dirty)
+      throw ReadOnlyFileException(handle.file->filename());
+    return;
+  }
+
+  // the caller's pin keeps the frame from being reused, so it can be checked without a latch
+  BufDesc* tmpbuf = &bufDescTable[handle.frameNo];
+  if (!tmpbuf->valid || tmpbuf->file != handle.file || tmpbuf->pageNo != handle.pageNo || tmpbuf->pinCnt == 0)
+    throw PageNotPinnedException(handle.file->filename(), handle.pageNo, handle.frameNo);
+
+  if (dirty == true) tmpbuf->dirty = dirty;
+  tmpbuf->pinCnt--;
+}
+
+void BufMgr::markDirty(const PageHandle& handle)
+{
+  if (handle.frameNo == MAPPED_FRAME)
+    throw ReadOnlyFileException(handle.file->filename());
+
+  BufDesc* tmpbuf = &bufDescTable[handle.frameNo];
+  if (!tmpbuf->valid || tmpbuf->file != handle.file || tmpbuf->pageNo != handle.pageNo || tmpbuf->pinCnt == 0)
+    throw PageNotPinnedException(handle.file->filename(), handle.pageNo, handle.frameNo);
+
+  tmpbuf->dirty = true;
+}
+
+void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
+{
+  page = allocPage(file, pageNo).page;
+}
+
+PageHandle BufMgr::allocPage(File* file, PageId &pageNo)
+{
+  return allocPage(file, pageNo, Page::INVALID_NUMBER);
+}
+
+PageHandle BufMgr::allocPage(File* file, PageId &pageNo, const PageId nearPage)
 {
   FrameId frameNo;
 
   // alloc a new frame
   allocBuf(frameNo);
+  BufDesc* tmpbuf = &bufDescTable[frameNo];
 
   // allocate a new page in the file
 	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
-  page = &bufPool[frameNo];
+  try
+  {
+    std::lock_guard<std::mutex> headerGuard(file->headerLatch());
+    file->allocatePageNear(pageNo, &bufPool[frameNo], nearPage);
+  }
+  catch (...)
+  {
+    tmpbuf->latch.unlock();
+    throw;
+  }
 
   // set up the entry properly
-  bufDescTable[frameNo].Set(file, pageNo);
+  tmpbuf->Set(file, pageNo);
+  policy->pinned(frameNo, true, RANDOM_ACCESS);
+  bufStats.miss(file);
 
   // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+  {
+    BufPartition& part = partitionOf(file, pageNo);
+    std::lock_guard<std::mutex> partGuard(part.latch);
+    part.hashTable->insert(file, pageNo, frameNo);
+  }
+  tmpbuf->latch.unlock();
+
+  return makeHandle(file, pageNo, frameNo);
 }
 
-void BufMgr::flushFile(const File* file) 
+void BufMgr::flushFile(const File* file)
 {
+  cancelPrefetch(file);
+
+  // latch every frame of the file first, so that its dirty pages can be written in page order rather than frame order
+  std::vector<std::unique_lock<std::mutex> > frameGuards;
+  std::vector<BufDesc*> fileBufs;
+  std::vector<BufDesc*> dirtyBufs;
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	BufDesc* tmpbuf = &(bufDescTable[i]);
+    std::unique_lock<std::mutex> frameGuard(tmpbuf->latch);
   	if(tmpbuf->file && tmpbuf->valid == true && tmpbuf->file == file)
 		{
 	    if (tmpbuf->pinCnt > 0)
   			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
 
 	    if (tmpbuf->dirty == true)
-			{
-				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-				tmpbuf->dirty = false;
-    	}
-
-    	hashTable->remove(file,tmpbuf->pageNo);
-    	tmpbuf->Clear();
+				dirtyBufs.push_back(tmpbuf);
+      fileBufs.push_back(tmpbuf);
+      frameGuards.push_back(std::move(frameGuard));
   	}
 		else if (tmpbuf->valid == false && tmpbuf->file == file)
-  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, policy->referenced(tmpbuf->frameNo));
+  }
+
+  writeBackRuns(dirtyBufs);
+
+  // the File object may go away after this, and another one take its address
+  SecondaryCache* cache = secondaryCache;
+  if (cache != NULL)
+    cache->dropFile(file);
+  bufStats.forget(file);
+
+  for (std::size_t i = 0; i < fileBufs.size(); i++)
+  {
+    BufDesc* tmpbuf = fileBufs[i];
+    BufPartition& part = partitionOf(file, tmpbuf->pageNo);
+    std::lock_guard<std::mutex> partGuard(part.latch);
+    part.hashTable->remove(file,tmpbuf->pageNo);
+    tmpbuf->Clear();
+    policy->evicted(tmpbuf->frameNo);
+  }
+  frameGuards.clear();
+
+  // make the writes of this flush, and of earlier evictions, durable before the file may be closed
+  bool unsynced;
+  {
+    std::lock_guard<std::mutex> syncGuard(syncLatch);
+    unsynced = unsyncedFiles.erase(file) > 0;
+  }
+  if (unsynced)
+    file->sync();
+}
+
+void BufMgr::checkpoint()
+{
+  std::lock_guard<std::mutex> checkpointGuard(checkpointLatch);
+  RedoLog* log = redoLog;
+  const Lsn redoLsn = (log != NULL) ? log->beginCheckpoint() : 0;
+
+  // a batch at a time, so that other threads only ever wait for the frames of one batch
+  std::vector<BufDesc*> busyBufs;
+  const std::uint32_t frames = numBufs;
+  for (std::uint32_t first = 0; first < frames; first += CHECKPOINT_BATCH_SIZE)
+  {
+    std::vector<std::unique_lock<std::mutex> > frameGuards;
+    std::vector<BufDesc*> dirtyBufs;
+    for (std::uint32_t i = first; i < frames && i < first + CHECKPOINT_BATCH_SIZE; i++)
+    {
+      BufDesc* tmpbuf = &(bufDescTable[i]);
+      std::unique_lock<std::mutex> frameGuard(tmpbuf->latch);
+      if (!tmpbuf->valid || !tmpbuf->dirty)
+        continue;
+      if (tmpbuf->logging != 0)
+      {
+        busyBufs.push_back(tmpbuf);
+        continue;
+      }
+      dirtyBufs.push_back(tmpbuf);
+      frameGuards.push_back(std::move(frameGuard));
+    }
+    writeBackRuns(dirtyBufs);
+  }
+
+  // a page half way through a logged change must not reach the disk before the change is in the log
+  for (std::size_t i = 0; i < busyBufs.size(); i++)
+  {
+    BufDesc* tmpbuf = busyBufs[i];
+    while (true)
+    {
+      {
+        std::lock_guard<std::mutex> frameGuard(tmpbuf->latch);
+        if (tmpbuf->logging == 0)
+        {
+          if (tmpbuf->valid && tmpbuf->dirty)
+            writeBack(tmpbuf);
+          break;
+        }
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  std::set<const File*> files;
+  {
+    std::lock_guard<std::mutex> syncGuard(syncLatch);
+    files.swap(unsyncedFiles);
+  }
+  for (std::set<const File*>::iterator it = files.begin(); it != files.end(); ++it)
+  {
+    (*it)->sync();
+  }
+
+  if (log != NULL)
+    log->endCheckpoint(redoLsn);
+}
+
+void BufMgr::flushLogFor(BufDesc* const* bufs, const std::size_t count)
+{
+  RedoLog* log = redoLog;
+  if (log == NULL)
+    return;
+  Lsn lsn = 0;
+  for (std::size_t i = 0; i < count; i++)
+    lsn = std::max<Lsn>(lsn, bufs[i]->lsn);
+  if (lsn > log->durableLsn())
+  {
+    bufStats.logFlushWaited();
+    log->flush(lsn);
+  }
+}
+
+void BufMgr::writeBack(BufDesc* buf)
+{
+  flushLogFor(&buf, 1);
+  SecondaryCache* cache = secondaryCache;
+  if (cache != NULL)
+    cache->invalidate(buf->file, buf->pageNo);
+
+  // as in writeBackRuns(), a change made to a pinned page while it is written marks the frame dirty again
+  buf->dirty = false;
+  try
+  {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    buf->file->writePage(buf->pageNo, bufPool[buf->frameNo]);
+    bufStats.written(1, microsSince(start));
   }
+  catch (...)
+  {
+    buf->dirty = true;
+    throw;
+  }
+
+  std::lock_guard<std::mutex> syncGuard(syncLatch);
+  unsyncedFiles.insert(buf->file);
+}
+
+void BufMgr::writeBackRuns(std::vector<BufDesc*>& bufs)
+{
+  // order the frames by file and then page number
+  struct PageOrder
+  {
+    bool operator()(const BufDesc* a, const BufDesc* b) const
+    {
+      if (a->file != b->file)
+        return std::less<const File*>()(a->file, b->file);
+      return a->pageNo < b->pageNo;
+    }
+  };
+  std::sort(bufs.begin(), bufs.end(), PageOrder());
+  if (!bufs.empty())
+    flushLogFor(&bufs[0], bufs.size());
+
+  std::vector<PageId> pageNos;
+  std::vector<const Page*> pages;
+  std::size_t start = 0;
+  while (start < bufs.size())
+  {
+    // the pages of a file go to it in one batch, which the backend gets as a vectored write per run of consecutive
+    // pages
+    std::size_t end = start + 1;
+    while (end < bufs.size() && bufs[end]->file == bufs[start]->file)
+      end++;
+
+    // a page that is still pinned may be changed while it is written; clearing the flag first makes such a change
+    // mark the frame dirty again instead of being lost
+    pageNos.clear();
+    pages.clear();
+    SecondaryCache* cache = secondaryCache;
+    for (std::size_t i = start; i < end; i++)
+    {
+      pageNos.push_back(bufs[i]->pageNo);
+      pages.push_back(&bufPool[bufs[i]->frameNo]);
+      bufs[i]->dirty = false;
+      if (cache != NULL)
+        cache->invalidate(bufs[i]->file, bufs[i]->pageNo);
+    }
+    try
+    {
+      const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+      bufs[start]->file->writePages(&pageNos[0], pages.size(), &pages[0]);
+      bufStats.written(pages.size(), microsSince(begin));
+    }
+    catch (...)
+    {
+      for (std::size_t i = start; i < end; i++)
+        bufs[i]->dirty = true;
+      throw;
+    }
+
+    {
+      std::lock_guard<std::mutex> syncGuard(syncLatch);
+      unsyncedFiles.insert(bufs[start]->file);
+    }
+    start = end;
+  }
+}
+
+void BufMgr::startWriter(const std::uint32_t batchFrames, const std::uint32_t intervalMs,
+                         const std::uint64_t checkpointBytes)
+{
+  std::lock_guard<std::mutex> writerGuard(writerLatch);
+  if (writer.joinable())
+    return;
+  writerBatch = std::max<std::uint32_t>(1, std::min<std::uint32_t>(batchFrames, numBufs));
+  writerInterval = intervalMs;
+  writerCheckpointBytes = checkpointBytes;
+  writerStop = false;
+  writerRunning = true;
+  writer = std::thread(&BufMgr::writerLoop, this);
+}
+
+void BufMgr::stopWriter()
+{
+  std::thread stopping;
+  {
+    std::lock_guard<std::mutex> writerGuard(writerLatch);
+    if (!writer.joinable())
+      return;
+    writerStop = true;
+    writerRunning = false;
+    stopping.swap(writer);
+  }
+  writerCond.notify_all();
+  stopping.join();
+}
+
+void BufMgr::writerLoop()
+{
+  std::chrono::steady_clock::time_point listSaved = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> writerGuard(writerLatch);
+  while (!writerStop)
+  {
+    writerCond.wait_for(writerGuard, std::chrono::milliseconds(writerInterval));
+    if (writerStop)
+      return;
+    const std::string listName = pageListName;
+    const std::uint32_t listInterval = pageListInterval;
+    writerGuard.unlock();
+    try
+    {
+      cleanAhead();
+      RedoLog* log = redoLog;
+      if (log != NULL && writerCheckpointBytes != 0 &&
+          log->endLsn() - log->checkpointLsn() >= writerCheckpointBytes)
+        checkpoint();
+      const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if (!listName.empty() && listInterval != 0 && now - listSaved >= std::chrono::milliseconds(listInterval))
+      {
+        listSaved = now;
+        savePageList(listName);
+      }
+    }
+    catch (const BadgerDbException &)
+    {
+      // the pages stay dirty, eviction writes them and reports the error to its caller; a checkpoint cut short
+      // leaves recovery to start from the one before
+    }
+    writerGuard.lock();
+  }
+}
+
+void BufMgr::cleanAhead()
+{
+  std::vector<std::unique_lock<std::mutex> > frameGuards;
+  std::vector<BufDesc*> dirtyBufs;
+  const FrameId start = policy->sweepPosition();
+  const std::uint32_t frames = numBufs;
+  for (std::uint32_t i = 0; i < writerBatch && i < frames; i++)
+  {
+    // frames dropped by a shrink on the way are invalid and skipped
+    BufDesc* tmpbuf = &bufDescTable[(start + i) % frames];
+
+    // frames that are being filled, evicted or flushed are busy already
+    std::unique_lock<std::mutex> frameGuard(tmpbuf->latch, std::try_to_lock);
+    if (!frameGuard.owns_lock())
+      continue;
+    if (tmpbuf->valid && tmpbuf->dirty && tmpbuf->pinCnt == 0 && !policy->referenced(tmpbuf->frameNo))
+    {
+      dirtyBufs.push_back(tmpbuf);
+      frameGuards.push_back(std::move(frameGuard));
+    }
+  }
+  writeBackRuns(dirtyBufs);
+}
+
+std::uint32_t BufMgr::resize(std::uint32_t bufs)
+{
+  std::lock_guard<std::mutex> resizeGuard(resizeLatch);
+  bufs = std::max<std::uint32_t>(1, std::min(bufs, maxBufs));
+  const std::uint32_t oldBufs = numBufs;
+  if (bufs >= oldBufs)
+  {
+    // the new frames are empty; the policy hands them out once it knows of them
+    pagePool->commit(oldBufs, bufs - oldBufs);
+    numBufs = bufs;
+    policy->resize(bufs);
+    return bufs;
+  }
+
+  // latch the frames from the end of the pool down, up to one that is pinned or busy; waiting for latches here
+  // would keep the policy handing out the frames latched so far, which other threads would have to pass up
+  std::vector<std::unique_lock<std::mutex> > frameGuards;
+  std::uint32_t target = oldBufs;
+  while (target > bufs)
+  {
+    std::unique_lock<std::mutex> frameGuard(bufDescTable[target - 1].latch, std::try_to_lock);
+    if (!frameGuard.owns_lock() || bufDescTable[target - 1].pinCnt != 0)
+      break;
+    frameGuards.push_back(std::move(frameGuard));
+    target--;
+  }
+  if (target == oldBufs)
+    return oldBufs;
+
+  // the policy stops handing out the frames before they are evicted, so that evicting them does not free them for
+  // other pages; frames it handed out already are skipped once their latch is free
+  policy->resize(target);
+  std::uint32_t newBufs = oldBufs;
+  try
+  {
+    // evict from the end of the pool down, a page pinned since it was looked at ends the shrink there
+    while (newBufs > target)
+    {
+      BufDesc* tmpbuf = &bufDescTable[newBufs - 1];
+      if (tmpbuf->valid ? !evictFrame(tmpbuf) : tmpbuf->pinCnt != 0)
+        break;
+      newBufs--;
+    }
+  }
+  catch (...)
+  {
+    retireFrames(target, newBufs, oldBufs);
+    throw;
+  }
+  retireFrames(target, newBufs, oldBufs);
+  return newBufs;
+}
+
+void BufMgr::retireFrames(const std::uint32_t target, const std::uint32_t newBufs, const std::uint32_t oldBufs)
+{
+  // give the policy back the frames a shrink did not get to evict
+  if (newBufs > target)
+    policy->resize(newBufs);
+  numBufs = newBufs;
+  pagePool->release(newBufs, oldBufs - newBufs);
+}
+
+void BufMgr::prefetchPages(File* file, const PageId pageNo, const std::uint32_t count, NextPageFn next)
+{
+  if (count == 0 || pageNo == Page::INVALID_NUMBER)
+    return;
+
+  {
+    std::lock_guard<std::mutex> prefetchGuard(prefetchLatch);
+    if (prefetchStop || prefetchQueue.size() >= PREFETCH_QUEUE_LIMIT)
+      return;
+
+    PrefetchRequest request;
+    request.file = file;
+    request.pageNo = pageNo;
+    request.count = count;
+    request.next = next;
+    prefetchQueue.push_back(request);
+
+    if (!prefetcher.joinable())
+      prefetcher = std::thread(&BufMgr::prefetchLoop, this);
+  }
+  prefetchCond.notify_all();
+}
+
+void BufMgr::prefetchLoop()
+{
+  std::unique_lock<std::mutex> prefetchGuard(prefetchLatch);
+  while (true)
+  {
+    while (!prefetchStop && prefetchQueue.empty())
+      prefetchCond.wait(prefetchGuard);
+    if (prefetchStop)
+      return;
+
+    // the requests for the same file waiting behind the first are taken along, so that the first pages of all of
+    // them are read in one batch
+    std::vector<PrefetchRequest> requests(1, prefetchQueue.front());
+    prefetchQueue.pop_front();
+    File* file = requests[0].file;
+    for (std::deque<PrefetchRequest>::iterator it = prefetchQueue.begin(); it != prefetchQueue.end();)
+    {
+      if (it->file == file)
+      {
+        requests.push_back(*it);
+        it = prefetchQueue.erase(it);
+      }
+      else
+        ++it;
+    }
+    prefetchActiveFile = file;
+    prefetchGuard.unlock();
+
+    std::vector<PageId> firstPages;
+    for (std::size_t k = 0; k < requests.size(); k++)
+      firstPages.push_back(requests[k].pageNo);
+    try
+    {
+      loadPages(file, &firstPages[0], firstPages.size(), SEQUENTIAL_ACCESS);
+    }
+    catch (const BadgerDbException &)
+    {
+      // a page that went away fails the whole batch; the chains below read their pages one by one
+    }
+
+    // a page that is already in the pool costs a lookup only, so each chain is walked from its start
+    for (std::size_t k = 0; k < requests.size(); k++)
+    {
+      PageId pageNo = requests[k].pageNo;
+      for (std::uint32_t i = 0; i < requests[k].count && pageNo != Page::INVALID_NUMBER; i++)
+      {
+        try
+        {
+          PageHandle handle = readPage(file, pageNo, SEQUENTIAL_ACCESS);
+          pageNo = requests[k].next(*handle.page);
+          unPinPage(handle, false);
+        }
+        catch (const BadgerDbException &)
+        {
+          // a full pool or a page that went away; read-ahead is only a hint
+          break;
+        }
+      }
+    }
+
+    prefetchGuard.lock();
+    prefetchActiveFile = NULL;
+    prefetchCond.notify_all();
+  }
+}
+
+void BufMgr::cancelPrefetch(const File* file)
+{
+  std::unique_lock<std::mutex> prefetchGuard(prefetchLatch);
+  for (std::deque<PrefetchRequest>::iterator it = prefetchQueue.begin(); it != prefetchQueue.end();)
+  {
+    if (it->file == file)
+      it = prefetchQueue.erase(it);
+    else
+      ++it;
+  }
+  while (prefetchActiveFile == file)
+    prefetchCond.wait(prefetchGuard);
+}
+
+void BufMgr::savePageList(const std::string& name)
+{
+  const std::string tmpName = name + ".tmp";
+  {
+    std::ofstream out(tmpName.c_str(), std::ios::out | std::ios::trunc);
+    const std::uint32_t frames = numBufs;
+    for (std::uint32_t i = 0; i < frames && out; i++)
+    {
+      BufDesc* tmpbuf = &bufDescTable[i];
+      std::lock_guard<std::mutex> frameGuard(tmpbuf->latch);
+      if (tmpbuf->valid)
+        out << tmpbuf->pageNo << ' ' << tmpbuf->file->filename() << '\n';
+    }
+    out.close();
+    if (out.fail())
+      throw IoErrorException("write", errno);
+  }
+  if (std::rename(tmpName.c_str(), name.c_str()) != 0)
+    throw IoErrorException("rename", errno);
+}
+
+void BufMgr::setPageListFile(const std::string& name, const std::uint32_t intervalMs)
+{
+  std::lock_guard<std::mutex> writerGuard(writerLatch);
+  pageListName = name;
+  pageListInterval = intervalMs;
+}
+
+std::size_t BufMgr::warmUp(const std::string& name, const std::vector<File*>& files)
+{
+  std::ifstream in(name.c_str());
+  if (!in)
+    return 0;
+
+  std::map<std::string, File*> byName;
+  for (std::size_t i = 0; i < files.size(); i++)
+  {
+    // pages of a mapped file never take a frame
+    if (!files[i]->isMapped())
+      byName[files[i]->filename()] = files[i];
+  }
+  std::map<File*, std::vector<PageId> > listed;
+  std::string line;
+  while (std::getline(in, line))
+  {
+    const std::size_t space = line.find(' ');
+    if (space == std::string::npos)
+      continue;
+    std::map<std::string, File*>::const_iterator it = byName.find(line.substr(space + 1));
+    if (it != byName.end())
+      listed[it->second].push_back(static_cast<PageId>(std::strtoul(line.c_str(), NULL, 10)));
+  }
+
+  std::size_t loaded = 0;
+  for (std::map<File*, std::vector<PageId> >::iterator it = listed.begin(); it != listed.end(); ++it)
+  {
+    File* file = it->first;
+    std::vector<PageId>& pages = it->second;
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+    std::size_t i = 0;
+    while (i < pages.size() && loaded < numBufs)
+    {
+      const std::size_t count = std::min<std::size_t>(std::min<std::size_t>(WARM_UP_BATCH_PAGES, pages.size() - i),
+                                                      numBufs - loaded);
+      try
+      {
+        loaded += loadPages(file, &pages[i], count, RANDOM_ACCESS);
+      }
+      catch (const BadgerDbException &)
+      {
+        // a page that went away fails the read of its whole batch, so the others are read one by one
+        for (std::size_t k = 0; k < count; k++)
+        {
+          try
+          {
+            loaded += loadPages(file, &pages[i + k], 1, RANDOM_ACCESS);
+          }
+          catch (const BadgerDbException &)
+          {
+          }
+        }
+      }
+      i += count;
+    }
+  }
+  return loaded;
+}
+
+bool BufMgr::isResident(const File* file, const PageId pageNo)
+{
+  BufPartition& part = partitionOf(file, pageNo);
+  std::lock_guard<std::mutex> partGuard(part.latch);
+  FrameId frameNo;
+  return part.hashTable->lookup(file, pageNo, frameNo);
+}
+
+std::size_t BufMgr::loadPages(File* file, const PageId* pageNos, const std::size_t count,
+                             const AccessPattern pattern)
+{
+  std::vector<BufDesc*> bufs;
+  std::vector<PageId> loading;
+  std::vector<Page*> pages;
+  for (std::size_t k = 0; k < count; k++)
+  {
+    // a page already in the pool costs no frame; one read in by another thread meanwhile gives its frame back
+    const PageId pageNo = pageNos[k];
+    if (isResident(file, pageNo))
+      continue;
+    BufPartition& part = partitionOf(file, pageNo);
+    FrameId newFrameNo;
+    try
+    {
+      allocBuf(newFrameNo);
+    }
+    catch (const BufferExceededException &)
+    {
+      break;
+    }
+    BufDesc* tmpbuf = &bufDescTable[newFrameNo];
+    bool found;
+    {
+      std::lock_guard<std::mutex> partGuard(part.latch);
+      FrameId frameNo;
+      found = part.hashTable->lookup(file, pageNo, frameNo);
+      if (!found)
+      {
+        // published like a page fetchPage() reads in; readers wait until it is in
+        tmpbuf->Set(file, pageNo);
+        tmpbuf->scanned = (pattern == SEQUENTIAL_ACCESS);
+        policy->pinned(newFrameNo, true, pattern);
+        tmpbuf->loading = true;
+        part.hashTable->insert(file, pageNo, newFrameNo);
+      }
+    }
+    if (found)
+    {
+      tmpbuf->latch.unlock();
+      continue;
+    }
+    bufs.push_back(tmpbuf);
+    loading.push_back(pageNo);
+    pages.push_back(&bufPool[newFrameNo]);
+  }
+  if (bufs.empty())
+    return 0;
+
+  try
+  {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    file->readPages(&loading[0], pages.size(), &pages[0]);
+    bufStats.read(microsSince(start), pages.size());
+  }
+  catch (...)
+  {
+    for (std::size_t k = 0; k < bufs.size(); k++)
+    {
+      BufDesc* tmpbuf = bufs[k];
+      {
+        BufPartition& part = partitionOf(file, tmpbuf->pageNo);
+        std::lock_guard<std::mutex> partGuard(part.latch);
+        part.hashTable->remove(file, tmpbuf->pageNo);
+      }
+      // threads waiting for the page see it invalid and drop their pins
+      policy->evicted(tmpbuf->frameNo);
+      tmpbuf->valid = false;
+      tmpbuf->file = NULL;
+      tmpbuf->pageNo = Page::INVALID_NUMBER;
+      tmpbuf->pinCnt--;
+      tmpbuf->loading = false;
+      tmpbuf->latch.unlock();
+    }
+    throw;
+  }
+  for (std::size_t k = 0; k < bufs.size(); k++)
+  {
+    bufs[k]->pinCnt--;
+    bufs[k]->loading = false;
+    bufs[k]->latch.unlock();
+  }
+  return bufs.size();
+}
+
+void BufMgr::setRedoLog(RedoLog* log)
+{
+  RedoLog* old = redoLog.exchange(log);
+  if (old != NULL)
+    old->flush(old->endLsn());
+}
+
+void BufMgr::setSecondaryCache(SecondaryCache* cache)
+{
+  secondaryCache = cache;
+}
+
+RecordId BufMgr::insertRecord(PageFile* file, const std::string& record_data)
+{
+  if (record_data.length() + sizeof(PageSlot) > Page::DATA_SIZE)
+  {
+    throw InsufficientSpaceException(Page::INVALID_NUMBER, record_data.length(), Page::DATA_SIZE - sizeof(PageSlot));
+  }
+
+  std::lock_guard<std::mutex> heapGuard(heapLatch);
+  while (true)
+  {
+    PageId pageNo;
+    {
+      std::lock_guard<std::mutex> headerGuard(file->headerLatch());
+      pageNo = file->findPageWithSpace(record_data.length());
+    }
+    const bool isNew = (pageNo == Page::INVALID_NUMBER);
+    const PageHandle handle = isNew ? allocPage(file, pageNo) : readPage(file, pageNo);
+    PageGuard page(this, handle);
+    RedoGroup group(this);
+    if (!page.page()->hasSpaceForRecord(record_data))
+    {
+      // the map is behind the page as it is in the pool; correct its entry and look again
+      std::lock_guard<std::mutex> headerGuard(file->headerLatch());
+      file->noteFreeSpace(*page.page());
+      continue;
+    }
+
+    if (isNew)
+      group.trackNew(handle);
+    else
+      group.track(handle);
+    const RecordId rid = page.page()->insertRecord(record_data);
+    page.markDirty();
+    group.log();
+    {
+      std::lock_guard<std::mutex> headerGuard(file->headerLatch());
+      file->noteFreeSpace(*page.page());
+    }
+    group.commit();
+    return rid;
+  }
+}
+
+void BufMgr::beginLogging(const PageHandle& handle)
+{
+  // a checkpoint writing the page holds the latch until it is done
+  BufDesc* tmpbuf = &bufDescTable[handle.frameNo];
+  std::lock_guard<std::mutex> frameGuard(tmpbuf->latch);
+  tmpbuf->logging++;
+  // the group keeps the page pinned until it is logged; the caller's pin keeps it from being evicted meanwhile
+  tmpbuf->pinCnt++;
+}
+
+void BufMgr::endLogging(const PageHandle& handle, const Lsn lsn)
+{
+  BufDesc* tmpbuf = &bufDescTable[handle.frameNo];
+  // groups changing the page are serialized by the caller, so LSNs only grow here
+  if (lsn != 0)
+    tmpbuf->lsn = lsn;
+  tmpbuf->logging--;
+  tmpbuf->pinCnt--;
 }
 
 void BufMgr::disposePage(File* file, const PageId pageNo)
 {
 	//Deallocate from file altogether
   //See if it is in the buffer pool
+  BufPartition& part = partitionOf(file, pageNo);
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  bool found;
+  {
+    std::lock_guard<std::mutex> partGuard(part.latch);
+    found = part.hashTable->lookup(file, pageNo, frameNo);
+  }
 
-	// clear the page
-	bufDescTable[frameNo].Clear();
+  if (found)
+  {
+    // frame latch before partition latch, as everywhere else; the page may have left the frame meanwhile
+    BufDesc* tmpbuf = &bufDescTable[frameNo];
+    std::lock_guard<std::mutex> frameGuard(tmpbuf->latch);
+    std::lock_guard<std::mutex> partGuard(part.latch);
+    if (tmpbuf->valid && tmpbuf->file == file && tmpbuf->pageNo == pageNo)
+    {
+      // clear the page
+      tmpbuf->Clear();
+      part.hashTable->remove(file, pageNo);
+      policy->evicted(frameNo);
+    }
+  }
 
-	hashTable->remove(file, pageNo);
+  // it may have been evicted into the secondary cache before it was found
+  SecondaryCache* cache = secondaryCache;
+  if (cache != NULL)
+    cache->invalidate(file, pageNo);
 
-  // deallocate it in the file	
+  // deallocate it in the file
+  std::lock_guard<std::mutex> headerGuard(file->headerLatch());
   file->deletePage(pageNo);
 }
 
-void BufMgr::printSelf(void) 
+void BufMgr::printSelf(void)
 {
   BufDesc* tmpbuf;
 	int validFrames = 0;
-  
+
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	tmpbuf = &(bufDescTable[i]);
 		std::cout << "FrameNo:" << i << " ";
-		tmpbuf->Print();
+		tmpbuf->Print(policy->referenced(i));
 
   	if (tmpbuf->valid == true)
     	validFrames++;
@@ -246,4 +1371,87 @@ void BufMgr::printSelf(void)
 	std::cout << "Total Number of Valid Frames:" << validFrames << "\n";
 }
 
+
+//----------------------------------------
+// RedoGroup
+//----------------------------------------
+
+RedoGroup::RedoGroup(BufMgr* bufMgr)
+  : bufMgr(bufMgr), redoLog(bufMgr->getRedoLog()), lastLsn(0)
+{
+}
+
+RedoGroup::~RedoGroup()
+{
+  for (std::size_t i = 0; i < pages.size(); i++)
+    bufMgr->endLogging(pages[i].handle, 0);
+}
+
+void RedoGroup::track(const PageHandle& handle)
+{
+  if (redoLog == NULL || handle.frameNo == MAPPED_FRAME)
+    return;
+  for (std::size_t i = 0; i < pages.size(); i++)
+  {
+    if (pages[i].handle.file == handle.file && pages[i].handle.pageNo == handle.pageNo)
+      return;
+  }
+  bufMgr->beginLogging(handle);
+  pages.push_back(TrackedPage());
+  pages.back().handle = handle;
+  pages.back().isNew = false;
+  memcpy(&pages.back().logged, handle.page, Page::SIZE);
+}
+
+void RedoGroup::trackNew(const PageHandle& handle)
+{
+  if (redoLog == NULL)
+    return;
+  bufMgr->beginLogging(handle);
+  pages.push_back(TrackedPage());
+  pages.back().handle = handle;
+  pages.back().isNew = true;
+}
+
+Lsn RedoGroup::log()
+{
+  if (pages.empty())
+    return 0;
+
+  std::vector<char> records;
+  for (std::size_t i = 0; i < pages.size(); i++)
+  {
+    TrackedPage& tracked = pages[i];
+    const PageHandle& handle = tracked.handle;
+    // the first change to a page since the log started is logged whole, like a new page
+    const bool image = redoLog->needsImage(handle.file, handle.pageNo) || tracked.isNew;
+    if (image)
+      RedoLog::addPageImage(records, handle.file, handle.pageNo, *handle.page);
+    else
+      RedoLog::addPageChanges(records, handle.file, handle.pageNo, tracked.logged, *handle.page);
+    if (tracked.isNew)
+    {
+      // recovery finds the page only if its allocation reached the disk first
+      redoLog->requireSynced(handle.file);
+    }
+  }
+
+  Lsn lsn = 0;
+  if (!records.empty())
+  {
+    lsn = redoLog->append(&records[0], records.size());
+    lastLsn = lsn;
+  }
+  for (std::size_t i = 0; i < pages.size(); i++)
+    bufMgr->endLogging(pages[i].handle, lsn);
+  pages.clear();
+  return lsn;
+}
+
+void RedoGroup::commit()
+{
+  if (lastLsn != 0)
+    redoLog->commit(lastLsn);
+}
+
 }
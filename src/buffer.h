@@ -9,7 +9,20 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include "buf_stats.h"
+#include "page_pool.h"
+#include "redo_log.h"
+#include "replacement_policy.h"
+#include "secondary_cache.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
 
 namespace badgerdb {
 
@@ -17,9 +30,65 @@ namespace badgerdb {
 * forward declaration of BufMgr class 
 */
 class BufMgr;
+class RedoGroup;
+
+/**
+* @brief Default number of partitions the buffer pool hash table is split into. Each partition has its own latch.
+*/
+const std::uint32_t BUF_PARTITIONS = 16;
+
+/**
+* @brief Frame number of handles to pages of a memory-mapped file, which are used in place and never take a frame.
+*/
+const FrameId MAPPED_FRAME = 0xFFFFFFFF;
+
+/**
+* @brief Maximum number of prefetch requests waiting for the read-ahead thread. Requests past it are dropped.
+*/
+const std::size_t PREFETCH_QUEUE_LIMIT = 64;
+
+/**
+* @brief Maximum number of pages BufMgr::warmUp() reads with one File::readPages().
+*/
+const std::size_t WARM_UP_BATCH_PAGES = 32;
+
+/**
+* @brief Default number of frames ahead of the replacement sweep the background writer looks at in each round.
+*/
+const std::uint32_t WRITER_BATCH_SIZE = 64;
+
+/**
+* @brief Default time, in milliseconds, the background writer sleeps between rounds.
+*/
+const std::uint32_t WRITER_INTERVAL_MS = 10;
+
+/**
+* @brief Default number of bytes the background writer lets the redo log grow by before it takes a checkpoint.
+*/
+const std::uint64_t CHECKPOINT_LOG_BYTES = 16 << 20;
+
+/**
+* @brief Number of frames a checkpoint latches and writes at a time.
+*/
+const std::uint32_t CHECKPOINT_BATCH_SIZE = 64;
+
+/**
+* @brief Default number of frames in a BufferRing.
+*/
+const std::uint32_t BUFFER_RING_SIZE = 32;
+
+/**
+* @brief Returns the number of the page to read ahead after the given one, or Page::INVALID_NUMBER if there is none.
+* Lets the caller lay out the chain of pages BufMgr::prefetchPages() follows, e.g. the right siblings of B+ tree leaves.
+*/
+typedef PageId (*NextPageFn)(const Page& page);
 
 /**
 * @brief Class for maintaining information about buffer pool frames
+*
+* file, pageNo, valid and the page in the frame only change while latch is held. pinCnt and dirty are
+* atomic so that pinning and unpinning a page that is already in the pool never takes the latch; a page is only
+* pinned while the latch of its hash table partition is held, which is what lets eviction check pinCnt safely.
 */
 class BufDesc {
 
@@ -44,12 +113,12 @@ class BufDesc {
 	/**
    * Number of times this page has been pinned
 	 */
-  int pinCnt;
+  std::atomic<int> pinCnt;
 
 	/**
    * True if page is dirty;  false otherwise
 	 */
-  bool dirty;
+  std::atomic<bool> dirty;
 
 	/**
    * True if page is valid
@@ -57,9 +126,31 @@ class BufDesc {
   bool valid;
 
 	/**
-   * Has this buffer frame been reference recently
+   * True while the page is being read into the frame. Threads that pin the page meanwhile wait on latch.
+	 */
+  std::atomic<bool> loading;
+
+	/**
+   * LSN of the last redo log group that changed the page, 0 if none. The page is only written once the log is
+   * durable up to it.
+	 */
+  std::atomic<Lsn> lsn;
+
+	/**
+   * Number of RedoGroups changing the page whose changes are not logged yet
+	 */
+  std::atomic<int> logging;
+
+	/**
+   * True while the page was only read with SEQUENTIAL_ACCESS since it came into the frame, which keeps it out of the
+   * SecondaryCache when it is evicted
+	 */
+  std::atomic<bool> scanned;
+
+	/**
+   * Held by the thread filling, evicting or flushing the frame
 	 */
-  bool refbit;
+  std::mutex latch;
 
 	/**
    * Initialize buffer frame for a new user
@@ -70,8 +161,11 @@ class BufDesc {
 		file = NULL;
 		pageNo = Page::INVALID_NUMBER;
     dirty = false;
-    refbit = false;
 		valid = false;
+    loading = false;
+    lsn = 0;
+    logging = 0;
+    scanned = false;
   };
 
 	/**
@@ -88,10 +182,16 @@ class BufDesc {
     pinCnt = 1;
     dirty = false;
     valid = true;
-    refbit = true;
+    lsn = 0;
+    scanned = false;
   }
 
-  void Print()
+	/**
+	 * Print the state of the frame
+	 *
+	 * @param refbit	True if the replacement policy saw the frame referenced recently
+	 */
+  void Print(const bool refbit)
 	{
 		if(file != NULL)
 		{
@@ -102,8 +202,8 @@ class BufDesc {
 			std::cout << "file:NULL ";
 
 		std::cout << "valid:" << valid << " ";
-		std::cout << "pinCnt:" << pinCnt << " ";
-		std::cout << "dirty:" << dirty << " ";
+		std::cout << "pinCnt:" << pinCnt.load() << " ";
+		std::cout << "dirty:" << dirty.load() << " ";
 		std::cout << "refbit:" << refbit << "\n";
   }
 
@@ -118,63 +218,173 @@ class BufDesc {
 
 
 /**
-* @brief Class to maintain statistics of buffer usage 
+* @brief Reference to a pinned page returned by the handle-based BufMgr calls. Remembers the frame holding the page so
+* unpinning or dirtying it does not go through the hash table again.
 */
-struct BufStats
+struct PageHandle
 {
 	/**
-   * Total number of accesses to buffer pool
+   * File the page belongs to
+	 */
+  File* file;
+
+	/**
+   * Page number in the file
 	 */
-  int accesses;
+  PageId pageNo;
 
 	/**
-   * Number of pages read from disk (including allocs)
+   * Frame of the buffer pool holding the page, MAPPED_FRAME if the page is read in place from a mapped file
 	 */
-  int diskreads;
+  FrameId frameNo;
 
 	/**
-   * Number of pages written back to disk
+   * Pinned in-memory page, NULL if the handle does not refer to a page
 	 */
-  int diskwrites;
+  Page* page;
 
 	/**
-   * Clear all values 
+   * Constructs a handle that does not refer to any page
 	 */
-  void clear()
+  PageHandle()
+    : file(NULL), pageNo(Page::INVALID_NUMBER), frameNo(0), page(NULL)
   {
-		accesses = diskreads = diskwrites = 0;
   }
-      
+};
+
+
+/**
+* @brief Chain of pages queued for the read-ahead thread of BufMgr
+*/
+struct PrefetchRequest
+{
+	/**
+   * File the pages belong to
+	 */
+  File* file;
+
+	/**
+   * First page of the chain
+	 */
+  PageId pageNo;
+
+	/**
+   * Number of pages to read, including the first one
+	 */
+  std::uint32_t count;
+
+	/**
+   * Finds the next page of the chain in a page that was read
+	 */
+  NextPageFn next;
+};
+
+
+/**
+* @brief Small private set of frames a scan reads its pages into, after the buffer access strategies of PostgreSQL.
+*
+* Pages the scan reads that are not in the pool yet go into the frames of the ring in turn: once the ring is full,
+* the next page takes the frame of the page read size reads earlier, as long as that page is still there and
+* unpinned, instead of a frame chosen by the replacement policy. So a scan over a large file evicts no more than
+* size pages of the pool. Pages already in the pool are used where they are. A ring belongs to one scan and is not
+* threadsafe.
+*/
+class BufferRing
+{
+	friend class BufMgr;
+
+ public:
 	/**
-   * Constructor of BufStats class 
+	 * Constructs an empty ring.
+	 *
+	 * @param size  Number of frames in the ring
 	 */
-  BufStats()
+  explicit BufferRing(const std::uint32_t size = BUFFER_RING_SIZE)
+    : slots(std::max<std::uint32_t>(1, size)), next(0)
   {
-		clear();
   }
+
+ private:
+	/**
+   * Frame of the ring and the page the scan read into it
+	 */
+  struct Slot
+  {
+    const File* file;
+    PageId pageNo;
+    FrameId frameNo;
+
+    Slot() : file(NULL), pageNo(Page::INVALID_NUMBER), frameNo(0)
+    {
+    }
+  };
+
+	/**
+   * Frames of the ring
+	 */
+  std::vector<Slot> slots;
+
+	/**
+   * Slot the next page read into the ring goes into
+	 */
+  std::size_t next;
+};
+
+
+/**
+* @brief One partition of the buffer pool hash table, with the latch guarding it
+*/
+struct BufPartition
+{
+	/**
+   * Held while the table is read or changed, and while a page found in it is pinned
+	 */
+  std::mutex latch;
+
+	/**
+   * Hash table mapping the (File, page) pairs of this partition to frames
+	 */
+  BufHashTbl *hashTable;
 };
 
 
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* BufMgr can be shared by several threads. The hash table is split into partitions with a latch each, so reading
+* pages that are already in the pool only contends with threads looking up pages of the same partition. Which
+* frame is replaced is up to a ReplacementPolicy, a clock sweep unless another one is given, and a frame being
+* filled is latched on its own. Calls into File are serialized by the buffer manager since File is not threadsafe.
 */
 class BufMgr 
 {
+	friend class RedoGroup;
+
  private:
 	/**
-   * Current position of clockhand in our buffer pool
+   * Number of frames in the buffer pool
 	 */
-  FrameId clockHand;
+  std::atomic<std::uint32_t> numBufs;
 
 	/**
-   * Number of frames in the buffer pool
+   * Number of frames the buffer pool may grow to
 	 */
-  std::uint32_t numBufs;
+  std::uint32_t maxBufs;
+
+	/**
+   * Serializes calls to resize()
+	 */
+  std::mutex resizeLatch;
 	
 	/**
-   * Hash table mapping (File, page) to frame
+   * Partitions of the hash table mapping (File, page) to frame
 	 */
-  BufHashTbl *hashTable;
+  BufPartition *partitions;
+
+	/**
+   * Number of partitions of the hash table
+	 */
+  std::uint32_t numPartitions;
 
 	/**
    * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
@@ -184,24 +394,254 @@ class BufMgr
 	/**
    * Maintains Buffer pool usage statistics 
 	 */
-  BufStats bufStats;
+  BufStatsCollector bufStats;
+
+	/**
+   * Chooses the frames to evict, owned by the buffer manager
+	 */
+  ReplacementPolicy *policy;
+
+	/**
+   * Memory holding bufPool
+	 */
+  PagePool *pagePool;
 
 	/**
-   * Advance clock to next frame in the buffer pool
+   * Returns the hash table partition holding (file, pageNo)
 	 */
-  void advanceClock()
+  BufPartition & partitionOf(const File* file, const PageId pageNo)
   {
-		clockHand = (clockHand + 1) % numBufs;
+		return partitions[(BufHashTbl::mix(file, pageNo) >> 32) % numPartitions];
   }
 
 	/**
-	 * Allocate a free frame.  
+	 * Allocate a free frame. The frame is returned with its latch held; the caller fills it and releases the latch.
 	 *
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
 	 */
   void allocBuf(FrameId & frame);
 
+	/**
+	 * Evicts the page in a valid frame unless it is pinned, writing it back first if it is dirty. The caller holds
+	 * the frame latch.
+	 *
+	 * @return  True if the frame is free now.
+	 */
+  bool evictFrame(BufDesc* buf);
+
+	/**
+	 * Takes back the frame of the next slot of a ring for a new page, if the page the scan read into it is still
+	 * there and unpinned. The frame is returned with its latch held, like from allocBuf().
+	 *
+	 * @return  False if the slot is empty or its frame cannot be reused.
+	 */
+  bool reuseRingFrame(BufferRing& ring, FrameId& frame);
+
+	/**
+	 * Reads a page like readPage(), with a ring to read it into if it is not in the pool, or NULL for a frame of
+	 * the pool.
+	 */
+  PageHandle fetchPage(File* file, const PageId PageNo, const AccessPattern pattern, BufferRing* ring);
+
+	/**
+	 * Waits until a frame pinned through the hash table holds its page, in case another thread is still reading it in.
+	 *
+	 * @param frameNo 	Frame pinned by the caller
+	 * @return  True if the page is there. False if reading it failed; the pin is dropped then.
+	 */
+  bool awaitFrame(const FrameId frameNo);
+
+	/**
+	 * Builds the handle for a page pinned in a frame.
+	 */
+  PageHandle makeHandle(File* file, const PageId pageNo, const FrameId frameNo);
+
+	/**
+   * Files pages were written to since they were last synced
+	 */
+  std::set<const File*> unsyncedFiles;
+
+	/**
+   * Guards unsyncedFiles
+	 */
+  std::mutex syncLatch;
+
+	/**
+   * Redo log pages are written ahead to, NULL if none
+	 */
+  std::atomic<RedoLog*> redoLog;
+
+	/**
+   * Second tier pages evicted clean go to and missing pages are looked up in, NULL if none
+	 */
+  std::atomic<SecondaryCache*> secondaryCache;
+
+	/**
+   * Serializes insertRecord()
+	 */
+  std::mutex heapLatch;
+
+	/**
+   * Makes the redo log, if there is one, durable up to the LSN of every given frame, so their pages may be written
+	 */
+  void flushLogFor(BufDesc* const* bufs, const std::size_t count);
+
+	/**
+   * Notes that a RedoGroup is about to change the page in a pinned frame, and pins it for the group. Waits for a
+   * write of the page that is under way, so the page is not written while it changes.
+	 */
+  void beginLogging(const PageHandle& handle);
+
+	/**
+   * Notes that the changes a RedoGroup made to the page in a frame were logged in the group with the given LSN, or
+   * 0 if none were, and drops the pin of the group.
+	 */
+  void endLogging(const PageHandle& handle, const Lsn lsn);
+
+	/**
+   * Writes the page in a dirty frame back to its file and marks the frame clean. The caller holds the frame latch.
+	 */
+  void writeBack(BufDesc* buf);
+
+	/**
+   * Writes the pages in the given dirty frames back in file and page order and marks the frames clean. The pages
+   * of a file go to it with one File::writePages(), so its backend gets a vectored write per run of consecutive
+   * pages all at once. The caller holds the latches of all the frames.
+	 */
+  void writeBackRuns(std::vector<BufDesc*>& bufs);
+
+	/**
+   * Thread reading queued prefetch requests into the pool, started by the first request
+	 */
+  std::thread prefetcher;
+
+	/**
+   * Guards prefetchQueue, prefetchActiveFile and prefetchStop
+	 */
+  std::mutex prefetchLatch;
+
+	/**
+   * Signalled when a request is queued, when the prefetcher is done with a file and when it has to stop
+	 */
+  std::condition_variable prefetchCond;
+
+	/**
+   * Requests waiting for the prefetcher
+	 */
+  std::deque<PrefetchRequest> prefetchQueue;
+
+	/**
+   * File the prefetcher is currently reading pages of, NULL while it waits
+	 */
+  const File* prefetchActiveFile;
+
+	/**
+   * Tells the prefetcher to exit
+	 */
+  bool prefetchStop;
+
+	/**
+   * Body of the prefetcher thread
+	 */
+  void prefetchLoop();
+
+	/**
+   * Drops the queued prefetch requests for a file and waits until the prefetcher holds none of its pages
+	 */
+  void cancelPrefetch(const File* file);
+
+	/**
+   * Background writer started by startWriter()
+	 */
+  std::thread writer;
+
+	/**
+   * True while the background writer runs; read without writerLatch to wake it up
+	 */
+  std::atomic<bool> writerRunning;
+
+	/**
+   * Guards writerStop
+	 */
+  std::mutex writerLatch;
+
+	/**
+   * Wakes the background writer up early, and tells it to stop
+	 */
+  std::condition_variable writerCond;
+
+	/**
+   * Tells the background writer to exit
+	 */
+  bool writerStop;
+
+	/**
+   * Number of frames the background writer looks at in each round
+	 */
+  std::uint32_t writerBatch;
+
+	/**
+   * Time, in milliseconds, the background writer sleeps between rounds
+	 */
+  std::uint32_t writerInterval;
+
+	/**
+   * Number of bytes the redo log may grow by before the background writer takes a checkpoint, 0 for never
+	 */
+  std::uint64_t writerCheckpointBytes;
+
+	/**
+   * Serializes checkpoints
+	 */
+  std::mutex checkpointLatch;
+
+	/**
+   * File savePageList() writes to at destruction and from the background writer, empty for none; guarded by
+   * writerLatch
+	 */
+  std::string pageListName;
+
+	/**
+   * Time, in milliseconds, between two saves of the page list by the background writer, 0 for none; guarded by
+   * writerLatch
+	 */
+  std::uint32_t pageListInterval;
+
+	/**
+   * Returns true if the page is in the pool, or being read in
+	 */
+  bool isResident(const File* file, const PageId pageNo);
+
+	/**
+   * Reads the given pages of the file that are not in the pool yet into free frames with one File::readPages(),
+   * which hands the backend all of their reads at once, and leaves them unpinned. Stops short once the pool has no
+   * frame to spare.
+   *
+   * @param pageNos  Numbers of the pages, each at most once
+   * @param count    Number of pages
+   * @param pattern  SEQUENTIAL_ACCESS for pages a scan is about to read
+   * @return  Number of pages read.
+	 */
+  std::size_t loadPages(File* file, const PageId* pageNos, const std::size_t count, const AccessPattern pattern);
+
+	/**
+   * Ends a shrink of the pool by resize(), which told the policy the pool has target frames and evicted the pages
+   * of the frames from newBufs to oldBufs - 1. The caller holds the latches of those frames.
+	 */
+  void retireFrames(const std::uint32_t target, const std::uint32_t newBufs, const std::uint32_t oldBufs);
+
+	/**
+   * Body of the background writer thread
+	 */
+  void writerLoop();
+
+	/**
+   * Writes back the dirty pages that are neither pinned nor referenced in the writerBatch frames the replacement
+   * policy sweeps next, so that eviction finds them clean
+	 */
+  void cleanAhead();
+
  public:
 	/**
    * Actual buffer pool from which frames are allocated
@@ -210,8 +650,16 @@ class BufMgr
 
 	/**
    * Constructor of BufMgr class
+	 *
+	 * @param bufs   	Number of frames in the buffer pool
+	 * @param numPartitions  Number of partitions the hash table is split into; more partitions let more threads
+	 *                       find pages at once
+	 * @param policy  Replacement policy, e.g. a TwoQueuePolicy to keep scans from flushing the pool. The buffer
+	 *                manager takes it over and deletes it. NULL uses a ClockPolicy.
+	 * @param poolOptions  How to allocate the frames, e.g. on huge pages or spread over the NUMA nodes
 	 */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs, std::uint32_t numPartitions = BUF_PARTITIONS, ReplacementPolicy* policy = NULL,
+         const PoolOptions& poolOptions = PoolOptions());
 	
 	/**
    * Destructor of BufMgr class
@@ -226,8 +674,49 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
 	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param pattern	SEQUENTIAL_ACCESS for scans reading every page once, so the replacement policy can evict the
+	 *                page early
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, const AccessPattern pattern = RANDOM_ACCESS);
+
+	/**
+	 * Reads the given page like readPage(File*, const PageId, Page*&) and returns a handle to it, which can be passed
+	 * back to unPinPage() and markDirty() without another hash table lookup.
+	 *
+	 * Pages of a file mapped with BlobFile::mapReadOnly() are not copied into the pool: the handle points into the
+	 * mapping, and the page must only be read.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param pattern	SEQUENTIAL_ACCESS for scans reading every page once, so the replacement policy can evict the
+	 *                page early
+	 * @return  Handle to the pinned page.
+	 */
+  PageHandle readPage(File* file, const PageId PageNo, const AccessPattern pattern = RANDOM_ACCESS);
+
+	/**
+	 * Reads the given page for a scan, like readPage(File*, const PageId, const AccessPattern) with
+	 * SEQUENTIAL_ACCESS, but into a frame of the ring if it is not in the pool yet.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param ring  	Ring of the scan
+	 * @return  Handle to the pinned page.
+	 */
+  PageHandle readPage(File* file, const PageId PageNo, BufferRing& ring);
+
+	/**
+	 * Pins the given page like readPage(File*, const PageId, const AccessPattern) if it is in the pool and fully read
+	 * in, and otherwise returns right away instead of reading it, e.g. so that the caller can ask for it with
+	 * prefetchPages() and get on with other work.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param handle  Set to the handle of the pinned page if it was in the pool
+	 * @param pattern	SEQUENTIAL_ACCESS for scans reading every page once
+	 * @return  True if the page was pinned, false if reading it would have waited for the disk.
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  bool tryReadPage(File* file, const PageId PageNo, PageHandle& handle, const AccessPattern pattern = RANDOM_ACCESS);
 
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
@@ -239,6 +728,25 @@ class BufMgr
 	 */
   void unPinPage(File* file, const PageId PageNo, const bool dirty);
 
+	/**
+	 * Unpin the page referred to by a handle. Goes straight to the frame recorded in the handle.
+	 *
+	 * @param handle  Handle returned by readPage() or allocPage()
+	 * @param dirty		True if the page to be unpinned needs to be marked dirty
+   * @throws  PageNotPinnedException If the frame no longer holds the page or the page is not pinned
+   * @throws  ReadOnlyFileException If dirty is set for a page of a mapped file
+	 */
+  void unPinPage(const PageHandle& handle, const bool dirty);
+
+	/**
+	 * Marks the page referred to by a handle dirty without unpinning it.
+	 *
+	 * @param handle  Handle returned by readPage() or allocPage()
+   * @throws  PageNotPinnedException If the frame no longer holds the page or the page is not pinned
+   * @throws  ReadOnlyFileException If the page belongs to a mapped file
+	 */
+  void markDirty(const PageHandle& handle);
+
 	/**
 	 * Allocates a new, empty page in the file and returns the Page object.
 	 * The newly allocated page is also assigned a frame in the buffer pool.
@@ -250,7 +758,28 @@ class BufMgr
   void allocPage(File* file, PageId &PageNo, Page*& page); 
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
+	 * Allocates a new, empty page like allocPage(File*, PageId&, Page*&) and returns a handle to it.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @return  Handle to the pinned page.
+	 */
+  PageHandle allocPage(File* file, PageId &PageNo);
+
+	/**
+	 * Allocates a new, empty page like allocPage(File*, PageId&), asking the file for a page close to nearPage on
+	 * disk (see File::allocatePageNear()), e.g. the left sibling of a new leaf.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @param nearPage  Page the new one should be close to, or Page::INVALID_NUMBER for no preference
+	 * @return  Handle to the pinned page.
+	 */
+  PageHandle allocPage(File* file, PageId &PageNo, const PageId nearPage);
+
+	/**
+	 * Writes out all dirty pages of the file to disk and syncs the file, so everything written to it through the
+	 * buffer manager is durable.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
 	 * Otherwise Error returned.
 	 *
@@ -260,6 +789,166 @@ class BufMgr
 	 */
   void flushFile(const File* file);
 
+	/**
+	 * Durability point for the whole pool. Writes out the pages of all dirty frames, leaving them in the pool,
+	 * and syncs every file that was written to since its last sync. Pages of evicted frames were written when
+	 * they were evicted, so only one sync per file is needed however many writes it got.
+	 *
+	 * The checkpoint is fuzzy: frames are latched CHECKPOINT_BATCH_SIZE at a time while other threads go on
+	 * reading and changing pages, and a page a RedoGroup is changing is written once the change is logged. With a
+	 * redo log, the next change logged to every page carries a full image of it, and once the files are synced
+	 * the log is told that recovery starts where it stood when the checkpoint began, so that restarting after a
+	 * crash only replays the changes logged since.
+	 *
+   * @throws IoErrorException If a page could not be written or a file could not be synced
+	 */
+  void checkpoint();
+
+	/**
+	 * Makes the buffer manager write pages ahead to a redo log: a dirty page is only written back, whether by
+	 * eviction, flushFile(), checkpoint() or the background writer, once the log is durable up to the last group
+	 * that changed it. Changes are logged with a RedoGroup. Replaces the log attached before, which is made durable
+	 * first, and NULL detaches it. The log must stay open while it is attached.
+	 *
+	 * @param log   Redo log, or NULL for none
+	 */
+  void setRedoLog(RedoLog* log);
+
+	/**
+   * Returns the redo log pages are written ahead to, NULL if none
+	 */
+  RedoLog* getRedoLog() const
+  {
+		return redoLog;
+  }
+
+	/**
+	 * Puts a second tier of cache behind the pool: pages evicted clean are offered to it, and a page that is not in
+	 * the pool is read from it before its file. The copy of a page in the cache is dropped whenever the page is
+	 * written back, and those of a file by flushFile(). NULL takes the cache away; a cache that was taken away missed
+	 * those writes and must not be attached again. The cache must stay alive while it is attached.
+	 *
+	 * @param cache   Secondary cache, or NULL for none
+	 */
+  void setSecondaryCache(SecondaryCache* cache);
+
+	/**
+   * Returns the secondary cache behind the pool, NULL if none
+	 */
+  SecondaryCache* getSecondaryCache() const
+  {
+		return secondaryCache;
+  }
+
+	/**
+	 * Inserts a record into a page of the file with room for it, through the buffer pool, like
+	 * PageFile::insertRecord() does directly. The insert is logged if the buffer manager has a redo log. Calls
+	 * are serialized, and the file must not be changed other than through the buffer manager meanwhile.
+	 *
+	 * @param file   	File object
+	 * @param record_data  Bytes that compose the record
+	 * @return  ID of the newly inserted record.
+	 * @throws  InsufficientSpaceException  If the record is too long for a page
+	 */
+  RecordId insertRecord(PageFile* file, const std::string& record_data);
+
+	/**
+	 * Asks for pages to be read into the buffer pool in the background, so that a later readPage() of them does
+	 * not wait for the disk. Reads the given page and then follows next from each page read until count pages
+	 * were read or next returns Page::INVALID_NUMBER. The first pages of the requests for a file that are waiting
+	 * together are read with one File::readPages(). Pages are left unpinned and count as read by a scan. This is only a hint: the request
+	 * is dropped if too many are waiting, and read errors end it silently.
+	 *
+	 * @param file   	File object; requests for it are dropped by flushFile()
+	 * @param PageNo  First page to read
+	 * @param count   Number of pages to read
+	 * @param next    Returns the page to read after a page that was read
+	 */
+  void prefetchPages(File* file, const PageId PageNo, const std::uint32_t count, NextPageFn next);
+
+	/**
+	 * Writes the file name and number of every page in the pool to a list, so that warmUp() can read the same
+	 * pages back in after a restart. The list is written next to the given name and then renamed over it, so a
+	 * crash leaves the old list whole.
+	 *
+	 * @param name  Name of the list
+   * @throws IoErrorException If the list could not be written
+	 */
+  void savePageList(const std::string& name);
+
+	/**
+	 * Saves the page list with savePageList() when the buffer manager is destroyed and, while the background writer
+	 * runs, every intervalMs milliseconds, so that the list stays close to the pool even after a crash. Pages of
+	 * files closed with flushFile() are no longer in the pool by then, so the writer's saves or a call to
+	 * savePageList() before the files are closed are what lists them.
+	 *
+	 * @param name  Name of the list, or the empty string to stop saving it
+	 * @param intervalMs  Time, in milliseconds, between two saves by the background writer; 0 for none
+	 */
+  void setPageListFile(const std::string& name, const std::uint32_t intervalMs = 0);
+
+	/**
+	 * Reads the pages of the given files named in a list saved by savePageList() back into the pool, e.g. on
+	 * startup before queries come in, so that they do not pay for cold misses. Pages are read in file and page
+	 * order, up to WARM_UP_BATCH_PAGES pages not in the pool at a time with one File::readPages(), and
+	 * are left unpinned. Stops once it read as many pages as the pool has frames. Pages the list names that no
+	 * longer exist are skipped.
+	 *
+	 * @param name  Name of the list; a missing list reads nothing
+	 * @param files  Open files whose pages are read; pages of other files in the list are skipped
+	 * @return  Number of pages read.
+	 */
+  std::size_t warmUp(const std::string& name, const std::vector<File*>& files);
+
+	/**
+	 * Starts a background writer thread. Every intervalMs milliseconds, and whenever eviction has to write a dirty
+	 * page itself, it writes back the dirty pages that are not pinned and not referenced recently among the
+	 * batchFrames frames the replacement policy looks at next, in page order, so that readPage() and allocPage()
+	 * usually find clean frames to evict and do not wait for writes. With a redo log, it also takes a checkpoint()
+	 * whenever the log grew by checkpointBytes since the last one, which bounds the time recovery takes. Does
+	 * nothing if the writer runs already.
+	 *
+	 * @param batchFrames   Number of frames to look at in each round
+	 * @param intervalMs    Time, in milliseconds, to sleep between rounds
+	 * @param checkpointBytes  Growth of the redo log, in bytes, between checkpoints; 0 for none
+	 */
+  void startWriter(const std::uint32_t batchFrames = WRITER_BATCH_SIZE,
+                   const std::uint32_t intervalMs = WRITER_INTERVAL_MS,
+                   const std::uint64_t checkpointBytes = CHECKPOINT_LOG_BYTES);
+
+	/**
+	 * Stops the background writer and waits for it to exit. Does nothing if it does not run.
+	 */
+  void stopWriter();
+
+	/**
+	 * Grows or shrinks the buffer pool while it is in use. Growing takes up to PoolOptions::maxFrames frames, which
+	 * are free right away. Shrinking evicts the pages in the frames dropped from the end of the pool, writing back
+	 * the dirty ones, and gives their memory back; it stops short at a frame whose page is pinned or that another thread
+	 * is working on, so it may take a few calls to get there under load.
+	 *
+	 * @param bufs   	Number of frames wanted, at least 1
+	 * @return  Number of frames the pool has now.
+   * @throws IoErrorException If a dirty page could not be written back; the pool keeps the frames not evicted yet
+	 */
+  std::uint32_t resize(std::uint32_t bufs);
+
+	/**
+   * Returns the number of frames in the buffer pool
+	 */
+  std::uint32_t size() const
+  {
+		return numBufs;
+  }
+
+	/**
+   * Returns the number of frames the buffer pool may grow to
+	 */
+  std::uint32_t capacity() const
+  {
+		return maxBufs;
+  }
+
 	/**
 	 * Delete page from file and also from buffer pool if present.
 	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
@@ -275,11 +964,19 @@ class BufMgr
   void  printSelf();
 
 	/**
-   * Get buffer pool usage statistics
+   * Returns the memory the frames of the pool live in, which tells what pages and NUMA nodes they got
+	 */
+  const PagePool & getPagePool() const
+  {
+		return *pagePool;
+  }
+
+	/**
+   * Get a snapshot of the buffer pool usage statistics
 	 */
-  BufStats & getBufStats()
+  BufStats getBufStats() const
   {
-		return bufStats;
+		return bufStats.snapshot();
   }
 
 	/**
@@ -291,4 +988,188 @@ class BufMgr
   }
 };
 
+/**
+* @brief Scoped pin on a page. Unpins the page when it goes out of scope, so every exit path of the caller,
+* including exceptions, gives the pin back.
+*/
+class PageGuard
+{
+ public:
+	/**
+	 * Takes over the pin held by a handle.
+	 *
+	 * @param bufMgr  Buffer manager the page was pinned through
+	 * @param handle  Handle returned by BufMgr::readPage() or BufMgr::allocPage()
+	 */
+  PageGuard(BufMgr* bufMgr, const PageHandle& handle)
+    : bufMgr(bufMgr), handle(handle), dirty(false)
+  {
+  }
+
+	/**
+   * Unpins the page unless the pin was released
+	 */
+  ~PageGuard()
+  {
+    if (handle.page != NULL)
+    {
+      try
+      {
+        bufMgr->unPinPage(handle, dirty);
+      }
+      catch (...)
+      {
+      }
+    }
+  }
+
+	/**
+   * Pinned in-memory page
+	 */
+  Page* page() const
+  {
+    return handle.page;
+  }
+
+	/**
+   * Page number of the pinned page
+	 */
+  PageId pageNo() const
+  {
+    return handle.pageNo;
+  }
+
+	/**
+   * Unpin the page dirty when the guard goes out of scope
+	 */
+  void markDirty()
+  {
+    dirty = true;
+  }
+
+	/**
+	 * Hands the pin back to the caller. The guard no longer unpins the page; a page marked dirty through the guard is
+	 * marked dirty in the buffer pool first.
+	 *
+	 * @return  Handle to the still pinned page.
+	 */
+  PageHandle release()
+  {
+    if (dirty)
+    {
+      bufMgr->markDirty(handle);
+    }
+    PageHandle released = handle;
+    handle.page = NULL;
+    return released;
+  }
+
+ private:
+  PageGuard(const PageGuard&);
+  PageGuard& operator=(const PageGuard&);
+
+	/**
+   * Buffer manager the page was pinned through
+	 */
+  BufMgr* bufMgr;
+
+	/**
+   * Handle to the pinned page
+	 */
+  PageHandle handle;
+
+	/**
+   * True if the page is unpinned dirty
+	 */
+  bool dirty;
+};
+
+
+/**
+* @brief Changes one operation makes to pages in the buffer pool, logged to the redo log of the buffer manager as one
+* group, e.g. an insert into a leaf together with the split it caused.
+*
+* Pages are tracked while pinned and before they change, and stay pinned until log() appends their changes, stamps
+* their frames with the LSN of the group and stops tracking them. The caller keeps other threads from changing a tracked page
+* until log() returns, and calls commit() once it let go of its latches. Without a redo log every call does nothing.
+*/
+class RedoGroup
+{
+ public:
+	/**
+	 * Starts an empty group.
+	 *
+	 * @param bufMgr  Buffer manager the pages are pinned through
+	 */
+  explicit RedoGroup(BufMgr* bufMgr);
+
+	/**
+   * Stops tracking the pages not logged
+	 */
+  ~RedoGroup();
+
+	/**
+	 * Tracks a page that is about to change, taking a copy of it to log the changes against. A page tracked
+	 * already is left as it is.
+	 *
+	 * @param handle  Handle of the pinned page
+	 */
+  void track(const PageHandle& handle);
+
+	/**
+	 * Tracks a newly allocated page, which is logged as a whole.
+	 *
+	 * @param handle  Handle of the pinned page
+	 */
+  void trackNew(const PageHandle& handle);
+
+	/**
+	 * Appends the changes to the tracked pages to the log as one group and stops tracking them.
+	 *
+	 * @return  LSN of the group, or 0 if nothing changed.
+	 */
+  Lsn log();
+
+	/**
+	 * Commits the groups logged, see RedoLog::commit().
+	 *
+   * @throws IoErrorException If the log could not be written
+	 */
+  void commit();
+
+ private:
+  RedoGroup(const RedoGroup&);
+  RedoGroup& operator=(const RedoGroup&);
+
+	/**
+   * A tracked page and the copy of it the changes are logged against
+	 */
+  struct TrackedPage
+  {
+    PageHandle handle;
+    bool isNew;
+    Page logged;
+  };
+
+	/**
+   * Buffer manager the pages are pinned through
+	 */
+  BufMgr* bufMgr;
+
+	/**
+   * Log of the buffer manager when the group started, NULL if none
+	 */
+  RedoLog* redoLog;
+
+	/**
+   * Tracked pages; a deque, so that tracking more does not copy the ones before
+	 */
+  std::deque<TrackedPage> pages;
+
+	/**
+   * LSN of the last group logged, 0 if none
+	 */
+  Lsn lastLsn;
+};
+
 }
@@ -0,0 +1,130 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "checksum.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define BADGERDB_CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define BADGERDB_CRC32C_ARM 1
+#endif
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Reflected CRC32C polynomial.
+ */
+const std::uint32_t POLYNOMIAL = 0x82F63B78;
+
+/**
+ * Table of the checksum of every byte value, for processors without CRC32C
+ * instructions.
+ */
+struct Crc32cTable {
+  std::uint32_t entries[256];
+
+  Crc32cTable() {
+    for (std::uint32_t byte = 0; byte < 256; byte++) {
+      std::uint32_t crc = byte;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc >> 1) ^ ((crc & 1) ? POLYNOMIAL : 0);
+      }
+      entries[byte] = crc;
+    }
+  }
+};
+
+std::uint32_t crc32cTable(const unsigned char* bytes, std::size_t length,
+                          std::uint32_t crc) {
+  static const Crc32cTable table;
+  for (std::size_t i = 0; i < length; i++) {
+    crc = table.entries[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(BADGERDB_CRC32C_X86)
+
+__attribute__((target("sse4.2")))
+std::uint32_t crc32cHardware(const unsigned char* bytes, std::size_t length,
+                             std::uint32_t crc) {
+#if defined(__x86_64__)
+  std::uint64_t crc64 = crc;
+  for (; length >= 8; bytes += 8, length -= 8) {
+    std::uint64_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  crc = static_cast<std::uint32_t>(crc64);
+#endif
+  for (; length >= 4; bytes += 4, length -= 4) {
+    std::uint32_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    crc = _mm_crc32_u32(crc, word);
+  }
+  for (; length > 0; bytes++, length--) {
+    crc = _mm_crc32_u8(crc, *bytes);
+  }
+  return crc;
+}
+
+bool hasHardwareCrc32c() {
+  return __builtin_cpu_supports("sse4.2");
+}
+
+#elif defined(BADGERDB_CRC32C_ARM)
+
+std::uint32_t crc32cHardware(const unsigned char* bytes, std::size_t length,
+                             std::uint32_t crc) {
+  for (; length >= 8; bytes += 8, length -= 8) {
+    std::uint64_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    crc = __crc32cd(crc, word);
+  }
+  for (; length > 0; bytes++, length--) {
+    crc = __crc32cb(crc, *bytes);
+  }
+  return crc;
+}
+
+bool hasHardwareCrc32c() {
+  // the instructions were required at compile time
+  return true;
+}
+
+#else
+
+std::uint32_t crc32cHardware(const unsigned char* bytes, std::size_t length,
+                             std::uint32_t crc) {
+  return crc32cTable(bytes, length, crc);
+}
+
+bool hasHardwareCrc32c() {
+  return false;
+}
+
+#endif
+
+}
+
+std::uint32_t crc32c(const void* data, const std::size_t length,
+                     const std::uint32_t crc) {
+  static const bool hardware = hasHardwareCrc32c();
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  if (hardware) {
+    return ~crc32cHardware(bytes, length, ~crc);
+  }
+  return ~crc32cTable(bytes, length, ~crc);
+}
+
+}
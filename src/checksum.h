@@ -0,0 +1,31 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace badgerdb {
+
+/**
+ * Returns the CRC32C (Castagnoli) checksum of the given bytes. Uses the SSE4.2
+ * or ARMv8 CRC32C instructions when the processor has them and a table
+ * otherwise; all three give the same result.
+ *
+ * Checksums can be computed piecewise: passing the checksum of the bytes
+ * before <data> as <crc> gives the checksum of all of them.
+ *
+ * @param data    First byte to checksum.
+ * @param length  Number of bytes.
+ * @param crc     Checksum of the bytes preceding <data>, or 0 for none.
+ * @return  Checksum of the preceding bytes followed by <data>.
+ */
+std::uint32_t crc32c(const void* data, const std::size_t length,
+                     const std::uint32_t crc = 0);
+
+}
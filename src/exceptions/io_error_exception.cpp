@@ -0,0 +1,24 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "io_error_exception.h"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+IoErrorException::IoErrorException(const std::string& operation,
+                                   const int error_code)
+    : BadgerDbException(""), error_code_(error_code) {
+  std::stringstream ss;
+  ss << "I/O error during " << operation << ": " << std::strerror(error_code_);
+  message_.assign(ss.str());
+}
+
+}
@@ -0,0 +1,42 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when the operating system fails a read
+ *        or write of a file.
+ */
+class IoErrorException : public BadgerDbException {
+ public:
+  /**
+   * Constructs an I/O error exception for the given failed operation.
+   *
+   * @param operation   Name of the operation that failed, e.g. "read".
+   * @param error_code  errno reported for the operation.
+   */
+  IoErrorException(const std::string& operation, const int error_code);
+
+  /**
+   * Returns the errno reported for the operation that caused this exception.
+   */
+  virtual int error_code() const { return error_code_; }
+
+ protected:
+  /**
+   * errno reported for the operation which caused this exception.
+   */
+  const int error_code_;
+};
+
+}
@@ -0,0 +1,442 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+#include "exceptions/file_not_found_exception.h"
+
+namespace badgerdb
+{
+
+  /**
+   * @brief Default number of entries ExternalSort keeps in memory before spilling a sorted run.
+   */
+  const std::size_t SORT_RUN_SIZE = 1 << 16;
+
+  /**
+   * @brief Default number of runs ExternalSort merges at once. Each run being merged keeps one page pinned.
+   */
+  const std::size_t SORT_MAX_FAN_IN = 16;
+
+  /**
+   * @brief Sorts a stream of fixed-size entries that may not fit in memory.
+   *
+   * Entries are collected with add() into an in-memory run of bounded size. Whenever the run fills up it is
+   * sorted and spilled to consecutive pages of a temporary BlobFile through the buffer manager. After finish(),
+   * next() returns the entries in ascending order by doing a k-way merge over the spilled runs, reading one
+   * page of each run at a time. If there are more runs than the maximum fan-in, runs are first merged into
+   * longer runs until a single merge pass suffices. If everything fits in one run, nothing is written to disk.
+   *
+   * T must be trivially copyable and ordered by operator<.
+   *
+   * @warning This class is not threadsafe.
+   */
+  template <class T>
+  class ExternalSort
+  {
+  public:
+    /**
+     * Constructs a sorter. The temporary file is only created once the first run is spilled.
+     *
+     * @param bufMgrIn    Buffer Manager Instance used to read and write run pages.
+     * @param tempName    Name of the temporary file holding the sorted runs. Any existing file of that name is removed.
+     * @param runSize     Maximum number of entries kept in memory.
+     * @param maxFanIn    Maximum number of runs merged at once.
+     */
+    ExternalSort(BufMgr *bufMgrIn, const std::string &tempName,
+                 const std::size_t runSize = SORT_RUN_SIZE, const std::size_t maxFanIn = SORT_MAX_FAN_IN)
+        : bufMgr(bufMgrIn), tempName(tempName), runSize(std::max<std::size_t>(runSize, 1)),
+          maxFanIn(std::max<std::size_t>(maxFanIn, 2)), file(NULL), memPos(0)
+    {
+      buffer.reserve(this->runSize);
+    }
+
+    /**
+     * Destructor. Unpins any run pages still pinned and removes the temporary file.
+     */
+    ~ExternalSort()
+    {
+      for (std::size_t i = 0; i < cursors.size(); i++)
+      {
+        releaseCursor(cursors[i]);
+      }
+      if (file != NULL)
+      {
+        bufMgr->flushFile(file);
+        delete file;
+        File::remove(tempName);
+      }
+    }
+
+    /**
+     * Adds an entry to be sorted. Spills the in-memory run to disk when it is full.
+     *
+     * @param entry   Entry to add.
+     */
+    void add(const T &entry)
+    {
+      buffer.push_back(entry);
+      if (buffer.size() == runSize)
+      {
+        spillRun();
+      }
+    }
+
+    /**
+     * Ends the input. Sorts the last run and gets ready to return entries through next().
+     */
+    void finish()
+    {
+      if (runs.empty())
+      {
+        // everything fit in memory, never touch the disk
+        std::sort(buffer.begin(), buffer.end());
+      }
+      else
+      {
+        if (!buffer.empty())
+        {
+          spillRun();
+        }
+        // merge runs into longer runs until one merge pass over all of them is within the fan-in
+        while (runs.size() > maxFanIn)
+        {
+          std::vector<Run> group(runs.begin(), runs.begin() + maxFanIn);
+          runs.erase(runs.begin(), runs.begin() + maxFanIn);
+          openMerge(group);
+          Run merged = beginRun();
+          T entry;
+          while (mergeNext(entry))
+          {
+            appendToRun(merged, entry);
+          }
+          endRun();
+          runs.push_back(merged);
+        }
+        openMerge(runs);
+      }
+    }
+
+    /**
+     * Fetches the next entry in ascending order.
+     *
+     * @param out   Next entry is returned in this.
+     * @return  False if all entries have been returned.
+     */
+    bool next(T &out)
+    {
+      if (runs.empty())
+      {
+        if (memPos == buffer.size())
+        {
+          return false;
+        }
+        out = buffer[memPos++];
+        return true;
+      }
+      return mergeNext(out);
+    }
+
+  private:
+    /**
+     * @brief A sorted run stored in consecutive pages of the temporary file.
+     */
+    struct Run
+    {
+      /**
+       * First page of the run.
+       */
+      PageId firstPage;
+
+      /**
+       * Number of entries in the run.
+       */
+      std::size_t numEntries;
+    };
+
+    /**
+     * @brief Read position inside a run during a merge. Keeps the page being read pinned.
+     */
+    struct RunCursor
+    {
+      /**
+       * Page currently being read, Page::INVALID_NUMBER if none is pinned.
+       */
+      PageId pageNo;
+
+      /**
+       * Pinned page being read.
+       */
+      Page *page;
+
+      /**
+       * Index of the next entry to return from the pinned page.
+       */
+      std::size_t posInPage;
+
+      /**
+       * Entries of the run not returned yet.
+       */
+      std::size_t remaining;
+    };
+
+    /**
+     * @brief Heap element of the k-way merge: an entry and the cursor it came from.
+     */
+    struct HeapEntry
+    {
+      T entry;
+      std::size_t cursor;
+
+      bool operator<(const HeapEntry &rhs) const
+      {
+        // std::priority_queue is a max-heap, invert the order to pop the smallest entry first
+        return rhs.entry < entry;
+      }
+    };
+
+    /**
+     * Number of entries stored in each run page.
+     */
+    static std::size_t entriesPerPage()
+    {
+      return BlobFile::DATA_SIZE / sizeof(T);
+    }
+
+    /**
+     * Sorts the in-memory entries and writes them out as a new run.
+     */
+    void spillRun()
+    {
+      std::sort(buffer.begin(), buffer.end());
+      Run run = beginRun();
+      for (typename std::vector<T>::const_iterator it = buffer.begin(); it != buffer.end(); ++it)
+      {
+        appendToRun(run, *it);
+      }
+      endRun();
+      runs.push_back(run);
+      buffer.clear();
+    }
+
+    /**
+     * Starts writing a new run at the end of the temporary file, creating the file if needed.
+     */
+    Run beginRun()
+    {
+      if (file == NULL)
+      {
+        try
+        {
+          File::remove(tempName);
+        }
+        catch (FileNotFoundException &e)
+        {
+        }
+        file = new BlobFile(tempName, true);
+      }
+      Run run;
+      run.firstPage = Page::INVALID_NUMBER;
+      run.numEntries = 0;
+      writePageNo = Page::INVALID_NUMBER;
+      writePage = NULL;
+      return run;
+    }
+
+    /**
+     * Appends an entry to the run being written, allocating a new page when the current one is full.
+     */
+    void appendToRun(Run &run, const T &entry)
+    {
+      const std::size_t posInPage = run.numEntries % entriesPerPage();
+      if (posInPage == 0)
+      {
+        if (writePage != NULL)
+        {
+          bufMgr->unPinPage(file, writePageNo, true);
+        }
+        bufMgr->allocPage(file, writePageNo, writePage);
+        if (run.firstPage == Page::INVALID_NUMBER)
+        {
+          run.firstPage = writePageNo;
+        }
+      }
+      std::memcpy(reinterpret_cast<char *>(writePage) + posInPage * sizeof(T), &entry, sizeof(T));
+      run.numEntries++;
+    }
+
+    /**
+     * Ends the run being written and unpins its last page.
+     */
+    void endRun()
+    {
+      if (writePage != NULL)
+      {
+        bufMgr->unPinPage(file, writePageNo, true);
+        writePage = NULL;
+      }
+    }
+
+    /**
+     * Sets up a k-way merge over the given runs, pinning the first page of each.
+     */
+    void openMerge(const std::vector<Run> &group)
+    {
+      for (std::size_t i = 0; i < cursors.size(); i++)
+      {
+        releaseCursor(cursors[i]);
+      }
+      cursors.clear();
+      heap = std::priority_queue<HeapEntry>();
+      for (std::size_t i = 0; i < group.size(); i++)
+      {
+        RunCursor cursor;
+        cursor.pageNo = group[i].firstPage;
+        cursor.page = NULL;
+        cursor.posInPage = 0;
+        cursor.remaining = group[i].numEntries;
+        if (cursor.remaining > 0)
+        {
+          bufMgr->readPage(file, cursor.pageNo, cursor.page);
+        }
+        else
+        {
+          cursor.pageNo = Page::INVALID_NUMBER;
+        }
+        cursors.push_back(cursor);
+        pushFromCursor(i);
+      }
+    }
+
+    /**
+     * Moves the next entry of the given cursor, if any, onto the merge heap.
+     * Steps to the next page of the run when the pinned page is used up.
+     */
+    void pushFromCursor(const std::size_t index)
+    {
+      RunCursor &cursor = cursors[index];
+      if (cursor.remaining == 0)
+      {
+        releaseCursor(cursor);
+        return;
+      }
+      if (cursor.posInPage == entriesPerPage())
+      {
+        bufMgr->unPinPage(file, cursor.pageNo, false);
+        cursor.pageNo++;
+        bufMgr->readPage(file, cursor.pageNo, cursor.page);
+        cursor.posInPage = 0;
+      }
+      HeapEntry top;
+      std::memcpy(&top.entry, reinterpret_cast<const char *>(cursor.page) + cursor.posInPage * sizeof(T), sizeof(T));
+      top.cursor = index;
+      cursor.posInPage++;
+      cursor.remaining--;
+      heap.push(top);
+    }
+
+    /**
+     * Pops the smallest entry of the current merge.
+     */
+    bool mergeNext(T &out)
+    {
+      if (heap.empty())
+      {
+        return false;
+      }
+      HeapEntry top = heap.top();
+      heap.pop();
+      out = top.entry;
+      pushFromCursor(top.cursor);
+      return true;
+    }
+
+    /**
+     * Unpins the page held by a cursor, if any.
+     */
+    void releaseCursor(RunCursor &cursor)
+    {
+      if (cursor.pageNo != Page::INVALID_NUMBER)
+      {
+        bufMgr->unPinPage(file, cursor.pageNo, false);
+        cursor.pageNo = Page::INVALID_NUMBER;
+        cursor.page = NULL;
+      }
+    }
+
+    /**
+     * Buffer Manager Instance.
+     */
+    BufMgr *bufMgr;
+
+    /**
+     * Name of the temporary file holding the runs.
+     */
+    std::string tempName;
+
+    /**
+     * Maximum number of entries kept in memory.
+     */
+    std::size_t runSize;
+
+    /**
+     * Maximum number of runs merged at once.
+     */
+    std::size_t maxFanIn;
+
+    /**
+     * Temporary file holding the runs, NULL until the first run is spilled.
+     */
+    BlobFile *file;
+
+    /**
+     * Entries collected in memory.
+     */
+    std::vector<T> buffer;
+
+    /**
+     * Position of the next entry to return when everything fit in memory.
+     */
+    std::size_t memPos;
+
+    /**
+     * Runs spilled to disk and not merged yet.
+     */
+    std::vector<Run> runs;
+
+    /**
+     * Page of the run currently being written.
+     */
+    PageId writePageNo;
+
+    /**
+     * Pinned page of the run currently being written.
+     */
+    Page *writePage;
+
+    /**
+     * Read positions of the runs being merged.
+     */
+    std::vector<RunCursor> cursors;
+
+    /**
+     * Heads of the runs being merged.
+     */
+    std::priority_queue<HeapEntry> heap;
+  };
+
+}
@@ -13,18 +13,192 @@
 #include <string>
 #include <cstdio>
 #include <cassert>
-
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <iterator>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "checksum.h"
+#include "page_compression.h"
+#include "trace.h"
+#include "exceptions/corrupt_page_exception.h"
 #include "exceptions/file_exists_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
+#include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_page_exception.h"
+#include "exceptions/io_error_exception.h"
+#include "exceptions/read_only_file_exception.h"
 #include "file_iterator.h"
 #include "page.h"
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
-File::CountMap File::open_counts_;
+namespace {
+
+/**
+ * Keeps the descriptor of a file stream open for the lifetime of the object.
+ */
+class DescriptorPin {
+ public:
+  explicit DescriptorPin(FileStream& stream)
+      : stream_(stream), fd_(stream.pinDescriptor()) {}
+
+  ~DescriptorPin() { stream_.unpinDescriptor(); }
+
+  int fd() const { return fd_; }
+
+ private:
+  DescriptorPin(const DescriptorPin&);
+  DescriptorPin& operator=(const DescriptorPin&);
+
+  FileStream& stream_;
+  const int fd_;
+};
+
+/**
+ * Start of the place of a page stored compressed, followed by its compressed
+ * bytes. The rest of the place is a hole in the file.
+ */
+struct CompressedFrame {
+  std::uint32_t magic;
+  /** Number of compressed bytes. */
+  std::uint32_t length;
+  /** CRC32C of the compressed bytes. */
+  std::uint32_t checksum;
+};
+
+static_assert(sizeof(Page) == Page::SIZE,
+              "Pages are compressed as they are laid out on disk.");
+
+// Neither a page header nor a node of an index starts with these bytes.
+const std::uint32_t COMPRESSED_MAGIC = 0x7a504442;
+
+bool holdsCompressedPage(const void* image) {
+  std::uint32_t magic;
+  std::memcpy(&magic, image, sizeof(magic));
+  return magic == COMPRESSED_MAGIC;
+}
+
+}
+
+std::mutex FileStream::descriptorLatch;
+std::list<FileStream*> FileStream::idleDescriptors;
+std::size_t FileStream::openDescriptors = 0;
+std::size_t FileStream::descriptorLimit =
+    FileStream::DEFAULT_MAX_OPEN_DESCRIPTORS;
+
+FileStream::FileStream(const std::string& path, const int fd, const int flags)
+    : path(path), fd(fd), openFlags(flags & ~(O_CREAT | O_EXCL | O_TRUNC)),
+      backend(IoBackend::defaultBackend()), checksums(true),
+      compression(false), mapping(NULL),
+      mappedLength(0), syncTicket(0), syncedTicket(0), syncing(false),
+      pageStatesLoaded(false), freePagesLoaded(false), pins(0), closeError(0) {
+  struct stat status;
+  if (fstat(fd, &status) != 0) {
+    const int error = errno;
+    ::close(fd);
+    throw IoErrorException("stat", error);
+  }
+  device = status.st_dev;
+  inode = status.st_ino;
+  std::lock_guard<std::mutex> guard(descriptorLatch);
+  closeIdleDescriptors(descriptorLimit);
+  ++openDescriptors;
+  idleDescriptors.push_front(this);
+  idlePosition = idleDescriptors.begin();
+}
+
+FileStream::~FileStream() {
+  if (mapping != NULL) {
+    munmap(mapping, mappedLength);
+  }
+  std::lock_guard<std::mutex> guard(descriptorLatch);
+  if (fd >= 0) {
+    idleDescriptors.erase(idlePosition);
+    --openDescriptors;
+    ::close(fd);
+  }
+}
+
+int FileStream::pinDescriptor() {
+  std::lock_guard<std::mutex> guard(descriptorLatch);
+  if (fd < 0) {
+    closeIdleDescriptors(descriptorLimit);
+    const int reopened = ::open(path.c_str(), openFlags);
+    if (reopened < 0) {
+      throw IoErrorException("open", errno);
+    }
+    // the file may have been renamed, or removed and created again, since
+    // its descriptor was closed
+    struct stat status;
+    if (fstat(reopened, &status) != 0 || status.st_dev != device ||
+        status.st_ino != inode) {
+      ::close(reopened);
+      throw IoErrorException("open", ESTALE);
+    }
+    fd = reopened;
+    ++openDescriptors;
+  } else if (pins == 0) {
+    idleDescriptors.erase(idlePosition);
+  }
+  ++pins;
+  return fd;
+}
+
+void FileStream::unpinDescriptor() {
+  std::lock_guard<std::mutex> guard(descriptorLatch);
+  assert(pins > 0);
+  if (--pins == 0) {
+    idleDescriptors.push_front(this);
+    idlePosition = idleDescriptors.begin();
+  }
+}
+
+int FileStream::takeCloseError() {
+  std::lock_guard<std::mutex> guard(descriptorLatch);
+  const int error = closeError;
+  closeError = 0;
+  return error;
+}
+
+std::size_t FileStream::maxOpenDescriptors() {
+  std::lock_guard<std::mutex> guard(descriptorLatch);
+  return descriptorLimit;
+}
+
+void FileStream::setMaxOpenDescriptors(const std::size_t count) {
+  std::lock_guard<std::mutex> guard(descriptorLatch);
+  descriptorLimit = std::max<std::size_t>(count, 1);
+  closeIdleDescriptors(descriptorLimit + 1);
+}
+
+void FileStream::closeIdleDescriptors(const std::size_t limit) {
+  while (openDescriptors >= limit && !idleDescriptors.empty()) {
+    FileStream* victim = idleDescriptors.back();
+    idleDescriptors.pop_back();
+    if (::close(victim->fd) != 0) {
+      victim->closeError = errno;
+    }
+    victim->fd = -1;
+    --openDescriptors;
+  }
+}
+
+File::RegistryShard File::registry_[File::REGISTRY_SHARDS];
+std::atomic<std::uint64_t> File::next_id_(1);
+
+File::RegistryShard& File::registryShard(const std::string& filename) {
+  return registry_[std::hash<std::string>()(filename) % REGISTRY_SHARDS];
+}
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -40,7 +214,9 @@ bool File::isOpen(const std::string& filename) {
   if (!exists(filename)) {
     return false;
   }
-  return open_counts_.find(filename) != open_counts_.end();
+  RegistryShard& shard = registryShard(filename);
+  std::lock_guard<std::mutex> guard(shard.latch);
+  return shard.files.find(filename) != shard.files.end();
 }
 
 bool File::exists(const std::string& filename) {
@@ -64,24 +240,39 @@ PageId File::getFirstPageNo() {
   return header.first_used_page;
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
+File::File(const std::string& name, const bool create_new)
+    : filename_(name), id_(next_id_.fetch_add(1)) {
   openIfNeeded(create_new);
 
   if (create_new) {
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+                         0 /* num_free_pages */, 0 /* first_free_page */,
+                         0 /* first_fsm_page */, 0 /* flags */,
+                         static_cast<std::uint32_t>(Page::SIZE)};
     writeHeader(header);
+    return;
+  }
+  const FileHeader header = readHeader();
+  if (header.page_size != Page::SIZE) {
+    // the pages of the file are not where this build looks for them
+    close();
+    throw CorruptPageException(0 /* header */, filename_);
+  }
+  if (header.flags & FileHeader::COMPRESSED_PAGES) {
+    stream_->compression = true;
   }
 }
 
 void File::openIfNeeded(const bool create_new) {
-  if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
-    ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+  RegistryShard& shard = registryShard(filename_);
+  std::lock_guard<std::mutex> guard(shard.latch);
+  const auto entry = shard.files.find(filename_);
+  if (entry != shard.files.end()) {	//exists an entry already
+    ++entry->second.count;
+    stream_ = entry->second.stream;
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
+    int flags = O_RDWR;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
@@ -89,48 +280,266 @@ void File::openIfNeeded(const bool create_new) {
         throw FileExistsException(filename_);
       }
       // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
+      flags |= O_CREAT | O_TRUNC;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
-    open_counts_[filename_] = 1;
+    const int fd = ::open(filename_.c_str(), flags, 0644);
+    if (fd < 0) {
+      throw FileNotFoundException(filename_);
+    }
+    stream_.reset(new FileStream(filename_, fd, flags));
+    OpenFile& opened = shard.files[filename_];
+    opened.stream = stream_;
+    opened.count = 1;
   }
 }
 
 void File::close() {
-	if(open_counts_[filename_] > 0)
-  	--open_counts_[filename_];
-
-  stream_.reset();
-	assert(open_counts_[filename_] >= 0);
-
-  if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
-    open_counts_.erase(filename_);
+  RegistryShard& shard = registryShard(filename_);
+  std::shared_ptr<FileStream> last;
+  std::lock_guard<std::mutex> guard(shard.latch);
+  const auto entry = shard.files.find(filename_);
+  if (entry == shard.files.end()) {
+    stream_.reset();
+    return;
+  }
+  assert(entry->second.count > 0);
+  if (--entry->second.count == 0) {
+    // the stream is destroyed once the latch is released
+    last = entry->second.stream;
+    shard.files.erase(entry);
   }
+  stream_.reset();
 }
 
 FileHeader File::readHeader() const {
   FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+  readAt(0 /* pos */, reinterpret_cast<char*>(&header), sizeof(FileHeader));
   return header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  writeAt(0 /* pos */, reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+}
+
+void File::readAt(const std::uint64_t position, char* buffer,
+                  const std::size_t length) const {
+  DescriptorPin pin(*stream_);
+  IoRequest request = {pin.fd(), false /* write */, position, buffer,
+                       length, 0 /* transferred */};
+  stream_->backend->execute(&request, 1);
+}
+
+void File::writeAt(const std::uint64_t position, const char* buffer,
+                   const std::size_t length) {
+  DescriptorPin pin(*stream_);
+  IoRequest request = {pin.fd(), true /* write */, position,
+                       const_cast<char*>(buffer), length, 0 /* transferred */};
+  stream_->backend->execute(&request, 1);
 }
 
+void File::sync() const {
+  FileStream& stream = *stream_;
+  std::unique_lock<std::mutex> guard(stream.syncLatch);
+  const std::uint64_t ticket = ++stream.syncTicket;
+  while (stream.syncedTicket < ticket) {
+    if (stream.syncing) {
+      stream.syncDone.wait(guard);
+      continue;
+    }
+    // every ticket taken so far belongs to a write that already finished, so
+    // one fdatasync covers them all
+    const std::uint64_t covered = stream.syncTicket;
+    stream.syncing = true;
+    guard.unlock();
+    int rc;
+    int error;
+    {
+      DescriptorPin pin(stream);
+      rc = fdatasync(pin.fd());
+      error = errno;
+    }
+    guard.lock();
+    stream.syncing = false;
+    stream.syncDone.notify_all();
+    if (rc != 0) {
+      throw IoErrorException("sync", error);
+    }
+    const int closeError = stream.takeCloseError();
+    if (closeError != 0) {
+      throw IoErrorException("close", closeError);
+    }
+    stream.syncedTicket = covered;
+  }
+}
+
+Page* File::mappedPage(const PageId page_number) const {
+  if (stream_->mapping == NULL) {
+    return NULL;
+  }
+  const std::uint64_t position = pagePosition(page_number);
+  if (page_number == 0 || position + Page::SIZE > stream_->mappedLength) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  return reinterpret_cast<Page*>(stream_->mapping + position);
+}
+
+void File::transferPages(const bool write, const PageId* page_numbers,
+                         const std::size_t count, const iovec* vectors,
+                         const std::size_t vectors_per_page) const {
+  if (count == 0) {
+    return;
+  }
+  DescriptorPin pin(*stream_);
+  const std::size_t run_limit =
+      std::max<std::size_t>(IOV_MAX / vectors_per_page, 1);
+  std::vector<IoRequest> requests;
+  std::vector<std::size_t> firsts;
+  for (std::size_t first = 0; first < count;) {
+    std::size_t last = first + 1;
+    while (last < count && last - first < run_limit &&
+           page_numbers[last] == page_numbers[last - 1] + 1) {
+      ++last;
+    }
+    const iovec* run = vectors + first * vectors_per_page;
+    const std::size_t run_vectors = (last - first) * vectors_per_page;
+    std::size_t length = 0;
+    for (std::size_t i = 0; i < run_vectors; i++) {
+      length += run[i].iov_len;
+    }
+    IoRequest request = {pin.fd(), write, pagePosition(page_numbers[first]),
+                         NULL, length, 0 /* transferred */, run,
+                         (int) run_vectors};
+    requests.push_back(request);
+    firsts.push_back(first);
+    first = last;
+  }
+  stream_->backend->execute(&requests[0], requests.size());
+
+  // a read that stops at the end of the file leaves the pages past it unread
+  for (std::size_t i = 0; !write && i < requests.size(); i++) {
+    if (requests[i].transferred < requests[i].length) {
+      throw InvalidPageException(
+          page_numbers[firsts[i] + requests[i].transferred / Page::SIZE],
+          filename_);
+    }
+  }
+}
+
+void File::setCompression(const bool enabled) {
+  if (enabled) {
+    std::lock_guard<std::mutex> guard(stream_->allocationLatch);
+    FileHeader header = readHeader();
+    if (!(header.flags & FileHeader::COMPRESSED_PAGES)) {
+      header.flags |= FileHeader::COMPRESSED_PAGES;
+      writeHeader(header);
+    }
+  }
+  stream_->compression = enabled;
+}
+
+std::uint64_t File::diskUsage() const {
+  DescriptorPin pin(*stream_);
+  struct stat status;
+  if (fstat(pin.fd(), &status) != 0) {
+    throw IoErrorException("stat", errno);
+  }
+  return static_cast<std::uint64_t>(status.st_blocks) * 512;
+}
+
+void File::writeCompressed(const PageId* page_numbers,
+                           const char* const* images, const std::size_t count) {
+  char frame[Page::SIZE];
+  for (std::size_t i = 0; i < count; i++) {
+    const std::uint64_t position = pagePosition(page_numbers[i]);
+    const std::uint64_t end = position + Page::SIZE;
+    // a block is freed only if the compressed page ends a whole block before
+    // the last block boundary inside its place
+    const std::uint64_t boundary = end / COMPRESSION_BLOCK * COMPRESSION_BLOCK;
+    std::size_t length = 0;
+    if (stream_->compression &&
+        boundary >= position + COMPRESSION_BLOCK + sizeof(CompressedFrame)) {
+      const std::size_t room = boundary - COMPRESSION_BLOCK - position;
+      length = compressBlock(images[i], Page::SIZE,
+                             frame + sizeof(CompressedFrame),
+                             room - sizeof(CompressedFrame));
+    }
+    if (length == 0) {
+      writeAt(position, images[i], Page::SIZE);
+      continue;
+    }
+
+    CompressedFrame header = {COMPRESSED_MAGIC,
+                              static_cast<std::uint32_t>(length),
+                              crc32c(frame + sizeof(CompressedFrame), length)};
+    std::memcpy(frame, &header, sizeof(header));
+    const std::size_t frame_length = sizeof(CompressedFrame) + length;
+    writeAt(position, frame, frame_length);
+    // punching keeps the length of the file, so its last byte is written to
+    // make the file cover the whole place of a new page
+    const char zero = 0;
+    writeAt(end - 1, &zero, 1);
+
+    DescriptorPin pin(*stream_);
+    if (fallocate(pin.fd(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  position + frame_length, Page::SIZE - frame_length) != 0) {
+      if (errno != EOPNOTSUPP && errno != ENOSYS) {
+        throw IoErrorException("fallocate", errno);
+      }
+      // the page stays readable, but compressing saves nothing here
+      stream_->compression = false;
+    }
+  }
+}
 
+bool File::inflatePage(const PageId page_number, char* image) const {
+  CompressedFrame header;
+  std::memcpy(&header, image, sizeof(header));
+  if (header.magic != COMPRESSED_MAGIC || header.length == 0 ||
+      header.length > Page::SIZE - sizeof(CompressedFrame)) {
+    return false;
+  }
+  const char* compressed = image + sizeof(CompressedFrame);
+  if (stream_->checksums && crc32c(compressed, header.length) != header.checksum) {
+    throw CorruptPageException(page_number, filename_);
+  }
+  char page[Page::SIZE];
+  if (!decompressBlock(compressed, header.length, page, Page::SIZE)) {
+    if (stream_->checksums) {
+      throw CorruptPageException(page_number, filename_);
+    }
+    return false;
+  }
+  std::memcpy(image, page, Page::SIZE);
+  return true;
+}
 
+/**
+ * Checksum of a PageFile page with the given header and data, never zero so
+ * that it cannot be taken for a page written without one.
+ */
+static std::uint32_t pageChecksum(const PageHeader& header, const char* data) {
+  PageHeader unsummed = header;
+  unsummed.checksum = 0;
+  const std::uint32_t crc = crc32c(
+      data, Page::DATA_SIZE, crc32c(&unsummed, sizeof(PageHeader)));
+  return crc != 0 ? crc : 1;
+}
 
+/**
+ * Throws CorruptPageException if the PageFile page with the given header and
+ * data has a checksum that does not match it.
+ */
+static void verifyPage(const PageId page_number, const PageHeader& header,
+                       const char* data, const std::string& filename) {
+  if (header.checksum != 0 && header.checksum != pageChecksum(header, data)) {
+    throw CorruptPageException(page_number, filename);
+  }
+}
 
 PageFile PageFile::create(const std::string& filename) {
   return PageFile(filename, true /* create_new */);
@@ -143,6 +552,15 @@ PageFile PageFile::open(const std::string& filename) {
 PageFile::PageFile(const std::string& name, const bool create_new)
 : File(name, create_new)
 {
+  FileHeader header = readHeader();
+  if (create_new) {
+    header.flags |= FileHeader::ALLOCATION_MAP;
+    writeHeader(header);
+  } else if (!(header.flags & FileHeader::ALLOCATION_MAP)) {
+    // page 1 of an older file holds records, not the first map page; the
+    // destructor of File closes the file again
+    throw CorruptPageException(0 /* header */, filename_);
+  }
 }
 
 PageFile::~PageFile() {
@@ -158,150 +576,481 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
   // same file.
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
+  id_ = next_id_.fetch_add(1);
   openIfNeeded(false /* create_new */);
   return *this;
 }
 
 Page PageFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
-  if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
-    new_page.set_page_number(header.first_free_page);
-		new_page_number = new_page.page_number();
-    header.first_free_page = new_page.next_page_number();
-    --header.num_free_pages;
+  allocatePageInto(new_page_number, &new_page);
+  return new_page;
+}
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
+void PageFile::allocatePageInto(PageId &new_page_number, Page* page) {
+  FileHeader header = readHeader();
+  page->initialize();
+  new_page_number = takePage(header, USED_PAGE);
+  page->set_page_number(new_page_number);
+  if (header.first_used_page == Page::INVALID_NUMBER ||
+      header.first_used_page > new_page_number) {
+    header.first_used_page = new_page_number;
+  }
+  writePage(new_page_number, page->header_, *page);
+  writeHeader(header);
+}
+
+PageId PageFile::reservePage(Page* page) {
+  FileHeader header = readHeader();
+  page->initialize();
+  const PageId page_number = takePage(header, RESERVED_PAGE);
+  writePage(page_number, page->header_, *page);
+  writeHeader(header);
+  return page_number;
+}
+
+const std::size_t PageFile::MAP_BITS_PER_PAGE;
+const std::size_t PageFile::MAP_SPAN;
+
+/**
+ * Position of the allocation map page recording the given page.
+ */
+static PageId mapPageOf(const PageId page_number) {
+  return (page_number - 1) / PageFile::MAP_SPAN * PageFile::MAP_SPAN + 1;
+}
+
+void PageFile::loadPageStates(const PageId num_pages) const {
+  std::vector<std::uint8_t>& states = stream_->pageStates;
+  if (stream_->pageStatesLoaded) {
+    if (states.size() < num_pages) {
+      states.resize(num_pages, FREE_PAGE);
     }
+    return;
+  }
+  states.assign(num_pages, FREE_PAGE);
+  std::vector<unsigned char> bits(Page::DATA_SIZE);
+  for (PageId map_page = 1; map_page < num_pages; map_page += MAP_SPAN) {
+    readAt(pagePosition(map_page) + sizeof(PageHeader),
+           reinterpret_cast<char*>(&bits[0]), Page::DATA_SIZE);
+    for (std::size_t i = 0; i < MAP_SPAN && map_page + i < num_pages; i++) {
+      const std::size_t bit = i * MAP_BITS_PER_PAGE;
+      states[map_page + i] = (bits[bit / 8] >> (bit % 8)) & 3;
+    }
+  }
+  stream_->pageStatesLoaded = true;
+}
 
-    assert((header.num_free_pages == 0) ==
-           (header.first_free_page == Page::INVALID_NUMBER));
+void PageFile::storePageState(const PageId page_number,
+                              const PageState state) {
+  std::vector<std::uint8_t>& states = stream_->pageStates;
+  if (states.size() <= page_number) {
+    states.resize(page_number + 1, FREE_PAGE);
   }
-	else
-	{
-    new_page.set_page_number(header.num_pages);
-		new_page_number = new_page.page_number();
-
-    if (header.first_used_page == Page::INVALID_NUMBER)
-		{
-      header.first_used_page = new_page.page_number();
-    }
-		else
-		{
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
+  states[page_number] = state;
+
+  // rewrite the byte of the map page holding the state, from the states of
+  // the pages sharing it
+  const PageId map_page = mapPageOf(page_number);
+  const std::size_t bit = (page_number - map_page) * MAP_BITS_PER_PAGE;
+  const PageId first = map_page + (bit / 8) * 8 / MAP_BITS_PER_PAGE;
+  char byte = 0;
+  for (std::size_t i = 0; i < 8 / MAP_BITS_PER_PAGE; i++) {
+    if (first + i < states.size()) {
+      byte |= static_cast<char>(states[first + i] << (i * MAP_BITS_PER_PAGE));
+    }
+  }
+  writeAt(pagePosition(map_page) + sizeof(PageHeader) + bit / 8, &byte, 1);
+}
+
+PageId PageFile::takePage(FileHeader& header, const PageState state) {
+  std::lock_guard<std::mutex> guard(stream_->allocationLatch);
+  loadPageStates(header.num_pages);
+  const std::vector<std::uint8_t>& states = stream_->pageStates;
+  PageId page_number;
+  if (header.num_free_pages > 0) {
+    page_number = header.first_free_page;
+    --header.num_free_pages;
+    header.first_free_page = Page::INVALID_NUMBER;
+    for (PageId next = page_number + 1;
+         header.num_free_pages > 0 && next < header.num_pages; ++next) {
+      if (states[next] == FREE_PAGE) {
+        header.first_free_page = next;
+        break;
       }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
     }
-    ++header.num_pages;
+  } else {
+    if (mapPageOf(header.num_pages) == header.num_pages) {
+      // the end of the file reached the next map page
+      Page map_page;
+      writePage(header.num_pages, map_page.header_, map_page);
+      storePageState(header.num_pages, RESERVED_PAGE);
+      ++header.num_pages;
+    }
+    page_number = header.num_pages++;
   }
-  writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_, existing_page);
+  storePageState(page_number, state);
+  return page_number;
+}
+
+PageFile::PageState PageFile::pageState(const PageId page_number) const {
+  const PageId num_pages = readHeader().num_pages;
+  if (page_number == Page::INVALID_NUMBER || page_number >= num_pages) {
+    return FREE_PAGE;
   }
-  writeHeader(header);
+  std::lock_guard<std::mutex> guard(stream_->allocationLatch);
+  loadPageStates(num_pages);
+  return static_cast<PageState>(stream_->pageStates[page_number]);
+}
 
-  return new_page;
+PageId PageFile::nextUsedPage(const PageId page_number) const {
+  const PageId num_pages = readHeader().num_pages;
+  std::lock_guard<std::mutex> guard(stream_->allocationLatch);
+  loadPageStates(num_pages);
+  const std::vector<std::uint8_t>& states = stream_->pageStates;
+  for (PageId next = page_number + 1; next < num_pages; ++next) {
+    if (states[next] == USED_PAGE) {
+      return next;
+    }
+  }
+  return Page::INVALID_NUMBER;
 }
 
 Page PageFile::readPage(const PageId page_number) const {
+  Page page;
+  readPageInto(page_number, &page);
+  return page;
+}
+
+void PageFile::readPageInto(const PageId page_number, Page* page) const {
   FileHeader header = readHeader();
 
 	if (page_number >= header.num_pages)
 	{
 		throw InvalidPageException(page_number, filename_);
 	}
-	return readPage(page_number, false /* allow_free */);
+	readPageInto(page_number, page, false /* allow_free */);
 }
 
 Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(&page.data_[0], Page::DATA_SIZE);
-  if (!allow_free && !page.isUsed()) {
+  readPageInto(page_number, &page, allow_free);
+  return page;
+}
+
+void PageFile::readPageInto(const PageId page_number, Page* page,
+                            const bool allow_free) const {
+  const std::uint64_t position = pagePosition(page_number);
+  BADGERDB_TRACE_SPAN(span);
+  readAt(position, reinterpret_cast<char*>(&page->header_), sizeof(PageHeader));
+  readAt(position + sizeof(PageHeader), &page->data_[0], Page::DATA_SIZE);
+  BADGERDB_TRACE_END(span, TRACE_FILE_READ, this, page_number, 1, Page::SIZE);
+  if (holdsCompressedPage(&page->header_)) {
+    inflatePage(page_number, reinterpret_cast<char*>(page));
+  }
+  if (stream_->checksums) {
+    verifyPage(page_number, page->header_, page->data_, filename_);
+  }
+  if (!allow_free && !page->isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
-	PageHeader header = readPageHeader(new_page_number);
-	if (header.current_page_number == Page::INVALID_NUMBER)
-	{
-		// Page has been deleted since it was read.
-		throw InvalidPageException(new_page_number, filename_);
-	}
-	// Page on disk may have had its next page pointer updated since it was read;
-	// we don't modify that, but we do keep all the other modifications to the
-	// page header.
-	const PageId next_page_number = header.next_page_number;
-	header = new_page.header_;
-	header.next_page_number = next_page_number;
-	writePage(new_page_number, header, new_page);
+	// throws InvalidPageException if the page has been deleted since it was read
+	const Page* page = &new_page;
+	writePages(new_page_number, 1, &page);
 }
 
-void PageFile::deletePage(const PageId page_number) {
-  FileHeader header = readHeader();
+const std::size_t PageFile::APPEND_BATCH_PAGES;
+const std::size_t PageFile::FSM_BUCKET_BYTES;
+const std::size_t PageFile::FSM_ENTRIES_PER_PAGE;
 
-  Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
-  } else {
-    // Walk the used list so we can update the page that points to this one.
+/**
+ * Free-space map entry standing for the given number of free bytes, rounded
+ * down so the entry never promises more room than there is.
+ */
+static std::uint8_t freeSpaceEntry(const std::size_t free_space) {
+  return static_cast<std::uint8_t>(
+      std::min<std::size_t>(free_space / PageFile::FSM_BUCKET_BYTES, UCHAR_MAX));
+}
+
+/**
+ * Smallest free-space map entry of a page guaranteed to hold a record of the
+ * given length in a new slot.
+ */
+static std::size_t neededEntry(const std::size_t record_length) {
+  const std::size_t needed = record_length + sizeof(PageSlot);
+  return (needed + PageFile::FSM_BUCKET_BYTES - 1) / PageFile::FSM_BUCKET_BYTES;
+}
+
+PageId PageFile::readFreeSpaceMapPage(const PageId page_number,
+                                      Page* fsm_page) {
+  FileHeader header = readHeader();
+  if (header.first_fsm_page == Page::INVALID_NUMBER) {
+    // start the map with the free space of the pages already in use
+    std::vector<std::pair<PageId, std::size_t> > used;
     for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
+      const Page page = *iter;
+      used.push_back(std::make_pair(page.page_number(), page.getFreeSpace()));
+    }
+    const PageId first_fsm_page = reservePage(fsm_page);
+    header = readHeader();
+    header.first_fsm_page = first_fsm_page;
+    writeHeader(header);
+    for (std::size_t i = 0; i < used.size(); i++) {
+      setFreeSpace(used[i].first, used[i].second);
+    }
+    header = readHeader();
+  }
+
+  const std::size_t index = (page_number - 1) / FSM_ENTRIES_PER_PAGE;
+  PageId fsm_page_number = header.first_fsm_page;
+  readPageInto(fsm_page_number, fsm_page, true /* allow_free */);
+  for (std::size_t i = 0; i < index; i++) {
+    if (fsm_page->next_page_number() == Page::INVALID_NUMBER) {
+      // extend the map by another page
+      Page next_page;
+      const PageId next = reservePage(&next_page);
+      fsm_page->set_next_page_number(next);
+      writePage(fsm_page_number, fsm_page->header_, *fsm_page);
+      *fsm_page = next_page;
+      fsm_page_number = next;
+    } else {
+      fsm_page_number = fsm_page->next_page_number();
+      readPageInto(fsm_page_number, fsm_page, true /* allow_free */);
+    }
+  }
+  return fsm_page_number;
+}
+
+void PageFile::setFreeSpace(const PageId page_number,
+                            const std::size_t free_space) {
+  Page fsm_page;
+  const PageId fsm_page_number = readFreeSpaceMapPage(page_number, &fsm_page);
+  const std::size_t slot = (page_number - 1) % FSM_ENTRIES_PER_PAGE;
+  fsm_page.data_[slot] = static_cast<char>(freeSpaceEntry(free_space));
+  // only the entry changed, so only rewrite its byte
+  writeAt(pagePosition(fsm_page_number) + sizeof(PageHeader) + slot,
+          &fsm_page.data_[slot], 1);
+}
+
+void PageFile::noteFreeSpace(const Page& page) {
+  if (readHeader().first_fsm_page != Page::INVALID_NUMBER) {
+    setFreeSpace(page.page_number(), page.getFreeSpace());
+  }
+}
+
+PageId PageFile::findPageWithSpace(const std::size_t record_length) {
+  const std::size_t needed = neededEntry(record_length);
+  Page fsm_page;
+  readFreeSpaceMapPage(1, &fsm_page);
+  const PageId num_pages = readHeader().num_pages;
+  for (PageId first = 1; first < num_pages; first += FSM_ENTRIES_PER_PAGE) {
+    if (first > 1) {
+      if (fsm_page.next_page_number() == Page::INVALID_NUMBER) {
         break;
       }
+      readPageInto(fsm_page.next_page_number(), &fsm_page,
+                   true /* allow_free */);
+    }
+    const unsigned char* entries =
+        reinterpret_cast<const unsigned char*>(fsm_page.data_);
+    for (std::size_t i = 0; i < FSM_ENTRIES_PER_PAGE; i++) {
+      if (entries[i] >= needed) {
+        return first + i;
+      }
+    }
+  }
+  return Page::INVALID_NUMBER;
+}
+
+RecordId PageFile::insertRecord(const std::string& record_data) {
+  if (record_data.length() + sizeof(PageSlot) > Page::DATA_SIZE) {
+    const std::size_t capacity = Page::DATA_SIZE - sizeof(PageSlot);
+    throw InsufficientSpaceException(Page::INVALID_NUMBER,
+                                     record_data.length(), capacity);
+  }
+  while (true) {
+    PageId page_number = findPageWithSpace(record_data.length());
+    Page page;
+    if (page_number == Page::INVALID_NUMBER) {
+      allocatePageInto(page_number, &page);
+    } else {
+      readPageInto(page_number, &page);
+    }
+    if (!page.hasSpaceForRecord(record_data)) {
+      // the page was changed without telling the map; correct its entry and
+      // look again
+      setFreeSpace(page_number, page.getFreeSpace());
+      continue;
+    }
+    const RecordId record_id = page.insertRecord(record_data);
+    writePage(page_number, page);
+    setFreeSpace(page_number, page.getFreeSpace());
+    return record_id;
+  }
+}
+
+void PageFile::deleteRecord(const RecordId& record_id) {
+  Page page = readPage(record_id.page_number);
+  page.deleteRecord(record_id);
+  writePage(record_id.page_number, page);
+  setFreeSpace(record_id.page_number, page.getFreeSpace());
+}
+
+void PageFile::appendRecords(const char* records,
+                             const std::size_t record_length,
+                             const std::size_t count, RecordId* record_ids) {
+  if (count == 0) {
+    return;
+  }
+  if (record_length + sizeof(PageSlot) > Page::DATA_SIZE) {
+    throw InsufficientSpaceException(Page::INVALID_NUMBER, record_length,
+                                     Page::DATA_SIZE - sizeof(PageSlot));
+  }
+  std::vector<Page> batch(APPEND_BATCH_PAGES);
+  std::vector<PageId> page_numbers(APPEND_BATCH_PAGES);
+  std::size_t appended = 0;
+  while (appended < count) {
+    std::size_t filled = 0;
+    while (filled < APPEND_BATCH_PAGES && appended < count) {
+      allocatePageInto(page_numbers[filled], &batch[filled]);
+      appended += batch[filled].insertRecords(
+          records + appended * record_length, record_length, count - appended,
+          record_ids != NULL ? record_ids + appended : NULL);
+      ++filled;
+    }
+    // pages taken from the free list need not be consecutive
+    std::vector<const Page*> written(filled);
+    for (std::size_t i = 0; i < filled; i++) {
+      written[i] = &batch[i];
+    }
+    writePages(&page_numbers[0], filled, &written[0]);
+    for (std::size_t i = 0; i < filled; i++) {
+      noteFreeSpace(batch[i]);
+    }
+  }
+}
+
+void PageFile::readPages(const PageId first_page_number,
+                         const std::size_t count, Page* const* pages) const {
+  std::vector<PageId> page_numbers(count);
+  for (std::size_t i = 0; i < count; i++) {
+    page_numbers[i] = first_page_number + i;
+  }
+  readPages(count > 0 ? &page_numbers[0] : NULL, count, pages);
+}
+
+void PageFile::writePages(const PageId first_page_number,
+                          const std::size_t count, const Page* const* pages) {
+  std::vector<PageId> page_numbers(count);
+  for (std::size_t i = 0; i < count; i++) {
+    page_numbers[i] = first_page_number + i;
+  }
+  writePages(count > 0 ? &page_numbers[0] : NULL, count, pages);
+}
+
+void PageFile::readPages(const PageId* page_numbers, const std::size_t count,
+                         Page* const* pages) const {
+  if (count == 0) {
+    return;
+  }
+  FileHeader header = readHeader();
+  for (std::size_t i = 0; i < count; i++) {
+    if (page_numbers[i] >= header.num_pages) {
+      throw InvalidPageException(page_numbers[i], filename_);
+    }
+  }
+
+  std::vector<iovec> vectors(2 * count);
+  for (std::size_t i = 0; i < count; i++) {
+    vectors[2 * i].iov_base = &pages[i]->header_;
+    vectors[2 * i].iov_len = sizeof(PageHeader);
+    vectors[2 * i + 1].iov_base = &pages[i]->data_[0];
+    vectors[2 * i + 1].iov_len = Page::DATA_SIZE;
+  }
+  BADGERDB_TRACE_SPAN(span);
+  transferPages(false /* write */, page_numbers, count, &vectors[0], 2);
+  BADGERDB_TRACE_END(span, TRACE_FILE_READ, this, page_numbers[0], count,
+                     count * Page::SIZE);
+
+  for (std::size_t i = 0; i < count; i++) {
+    if (holdsCompressedPage(&pages[i]->header_)) {
+      inflatePage(page_numbers[i], reinterpret_cast<char*>(pages[i]));
+    }
+    if (stream_->checksums) {
+      verifyPage(page_numbers[i], pages[i]->header_, pages[i]->data_,
+                 filename_);
+    }
+    if (!pages[i]->isUsed()) {
+      throw InvalidPageException(page_numbers[i], filename_);
+    }
+  }
+}
+
+void PageFile::writePages(const PageId* page_numbers, const std::size_t count,
+                          const Page* const* pages) {
+  if (count == 0) {
+    return;
+  }
+  for (std::size_t i = 0; i < count; i++) {
+    if (pageState(page_numbers[i]) != USED_PAGE) {
+      throw InvalidPageException(page_numbers[i], filename_);
+    }
+  }
+
+  BADGERDB_TRACE_SPAN(span);
+  if (compressionEnabled()) {
+    // the pages are compressed as they are laid out on disk
+    std::vector<Page> images(count);
+    std::vector<const char*> starts(count);
+    for (std::size_t i = 0; i < count; i++) {
+      images[i] = *pages[i];
+      images[i].header_ = summedHeader(pages[i]->header_, *pages[i]);
+      starts[i] = reinterpret_cast<const char*>(&images[i]);
     }
+    writeCompressed(page_numbers, &starts[0], count);
+    BADGERDB_TRACE_END(span, TRACE_FILE_WRITE, this, page_numbers[0], count,
+                       count * Page::SIZE);
+    return;
   }
-  // Clear the page and add it to the head of the free list.
+
+  std::vector<PageHeader> headers(count);
+  std::vector<iovec> vectors(2 * count);
+  for (std::size_t i = 0; i < count; i++) {
+    headers[i] = summedHeader(pages[i]->header_, *pages[i]);
+    vectors[2 * i].iov_base = &headers[i];
+    vectors[2 * i].iov_len = sizeof(PageHeader);
+    vectors[2 * i + 1].iov_base = const_cast<char*>(&pages[i]->data_[0]);
+    vectors[2 * i + 1].iov_len = Page::DATA_SIZE;
+  }
+  transferPages(true /* write */, page_numbers, count, &vectors[0], 2);
+  BADGERDB_TRACE_END(span, TRACE_FILE_WRITE, this, page_numbers[0], count,
+                     count * Page::SIZE);
+}
+
+void PageFile::deletePage(const PageId page_number) {
+  FileHeader header = readHeader();
+  Page existing_page = readPage(page_number);
   existing_page.initialize();
-  existing_page.set_next_page_number(header.first_free_page);
-  header.first_free_page = page_number;
+  writePage(page_number, existing_page.header_, existing_page);
+  {
+    std::lock_guard<std::mutex> guard(stream_->allocationLatch);
+    loadPageStates(header.num_pages);
+    storePageState(page_number, FREE_PAGE);
+  }
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_, previous_page);
+  if (header.first_free_page == Page::INVALID_NUMBER ||
+      header.first_free_page > page_number) {
+    header.first_free_page = page_number;
+  }
+  if (header.first_used_page == page_number) {
+    header.first_used_page = nextUsedPage(page_number);
   }
-  writePage(page_number, existing_page.header_, existing_page);
   writeHeader(header);
+  if (header.first_fsm_page != Page::INVALID_NUMBER) {
+    setFreeSpace(page_number, 0);
+  }
 }
 
 FileIterator PageFile::begin() {
@@ -315,16 +1064,28 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(&new_page.data_[0], Page::DATA_SIZE);
-  stream_->flush();
+  const std::uint64_t position = pagePosition(page_number);
+  const PageHeader summed = summedHeader(header, new_page);
+  BADGERDB_TRACE_SPAN(span);
+  writeAt(position, reinterpret_cast<const char*>(&summed), sizeof(PageHeader));
+  writeAt(position + sizeof(PageHeader), &new_page.data_[0], Page::DATA_SIZE);
+  BADGERDB_TRACE_END(span, TRACE_FILE_WRITE, this, page_number, 1, Page::SIZE);
+}
+
+PageHeader PageFile::summedHeader(const PageHeader& header,
+                                  const Page& page) const {
+  PageHeader summed = header;
+  summed.checksum = 0;
+  if (stream_->checksums && header.current_page_number != Page::INVALID_NUMBER) {
+    summed.checksum = pageChecksum(summed, page.data_);
+  }
+  return summed;
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  readAt(pagePosition(page_number), reinterpret_cast<char*>(&header),
+         sizeof(PageHeader));
   return header;
 }
 
@@ -356,44 +1117,374 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
   // same file.
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
+  id_ = next_id_.fetch_add(1);
   openIfNeeded(false /* create_new */);
   return *this;
 }
 
 Page BlobFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
 	Page new_page;
+	allocatePageInto(new_page_number, &new_page);
+	return new_page;
+}
 
-	new_page_number = header.num_pages;
+void BlobFile::allocatePageInto(PageId &new_page_number, Page* page) {
+  allocatePageNear(new_page_number, page, Page::INVALID_NUMBER);
+}
 
-	if (header.first_used_page == Page::INVALID_NUMBER) {
-		header.first_used_page = header.num_pages;
-	}
+const std::size_t BlobFile::EXTENT_PAGES;
+
+void BlobFile::allocatePageNear(PageId &new_page_number, Page* page,
+                                const PageId near_page) {
+  if (isMapped()) {
+    throw ReadOnlyFileException(filename_);
+  }
+  FileHeader header = readHeader();
+	page->initialize();
+
+  std::lock_guard<std::mutex> guard(stream_->allocationLatch);
+  new_page_number = Page::INVALID_NUMBER;
+  const std::set<PageId>& free_pages = stream_->freePages;
+  if (near_page == Page::INVALID_NUMBER || near_page >= header.num_pages) {
+    if (header.num_free_pages > 0) {
+      // the head of the free list, whose first bytes link to the next one
+      new_page_number = header.first_free_page;
+      readAt(pagePosition(new_page_number),
+             reinterpret_cast<char*>(&header.first_free_page), sizeof(PageId));
+      --header.num_free_pages;
+      if (stream_->freePagesLoaded) {
+        stream_->freePages.erase(new_page_number);
+      }
+    }
+  } else {
+    loadFreePages(header);
+    const PageId extent_start =
+        (near_page - 1) / EXTENT_PAGES * EXTENT_PAGES + 1;
+    const PageId extent_end = extent_start + EXTENT_PAGES;
+    std::set<PageId>::const_iterator after = free_pages.upper_bound(near_page);
+    std::set<PageId>::const_iterator before = free_pages.lower_bound(extent_start);
+    if (after != free_pages.end() && *after < extent_end) {
+      new_page_number = *after;
+    } else if (before != free_pages.end() && *before < near_page) {
+      new_page_number = *before;
+    } else if (header.num_pages >= extent_end) {
+      // the extent is full; start a new one at the end of the file and keep
+      // the rest of it, and of the last extent, free for pages near it
+      const PageId new_extent =
+          (header.num_pages - 1 + EXTENT_PAGES - 1) / EXTENT_PAGES *
+          EXTENT_PAGES + 1;
+      const PageId first_spare = header.num_pages;
+      header.num_pages = new_extent + EXTENT_PAGES;
+      for (PageId spare = first_spare; spare < header.num_pages; spare++) {
+        if (spare != new_extent) {
+          addFreePage(header, spare);
+        }
+      }
+      new_page_number = new_extent;
+    }
+    if (new_page_number != Page::INVALID_NUMBER &&
+        free_pages.count(new_page_number) > 0) {
+      takeFreePage(header, new_page_number);
+    }
+  }
 
-	++header.num_pages;
+  if (new_page_number == Page::INVALID_NUMBER) {
+		new_page_number = header.num_pages;
+		++header.num_pages;
+	}
+  if (header.first_used_page == Page::INVALID_NUMBER) {
+    header.first_used_page = new_page_number;
+  }
 
-	writePage(new_page_number, new_page);
+	writePage(new_page_number, *page);
 	writeHeader(header);
+}
 
-	return new_page;
+void BlobFile::writeFreeLink(FileHeader& header, const PageId page_number,
+                             const PageId next) {
+  if (page_number == Page::INVALID_NUMBER) {
+    header.first_free_page = next;
+  } else {
+    writeAt(pagePosition(page_number), reinterpret_cast<const char*>(&next),
+            sizeof(PageId));
+  }
+}
+
+void BlobFile::loadFreePages(FileHeader& header) {
+  if (stream_->freePagesLoaded) {
+    return;
+  }
+  std::set<PageId>& free_pages = stream_->freePages;
+  free_pages.clear();
+  bool sorted = true;
+  PageId page_number = header.first_free_page;
+  for (PageId i = 0; i < header.num_free_pages; i++) {
+    if (!free_pages.empty() && page_number < *free_pages.rbegin()) {
+      sorted = false;
+    }
+    free_pages.insert(page_number);
+    readAt(pagePosition(page_number), reinterpret_cast<char*>(&page_number),
+           sizeof(PageId));
+  }
+  if (!sorted) {
+    // relink the list in page number order
+    PageId previous = Page::INVALID_NUMBER;
+    for (std::set<PageId>::const_iterator iter = free_pages.begin();
+         iter != free_pages.end(); ++iter) {
+      writeFreeLink(header, previous, *iter);
+      previous = *iter;
+    }
+    writeFreeLink(header, previous, Page::INVALID_NUMBER);
+  }
+  stream_->freePagesLoaded = true;
+}
+
+void BlobFile::takeFreePage(FileHeader& header, const PageId page_number) {
+  std::set<PageId>& free_pages = stream_->freePages;
+  std::set<PageId>::iterator iter = free_pages.find(page_number);
+  std::set<PageId>::iterator next = iter;
+  ++next;
+  const PageId previous =
+      (iter == free_pages.begin()) ? Page::INVALID_NUMBER : *std::prev(iter);
+  writeFreeLink(header, previous,
+                next == free_pages.end() ? Page::INVALID_NUMBER : *next);
+  free_pages.erase(iter);
+  --header.num_free_pages;
+}
+
+void BlobFile::addFreePage(FileHeader& header, const PageId page_number) {
+  std::set<PageId>& free_pages = stream_->freePages;
+  std::set<PageId>::iterator iter = free_pages.insert(page_number).first;
+  std::set<PageId>::iterator next = iter;
+  ++next;
+  const PageId previous =
+      (iter == free_pages.begin()) ? Page::INVALID_NUMBER : *std::prev(iter);
+  writeFreeLink(header, page_number,
+                next == free_pages.end() ? Page::INVALID_NUMBER : *next);
+  writeFreeLink(header, previous, page_number);
+  ++header.num_free_pages;
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	readPageInto(page_number, &page);
 	return page;
 }
 
+void BlobFile::readPageInto(const PageId page_number, Page* page) const {
+	const Page* mapped = mappedPage(page_number);
+	if (mapped != NULL) {
+		*page = *mapped;
+		return;
+	}
+	BADGERDB_TRACE_SPAN(span);
+	readAt(pagePosition(page_number), reinterpret_cast<char*>(page), Page::SIZE);
+	BADGERDB_TRACE_END(span, TRACE_FILE_READ, this, page_number, 1, Page::SIZE);
+	if (holdsCompressedPage(page)) {
+		inflatePage(page_number, reinterpret_cast<char*>(page));
+	}
+	verifyPage(page_number, *page);
+}
+
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	const Page* page = &new_page;
+	writePages(new_page_number, 1, &page);
+}
+
+std::uint32_t BlobFile::pageChecksum(const Page& page) const {
+  if (!stream_->checksums) {
+    return 0;
+  }
+  const std::uint32_t crc = crc32c(&page, DATA_SIZE);
+  return crc != 0 ? crc : 1;
+}
+
+void BlobFile::verifyPage(const PageId page_number, const Page& page) const {
+  if (!stream_->checksums) {
+    return;
+  }
+  std::uint32_t stored;
+  memcpy(&stored, reinterpret_cast<const char*>(&page) + DATA_SIZE,
+         sizeof(stored));
+  if (stored != 0 && stored != pageChecksum(page)) {
+    throw CorruptPageException(page_number, filename_);
+  }
+}
+
+void BlobFile::mapReadOnly() {
+  if (isMapped()) {
+    return;
+  }
+  DescriptorPin pin(*stream_);
+  struct stat status;
+  if (fstat(pin.fd(), &status) != 0) {
+    throw IoErrorException("stat", errno);
+  }
+  const std::size_t length = status.st_size;
+  const FileHeader header = readHeader();
+  void* mapping;
+  if (!(header.flags & FileHeader::COMPRESSED_PAGES)) {
+    mapping = mmap(NULL, length, PROT_READ, MAP_SHARED, pin.fd(), 0);
+    if (mapping == MAP_FAILED) {
+      throw IoErrorException("mmap", errno);
+    }
+  } else {
+    // compressed pages are read and decompressed into anonymous memory laid
+    // out like the file, which is then made read-only
+    mapping = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+      throw IoErrorException("mmap", errno);
+    }
+    char* image = static_cast<char*>(mapping);
+    try {
+      readAt(0 /* pos */, image, length);
+      for (PageId page_number = 1; page_number < header.num_pages;
+           page_number++) {
+        const std::uint64_t position = pagePosition(page_number);
+        if (position + Page::SIZE <= length &&
+            holdsCompressedPage(image + position)) {
+          inflatePage(page_number, image + position);
+        }
+      }
+    } catch (...) {
+      munmap(mapping, length);
+      throw;
+    }
+    if (mprotect(mapping, length, PROT_READ) != 0) {
+      const int error = errno;
+      munmap(mapping, length);
+      throw IoErrorException("mprotect", error);
+    }
+  }
+  stream_->mapping = static_cast<char*>(mapping);
+  stream_->mappedLength = length;
+}
+
+void BlobFile::readPages(const PageId first_page_number,
+                         const std::size_t count, Page* const* pages) const {
+  std::vector<PageId> page_numbers(count);
+  for (std::size_t i = 0; i < count; i++) {
+    page_numbers[i] = first_page_number + i;
+  }
+  readPages(count > 0 ? &page_numbers[0] : NULL, count, pages);
+}
+
+void BlobFile::writePages(const PageId first_page_number,
+                          const std::size_t count, const Page* const* pages) {
+  std::vector<PageId> page_numbers(count);
+  for (std::size_t i = 0; i < count; i++) {
+    page_numbers[i] = first_page_number + i;
+  }
+  writePages(count > 0 ? &page_numbers[0] : NULL, count, pages);
+}
+
+void BlobFile::readPages(const PageId* page_numbers, const std::size_t count,
+                         Page* const* pages) const {
+  if (count == 0) {
+    return;
+  }
+  if (isMapped()) {
+    for (std::size_t i = 0; i < count; i++) {
+      *pages[i] = *mappedPage(page_numbers[i]);
+    }
+    return;
+  }
+
+  std::vector<iovec> vectors(count);
+  for (std::size_t i = 0; i < count; i++) {
+    vectors[i].iov_base = pages[i];
+    vectors[i].iov_len = Page::SIZE;
+  }
+  BADGERDB_TRACE_SPAN(span);
+  transferPages(false /* write */, page_numbers, count, &vectors[0], 1);
+  BADGERDB_TRACE_END(span, TRACE_FILE_READ, this, page_numbers[0], count,
+                     count * Page::SIZE);
+  for (std::size_t i = 0; i < count; i++) {
+    if (holdsCompressedPage(pages[i])) {
+      inflatePage(page_numbers[i], reinterpret_cast<char*>(pages[i]));
+    }
+    verifyPage(page_numbers[i], *pages[i]);
+  }
+}
+
+void BlobFile::writePages(const PageId* page_numbers, const std::size_t count,
+                          const Page* const* pages) {
+  if (count == 0) {
+    return;
+  }
+  if (isMapped()) {
+    throw ReadOnlyFileException(filename_);
+  }
+  BADGERDB_TRACE_SPAN(span);
+  if (compressionEnabled()) {
+    // the pages are compressed as they are laid out on disk, checksum included
+    std::vector<Page> images(count);
+    std::vector<const char*> starts(count);
+    for (std::size_t i = 0; i < count; i++) {
+      images[i] = *pages[i];
+      const std::uint32_t checksum = pageChecksum(*pages[i]);
+      memcpy(reinterpret_cast<char*>(&images[i]) + DATA_SIZE, &checksum,
+             sizeof(checksum));
+      starts[i] = reinterpret_cast<const char*>(&images[i]);
+    }
+    writeCompressed(page_numbers, &starts[0], count);
+    BADGERDB_TRACE_END(span, TRACE_FILE_WRITE, this, page_numbers[0], count,
+                       count * Page::SIZE);
+    return;
+  }
+
+  // the checksums are gathered from here rather than stored into the pages,
+  // which the caller may still be reading
+  std::vector<std::uint32_t> checksums(count);
+  std::vector<iovec> vectors(2 * count);
+  for (std::size_t i = 0; i < count; i++) {
+    checksums[i] = pageChecksum(*pages[i]);
+    vectors[2 * i].iov_base = const_cast<Page*>(pages[i]);
+    vectors[2 * i].iov_len = DATA_SIZE;
+    vectors[2 * i + 1].iov_base = &checksums[i];
+    vectors[2 * i + 1].iov_len = sizeof(std::uint32_t);
+  }
+  transferPages(true /* write */, page_numbers, count, &vectors[0], 2);
+  BADGERDB_TRACE_END(span, TRACE_FILE_WRITE, this, page_numbers[0], count,
+                     count * Page::SIZE);
+}
+
+bool BlobFile::pageInUse(const PageId page_number) {
+	FileHeader header = readHeader();
+	if (page_number == Page::INVALID_NUMBER || page_number >= header.num_pages) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(stream_->allocationLatch);
+	const PageId first_free_page = header.first_free_page;
+	loadFreePages(header);
+	if (header.first_free_page != first_free_page) {
+		// loading relinked the free list in page number order
+		writeHeader(header);
+	}
+	return stream_->freePages.count(page_number) == 0;
 }
 
-//delePage should not be called for a blob_file, not supported
 void BlobFile::deletePage(const PageId page_number) {
-	throw InvalidPageException(page_number, filename_);
+	if (isMapped()) {
+		throw ReadOnlyFileException(filename_);
+	}
+	FileHeader header = readHeader();
+	// pages are not linked to each other, so the first one must stay where
+	// getFirstPageNo() finds it
+	if (page_number == Page::INVALID_NUMBER || page_number >= header.num_pages ||
+	    page_number == header.first_used_page) {
+		throw InvalidPageException(page_number, filename_);
+	}
+
+	std::lock_guard<std::mutex> guard(stream_->allocationLatch);
+	loadFreePages(header);
+	if (stream_->freePages.count(page_number) > 0) {
+		throw InvalidPageException(page_number, filename_);
+	}
+	addFreePage(header, page_number);
+	writeHeader(header);
 }
 
 }
@@ -7,11 +7,19 @@
 
 #pragma once
 
-#include <fstream>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
 #include <string>
-#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
 
+#include "io_backend.h"
 #include "page.h"
 
 namespace badgerdb {
@@ -39,9 +47,42 @@ struct FileHeader {
 
   /**
    * Page number of the first free (allocated but unused) page in the file.
+   * A PageFile keeps this the lowest-numbered free page; a BlobFile the head
+   * of its free list.
    */
   PageId first_free_page;
 
+  /**
+   * Page number of the first page of the free-space map of a PageFile, or
+   * Page::INVALID_NUMBER if the file has none yet.
+   */
+  PageId first_fsm_page;
+
+  /**
+   * COMPRESSED_PAGES if pages of the file may be stored compressed, and
+   * ALLOCATION_MAP if it is a PageFile recording its pages in allocation map
+   * pages.
+   */
+  std::uint32_t flags;
+
+  /**
+   * Page::SIZE of the binary that created the file.
+   */
+  std::uint32_t page_size;
+
+  /**
+   * Bit of flags set once a page of the file may have been written
+   * compressed.
+   */
+  static const std::uint32_t COMPRESSED_PAGES = 1;
+
+  /**
+   * Bit of flags set when a PageFile is created. A PageFile without it was
+   * created before allocation map pages, when the used and free pages were
+   * linked through the page headers instead, and cannot be opened.
+   */
+  static const std::uint32_t ALLOCATION_MAP = 2;
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,10 +93,244 @@ struct FileHeader {
     return num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
-        first_free_page == rhs.first_free_page;
+        first_free_page == rhs.first_free_page &&
+        first_fsm_page == rhs.first_fsm_page &&
+        flags == rhs.flags &&
+        page_size == rhs.page_size;
   }
 };
 
+/**
+ * @brief Handle of a file on disk, shared by all File objects for the file,
+ *        together with the IoBackend its pages go through.
+ *
+ * The handle stays valid for as long as the file is open, but its descriptor
+ * does not: at most maxOpenDescriptors() descriptors are kept open, and the
+ * descriptor of the least recently used file that no one is reading or
+ * writing is closed to make room for another. pinDescriptor() reopens it when
+ * it is needed again. The handle is destroyed when the last File object using
+ * it goes away.
+ */
+struct FileStream {
+  /**
+   * Takes over an open descriptor. Newly opened files use the default backend.
+   *
+   * @param path  Name the file was opened by, used to reopen it.
+   * @param fd    Open file descriptor, closed if this throws.
+   * @param flags Flags the file was opened with. It is reopened with the same
+   *              ones, less those that only apply when it is created.
+   * @throws  IoErrorException  If the file behind the descriptor could not be
+   *                            looked at.
+   */
+  FileStream(const std::string& path, const int fd, const int flags);
+
+  /**
+   * Unmaps the file if it is mapped and closes the descriptor.
+   */
+  ~FileStream();
+
+  /**
+   * Returns the descriptor of the file, reopening it if it was closed, and
+   * keeps it open until the matching unpinDescriptor().
+   *
+   * @return  Open file descriptor.
+   * @throws  IoErrorException  If the file could not be reopened, or its name
+   *                            now stands for another file (ESTALE).
+   */
+  int pinDescriptor();
+
+  /**
+   * Releases a descriptor returned by pinDescriptor(), making it a candidate
+   * for closing once no other pin is held.
+   */
+  void unpinDescriptor();
+
+  /**
+   * Returns the number of descriptors kept open at most, over all files.
+   */
+  static std::size_t maxOpenDescriptors();
+
+  /**
+   * Sets the number of descriptors kept open at most, over all files, closing
+   * idle ones if more are open. Descriptors that are pinned are never closed,
+   * so the cap can be exceeded while that many files are in use at once.
+   *
+   * @param count   Maximum number of open descriptors; at least 1.
+   */
+  static void setMaxOpenDescriptors(const std::size_t count);
+
+  /**
+   * Returns the error the last close of an idle descriptor of the file
+   * reported and forgets it, 0 if there was none. Writes made before such a
+   * close may not have reached the disk, so File::sync() fails with it.
+   */
+  int takeCloseError();
+
+  /**
+   * Default value of maxOpenDescriptors().
+   */
+  static const std::size_t DEFAULT_MAX_OPEN_DESCRIPTORS = 512;
+
+  /**
+   * Name the file was opened by.
+   */
+  const std::string path;
+
+  /**
+   * Descriptor of the file, or -1 while it is closed to keep the number of
+   * open descriptors under the cap. Use pinDescriptor() rather than reading
+   * this directly.
+   */
+  int fd;
+
+  /**
+   * Flags the descriptor is reopened with.
+   */
+  const int openFlags;
+
+  /**
+   * Device and inode of the file, which a reopened descriptor must still
+   * refer to.
+   */
+  dev_t device;
+  ino_t inode;
+
+  /**
+   * Backend reads and writes of the file are run through.
+   */
+  IoBackend* backend;
+
+  /**
+   * True if pages are written with a checksum and checked against it when
+   * read.
+   */
+  bool checksums;
+
+  /**
+   * True if pages are written compressed where that saves room on disk, see
+   * File::setCompression(). A write that finds the file system cannot punch
+   * holes clears it, possibly while other threads write pages.
+   */
+  std::atomic<bool> compression;
+
+  /**
+   * Read-only mapping of the whole file, NULL if it is not mapped.
+   */
+  char* mapping;
+
+  /**
+   * Length of the mapping in bytes.
+   */
+  std::size_t mappedLength;
+
+  /**
+   * Number of File::sync() calls made on the file so far.
+   */
+  std::uint64_t syncTicket;
+
+  /**
+   * Highest ticket whose writes are known to be on disk.
+   */
+  std::uint64_t syncedTicket;
+
+  /**
+   * True while a thread is in fdatasync for the file.
+   */
+  bool syncing;
+
+  /**
+   * Guards the sync tickets.
+   */
+  std::mutex syncLatch;
+
+  /**
+   * Signalled when an fdatasync finishes.
+   */
+  std::condition_variable syncDone;
+
+  /**
+   * In-memory copy of the allocation map of a PageFile: the PageFile::PageState
+   * of every page, indexed by page number. Loaded from the map pages the first
+   * time it is needed and written through on every change.
+   */
+  std::vector<std::uint8_t> pageStates;
+
+  /**
+   * True once pageStates has been loaded.
+   */
+  bool pageStatesLoaded;
+
+  /**
+   * In-memory copy of the free list of a BlobFile, which is kept sorted by
+   * page number on disk. Loaded by walking the list the first time it is
+   * needed.
+   */
+  std::set<PageId> freePages;
+
+  /**
+   * True once freePages has been loaded.
+   */
+  bool freePagesLoaded;
+
+  /**
+   * Guards pageStates, freePages and whether they have been loaded.
+   */
+  std::mutex allocationLatch;
+
+  /**
+   * See File::headerLatch().
+   */
+  std::mutex headerLatch;
+
+ private:
+  FileStream(const FileStream&);
+  FileStream& operator=(const FileStream&);
+
+  /**
+   * Closes idle descriptors, least recently used first, until fewer than
+   * <limit> are open or none is idle. The caller holds descriptorLatch.
+   *
+   * @param limit   Number of open descriptors to get below.
+   */
+  static void closeIdleDescriptors(const std::size_t limit);
+
+  /**
+   * Number of pins held on the descriptor.
+   */
+  std::size_t pins;
+
+  /**
+   * errno of the last failed close of the descriptor, 0 if none failed since
+   * takeCloseError().
+   */
+  int closeError;
+
+  /**
+   * Position in idleDescriptors while the descriptor is open and unpinned.
+   */
+  std::list<FileStream*>::iterator idlePosition;
+
+  /**
+   * Guards the descriptors of all files, their pins and idleDescriptors.
+   */
+  static std::mutex descriptorLatch;
+
+  /**
+   * Files whose descriptor is open but not pinned, most recently used first.
+   */
+  static std::list<FileStream*> idleDescriptors;
+
+  /**
+   * Number of descriptors currently open.
+   */
+  static std::size_t openDescriptors;
+
+  /**
+   * Cap on openDescriptors.
+   */
+  static std::size_t descriptorLimit;
+};
+
 /**
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
@@ -65,7 +340,7 @@ struct FileHeader {
  * deleted pages if possible).  If multiple File objects refer to the same
  * underlying file, they will share the stream in memory.
  * If a file that has already been opened (possibly by another query), then the File class
- * detects this (by looking in the open_streams_ map) and just returns a file object with
+ * detects this (by looking in the registry of opened files) and just returns a file object with
  * the already created stream for the file without actually opening the UNIX file again. 
  *
  * @warning This class is not threadsafe.
@@ -84,6 +359,8 @@ class File {
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
+   * @throws  CorruptPageException    If the file was created with another
+   *                                  page size.
    */
   File(const std::string& name, const bool create_new);
 
@@ -124,6 +401,30 @@ class File {
    */
   virtual Page allocatePage(PageId &new_page_number) = 0;
 
+  /**
+   * Allocates a new page in the file like allocatePage(), building it in
+   * the given memory instead of returning a copy.
+   *
+   * @param new_page_number   Number of the new page is returned in this.
+   * @param page              The new page is written here.
+   */
+  virtual void allocatePageInto(PageId &new_page_number, Page* page) = 0;
+
+  /**
+   * Allocates a new page like allocatePageInto(), preferring one close to
+   * the given page, so that pages read one after the other stay next to each
+   * other on disk. By default the hint is ignored.
+   *
+   * @param new_page_number   Number of the new page is returned in this.
+   * @param page              The new page is written here.
+   * @param near_page         Page the new one should be close to, or
+   *                          Page::INVALID_NUMBER for no preference.
+   */
+  virtual void allocatePageNear(PageId &new_page_number, Page* page,
+                                const PageId near_page) {
+    allocatePageInto(new_page_number, page);
+  }
+
   /**
    * Reads an existing page from the file.
    *
@@ -131,9 +432,22 @@ class File {
    * @return  The page.
    * @throws  InvalidPageException  If the page doesn't exist in the file or is
    *                                not currently used.
+   * @throws  CorruptPageException  If a page read does not match its checksum.
    */
   virtual Page readPage(const PageId page_number) const = 0;
 
+  /**
+   * Reads an existing page from the file like readPage(), straight into the
+   * given memory instead of returning a copy.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          The page is read into this.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   * @throws  CorruptPageException  If a page read does not match its checksum.
+   */
+  virtual void readPageInto(const PageId page_number, Page* page) const = 0;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -143,6 +457,60 @@ class File {
    */
   virtual void writePage(const PageId page_number, const Page& new_page) = 0;
 
+  /**
+   * Reads a run of consecutive pages from the file with as few vectored reads
+   * as possible.
+   *
+   * @param first_page_number   Number of the first page of the run.
+   * @param count               Number of pages in the run.
+   * @param pages               The pages are read into these, in order.
+   * @throws  InvalidPageException  If a page of the run doesn't exist in the
+   *                                file or is not currently used.
+   * @throws  CorruptPageException  If a page read does not match its checksum.
+   */
+  virtual void readPages(const PageId first_page_number, const std::size_t count,
+                         Page* const* pages) const = 0;
+
+  /**
+   * Writes a run of consecutive pages into the file with as few vectored
+   * writes as possible, with the same effect as writePage() on each of them.
+   *
+   * @param first_page_number   Number of the first page of the run.
+   * @param count               Number of pages in the run.
+   * @param pages               Pages to write, in order.
+   */
+  virtual void writePages(const PageId first_page_number, const std::size_t count,
+                          const Page* const* pages) = 0;
+
+  /**
+   * Reads a set of pages, not necessarily consecutive, from the file. The
+   * reads of all of them go to the backend as one batch, one vectored read per
+   * run of consecutive pages, so a backend that runs requests in parallel has
+   * them all in flight at once.
+   *
+   * @param page_numbers  Numbers of the pages, each at most once.
+   * @param count         Number of pages.
+   * @param pages         The pages are read into these, in order.
+   * @throws  InvalidPageException  If a page doesn't exist in the file, is cut
+   *                                short by the end of the file or is not
+   *                                currently used.
+   * @throws  CorruptPageException  If a page read does not match its checksum.
+   */
+  virtual void readPages(const PageId* page_numbers, const std::size_t count,
+                         Page* const* pages) const = 0;
+
+  /**
+   * Writes a set of pages, not necessarily consecutive, into the file with the
+   * same effect as writePage() on each of them. The writes go to the backend
+   * as one batch, like the reads of readPages().
+   *
+   * @param page_numbers  Numbers of the pages, each at most once.
+   * @param count         Number of pages.
+   * @param pages         Pages to write, in order.
+   */
+  virtual void writePages(const PageId* page_numbers, const std::size_t count,
+                          const Page* const* pages) = 0;
+
   /**
    * Deletes a page from the file.
    *
@@ -157,6 +525,15 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Returns a number that tells this object apart from every other File the
+   * process made, including those gone since. Assigning another file to the
+   * object gives it a new number.
+   *
+   * @return Number of the object.
+   */
+  std::uint64_t id() const { return id_; }
+
  	/**
    * Returns pageid of first page in the file.
    *
@@ -164,6 +541,121 @@ class File {
    */
 	PageId getFirstPageNo();
 
+  /**
+   * Returns the backend reads and writes of this file go through.
+   */
+  IoBackend* ioBackend() const { return stream_->backend; }
+
+  /**
+   * Sets the backend reads and writes of this file go through. The backend is
+   * shared by every File object open on the same file.
+   *
+   * @param backend   Backend to use; it must outlive the open file.
+   */
+  void setIoBackend(IoBackend* backend) { stream_->backend = backend; }
+
+  /**
+   * Returns the latch of the file that threads sharing it hold while they
+   * allocate, delete or look for pages with room, each of which reads the
+   * header and writes it back. Reads and writes of page contents are
+   * positional and need no latch; a reader only checks the page number
+   * against the header, and the number of pages never shrinks. The latch is
+   * shared by every File object open on the same file.
+   */
+  std::mutex& headerLatch() const { return stream_->headerLatch; }
+
+  /**
+   * Returns true if pages of this file are checksummed. They are by default.
+   */
+  bool checksumsEnabled() const { return stream_->checksums; }
+
+  /**
+   * Turns page checksums on or off for every File object open on the same
+   * file. While they are on, every page written gets a CRC32C of its contents,
+   * and every page read that has one is checked against it. While they are
+   * off, pages are written without one and nothing is checked.
+   *
+   * Pages read from the read-only mapping of a BlobFile are never checked.
+   *
+   * @param enabled   True to checksum pages.
+   */
+  void setChecksums(const bool enabled) { stream_->checksums = enabled; }
+
+  /**
+   * Number of bytes of file system blocks that compressed pages are rounded
+   * to; see setCompression().
+   */
+  static const std::size_t COMPRESSION_BLOCK = 4096;
+
+  /**
+   * Returns true if pages written to this file are compressed. They are not,
+   * unless compression was turned on for the file before.
+   */
+  bool compressionEnabled() const { return stream_->compression; }
+
+  /**
+   * Turns page compression on or off for every File object open on the same
+   * file. While it is on, every page written is compressed in the LZ4 block
+   * format, and stored compressed if that frees at least one whole file
+   * system block of the page's place in the file: the compressed page is
+   * written at the start of its place and the rest is punched out of the
+   * file, so it takes no room on disk. Pages keep their places, so no map of
+   * page offsets is needed and runs of pages are still read with one request.
+   * Pages that do not shrink enough are written as they are.
+   *
+   * Compressed pages are recognized whenever they are read, and decompressed
+   * into the page read, checked against a CRC32C of the compressed bytes if
+   * checksums are on. Turning compression on marks the file, so that it stays
+   * on when the file is opened again and mapReadOnly() of a BlobFile reads
+   * and decompresses the file instead of mapping it. If the file system
+   * cannot punch holes, compression turns itself off at the first page
+   * written, since it would save nothing.
+   *
+   * With pages of 8KB on blocks of 4KB a compressed page takes at most half
+   * the room of a page.
+   *
+   * @param enabled   True to compress pages.
+   */
+  void setCompression(const bool enabled);
+
+  /**
+   * Returns the number of bytes the file takes up on disk, which is less
+   * than its length if pages were stored compressed.
+   *
+   * @throws  IoErrorException  If the file could not be examined.
+   */
+  std::uint64_t diskUsage() const;
+
+  /**
+   * Makes every write to the file that finished before the call durable.
+   * Writes themselves only reach the operating system's cache.
+   *
+   * Concurrent calls are committed as a group: while one thread is in
+   * fdatasync, the others wait and are all covered by the next one.
+   *
+   * @throws  IoErrorException  If the file could not be synced, or closing
+   *                            its descriptor to stay under
+   *                            FileStream::maxOpenDescriptors() failed since
+   *                            the last sync.
+   */
+  void sync() const;
+
+  /**
+   * Returns true if the file is mapped read-only into memory.
+   */
+  bool isMapped() const { return stream_->mapping != NULL; }
+
+  /**
+   * Returns a pointer to the given page inside the read-only mapping of the
+   * file, or NULL if the file is not mapped. The page must not be written to.
+   *
+   * @param page_number   Number of page.
+   * @return  The page in the mapping.
+   * @throws  InvalidPageException  If the file is mapped and the page lies
+   *                                past its end.
+   */
+  Page* mappedPage(const PageId page_number) const;
+
  protected:
   /**
    * Returns the position of the page with the given number in the file (as an
@@ -172,7 +664,7 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
+  static std::uint64_t pagePosition(const PageId page_number) {
     return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
   }
 
@@ -210,28 +702,129 @@ class File {
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
-  typedef std::map<std::string, int> CountMap;
+  /**
+   * Reads a range of the file through its backend. Bytes past the end of the
+   * file are left as they are in the buffer.
+   *
+   * @param position  Offset of the range in the file.
+   * @param buffer    Memory the range is read into.
+   * @param length    Length of the range.
+   * @throws  IoErrorException  If the read fails.
+   */
+  void readAt(const std::uint64_t position, char* buffer,
+              const std::size_t length) const;
+
+  /**
+   * Writes a range of the file through its backend.
+   *
+   * @param position  Offset of the range in the file.
+   * @param buffer    Memory the range is written from.
+   * @param length    Length of the range.
+   * @throws  IoErrorException  If the write fails.
+   */
+  void writeAt(const std::uint64_t position, const char* buffer,
+               const std::size_t length);
+
+  /**
+   * Reads or writes whole pages, each scattered over, or gathered from,
+   * vectors_per_page consecutive buffers. The transfers are handed to the
+   * backend in one batch: a vectored request per run of consecutive pages,
+   * split where a run has more buffers than the system allows in one request.
+   *
+   * @param write             True to write, false to read.
+   * @param page_numbers      Numbers of the pages.
+   * @param count             Number of pages.
+   * @param vectors           Buffers, vectors_per_page per page in the order
+   *                          of page_numbers.
+   * @param vectors_per_page  Number of buffers of each page, Page::SIZE bytes
+   *                          in all.
+   * @throws  IoErrorException  If a transfer fails.
+   * @throws  InvalidPageException  If a read ends at the end of the file
+   *                                before the whole of a page.
+   */
+  void transferPages(const bool write, const PageId* page_numbers,
+                     const std::size_t count, const iovec* vectors,
+                     const std::size_t vectors_per_page) const;
+
+  /**
+   * Writes the on-disk images of consecutive pages, compressing those that
+   * shrink enough as setCompression() describes. Used instead of a vectored
+   * write while compression is on.
+   *
+   * @param page_numbers  Numbers of the pages.
+   * @param images        Images of the pages, Page::SIZE bytes each.
+   * @param count         Number of pages.
+   * @throws  IoErrorException  If a write fails.
+   */
+  void writeCompressed(const PageId* page_numbers, const char* const* images,
+                       const std::size_t count);
+
+  /**
+   * Replaces the on-disk image of a page just read with the page it holds
+   * compressed, if it holds one.
+   *
+   * @param page_number   Number of the page.
+   * @param image         Image of the page, Page::SIZE bytes.
+   * @return  True if the image held a compressed page.
+   * @throws  CorruptPageException  If checksums are on and the compressed
+   *                                page is damaged.
+   */
+  bool inflatePage(const PageId page_number, char* image) const;
+
+  /**
+   * Stream of an opened file and the number of File objects using it.
+   */
+  struct OpenFile {
+    std::shared_ptr<FileStream> stream;
+    int count;
+  };
+
+  /**
+   * Part of the registry of opened files, with its own latch so that threads
+   * opening and closing different files rarely wait on each other.
+   */
+  struct RegistryShard {
+    std::mutex latch;
+    std::unordered_map<std::string, OpenFile> files;
+  };
+
+  /**
+   * Number of shards the registry of opened files is split into.
+   */
+  static const std::size_t REGISTRY_SHARDS = 16;
 
   /**
-   * Streams for opened files.
+   * Returns the shard of the registry the given file belongs to.
+   *
+   * @param filename  Name of the file.
+   * @return  The shard.
    */
-  static StreamMap open_streams_;
+  static RegistryShard& registryShard(const std::string& filename);
 
   /**
-   * Counts for opened files.
+   * Registry of opened files, hashed by name into shards.
    */
-  static CountMap open_counts_;
+  static RegistryShard registry_[REGISTRY_SHARDS];
 
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
+  /**
+   * Number returned by id().
+   */
+  std::uint64_t id_;
+
+  /**
+   * Number of the next File object.
+   */
+  static std::atomic<std::uint64_t> next_id_;
+
   /**
    * Stream for underlying filesystem object.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<FileStream> stream_;
 
   friend class FileIterator;
 };
@@ -250,9 +843,9 @@ class PageFile : public File {
   /**
    * Opens the file named fileName and returns the corresponding File object.
 	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
-	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
+	 * that already open file. Reference count (kept in the static registry of opened files) is incremented whenever an already open file is
 	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * registry of opened files.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -268,6 +861,9 @@ class PageFile : public File {
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
+   * @throws  CorruptPageException    If the file was created with another
+   *                                  page size, or is not a PageFile with
+   *                                  allocation map pages.
    */
   PageFile(const std::string& name, const bool create_new);
 
@@ -300,6 +896,14 @@ class PageFile : public File {
    */
   Page allocatePage(PageId &new_page_number) override;
 
+  /**
+   * Allocates a new page in the file, building it in the given memory.
+   *
+   * @param new_page_number   Number of the new page is returned in this.
+   * @param page              The new page is written here.
+   */
+  void allocatePageInto(PageId &new_page_number, Page* page) override;
+
   /**
    * Reads an existing page from the file.
    *
@@ -310,6 +914,16 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file straight into the given memory.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          The page is read into this.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPageInto(const PageId page_number, Page* page) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -319,6 +933,152 @@ class PageFile : public File {
    */
   void writePage(const PageId page_number, const Page& new_page) override;
 
+  /**
+   * Reads a run of consecutive pages from the file with as few vectored reads
+   * as possible.
+   *
+   * @param first_page_number   Number of the first page of the run.
+   * @param count               Number of pages in the run.
+   * @param pages               The pages are read into these, in order.
+   * @throws  InvalidPageException  If a page of the run doesn't exist in the
+   *                                file or is not currently used.
+   */
+  void readPages(const PageId first_page_number, const std::size_t count,
+                 Page* const* pages) const override;
+
+  /**
+   * Writes a run of consecutive pages into the file with as few vectored
+   * writes as possible, with the same effect as writePage() on each of them.
+   *
+   * @param first_page_number   Number of the first page of the run.
+   * @param count               Number of pages in the run.
+   * @param pages               Pages to write, in order.
+   */
+  void writePages(const PageId first_page_number, const std::size_t count,
+                  const Page* const* pages) override;
+
+  /**
+   * @see File::readPages(const PageId*, const std::size_t, Page* const*)
+   */
+  void readPages(const PageId* page_numbers, const std::size_t count,
+                 Page* const* pages) const override;
+
+  /**
+   * @see File::writePages(const PageId*, const std::size_t, const Page* const*)
+   */
+  void writePages(const PageId* page_numbers, const std::size_t count,
+                  const Page* const* pages) override;
+
+  /**
+   * Appends a packed array of fixed-length records to the file. Records are
+   * packed into newly allocated pages, as many per page as fit, and the full
+   * pages are written in batches of up to APPEND_BATCH_PAGES with
+   * writePages().
+   *
+   * @param records        Bytes of the records, one after the other.
+   * @param record_length  Length of each record in bytes.
+   * @param count          Number of records in the array.
+   * @param record_ids     If not NULL, the IDs of the appended records are
+   *                       stored here, in order.
+   * @throws  InsufficientSpaceException  If a record is too long for a page.
+   */
+  void appendRecords(const char* records, const std::size_t record_length,
+                     const std::size_t count, RecordId* record_ids = NULL);
+
+  /**
+   * Number of pages appendRecords() fills before writing them out.
+   */
+  static const std::size_t APPEND_BATCH_PAGES = 16;
+
+  /**
+   * Inserts a record into a page of the file with room for it, found through
+   * the free-space map, or into a newly allocated page if none has room. The
+   * page is read and written directly, so the file must not be accessed
+   * through the buffer manager at the same time.
+   *
+   * @param record_data  Bytes that compose the record.
+   * @return  ID of the newly inserted record.
+   * @throws  InsufficientSpaceException  If the record is too long for a page.
+   */
+  RecordId insertRecord(const std::string& record_data);
+
+  /**
+   * Deletes a record from its page and records the space it leaves in the
+   * free-space map, so that insertRecord() can reuse it.
+   *
+   * @param record_id  ID of the record to delete.
+   */
+  void deleteRecord(const RecordId& record_id);
+
+  /**
+   * Looks up the free-space map for a used page with room for a record of
+   * the given length. The map is created on first use from the free space of
+   * every used page.
+   *
+   * @param record_length  Length of the record in bytes.
+   * @return  Number of a page with room, or Page::INVALID_NUMBER if the map
+   *          knows of none.
+   */
+  PageId findPageWithSpace(const std::size_t record_length);
+
+  /**
+   * Records the free space of a page in the free-space map, for callers that
+   * change pages themselves, e.g. through the buffer manager. Does nothing if
+   * the file has no free-space map yet.
+   *
+   * @param page  Page whose free space to record.
+   */
+  void noteFreeSpace(const Page& page);
+
+  /**
+   * Number of bytes of free space each step of a free-space map entry stands
+   * for. An entry of n promises at least n times this many free bytes.
+   */
+  static const std::size_t FSM_BUCKET_BYTES = 32;
+
+  /**
+   * Number of pages whose free space one page of the free-space map records.
+   */
+  static const std::size_t FSM_ENTRIES_PER_PAGE = Page::DATA_SIZE;
+
+  /**
+   * Allocation state of a page, as recorded in the allocation map.
+   */
+  enum PageState {
+    FREE_PAGE = 0,      //!< Deleted, can be allocated again
+    USED_PAGE = 1,      //!< Holds records; visited by FileIterator
+    RESERVED_PAGE = 2   //!< Belongs to the allocation or free-space map
+  };
+
+  /**
+   * Number of bits of the allocation map per page.
+   */
+  static const std::size_t MAP_BITS_PER_PAGE = 2;
+
+  /**
+   * Number of pages, starting with itself, whose state one page of the
+   * allocation map records. Map pages sit at page numbers
+   * 1, 1 + MAP_SPAN, 1 + 2 * MAP_SPAN, ...
+   */
+  static const std::size_t MAP_SPAN = Page::DATA_SIZE * 8 / MAP_BITS_PER_PAGE;
+
+  /**
+   * Returns the allocation state of a page, without reading the page.
+   *
+   * @param page_number   Number of page.
+   * @return  State of the page; FREE_PAGE past the end of the file.
+   */
+  PageState pageState(const PageId page_number) const;
+
+  /**
+   * Returns the lowest-numbered used page after the given one, from the
+   * allocation map and without reading any page.
+   *
+   * @param page_number   Page to start after.
+   * @return  Number of the next used page, or Page::INVALID_NUMBER if none.
+   */
+  PageId nextUsedPage(const PageId page_number) const;
+
   /**
    * Deletes a page from the file.
    *
@@ -358,6 +1118,19 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number, const bool allow_free) const;
 
+  /**
+   * Reads a page from the file into the given memory, like
+   * readPage(const PageId, const bool).
+   *
+   * @param page_number   Number of page to read.
+   * @param page          The page is read into this.
+   * @param allow_free    Whether to allow reading a free (unused) page.
+   * @throws  InvalidPageException  If the page is free (unused) and
+   *                                allow_free is false.
+   */
+  void readPageInto(const PageId page_number, Page* page,
+                    const bool allow_free) const;
+
   /**
    * Writes a page into the file at the given page number with the given header.
    * This does not ensure that the number in the header equals the position on
@@ -379,6 +1152,78 @@ class PageFile : public File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Returns the number of the free-space map page holding the entry of the
+   * given page, adding map pages to the end of the file as needed. Creates
+   * the map if the file has none.
+   *
+   * The map is a list of pages, chained through their next page numbers and
+   * on neither the used nor the free list, whose data areas hold one byte per
+   * page of the file: page k of the map covers pages
+   * k * FSM_ENTRIES_PER_PAGE + 1 onwards.
+   *
+   * @param page_number   Page whose entry is wanted.
+   * @param fsm_page      The map page is read into this.
+   * @return  Number of the map page.
+   */
+  PageId readFreeSpaceMapPage(const PageId page_number, Page* fsm_page);
+
+  /**
+   * Sets the free-space map entry of a page.
+   *
+   * @param page_number   Page whose entry to set.
+   * @param free_space    Free bytes on the page.
+   */
+  void setFreeSpace(const PageId page_number, const std::size_t free_space);
+
+  /**
+   * Loads the allocation map into stream_->pageStates if that has not been
+   * done yet. The caller holds stream_->allocationLatch.
+   *
+   * @param num_pages   Number of pages in the file.
+   */
+  void loadPageStates(const PageId num_pages) const;
+
+  /**
+   * Records a new state for a page in memory and in its allocation map page.
+   * The caller holds stream_->allocationLatch.
+   *
+   * @param page_number   Number of page.
+   * @param state         New state of the page.
+   */
+  void storePageState(const PageId page_number, const PageState state);
+
+  /**
+   * Takes the lowest free page of the file, or a new page at its end, and
+   * gives it the given state. Adds an allocation map page first whenever the
+   * end of the file reaches the position of one. Updates the counts in
+   * header, which the caller writes back.
+   *
+   * @param header  Header of the file.
+   * @param state   State of the taken page.
+   * @return  Number of the taken page.
+   */
+  PageId takePage(FileHeader& header, const PageState state);
+
+  /**
+   * Takes a page for the free-space map and writes it out empty.
+   *
+   * @param page  The empty page is built in this.
+   * @return  Number of the page.
+   */
+  PageId reservePage(Page* page);
+
+  /**
+   * Returns a copy of the given header of the given page with its checksum
+   * filled in if checksums are on and the page is in use, or cleared
+   * otherwise.
+   *
+   * @param header  Header to write with the page.
+   * @param page    Page whose data is written.
+   * @return  Header as it is written.
+   */
+  PageHeader summedHeader(const PageHeader& header, const Page& page) const;
+
   friend class FileIterator;
 };
 
@@ -396,9 +1241,9 @@ class BlobFile : public File {
   /**
    * Opens the file named fileName and returns the corresponding File object.
 	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
-	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
+	 * that already open file. Reference count (kept in the static registry of opened files) is incremented whenever an already open file is
 	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * registry of opened files.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -416,6 +1261,8 @@ class BlobFile : public File {
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
+   * @throws  CorruptPageException    If the file was created with another
+   *                                  page size.
    */
   BlobFile(const std::string& name, const bool create_new);
 
@@ -442,12 +1289,22 @@ class BlobFile : public File {
   ~BlobFile();
 
   /**
-   * Allocates a new page in the file.
+   * Allocates a new page in the file, reusing the last page deleted if there
+   * is one.
    *
    * @return The new page.
    */
   Page allocatePage(PageId &new_page_number) override;
 
+  /**
+   * Allocates a new page in the file like allocatePage(), building it in the
+   * given memory.
+   *
+   * @param new_page_number   Number of the new page is returned in this.
+   * @param page              The new page is written here.
+   */
+  void allocatePageInto(PageId &new_page_number, Page* page) override;
+
   /**
    * Reads an existing page from the file.
    *
@@ -458,6 +1315,14 @@ class BlobFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file straight into the given memory.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          The page is read into this.
+   */
+  void readPageInto(const PageId page_number, Page* page) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -468,11 +1333,161 @@ class BlobFile : public File {
   void writePage(const PageId page_number, const Page& new_page) override;
 
   /**
-   * Deletes a page from the file.
+   * Reads a run of consecutive pages from the file with as few vectored reads
+   * as possible.
+   *
+   * @param first_page_number   Number of the first page of the run.
+   * @param count               Number of pages in the run.
+   * @param pages               The pages are read into these, in order.
+   * @throws  InvalidPageException  If a page of the run doesn't exist in the
+   *                                file or is not currently used.
+   */
+  void readPages(const PageId first_page_number, const std::size_t count,
+                 Page* const* pages) const override;
+
+  /**
+   * Writes a run of consecutive pages into the file with as few vectored
+   * writes as possible, with the same effect as writePage() on each of them.
+   *
+   * @param first_page_number   Number of the first page of the run.
+   * @param count               Number of pages in the run.
+   * @param pages               Pages to write, in order.
+   */
+  void writePages(const PageId first_page_number, const std::size_t count,
+                  const Page* const* pages) override;
+
+  /**
+   * @see File::readPages(const PageId*, const std::size_t, Page* const*)
+   */
+  void readPages(const PageId* page_numbers, const std::size_t count,
+                 Page* const* pages) const override;
+
+  /**
+   * @see File::writePages(const PageId*, const std::size_t, const Page* const*)
+   */
+  void writePages(const PageId* page_numbers, const std::size_t count,
+                  const Page* const* pages) override;
+
+  /**
+   * Deletes a page from the file, putting it on the free list allocatePage()
+   * takes pages from first. Blob pages have no header, so the link to the
+   * next free page overwrites the first bytes of the page.
    *
    * @param page_number   Number of page to delete.
+   * @throws  InvalidPageException  If the page is not in the file, or it is
+   *                                the first page, which getFirstPageNo()
+   *                                returns.
+   * @throws  ReadOnlyFileException If the file is mapped read-only.
    */
   void deletePage(const PageId page_number) override;
+
+  /**
+   * Allocates a new page in the same extent of EXTENT_PAGES pages as
+   * near_page: the first free page after it in the extent, else the first
+   * one before it, else the end of the file if that is in the extent. Failing
+   * that, the file grows by a whole new extent; the new page is its first
+   * page, and the rest of the extent, together with any pages left at the end
+   * of the last one, goes on the free list for later pages near it.
+   *
+   * @param new_page_number   Number of the new page is returned in this.
+   * @param page              The new page is written here.
+   * @param near_page         Page the new one should be close to, or
+   *                          Page::INVALID_NUMBER for no preference.
+   * @throws  ReadOnlyFileException If the file is mapped read-only.
+   */
+  void allocatePageNear(PageId &new_page_number, Page* page,
+                        const PageId near_page) override;
+
+  /**
+   * Number of pages in an extent. Extent k holds pages
+   * k * EXTENT_PAGES + 1 to (k + 1) * EXTENT_PAGES.
+   */
+  static const std::size_t EXTENT_PAGES = 64;
+
+  /**
+   * Returns true if the page is allocated and not on the free list.
+   *
+   * @param page_number   Number of page.
+   * @return  True if the page is in use; false if it is free or lies past
+   *          the end of the file.
+   */
+  bool pageInUse(const PageId page_number);
+
+  /**
+   * Number of bytes at the start of a page that hold its contents. The last
+   * bytes of every page written hold the CRC32C of those, or zero if it was
+   * written without one; whatever is stored there is overwritten.
+   */
+  static const std::size_t DATA_SIZE = Page::SIZE - sizeof(std::uint32_t);
+
+  /**
+   * Maps the whole file read-only into memory, for every BlobFile open on it.
+   * From then on readPage() copies pages out of the mapping, and BufMgr hands
+   * out pointers into it instead of reading pages into frames. Writes and new
+   * pages are refused until the file is closed by all its File objects.
+   *
+   * A file that holds compressed pages is read and decompressed into memory
+   * laid out like the file instead, which takes as much memory as the file is
+   * long.
+   *
+   * All pages of the file cached in a BufMgr must have been flushed first.
+   *
+   * @throws  IoErrorException  If the file could not be mapped.
+   */
+  void mapReadOnly();
+
+ private:
+  /**
+   * Loads the free list into stream_->freePages if that has not been done
+   * yet, sorting the list on disk if it is not. The caller holds
+   * stream_->allocationLatch.
+   *
+   * @param header  Header of the file; its first free page may change.
+   */
+  void loadFreePages(FileHeader& header);
+
+  /**
+   * Takes a page off the free list. The caller holds stream_->allocationLatch.
+   *
+   * @param header        Header of the file, which the caller writes back.
+   * @param page_number   Free page to take.
+   */
+  void takeFreePage(FileHeader& header, const PageId page_number);
+
+  /**
+   * Puts a page on the free list, in page number order. The caller holds
+   * stream_->allocationLatch.
+   *
+   * @param header        Header of the file, which the caller writes back.
+   * @param page_number   Page to free.
+   */
+  void addFreePage(FileHeader& header, const PageId page_number);
+
+  /**
+   * Writes the link of a free page, or the head of the free list in the file
+   * header if page_number is Page::INVALID_NUMBER.
+   */
+  void writeFreeLink(FileHeader& header, const PageId page_number,
+                     const PageId next);
+
+  /**
+   * Returns the checksum to store at the end of the given page, or zero if
+   * checksums are off.
+   *
+   * @param page  Page to checksum.
+   * @return  Checksum of the first DATA_SIZE bytes of the page.
+   */
+  std::uint32_t pageChecksum(const Page& page) const;
+
+  /**
+   * Checks a page just read against the checksum stored at its end, if
+   * checksums are on and it has one.
+   *
+   * @param page_number   Number of the page.
+   * @param page          The page.
+   * @throws  CorruptPageException  If the page does not match its checksum.
+   */
+  void verifyPage(const PageId page_number, const Page& page) const;
 };
 
 }
@@ -5,18 +5,149 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
 #include "filescan.h"
 #include "exceptions/end_of_file_exception.h"
 
 namespace badgerdb { 
 
-FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr, const std::uint32_t ringSize)
 {
   file = new PageFile(name, false);	//dont create new file
 	bufMgr = bufferMgr;
+  ring = (ringSize > 0) ? new BufferRing(ringSize) : NULL;
 	curDirtyFlag = false;
   curPage = NULL;
 	filePageIter = file->begin();
+  rangeBegin = file->begin();
+  rangeEnd = file->end();
+}
+
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr, const PageId firstPage, const PageId endPage,
+                   const std::uint32_t ringSize)
+{
+  file = new PageFile(name, false);	//dont create new file
+	bufMgr = bufferMgr;
+  ring = (ringSize > 0) ? new BufferRing(ringSize) : NULL;
+	curDirtyFlag = false;
+  curPage = NULL;
+  rangeBegin = FileIterator(file, firstPage);
+  rangeEnd = (endPage == Page::INVALID_NUMBER) ? file->end() : FileIterator(file, endPage);
+	filePageIter = rangeBegin;
+}
+
+std::vector<PageId> FileScan::partition(const std::string &name, const std::size_t numRanges)
+{
+  PageFile file(name, false);
+  std::vector<PageId> pages;
+  for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+    pages.push_back(iter.page_number());
+
+  std::vector<PageId> starts;
+  const std::size_t ranges = std::max<std::size_t>(1, std::min(numRanges, pages.size()));
+  for (std::size_t k = 0; k < ranges && !pages.empty(); k++)
+    starts.push_back(pages[k * pages.size() / ranges]);
+  return starts;
+}
+
+/**
+ * State shared by the threads of a parallelScan().
+ */
+struct ParallelScanState
+{
+  PageFile *file;
+  BufMgr *bufMgr;
+  std::vector<PageId> pages;
+  std::size_t morselPages;
+  std::uint32_t ringSize;
+  RecordVisitor visitor;
+  void *arg;
+
+  /**
+   * Index in pages of the first page of the next morsel to hand out.
+   */
+  std::atomic<std::size_t> nextPage;
+
+  /**
+   * Set when a thread failed, to stop the others.
+   */
+  std::atomic<bool> stop;
+
+  std::vector<std::exception_ptr> errors;
+};
+
+static void parallelScanWorker(ParallelScanState *state, const std::size_t worker)
+{
+  BufferRing *ring = (state->ringSize > 0) ? new BufferRing(state->ringSize) : NULL;
+  try
+  {
+    while (!state->stop.load())
+    {
+      const std::size_t first = state->nextPage.fetch_add(state->morselPages);
+      if (first >= state->pages.size())
+        break;
+      const std::size_t last = std::min(first + state->morselPages, state->pages.size());
+      for (std::size_t i = first; i < last && !state->stop.load(); i++)
+      {
+        PageHandle handle = (ring != NULL) ? state->bufMgr->readPage(state->file, state->pages[i], *ring)
+                                           : state->bufMgr->readPage(state->file, state->pages[i], SEQUENTIAL_ACCESS);
+        try
+        {
+          for (PageIterator iter = handle.page->begin(); iter != handle.page->end(); ++iter)
+            state->visitor(worker, iter.getCurrentRecord(), iter.view(), state->arg);
+        }
+        catch (...)
+        {
+          state->bufMgr->unPinPage(handle, false);
+          throw;
+        }
+        state->bufMgr->unPinPage(handle, false);
+      }
+    }
+  }
+  catch (...)
+  {
+    state->errors[worker] = std::current_exception();
+    state->stop.store(true);
+  }
+  delete ring;
+}
+
+void FileScan::parallelScan(const std::string &name, BufMgr *bufMgr, const std::size_t numThreads,
+                            RecordVisitor visitor, void *arg, const std::size_t morselPages,
+                            const std::uint32_t ringSize)
+{
+  PageFile file(name, false);
+  ParallelScanState state;
+  state.file = &file;
+  state.bufMgr = bufMgr;
+  for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+    state.pages.push_back(iter.page_number());
+  state.morselPages = std::max<std::size_t>(1, morselPages);
+  state.ringSize = ringSize;
+  state.visitor = visitor;
+  state.arg = arg;
+  state.nextPage.store(0);
+  state.stop.store(false);
+
+  const std::size_t threads = std::max<std::size_t>(1, numThreads);
+  state.errors.resize(threads);
+  std::vector<std::thread> workers;
+  for (std::size_t k = 1; k < threads; k++)
+    workers.push_back(std::thread(parallelScanWorker, &state, k));
+  parallelScanWorker(&state, 0);
+  for (std::size_t k = 0; k < workers.size(); k++)
+    workers[k].join();
+
+  bufMgr->flushFile(&file);
+  for (std::size_t k = 0; k < threads; k++)
+  {
+    if (state.errors[k])
+      std::rethrow_exception(state.errors[k]);
+  }
 }
 
 FileScan::~FileScan()
@@ -27,17 +158,25 @@ FileScan::~FileScan()
     bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
     curPage = NULL;
 		curDirtyFlag = false;
-    filePageIter = file->begin();
+    filePageIter = rangeBegin;
   }
   bufMgr->flushFile(file);
   delete file;
+  delete ring;
 }
 
-void FileScan::scanNext(RecordId& outRid)
+void FileScan::readCurrentPage()
 {
-  std::string rec;
+  const PageId pageNo = (*filePageIter).page_number();
+  if (ring != NULL)
+    curPage = bufMgr->readPage(file, pageNo, *ring).page;
+  else
+    bufMgr->readPage(file, pageNo, curPage, SEQUENTIAL_ACCESS);
+}
 
-  if (filePageIter == file->end())
+void FileScan::scanNext(RecordId& outRid)
+{
+  if (filePageIter == rangeEnd)
 	{
 		throw EndOfFileException();
 	}
@@ -46,14 +185,14 @@ void FileScan::scanNext(RecordId& outRid)
   if (curPage == NULL)
   {
     // need to get the first page of the file
-		filePageIter = file->begin();
-    if(filePageIter == file->end())
+		filePageIter = rangeBegin;
+    if(filePageIter == rangeEnd)
 		{
 			throw EndOfFileException();
 		}
 	 
 		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
+    readCurrentPage();
 		curDirtyFlag = false;
 
 		// get the first record off the page
@@ -61,9 +200,6 @@ void FileScan::scanNext(RecordId& outRid)
 
 		if(pageRecordIter != curPage->end()) 
 		{
-		  // get pointer to record
-		  rec = *pageRecordIter;
-
 			outRid = pageRecordIter.getCurrentRecord();
 			return;
 		}
@@ -81,24 +217,20 @@ void FileScan::scanNext(RecordId& outRid)
     curDirtyFlag = false;
 
     filePageIter++;
-    if (filePageIter == file->end())
+    if (filePageIter == rangeEnd)
     {
       curPage = NULL;
 			throw EndOfFileException();
     }
 
     // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    readCurrentPage();
 
     // get the first record off the page
     pageRecordIter = curPage->begin(); 
   }
 
   // curRec points at a valid record
-  // see if the record satisfies the scan's predicate 
-  // get a pointer to the record
-  rec = *pageRecordIter;
-
 	// return rid of the record
 	outRid = pageRecordIter.getCurrentRecord();
 	return;
@@ -111,6 +243,11 @@ std::string FileScan::getRecord()
   return *pageRecordIter;
 }
 
+RecordView FileScan::viewRecord()
+{
+  return pageRecordIter.view();
+}
+
 // mark current page of scan dirty
 void FileScan::markDirty()
 {
@@ -9,6 +9,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include "types.h"
 #include "page.h"
 #include "buffer.h"
@@ -17,6 +18,21 @@
 
 namespace badgerdb {
 
+/**
+ * @brief Default number of consecutive pages a thread of FileScan::parallelScan() takes at a time.
+ */
+const std::size_t SCAN_MORSEL_PAGES = 16;
+
+/**
+ * @brief Called by FileScan::parallelScan() for every record of the relation.
+ *
+ * @param worker  Index, in [0, numThreads), of the thread the call is made on, e.g. to pick a per-thread accumulator
+ * @param rid     Record id of the record
+ * @param record  Contents of the record, valid until the call returns
+ * @param arg     Argument handed to parallelScan()
+ */
+typedef void (*RecordVisitor)(std::size_t worker, const RecordId &rid, const RecordView &record, void *arg);
+
 /**
  * @brief This class is used to sequentially scan records in a relation.
  */
@@ -24,7 +40,59 @@ class FileScan
 {
  public:
 
-  FileScan(const std::string &name, BufMgr *bufMgr);
+  /**
+   * Opens a scan over the relation.
+   *
+   * @param name      Name of the relation file
+   * @param bufMgr    Buffer manager to read the pages through
+   * @param ringSize  If not 0, pages not in the buffer pool are read into a BufferRing of that many frames, so the
+   *                  scan evicts no more than ringSize pages of the pool
+   */
+  FileScan(const std::string &name, BufMgr *bufMgr, const std::uint32_t ringSize = 0);
+
+  /**
+   * Opens a scan over a range of the relation's pages: from firstPage along the file's page list up to, but not
+   * including, endPage. Scans over disjoint ranges can run on different threads.
+   *
+   * @param name       Name of the relation file
+   * @param bufMgr     Buffer manager to read the pages through
+   * @param firstPage  First page of the range
+   * @param endPage    Page the range ends before, Page::INVALID_NUMBER to scan to the end of the file
+   * @param ringSize   As for the scan over the whole relation
+   */
+  FileScan(const std::string &name, BufMgr *bufMgr, const PageId firstPage, const PageId endPage,
+           const std::uint32_t ringSize = 0);
+
+  /**
+   * Splits the pages of a relation into at most numRanges ranges of about the same number of pages, in file order.
+   *
+   * @param name       Name of the relation file
+   * @param numRanges  Number of ranges wanted
+   * @return  The first page of every range; each range ends where the next one starts, the last one at the end
+   *          of the file. Empty if the relation has no pages.
+   */
+  static std::vector<PageId> partition(const std::string &name, const std::size_t numRanges);
+
+  /**
+   * Scans every record of a relation with several threads. The pages of the relation are handed out in morsels of
+   * consecutive pages; a thread that is done with its morsel takes the next one, so threads that are slowed down by
+   * the disk or by the visitor do not hold the others up. Each thread pins one page at a time and walks it with its
+   * own PageIterator. Records are visited in no particular order, and visitor is called on several threads at once.
+   *
+   * An exception thrown by visitor stops the scan: the other threads finish the page they are on, and it is
+   * rethrown once they have all stopped.
+   *
+   * @param name         Name of the relation file
+   * @param bufMgr       Buffer manager to read the pages through
+   * @param numThreads   Number of threads scanning, including the calling thread
+   * @param visitor      Called for every record
+   * @param arg          Passed on to visitor
+   * @param morselPages  Number of consecutive pages a thread takes at a time
+   * @param ringSize     If not 0, each thread reads pages not in the pool into its own BufferRing of that many frames
+   */
+  static void parallelScan(const std::string &name, BufMgr *bufMgr, const std::size_t numThreads,
+                           RecordVisitor visitor, void *arg, const std::size_t morselPages = SCAN_MORSEL_PAGES,
+                           const std::uint32_t ringSize = 0);
 
   ~FileScan();
 
@@ -34,6 +102,13 @@ class FileScan
   //read current record, returning pointer and length
   std::string getRecord();
 
+  /**
+   * Returns the current record in place on the pinned page, without copying it.
+   *
+   * @return  View of the record, valid until the next call to scanNext() or the end of the scan.
+   */
+  RecordView viewRecord();
+
   //marks current page of scan dirty
   void markDirty();
 
@@ -48,18 +123,34 @@ class FileScan
    */
 	BufMgr				*bufMgr;
 
+  /**
+   * Ring of frames the scan reads pages into, NULL to read them into the pool like everyone else.
+   */
+  BufferRing    *ring;
+
   /**
    * Current page being scanned.
    */
   Page*         curPage;
 
   FileIterator  filePageIter;
+
+  /**
+   * First page of the scanned range and the page it ends before.
+   */
+  FileIterator  rangeBegin;
+  FileIterator  rangeEnd;
   PageIterator  pageRecordIter;
 
   /**
    * True if page has been updated
    */
   bool  	      curDirtyFlag;
+
+  /**
+   * Reads and pins the page filePageIter is at into curPage, through the ring if the scan has one.
+   */
+  void readCurrentPage();
 };
 
 }
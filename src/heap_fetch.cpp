@@ -0,0 +1,175 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include "heap_fetch.h"
+#include "btree.h"
+#include "rid_bitmap.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+
+namespace badgerdb {
+
+/**
+ * Orders record ids by page, then by slot.
+ */
+static bool ridLess(const RecordId &a, const RecordId &b)
+{
+  return a.page_number < b.page_number || (a.page_number == b.page_number && a.slot_number < b.slot_number);
+}
+
+/**
+ * NextPageFn that ends read-ahead after the first page.
+ */
+static PageId noNextPage(const Page &)
+{
+  return Page::INVALID_NUMBER;
+}
+
+HeapFetch::HeapFetch(const std::string &name, BufMgr *bufferMgr, const std::uint32_t prefetchDepth)
+  : file(new PageFile(name, false)), bufMgr(bufferMgr), prefetchDepth(prefetchDepth), sorted(false), nextRid(0),
+    curPageIndex(0), nextPrefetch(0), curPage(NULL), numPagesRead(0)
+{
+  curRid.page_number = Page::INVALID_NUMBER;
+  curRid.slot_number = 0;
+  curRid.padding = 0;
+}
+
+HeapFetch::~HeapFetch()
+{
+  releasePage();
+  // also drops the read-ahead requests still waiting
+  bufMgr->flushFile(file);
+  delete file;
+}
+
+void HeapFetch::add(const RecordId &rid)
+{
+  add(&rid, 1);
+}
+
+void HeapFetch::add(const RecordId *added, const std::size_t count)
+{
+  releasePage();
+  rids.insert(rids.end(), added, added + count);
+  sorted = false;
+}
+
+void HeapFetch::add(const RidBitmap &bitmap)
+{
+  releasePage();
+  bitmap.toRids(rids);
+  sorted = false;
+}
+
+std::size_t HeapFetch::addScan(IndexScanCursor &cursor, const std::size_t batchSize)
+{
+  const std::size_t before = rids.size();
+  std::vector<RecordId> batch(std::max<std::size_t>(1, batchSize));
+  try
+  {
+    // a short batch means the scan reached the end of its range
+    std::size_t count;
+    do
+    {
+      count = cursor.scanNextBatch(&batch[0], batch.size());
+      add(&batch[0], count);
+    } while (count == batch.size());
+  }
+  catch (const IndexScanCompletedException &e)
+  {
+  }
+  cursor.endScan();
+  return rids.size() - before;
+}
+
+std::size_t HeapFetch::size()
+{
+  prepare();
+  return rids.size();
+}
+
+void HeapFetch::prepare()
+{
+  if (sorted)
+    return;
+
+  std::sort(rids.begin(), rids.end(), ridLess);
+  rids.erase(std::unique(rids.begin(), rids.end()), rids.end());
+  pages.clear();
+  for (std::size_t i = 0; i < rids.size(); i++)
+  {
+    if (pages.empty() || pages.back() != rids[i].page_number)
+      pages.push_back(rids[i].page_number);
+  }
+  nextRid = 0;
+  curPageIndex = 0;
+  nextPrefetch = 0;
+  sorted = true;
+}
+
+void HeapFetch::releasePage()
+{
+  if (curPage != NULL)
+  {
+    bufMgr->unPinPage(file, pages[curPageIndex], false);
+    curPage = NULL;
+    curPageIndex++;
+  }
+}
+
+void HeapFetch::readAhead()
+{
+  const std::size_t end = std::min<std::size_t>(pages.size(), curPageIndex + 1 + prefetchDepth);
+  for (nextPrefetch = std::max(nextPrefetch, curPageIndex + 1); nextPrefetch < end; nextPrefetch++)
+    bufMgr->prefetchPages(file, pages[nextPrefetch], 1, &noNextPage);
+}
+
+void HeapFetch::fetchNext(RecordId &outRid)
+{
+  prepare();
+  if (nextRid >= rids.size())
+  {
+    releasePage();
+    throw EndOfFileException();
+  }
+
+  const RecordId &rid = rids[nextRid];
+  if (curPage != NULL && pages[curPageIndex] != rid.page_number)
+    releasePage();
+  if (curPage == NULL)
+  {
+    // read like the index probes the fetch stands in for, so pages other fetches need stay in the pool
+    readAhead();
+    bufMgr->readPage(file, pages[curPageIndex], curPage);
+    numPagesRead++;
+  }
+
+  curRid = rid;
+  outRid = rid;
+  nextRid++;
+}
+
+RecordView HeapFetch::viewRecord() const
+{
+  return curPage->viewRecord(curRid);
+}
+
+std::string HeapFetch::getRecord() const
+{
+  return curPage->getRecord(curRid);
+}
+
+void HeapFetch::clear()
+{
+  releasePage();
+  rids.clear();
+  pages.clear();
+  sorted = false;
+}
+
+}
@@ -0,0 +1,203 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "types.h"
+#include "page.h"
+#include "buffer.h"
+
+namespace badgerdb {
+
+class IndexScanCursor;
+class RidBitmap;
+
+/**
+ * @brief Default number of heap pages a HeapFetch asks the buffer manager to read ahead of the page it is on.
+ */
+const std::uint32_t HEAP_FETCH_PREFETCH_DEPTH = 8;
+
+/**
+ * @brief Default number of record ids HeapFetch::addScan() takes from the scan at a time.
+ */
+const std::size_t HEAP_FETCH_BATCH_SIZE = 256;
+
+/**
+ * @brief Fetches the records of a set of record ids from a relation in page order, after the bitmap heap scan of
+ * PostgreSQL.
+ *
+ * An index scan returns record ids in key order, so fetching their records one by one reads the heap pages at
+ * random and reads a page again for every entry on it. A HeapFetch collects the record ids first, e.g. all those
+ * of an index scan, then sorts them by page and slot and drops duplicates, so that fetchNext() reads every page
+ * once, in ascending page number, while the buffer manager reads the next pages ahead in the background.
+ * Records come back in page order, not in the order their ids were added.
+ *
+ * One page is pinned at a time, from the first fetchNext() on it until the fetch moves past it or ends.
+ */
+class HeapFetch
+{
+ public:
+  /**
+   * Opens the relation to fetch records of. No record ids are collected yet.
+   *
+   * @param name           Name of the relation file
+   * @param bufMgr         Buffer manager to read the pages through
+   * @param prefetchDepth  Number of pages to have read ahead of the page being fetched from, 0 for none
+   */
+  HeapFetch(const std::string &name, BufMgr *bufMgr, const std::uint32_t prefetchDepth = HEAP_FETCH_PREFETCH_DEPTH);
+
+  ~HeapFetch();
+
+  /**
+   * Adds a record id to fetch. Adding ids after fetching started ends the fetch; the next fetchNext() starts
+   * over from the first page.
+   */
+  void add(const RecordId &rid);
+
+  /**
+   * Adds count record ids to fetch, like add(const RecordId&).
+   */
+  void add(const RecordId *added, const std::size_t count);
+
+  /**
+   * Adds the record ids of a set, e.g. the intersection of the results of scans on several indexes, like
+   * add(const RecordId&).
+   */
+  void add(const RidBitmap &bitmap);
+
+  /**
+   * Adds the record ids of the remaining entries of the scan running on a cursor, taking them batchSize at a
+   * time, and ends the cursor's scan.
+   *
+   * @param cursor     Cursor with a scan started on it
+   * @param batchSize  Number of record ids to take at a time
+   * @return  Number of record ids added.
+   * @throws ScanNotInitializedException If no scan has been initialized on the cursor.
+   */
+  std::size_t addScan(IndexScanCursor &cursor, const std::size_t batchSize = HEAP_FETCH_BATCH_SIZE);
+
+  /**
+   * Returns the number of distinct record ids collected.
+   */
+  std::size_t size();
+
+  /**
+   * Fetches the next record in page order.
+   *
+   * @param outRid  Record id of the record, whose contents viewRecord() and getRecord() return
+   * @throws EndOfFileException If every record was fetched.
+   */
+  void fetchNext(RecordId &outRid);
+
+  /**
+   * Returns the record last fetched in place on its pinned page, without copying it.
+   *
+   * @return  View of the record, valid until the next call to fetchNext() or add().
+   */
+  RecordView viewRecord() const;
+
+  /**
+   * Returns a copy of the record last fetched.
+   */
+  std::string getRecord() const;
+
+  /**
+   * Returns the number of heap pages read since the HeapFetch was opened, counting each page once per fetch.
+   */
+  std::size_t pagesRead() const
+  {
+    return numPagesRead;
+  }
+
+  /**
+   * Ends the fetch and drops the record ids collected.
+   */
+  void clear();
+
+ private:
+  HeapFetch(const HeapFetch &);
+  HeapFetch &operator=(const HeapFetch &);
+
+  /**
+   * Relation the records are fetched from.
+   */
+  PageFile *file;
+
+  /**
+   * Buffer Manager instance used to read pages into the buffer pool.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * Number of pages to have read ahead.
+   */
+  std::uint32_t prefetchDepth;
+
+  /**
+   * Record ids collected; sorted by page and slot, without duplicates, while sorted is true.
+   */
+  std::vector<RecordId> rids;
+
+  /**
+   * True once rids has been sorted for the fetch.
+   */
+  bool sorted;
+
+  /**
+   * Distinct pages of rids, in ascending order, valid while sorted is true.
+   */
+  std::vector<PageId> pages;
+
+  /**
+   * Index in rids of the next record to fetch.
+   */
+  std::size_t nextRid;
+
+  /**
+   * Index in pages of the pinned page, or of the next page to read if none is pinned.
+   */
+  std::size_t curPageIndex;
+
+  /**
+   * Index in pages of the first page not asked to be read ahead yet.
+   */
+  std::size_t nextPrefetch;
+
+  /**
+   * Pinned page the last record was fetched from, NULL if none.
+   */
+  Page *curPage;
+
+  /**
+   * Record id of the last record fetched.
+   */
+  RecordId curRid;
+
+  /**
+   * Number of heap pages read.
+   */
+  std::size_t numPagesRead;
+
+  /**
+   * Sorts the record ids collected and drops duplicates, once after they change.
+   */
+  void prepare();
+
+  /**
+   * Unpins the pinned page, if any.
+   */
+  void releasePage();
+
+  /**
+   * Asks for the pages up to prefetchDepth past the current one to be read ahead, those not asked for already.
+   */
+  void readAhead();
+};
+
+}
@@ -0,0 +1,265 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "io_backend.h"
+
+#include <aio.h>
+#include <cerrno>
+#include <cstring>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+#include "exceptions/io_error_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+SyncIoBackend syncBackend;
+IoBackend* defaultIoBackend = &syncBackend;
+
+/**
+ * Runs the part of the request past its first <done> bytes with pread/pwrite
+ * and returns the total number of bytes transferred.
+ */
+std::size_t transferSync(const IoRequest& request, std::size_t done) {
+  while (done < request.length) {
+    ssize_t n;
+    if (request.write) {
+      n = pwrite(request.fd, request.buffer + done, request.length - done,
+                 request.offset + done);
+    } else {
+      n = pread(request.fd, request.buffer + done, request.length - done,
+                request.offset + done);
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw IoErrorException(request.write ? "write" : "read", errno);
+    }
+    if (n == 0) {
+      // end of the file; only reads get here
+      break;
+    }
+    done += n;
+  }
+  return done;
+}
+
+/**
+ * Runs a vectored request with preadv/pwritev and returns the number of bytes
+ * transferred.
+ */
+std::size_t transferVectored(const IoRequest& request) {
+  std::vector<iovec> vectors(request.vectors,
+                             request.vectors + request.vectorCount);
+  std::size_t next = 0;
+  std::size_t done = 0;
+  while (next < vectors.size()) {
+    ssize_t n;
+    if (request.write) {
+      n = pwritev(request.fd, &vectors[next], vectors.size() - next,
+                  request.offset + done);
+    } else {
+      n = preadv(request.fd, &vectors[next], vectors.size() - next,
+                 request.offset + done);
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw IoErrorException(request.write ? "write" : "read", errno);
+    }
+    if (n == 0) {
+      break;
+    }
+    done += n;
+    // skip the buffers that were filled and trim the one that was not
+    std::size_t left = n;
+    while (next < vectors.size() && left >= vectors[next].iov_len) {
+      left -= vectors[next].iov_len;
+      next++;
+    }
+    if (next < vectors.size()) {
+      vectors[next].iov_base = static_cast<char*>(vectors[next].iov_base) + left;
+      vectors[next].iov_len -= left;
+    }
+  }
+  return done;
+}
+
+/**
+ * Waits until an aio control block is done and deletes it. Returns its error,
+ * 0 if it succeeded, and sets n to the number of bytes it transferred.
+ */
+int awaitControlBlock(aiocb* cb, ssize_t& n) {
+  int error;
+  while ((error = aio_error(cb)) == EINPROGRESS) {
+    aio_suspend(&cb, 1, NULL);
+  }
+  n = aio_return(cb);
+  delete cb;
+  return error;
+}
+
+/**
+ * Runs a request synchronously, vectored or not.
+ */
+std::size_t transfer(const IoRequest& request) {
+  if (request.vectors != NULL) {
+    return transferVectored(request);
+  }
+  return transferSync(request, 0);
+}
+
+}
+
+IoBackend* IoBackend::defaultBackend() {
+  return defaultIoBackend;
+}
+
+void IoBackend::setDefaultBackend(IoBackend* backend) {
+  defaultIoBackend = backend != NULL ? backend : &syncBackend;
+}
+
+void SyncIoBackend::submit(IoRequest* requests, const std::size_t count) {
+  for (std::size_t i = 0; i < count; i++) {
+    requests[i].transferred = transfer(requests[i]);
+  }
+}
+
+void SyncIoBackend::complete(IoRequest* requests, const std::size_t count) {
+}
+
+PosixAioBackend::~PosixAioBackend() {
+  // requests still in flight write into buffers the caller owns, so wait for
+  // them before their control blocks go away
+  for (std::map<const IoRequest*, std::vector<aiocb*> >::iterator it =
+           inFlight_.begin();
+       it != inFlight_.end(); ++it) {
+    for (std::size_t k = 0; k < it->second.size(); k++) {
+      ssize_t n;
+      awaitControlBlock(it->second[k], n);
+    }
+  }
+}
+
+void PosixAioBackend::submit(IoRequest* requests, const std::size_t count) {
+  for (std::size_t i = 0; i < count; i++) {
+    IoRequest& request = requests[i];
+    request.transferred = 0;
+
+    const int parts = request.vectors != NULL ? request.vectorCount : 1;
+    std::vector<aiocb*> cbs;
+    std::uint64_t offset = request.offset;
+    int error = 0;
+    for (int k = 0; k < parts; k++) {
+      aiocb* cb = new aiocb;
+      std::memset(cb, 0, sizeof(aiocb));
+      cb->aio_fildes = request.fd;
+      cb->aio_offset = offset;
+      if (request.vectors != NULL) {
+        cb->aio_buf = request.vectors[k].iov_base;
+        cb->aio_nbytes = request.vectors[k].iov_len;
+      } else {
+        cb->aio_buf = request.buffer;
+        cb->aio_nbytes = request.length;
+      }
+      cb->aio_sigevent.sigev_notify = SIGEV_NONE;
+      if ((request.write ? aio_write(cb) : aio_read(cb)) != 0) {
+        error = errno;
+        delete cb;
+        break;
+      }
+      cbs.push_back(cb);
+      offset += cb->aio_nbytes;
+    }
+
+    if (error != 0) {
+      // the buffers already queued are waited for, then the whole request
+      // runs synchronously or fails
+      for (std::size_t k = 0; k < cbs.size(); k++) {
+        ssize_t n;
+        awaitControlBlock(cbs[k], n);
+      }
+      if (error != EAGAIN) {
+        throw IoErrorException(request.write ? "write" : "read", error);
+      }
+      request.transferred = transfer(request);
+      continue;
+    }
+
+    std::lock_guard<std::mutex> guard(latch_);
+    inFlight_[&request].swap(cbs);
+  }
+}
+
+void PosixAioBackend::complete(IoRequest* requests, const std::size_t count) {
+  int firstError = 0;
+  bool firstErrorWrite = false;
+  for (std::size_t i = 0; i < count; i++) {
+    IoRequest& request = requests[i];
+    std::vector<aiocb*> cbs;
+    {
+      std::lock_guard<std::mutex> guard(latch_);
+      std::map<const IoRequest*, std::vector<aiocb*> >::iterator it =
+          inFlight_.find(&request);
+      if (it == inFlight_.end()) {
+        // ran synchronously in submit()
+        continue;
+      }
+      cbs.swap(it->second);
+      inFlight_.erase(it);
+    }
+
+    // every buffer is waited for, even after one failed, since they all
+    // belong to the caller
+    int error = 0;
+    bool whole = true;
+    std::size_t done = 0;
+    for (std::size_t k = 0; k < cbs.size(); k++) {
+      const std::size_t length = cbs[k]->aio_nbytes;
+      ssize_t n;
+      const int cbError = awaitControlBlock(cbs[k], n);
+      if (cbError != 0) {
+        if (error == 0) {
+          error = cbError;
+        }
+        continue;
+      }
+      done += n;
+      whole = whole && static_cast<std::size_t>(n) == length;
+    }
+
+    try {
+      if (error != 0) {
+        throw IoErrorException(request.write ? "write" : "read", error);
+      }
+      // like pread/pwrite, aio may stop short; finish the rest synchronously
+      if (whole) {
+        request.transferred = done;
+      } else if (request.vectors != NULL) {
+        request.transferred = transfer(request);
+      } else if (done > 0 || request.write) {
+        request.transferred = transferSync(request, done);
+      }
+    } catch (const IoErrorException& e) {
+      if (firstError == 0) {
+        firstError = e.error_code();
+        firstErrorWrite = request.write;
+      }
+    }
+  }
+
+  if (firstError != 0) {
+    throw IoErrorException(firstErrorWrite ? "write" : "read", firstError);
+  }
+}
+
+}
@@ -0,0 +1,177 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+struct aiocb;
+struct iovec;
+
+namespace badgerdb {
+
+/**
+ * @brief One read or write of a contiguous range of a file, handed to an
+ *        IoBackend.
+ *
+ * The request, and the buffer it points to, must stay alive until the backend
+ * has completed it.
+ */
+struct IoRequest {
+  /**
+   * File descriptor to read from or write to.
+   */
+  int fd;
+
+  /**
+   * True for a write, false for a read.
+   */
+  bool write;
+
+  /**
+   * Offset of the range in the file.
+   */
+  std::uint64_t offset;
+
+  /**
+   * Memory the range is read into or written from.
+   */
+  char* buffer;
+
+  /**
+   * Length of the range in bytes.
+   */
+  std::size_t length;
+
+  /**
+   * Number of bytes transferred, set when the request completes. Reads stop
+   * short at the end of the file; writes always transfer the whole range.
+   */
+  std::size_t transferred;
+
+  /**
+   * If not NULL, the range is scattered over (read) or gathered from (write)
+   * these buffers in order instead of buffer, and length is their total size.
+   */
+  const iovec* vectors;
+
+  /**
+   * Number of buffers in vectors, at most IOV_MAX.
+   */
+  int vectorCount;
+};
+
+/**
+ * @brief Interface through which File reads and writes pages.
+ *
+ * Requests are started in batches with submit() and waited for with
+ * complete(), so that a caller can have many reads or writes in flight and do
+ * other work in between. Backends may run a request at any point between the
+ * two calls, including inside submit().
+ */
+class IoBackend {
+ public:
+  virtual ~IoBackend() {}
+
+  /**
+   * Starts the given requests.
+   *
+   * @param requests  Requests to start.
+   * @param count     Number of requests.
+   * @throws  IoErrorException  If a request could not be started.
+   */
+  virtual void submit(IoRequest* requests, const std::size_t count) = 0;
+
+  /**
+   * Waits until all of the given requests, which must have been submitted
+   * through this backend, are done.
+   *
+   * @param requests  Requests to wait for.
+   * @param count     Number of requests.
+   * @throws  IoErrorException  If a request failed. All of the requests are
+   *                            done, successfully or not, when it is thrown.
+   */
+  virtual void complete(IoRequest* requests, const std::size_t count) = 0;
+
+  /**
+   * Submits the given requests and waits for them.
+   *
+   * @param requests  Requests to run.
+   * @param count     Number of requests.
+   * @throws  IoErrorException  If a request failed.
+   */
+  void execute(IoRequest* requests, const std::size_t count) {
+    submit(requests, count);
+    complete(requests, count);
+  }
+
+  /**
+   * Returns the backend newly opened files use.
+   */
+  static IoBackend* defaultBackend();
+
+  /**
+   * Sets the backend newly opened files use. Files that are already open keep
+   * theirs.
+   *
+   * @param backend   Backend to use; it must outlive every file using it.
+   *                  NULL restores the built-in SyncIoBackend.
+   */
+  static void setDefaultBackend(IoBackend* backend);
+};
+
+/**
+ * @brief IoBackend running every request with pread/pwrite (preadv/pwritev
+ *        for vectored requests) inside submit().
+ */
+class SyncIoBackend : public IoBackend {
+ public:
+  void submit(IoRequest* requests, const std::size_t count) override;
+
+  void complete(IoRequest* requests, const std::size_t count) override;
+};
+
+/**
+ * @brief IoBackend on POSIX asynchronous I/O. submit() queues every request
+ *        with aio_read/aio_write and returns; complete() suspends until they
+ *        are done.
+ *
+ * POSIX AIO has no vectored call, so a vectored request is queued as one read
+ * or write per buffer. Requests the system refuses to queue for lack of
+ * resources are run synchronously instead.
+ */
+class PosixAioBackend : public IoBackend {
+ public:
+  PosixAioBackend() {}
+
+  ~PosixAioBackend();
+
+  void submit(IoRequest* requests, const std::size_t count) override;
+
+  void complete(IoRequest* requests, const std::size_t count) override;
+
+ private:
+  PosixAioBackend(const PosixAioBackend&);
+  PosixAioBackend& operator=(const PosixAioBackend&);
+
+  /**
+   * Control blocks of the requests in flight, one per buffer of a vectored
+   * request. Requests run synchronously have none.
+   */
+  std::map<const IoRequest*, std::vector<aiocb*> > inFlight_;
+
+  /**
+   * Guards inFlight_, so one backend can serve several threads.
+   */
+  std::mutex latch_;
+};
+
+}
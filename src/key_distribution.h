@@ -0,0 +1,115 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace badgerdb
+{
+
+  /**
+   * @brief Draws values in [0, n) such that value k comes up in proportion to 1 / (k + 1)^theta, with the method of
+   * Gray et al., "Quickly Generating Billion-Record Synthetic Databases". theta is in (0, 1).
+   */
+  class ZipfGenerator
+  {
+  public:
+    ZipfGenerator(const std::uint64_t n, const double theta)
+      : n(n), theta(theta)
+    {
+      zetaN = zeta(n);
+      alpha = 1.0 / (1.0 - theta);
+      eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta(2) / zetaN);
+    }
+
+    std::uint64_t next(std::mt19937_64 &rng)
+    {
+      const double u = std::uniform_real_distribution<double>(0, 1)(rng);
+      const double uz = u * zetaN;
+      if (uz < 1.0)
+        return 0;
+      if (uz < 1.0 + std::pow(0.5, theta))
+        return 1;
+      const std::uint64_t value = static_cast<std::uint64_t>(n * std::pow(eta * u - eta + 1.0, alpha));
+      return std::min(value, n - 1);
+    }
+
+  private:
+    double zeta(const std::uint64_t count) const
+    {
+      double sum = 0;
+      for (std::uint64_t i = 1; i <= count; i++)
+        sum += 1.0 / std::pow(static_cast<double>(i), theta);
+      return sum;
+    }
+
+    std::uint64_t n;
+    double theta;
+    double zetaN;
+    double alpha;
+    double eta;
+  };
+
+  /**
+   * Generates n int keys in the order they are to be stored.
+   *
+   * - forward, backward: 0 to n - 1, ascending or descending
+   * - random: 0 to n - 1, shuffled
+   * - sparse: n distinct keys spread evenly over the positive ints, shuffled
+   * - zipf: n draws of a ZipfGenerator over [0, n), a few keys repeated many times and a long tail seen once or never
+   *
+   * @param distribution  One of the names above
+   * @param n             Number of keys
+   * @param zipfTheta     Skew of the zipf distribution, in (0, 1)
+   * @param rng           Source of the random order and draws
+   * @param keys          Set to the keys
+   * @return  False if the distribution is not one of the above.
+   */
+  inline bool generateKeys(const std::string &distribution, const int n, const double zipfTheta, std::mt19937_64 &rng,
+                           std::vector<int> &keys)
+  {
+    keys.resize(n);
+    if (distribution == "forward" || distribution == "random")
+    {
+      for (int i = 0; i < n; i++)
+        keys[i] = i;
+      if (distribution == "random")
+        std::shuffle(keys.begin(), keys.end(), rng);
+    }
+    else if (distribution == "backward")
+    {
+      for (int i = 0; i < n; i++)
+        keys[i] = n - 1 - i;
+    }
+    else if (distribution == "sparse")
+    {
+      const int stride = std::max(1, 0x7fffffff / std::max(1, n));
+      for (int i = 0; i < n; i++)
+        keys[i] = i * stride;
+      std::shuffle(keys.begin(), keys.end(), rng);
+    }
+    else if (distribution == "zipf")
+    {
+      ZipfGenerator zipf(n, zipfTheta);
+      for (int i = 0; i < n; i++)
+        keys[i] = static_cast<int>(zipf.next(rng));
+    }
+    else
+    {
+      keys.clear();
+      return false;
+    }
+    return true;
+  }
+
+}
@@ -0,0 +1,533 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace badgerdb
+{
+
+  /**
+   * @brief Portable key search policy. Works for any key type ordered by operator<.
+   *
+   * Both searches are branch-free binary searches: every probe halves the range with a conditional move, so a
+   * search costs log2(numKeys) comparisons and only touches the cache lines it probes.
+   */
+  struct ScalarKeySearch
+  {
+    /**
+     * Returns the number of keys in the sorted array that are smaller than key, i.e. the position of the
+     * first key not less than key.
+     *
+     * @param keys      Sorted keys.
+     * @param numKeys   Number of keys in use.
+     * @param key       Key to search for.
+     */
+    template <class T>
+    static int lowerBound(const T *keys, const int numKeys, const T &key)
+    {
+      const T *base = keys;
+      int len = numKeys;
+      while (len > 1)
+      {
+        const int half = len / 2;
+        base = (base[half] < key) ? base + half : base;
+        len -= half;
+      }
+      return (base - keys) + (len == 1 && *base < key);
+    }
+
+    /**
+     * Returns the number of keys in the sorted array that are not greater than key, i.e. the position of the
+     * first key greater than key.
+     *
+     * @param keys      Sorted keys.
+     * @param numKeys   Number of keys in use.
+     * @param key       Key to search for.
+     */
+    template <class T>
+    static int upperBound(const T *keys, const int numKeys, const T &key)
+    {
+      const T *base = keys;
+      int len = numKeys;
+      while (len > 1)
+      {
+        const int half = len / 2;
+        base = (key < base[half]) ? base : base + half;
+        len -= half;
+      }
+      return (base - keys) + (len == 1 && !(key < *base));
+    }
+  };
+
+  /**
+   * @brief Number of keys below which the SIMD policies stop halving the range and count the rest with vector
+   * compares. A few cache lines' worth, so the tail of the search costs a handful of loads instead of several
+   * dependent probes.
+   */
+  const int SIMD_SEARCH_WINDOW = 32;
+
+  /**
+   * @brief Key search policy for INTEGER keys built on a vector compare kernel. Halves the range like
+   * ScalarKeySearch until at most SIMD_SEARCH_WINDOW keys' worth of bytes remain, then counts the keys below the
+   * search key with Kernel::countLess / Kernel::countLessEqual. Besides int it takes the unsigned 8, 16 and 32-bit
+   * key distances of packed INTEGER leaves, whose windows hold as many more keys as they are narrower. Other key
+   * types fall back to ScalarKeySearch.
+   */
+  template <class Kernel>
+  struct SimdKeySearch : public ScalarKeySearch
+  {
+    using ScalarKeySearch::lowerBound;
+    using ScalarKeySearch::upperBound;
+
+    /**
+     * @see ScalarKeySearch::lowerBound
+     */
+    static int lowerBound(const int *keys, const int numKeys, const int &key)
+    {
+      return windowLowerBound(keys, numKeys, key);
+    }
+
+    static int lowerBound(const std::uint8_t *keys, const int numKeys, const std::uint8_t &key)
+    {
+      return windowLowerBound(keys, numKeys, key);
+    }
+
+    static int lowerBound(const std::uint16_t *keys, const int numKeys, const std::uint16_t &key)
+    {
+      return windowLowerBound(keys, numKeys, key);
+    }
+
+    static int lowerBound(const std::uint32_t *keys, const int numKeys, const std::uint32_t &key)
+    {
+      return windowLowerBound(keys, numKeys, key);
+    }
+
+    /**
+     * @see ScalarKeySearch::upperBound
+     */
+    static int upperBound(const int *keys, const int numKeys, const int &key)
+    {
+      return windowUpperBound(keys, numKeys, key);
+    }
+
+    static int upperBound(const std::uint8_t *keys, const int numKeys, const std::uint8_t &key)
+    {
+      return windowUpperBound(keys, numKeys, key);
+    }
+
+    static int upperBound(const std::uint16_t *keys, const int numKeys, const std::uint16_t &key)
+    {
+      return windowUpperBound(keys, numKeys, key);
+    }
+
+    static int upperBound(const std::uint32_t *keys, const int numKeys, const std::uint32_t &key)
+    {
+      return windowUpperBound(keys, numKeys, key);
+    }
+
+  private:
+    template <class K>
+    static int windowLowerBound(const K *keys, const int numKeys, const K key)
+    {
+      const int window = SIMD_SEARCH_WINDOW * (int)(sizeof(int) / (int)sizeof(K));
+      const K *base = keys;
+      int len = numKeys;
+      while (len > window)
+      {
+        const int half = len / 2;
+        base = (base[half] < key) ? base + half : base;
+        len -= half;
+      }
+      return (base - keys) + Kernel::countLess(base, len, key);
+    }
+
+    template <class K>
+    static int windowUpperBound(const K *keys, const int numKeys, const K key)
+    {
+      const int window = SIMD_SEARCH_WINDOW * (int)(sizeof(int) / (int)sizeof(K));
+      const K *base = keys;
+      int len = numKeys;
+      while (len > window)
+      {
+        const int half = len / 2;
+        base = (key < base[half]) ? base : base + half;
+        len -= half;
+      }
+      return (base - keys) + Kernel::countLessEqual(base, len, key);
+    }
+  };
+
+#if defined(__SSE2__)
+  /**
+   * @brief Compare kernel using 128-bit SSE compares, 4 int keys at a time.
+   */
+  struct SseKernel
+  {
+    /**
+     * Returns the number of the len keys starting at base that are smaller than key.
+     */
+    static int countLess(const int *base, const int len, const int key)
+    {
+      const __m128i needle = _mm_set1_epi32(key);
+      int count = 0;
+      int i = 0;
+      for (; i + 4 <= len; i += 4)
+      {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(base + i));
+        count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(needle, block))));
+      }
+      for (; i < len; i++)
+      {
+        count += (base[i] < key);
+      }
+      return count;
+    }
+
+    /**
+     * Returns the number of the len keys starting at base that are not greater than key.
+     */
+    static int countLessEqual(const int *base, const int len, const int key)
+    {
+      const __m128i needle = _mm_set1_epi32(key);
+      int count = 0;
+      int i = 0;
+      for (; i + 4 <= len; i += 4)
+      {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(base + i));
+        count += 4 - __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(block, needle))));
+      }
+      for (; i < len; i++)
+      {
+        count += !(key < base[i]);
+      }
+      return count;
+    }
+
+    /**
+     * Returns the unsigned key with its top bit flipped in every lane of its width. Flipped keys order as signed
+     * numbers, which is what the vector compares take.
+     */
+    static __m128i splat(const std::uint8_t key) { return _mm_set1_epi8((char)(key ^ 0x80)); }
+    static __m128i splat(const std::uint16_t key) { return _mm_set1_epi16((short)(key ^ 0x8000)); }
+    static __m128i splat(const std::uint32_t key) { return _mm_set1_epi32((int)(key ^ 0x80000000u)); }
+
+    /**
+     * Compares the lanes of the width of the last argument's type as signed numbers.
+     */
+    static __m128i greater(const __m128i a, const __m128i b, std::uint8_t) { return _mm_cmpgt_epi8(a, b); }
+    static __m128i greater(const __m128i a, const __m128i b, std::uint16_t) { return _mm_cmpgt_epi16(a, b); }
+    static __m128i greater(const __m128i a, const __m128i b, std::uint32_t) { return _mm_cmpgt_epi32(a, b); }
+
+    /**
+     * Returns the number of the len keys starting at base that are smaller than key.
+     */
+    template <class K>
+    static int countLess(const K *base, const int len, const K key)
+    {
+      const int lanes = 16 / (int)sizeof(K);
+      const __m128i bias = splat(K(0));
+      const __m128i needle = splat(key);
+      int count = 0;
+      int i = 0;
+      for (; i + lanes <= len; i += lanes)
+      {
+        const __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(base + i)), bias);
+        count += __builtin_popcount(_mm_movemask_epi8(greater(needle, block, K()))) / (int)sizeof(K);
+      }
+      for (; i < len; i++)
+      {
+        count += (base[i] < key);
+      }
+      return count;
+    }
+
+    /**
+     * Returns the number of the len keys starting at base that are not greater than key.
+     */
+    template <class K>
+    static int countLessEqual(const K *base, const int len, const K key)
+    {
+      const int lanes = 16 / (int)sizeof(K);
+      const __m128i bias = splat(K(0));
+      const __m128i needle = splat(key);
+      int count = 0;
+      int i = 0;
+      for (; i + lanes <= len; i += lanes)
+      {
+        const __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(base + i)), bias);
+        count += lanes - __builtin_popcount(_mm_movemask_epi8(greater(block, needle, K()))) / (int)sizeof(K);
+      }
+      for (; i < len; i++)
+      {
+        count += !(key < base[i]);
+      }
+      return count;
+    }
+  };
+
+  typedef SimdKeySearch<SseKernel> SseKeySearch;
+#endif
+
+#if defined(__AVX2__)
+  /**
+   * @brief Compare kernel using 256-bit AVX2 compares, 8 int keys at a time.
+   */
+  struct Avx2Kernel
+  {
+    /**
+     * Returns the number of the len keys starting at base that are smaller than key.
+     */
+    static int countLess(const int *base, const int len, const int key)
+    {
+      const __m256i needle = _mm256_set1_epi32(key);
+      int count = 0;
+      int i = 0;
+      for (; i + 8 <= len; i += 8)
+      {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(base + i));
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, block))));
+      }
+      for (; i < len; i++)
+      {
+        count += (base[i] < key);
+      }
+      return count;
+    }
+
+    /**
+     * Returns the number of the len keys starting at base that are not greater than key.
+     */
+    static int countLessEqual(const int *base, const int len, const int key)
+    {
+      const __m256i needle = _mm256_set1_epi32(key);
+      int count = 0;
+      int i = 0;
+      for (; i + 8 <= len; i += 8)
+      {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(base + i));
+        count += 8 - __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(block, needle))));
+      }
+      for (; i < len; i++)
+      {
+        count += !(key < base[i]);
+      }
+      return count;
+    }
+
+    /**
+     * Returns the unsigned key with its top bit flipped in every lane of its width. Flipped keys order as signed
+     * numbers, which is what the vector compares take.
+     */
+    static __m256i splat(const std::uint8_t key) { return _mm256_set1_epi8((char)(key ^ 0x80)); }
+    static __m256i splat(const std::uint16_t key) { return _mm256_set1_epi16((short)(key ^ 0x8000)); }
+    static __m256i splat(const std::uint32_t key) { return _mm256_set1_epi32((int)(key ^ 0x80000000u)); }
+
+    /**
+     * Compares the lanes of the width of the last argument's type as signed numbers.
+     */
+    static __m256i greater(const __m256i a, const __m256i b, std::uint8_t) { return _mm256_cmpgt_epi8(a, b); }
+    static __m256i greater(const __m256i a, const __m256i b, std::uint16_t) { return _mm256_cmpgt_epi16(a, b); }
+    static __m256i greater(const __m256i a, const __m256i b, std::uint32_t) { return _mm256_cmpgt_epi32(a, b); }
+
+    /**
+     * Returns the number of the len keys starting at base that are smaller than key.
+     */
+    template <class K>
+    static int countLess(const K *base, const int len, const K key)
+    {
+      const int lanes = 32 / (int)sizeof(K);
+      const __m256i bias = splat(K(0));
+      const __m256i needle = splat(key);
+      int count = 0;
+      int i = 0;
+      for (; i + lanes <= len; i += lanes)
+      {
+        const __m256i block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(base + i)), bias);
+        count += __builtin_popcount(_mm256_movemask_epi8(greater(needle, block, K()))) / (int)sizeof(K);
+      }
+      for (; i < len; i++)
+      {
+        count += (base[i] < key);
+      }
+      return count;
+    }
+
+    /**
+     * Returns the number of the len keys starting at base that are not greater than key.
+     */
+    template <class K>
+    static int countLessEqual(const K *base, const int len, const K key)
+    {
+      const int lanes = 32 / (int)sizeof(K);
+      const __m256i bias = splat(K(0));
+      const __m256i needle = splat(key);
+      int count = 0;
+      int i = 0;
+      for (; i + lanes <= len; i += lanes)
+      {
+        const __m256i block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(base + i)), bias);
+        count += lanes - __builtin_popcount(_mm256_movemask_epi8(greater(block, needle, K()))) / (int)sizeof(K);
+      }
+      for (; i < len; i++)
+      {
+        count += !(key < base[i]);
+      }
+      return count;
+    }
+  };
+
+  typedef SimdKeySearch<Avx2Kernel> Avx2KeySearch;
+#endif
+
+  /**
+   * @brief Number of keys on either side of its predicted position InterpolationKeySearch looks for a key in
+   * before it gives up on the prediction.
+   */
+  const int INTERPOLATION_WINDOW = 8;
+
+  /**
+   * @brief Key search policy for INTEGER keys that are spread about evenly, like dense ids. The position of the
+   * key is predicted by interpolating between the first and the last key. If the key belongs within
+   * INTERPOLATION_WINDOW keys of the prediction, which takes two compares to tell, Base searches just that
+   * window; otherwise it searches the whole array as it would have anyway. Like SimdKeySearch it also takes the
+   * unsigned key distances of packed INTEGER leaves. Other key types, and arrays too short to gain from it, go to
+   * Base directly.
+   */
+  template <class Base>
+  struct InterpolationKeySearch : public Base
+  {
+    using Base::lowerBound;
+    using Base::upperBound;
+
+    /**
+     * @see ScalarKeySearch::lowerBound
+     */
+    static int lowerBound(const int *keys, const int numKeys, const int &key)
+    {
+      return interpolatedLowerBound(keys, numKeys, key);
+    }
+
+    static int lowerBound(const std::uint8_t *keys, const int numKeys, const std::uint8_t &key)
+    {
+      return interpolatedLowerBound(keys, numKeys, key);
+    }
+
+    static int lowerBound(const std::uint16_t *keys, const int numKeys, const std::uint16_t &key)
+    {
+      return interpolatedLowerBound(keys, numKeys, key);
+    }
+
+    static int lowerBound(const std::uint32_t *keys, const int numKeys, const std::uint32_t &key)
+    {
+      return interpolatedLowerBound(keys, numKeys, key);
+    }
+
+    /**
+     * @see ScalarKeySearch::upperBound
+     */
+    static int upperBound(const int *keys, const int numKeys, const int &key)
+    {
+      return interpolatedUpperBound(keys, numKeys, key);
+    }
+
+    static int upperBound(const std::uint8_t *keys, const int numKeys, const std::uint8_t &key)
+    {
+      return interpolatedUpperBound(keys, numKeys, key);
+    }
+
+    static int upperBound(const std::uint16_t *keys, const int numKeys, const std::uint16_t &key)
+    {
+      return interpolatedUpperBound(keys, numKeys, key);
+    }
+
+    static int upperBound(const std::uint32_t *keys, const int numKeys, const std::uint32_t &key)
+    {
+      return interpolatedUpperBound(keys, numKeys, key);
+    }
+
+  private:
+    template <class K>
+    static int interpolatedLowerBound(const K *keys, const int numKeys, const K &key)
+    {
+      int low;
+      int high;
+      if (predict(keys, numKeys, key, low, high) &&
+          (low == 0 || keys[low - 1] < key) && (high == numKeys || !(keys[high] < key)))
+      {
+        return low + Base::lowerBound(keys + low, high - low, key);
+      }
+      return Base::lowerBound(keys, numKeys, key);
+    }
+
+    template <class K>
+    static int interpolatedUpperBound(const K *keys, const int numKeys, const K &key)
+    {
+      int low;
+      int high;
+      if (predict(keys, numKeys, key, low, high) &&
+          (low == 0 || !(key < keys[low - 1])) && (high == numKeys || key < keys[high]))
+      {
+        return low + Base::upperBound(keys + low, high - low, key);
+      }
+      return Base::upperBound(keys, numKeys, key);
+    }
+
+    /**
+     * Predict where the key goes and set [low, high) to the window of keys around it.
+     *
+     * @return  False if the array is too short or its keys all equal, so there is nothing to interpolate.
+     */
+    template <class K>
+    static bool predict(const K *keys, const int numKeys, const K key, int &low, int &high)
+    {
+      if (numKeys <= 4 * INTERPOLATION_WINDOW || keys[0] == keys[numKeys - 1])
+      {
+        return false;
+      }
+      const long long first = keys[0];
+      const long long span = (long long)keys[numKeys - 1] - first;
+      const long long offset = std::min(std::max((long long)key - first, 0LL), span);
+      const int position = (int)(offset * (numKeys - 1) / span);
+      low = std::max(position - INTERPOLATION_WINDOW, 0);
+      high = std::min(position + INTERPOLATION_WINDOW + 1, numKeys);
+      return true;
+    }
+  };
+
+  /**
+   * @brief Binary key search policy, picked at compile time from the instruction sets the build targets (e.g.
+   * make ARCH_FLAGS=-mavx2). Define BADGERDB_SCALAR_SEARCH to force the portable version.
+   */
+#if defined(BADGERDB_SCALAR_SEARCH)
+  typedef ScalarKeySearch BinaryKeySearch;
+#elif defined(__AVX2__)
+  typedef Avx2KeySearch BinaryKeySearch;
+#elif defined(__SSE2__)
+  typedef SseKeySearch BinaryKeySearch;
+#else
+  typedef ScalarKeySearch BinaryKeySearch;
+#endif
+
+  /**
+   * @brief Key search policy used by BTreeIndex. Define BADGERDB_INTERPOLATION_SEARCH (e.g. make
+   * ARCH_FLAGS=-DBADGERDB_INTERPOLATION_SEARCH) to have INTEGER keys found by interpolation first, for indexes on
+   * dense ids.
+   */
+#if defined(BADGERDB_INTERPOLATION_SEARCH)
+  typedef InterpolationKeySearch<BinaryKeySearch> KeySearch;
+#else
+  typedef BinaryKeySearch KeySearch;
+#endif
+
+}
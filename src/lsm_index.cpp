@@ -0,0 +1,971 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "lsm_index.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include "filescan.h"
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_scanrange_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/scan_not_initialized_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/io_error_exception.h"
+
+namespace badgerdb
+{
+
+	// -----------------------------------------------------------------------------
+	// Keys of the runs
+	// -----------------------------------------------------------------------------
+
+	/**
+	 * Returns the smallest key of type T, the low end of a scan over a whole run.
+	 */
+	template <class T>
+	static T lowestKey();
+
+	template <>
+	int lowestKey<int>()
+	{
+		return std::numeric_limits<int>::min();
+	}
+
+	template <>
+	double lowestKey<double>()
+	{
+		return -std::numeric_limits<double>::infinity();
+	}
+
+	template <>
+	StringKey lowestKey<StringKey>()
+	{
+		StringKey key;
+		memset(key.data, 0, STRINGSIZE);
+		return key;
+	}
+
+	/**
+	 * Returns the largest key of type T, the high end of a scan over a whole run.
+	 */
+	template <class T>
+	static T highestKey();
+
+	template <>
+	int highestKey<int>()
+	{
+		return std::numeric_limits<int>::max();
+	}
+
+	template <>
+	double highestKey<double>()
+	{
+		return std::numeric_limits<double>::infinity();
+	}
+
+	template <>
+	StringKey highestKey<StringKey>()
+	{
+		StringKey key;
+		memset(key.data, 0xff, STRINGSIZE);
+		return key;
+	}
+
+	/**
+	 * Returns the key as it is hashed into the Bloom filters: equal keys must have equal bytes.
+	 */
+	template <class T>
+	static T bloomKey(const T &key)
+	{
+		return key;
+	}
+
+	template <>
+	double bloomKey<double>(const double &key)
+	{
+		// -0.0 equals 0.0
+		return key == 0.0 ? 0.0 : key;
+	}
+
+	/**
+	 * Returns true if the key lies in the range of a scan.
+	 */
+	template <class T>
+	static bool inRange(const T &key, const T &low, const Operator lowOp, const T &high, const Operator highOp)
+	{
+		const bool aboveLow = (lowOp == GT) ? low < key : !(key < low);
+		const bool belowHigh = (highOp == LT) ? key < high : !(high < key);
+		return aboveLow && belowHigh;
+	}
+
+	/**
+	 * Append the entry <key, rid> to the bytes of a memtable.
+	 */
+	template <class T>
+	static void appendPair(std::vector<char> &pairs, const void *key, const RecordId rid)
+	{
+		RIDKeyPair<T> pair;
+		pair.set(rid, loadKey<T>(key));
+		const char *bytes = reinterpret_cast<const char *>(&pair);
+		pairs.insert(pairs.end(), bytes, bytes + sizeof(pair));
+	}
+
+	// -----------------------------------------------------------------------------
+	// Sorted entry sources
+	// -----------------------------------------------------------------------------
+
+	/**
+	 * Entries of a sorted vector.
+	 */
+	template <class T>
+	class SortedPairs : public SortedEntrySource
+	{
+	public:
+		explicit SortedPairs(const std::vector<RIDKeyPair<T> > &pairs) : pairs(pairs), nextPair(0)
+		{
+		}
+
+		bool next(void *outKey, RecordId &outRid)
+		{
+			if (nextPair == pairs.size())
+			{
+				return false;
+			}
+			if (outKey != NULL)
+			{
+				memcpy(outKey, &pairs[nextPair].key, sizeof(T));
+			}
+			outRid = pairs[nextPair].rid;
+			nextPair++;
+			return true;
+		}
+
+	private:
+		const std::vector<RIDKeyPair<T> > &pairs;
+		std::size_t nextPair;
+	};
+
+	/**
+	 * Entries in a range of keys of several runs and of a sorted copy of memtable entries, merged in key order.
+	 * Holds on to the runs until it is destroyed.
+	 */
+	template <class T>
+	class MergedRuns : public SortedEntrySource
+	{
+	public:
+		/**
+		 * Starts a scan of the range on every run. Takes the memtable entries out of memory, which must be sorted
+		 * and in the range.
+		 */
+		MergedRuns(const std::vector<std::shared_ptr<LsmRun> > &runs, const T &low, const Operator lowOp, const T &high,
+				   const Operator highOp, std::vector<RIDKeyPair<T> > &memory)
+			: runs(runs), heads(runs.size()), live(runs.size(), false), memoryNext(0)
+		{
+			this->memory.swap(memory);
+			for (std::size_t k = 0; k < runs.size(); k++)
+			{
+				cursors.push_back(std::unique_ptr<IndexScanCursor>(new IndexScanCursor(runs[k]->index)));
+				try
+				{
+					cursors[k]->startScan(&low, lowOp, &high, highOp);
+				}
+				catch (NoSuchKeyFoundException &e)
+				{
+					continue;
+				}
+				live[k] = true;
+				advance(k);
+			}
+		}
+
+		bool next(void *outKey, RecordId &outRid)
+		{
+			// a handful of runs, so the smallest head is found by looking at each
+			int best = -1;
+			for (std::size_t k = 0; k < heads.size(); k++)
+			{
+				if (live[k] && (best < 0 || heads[k] < heads[best]))
+				{
+					best = k;
+				}
+			}
+			RIDKeyPair<T> pair;
+			if (memoryNext < memory.size() && (best < 0 || memory[memoryNext] < heads[best]))
+			{
+				pair = memory[memoryNext++];
+			}
+			else if (best >= 0)
+			{
+				pair = heads[best];
+				advance(best);
+			}
+			else
+			{
+				return false;
+			}
+			if (outKey != NULL)
+			{
+				memcpy(outKey, &pair.key, sizeof(T));
+			}
+			outRid = pair.rid;
+			return true;
+		}
+
+		/**
+		 * Returns true if no entry is left.
+		 */
+		bool exhausted() const
+		{
+			return memoryNext == memory.size() && std::find(live.begin(), live.end(), true) == live.end();
+		}
+
+	private:
+		/**
+		 * Move the head of run k on to its next entry.
+		 */
+		void advance(const std::size_t k)
+		{
+			try
+			{
+				RecordId rid;
+				T key;
+				cursors[k]->scanNext(rid, &key);
+				heads[k].set(rid, key);
+			}
+			catch (IndexScanCompletedException &e)
+			{
+				live[k] = false;
+			}
+		}
+
+		// the cursors go before the runs they scan
+		std::vector<std::shared_ptr<LsmRun> > runs;
+		std::vector<std::unique_ptr<IndexScanCursor> > cursors;
+		std::vector<RIDKeyPair<T> > heads;
+		std::vector<bool> live;
+		std::vector<RIDKeyPair<T> > memory;
+		std::size_t memoryNext;
+	};
+
+	/**
+	 * Passes the entries of another source on to the bulk loader of a run, adding their keys to the run's Bloom
+	 * filter and counting them.
+	 */
+	template <class T>
+	class RunFeed : public SortedEntrySource
+	{
+	public:
+		RunFeed(SortedEntrySource &source, BloomFilter &bloom) : count(0), source(source), bloom(bloom)
+		{
+		}
+
+		bool next(void *outKey, RecordId &outRid)
+		{
+			T key;
+			if (!source.next(&key, outRid))
+			{
+				return false;
+			}
+			const T hashed = bloomKey(key);
+			bloom.add(&hashed, sizeof(T));
+			count++;
+			if (outKey != NULL)
+			{
+				memcpy(outKey, &key, sizeof(T));
+			}
+			return true;
+		}
+
+		/**
+		 * Number of entries passed on.
+		 */
+		std::size_t count;
+
+	private:
+		SortedEntrySource &source;
+		BloomFilter &bloom;
+	};
+
+	/**
+	 * Stands in for the entries of a run that already exists, which BTreeIndex opens without reading its source.
+	 */
+	class NoEntries : public SortedEntrySource
+	{
+	public:
+		bool next(void *outKey, RecordId &outRid)
+		{
+			return false;
+		}
+	};
+
+	/**
+	 * Returns the options runs are bulk loaded with: they never change, so their nodes are filled up.
+	 */
+	static BTreeOptions runOptions()
+	{
+		BTreeOptions options;
+		options.fillFactor = 1.0;
+		return options;
+	}
+
+	// -----------------------------------------------------------------------------
+	// LsmRun
+	// -----------------------------------------------------------------------------
+
+	LsmRun::~LsmRun()
+	{
+		delete index;
+		try
+		{
+			if (obsolete && File::exists(name))
+			{
+				File::remove(name);
+			}
+		}
+		catch (BadgerDbException &e)
+		{
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// LsmIndex::LsmIndex -- Constructor
+	// -----------------------------------------------------------------------------
+
+	LsmIndex::LsmIndex(const std::string &relationName,
+					   std::string &outIndexName,
+					   BufMgr *bufMgrIn,
+					   const int attrByteOffset,
+					   const Datatype attrType,
+					   const LsmOptions &options)
+		: bufMgr(bufMgrIn), relationName(relationName), attributeType(attrType), attrByteOffset(attrByteOffset),
+		  options(options), memCount(0), frozenCount(0), nextRunNo(0), stopping(false)
+	{
+		if (attrType != INTEGER && attrType != DOUBLE && attrType != STRING)
+		{
+			throw BadIndexInfoException("An LSM index takes INTEGER, DOUBLE or STRING keys");
+		}
+		this->options.compactionFanIn = std::max<std::size_t>(2, options.compactionFanIn);
+
+		std::ostringstream idxStr;
+		idxStr << relationName << '.' << attrByteOffset << ".lsm";
+		outIndexName = idxStr.str();
+		indexName = outIndexName;
+
+		const bool exists = File::exists(indexName);
+		if (exists)
+		{
+			readManifest();
+		}
+		else
+		{
+			std::lock_guard<std::mutex> guard(latch);
+			writeManifest();
+		}
+
+		if (this->options.backgroundCompaction)
+		{
+			compactor = std::thread(&LsmIndex::compactLoop, this);
+		}
+		if (!exists)
+		{
+			try
+			{
+				build();
+			}
+			catch (...)
+			{
+				{
+					std::lock_guard<std::mutex> guard(latch);
+					stopping = true;
+				}
+				compactWake.notify_all();
+				if (compactor.joinable())
+				{
+					compactor.join();
+				}
+				throw;
+			}
+		}
+	}
+
+	void LsmIndex::build()
+	{
+		FileScan scanner(relationName, bufMgr);
+		RecordId rid;
+		while (true)
+		{
+			try
+			{
+				scanner.scanNext(rid);
+			}
+			catch (EndOfFileException &e)
+			{
+				break;
+			}
+			const RecordView record = scanner.viewRecord();
+			insertEntry(record.data + attrByteOffset, rid);
+		}
+		flush();
+	}
+
+	// -----------------------------------------------------------------------------
+	// LsmIndex::~LsmIndex -- destructor
+	// -----------------------------------------------------------------------------
+
+	LsmIndex::~LsmIndex()
+	{
+		{
+			std::lock_guard<std::mutex> guard(latch);
+			stopping = true;
+		}
+		compactWake.notify_all();
+		if (compactor.joinable())
+		{
+			compactor.join();
+		}
+		scanSource.reset();
+		try
+		{
+			flush();
+		}
+		catch (BadgerDbException &e)
+		{
+		}
+		runs.clear();
+	}
+
+	// -----------------------------------------------------------------------------
+	// LsmIndex manifest
+	// -----------------------------------------------------------------------------
+	// The manifest holds the number of the next run on its first line, then the number and the entry count of
+	// each run, oldest first, one run per line.
+
+	std::string LsmIndex::runName(const std::uint64_t runNo) const
+	{
+		std::ostringstream name;
+		name << indexName << '.' << runNo;
+		return name.str();
+	}
+
+	void LsmIndex::readManifest()
+	{
+		std::ifstream in(indexName.c_str());
+		in >> nextRunNo;
+		std::uint64_t runNo;
+		std::size_t entries;
+		while (in >> runNo >> entries)
+		{
+			std::shared_ptr<LsmRun> run(new LsmRun());
+			run->runNo = runNo;
+			run->name = runName(runNo);
+			run->entries = entries;
+			NoEntries none;
+			run->index = new BTreeIndex(relationName, run->name, bufMgr, attrByteOffset, attributeType, none, runOptions());
+			if (attributeType == INTEGER)
+			{
+				loadBloom<int>(run);
+			}
+			else if (attributeType == DOUBLE)
+			{
+				loadBloom<double>(run);
+			}
+			else
+			{
+				loadBloom<StringKey>(run);
+			}
+			runs.push_back(run);
+		}
+	}
+
+	void LsmIndex::remove(const std::string &indexName)
+	{
+		if (!File::exists(indexName))
+		{
+			throw FileNotFoundException(indexName);
+		}
+		std::ifstream in(indexName.c_str());
+		std::uint64_t runNo;
+		std::size_t entries;
+		in >> runNo;
+		while (in >> runNo >> entries)
+		{
+			std::ostringstream name;
+			name << indexName << '.' << runNo;
+			if (File::exists(name.str()))
+			{
+				File::remove(name.str());
+			}
+		}
+		in.close();
+		std::remove(indexName.c_str());
+	}
+
+	void LsmIndex::writeManifest()
+	{
+		// write a new manifest next to the old one and move it over, so a crash leaves one or the other
+		const std::string tmpName = indexName + ".tmp";
+		{
+			std::ofstream out(tmpName.c_str(), std::ios::out | std::ios::trunc);
+			out << nextRunNo << '\n';
+			for (std::size_t k = 0; k < runs.size(); k++)
+			{
+				out << runs[k]->runNo << ' ' << runs[k]->entries << '\n';
+			}
+			out.close();
+			if (out.fail())
+			{
+				throw IoErrorException("write", errno);
+			}
+		}
+		if (std::rename(tmpName.c_str(), indexName.c_str()) != 0)
+		{
+			throw IoErrorException("rename", errno);
+		}
+	}
+
+	template <class T>
+	void LsmIndex::loadBloom(const std::shared_ptr<LsmRun> &run)
+	{
+		run->bloom = BloomFilter(run->entries, options.bloomBitsPerKey);
+		std::vector<std::shared_ptr<LsmRun> > single(1, run);
+		std::vector<RIDKeyPair<T> > none;
+		MergedRuns<T> source(single, lowestKey<T>(), GTE, highestKey<T>(), LTE, none);
+		RunFeed<T> feed(source, run->bloom);
+		RecordId rid;
+		while (feed.next(NULL, rid))
+		{
+		}
+		run->entries = feed.count;
+	}
+
+	// -----------------------------------------------------------------------------
+	// LsmIndex::insertEntry
+	// -----------------------------------------------------------------------------
+
+	void LsmIndex::insertEntry(const void *key, const RecordId rid)
+	{
+		bool full;
+		{
+			std::lock_guard<std::mutex> guard(latch);
+			if (attributeType == INTEGER)
+			{
+				appendPair<int>(memPairs, key, rid);
+			}
+			else if (attributeType == DOUBLE)
+			{
+				appendPair<double>(memPairs, key, rid);
+			}
+			else
+			{
+				appendPair<StringKey>(memPairs, key, rid);
+			}
+			full = (++memCount >= options.memtableSize);
+		}
+		if (full)
+		{
+			flush();
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// LsmIndex::flush
+	// -----------------------------------------------------------------------------
+
+	void LsmIndex::flush()
+	{
+		std::lock_guard<std::mutex> flushGuard(flushLatch);
+		std::uint64_t runNo;
+		{
+			// freeze the memtable; lookups and scans go on reading it until its run is in place
+			std::lock_guard<std::mutex> guard(latch);
+			if (memCount == 0)
+			{
+				return;
+			}
+			frozenPairs.swap(memPairs);
+			frozenCount = memCount;
+			memPairs.clear();
+			memCount = 0;
+			runNo = nextRunNo++;
+		}
+
+		std::shared_ptr<LsmRun> run;
+		try
+		{
+			if (attributeType == INTEGER)
+			{
+				run = writeRun<int>(runNo);
+			}
+			else if (attributeType == DOUBLE)
+			{
+				run = writeRun<double>(runNo);
+			}
+			else
+			{
+				run = writeRun<StringKey>(runNo);
+			}
+		}
+		catch (...)
+		{
+			// put the entries back ahead of the ones inserted meanwhile, so none is lost
+			std::lock_guard<std::mutex> guard(latch);
+			frozenPairs.insert(frozenPairs.end(), memPairs.begin(), memPairs.end());
+			memPairs.swap(frozenPairs);
+			memCount += frozenCount;
+			frozenPairs.clear();
+			frozenCount = 0;
+			throw;
+		}
+
+		bool merge;
+		{
+			std::lock_guard<std::mutex> guard(latch);
+			runs.push_back(run);
+			frozenPairs.clear();
+			frozenCount = 0;
+			writeManifest();
+			merge = (runs.size() >= options.compactionFanIn);
+		}
+		counters.flushes.fetch_add(1, std::memory_order_relaxed);
+
+		if (merge)
+		{
+			if (options.backgroundCompaction)
+			{
+				compactWake.notify_one();
+			}
+			else
+			{
+				mergeRuns(options.compactionFanIn);
+			}
+		}
+	}
+
+	template <class T>
+	std::shared_ptr<LsmRun> LsmIndex::writeRun(const std::uint64_t runNo)
+	{
+		// equal keys keep the order they were inserted in
+		const RIDKeyPair<T> *frozen = reinterpret_cast<const RIDKeyPair<T> *>(frozenPairs.data());
+		std::vector<RIDKeyPair<T> > pairs(frozen, frozen + frozenCount);
+		std::stable_sort(pairs.begin(), pairs.end());
+		SortedPairs<T> source(pairs);
+		return buildRun<T>(source, runNo, pairs.size());
+	}
+
+	template <class T>
+	std::shared_ptr<LsmRun> LsmIndex::buildRun(SortedEntrySource &source, const std::uint64_t runNo,
+											   const std::size_t expectedEntries)
+	{
+		std::shared_ptr<LsmRun> run(new LsmRun());
+		run->runNo = runNo;
+		run->name = runName(runNo);
+		run->bloom = BloomFilter(expectedEntries, options.bloomBitsPerKey);
+
+		// a file of that name can only be left over from a merge cut short, BTreeIndex would open it
+		if (File::exists(run->name))
+		{
+			File::remove(run->name);
+		}
+		RunFeed<T> feed(source, run->bloom);
+		try
+		{
+			run->index = new BTreeIndex(relationName, run->name, bufMgr, attrByteOffset, attributeType, feed, runOptions());
+		}
+		catch (...)
+		{
+			run->obsolete = true;
+			throw;
+		}
+		run->entries = feed.count;
+		return run;
+	}
+
+	// -----------------------------------------------------------------------------
+	// LsmIndex::compact
+	// -----------------------------------------------------------------------------
+
+	void LsmIndex::compact()
+	{
+		flush();
+		mergeRuns(2);
+	}
+
+	void LsmIndex::mergeRuns(const std::size_t minRuns)
+	{
+		std::lock_guard<std::mutex> compactGuard(compactLatch);
+		std::vector<std::shared_ptr<LsmRun> > merged;
+		std::uint64_t runNo;
+		{
+			std::lock_guard<std::mutex> guard(latch);
+			if (runs.size() < minRuns)
+			{
+				return;
+			}
+			merged = runs;
+			runNo = nextRunNo++;
+		}
+
+		std::size_t entries = 0;
+		for (std::size_t k = 0; k < merged.size(); k++)
+		{
+			entries += merged[k]->entries;
+		}
+		std::shared_ptr<LsmRun> run;
+		std::vector<RIDKeyPair<int> > noInts;
+		std::vector<RIDKeyPair<double> > noDoubles;
+		std::vector<RIDKeyPair<StringKey> > noStrings;
+		if (attributeType == INTEGER)
+		{
+			MergedRuns<int> source(merged, lowestKey<int>(), GTE, highestKey<int>(), LTE, noInts);
+			run = buildRun<int>(source, runNo, entries);
+		}
+		else if (attributeType == DOUBLE)
+		{
+			MergedRuns<double> source(merged, lowestKey<double>(), GTE, highestKey<double>(), LTE, noDoubles);
+			run = buildRun<double>(source, runNo, entries);
+		}
+		else
+		{
+			MergedRuns<StringKey> source(merged, lowestKey<StringKey>(), GTE, highestKey<StringKey>(), LTE, noStrings);
+			run = buildRun<StringKey>(source, runNo, entries);
+		}
+
+		{
+			// runs written out meanwhile were appended after the merged ones
+			std::lock_guard<std::mutex> guard(latch);
+			runs.erase(runs.begin(), runs.begin() + merged.size());
+			runs.insert(runs.begin(), run);
+			for (std::size_t k = 0; k < merged.size(); k++)
+			{
+				merged[k]->obsolete = true;
+			}
+			writeManifest();
+		}
+		counters.compactions.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void LsmIndex::compactLoop()
+	{
+		std::size_t wanted = options.compactionFanIn;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> guard(latch);
+				while (!stopping && runs.size() < wanted)
+				{
+					compactWake.wait(guard);
+				}
+				if (stopping)
+				{
+					return;
+				}
+			}
+			try
+			{
+				mergeRuns(options.compactionFanIn);
+				wanted = options.compactionFanIn;
+			}
+			catch (BadgerDbException &e)
+			{
+				// the runs stay as they were; try again once another one is written out
+				std::lock_guard<std::mutex> guard(latch);
+				wanted = runs.size() + 1;
+			}
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// LsmIndex::lookup
+	// -----------------------------------------------------------------------------
+
+	std::size_t LsmIndex::lookup(const void *key, RecordId *outRids, const std::size_t maxRids)
+	{
+		counters.lookups.fetch_add(1, std::memory_order_relaxed);
+		if (attributeType == INTEGER)
+		{
+			return lookupKey<int>(loadKey<int>(key), outRids, maxRids);
+		}
+		else if (attributeType == DOUBLE)
+		{
+			return lookupKey<double>(loadKey<double>(key), outRids, maxRids);
+		}
+		return lookupKey<StringKey>(loadKey<StringKey>(key), outRids, maxRids);
+	}
+
+	template <class T>
+	std::size_t LsmIndex::lookupKey(const T &key, RecordId *outRids, const std::size_t maxRids)
+	{
+		std::vector<std::shared_ptr<LsmRun> > snapshot;
+		std::vector<RecordId> inMemory;
+		{
+			std::lock_guard<std::mutex> guard(latch);
+			snapshot = runs;
+			const RIDKeyPair<T> *frozen = reinterpret_cast<const RIDKeyPair<T> *>(frozenPairs.data());
+			for (std::size_t i = 0; i < frozenCount; i++)
+			{
+				if (frozen[i].key == key)
+				{
+					inMemory.push_back(frozen[i].rid);
+				}
+			}
+			const RIDKeyPair<T> *active = reinterpret_cast<const RIDKeyPair<T> *>(memPairs.data());
+			for (std::size_t i = 0; i < memCount; i++)
+			{
+				if (active[i].key == key)
+				{
+					inMemory.push_back(active[i].rid);
+				}
+			}
+		}
+
+		const T hashed = bloomKey(key);
+		std::size_t found = 0;
+		for (std::size_t k = 0; k < snapshot.size() && found < maxRids; k++)
+		{
+			if (!snapshot[k]->bloom.mayContain(&hashed, sizeof(T)))
+			{
+				counters.bloomSkips.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+			counters.runProbes.fetch_add(1, std::memory_order_relaxed);
+			found += snapshot[k]->index->lookup(&key, outRids + found, maxRids - found);
+		}
+		for (std::size_t i = 0; i < inMemory.size() && found < maxRids; i++)
+		{
+			outRids[found++] = inMemory[i];
+		}
+		return found;
+	}
+
+	// -----------------------------------------------------------------------------
+	// LsmIndex::startScan
+	// -----------------------------------------------------------------------------
+
+	void LsmIndex::startScan(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp)
+	{
+		scanSource.reset();
+		if ((highOp != LTE && highOp != LT) || (lowOp != GTE && lowOp != GT))
+		{
+			throw BadOpcodesException();
+		}
+		if (attributeType == INTEGER)
+		{
+			startScanRange<int>(lowVal, lowOp, highVal, highOp);
+		}
+		else if (attributeType == DOUBLE)
+		{
+			startScanRange<double>(lowVal, lowOp, highVal, highOp);
+		}
+		else
+		{
+			startScanRange<StringKey>(lowVal, lowOp, highVal, highOp);
+		}
+	}
+
+	template <class T>
+	void LsmIndex::startScanRange(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp)
+	{
+		const T low = loadKey<T>(lowVal);
+		const T high = loadKey<T>(highVal);
+		if (high < low)
+		{
+			throw BadScanrangeException();
+		}
+
+		// copy the memtable entries in the range, the frozen ones first as they were inserted first
+		std::vector<std::shared_ptr<LsmRun> > snapshot;
+		std::vector<RIDKeyPair<T> > inMemory;
+		{
+			std::lock_guard<std::mutex> guard(latch);
+			snapshot = runs;
+			const RIDKeyPair<T> *frozen = reinterpret_cast<const RIDKeyPair<T> *>(frozenPairs.data());
+			for (std::size_t i = 0; i < frozenCount; i++)
+			{
+				if (inRange(frozen[i].key, low, lowOp, high, highOp))
+				{
+					inMemory.push_back(frozen[i]);
+				}
+			}
+			const RIDKeyPair<T> *active = reinterpret_cast<const RIDKeyPair<T> *>(memPairs.data());
+			for (std::size_t i = 0; i < memCount; i++)
+			{
+				if (inRange(active[i].key, low, lowOp, high, highOp))
+				{
+					inMemory.push_back(active[i]);
+				}
+			}
+		}
+		std::stable_sort(inMemory.begin(), inMemory.end());
+
+		std::unique_ptr<MergedRuns<T> > source(new MergedRuns<T>(snapshot, low, lowOp, high, highOp, inMemory));
+		if (source->exhausted())
+		{
+			throw NoSuchKeyFoundException();
+		}
+		scanSource.reset(source.release());
+	}
+
+	// -----------------------------------------------------------------------------
+	// LsmIndex::scanNext
+	// -----------------------------------------------------------------------------
+
+	void LsmIndex::scanNext(RecordId &outRid)
+	{
+		if (!scanSource)
+		{
+			throw ScanNotInitializedException();
+		}
+		if (!scanSource->next(NULL, outRid))
+		{
+			throw IndexScanCompletedException();
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// LsmIndex::endScan
+	// -----------------------------------------------------------------------------
+
+	void LsmIndex::endScan()
+	{
+		if (!scanSource)
+		{
+			throw ScanNotInitializedException();
+		}
+		scanSource.reset();
+	}
+
+	// -----------------------------------------------------------------------------
+	// LsmIndex::getStats
+	// -----------------------------------------------------------------------------
+
+	LsmStats LsmIndex::getStats()
+	{
+		LsmStats stats;
+		{
+			std::lock_guard<std::mutex> guard(latch);
+			stats.runs = runs.size();
+			for (std::size_t k = 0; k < runs.size(); k++)
+			{
+				stats.runEntries += runs[k]->entries;
+			}
+			stats.memtableEntries = memCount + frozenCount;
+		}
+		stats.flushes = counters.flushes.load(std::memory_order_relaxed);
+		stats.compactions = counters.compactions.load(std::memory_order_relaxed);
+		stats.lookups = counters.lookups.load(std::memory_order_relaxed);
+		stats.runProbes = counters.runProbes.load(std::memory_order_relaxed);
+		stats.bloomSkips = counters.bloomSkips.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+}
@@ -0,0 +1,450 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "btree.h"
+#include "bloom_filter.h"
+
+namespace badgerdb
+{
+
+  /**
+   * @brief Default number of entries an LsmIndex collects in memory before writing them out as a sorted run.
+   */
+  const std::size_t LSM_MEMTABLE_SIZE = 16384;
+
+  /**
+   * @brief Default number of sorted runs of an LsmIndex that are merged into one.
+   */
+  const std::size_t LSM_COMPACTION_FAN_IN = 4;
+
+  /**
+   * @brief Options controlling an LsmIndex. Passed to the LsmIndex constructor.
+   */
+  struct LsmOptions
+  {
+    /**
+     * Number of entries inserted into memory before they are written out as a new sorted run.
+     */
+    std::size_t memtableSize;
+
+    /**
+     * Number of sorted runs at which all of them are merged into one.
+     */
+    std::size_t compactionFanIn;
+
+    /**
+     * Number of Bloom filter bits per entry of a run. Point lookups skip a run whose filter rules the key out.
+     */
+    int bloomBitsPerKey;
+
+    /**
+     * If true, runs are merged by a thread of the index while inserts go on. Otherwise the insert that writes out
+     * the run reaching compactionFanIn merges them before it returns.
+     */
+    bool backgroundCompaction;
+
+    LsmOptions()
+        : memtableSize(LSM_MEMTABLE_SIZE), compactionFanIn(LSM_COMPACTION_FAN_IN), bloomBitsPerKey(BLOOM_BITS_PER_KEY),
+          backgroundCompaction(true)
+    {
+    }
+  };
+
+  /**
+   * @brief Shape of an LsmIndex and counts of the work it did, as returned by LsmIndex::getStats().
+   */
+  struct LsmStats
+  {
+    /**
+     * Number of sorted runs.
+     */
+    std::size_t runs;
+
+    /**
+     * Number of entries in the sorted runs.
+     */
+    std::size_t runEntries;
+
+    /**
+     * Number of entries in memory, not written to a run yet.
+     */
+    std::size_t memtableEntries;
+
+    /**
+     * Number of runs written out from memory.
+     */
+    std::uint64_t flushes;
+
+    /**
+     * Number of merges of runs.
+     */
+    std::uint64_t compactions;
+
+    /**
+     * Number of lookup() calls.
+     */
+    std::uint64_t lookups;
+
+    /**
+     * Number of runs lookups searched.
+     */
+    std::uint64_t runProbes;
+
+    /**
+     * Number of runs lookups skipped because the run's Bloom filter ruled the key out.
+     */
+    std::uint64_t bloomSkips;
+
+    LsmStats()
+        : runs(0), runEntries(0), memtableEntries(0), flushes(0), compactions(0), lookups(0), runProbes(0),
+          bloomSkips(0)
+    {
+    }
+  };
+
+  /**
+   * @brief Immutable sorted run of an LsmIndex: a BTreeIndex bulk loaded with fully packed leaves, with a Bloom
+   * filter over its keys. Shared by the index and the scans and merges reading it; the file of a run merged away
+   * is removed once the last of them lets go of it.
+   */
+  struct LsmRun
+  {
+    /**
+     * Number of the run, which names its file.
+     */
+    std::uint64_t runNo;
+
+    /**
+     * Name of the index file of the run.
+     */
+    std::string name;
+
+    /**
+     * The run's entries.
+     */
+    BTreeIndex *index;
+
+    /**
+     * Filter over the keys of the run.
+     */
+    BloomFilter bloom;
+
+    /**
+     * Number of entries of the run.
+     */
+    std::size_t entries;
+
+    /**
+     * Set once the run has been merged into another one, so its file goes away with it.
+     */
+    bool obsolete;
+
+    LsmRun() : runNo(0), index(NULL), entries(0), obsolete(false)
+    {
+    }
+
+    ~LsmRun();
+  };
+
+  /**
+   * @brief Append-optimized secondary index on an INTEGER, DOUBLE or STRING attribute of a relation, with the
+   * scan interface of BTreeIndex.
+   *
+   * Inserts go to an unsorted buffer in memory, the memtable. A full memtable is sorted and bulk loaded into a new
+   * BTreeIndex file, a sorted run, which is never changed again, so an insert writes no index page and a run
+   * writes every page once. Runs pile up and are merged into one, by a background thread of the index, once there
+   * are LsmOptions::compactionFanIn of them. Lookups search the memtable and every run whose Bloom filter does not
+   * rule the key out. Scans merge a copy of the matching entries of the memtable with scans of all runs, so they
+   * return the entries in key order like a BTreeIndex.
+   *
+   * The names of the runs are kept in a manifest file named after the index; the index opens them again when
+   * constructed over an existing manifest. Entries are never deleted. Entries still in memory when the process dies
+   * are lost.
+   *
+   * Inserts and lookups may run concurrently. Like the scan built into BTreeIndex, the scan of the index is used by
+   * one thread at a time.
+   */
+  class LsmIndex
+  {
+  public:
+    /**
+     * LsmIndex Constructor.
+     * If the manifest of the index exists, open the runs it names. If not, create it and insert the entry of
+     * every tuple of the base relation, which writes the first runs.
+     *
+     * @param relationName        Name of the base relation.
+     * @param outIndexName        Returns the name of the manifest, which the run files are named after.
+     * @param bufMgrIn            Buffer Manager Instance
+     * @param attrByteOffset      Offset of the key attribute in the records
+     * @param attrType            Datatype of the key, INTEGER, DOUBLE or STRING
+     * @param options             Options of the index
+     * @throws  BadIndexInfoException  If the key is COMPOSITE.
+     */
+    LsmIndex(const std::string &relationName, std::string &outIndexName, BufMgr *bufMgrIn,
+             const int attrByteOffset, const Datatype attrType, const LsmOptions &options = LsmOptions());
+
+    /**
+     * LsmIndex Destructor.
+     * Stops the compaction thread, writes the memtable out as a run and records the runs in the manifest.
+     * Throws no exceptions.
+     */
+    ~LsmIndex();
+
+    /**
+     * Insert the entry <key, rid> into the memtable, writing the memtable out as a run if it is full.
+     *
+     * @param key   Key to insert, pointer to integer/double/char string
+     * @param rid   Record ID of the entry
+     */
+    void insertEntry(const void *key, const RecordId rid);
+
+    /**
+     * Write the entries of the memtable out as a new sorted run, if there are any.
+     */
+    void flush();
+
+    /**
+     * Write the memtable out and merge all runs into one, waiting for a merge in the background to finish first.
+     */
+    void compact();
+
+    /**
+     * Find the record ids of the entries whose key equals the given one, up to maxRids of them, those of the
+     * runs from the oldest run on before those of the memtable.
+     *
+     * @param key       Key to look for, pointer to integer / double / char string
+     * @param outRids   Array of at least maxRids record ids the entries found are returned in
+     * @param maxRids   Maximum number of record ids to return
+     * @return  Number of record ids written to outRids, 0 if the key is not in the index.
+     */
+    std::size_t lookup(const void *key, RecordId *outRids, const std::size_t maxRids);
+
+    /**
+     * Begin a scan of the entries in a range of keys, ending the scan that was running.
+     * @see BTreeIndex::startScan
+     * @throws  BadOpcodesException If lowOp and highOp do not contain one of their expected values
+     * @throws  BadScanrangeException If lowVal > highval
+     * @throws  NoSuchKeyFoundException If there is no key in the index that satisfies the scan criteria.
+     */
+    void startScan(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp);
+
+    /**
+     * Fetch the record id of the next entry of the scan, in key order.
+     * @param outRid  RecordId of next record found that satisfies the scan criteria returned in this
+     * @throws ScanNotInitializedException If no scan has been initialized.
+     * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+     */
+    void scanNext(RecordId &outRid);
+
+    /**
+     * Terminate the current scan.
+     * @throws ScanNotInitializedException If no scan has been initialized.
+     */
+    void endScan();
+
+    /**
+     * Returns the number of runs and entries of the index and counters of the work it did.
+     */
+    LsmStats getStats();
+
+    /**
+     * Remove the manifest of an index that is not open and the files of the runs it names.
+     *
+     * @param indexName  Name of the manifest, as returned by the constructor.
+     * @throws  FileNotFoundException  If there is no such manifest.
+     */
+    static void remove(const std::string &indexName);
+
+  private:
+    LsmIndex(const LsmIndex &);
+    LsmIndex &operator=(const LsmIndex &);
+
+    /**
+     * Buffer Manager Instance.
+     */
+    BufMgr *bufMgr;
+
+    /**
+     * Name of the base relation.
+     */
+    std::string relationName;
+
+    /**
+     * Name of the manifest.
+     */
+    std::string indexName;
+
+    /**
+     * Datatype of the key.
+     */
+    Datatype attributeType;
+
+    /**
+     * Offset of the key attribute in the records.
+     */
+    int attrByteOffset;
+
+    /**
+     * Options of the index.
+     */
+    LsmOptions options;
+
+    /**
+     * Guards the memtables, the list of runs and the counters.
+     */
+    std::mutex latch;
+
+    /**
+     * Entries inserted since the memtable was last written out, RIDKeyPair<T> for the key type T, in insert order.
+     */
+    std::vector<char> memPairs;
+
+    /**
+     * Number of entries in memPairs.
+     */
+    std::size_t memCount;
+
+    /**
+     * Entries of the memtable being written out, still searched until their run is in runs.
+     */
+    std::vector<char> frozenPairs;
+
+    /**
+     * Number of entries in frozenPairs.
+     */
+    std::size_t frozenCount;
+
+    /**
+     * Sorted runs, oldest first.
+     */
+    std::vector<std::shared_ptr<LsmRun> > runs;
+
+    /**
+     * Number the next run is named with.
+     */
+    std::uint64_t nextRunNo;
+
+    /**
+     * Serializes writing out memtables, so at most one is frozen at a time.
+     */
+    std::mutex flushLatch;
+
+    /**
+     * Serializes merges of runs.
+     */
+    std::mutex compactLatch;
+
+    /**
+     * Wakes the compaction thread.
+     */
+    std::condition_variable compactWake;
+
+    /**
+     * Set to stop the compaction thread.
+     */
+    bool stopping;
+
+    /**
+     * Thread merging runs in the background, if LsmOptions::backgroundCompaction is set.
+     */
+    std::thread compactor;
+
+    /**
+     * Merged entries of the running scan, NULL if no scan is running.
+     */
+    std::unique_ptr<SortedEntrySource> scanSource;
+
+    /**
+     * @brief Counters of LsmStats, updated without ordering.
+     */
+    struct Counters
+    {
+      std::atomic<std::uint64_t> flushes;
+      std::atomic<std::uint64_t> compactions;
+      std::atomic<std::uint64_t> lookups;
+      std::atomic<std::uint64_t> runProbes;
+      std::atomic<std::uint64_t> bloomSkips;
+
+      Counters() : flushes(0), compactions(0), lookups(0), runProbes(0), bloomSkips(0)
+      {
+      }
+    };
+
+    Counters counters;
+
+    /**
+     * Insert the entry of every tuple of the base relation.
+     */
+    void build();
+
+    /**
+     * Open the runs named in the manifest.
+     */
+    void readManifest();
+
+    /**
+     * Record the runs in the manifest. Called with latch held.
+     */
+    void writeManifest();
+
+    /**
+     * Returns the name of the file of the run with the given number.
+     */
+    std::string runName(const std::uint64_t runNo) const;
+
+    /**
+     * Sort the frozen memtable and bulk load it into a new run.
+     */
+    template <class T>
+    std::shared_ptr<LsmRun> writeRun(const std::uint64_t runNo);
+
+    /**
+     * Bulk load a new run from sorted entries, building its Bloom filter on the way.
+     *
+     * @param source           Entries of the run, in key order.
+     * @param runNo            Number of the run.
+     * @param expectedEntries  Number of entries the Bloom filter is sized for.
+     */
+    template <class T>
+    std::shared_ptr<LsmRun> buildRun(SortedEntrySource &source, const std::uint64_t runNo, const std::size_t expectedEntries);
+
+    /**
+     * Merge the runs there are when it is called into one, if there are at least minRuns of them. Runs written out
+     * during the merge are left alone.
+     */
+    void mergeRuns(const std::size_t minRuns);
+
+    /**
+     * Fill in the Bloom filter of a run opened from the manifest by scanning its entries.
+     */
+    template <class T>
+    void loadBloom(const std::shared_ptr<LsmRun> &run);
+
+    /**
+     * Body of the compaction thread.
+     */
+    void compactLoop();
+
+    template <class T>
+    std::size_t lookupKey(const T &key, RecordId *outRids, const std::size_t maxRids);
+
+    template <class T>
+    void startScanRange(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp);
+  };
+
+}
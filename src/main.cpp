@@ -5,10 +5,35 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <type_traits>
 #include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "btree.h"
+#include "external_sort.h"
+#include "key_distribution.h"
+#include "lsm_index.h"
+#include "partitioned_index.h"
 #include "page.h"
 #include "filescan.h"
+#include "heap_fetch.h"
+#include "rid_bitmap.h"
+#include "merge_join.h"
+#include "trace.h"
+#include "checksum.h"
 #include "page_iterator.h"
 #include "file_iterator.h"
 #include "exceptions/insufficient_space_exception.h"
@@ -19,6 +44,16 @@
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/read_only_file_exception.h"
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/corrupt_page_exception.h"
+#include "exceptions/io_error_exception.h"
+#include "exceptions/page_not_pinned_exception.h"
+#include "exceptions/page_pinned_exception.h"
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/hash_already_present_exception.h"
+#include "exceptions/hash_not_found_exception.h"
 
 #define checkPassFail(a, b)                                               \
 	{                                                                     \
@@ -69,11 +104,63 @@ void createRelationBackward();
 void createRelationRandom();
 void intTests();
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+void doubleTests();
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp);
+void stringTests();
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int scanAndPrint(BTreeIndex *index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp);
 void indexTests();
 void createRelationLargeSize(int size);
 void createRelationSparse(int size);
 void indexTestsSearch();
 void intTestsSearch();
+void readOnlyTestsSearch();
+void deleteTestsSearch();
+void deltaTestsSearch();
+void retireTestsSearch();
+void coveredTestsSearch();
+int coveredScan(BTreeIndex *index, int lowVal, int highVal);
+void splitScratchTestsSearch();
+void compositeTestsSearch();
+void statsTestsSearch();
+void parallelTestsSearch();
+void concurrentInsertTestsSearch();
+void bulkLoadTestsSearch();
+void nodeSearchTestsSearch();
+int windowMismatches(BTreeIndex *index, int numKeys);
+void vectorSearchTestsSearch();
+void stringPrefixTestsSearch();
+int stringCount(BTreeIndex *index, const char *lowVal, Operator lowOp, const char *highVal, Operator highOp);
+void redoTestsSearch();
+void warmUpTestsSearch();
+void pinnedLevelTestsSearch();
+int unpinnedFrames(BufMgr *pool, PageFile *scratch, const std::vector<PageId> &pageNos);
+void lsmTestsSearch();
+void bloomTestsSearch();
+void heapFetchTestsSearch();
+void bitmapTestsSearch();
+void mergeJoinTestsSearch();
+void compressionTestsSearch();
+void secondaryCacheTestsSearch();
+void snapshotTestsSearch();
+void partitionTestsSearch();
+void traceTestsSearch();
+void createRelationCompressed(const std::string &name, bool compressed);
+int heapFetch(HeapFetch *fetch, int lowVal, int highVal);
+int mergeJoin(IndexScanCursor *left, int leftLow, int leftHigh, IndexScanCursor *right, int rightLow, int rightHigh,
+			  std::size_t batchSize, std::size_t &skips);
+int lsmScan(LsmIndex *index, int lowVal, int highVal);
+int resumeScan(IndexScanCursor *cursor, int &lastKey);
+int partitionScan(PartitionedIndex *index, int lowVal, int highVal, bool batched);
+int countTrace(const std::vector<TraceRecord> &trace, TraceEvent event, std::uint64_t tag);
+int compositeScan(BTreeIndex *index, const RECORD &low, const RECORD &high);
+int interleavedScan(BTreeIndex *index, int lowVal1, int highVal1, int lowVal2, int highVal2);
+int batchScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, int batchSize);
+int filteredScan(BTreeIndex *index, int lowVal, int highVal, std::size_t limit, bool batched);
+int parallelCount(std::size_t numThreads, std::size_t morselPages);
+int lookupRange(BTreeIndex *index, int lowVal, int highVal);
+int lookupBatchRange(BTreeIndex *index, int lowVal, int highVal, bool interleaved);
+int deleteRange(BTreeIndex *index, int lowVal, int highVal, int step, std::vector<std::pair<int, RecordId> > &deleted);
 void test1();
 void test2();
 void test3();
@@ -82,6 +169,53 @@ void test5();
 // void test6();
 void test7();
 void errorTests();
+void bufferTests();
+void hashTableTests();
+void checkpointTests();
+void fileStatsTests();
+void resizeTests(ReplacementPolicy *policy);
+void twoQueueTests();
+void referenceBitmapTests();
+void pageHandleTests();
+bool filePinned(BufMgr *pool, PageFile *file);
+void backgroundWriterTests();
+bool awaitDiskWrites(BufMgr *pool, std::uint64_t writes);
+void concurrentPinTests();
+void concurrentMissTests();
+void fileTests();
+void descriptorTests();
+int descriptorOf(const std::string &name);
+void ioBackendTests();
+void vectoredPageTests();
+void pageIntoTests();
+void allocationMapTests();
+void keySearchTests();
+int searchMismatches(const std::vector<int> &keys);
+template <class K>
+int unsignedSearchMismatches(const std::vector<K> &keys);
+void keyDistributionTests();
+void externalSortTests();
+int sortMismatches(std::size_t runSize, std::size_t maxFanIn, int numKeys, int &count);
+void ridBitmapTests();
+int bitmapMismatches(const std::vector<RecordId> &a, const std::vector<RecordId> &b);
+void postingTestsSearch();
+int unsortedRids(BTreeIndex *index, double key, std::size_t &count);
+void blockKeyTestsSearch();
+RecordId blockKeyRid(int key);
+int blockKeyMismatches(BTreeIndex *index, int lowKey, int highKey, int deletedLow, int deletedHigh);
+int doubleCount(BTreeIndex *index, double lowVal, double highVal);
+void prefetchTests();
+PageId chainNext(const Page &page);
+bool awaitDiskReads(BufMgr *pool, std::uint64_t reads);
+void prefetchTestsSearch();
+void ringTests();
+void pagePoolTests();
+int pagePoolMismatches(PagePool &pages, FrameId first, std::uint32_t count);
+void freeSpaceMapTests();
+int usedPages(PageFile &file);
+void extentTests();
+void checksumTests();
+void corruptByte(const std::string &name, off_t position);
 void deleteRelation();
 
 int main(int argc, char **argv)
@@ -126,8 +260,7 @@ int main(int argc, char **argv)
 			{
 				fscan.scanNext(scanRid);
 				// Assuming RECORD.i is our key, lets extract the key, which we know is INTEGER and whose byte offset is also know inside the record.
-				std::string recordStr = fscan.getRecord();
-				const char *record = recordStr.c_str();
+				const char *record = fscan.viewRecord().data;
 				int key = *((int *)(record + offsetof(RECORD, i)));
 				std::cout << "Extracted : " << key << std::endl;
 			}
@@ -149,6 +282,12 @@ int main(int argc, char **argv)
 	// test6();
 	test7();
 	errorTests();
+	bufferTests();
+	fileTests();
+	keySearchTests();
+	keyDistributionTests();
+	externalSortTests();
+	ridBitmapTests();
 
 	delete bufMgr;
 
@@ -293,30 +432,16 @@ void createRelationLargeSize(int size)
 
 	// initialize all of record1.s to keep purify happy
 	memset(record1.s, ' ', sizeof(record1.s));
-	PageId new_page_number;
-	Page new_page = file1->allocatePage(new_page_number);
+	std::vector<RECORD> records(size);
 	for (int i = 0; i < size; i++)
 	{
 		sprintf(record1.s, "%05d string record", i);
 		record1.i = i;
 		record1.d = (double)i;
-		std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
-
-		while (1)
-		{
-			try
-			{
-				new_page.insertRecord(new_data);
-				break;
-			}
-			catch (const InsufficientSpaceException &e)
-			{
-				file1->writePage(new_page_number, new_page);
-				new_page = file1->allocatePage(new_page_number);
-			}
-		}
+		records[i] = record1;
 	}
-	file1->writePage(new_page_number, new_page);
+	// pack the records into pages without building a string for each of them
+	file1->appendRecords(reinterpret_cast<char *>(&records[0]), sizeof(RECORD), records.size());
 }
 
 // -----------------------------------------------------------------------------
@@ -495,6 +620,22 @@ void indexTests()
 	catch (const FileNotFoundException &e)
 	{
 	}
+	doubleTests();
+	try
+	{
+		File::remove(doubleIndexName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+	stringTests();
+	try
+	{
+		File::remove(stringIndexName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
 }
 
 // -----------------------------------------------------------------------------
@@ -504,6 +645,22 @@ void indexTests()
 void indexTestsSearch()
 {
 	intTestsSearch();
+	readOnlyTestsSearch();
+	deleteTestsSearch();
+	retireTestsSearch();
+	postingTestsSearch();
+	blockKeyTestsSearch();
+	prefetchTestsSearch();
+	deltaTestsSearch();
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+	coveredTestsSearch();
+	splitScratchTestsSearch();
 	try
 	{
 		File::remove(intIndexName);
@@ -511,6 +668,27 @@ void indexTestsSearch()
 	catch (const FileNotFoundException &e)
 	{
 	}
+	compositeTestsSearch();
+	bulkLoadTestsSearch();
+	nodeSearchTestsSearch();
+	vectorSearchTestsSearch();
+	stringPrefixTestsSearch();
+	statsTestsSearch();
+	parallelTestsSearch();
+	concurrentInsertTestsSearch();
+	redoTestsSearch();
+	warmUpTestsSearch();
+	pinnedLevelTestsSearch();
+	lsmTestsSearch();
+	bloomTestsSearch();
+	heapFetchTestsSearch();
+	bitmapTestsSearch();
+	mergeJoinTestsSearch();
+	compressionTestsSearch();
+	secondaryCacheTestsSearch();
+	snapshotTestsSearch();
+	partitionTestsSearch();
+	traceTestsSearch();
 }
 
 // -----------------------------------------------------------------------------
@@ -524,217 +702,900 @@ void intTestsSearch()
 
 	// run test search key -1000 to 6000
 	checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 5000)
+
+	// two cursors on the same index advance independently of each other
+	checkPassFail(interleavedScan(&index, 0, 100, 1000, 1100), 200)
+
+	// batches stop at the end of the range and span leaves
+	checkPassFail(batchScan(&index, 1000, GT, 4000, LTE, 64), 3000)
+
+	// the predicate and the limit are applied inside the leaves
+	checkPassFail(filteredScan(&index, 0, 4999, 0, false), 1667)
+	checkPassFail(filteredScan(&index, 0, 4999, 0, true), 1667)
+	checkPassFail(filteredScan(&index, 0, 4999, 500, false), 500)
+	checkPassFail(filteredScan(&index, 0, 4999, 500, true), 500)
+
+	// equality lookups find every key once and nothing outside the relation
+	checkPassFail(lookupRange(&index, -1000, 6000), 5000)
+	checkPassFail(lookupBatchRange(&index, -1000, 6000, false), 5000)
+	checkPassFail(lookupBatchRange(&index, -1000, 6000, true), 5000)
 }
 
 // -----------------------------------------------------------------------------
-// intTests
+// redoTestsSearch
 // -----------------------------------------------------------------------------
 
-void intTests()
+void redoTestsSearch()
 {
-	std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
-
-	// run some tests
-	checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
-		checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
-			checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
-				checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
-					checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
-						checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
-							checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
-}
+	std::cout << "Recover a relation and its index from the redo log after a crash" << std::endl;
+	const std::string heapName = "relR";
+	const std::string logName = "relR.log";
+	const std::string names[] = {heapName, heapName + ".0", logName};
+	for (int n = 0; n < 3; n++)
+	{
+		try
+		{
+			File::remove(names[n]);
+		}
+		catch (const FileNotFoundException &e)
+		{
+		}
+	}
+	std::remove(logName.c_str());
 
-int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
-{
-	RecordId scanRid;
-	Page *curPage;
+	// the child changes the files through a pool of its own and exits without
+	// writing any of it back, so only the log knows about the later changes;
+	// its background writer takes checkpoints all along
+	pid_t child = fork();
+	if (child == 0)
+	{
+		BufMgr *pool = new BufMgr(100);
+		pool->setRedoLog(new RedoLog(logName));
+		pool->startWriter(WRITER_BATCH_SIZE, 1, 1 << 16);
+		PageFile *heap = new PageFile(heapName, true);
+		std::vector<RecordId> rids;
+		std::string redoIndexName;
+		BTreeIndex *index = NULL;
+		for (int i = 0; i < 3000; i++)
+		{
+			// the first third is in the relation when the index is built
+			if (i == 1000)
+			{
+				pool->flushFile(heap);
+				index = new BTreeIndex(heapName, redoIndexName, pool, offsetof(tuple, i), INTEGER);
+			}
+			RECORD record;
+			memset(&record, 0, sizeof(record));
+			record.i = i;
+			record.d = (double)i;
+			rids.push_back(pool->insertRecord(heap, std::string(reinterpret_cast<char *>(&record), sizeof(record))));
+			if (index != NULL)
+			{
+				index->insertEntry(&i, rids.back());
+			}
+		}
+		for (int i = 0; i < 3000; i += 3)
+		{
+			index->deleteEntry(&i, rids[i]);
+		}
+		_exit(0);
+	}
+	int status = 0;
+	waitpid(child, &status, 0);
+	checkPassFail((WIFEXITED(status) && WEXITSTATUS(status) == 0), true)
 
-	std::cout << "Scan for ";
-	if (lowOp == GT)
+	// recovery replays the groups since the last checkpoint, not the 5000 the
+	// inserts and deletes after the build logged
+	const std::size_t groups = RedoLog::recover(logName);
+	checkPassFail((groups > 0 && groups < 5000), true)
 	{
-		std::cout << "(";
+		BufMgr pool(100);
+		int records = 0;
+		{
+			FileScan scan(heapName, &pool);
+			try
+			{
+				RecordId rid;
+				while (1)
+				{
+					scan.scanNext(rid);
+					records++;
+				}
+			}
+			catch (const EndOfFileException &e)
+			{
+			}
+		}
+		checkPassFail(records, 3000)
+
+		std::string redoIndexName;
+		BTreeIndex index(heapName, redoIndexName, &pool, offsetof(tuple, i), INTEGER);
+		checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 2000)
+		checkPassFail(lookupRange(&index, -1000, 6000), 2000)
 	}
-	else
+
+	for (int n = 0; n < 3; n++)
 	{
-		std::cout << "[";
+		try
+		{
+			File::remove(names[n]);
+		}
+		catch (const FileNotFoundException &e)
+		{
+		}
 	}
-	std::cout << lowVal << "," << highVal;
-	if (highOp == LT)
+	std::remove(logName.c_str());
+}
+
+// -----------------------------------------------------------------------------
+// warmUpTestsSearch
+// -----------------------------------------------------------------------------
+
+void warmUpTestsSearch()
+{
+	std::cout << "Warm a new buffer pool up with the pages of the index an old one held" << std::endl;
+	const std::string listName = "relA.pages";
 	{
-		std::cout << ")";
+		BufMgr pool(1000);
+		BTreeIndex index(relationName, intIndexName, &pool, offsetof(tuple, i), INTEGER);
+		checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 5000)
+		pool.savePageList(listName);
 	}
-	else
 	{
-		std::cout << "]";
+		BufMgr pool(1000);
+		BTreeIndex index(relationName, intIndexName, &pool, offsetof(tuple, i), INTEGER);
+		checkPassFail((index.warmUp(listName) > 0), true)
+
+		// the scan finds every page of the index in the pool
+		pool.clearBufStats();
+		checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 5000)
+		checkPassFail(pool.getBufStats().misses, 0)
 	}
-	std::cout << std::endl;
+	std::remove(listName.c_str());
+}
 
-	int numResults = 0;
+// -----------------------------------------------------------------------------
+// pinnedLevelTestsSearch
+// -----------------------------------------------------------------------------
 
+void pinnedLevelTestsSearch()
+{
+	std::cout << "Keep the root pinned across the root split that makes it a non-leaf node" << std::endl;
+	const std::string emptyName = relationName + ".pins";
+	const std::string scratchName = relationName + ".scratch";
 	try
 	{
-		index->startScan(&lowVal, lowOp, &highVal, highOp);
+		File::remove(emptyName);
 	}
-	catch (const NoSuchKeyFoundException &e)
+	catch (const FileNotFoundException &e)
 	{
-		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
-		return 0;
+	}
+	{
+		PageFile::create(emptyName);
+	}
+	const int numBufs = 16;
+	std::vector<PageId> scratchPages;
+	{
+		PageFile scratch = PageFile::create(scratchName);
+		for (int i = 0; i <= numBufs; i++)
+		{
+			PageId pageNo;
+			scratch.allocatePage(pageNo);
+			scratchPages.push_back(pageNo);
+		}
 	}
 
-	while (1)
+	for (int levels = 0; levels <= 1; levels++)
 	{
-		try
+		BufMgr pool(numBufs);
+		PageFile scratch = PageFile::open(scratchName);
+		std::string indexName;
 		{
-			index->scanNext(scanRid);
-			bufMgr->readPage(file1, scanRid.page_number, curPage);
-			RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
-			bufMgr->unPinPage(file1, scanRid.page_number, false);
+			BTreeOptions options;
+			options.pinnedLevels = levels;
+			BTreeIndex index(emptyName, indexName, &pool, offsetof(tuple, i), INTEGER, options);
 
-			if (numResults < 5)
+			// a root that is a leaf is never pinned
+			checkPassFail(index.getStats().height, 1)
+			checkPassFail(unpinnedFrames(&pool, &scratch, scratchPages), numBufs)
+
+			int key = 0;
+			while (index.getStats().height == 1)
 			{
-				std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
-				std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" << std::endl;
+				for (int i = 0; i < 64; i++, key++)
+				{
+					index.insertEntry(&key, rid);
+				}
 			}
-			else if (numResults == 5)
+			checkPassFail((int)index.getStats().rootSplits, 1)
+
+			// the new root stays pinned for as long as the index is open, and only with pinnedLevels set
+			checkPassFail(unpinnedFrames(&pool, &scratch, scratchPages), numBufs - levels)
+			for (int i = 0; i < 64; i++, key++)
 			{
-				std::cout << "..." << std::endl;
+				index.insertEntry(&key, rid);
 			}
+			checkPassFail(unpinnedFrames(&pool, &scratch, scratchPages), numBufs - levels)
+			checkPassFail((int)index.getStats().entries, key)
 		}
-		catch (const IndexScanCompletedException &e)
+		checkPassFail(unpinnedFrames(&pool, &scratch, scratchPages), numBufs)
+		pool.flushFile(&scratch);
+		File::remove(indexName);
+	}
+	File::remove(scratchName);
+	File::remove(emptyName);
+}
+
+/**
+ * Returns the number of frames of pool that are not pinned, found by pinning pages of scratch until the pool
+ * has no frame left. The pages are unpinned again before returning; scratch must have more pages than the pool.
+ */
+int unpinnedFrames(BufMgr *pool, PageFile *scratch, const std::vector<PageId> &pageNos)
+{
+	std::vector<PageHandle> handles;
+	try
+	{
+		for (std::size_t i = 0; i < pageNos.size(); i++)
 		{
-			break;
+			handles.push_back(pool->readPage(scratch, pageNos[i]));
 		}
-
-		numResults++;
 	}
-
-	if (numResults >= 5)
+	catch (const BufferExceededException &e)
 	{
-		std::cout << "Number of results: " << numResults << std::endl;
 	}
-	index->endScan();
-	std::cout << std::endl;
-
-	return numResults;
+	for (std::size_t i = 0; i < handles.size(); i++)
+	{
+		pool->unPinPage(handles[i], false);
+	}
+	return handles.size();
 }
 
 // -----------------------------------------------------------------------------
-// errorTests
+// lsmTestsSearch
 // -----------------------------------------------------------------------------
 
-void errorTests()
+void lsmTestsSearch()
 {
+	std::cout << "Create an LSM index on the integer field" << std::endl;
+	std::string lsmIndexName;
+	LsmOptions options;
+	options.memtableSize = 512;
 	{
-		std::cout << "Error handling tests" << std::endl;
-		std::cout << "--------------------" << std::endl;
-		// Given error test
+		// the relation goes in as ten runs, which the background thread merges as they pile up
+		LsmIndex index(relationName, lsmIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+		checkPassFail(lsmScan(&index, -1000, 6000), 5000)
+		checkPassFail(lsmScan(&index, 1000, 1999), 1000)
 
-		try
+		// a second entry for each of the first keys stays in memory, and scans merge it with the runs
+		for (int key = 0; key < 100; key++)
 		{
-			File::remove(relationName);
+			RecordId rids[2];
+			checkPassFail(index.lookup(&key, rids, 2), 1)
+			index.insertEntry(&key, rids[0]);
 		}
-		catch (const FileNotFoundException &e)
+		checkPassFail(lsmScan(&index, 0, 99), 200)
+		RecordId rids[4];
+		int key = 50;
+		checkPassFail(index.lookup(&key, rids, 4), 2)
+
+		// the Bloom filters keep lookups of missing keys out of the runs
+		LsmStats before = index.getStats();
+		for (key = 10000; key < 10100; key++)
 		{
+			checkPassFail(index.lookup(&key, rids, 4), 0)
 		}
+		LsmStats stats = index.getStats();
+		checkPassFail((stats.bloomSkips - before.bloomSkips > stats.runProbes - before.runProbes), true)
 
-		file1 = new PageFile(relationName, true);
+		index.compact();
+		stats = index.getStats();
+		checkPassFail((int)stats.runs, 1)
+		checkPassFail((int)stats.runEntries, 5100)
+		checkPassFail((stats.compactions >= 1), true)
+	}
+	{
+		// the runs are opened again from the manifest
+		LsmIndex index(relationName, lsmIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+		checkPassFail(lsmScan(&index, -1000, 6000), 5100)
+	}
+	LsmIndex::remove(lsmIndexName);
+}
 
-		// initialize all of record1.s to keep purify happy
-		memset(record1.s, ' ', sizeof(record1.s));
-		PageId new_page_number;
-		Page new_page = file1->allocatePage(new_page_number);
+// -----------------------------------------------------------------------------
+// bloomTestsSearch
+// -----------------------------------------------------------------------------
 
-		// Insert a bunch of tuples into the relation.
-		for (int i = 0; i < 10; i++)
-		{
-			sprintf(record1.s, "%05d string record", i);
-			record1.i = i;
-			record1.d = (double)i;
-			std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+void bloomTestsSearch()
+{
+	std::cout << "Create a B+ Tree index on the integer field with a Bloom filter" << std::endl;
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+	BTreeOptions options;
+	options.bloomBitsPerKey = 10;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+		checkPassFail(lookupRange(&index, 0, 5000), 5000)
+		checkPassFail(lookupBatchRange(&index, -100, 5100, false), 5000)
+		checkPassFail(lookupBatchRange(&index, -100, 5100, true), 5000)
 
-			while (1)
-			{
-				try
-				{
-					new_page.insertRecord(new_data);
-					break;
-				}
-				catch (const InsufficientSpaceException &e)
-				{
-					file1->writePage(new_page_number, new_page);
-					new_page = file1->allocatePage(new_page_number);
-				}
-			}
+		// lookups and equality scans of keys not in the index mostly end at the filter
+		checkPassFail(lookupRange(&index, 10000, 11000), 0)
+		checkPassFail(intScan(&index, 20000, GTE, 20000, LTE), 0)
+		BTreeStats stats = index.getStats();
+		checkPassFail((stats.bloomRejects > 1000), true)
+
+		// inserted keys get into the filter
+		for (int key = 10000; key < 10100; key++)
+		{
+			RecordId rids[1];
+			const int existing = key - 10000;
+			index.lookup(&existing, rids, 1);
+			index.insertEntry(&key, rids[0]);
 		}
+		checkPassFail(lookupRange(&index, 10000, 10100), 100)
+	}
+	{
+		// the filter saved on close comes back with the index
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		checkPassFail(lookupRange(&index, 10000, 10100), 100)
+		checkPassFail(lookupRange(&index, 20000, 21000), 0)
+		checkPassFail((index.getStats().bloomRejects > 900), true)
 
-		file1->writePage(new_page_number, new_page);
+		// compaction sizes the filter for the keys there are now
+		index.compact();
+		checkPassFail(lookupRange(&index, 0, 5000), 5000)
+		checkPassFail(lookupRange(&index, 10000, 10100), 100)
+	}
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		checkPassFail(intScan(&index, -1000, GTE, 11000, LT), 5100)
+		checkPassFail(lookupRange(&index, 20000, 21000), 0)
+		checkPassFail((index.getStats().bloomRejects > 900), true)
+	}
+	File::remove(intIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// heapFetchTestsSearch
+// -----------------------------------------------------------------------------
 
+void heapFetchTestsSearch()
+{
+	std::cout << "Fetch the records of index scans in page order" << std::endl;
+	{
 		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		IndexScanCursor cursor(&index);
+		HeapFetch fetch(relationName, bufMgr);
 
-		int int2 = 2;
-		int int5 = 5;
+		// the record ids of overlapping scans are fetched once each
+		int low = 1000;
+		int high = 4000;
+		cursor.startScan(&low, GTE, &high, LT);
+		checkPassFail((int)fetch.addScan(cursor, 64), 3000)
+		low = 2000;
+		high = 5000;
+		cursor.startScan(&low, GTE, &high, LT);
+		checkPassFail((int)fetch.addScan(cursor), 3000)
+		checkPassFail((int)fetch.size(), 4000)
+		checkPassFail(heapFetch(&fetch, 1000, 5000), 4000)
 
-		// Scan Tests
-		std::cout << "Call endScan before startScan" << std::endl;
+		// a finished fetch stays finished until more record ids are added, which starts it over
+		checkPassFail(heapFetch(&fetch, 1000, 5000), 0)
+		low = 0;
+		high = 10;
+		cursor.startScan(&low, GTE, &high, LT);
+		checkPassFail((int)fetch.addScan(cursor), 10)
+		checkPassFail(heapFetch(&fetch, 0, 5000), 4010)
+		fetch.clear();
+		checkPassFail(heapFetch(&fetch, 1000, 5000), 0)
+	}
+	File::remove(intIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// bitmapTestsSearch
+// -----------------------------------------------------------------------------
+
+void bitmapTestsSearch()
+{
+	std::cout << "Intersect and unite scans on the integer and double fields" << std::endl;
+	{
+		BTreeIndex intIndex(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		BTreeIndex doubleIndex(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+		IndexScanCursor byInt(&intIndex);
+		IndexScanCursor byDouble(&doubleIndex);
+		IndexScanCursor *cursors[] = {&byInt, &byDouble};
+		int lowInt = 1000;
+		int highInt = 3000;
+		double lowDouble = 2000;
+		double highDouble = 4000;
+
+		// i in [1000, 3000) and d in [2000, 4000)
+		RidBitmap found;
+		byInt.startScan(&lowInt, GTE, &highInt, LT);
+		byDouble.startScan(&lowDouble, GTE, &highDouble, LT);
+		RidBitmap::intersectScans(cursors, 2, found);
+		checkPassFail((int)found.cardinality(), 1000)
+		HeapFetch both(relationName, bufMgr);
+		both.add(found);
+		checkPassFail(heapFetch(&both, 2000, 3000), 1000)
+
+		// i in [1000, 3000) or d in [2000, 4000)
+		byInt.startScan(&lowInt, GTE, &highInt, LT);
+		byDouble.startScan(&lowDouble, GTE, &highDouble, LT);
+		RidBitmap::unionScans(cursors, 2, found);
+		checkPassFail((int)found.cardinality(), 3000)
+		HeapFetch either(relationName, bufMgr);
+		either.add(found);
+		checkPassFail(heapFetch(&either, 1000, 4000), 3000)
+
+		// a scan that finds no key empties the intersection
+		lowDouble = 10000;
+		highDouble = 20000;
+		byInt.startScan(&lowInt, GTE, &highInt, LT);
 		try
 		{
-			index.endScan();
-			std::cout << "ScanNotInitialized Test 1 Failed." << std::endl;
+			byDouble.startScan(&lowDouble, GTE, &highDouble, LT);
 		}
-		catch (const ScanNotInitializedException &e)
+		catch (const NoSuchKeyFoundException &e)
 		{
-			std::cout << "ScanNotInitialized Test 1 Passed." << std::endl;
 		}
+		RidBitmap::intersectScans(cursors, 2, found);
+		checkPassFail((int)found.cardinality(), 0)
+	}
+	File::remove(intIndexName);
+	File::remove(doubleIndexName);
+}
 
-		std::cout << "Call scanNext before startScan" << std::endl;
-		try
+// -----------------------------------------------------------------------------
+// mergeJoinTestsSearch
+// -----------------------------------------------------------------------------
+
+void mergeJoinTestsSearch()
+{
+	std::cout << "Merge join the integer field with that of a relation of its multiples of 3" << std::endl;
+	const std::string joinRelationName = relationName + "Join";
+	{
+		PageFile joinFile = PageFile::create(joinRelationName);
+		PageId pageNumber;
+		Page page = joinFile.allocatePage(pageNumber);
+		for (int i = 0; i < 2000; i++)
 		{
-			RecordId foo;
-			index.scanNext(foo);
-			std::cout << "ScanNotInitialized Test 2 Failed." << std::endl;
+			RECORD record;
+			memset(&record, 0, sizeof(record));
+			record.i = 3 * i;
+			record.d = (double)record.i;
+			sprintf(record.s, "%05d string record", record.i);
+			std::string data(reinterpret_cast<char *>(&record), sizeof(record));
+			try
+			{
+				page.insertRecord(data);
+			}
+			catch (const InsufficientSpaceException &e)
+			{
+				joinFile.writePage(pageNumber, page);
+				page = joinFile.allocatePage(pageNumber);
+				page.insertRecord(data);
+			}
 		}
-		catch (const ScanNotInitializedException &e)
+		joinFile.writePage(pageNumber, page);
+	}
+
+	std::string joinIndexName;
+	{
+		BTreeIndex leftIndex(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		BTreeIndex rightIndex(joinRelationName, joinIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		IndexScanCursor left(&leftIndex);
+		IndexScanCursor right(&rightIndex);
+		std::size_t skips = 0;
+
+		// one pair at a time and in batches
+		checkPassFail(mergeJoin(&left, 0, 5000, &right, 0, 6000, 0, skips), 1667)
+		checkPassFail(mergeJoin(&left, 0, 5000, &right, 0, 6000, 64, skips), 1667)
+		checkPassFail(mergeJoin(&left, 1000, 3000, &right, 2000, 4000, 64, skips), 333)
+
+		// a narrow range on one side skips the other one ahead instead of reading up to it
+		checkPassFail(mergeJoin(&left, 0, 5000, &right, 4000, 4100, 64, skips), 33)
+		checkPassFail((skips >= 1), true)
+		checkPassFail(mergeJoin(&left, 0, 1000, &right, 3000, 6000, 64, skips), 0)
+		checkPassFail(mergeJoin(&left, 0, 5000, &right, 6000, 7000, 64, skips), 0)
+
+		// every left entry of a key pairs with every right entry of it
+		int dupKey = 2502;
+		for (int i = 0; i < 300; i++)
 		{
-			std::cout << "ScanNotInitialized Test 2 Passed." << std::endl;
+			RecordId dupRid;
+			dupRid.page_number = 100000 + i;
+			dupRid.slot_number = 1;
+			dupRid.padding = 0;
+			rightIndex.insertEntry(&dupKey, dupRid);
+			if (i < 3)
+			{
+				leftIndex.insertEntry(&dupKey, dupRid);
+			}
 		}
+		checkPassFail(mergeJoin(&left, 2000, 3000, &right, 2000, 3000, 64, skips), 332 + 4 * 301)
+		checkPassFail(mergeJoin(&left, 2000, 3000, &right, 2000, 3000, 0, skips), 332 + 4 * 301)
 
-		std::cout << "Scan with bad lowOp" << std::endl;
+		// keys of different types do not join
+		BTreeIndex doubleIndex(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+		IndexScanCursor byDouble(&doubleIndex);
+		bool refused = false;
 		try
 		{
-			index.startScan(&int2, LTE, &int5, LTE);
-			std::cout << "BadOpcodesException Test 1 Failed." << std::endl;
+			MergeJoin join(left, byDouble);
 		}
-		catch (const BadOpcodesException &e)
+		catch (const BadIndexInfoException &e)
 		{
-			std::cout << "BadOpcodesException Test 1 Passed." << std::endl;
+			refused = true;
 		}
+		checkPassFail(refused, true)
+	}
+	File::remove(intIndexName);
+	File::remove(doubleIndexName);
+	File::remove(joinIndexName);
+	File::remove(joinRelationName);
+}
 
-		std::cout << "Scan with bad highOp" << std::endl;
+// -----------------------------------------------------------------------------
+// compressionTestsSearch
+// -----------------------------------------------------------------------------
+
+void compressionTestsSearch()
+{
+	std::cout << "Store a relation and its index on the integer field with compressed pages" << std::endl;
+	const std::string plainName = relationName + "Plain";
+	const std::string compressedName = relationName + "Compressed";
+	createRelationCompressed(plainName, false);
+	createRelationCompressed(compressedName, true);
+
+	std::uint64_t plainUsage;
+	std::uint64_t compressedUsage;
+	{
+		PageFile plainFile = PageFile::open(plainName);
+		PageFile compressedFile = PageFile::open(compressedName);
+		plainUsage = plainFile.diskUsage();
+		compressedUsage = compressedFile.diskUsage();
+		checkPassFail(compressedFile.compressionEnabled(), true)
+	}
+	// pages no larger than a file system block have nothing to give back
+	const bool saves = Page::SIZE > File::COMPRESSION_BLOCK;
+	checkPassFail((compressedUsage < plainUsage), saves)
+
+	// every record reads back through the buffer manager
+	int scanned = 0;
+	{
+		FileScan fscan(compressedName, bufMgr);
 		try
 		{
-			index.startScan(&int2, GTE, &int5, GTE);
-			std::cout << "BadOpcodesException Test 2 Failed." << std::endl;
+			RecordId scanRid;
+			while (1)
+			{
+				fscan.scanNext(scanRid);
+				scanned++;
+			}
 		}
-		catch (const BadOpcodesException &e)
+		catch (const EndOfFileException &e)
 		{
-			std::cout << "BadOpcodesException Test 2 Passed." << std::endl;
 		}
+	}
+	checkPassFail(scanned, 5000)
 
-		std::cout << "Scan with bad range" << std::endl;
-		try
+	std::string plainIndexName;
+	std::string compressedIndexName;
+	{
+		BTreeOptions options;
+		options.compressPages = true;
+		BTreeIndex plainIndex(plainName, plainIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		BTreeIndex compressedIndex(compressedName, compressedIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+		checkPassFail(intScan(&compressedIndex, -1000, GTE, 6000, LT), 5000)
+		checkPassFail(lookupRange(&compressedIndex, -1000, 6000), 5000)
+	}
+	{
+		BlobFile plainFile = BlobFile::open(plainIndexName);
+		BlobFile compressedFile = BlobFile::open(compressedIndexName);
+		checkPassFail((compressedFile.diskUsage() < plainFile.diskUsage()), saves)
+	}
+
+	// an index file opened again keeps compressing, and is decompressed when mapped read-only
+	{
+		BTreeIndex index(compressedName, compressedIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		for (int key = 5000; key < 6000; key++)
 		{
-			index.startScan(&int5, GTE, &int2, LTE);
-			std::cout << "BadScanrangeException Test 1 Failed." << std::endl;
+			RecordId newRid;
+			newRid.page_number = 100000 + key;
+			newRid.slot_number = 1;
+			newRid.padding = 0;
+			index.insertEntry(&key, newRid);
 		}
-		catch (const BadScanrangeException &e)
+	}
+	{
+		BTreeOptions options;
+		options.readOnly = true;
+		BTreeIndex index(compressedName, compressedIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+		checkPassFail(intScan(&index, -1000, GTE, 5000, LT), 5000)
+		checkPassFail(lookupRange(&index, -1000, 7000), 6000)
+	}
+
+	File::remove(plainIndexName);
+	File::remove(compressedIndexName);
+	File::remove(plainName);
+	File::remove(compressedName);
+}
+
+// -----------------------------------------------------------------------------
+// secondaryCacheTestsSearch
+// -----------------------------------------------------------------------------
+
+void secondaryCacheTestsSearch()
+{
+	std::cout << "Read the pages of the relation through a small pool with a secondary cache behind it" << std::endl;
+	const std::string cacheName = relationName + ".cache";
+	std::vector<PageId> pageNos;
+	{
+		PageFile file = PageFile::open(relationName);
+		for (FileIterator it = file.begin(); it != file.end(); ++it)
+			pageNos.push_back((*it).page_number());
+	}
+
+	// the pool holds fewer pages than the relation has, whatever their size
+	const std::uint32_t frames = std::min<std::uint32_t>(8, pageNos.size() / 2);
+	BufMgr pool(frames);
+	SecondaryCache cache(cacheName, 1000);
+	pool.setSecondaryCache(&cache);
+	{
+		PageFile file = PageFile::open(relationName);
+
+		// a scan evicts its pages without them getting into the cache
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+			pool.unPinPage(pool.readPage(&file, pageNos[i], SEQUENTIAL_ACCESS), false);
+		checkPassFail(cache.getStats().admissions, 0)
+		checkPassFail((cache.getStats().rejections > 0), true)
+
+		// pages read at random are kept, and read again from the cache rather than from the file
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+			pool.unPinPage(pool.readPage(&file, pageNos[i], RANDOM_ACCESS), false);
+		checkPassFail((cache.getStats().admissions > 0), true)
+		pool.clearBufStats();
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+			pool.unPinPage(pool.readPage(&file, pageNos[i], RANDOM_ACCESS), false);
+		checkPassFail((cache.getStats().hits >= pageNos.size() - frames), true)
+		checkPassFail((pool.getBufStats().diskreads <= frames), true)
+
+		// a page changed and written back is read from its file again, not from the stale copy
+		RecordId changed;
+		changed.page_number = pageNos[0];
+		changed.slot_number = 1;
+		changed.padding = 0;
+		std::string record;
 		{
-			std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
+			PageGuard page(&pool, pool.readPage(&file, changed.page_number, RANDOM_ACCESS));
+			record = page.page()->getRecord(changed);
+			record[offsetof(RECORD, s)] = 'X';
+			page.page()->updateRecord(changed, record);
+			page.markDirty();
+		}
+		for (std::size_t i = 1; i < pageNos.size(); i++)
+			pool.unPinPage(pool.readPage(&file, pageNos[i], RANDOM_ACCESS), false);
+		checkPassFail((cache.getStats().invalidations > 0), true)
+		{
+			PageGuard page(&pool, pool.readPage(&file, changed.page_number, RANDOM_ACCESS));
+			checkPassFail((page.page()->getRecord(changed) == record), true)
 		}
 
-		deleteRelation();
+		// the pages of a flushed file are dropped
+		pool.flushFile(&file);
+		checkPassFail(cache.size(), 0)
+	}
+	pool.setSecondaryCache(NULL);
+}
+
+// -----------------------------------------------------------------------------
+// snapshotTestsSearch
+// -----------------------------------------------------------------------------
+
+void snapshotTestsSearch()
+{
+	std::cout << "Scan a snapshot of the B+ Tree index while entries are inserted and deleted" << std::endl;
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		{
+			IndexSnapshot snapshot(&index);
+			IndexScanCursor cursor(snapshot);
+			int lowVal = -1000;
+			int highVal = 20000;
+			cursor.startScan(&lowVal, GTE, &highVal, LT);
+			std::vector<RecordId> rids(100);
+			std::vector<int> keys(100);
+			checkPassFail((int)cursor.scanNextKeys(&rids[0], &keys[0], keys.size()), 100)
+
+			// splits ahead of the scan and up to the root, merges of the leaf it is on and of the ones behind it
+			for (int key = 5000; key < 10000; key++)
+			{
+				RecordId newRid;
+				newRid.page_number = 100000 + key;
+				newRid.slot_number = 1;
+				newRid.padding = 0;
+				index.insertEntry(&key, newRid);
+			}
+			std::vector<std::pair<int, RecordId> > deleted;
+			checkPassFail(deleteRange(&index, 0, 2000, 1, deleted), 2000)
+			checkPassFail((index.getStats().snapshotImages > 0), true)
+
+			int lastKey = keys[99];
+			checkPassFail(resumeScan(&cursor, lastKey), 4900)
+			checkPassFail(lastKey, 4999)
+
+			// a scan started after the changes sees them neither, skipping ahead by a descent of the old tree
+			lowVal = 0;
+			highVal = 5000;
+			cursor.startScan(&lowVal, GTE, &highVal, LT);
+			const int skipKey = 4000;
+			cursor.skipTo(&skipKey);
+			lastKey = INT_MIN;
+			checkPassFail(resumeScan(&cursor, lastKey), 1000)
+
+			checkPassFail(lookupRange(&index, -1000, 20000), 8000)
+		}
+		checkPassFail((int)index.getStats().snapshotImages, 0)
+	}
+	File::remove(intIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// partitionTestsSearch
+// -----------------------------------------------------------------------------
+
+void partitionTestsSearch()
+{
+	std::cout << "Create an index on the integer field partitioned by key range" << std::endl;
+	std::string partIndexName;
+	const std::string directory = relationName + ".partitions";
+	mkdir(directory.c_str(), S_IRWXU);
+	PartitionOptions options;
+	options.directories.push_back(".");
+	options.directories.push_back(directory);
+	{
+		// the four partitions are bulk loaded at once, every other one in the second directory
+		PartitionedIndex index(relationName, partIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+		checkPassFail((int)index.partitionCount(), 4)
+		checkPassFail(File::exists(directory + "/" + partIndexName + ".1"), true)
+		checkPassFail((int)index.partition(3)->getStats().entries, 1250)
+		checkPassFail(partitionScan(&index, -1000, 6000, false), 5000)
+		checkPassFail(partitionScan(&index, -1000, 6000, true), 5000)
+
+		// a range within one partition reads only that one
+		PartitionStats before = index.getStats();
+		checkPassFail(partitionScan(&index, 1300, 1400, false), 101)
+		PartitionStats stats = index.getStats();
+		checkPassFail((int)(stats.partitionsScanned - before.partitionsScanned), 1)
+		checkPassFail((int)(stats.partitionsPruned - before.partitionsPruned), 3)
+
+		// entries go to the partition of their key
+		for (int key = 0; key < 100; key++)
+		{
+			RecordId rids[2];
+			checkPassFail(index.lookup(&key, rids, 2), 1)
+			index.insertEntry(&key, rids[0]);
+		}
+		checkPassFail(partitionScan(&index, 0, 99, false), 200)
+		checkPassFail((int)index.partition(0)->getStats().entries, 1350)
+		int key = 2500;
+		checkPassFail((int)index.partitionOf(&key), 2)
+		RecordId rid;
+		checkPassFail(index.lookup(&key, &rid, 1), 1)
+		checkPassFail(index.deleteEntry(&key, rid), true)
+		checkPassFail(index.lookup(&key, &rid, 1), 0)
+
+		index.compact();
+		checkPassFail(partitionScan(&index, -1000, 6000, true), 5099)
+	}
+	{
+		// the partitions are opened again from the manifest
+		PartitionedIndex index(relationName, partIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+		checkPassFail((int)index.partitionCount(), 4)
+		checkPassFail(partitionScan(&index, 2400, 2600, false), 200)
+	}
+	PartitionedIndex::remove(partIndexName);
+	checkPassFail(File::exists(directory + "/" + partIndexName + ".1"), false)
+	rmdir(directory.c_str());
+
+	// runs of 64 entries spill the keys to disk and take more than one merge pass; the ranges are cut from the
+	// merged stream, spooled or not
+	for (int parallel = 0; parallel <= 1; parallel++)
+	{
+		std::cout << "Partition the integer field from sorted runs on disk" << std::endl;
+		PartitionOptions spilled;
+		spilled.indexOptions.sortRunSize = 64;
+		spilled.parallel = (parallel == 1);
+		{
+			PartitionedIndex index(relationName, partIndexName, bufMgr, offsetof(tuple, i), INTEGER, spilled);
+			checkPassFail((int)index.partitionCount(), 4)
+			checkPassFail((int)index.partition(0)->getStats().entries, 1250)
+			checkPassFail((int)index.partition(3)->getStats().entries, 1250)
+			checkPassFail(File::exists(partIndexName + ".sort"), false)
+
+			// batches run on from one partition into the next, so none of a range spanning all four is short
+			PartitionStats before = index.getStats();
+			int low = 1000;
+			int high = 3999;
+			index.startScan(&low, GTE, &high, LTE);
+			HeapFetch fetch(relationName, bufMgr);
+			std::vector<RecordId> rids(300);
+			int batches = 0;
+			int shortBatches = 0;
+			while (true)
+			{
+				std::size_t count;
+				try
+				{
+					count = index.scanNextBatch(&rids[0], rids.size());
+				}
+				catch (const IndexScanCompletedException &e)
+				{
+					break;
+				}
+				batches++;
+				if (count < rids.size())
+					shortBatches++;
+				fetch.add(&rids[0], count);
+			}
+			index.endScan();
+			checkPassFail(batches, 10)
+			checkPassFail(shortBatches, 0)
+			checkPassFail((int)(index.getStats().partitionsScanned - before.partitionsScanned), 4)
+			checkPassFail(heapFetch(&fetch, 1000, 4000), 3000)
+		}
+		PartitionedIndex::remove(partIndexName);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// traceTestsSearch
+// -----------------------------------------------------------------------------
+
+void traceTestsSearch()
+{
+	std::cout << "Trace the buffer, file and index events of two tagged queries" << std::endl;
+	Tracer tracer(1 << 18);
+	Tracer::install(&tracer);
+	std::vector<PageId> pageNos;
+	{
+		PageFile file = PageFile::open(relationName);
+		for (FileIterator it = file.begin(); it != file.end(); ++it)
+			pageNos.push_back((*it).page_number());
+	}
+
+	// every page of the relation read twice through a pool of one frame: a miss that reads the file and evicts
+	// the page before, then a hit
+	BufMgr pool(1);
+	{
+		TraceTag tag(1);
+		PageFile file = PageFile::open(relationName);
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			pool.unPinPage(pool.readPage(&file, pageNos[i]), false);
+			pool.unPinPage(pool.readPage(&file, pageNos[i]), false);
+		}
+		pool.flushFile(&file);
 	}
 
+	// inserts behind the last key split leaves, unless the pages are large enough to take them all
+#if BADGERDB_TRACING
+	int splits = 0;
+#endif
 	try
 	{
 		File::remove(intIndexName);
@@ -742,6 +1603,4979 @@ void errorTests()
 	catch (const FileNotFoundException &e)
 	{
 	}
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+		TraceTag tag(2);
+		for (int key = 5000; key < 7000; key++)
+		{
+			RecordId newRid;
+			newRid.page_number = 100000 + key;
+			newRid.slot_number = 1;
+			newRid.padding = 0;
+			index.insertEntry(&key, newRid);
+		}
+		checkPassFail(lookupRange(&index, 5000, 7000), 2000)
+#if BADGERDB_TRACING
+		splits = (int)index.getStats().leafSplits;
+#endif
+	}
+	File::remove(intIndexName);
+	Tracer::install(NULL);
+
+	const std::vector<TraceRecord> trace = tracer.records();
+	checkPassFail((trace.size() == tracer.recorded()), true)
+#if BADGERDB_TRACING
+	const int pages = (int)pageNos.size();
+	checkPassFail(countTrace(trace, TRACE_BUFFER_MISS, 1), pages)
+	checkPassFail(countTrace(trace, TRACE_BUFFER_HIT, 1), pages)
+	checkPassFail(countTrace(trace, TRACE_FILE_READ, 1), pages)
+	checkPassFail(countTrace(trace, TRACE_BUFFER_EVICT, 1), pages - 1)
+	checkPassFail(countTrace(trace, TRACE_INDEX_LEAF_SPLIT, 1), 0)
+	checkPassFail(countTrace(trace, TRACE_INDEX_LEAF_SPLIT, 2), splits)
+	checkPassFail((countTrace(trace, TRACE_INDEX_DESCENT, 2) >= 2000), true)
+	bool timed = true;
+	for (std::size_t i = 0; i < trace.size(); i++)
+	{
+		if (trace[i].event == TRACE_FILE_READ && trace[i].tag == 1)
+			timed = timed && trace[i].duration > 0 && trace[i].bytes == Page::SIZE;
+	}
+	checkPassFail(timed, true)
+#else
+	checkPassFail((int)trace.size(), 0)
+#endif
+
+	// nothing is recorded once the tracer is uninstalled
+	const std::uint64_t recorded = tracer.recorded();
+	{
+		PageFile file = PageFile::open(relationName);
+		pool.unPinPage(pool.readPage(&file, pageNos[0]), false);
+		pool.flushFile(&file);
+	}
+	checkPassFail((tracer.recorded() == recorded), true)
+
+	// a full ring keeps the newest records, and the dump has a line for each
+	std::cout << "Record more events than the ring holds" << std::endl;
+	Tracer ring(4);
+	for (PageId pageNo = 1; pageNo <= 6; pageNo++)
+		ring.record(TRACE_FILE_WRITE, &ring, pageNo, 1, Page::SIZE, Tracer::now(), 0);
+	const std::vector<TraceRecord> newest = ring.records();
+	checkPassFail((int)newest.size(), 4)
+	checkPassFail((int)newest[0].pageNo, 3)
+	checkPassFail((int)newest[3].pageNo, 6)
+	std::ostringstream dump;
+	ring.dump(dump);
+	const std::string lines = dump.str();
+	checkPassFail((int)std::count(lines.begin(), lines.end(), '\n'), 5)
+}
+
+/**
+ * Returns the number of events of a kind in a trace made by threads with the given tag.
+ */
+int countTrace(const std::vector<TraceRecord> &trace, TraceEvent event, std::uint64_t tag)
+{
+	int count = 0;
+	for (std::size_t i = 0; i < trace.size(); i++)
+	{
+		if (trace[i].event == (std::uint32_t)event && trace[i].tag == tag)
+			count++;
+	}
+	return count;
+}
+
+/**
+ * Scans [lowVal, highVal] on a partitioned index, one entry or 100 at a time, and returns the number of entries,
+ * or -1 if they do not come in key order.
+ */
+int partitionScan(PartitionedIndex *index, int lowVal, int highVal, bool batched)
+{
+	std::cout << "Partitioned scan for [" << lowVal << "," << highVal << "]" << std::endl;
+	try
+	{
+		index->startScan(&lowVal, GTE, &highVal, LTE);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		return 0;
+	}
+
+	// the partitions are read one after the other, in key order
+	int numResults = 0;
+	int lastKey = lowVal;
+	std::vector<RecordId> rids(batched ? 100 : 1);
+	while (true)
+	{
+		std::size_t count = 1;
+		try
+		{
+			if (batched)
+				count = index->scanNextBatch(&rids[0], rids.size());
+			else
+				index->scanNext(rids[0]);
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+			break;
+		}
+		for (std::size_t i = 0; i < count; i++)
+		{
+			Page *curPage;
+			bufMgr->readPage(file1, rids[i].page_number, curPage);
+			const int key = reinterpret_cast<const RECORD *>(curPage->getRecord(rids[i]).data())->i;
+			bufMgr->unPinPage(file1, rids[i].page_number, false);
+			if (key < lastKey || key > highVal)
+			{
+				index->endScan();
+				return -1;
+			}
+			lastKey = key;
+		}
+		numResults += (int)count;
+	}
+	index->endScan();
+	std::cout << "Number of results: " << numResults << std::endl;
+	return numResults;
+}
+
+/**
+ * Reads the rest of the running scan of the cursor in batches of 100 and ends it. Returns the number of entries
+ * read, or -1 if a key was not larger than the one before. lastKey holds the key read before and is left holding
+ * the last one read.
+ */
+int resumeScan(IndexScanCursor *cursor, int &lastKey)
+{
+	std::vector<RecordId> rids(100);
+	std::vector<int> keys(100);
+	int numResults = 0;
+	bool ordered = true;
+	try
+	{
+		while (1)
+		{
+			const std::size_t count = cursor->scanNextKeys(&rids[0], &keys[0], keys.size());
+			for (std::size_t i = 0; i < count; i++)
+			{
+				ordered = ordered && lastKey < keys[i];
+				lastKey = keys[i];
+			}
+			numResults += (int)count;
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	cursor->endScan();
+
+	std::cout << "Number of results: " << numResults << std::endl;
+	return ordered ? numResults : -1;
+}
+
+/**
+ * Creates a relation of the keys 0 to 4999 in order, with its pages compressed or not.
+ */
+void createRelationCompressed(const std::string &name, bool compressed)
+{
+	PageFile file = PageFile::create(name);
+	file.setCompression(compressed);
+	PageId pageNumber;
+	Page page = file.allocatePage(pageNumber);
+	for (int i = 0; i < 5000; i++)
+	{
+		RECORD record;
+		memset(&record, 0, sizeof(record));
+		record.i = i;
+		record.d = (double)i;
+		sprintf(record.s, "%05d string record", i);
+		std::string data(reinterpret_cast<char *>(&record), sizeof(record));
+		try
+		{
+			page.insertRecord(data);
+		}
+		catch (const InsufficientSpaceException &e)
+		{
+			file.writePage(pageNumber, page);
+			page = file.allocatePage(pageNumber);
+			page.insertRecord(data);
+		}
+	}
+	file.writePage(pageNumber, page);
+}
+
+/**
+ * Fetches every record of a HeapFetch, checking that they come in page order, that every page is read once and
+ * that the keys of the records are in [lowVal, highVal). Returns the number of records fetched, or -1 on a failed
+ * check.
+ */
+int heapFetch(HeapFetch *fetch, int lowVal, int highVal)
+{
+	std::cout << "Heap fetch of keys in [" << lowVal << "," << highVal << ")" << std::endl;
+	const std::size_t pagesBefore = fetch->pagesRead();
+	std::size_t pages = 0;
+	int numResults = 0;
+	RecordId previous;
+	previous.page_number = Page::INVALID_NUMBER;
+	previous.slot_number = 0;
+	try
+	{
+		while (1)
+		{
+			RecordId rid;
+			fetch->fetchNext(rid);
+			const int key = ((const RECORD *)fetch->viewRecord().data)->i;
+			if (key < lowVal || key >= highVal)
+			{
+				return -1;
+			}
+			if (rid.page_number != previous.page_number)
+			{
+				if (previous.page_number != Page::INVALID_NUMBER && rid.page_number < previous.page_number)
+				{
+					return -1;
+				}
+				pages++;
+			}
+			else if (rid.slot_number <= previous.slot_number)
+			{
+				return -1;
+			}
+			previous = rid;
+			numResults++;
+		}
+	}
+	catch (const EndOfFileException &e)
+	{
+	}
+	if (fetch->pagesRead() - pagesBefore != pages)
+	{
+		return -1;
+	}
+
+	std::cout << "Number of results: " << numResults << " from " << pages << " pages" << std::endl;
+	return numResults;
+}
+
+/**
+ * Merge joins the scans of [leftLow, leftHigh) on left and [rightLow, rightHigh) on right, batchSize pairs at a
+ * time or one at a time if it is 0, and returns the skips of the cursors in skips. Returns the number of pairs, or
+ * -1 if a scan is still running after the join.
+ */
+int mergeJoin(IndexScanCursor *left, int leftLow, int leftHigh, IndexScanCursor *right, int rightLow, int rightHigh,
+			  std::size_t batchSize, std::size_t &skips)
+{
+	std::cout << "Merge join of [" << leftLow << "," << leftHigh << ") and [" << rightLow << "," << rightHigh << ")"
+			  << std::endl;
+	try
+	{
+		left->startScan(&leftLow, GTE, &leftHigh, LT);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+	}
+	try
+	{
+		right->startScan(&rightLow, GTE, &rightHigh, LT);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+	}
+
+	MergeJoin join(*left, *right, 100);
+	std::vector<RecordId> leftRids(std::max<std::size_t>(1, batchSize));
+	std::vector<RecordId> rightRids(leftRids.size());
+	int numResults = 0;
+	try
+	{
+		std::size_t count;
+		do
+		{
+			if (batchSize == 0)
+			{
+				join.joinNext(leftRids[0], rightRids[0]);
+				count = 1;
+			}
+			else
+			{
+				count = join.joinNextBatch(&leftRids[0], &rightRids[0], batchSize);
+			}
+			numResults += (int)count;
+		} while (count == leftRids.size());
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	skips = join.cursorSkips();
+	if (left->isScanning() || right->isScanning() || join.pairsJoined() != (std::size_t)numResults)
+	{
+		return -1;
+	}
+
+	std::cout << "Number of results: " << numResults << " after " << skips << " skips" << std::endl;
+	return numResults;
+}
+
+int lsmScan(LsmIndex *index, int lowVal, int highVal)
+{
+	std::cout << "LSM scan for [" << lowVal << "," << highVal << "]" << std::endl;
+	try
+	{
+		index->startScan(&lowVal, GTE, &highVal, LTE);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		return 0;
+	}
+
+	// the entries of all runs come out in key order
+	int numResults = 0;
+	int lastKey = lowVal;
+	RecordId scanRid;
+	while (true)
+	{
+		try
+		{
+			index->scanNext(scanRid);
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+			break;
+		}
+		Page *curPage;
+		bufMgr->readPage(file1, scanRid.page_number, curPage);
+		const int key = reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data())->i;
+		bufMgr->unPinPage(file1, scanRid.page_number, false);
+		if (key < lastKey || key > highVal)
+		{
+			index->endScan();
+			return -1;
+		}
+		lastKey = key;
+		numResults++;
+	}
+	index->endScan();
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// bulkLoadTestsSearch
+// -----------------------------------------------------------------------------
+
+void bulkLoadTestsSearch()
+{
+	std::cout << "Bulk-load the B+ Tree index on the integer field at two fill factors, and build it by inserts" << std::endl;
+	BTreeStats stats[3];
+	const double fillFactors[] = {1.0, 0.5, 1.0};
+	for (int build = 0; build < 3; build++)
+	{
+		try
+		{
+			File::remove(intIndexName);
+		}
+		catch (const FileNotFoundException &e)
+		{
+		}
+		BTreeOptions options;
+		options.bulkLoad = (build < 2);
+		options.fillFactor = fillFactors[build];
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+		checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 5000)
+		checkPassFail(lookupRange(&index, -1000, 6000), 5000)
+		stats[build] = index.getStats();
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	// the dense keys take 5 bytes an entry in packed leaves; the loader fills each leaf up to its share of them
+	// before it starts the next, where inserts split leaves and leave room behind
+	const int fullLeaf = PACKEDLEAFDATASIZE / 5;
+	const int halfLeaf = (int)(PACKEDLEAFDATASIZE * 0.5) / 5;
+	checkPassFail((int)stats[0].leafPages, (5000 + fullLeaf - 1) / fullLeaf)
+	checkPassFail((int)stats[1].leafPages, (5000 + halfLeaf - 1) / halfLeaf)
+	checkPassFail((int)stats[0].entries, 5000)
+	checkPassFail((int)stats[1].entries, 5000)
+	checkPassFail((stats[2].leafPages >= stats[0].leafPages), true)
+	checkPassFail((stats[0].leafFill >= stats[2].leafFill), true)
+
+	// the loader builds the non-leaf levels over the leaves without splitting a node
+	checkPassFail((int)(stats[0].leafSplits + stats[0].nonLeafSplits + stats[0].rootSplits), 0)
+	checkPassFail((int)(stats[1].leafSplits + stats[1].nonLeafSplits + stats[1].rootSplits), 0)
+	checkPassFail((int)stats[0].inserts, 0)
+	checkPassFail((int)stats[2].inserts, 5000)
+}
+
+// -----------------------------------------------------------------------------
+// nodeSearchTestsSearch
+// -----------------------------------------------------------------------------
+
+void nodeSearchTestsSearch()
+{
+	std::cout << "Scan narrow windows around every key of a B+ Tree built by inserts in scrambled order" << std::endl;
+	const std::string emptyName = relationName + ".window";
+	{
+		PageFile::create(emptyName);
+	}
+	std::string indexName;
+	{
+		BTreeOptions options;
+		options.bulkLoad = false;
+		BTreeIndex index(emptyName, indexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+
+		// multiples of 3, each twice, so every window starts and ends on a key, next to one and between two
+		const int numKeys = 20000;
+		for (int k = 0; k < numKeys; k++)
+		{
+			int key = 3 * (int)(((long long)k * 7919) % numKeys);
+			for (int copy = 0; copy < 2; copy++)
+			{
+				RecordId entryRid;
+				entryRid.page_number = key + 1;
+				entryRid.slot_number = copy + 1;
+				index.insertEntry(&key, entryRid);
+			}
+		}
+		checkPassFail((index.getStats().leafSplits > 0), true)
+		checkPassFail(windowMismatches(&index, numKeys), 0)
+	}
+	File::remove(indexName);
+	File::remove(emptyName);
+}
+
+/**
+ * Scans windows of 4 values starting at every value from just below the smallest key, 0, to just above the
+ * largest, 3 * (numKeys - 1), of an index holding each multiple of 3 below 3 * numKeys twice, with every
+ * combination of operators. Returns the number of windows that found a different number of entries than
+ * there are in them.
+ */
+int windowMismatches(BTreeIndex *index, int numKeys)
+{
+	const Operator lowOps[] = {GT, GTE};
+	const Operator highOps[] = {LT, LTE};
+	int mismatches = 0;
+	for (int low = -2; low <= 3 * numKeys; low++)
+	{
+		const Operator lowOp = lowOps[low & 1];
+		const Operator highOp = highOps[(low >> 1) & 1];
+		int high = low + 4;
+		int expected = 0;
+		for (int v = std::max(low, 0); v <= high; v++)
+		{
+			if (v % 3 == 0 && v < 3 * numKeys && (v > low || lowOp == GTE) && (v < high || highOp == LTE))
+				expected += 2;
+		}
+
+		int found = 0;
+		try
+		{
+			index->startScan(&low, lowOp, &high, highOp);
+			RecordId scanRid;
+			while (1)
+			{
+				index->scanNext(scanRid);
+				found++;
+			}
+		}
+		catch (const NoSuchKeyFoundException &e)
+		{
+			// an empty window starts no scan
+			if (expected != 0)
+				mismatches++;
+			continue;
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+		}
+		index->endScan();
+		if (found != expected)
+			mismatches++;
+	}
+	return mismatches;
+}
+
+// -----------------------------------------------------------------------------
+// vectorSearchTestsSearch
+// -----------------------------------------------------------------------------
+
+void vectorSearchTestsSearch()
+{
+	std::cout << "Look up keys spread over the whole range of int in a B+ Tree searched with vector compares" << std::endl;
+
+	// unless scalar search is asked for, an x86 build searches the nodes with SSE or AVX2 compares
+#if defined(__AVX2__) && !defined(BADGERDB_SCALAR_SEARCH)
+	checkPassFail((std::is_same<BinaryKeySearch, Avx2KeySearch>::value), true)
+#elif defined(__SSE2__) && !defined(BADGERDB_SCALAR_SEARCH)
+	checkPassFail((std::is_same<BinaryKeySearch, SseKeySearch>::value), true)
+#endif
+
+	const std::string emptyName = relationName + ".vector";
+	{
+		PageFile::create(emptyName);
+	}
+	std::string indexName;
+	{
+		BTreeOptions options;
+		options.bulkLoad = false;
+		BTreeIndex index(emptyName, indexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+
+		// negative and positive keys far apart, so the non-leaf nodes compare signed keys and the leaves store
+		// 4-byte distances, with the ends of int on either side
+		const int numKeys = 20000;
+		const int spacing = 104729;
+		std::vector<int> keys;
+		keys.push_back(INT_MIN);
+		for (int k = 0; k < numKeys; k++)
+			keys.push_back((k - numKeys / 2) * spacing);
+		keys.push_back(INT_MAX);
+		for (std::size_t k = 0; k < keys.size(); k++)
+		{
+			int key = keys[(k * 7919) % keys.size()];
+			RecordId entryRid;
+			entryRid.page_number = (k * 7919) % keys.size() + 1;
+			entryRid.slot_number = 1;
+			index.insertEntry(&key, entryRid);
+		}
+		checkPassFail((index.getStats().height > 1), true)
+
+		// every key is found on its own, and nothing between two neighbours
+		int mismatches = 0;
+		for (std::size_t k = 0; k < keys.size(); k++)
+		{
+			RecordId found;
+			int low = keys[k];
+			int high = keys[k];
+			index.startScan(&low, GTE, &high, LTE);
+			index.scanNext(found);
+			if (found.page_number != k + 1)
+				mismatches++;
+			index.endScan();
+			if (k + 1 < keys.size())
+			{
+				high = keys[k + 1];
+				try
+				{
+					index.startScan(&low, GT, &high, LT);
+					mismatches++;
+					index.endScan();
+				}
+				catch (const NoSuchKeyFoundException &e)
+				{
+				}
+			}
+		}
+		checkPassFail(mismatches, 0)
+		checkPassFail(batchScan(&index, INT_MIN, GTE, INT_MAX, LTE, 256), (int)keys.size())
+		checkPassFail(batchScan(&index, INT_MIN, GT, INT_MAX, LT, 256), (int)keys.size() - 2)
+		checkPassFail(batchScan(&index, -1, GT, 0, LTE, 256), 1)
+	}
+	File::remove(indexName);
+	File::remove(emptyName);
+}
+
+// -----------------------------------------------------------------------------
+// stringPrefixTestsSearch
+// -----------------------------------------------------------------------------
+
+void stringPrefixTestsSearch()
+{
+	std::cout << "Index strings sharing a long prefix and strings sharing none on the string field" << std::endl;
+	const std::string sharedRelation = relationName + ".prefix1";
+	const std::string distinctRelation = relationName + ".prefix2";
+	{
+		PageFile::create(sharedRelation);
+		PageFile::create(distinctRelation);
+	}
+	std::string sharedName;
+	std::string distinctName;
+	{
+		BTreeOptions options;
+		options.bulkLoad = false;
+		BTreeIndex shared(sharedRelation, sharedName, bufMgr, offsetof(tuple, s), STRING, options);
+		BTreeIndex distinct(distinctRelation, distinctName, bufMgr, offsetof(tuple, s), STRING, options);
+
+		// the same 10000 numbers, after six shared bytes in one index and before them in the other
+		const int numKeys = 10000;
+		for (int k = 0; k < numKeys; k++)
+		{
+			const int n = (int)(((long long)k * 7919) % numKeys);
+			char key[STRINGSIZE + 1];
+			RecordId entryRid;
+			entryRid.page_number = n + 1;
+			entryRid.slot_number = 1;
+			sprintf(key, "zzzzzz%04d", n);
+			shared.insertEntry(key, entryRid);
+			sprintf(key, "%04dzzzzzz", n);
+			distinct.insertEntry(key, entryRid);
+		}
+
+		// leaves store the shared bytes once, so the same entries take fewer of them
+		const BTreeStats sharedStats = shared.getStats();
+		const BTreeStats distinctStats = distinct.getStats();
+		checkPassFail((int)sharedStats.entries, numKeys)
+		checkPassFail((int)distinctStats.entries, numKeys)
+		checkPassFail((sharedStats.leafPages < distinctStats.leafPages), true)
+		checkPassFail((sharedStats.leafSplits > 0), true)
+
+		checkPassFail(stringCount(&shared, "zzzzzz0000", GTE, "zzzzzz9999", LTE), numKeys)
+		checkPassFail(stringCount(&shared, "zzzzzz1000", GTE, "zzzzzz1999", LTE), 1000)
+		checkPassFail(stringCount(&shared, "zzzzzz1000", GT, "zzzzzz2000", LT), 999)
+		checkPassFail(stringCount(&distinct, "1000zzzzzz", GTE, "1999zzzzzz", LTE), 1000)
+
+		// a key that is the shared prefix alone sorts before all of them, and one a byte longer between two
+		RecordId entryRid;
+		entryRid.page_number = numKeys + 1;
+		entryRid.slot_number = 1;
+		shared.insertEntry("zzzzzz", entryRid);
+		shared.insertEntry("zzzzzz5", entryRid);
+		checkPassFail(stringCount(&shared, "zzzzzz", GTE, "zzzzzz0000", LT), 1)
+		checkPassFail(stringCount(&shared, "zzzzzz4999", GT, "zzzzzz5000", LT), 1)
+		checkPassFail(stringCount(&shared, "zzzzzy", GT, "zzzzzz9999", LTE), numKeys + 2)
+		checkPassFail(stringCount(&shared, "zzzzzz999a", GTE, "zzzzzzz", LTE), 0)
+	}
+	File::remove(sharedName);
+	File::remove(distinctName);
+	File::remove(sharedRelation);
+	File::remove(distinctRelation);
+}
+
+/**
+ * Returns the number of entries of the string index in the range, 0 if the scan finds none.
+ */
+int stringCount(BTreeIndex *index, const char *lowVal, Operator lowOp, const char *highVal, Operator highOp)
+{
+	std::vector<RecordId> batch(256);
+	int numResults = 0;
+	try
+	{
+		index->startScan(lowVal, lowOp, highVal, highOp);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		return 0;
+	}
+	try
+	{
+		while (1)
+		{
+			numResults += index->scanNextBatch(&batch[0], batch.size());
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	index->endScan();
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// statsTestsSearch
+// -----------------------------------------------------------------------------
+
+void statsTestsSearch()
+{
+	std::cout << "Count the shape of the B+ Tree index and the work done on it" << std::endl;
+	const std::string emptyName = relationName + ".stats";
+	{
+		PageFile::create(emptyName);
+	}
+	std::string indexName;
+	{
+		BTreeOptions options;
+		options.bulkLoad = false;
+		BTreeIndex index(emptyName, indexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+		// a new index is a single empty leaf
+		BTreeStats stats = index.getStats();
+		checkPassFail((int)stats.height, 1)
+		checkPassFail((int)stats.leafPages, 1)
+		checkPassFail((int)stats.nonLeafPages, 0)
+		checkPassFail((int)stats.entries, 0)
+		checkPassFail((int)stats.inserts, 0)
+
+		// without deletes, every leaf but the first comes from a split and every level above the leaves from a root
+		// split; an insert reads at least one node and at most one per level
+		const int numKeys = 20000;
+		for (int key = 0; key < numKeys; key++)
+		{
+			RecordId entryRid;
+			entryRid.page_number = key + 1;
+			entryRid.slot_number = 1;
+			index.insertEntry(&key, entryRid);
+		}
+		stats = index.getStats();
+		checkPassFail((int)stats.entries, numKeys)
+		checkPassFail((int)stats.inserts, numKeys)
+		checkPassFail((int)stats.insertRetries, 0)
+		checkPassFail((stats.height > 1), true)
+		checkPassFail(stats.leafSplits, stats.leafPages - 1)
+		checkPassFail((int)stats.rootSplits, stats.height - 1)
+		checkPassFail(stats.nonLeafSplits + stats.rootSplits, stats.nonLeafPages)
+		checkPassFail((stats.insertNodeVisits > stats.inserts), true)
+		checkPassFail((stats.insertNodeVisits <= stats.inserts * stats.height), true)
+		checkPassFail((stats.leafFill > 0 && stats.leafFill <= 1), true)
+		checkPassFail((stats.nonLeafFill > 0 && stats.nonLeafFill <= 1), true)
+
+		// clearing the counts leaves the shape
+		const BTreeStats built = stats;
+		index.clearStats();
+		stats = index.getStats();
+		checkPassFail((int)stats.inserts, 0)
+		checkPassFail((int)stats.insertNodeVisits, 0)
+		checkPassFail((int)stats.leafSplits, 0)
+		checkPassFail((int)stats.rootSplits, 0)
+		checkPassFail(stats.leafPages, built.leafPages)
+		checkPassFail(stats.entries, built.entries)
+
+		// a scan descends once and moves on to every leaf after the first; the call finding the end counts too
+		const int lowVal = 0;
+		const int highVal = numKeys;
+		index.startScan(&lowVal, GTE, &highVal, LT);
+		RecordId outRid;
+		int nexts = 0;
+		try
+		{
+			while (1)
+			{
+				index.scanNext(outRid);
+				nexts++;
+			}
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+		}
+		index.endScan();
+		checkPassFail(nexts, numKeys)
+		RecordId matches[4];
+		checkPassFail((int)index.lookup(&lowVal, matches, 4), 1)
+		stats = index.getStats();
+		checkPassFail((int)stats.scans, 1)
+		checkPassFail((int)stats.scanNodeVisits, stats.height)
+		checkPassFail((int)stats.scanNexts, numKeys + 1)
+		checkPassFail(stats.scanNextNodeVisits, stats.leafPages - 1)
+		checkPassFail((int)stats.lookups, 1)
+		checkPassFail((int)stats.lookupNodeVisits, stats.height)
+		checkPassFail((int)stats.inserts, 0)
+	}
+	File::remove(indexName);
+	File::remove(emptyName);
+}
+
+// -----------------------------------------------------------------------------
+// parallelTestsSearch
+// -----------------------------------------------------------------------------
+
+void parallelTestsSearch()
+{
+	std::cout << "Build the B+ Tree index on the integer field with several threads" << std::endl;
+	for (int bulk = 1; bulk >= 0; bulk--)
+	{
+		try
+		{
+			File::remove(intIndexName);
+		}
+		catch (const FileNotFoundException &e)
+		{
+		}
+		BTreeOptions options;
+		options.bulkLoad = (bulk == 1);
+		options.buildThreads = 4;
+		options.sortRunSize = 1000;
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+
+		checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 5000)
+		checkPassFail(lookupRange(&index, -1000, 6000), 5000)
+	}
+
+	// every record of the relation is visited once, whichever thread takes its page
+	checkPassFail(parallelCount(4, 1), 5000)
+	checkPassFail(parallelCount(3, SCAN_MORSEL_PAGES), 5000)
+}
+
+// -----------------------------------------------------------------------------
+// concurrentInsertTestsSearch
+// -----------------------------------------------------------------------------
+
+/**
+ * What one thread of concurrentInsertTestsSearch() works on and what it found.
+ */
+struct InsertWorker
+{
+	BTreeIndex *index;
+	const std::atomic<bool> *inserting;
+	int id;
+	int numThreads;
+	int numKeys;
+	int errors;
+	int scans;
+	int disorder;
+};
+
+/**
+ * Inserts every numThreads-th key from the thread's id up, keys the other threads insert next to it.
+ */
+void insertWorkerRun(InsertWorker *worker)
+{
+	for (int key = worker->id; key < worker->numKeys; key += worker->numThreads)
+	{
+		try
+		{
+			RecordId entryRid;
+			entryRid.page_number = key + 1;
+			entryRid.slot_number = 1;
+			worker->index->insertEntry(&key, entryRid);
+		}
+		catch (const BadgerDbException &e)
+		{
+			worker->errors++;
+		}
+	}
+}
+
+/**
+ * Scans the whole index over and over while the other threads insert, counting entries that do not come in
+ * increasing order. Every rid holds its key plus one.
+ */
+void scanWorkerRun(InsertWorker *worker)
+{
+	const int lowVal = INT_MIN;
+	const int highVal = INT_MAX;
+	std::vector<RecordId> batch(64);
+	while (worker->inserting->load())
+	{
+		try
+		{
+			worker->index->startScan(&lowVal, GTE, &highVal, LTE);
+		}
+		catch (const NoSuchKeyFoundException &e)
+		{
+			continue;
+		}
+		PageId last = 0;
+		try
+		{
+			while (1)
+			{
+				const std::size_t filled = worker->index->scanNextBatch(&batch[0], batch.size());
+				for (std::size_t i = 0; i < filled; i++)
+				{
+					if (batch[i].page_number <= last)
+						worker->disorder++;
+					last = batch[i].page_number;
+				}
+			}
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+		}
+		catch (const BadgerDbException &e)
+		{
+			worker->errors++;
+		}
+		worker->index->endScan();
+		worker->scans++;
+	}
+}
+
+void concurrentInsertTestsSearch()
+{
+	std::cout << "Insert into the B+ Tree index on the integer field from several threads while another scans it" << std::endl;
+	const std::string emptyName = relationName + ".inserts";
+	{
+		PageFile::create(emptyName);
+	}
+	std::string indexName;
+	{
+		BTreeOptions options;
+		options.bulkLoad = false;
+		BTreeIndex index(emptyName, indexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+
+		// the threads insert neighbouring keys, so they keep splitting the same leaves under each other
+		const int numThreads = 4;
+		const int numKeys = 20000;
+		std::atomic<bool> inserting(true);
+		std::vector<InsertWorker> workers(numThreads + 1);
+		for (int k = 0; k <= numThreads; k++)
+		{
+			workers[k].index = &index;
+			workers[k].inserting = &inserting;
+			workers[k].id = k;
+			workers[k].numThreads = numThreads;
+			workers[k].numKeys = numKeys;
+			workers[k].errors = 0;
+			workers[k].scans = 0;
+			workers[k].disorder = 0;
+		}
+		std::thread scanner(scanWorkerRun, &workers[numThreads]);
+		std::vector<std::thread> threads;
+		for (int k = 0; k < numThreads; k++)
+			threads.push_back(std::thread(insertWorkerRun, &workers[k]));
+		for (int k = 0; k < numThreads; k++)
+			threads[k].join();
+		inserting.store(false);
+		scanner.join();
+
+		int errors = 0;
+		for (int k = 0; k <= numThreads; k++)
+			errors += workers[k].errors;
+		checkPassFail(errors, 0)
+		// splits only move entries right, so a scan racing them neither repeats nor goes back
+		checkPassFail(workers[numThreads].disorder, 0)
+
+		const BTreeStats stats = index.getStats();
+		checkPassFail((int)stats.inserts, numKeys)
+		checkPassFail((int)stats.entries, numKeys)
+		checkPassFail((stats.height > 1), true)
+		checkPassFail((stats.leafSplits > 0), true)
+
+		// no insert was lost, and every key has its own rid
+		int mismatches = 0;
+		RecordId matches[4];
+		for (int key = 0; key < numKeys; key++)
+		{
+			if (index.lookup(&key, matches, 4) != 1 || matches[0].page_number != (PageId)key + 1)
+				mismatches++;
+		}
+		checkPassFail(mismatches, 0)
+		checkPassFail(batchScan(&index, 0, GTE, numKeys, LT, 256), numKeys)
+	}
+	File::remove(indexName);
+	File::remove(emptyName);
+}
+
+// -----------------------------------------------------------------------------
+// readOnlyTestsSearch
+// -----------------------------------------------------------------------------
+
+void readOnlyTestsSearch()
+{
+	std::cout << "Reopen the B+ Tree index on the integer field read-only" << std::endl;
+	BTreeOptions options;
+	options.readOnly = true;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+
+	// scans read the nodes straight from the mapped file
+	checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 5000)
+	checkPassFail(lookupRange(&index, -1000, 6000), 5000)
+
+	int key = 6000;
+	try
+	{
+		index.insertEntry(&key, rid);
+		std::cout << "Insert into a read-only index should have thrown" << std::endl;
+		exit(1);
+	}
+	catch (const ReadOnlyFileException &e)
+	{
+		std::cout << "ReadOnlyFileException Test Passed." << std::endl;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// deleteTestsSearch
+// -----------------------------------------------------------------------------
+
+void deleteTestsSearch()
+{
+	std::cout << "Delete entries from the B+ Tree index on the integer field" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	std::vector<std::pair<int, RecordId> > deleted;
+	const bool severalLeaves = index.getStats().leafPages > 1;
+
+	// thinning every leaf to half stays above the merge threshold
+	checkPassFail(deleteRange(&index, 0, 5000, 2, deleted), 2500)
+	checkPassFail(deleteRange(&index, 0, 5000, 2, deleted), 0)
+	checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 2500)
+
+	// emptying most of the leaves merges them away
+	checkPassFail(deleteRange(&index, 1, 4000, 2, deleted), 2000)
+	checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 500)
+	checkPassFail(lookupRange(&index, -1000, 6000), 500)
+	BTreeStats stats = index.getStats();
+	checkPassFail((int)stats.entries, 500)
+	checkPassFail((stats.leafMerges > 0), severalLeaves)
+
+	// compaction packs what is left into a single leaf
+	std::cout << "Compact the B+ Tree index" << std::endl;
+	index.compact();
+	stats = index.getStats();
+	checkPassFail((int)stats.leafPages, 1)
+	checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 500)
+	checkPassFail(lookupRange(&index, -1000, 6000), 500)
+
+	// the entries can be put back
+	for (std::size_t i = 0; i < deleted.size(); i++)
+	{
+		index.insertEntry(&deleted[i].first, deleted[i].second);
+	}
+	checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 5000)
+	checkPassFail(lookupRange(&index, -1000, 6000), 5000)
+
+	// dense keys on few pages pack into two bytes of key and one of page number per entry, 5 bytes with the
+	// slot number, so 5000 entries fit in 4 leaves of 8 KB where a 4-byte key and 8-byte record id take 8
+	index.compact();
+	stats = index.getStats();
+	checkPassFail((int)stats.leafPages, (5000 * 5 + PACKEDLEAFDATASIZE - 1) / PACKEDLEAFDATASIZE)
+	checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 5000)
+
+	// duplicates of a key go on in the next leaves once they fill one, far away page numbers widening the leaves
+	std::cout << "Insert and delete 3000 duplicates of one key" << std::endl;
+	int dupKey = 7;
+	std::vector<RecordId> dupRids(3000);
+	for (std::size_t i = 0; i < dupRids.size(); i++)
+	{
+		dupRids[i].page_number = 100000 + i;
+		dupRids[i].slot_number = 1;
+		index.insertEntry(&dupKey, dupRids[i]);
+	}
+	checkPassFail(batchScan(&index, dupKey, GTE, dupKey, LTE, 256), 3001)
+	std::vector<RecordId> matches(4000);
+	checkPassFail((int)index.lookup(&dupKey, &matches[0], matches.size()), 3001)
+	int numDeleted = 0;
+	for (std::size_t i = 0; i < dupRids.size(); i++)
+	{
+		numDeleted += index.deleteEntry(&dupKey, dupRids[i]);
+	}
+	checkPassFail(numDeleted, 3000)
+	checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 5000)
+}
+
+// -----------------------------------------------------------------------------
+// retireTestsSearch
+// -----------------------------------------------------------------------------
+
+void retireTestsSearch()
+{
+	std::cout << "Free the page a borrow retires once the scans that started before it are done" << std::endl;
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+	BlobFile file = BlobFile::open(intIndexName);
+	std::vector<std::pair<int, RecordId> > deleted;
+
+	// full leaves, so that a leaf thinned below the threshold next to a full one borrows from it
+	index.compact(1.0);
+	BTreeStats stats = index.getStats();
+	const bool severalLeaves = stats.leafPages > 1;
+	std::vector<PageId> usedBefore;
+	for (PageId pageNo = 1; pageNo < 100000; pageNo++)
+	{
+		if (file.pageInUse(pageNo))
+			usedBefore.push_back(pageNo);
+	}
+	const std::uint64_t freedBefore = stats.freedPages;
+
+	// thin the first leaf until it borrows from its sibling, which replaces the sibling by a new page, while a
+	// scan that started before runs
+	int lowVal = 0;
+	int highVal = 5000;
+	IndexScanCursor early(&index);
+	early.startScan(&lowVal, GTE, &highVal, LT);
+	int key = 0;
+	for (; key < 5000 && index.getStats().leafBorrows == 0; key++)
+	{
+		RecordId match;
+		if (key % 10 != 0 && index.lookup(&key, &match, 1) == 1 && index.deleteEntry(&key, match))
+			deleted.push_back(std::make_pair(key, match));
+	}
+	stats = index.getStats();
+	checkPassFail((stats.leafBorrows > 0), severalLeaves)
+	checkPassFail(stats.freedPages, freedBefore)
+
+	// a scan started after the sibling was retired does not keep it from being freed
+	IndexScanCursor late(&index);
+	late.startScan(&lowVal, GTE, &highVal, LT);
+	early.endScan();
+	for (int numDeleted = 0; numDeleted < 1 && key < 5000; key++)
+	{
+		RecordId match;
+		if (key % 10 != 0 && index.lookup(&key, &match, 1) == 1 && index.deleteEntry(&key, match))
+		{
+			deleted.push_back(std::make_pair(key, match));
+			numDeleted++;
+		}
+	}
+	checkPassFail((index.getStats().freedPages > freedBefore), severalLeaves)
+	late.endScan();
+
+	// putting the entries back splits leaves into the pages freed
+	std::vector<PageId> freed;
+	for (std::size_t i = 0; i < usedBefore.size(); i++)
+		if (!file.pageInUse(usedBefore[i]))
+			freed.push_back(usedBefore[i]);
+	checkPassFail((freed.size() > 0), severalLeaves)
+	for (std::size_t i = 0; i < deleted.size(); i++)
+		index.insertEntry(&deleted[i].first, deleted[i].second);
+	int reused = 0;
+	for (std::size_t i = 0; i < freed.size(); i++)
+		if (file.pageInUse(freed[i]))
+			reused++;
+	checkPassFail((reused > 0), severalLeaves)
+	checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 5000)
+	checkPassFail(lookupRange(&index, -1000, 6000), 5000)
+}
+
+// -----------------------------------------------------------------------------
+// deltaTestsSearch
+// -----------------------------------------------------------------------------
+
+void deltaTestsSearch()
+{
+	std::cout << "Insert into the B+ Tree index through a delta buffer" << std::endl;
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+	BTreeOptions options;
+	options.deltaBufferSize = 256;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+	std::vector<std::pair<int, RecordId> > deleted;
+	checkPassFail(deleteRange(&index, 0, 5000, 2, deleted), 2500)
+
+	// a scan sees the entries still in the buffer
+	for (std::size_t i = 0; i < 100; i++)
+	{
+		index.insertEntry(&deleted[i].first, deleted[i].second);
+	}
+	checkPassFail(intScan(&index, -1000, GTE, 6000, LT), 2600)
+
+	// the rest go in backwards, several buffers full of them
+	for (std::size_t i = deleted.size(); i-- > 100;)
+	{
+		index.insertEntry(&deleted[i].first, deleted[i].second);
+	}
+	checkPassFail(lookupRange(&index, -1000, 6000), 5000)
+	BTreeStats stats = index.getStats();
+	checkPassFail((int)stats.entries, 5000)
+	checkPassFail((stats.deltaFlushes >= 10), true)
+}
+
+// -----------------------------------------------------------------------------
+// coveredTestsSearch
+// -----------------------------------------------------------------------------
+
+void coveredTestsSearch()
+{
+	std::cout << "Create a covering B+ Tree index on the integer field including the double field" << std::endl;
+	BTreeOptions options;
+	IndexAttribute attribute;
+	attribute.attrByteOffset = offsetof(tuple, d);
+	attribute.attrType = DOUBLE;
+	options.included.push_back(attribute);
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, options);
+	checkPassFail(index.getPayloadSize(), (int)sizeof(double))
+
+	// every entry carries the double of its record, so the scan needs no record
+	checkPassFail(coveredScan(&index, 1000, 4000), 3001)
+
+	// inserted entries carry the payload they were given, and splits keep it with them
+	for (int key = 5000; key < 6000; key++)
+	{
+		double d = key;
+		RecordId fakeRid;
+		fakeRid.page_number = 100000 + key;
+		fakeRid.slot_number = 1;
+		index.insertEntry(&key, fakeRid, &d);
+	}
+	checkPassFail(coveredScan(&index, 0, 5999), 6000)
+}
+
+// -----------------------------------------------------------------------------
+// splitScratchTestsSearch
+// -----------------------------------------------------------------------------
+
+void splitScratchTestsSearch()
+{
+	std::cout << "Split, merge and rebalance the leaves of two DOUBLE indexes in turn on one thread" << std::endl;
+	const std::string coveredRelation = relationName + ".split1";
+	const std::string plainRelation = relationName + ".split2";
+	{
+		PageFile::create(coveredRelation);
+		PageFile::create(plainRelation);
+	}
+	std::string coveredName;
+	std::string plainName;
+	{
+		// the leaves of both decode into the same scratch entries of this thread, one with payloads and one without
+		BTreeOptions options;
+		IndexAttribute attribute;
+		attribute.attrByteOffset = offsetof(tuple, d);
+		attribute.attrType = DOUBLE;
+		options.included.push_back(attribute);
+		BTreeIndex covered(coveredRelation, coveredName, bufMgr, offsetof(tuple, d), DOUBLE, options);
+		BTreeIndex plain(plainRelation, plainName, bufMgr, offsetof(tuple, d), DOUBLE);
+
+		// three entries a key, so posting lists are split between leaves too
+		const int numKeys = 5000;
+		for (int key = 0; key < numKeys; key++)
+		{
+			for (int copy = 0; copy < 3; copy++)
+			{
+				double d = key;
+				double payload = 2.0 * key + copy;
+				RecordId entryRid;
+				entryRid.page_number = key + 1;
+				entryRid.slot_number = copy + 1;
+				covered.insertEntry(&d, entryRid, &payload);
+				plain.insertEntry(&d, entryRid);
+			}
+		}
+
+		// thinning every list to one entry and emptying a range merges leaves or moves entries between them
+		for (int key = 0; key < numKeys; key++)
+		{
+			for (int copy = 0; copy < 3; copy++)
+			{
+				if (copy == 2 && (key < 1000 || key >= 3000))
+					continue;
+				double d = key;
+				RecordId entryRid;
+				entryRid.page_number = key + 1;
+				entryRid.slot_number = copy + 1;
+				covered.deleteEntry(&d, entryRid);
+				plain.deleteEntry(&d, entryRid);
+			}
+		}
+		const BTreeStats coveredStats = covered.getStats();
+		const BTreeStats plainStats = plain.getStats();
+		checkPassFail((coveredStats.leafSplits > 0), true)
+		checkPassFail((plainStats.leafSplits > 0), true)
+		checkPassFail((coveredStats.leafMerges + coveredStats.leafBorrows > 0), true)
+		checkPassFail((plainStats.leafMerges + plainStats.leafBorrows > 0), true)
+		checkPassFail((int)coveredStats.entries, numKeys - 2000)
+		checkPassFail((int)plainStats.entries, numKeys - 2000)
+
+		// every entry left is the last one of its key, and the covered one still carries its own payload
+		double low = 0;
+		double high = numKeys;
+		std::vector<RecordId> batch(64);
+		std::vector<double> payloads(batch.size());
+		int matches = 0;
+		covered.startScan(&low, GTE, &high, LT);
+		try
+		{
+			while (1)
+			{
+				const std::size_t filled = covered.scanNextCovered(&batch[0], &payloads[0], batch.size());
+				for (std::size_t i = 0; i < filled; i++)
+				{
+					const int key = batch[i].page_number - 1;
+					if (batch[i].slot_number == 3 && payloads[i] == 2.0 * key + 2 && (key < 1000 || key >= 3000))
+						matches++;
+				}
+			}
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+		}
+		covered.endScan();
+		checkPassFail(matches, numKeys - 2000)
+
+		matches = 0;
+		PageId lastPage = 0;
+		plain.startScan(&low, GTE, &high, LT);
+		try
+		{
+			while (1)
+			{
+				const std::size_t filled = plain.scanNextBatch(&batch[0], batch.size());
+				for (std::size_t i = 0; i < filled; i++)
+				{
+					if (batch[i].slot_number == 3 && batch[i].page_number > lastPage)
+						matches++;
+					lastPage = batch[i].page_number;
+				}
+			}
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+		}
+		plain.endScan();
+		checkPassFail(matches, numKeys - 2000)
+	}
+	File::remove(coveredName);
+	File::remove(plainName);
+	File::remove(coveredRelation);
+	File::remove(plainRelation);
+}
+
+// -----------------------------------------------------------------------------
+// coveredScan
+// -----------------------------------------------------------------------------
+
+int coveredScan(BTreeIndex *index, int lowVal, int highVal)
+{
+	std::cout << "Covered scan for " << lowVal << "," << highVal << std::endl;
+
+	// the keys are unique and equal to the double field, so the payloads count up from lowVal
+	std::vector<RecordId> batch(64);
+	std::vector<double> payloads(batch.size());
+	int numResults = 0;
+	index->startScan(&lowVal, GTE, &highVal, LTE);
+	try
+	{
+		while (1)
+		{
+			const std::size_t filled = index->scanNextCovered(&batch[0], &payloads[0], batch.size());
+			for (std::size_t i = 0; i < filled; i++)
+			{
+				if (payloads[i] == lowVal + numResults)
+				{
+					numResults++;
+				}
+			}
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	index->endScan();
+
+	std::cout << "Number of results: " << numResults << std::endl;
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// compositeTestsSearch
+// -----------------------------------------------------------------------------
+
+void compositeTestsSearch()
+{
+	std::cout << "Create a B+ Tree index on the composite key (i, d)" << std::endl;
+	std::vector<IndexAttribute> keyAttrs(2);
+	keyAttrs[0].attrByteOffset = offsetof(tuple, i);
+	keyAttrs[0].attrType = INTEGER;
+	keyAttrs[1].attrByteOffset = offsetof(tuple, d);
+	keyAttrs[1].attrType = DOUBLE;
+	std::string compositeIndexName;
+	{
+		BTreeIndex index(relationName, compositeIndexName, bufMgr, keyAttrs);
+
+		// the range is ordered by i first, so every d of the keys in between qualifies
+		RECORD low, high;
+		low.i = 1000;
+		low.d = -1e9;
+		high.i = 4000;
+		high.d = 1e9;
+		checkPassFail(compositeScan(&index, low, high), 3001)
+
+		// lookups need both attributes to match
+		RecordId match;
+		low.i = 1234;
+		low.d = 1234;
+		checkPassFail((int)index.lookup(&low, &match, 1), 1)
+		low.d = 1234.5;
+		checkPassFail((int)index.lookup(&low, &match, 1), 0)
+	}
+	File::remove(compositeIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// compositeScan
+// -----------------------------------------------------------------------------
+
+int compositeScan(BTreeIndex *index, const RECORD &low, const RECORD &high)
+{
+	std::cout << "Composite scan for (" << low.i << "," << low.d << "),(" << high.i << "," << high.d << ")" << std::endl;
+
+	std::vector<RecordId> batch(64);
+	int numResults = 0;
+	index->startScan(&low, GTE, &high, LTE);
+	try
+	{
+		while (1)
+		{
+			numResults += index->scanNextBatch(&batch[0], batch.size());
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	index->endScan();
+
+	std::cout << "Number of results: " << numResults << std::endl;
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// deleteRange
+// -----------------------------------------------------------------------------
+
+int deleteRange(BTreeIndex *index, int lowVal, int highVal, int step, std::vector<std::pair<int, RecordId> > &deleted)
+{
+	std::cout << "Delete the keys in [" << lowVal << "," << highVal << ") in steps of " << step << std::endl;
+
+	int numDeleted = 0;
+	for (int key = lowVal; key < highVal; key += step)
+	{
+		RecordId match;
+		if (index->lookup(&key, &match, 1) == 1 && index->deleteEntry(&key, match))
+		{
+			deleted.push_back(std::make_pair(key, match));
+			numDeleted++;
+		}
+	}
+
+	std::cout << "Number of entries deleted: " << numDeleted << std::endl;
+	return numDeleted;
+}
+
+// -----------------------------------------------------------------------------
+// batchScan
+// -----------------------------------------------------------------------------
+
+int batchScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, int batchSize)
+{
+	std::cout << "Batched scan of " << batchSize << " entries for " << lowVal << "," << highVal << std::endl;
+
+	std::vector<RecordId> batch(batchSize);
+	int numResults = 0;
+	index->startScan(&lowVal, lowOp, &highVal, highOp);
+	try
+	{
+		while (1)
+		{
+			numResults += index->scanNextBatch(&batch[0], batch.size());
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	index->endScan();
+
+	std::cout << "Number of results: " << numResults << std::endl;
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// parallelCount
+// -----------------------------------------------------------------------------
+
+void countRecord(std::size_t worker, const RecordId &rid, const RecordView &record, void *arg)
+{
+	((int *)arg)[worker]++;
+}
+
+int parallelCount(std::size_t numThreads, std::size_t morselPages)
+{
+	std::cout << "Count the records with " << numThreads << " threads" << std::endl;
+
+	std::vector<int> counts(numThreads, 0);
+	FileScan::parallelScan(relationName, bufMgr, numThreads, &countRecord, &counts[0], morselPages);
+	int numResults = 0;
+	for (std::size_t k = 0; k < numThreads; k++)
+	{
+		numResults += counts[k];
+	}
+	std::cout << "Number of results: " << numResults << std::endl;
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// filteredScan
+// -----------------------------------------------------------------------------
+
+bool isMultipleOf(const void *key, void *arg)
+{
+	return *(const int *)key % *(int *)arg == 0;
+}
+
+int filteredScan(BTreeIndex *index, int lowVal, int highVal, std::size_t limit, bool batched)
+{
+	std::cout << "Scan of multiples of 3 for " << lowVal << "," << highVal << " limited to " << limit << std::endl;
+
+	int divisor = 3;
+	ScanOptions scanOptions;
+	scanOptions.predicate = &isMultipleOf;
+	scanOptions.predicateArg = &divisor;
+	scanOptions.limit = limit;
+
+	RecordId batch[64];
+	int numResults = 0;
+	index->startScan(&lowVal, GTE, &highVal, LTE, scanOptions);
+	try
+	{
+		while (1)
+		{
+			if (batched)
+			{
+				numResults += index->scanNextBatch(batch, 64);
+			}
+			else
+			{
+				index->scanNext(batch[0]);
+				numResults++;
+			}
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	index->endScan();
+
+	std::cout << "Number of results: " << numResults << std::endl;
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// lookupRange
+// -----------------------------------------------------------------------------
+
+int lookupRange(BTreeIndex *index, int lowVal, int highVal)
+{
+	std::cout << "Lookups of every key in [" << lowVal << "," << highVal << ")" << std::endl;
+
+	RecordId matches[4];
+	int numResults = 0;
+	for (int key = lowVal; key < highVal; key++)
+	{
+		numResults += index->lookup(&key, matches, 4);
+	}
+
+	std::cout << "Number of results: " << numResults << std::endl;
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// lookupBatchRange
+// -----------------------------------------------------------------------------
+
+int lookupBatchRange(BTreeIndex *index, int lowVal, int highVal, bool interleaved)
+{
+	std::cout << (interleaved ? "Interleaved" : "Batched") << " lookup of every key in [" << lowVal << "," << highVal << ") in descending order" << std::endl;
+
+	std::vector<int> keys;
+	for (int key = highVal - 1; key >= lowVal; key--)
+	{
+		keys.push_back(key);
+	}
+	std::vector<const void *> probes;
+	for (std::size_t i = 0; i < keys.size(); i++)
+	{
+		probes.push_back(&keys[i]);
+	}
+	std::vector<RecordId> matches;
+	std::vector<std::size_t> offsets;
+	if (interleaved)
+	{
+		index->lookupInterleaved(&probes[0], probes.size(), matches, offsets);
+	}
+	else
+	{
+		index->lookupBatch(&probes[0], probes.size(), matches, offsets);
+	}
+
+	int numResults = 0;
+	for (std::size_t i = 0; i < keys.size(); i++)
+	{
+		// each key of the relation matches once, at the position it was asked for
+		if (offsets[i + 1] - offsets[i] == 1)
+		{
+			numResults++;
+		}
+	}
+
+	std::cout << "Number of results: " << numResults << std::endl;
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// interleavedScan
+// -----------------------------------------------------------------------------
+
+int interleavedScan(BTreeIndex *index, int lowVal1, int highVal1, int lowVal2, int highVal2)
+{
+	std::cout << "Interleaved scans for [" << lowVal1 << "," << highVal1 << ") and [" << lowVal2 << "," << highVal2 << ")" << std::endl;
+
+	IndexScanCursor first(index);
+	IndexScanCursor second(index);
+	first.startScan(&lowVal1, GTE, &highVal1, LT);
+	second.startScan(&lowVal2, GTE, &highVal2, LT);
+
+	int numResults = 0;
+	bool firstDone = false;
+	bool secondDone = false;
+	while (!firstDone || !secondDone)
+	{
+		RecordId scanRid;
+		if (!firstDone)
+		{
+			try
+			{
+				first.scanNext(scanRid);
+				numResults++;
+			}
+			catch (const IndexScanCompletedException &e)
+			{
+				firstDone = true;
+			}
+		}
+		if (!secondDone)
+		{
+			try
+			{
+				second.scanNext(scanRid);
+				numResults++;
+			}
+			catch (const IndexScanCompletedException &e)
+			{
+				secondDone = true;
+			}
+		}
+	}
+	first.endScan();
+	second.endScan();
+
+	std::cout << "Number of results: " << numResults << std::endl;
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// intTests
+// -----------------------------------------------------------------------------
+
+void intTests()
+{
+	std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+	BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+	// run some tests
+	checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+		checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
+			checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
+				checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
+					checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
+						checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
+							checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+}
+
+int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+	std::cout << "Scan for ";
+	if (lowOp == GT)
+	{
+		std::cout << "(";
+	}
+	else
+	{
+		std::cout << "[";
+	}
+	std::cout << lowVal << "," << highVal;
+	if (highOp == LT)
+	{
+		std::cout << ")";
+	}
+	else
+	{
+		std::cout << "]";
+	}
+	std::cout << std::endl;
+
+	return scanAndPrint(index, &lowVal, lowOp, &highVal, highOp);
+}
+
+// -----------------------------------------------------------------------------
+// doubleTests
+// -----------------------------------------------------------------------------
+
+void doubleTests()
+{
+	std::cout << "Create a B+ Tree index on the double field" << std::endl;
+	BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+
+	// run some tests
+	checkPassFail(doubleScan(&index, 25, GT, 40, LT), 14)
+		checkPassFail(doubleScan(&index, 20, GTE, 35, LTE), 16)
+			checkPassFail(doubleScan(&index, -3, GT, 3, LT), 3)
+				checkPassFail(doubleScan(&index, 996, GT, 1001, LT), 4)
+					checkPassFail(doubleScan(&index, 0, GT, 1, LT), 0)
+						checkPassFail(doubleScan(&index, 300, GT, 400, LT), 99)
+							checkPassFail(doubleScan(&index, 3000, GTE, 4000, LT), 1000)
+}
+
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp)
+{
+	std::cout << "Scan for ";
+	if (lowOp == GT)
+	{
+		std::cout << "(";
+	}
+	else
+	{
+		std::cout << "[";
+	}
+	std::cout << lowVal << "," << highVal;
+	if (highOp == LT)
+	{
+		std::cout << ")";
+	}
+	else
+	{
+		std::cout << "]";
+	}
+	std::cout << std::endl;
+
+	return scanAndPrint(index, &lowVal, lowOp, &highVal, highOp);
+}
+
+// -----------------------------------------------------------------------------
+// stringTests
+// -----------------------------------------------------------------------------
+
+void stringTests()
+{
+	std::cout << "Create a B+ Tree index on the string field" << std::endl;
+	BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s), STRING);
+
+	// run some tests
+	checkPassFail(stringScan(&index, 25, GT, 40, LT), 14)
+		checkPassFail(stringScan(&index, 20, GTE, 35, LTE), 16)
+			checkPassFail(stringScan(&index, -3, GT, 3, LT), 3)
+				checkPassFail(stringScan(&index, 996, GT, 1001, LT), 4)
+					checkPassFail(stringScan(&index, 0, GT, 1, LT), 0)
+						checkPassFail(stringScan(&index, 300, GT, 400, LT), 99)
+							checkPassFail(stringScan(&index, 3000, GTE, 4000, LT), 1000)
+}
+
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+	// the keys are the first STRINGSIZE bytes of the string records, so scan between records of the same format
+	char lowValStr[100];
+	sprintf(lowValStr, "%05d string record", lowVal);
+	char highValStr[100];
+	sprintf(highValStr, "%05d string record", highVal);
+
+	std::cout << "Scan for ";
+	if (lowOp == GT)
+	{
+		std::cout << "(";
+	}
+	else
+	{
+		std::cout << "[";
+	}
+	std::cout << lowValStr << "," << highValStr;
+	if (highOp == LT)
+	{
+		std::cout << ")";
+	}
+	else
+	{
+		std::cout << "]";
+	}
+	std::cout << std::endl;
+
+	return scanAndPrint(index, lowValStr, lowOp, highValStr, highOp);
+}
+
+// -----------------------------------------------------------------------------
+// scanAndPrint
+// -----------------------------------------------------------------------------
+
+int scanAndPrint(BTreeIndex *index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp)
+{
+	RecordId scanRid;
+	Page *curPage;
+	int numResults = 0;
+
+	try
+	{
+		index->startScan(lowVal, lowOp, highVal, highOp);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	while (1)
+	{
+		try
+		{
+			index->scanNext(scanRid);
+			bufMgr->readPage(file1, scanRid.page_number, curPage);
+			RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
+			bufMgr->unPinPage(file1, scanRid.page_number, false);
+
+			if (numResults < 5)
+			{
+				std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
+				std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" << std::endl;
+			}
+			else if (numResults == 5)
+			{
+				std::cout << "..." << std::endl;
+			}
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+			break;
+		}
+
+		numResults++;
+	}
+
+	if (numResults >= 5)
+	{
+		std::cout << "Number of results: " << numResults << std::endl;
+	}
+	index->endScan();
+	std::cout << std::endl;
+
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// keySearchTests
+// -----------------------------------------------------------------------------
+
+void keySearchTests()
+{
+	std::cout << "--------------------" << std::endl;
+	std::cout << "Key search tests" << std::endl;
+
+	// dense ids, which interpolation finds right away
+	std::vector<int> keys;
+	for (int i = 0; i < 500; i++)
+	{
+		keys.push_back(1000 + i);
+	}
+	checkPassFail(searchMismatches(keys), 0)
+
+	// gaps and runs of equal keys, which throw the prediction off
+	keys.clear();
+	for (int i = 0; i < 300; i++)
+	{
+		keys.push_back(i < 100 ? i / 4 : i * i);
+	}
+	checkPassFail(searchMismatches(keys), 0)
+
+	// the whole range of int, with a single outlier at the top
+	keys.clear();
+	keys.push_back(INT_MIN);
+	for (int i = 0; i < 100; i++)
+	{
+		keys.push_back(i * 3);
+	}
+	keys.push_back(INT_MAX);
+	checkPassFail(searchMismatches(keys), 0)
+
+	// the key distances of packed INTEGER leaves, with runs of equal keys and keys past the top bit of their width
+	std::vector<std::uint8_t> narrow;
+	for (int i = 0; i < 700; i++)
+	{
+		narrow.push_back((std::uint8_t)(i * 255 / 699));
+	}
+	checkPassFail(unsignedSearchMismatches(narrow), 0)
+	std::vector<std::uint16_t> medium;
+	for (int i = 0; i < 500; i++)
+	{
+		medium.push_back((std::uint16_t)(i < 50 ? 7 : i * 131));
+	}
+	checkPassFail(unsignedSearchMismatches(medium), 0)
+	std::vector<std::uint32_t> wide;
+	for (std::uint32_t i = 0; i < 300; i++)
+	{
+		wide.push_back(i * 14000000u);
+	}
+	checkPassFail(unsignedSearchMismatches(wide), 0)
+}
+
+void ridBitmapTests()
+{
+	std::cout << "--------------------" << std::endl;
+	std::cout << "Record id bitmap tests" << std::endl;
+
+	// sets of pages with array containers, bitmap containers and both, overlapping in some pages
+	std::vector<RecordId> a;
+	std::vector<RecordId> b;
+	RecordId rid;
+	rid.padding = 0;
+	for (PageId page = 1; page <= 30; page++)
+	{
+		rid.page_number = page;
+		for (int slot = 0; slot < 20000; slot++)
+		{
+			rid.slot_number = slot;
+			if ((page % 2 == 0 && slot % 2 == 0) || (page % 2 == 1 && page < 20 && slot % 7 == 0 && slot < 3000))
+			{
+				a.push_back(rid);
+			}
+			if ((page % 3 == 0 && slot % 3 == 0) || (page % 3 != 0 && page > 10 && (slot * 13) % 11 < 3))
+			{
+				b.push_back(rid);
+			}
+		}
+	}
+	checkPassFail(bitmapMismatches(a, b), 0)
+
+	// arrays whose blocks of 8 slots end on equal and unequal slots
+	a.clear();
+	b.clear();
+	rid.page_number = 5;
+	for (int slot = 0; slot < 1000; slot++)
+	{
+		rid.slot_number = slot;
+		if (slot % 2 == 0 || slot % 17 == 0)
+		{
+			a.push_back(rid);
+		}
+		if (slot % 3 == 0 || slot < 40)
+		{
+			b.push_back(rid);
+		}
+	}
+	checkPassFail(bitmapMismatches(a, b), 0)
+	checkPassFail(bitmapMismatches(a, a), 0)
+	checkPassFail(bitmapMismatches(a, std::vector<RecordId>()), 0)
+}
+
+/**
+ * Orders record ids by page, then by slot.
+ */
+bool ridLess(const RecordId &a, const RecordId &b)
+{
+	return a.page_number < b.page_number || (a.page_number == b.page_number && a.slot_number < b.slot_number);
+}
+
+/**
+ * Returns the number of record ids that the intersection and the union of RidBitmaps of a and b, added in reverse
+ * order, get wrong compared to those of the sorted vectors.
+ */
+int bitmapMismatches(const std::vector<RecordId> &a, const std::vector<RecordId> &b)
+{
+	std::cout << "Intersect and unite " << a.size() << " and " << b.size() << " record ids" << std::endl;
+
+	RidBitmap bitmapA;
+	RidBitmap bitmapB;
+	for (std::size_t i = a.size(); i > 0; i--)
+	{
+		bitmapA.add(a[i - 1]);
+	}
+	if (!b.empty())
+	{
+		bitmapB.add(&b[0], b.size());
+	}
+	if (bitmapA.cardinality() != a.size() || bitmapB.cardinality() != b.size())
+	{
+		return -1;
+	}
+
+	int mismatches = 0;
+	for (int unite = 0; unite < 2; unite++)
+	{
+		std::vector<RecordId> expected(a.size() + b.size());
+		if (unite)
+		{
+			expected.erase(std::set_union(a.begin(), a.end(), b.begin(), b.end(), expected.begin(), ridLess), expected.end());
+		}
+		else
+		{
+			expected.erase(std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), expected.begin(), ridLess),
+						   expected.end());
+		}
+
+		RidBitmap combined = bitmapA;
+		if (unite)
+		{
+			combined.unionWith(bitmapB);
+		}
+		else
+		{
+			combined.intersectWith(bitmapB);
+		}
+		std::vector<RecordId> actual;
+		combined.toRids(actual);
+		mismatches += std::abs((int)actual.size() - (int)expected.size());
+		for (std::size_t i = 0; i < std::min(actual.size(), expected.size()); i++)
+		{
+			if (actual[i] != expected[i] || !combined.contains(expected[i]))
+			{
+				mismatches++;
+			}
+		}
+	}
+	return mismatches;
+}
+
+/**
+ * Returns the number of keys around those of the sorted array for which interpolation search and binary search
+ * give different positions.
+ */
+int searchMismatches(const std::vector<int> &keys)
+{
+	std::cout << "Compare interpolation and binary search over " << keys.size() << " keys" << std::endl;
+
+	std::vector<int> probes;
+	probes.push_back(INT_MIN);
+	probes.push_back(INT_MAX);
+	for (std::size_t i = 0; i < keys.size(); i++)
+	{
+		probes.push_back(keys[i]);
+		if (keys[i] > INT_MIN)
+		{
+			probes.push_back(keys[i] - 1);
+		}
+		if (keys[i] < INT_MAX)
+		{
+			probes.push_back(keys[i] + 1);
+		}
+	}
+	int mismatches = 0;
+	const int numKeys = keys.size();
+	for (std::size_t i = 0; i < probes.size(); i++)
+	{
+		const int key = probes[i];
+		if (InterpolationKeySearch<ScalarKeySearch>::lowerBound(&keys[0], numKeys, key) !=
+				ScalarKeySearch::lowerBound(&keys[0], numKeys, key) ||
+			InterpolationKeySearch<ScalarKeySearch>::upperBound(&keys[0], numKeys, key) !=
+				ScalarKeySearch::upperBound(&keys[0], numKeys, key))
+		{
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+/**
+ * Searches sorted unsigned keys for every key, the keys next to them and both ends of the type with the key search
+ * policies, interpolation included, and returns the number of searches whose positions differ from std::lower_bound
+ * and std::upper_bound.
+ */
+template <class K>
+int unsignedSearchMismatches(const std::vector<K> &keys)
+{
+	std::cout << "Compare vector, interpolation and scalar search over " << keys.size() << " keys of " << sizeof(K) << " bytes" << std::endl;
+
+	std::vector<K> probes;
+	probes.push_back(0);
+	probes.push_back((K)~K(0));
+	for (std::size_t i = 0; i < keys.size(); i++)
+	{
+		probes.push_back(keys[i]);
+		probes.push_back((K)(keys[i] - 1));
+		probes.push_back((K)(keys[i] + 1));
+	}
+	int mismatches = 0;
+	const int numKeys = keys.size();
+	for (std::size_t i = 0; i < probes.size(); i++)
+	{
+		const K key = probes[i];
+		const int lower = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+		const int upper = std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+		if (KeySearch::lowerBound(&keys[0], numKeys, key) != lower ||
+			KeySearch::upperBound(&keys[0], numKeys, key) != upper ||
+			BinaryKeySearch::lowerBound(&keys[0], numKeys, key) != lower ||
+			BinaryKeySearch::upperBound(&keys[0], numKeys, key) != upper ||
+			InterpolationKeySearch<BinaryKeySearch>::lowerBound(&keys[0], numKeys, key) != lower ||
+			InterpolationKeySearch<BinaryKeySearch>::upperBound(&keys[0], numKeys, key) != upper)
+		{
+			mismatches++;
+		}
+		// every length, so that the window counts keys in whole vectors and in the scalar tail alike
+		const int length = i % (numKeys + 1);
+		if (BinaryKeySearch::lowerBound(&keys[0], length, key) !=
+				std::lower_bound(keys.begin(), keys.begin() + length, key) - keys.begin() ||
+			BinaryKeySearch::upperBound(&keys[0], length, key) !=
+				std::upper_bound(keys.begin(), keys.begin() + length, key) - keys.begin())
+		{
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+// -----------------------------------------------------------------------------
+// keyDistributionTests
+// -----------------------------------------------------------------------------
+
+void keyDistributionTests()
+{
+	std::cout << "Generate the key distributions of the benchmark" << std::endl;
+	const int n = 10000;
+	std::mt19937_64 rng(1);
+	std::vector<int> keys;
+
+	int mismatches = 0;
+	checkPassFail(generateKeys("forward", n, 0.99, rng, keys), true)
+	checkPassFail((int)keys.size(), n)
+	for (int i = 0; i < n; i++)
+	{
+		if (keys[i] != i)
+			mismatches++;
+	}
+	checkPassFail(generateKeys("backward", n, 0.99, rng, keys), true)
+	for (int i = 0; i < n; i++)
+	{
+		if (keys[i] != n - 1 - i)
+			mismatches++;
+	}
+	checkPassFail(mismatches, 0)
+
+	// random holds the same keys as forward in another order, the same order again for the same seed
+	checkPassFail(generateKeys("random", n, 0.99, rng, keys), true)
+	std::vector<int> sorted(keys);
+	std::sort(sorted.begin(), sorted.end());
+	int inPlace = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (sorted[i] != i)
+			mismatches++;
+		if (keys[i] == i)
+			inPlace++;
+	}
+	checkPassFail(mismatches, 0)
+	checkPassFail((inPlace < n / 100), true)
+	std::mt19937_64 first(7);
+	std::mt19937_64 second(7);
+	std::vector<int> again;
+	generateKeys("random", n, 0.99, first, keys);
+	generateKeys("random", n, 0.99, second, again);
+	checkPassFail((keys == again), true)
+
+	// sparse keys are distinct and evenly spaced up to near the largest int
+	checkPassFail(generateKeys("sparse", n, 0.99, rng, keys), true)
+	sorted = keys;
+	std::sort(sorted.begin(), sorted.end());
+	const int stride = sorted[1] - sorted[0];
+	for (int i = 1; i < n; i++)
+	{
+		if (sorted[i] - sorted[i - 1] != stride)
+			mismatches++;
+	}
+	checkPassFail(mismatches, 0)
+	checkPassFail(sorted[0], 0)
+	checkPassFail((stride > 1 && sorted[n - 1] > INT_MAX - 2 * stride), true)
+
+	// zipf keys stay in range, and key 0 comes up about 1 / (1 + 1/2^theta + ... + 1/n^theta) of the time; the
+	// counts fall off with the key at high skew, and less skew spreads the draws over more keys
+	const double thetas[] = {0.99, 0.5};
+	int distinct[2];
+	for (int t = 0; t < 2; t++)
+	{
+		checkPassFail(generateKeys("zipf", n, thetas[t], rng, keys), true)
+		std::vector<int> counts(n, 0);
+		for (int i = 0; i < n; i++)
+		{
+			if (keys[i] < 0 || keys[i] >= n)
+				mismatches++;
+			else
+				counts[keys[i]]++;
+		}
+		checkPassFail(mismatches, 0)
+		double zeta = 0;
+		for (int k = 1; k <= n; k++)
+			zeta += 1.0 / std::pow((double)k, thetas[t]);
+		const double share = (double)counts[0] / n;
+		checkPassFail((share > 1 / zeta - 0.02 && share < 1 / zeta + 0.02), true)
+		if (t == 0)
+			checkPassFail((counts[0] > counts[1] && counts[1] > counts[10] && counts[10] > counts[1000]), true)
+		distinct[t] = n - (int)std::count(counts.begin(), counts.end(), 0);
+	}
+	checkPassFail((distinct[0] < distinct[1]), true)
+
+	checkPassFail(generateKeys("gaussian", n, 0.99, rng, keys), false)
+	checkPassFail((int)keys.size(), 0)
+}
+
+// -----------------------------------------------------------------------------
+// externalSortTests
+// -----------------------------------------------------------------------------
+
+void externalSortTests()
+{
+	std::cout << "--------------------" << std::endl;
+	std::cout << "External sort tests" << std::endl;
+
+	// everything fits in one run and never reaches the disk
+	int count = 0;
+	checkPassFail(sortMismatches(SORT_RUN_SIZE, SORT_MAX_FAN_IN, 5000, count), 0)
+	checkPassFail(count, 5000)
+
+	// 79 runs of 64 entries are more than one merge takes, so they are merged into longer runs first
+	checkPassFail(sortMismatches(64, SORT_MAX_FAN_IN, 5000, count), 0)
+	checkPassFail(count, 5000)
+
+	// merging two runs at a time takes seven passes, and the last run is a short one
+	checkPassFail(sortMismatches(64, 2, 5000, count), 0)
+	checkPassFail(count, 5000)
+	checkPassFail(File::exists(relationName + ".sort"), false)
+}
+
+/**
+ * Sorts numKeys keys, each of the first half of them twice, fed in a scrambled order through an ExternalSort.
+ * Returns the number of entries that come out of order or more or less often than they went in, and the
+ * number of entries returned in count. Checks that the runs spill to disk exactly when they do not fit in one.
+ */
+int sortMismatches(std::size_t runSize, std::size_t maxFanIn, int numKeys, int &count)
+{
+	std::cout << "Sort " << numKeys << " keys in runs of " << runSize << ", merging " << maxFanIn << " at a time" << std::endl;
+
+	const std::string name = relationName + ".sort";
+	int mismatches = 0;
+	std::vector<int> seen(numKeys / 2, 0);
+	count = 0;
+	{
+		ExternalSort<int> sorter(bufMgr, name, runSize, maxFanIn);
+		for (int i = 0; i < numKeys; i++)
+		{
+			// 7919 is prime, so the keys come in a different order than they sort in
+			sorter.add((int)(((long long)i * 7919) % numKeys) / 2);
+		}
+		sorter.finish();
+		if (File::exists(name) != ((std::size_t)numKeys > runSize))
+		{
+			mismatches++;
+		}
+
+		int key;
+		int last = INT_MIN;
+		while (sorter.next(key))
+		{
+			if (key < last || key < 0 || key >= (int)seen.size())
+			{
+				mismatches++;
+				continue;
+			}
+			seen[key]++;
+			last = key;
+			count++;
+		}
+	}
+	for (std::size_t i = 0; i < seen.size(); i++)
+	{
+		if (seen[i] != 2)
+		{
+			mismatches++;
+		}
+	}
+	if (File::exists(name))
+	{
+		mismatches++;
+	}
+	return mismatches;
+}
+
+// -----------------------------------------------------------------------------
+// errorTests
+// -----------------------------------------------------------------------------
+
+void errorTests()
+{
+	{
+		std::cout << "Error handling tests" << std::endl;
+		std::cout << "--------------------" << std::endl;
+		// Given error test
+
+		try
+		{
+			File::remove(relationName);
+		}
+		catch (const FileNotFoundException &e)
+		{
+		}
+
+		file1 = new PageFile(relationName, true);
+
+		// initialize all of record1.s to keep purify happy
+		memset(record1.s, ' ', sizeof(record1.s));
+		PageId new_page_number;
+		Page new_page = file1->allocatePage(new_page_number);
+
+		// Insert a bunch of tuples into the relation.
+		for (int i = 0; i < 10; i++)
+		{
+			sprintf(record1.s, "%05d string record", i);
+			record1.i = i;
+			record1.d = (double)i;
+			std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+
+			while (1)
+			{
+				try
+				{
+					new_page.insertRecord(new_data);
+					break;
+				}
+				catch (const InsufficientSpaceException &e)
+				{
+					file1->writePage(new_page_number, new_page);
+					new_page = file1->allocatePage(new_page_number);
+				}
+			}
+		}
+
+		file1->writePage(new_page_number, new_page);
+
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+		int int2 = 2;
+		int int5 = 5;
+
+		// Scan Tests
+		std::cout << "Call endScan before startScan" << std::endl;
+		try
+		{
+			index.endScan();
+			std::cout << "ScanNotInitialized Test 1 Failed." << std::endl;
+		}
+		catch (const ScanNotInitializedException &e)
+		{
+			std::cout << "ScanNotInitialized Test 1 Passed." << std::endl;
+		}
+
+		std::cout << "Call scanNext before startScan" << std::endl;
+		try
+		{
+			RecordId foo;
+			index.scanNext(foo);
+			std::cout << "ScanNotInitialized Test 2 Failed." << std::endl;
+		}
+		catch (const ScanNotInitializedException &e)
+		{
+			std::cout << "ScanNotInitialized Test 2 Passed." << std::endl;
+		}
+
+		std::cout << "Scan with bad lowOp" << std::endl;
+		try
+		{
+			index.startScan(&int2, LTE, &int5, LTE);
+			std::cout << "BadOpcodesException Test 1 Failed." << std::endl;
+		}
+		catch (const BadOpcodesException &e)
+		{
+			std::cout << "BadOpcodesException Test 1 Passed." << std::endl;
+		}
+
+		std::cout << "Scan with bad highOp" << std::endl;
+		try
+		{
+			index.startScan(&int2, GTE, &int5, GTE);
+			std::cout << "BadOpcodesException Test 2 Failed." << std::endl;
+		}
+		catch (const BadOpcodesException &e)
+		{
+			std::cout << "BadOpcodesException Test 2 Passed." << std::endl;
+		}
+
+		std::cout << "Scan with bad range" << std::endl;
+		try
+		{
+			index.startScan(&int5, GTE, &int2, LTE);
+			std::cout << "BadScanrangeException Test 1 Failed." << std::endl;
+		}
+		catch (const BadScanrangeException &e)
+		{
+			std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
+		}
+
+		std::cout << "Open a file created with another page size" << std::endl;
+		const std::string otherName = relationName + ".pagesize";
+		{
+			PageFile other(otherName, true);
+		}
+		{
+			std::fstream stream(otherName.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+			FileHeader header;
+			stream.read(reinterpret_cast<char *>(&header), sizeof(header));
+			header.page_size = Page::SIZE * 2;
+			stream.seekp(0);
+			stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		}
+		try
+		{
+			PageFile other = PageFile::open(otherName);
+			std::cout << "CorruptPageException Test 1 Failed." << std::endl;
+		}
+		catch (const CorruptPageException &e)
+		{
+			std::cout << "CorruptPageException Test 1 Passed." << std::endl;
+		}
+		File::remove(otherName);
+
+		deleteRelation();
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+}
+
+// -----------------------------------------------------------------------------
+// bufferTests
+// -----------------------------------------------------------------------------
+
+/**
+ * A PageFile whose writes can be made to fail, or to change a page pinned in a pool while they run, the way another
+ * thread could.
+ */
+class WriteHookFile : public PageFile
+{
+public:
+	WriteHookFile(const std::string &name, const bool create_new)
+		: PageFile(name, create_new), pool(NULL), failWrites(0)
+	{
+	}
+
+	void writePage(const PageId page_number, const Page &new_page)
+	{
+		beforeWrite();
+		PageFile::writePage(page_number, new_page);
+		afterWrite();
+	}
+
+	void writePages(const PageId *page_numbers, const std::size_t count, const Page *const *pages)
+	{
+		beforeWrite();
+		PageFile::writePages(page_numbers, count, pages);
+		afterWrite();
+	}
+
+	/**
+	 * Pool holding changed, NULL to change nothing.
+	 */
+	BufMgr *pool;
+
+	/**
+	 * Pinned page that the next write changes and marks dirty.
+	 */
+	PageHandle changed;
+
+	/**
+	 * Number of writes still to fail.
+	 */
+	int failWrites;
+
+private:
+	void beforeWrite()
+	{
+		if (failWrites > 0)
+		{
+			failWrites--;
+			throw IoErrorException("write", EIO);
+		}
+	}
+
+	void afterWrite()
+	{
+		if (pool != NULL)
+		{
+			changed.page->insertRecord("changed while written");
+			pool->markDirty(changed);
+			pool = NULL;
+		}
+	}
+};
+
+void bufferTests()
+{
+	std::cout << "--------------------" << std::endl;
+	std::cout << "Buffer manager tests" << std::endl;
+	hashTableTests();
+	checkpointTests();
+	fileStatsTests();
+	resizeTests(new ClockPolicy());
+	resizeTests(new TwoQueuePolicy());
+	twoQueueTests();
+	referenceBitmapTests();
+	pageHandleTests();
+	backgroundWriterTests();
+	concurrentPinTests();
+	concurrentMissTests();
+	prefetchTests();
+	ringTests();
+	pagePoolTests();
+}
+
+void hashTableTests()
+{
+	std::cout << "Insert, look up and remove pages of two files in the buffer hash table" << std::endl;
+	const std::string name = "hash.test";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+	{
+		PageFile first = PageFile::create(name);
+		PageFile second = PageFile::open(name);
+		const File *files[] = {&first, &second};
+
+		// a table made for one entry grows many times over, and removals in the middle of long probe sequences
+		// move the entries after them back, around the end of the table too when it stays small; every step is
+		// checked against a map
+		const PageId keySpaces[] = {6, 300};
+		int mismatches = 0;
+		std::map<std::pair<int, PageId>, FrameId> expected;
+		for (int space = 0; space < 2; space++)
+		{
+			const PageId numPages = keySpaces[space];
+			BufHashTbl table(1);
+			expected.clear();
+			unsigned int state = 1;
+			for (FrameId step = 0; step < 20000; step++)
+			{
+				state = state * 1103515245u + 12345u;
+				const int f = (state >> 8) & 1;
+				const PageId pageNo = (state >> 9) % numPages;
+				const std::pair<int, PageId> key(f, pageNo);
+				std::map<std::pair<int, PageId>, FrameId>::iterator it = expected.find(key);
+				if (it == expected.end())
+				{
+					table.insert(files[f], pageNo, step);
+					expected[key] = step;
+				}
+				else if ((state >> 20) & 1)
+				{
+					table.remove(files[f], pageNo);
+					expected.erase(it);
+				}
+				for (int g = 0; g < 2; g++)
+				{
+					FrameId frameNo;
+					const bool found = table.lookup(files[g], pageNo, frameNo);
+					it = expected.find(std::make_pair(g, pageNo));
+					if (found != (it != expected.end()) || (found && frameNo != it->second))
+						mismatches++;
+				}
+			}
+			for (int f = 0; f < 2; f++)
+			{
+				for (PageId pageNo = 0; pageNo < numPages; pageNo++)
+				{
+					FrameId frameNo;
+					const bool found = table.lookup(files[f], pageNo, frameNo);
+					std::map<std::pair<int, PageId>, FrameId>::iterator it = expected.find(std::make_pair(f, pageNo));
+					if (found != (it != expected.end()) || (found && frameNo != it->second))
+						mismatches++;
+				}
+			}
+		}
+		checkPassFail(mismatches, 0)
+		checkPassFail((expected.size() > 100), true)
+		BufHashTbl table(1);
+		for (std::map<std::pair<int, PageId>, FrameId>::iterator it = expected.begin(); it != expected.end(); ++it)
+			table.insert(files[it->first.first], it->first.second, it->second);
+
+		// a page already in the table is refused, and one not in it cannot be removed
+		const std::pair<int, PageId> present = expected.begin()->first;
+		bool refused = false;
+		try
+		{
+			table.insert(files[present.first], present.second, 1);
+		}
+		catch (const HashAlreadyPresentException &e)
+		{
+			refused = true;
+		}
+		checkPassFail(refused, true)
+		table.remove(files[present.first], present.second);
+		bool missing = false;
+		try
+		{
+			table.remove(files[present.first], present.second);
+		}
+		catch (const HashNotFoundException &e)
+		{
+			missing = true;
+		}
+		checkPassFail(missing, true)
+	}
+	File::remove(name);
+}
+
+void checkpointTests()
+{
+	std::cout << "Change pages while they are written back, and make their writes throw" << std::endl;
+	const std::string name = relationName + ".checkpoint";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	{
+		WriteHookFile file(name, true);
+		BufMgr pool(2);
+
+		// a page changed while a checkpoint writes it stays dirty, and the change reaches the file on the next flush
+		PageId pageNo;
+		PageHandle handle = pool.allocPage(&file, pageNo);
+		handle.page->insertRecord("written");
+		pool.markDirty(handle);
+		file.pool = &pool;
+		file.changed = handle;
+		std::uint64_t writes = pool.getBufStats().diskwrites;
+		pool.checkpoint();
+		checkPassFail(pool.getBufStats().diskwrites - writes, 1)
+		pool.unPinPage(handle, false);
+		pool.flushFile(&file);
+		checkPassFail(pool.getBufStats().diskwrites - writes, 2)
+		checkPassFail(file.PageFile::readPage(pageNo).getFreeSpace(), handle.page->getFreeSpace())
+
+		// a page whose write fails stays dirty
+		handle = pool.readPage(&file, pageNo);
+		handle.page->insertRecord("written again");
+		const std::uint16_t freeSpace = handle.page->getFreeSpace();
+		pool.unPinPage(handle, true);
+		file.failWrites = 1;
+		try
+		{
+			pool.checkpoint();
+			std::cout << "IoErrorException Test 1 Failed." << std::endl;
+		}
+		catch (const IoErrorException &e)
+		{
+			std::cout << "IoErrorException Test 1 Passed." << std::endl;
+		}
+		writes = pool.getBufStats().diskwrites;
+		pool.flushFile(&file);
+		checkPassFail(pool.getBufStats().diskwrites - writes, 1)
+		checkPassFail(file.PageFile::readPage(pageNo).getFreeSpace(), freeSpace)
+
+		// as does one that fails to be written when it is evicted, and the frame can still be used afterwards
+		PageId otherNo;
+		pool.unPinPage(pool.allocPage(&file, pageNo), true);
+		pool.unPinPage(pool.allocPage(&file, otherNo), true);
+		file.failWrites = 1;
+		PageId thirdNo;
+		try
+		{
+			pool.allocPage(&file, thirdNo);
+			std::cout << "IoErrorException Test 2 Failed." << std::endl;
+		}
+		catch (const IoErrorException &e)
+		{
+			std::cout << "IoErrorException Test 2 Passed." << std::endl;
+		}
+		writes = pool.getBufStats().diskwrites;
+		pool.unPinPage(pool.allocPage(&file, thirdNo), true);
+		pool.unPinPage(pool.allocPage(&file, thirdNo), true);
+		pool.flushFile(&file);
+		checkPassFail(pool.getBufStats().diskwrites - writes, 4)
+	}
+	File::remove(name);
+}
+
+void fileStatsTests()
+{
+	std::cout << "Count hits and misses by file, for files made one after another in the same place" << std::endl;
+	BufMgr pool(8);
+	for (int i = 0; i < 3; i++)
+	{
+		std::stringstream name;
+		name << relationName << ".stats" << i;
+		{
+			// a File made in the same place as the last one, and likely at its address
+			PageFile file(name.str(), true);
+			PageId pageNo;
+			pool.unPinPage(pool.allocPage(&file, pageNo), true);
+			for (int j = 0; j <= i; j++)
+				pool.unPinPage(pool.readPage(&file, pageNo), false);
+			pool.flushFile(&file);
+		}
+		File::remove(name.str());
+	}
+
+	// the counts of the flushed files are kept by name
+	BufStats stats = pool.getBufStats();
+	checkPassFail(stats.files.size(), 3)
+	for (int i = 0; i < 3; i++)
+	{
+		std::stringstream name;
+		name << relationName << ".stats" << i;
+		checkPassFail(stats.files[i].filename, name.str())
+		checkPassFail(stats.files[i].misses, 1)
+		checkPassFail(stats.files[i].hits, (std::uint64_t)i + 1)
+	}
+
+	// a file opened again under a name adds to its counts
+	const std::string name = relationName + ".stats0";
+	{
+		PageFile file(name, true);
+		PageId pageNo;
+		pool.unPinPage(pool.allocPage(&file, pageNo), true);
+		pool.unPinPage(pool.readPage(&file, pageNo), false);
+		checkPassFail(pool.getBufStats().files[0].hits, 2)
+		pool.flushFile(&file);
+	}
+	File::remove(name);
+	checkPassFail(pool.getBufStats().files[0].hits, 2)
+	checkPassFail(pool.getBufStats().files[0].misses, 2)
+	pool.clearBufStats();
+	checkPassFail(pool.getBufStats().files.size(), 0)
+}
+
+// -----------------------------------------------------------------------------
+// fileTests
+// -----------------------------------------------------------------------------
+
+void fileTests()
+{
+	std::cout << "--------------------" << std::endl;
+	std::cout << "File tests" << std::endl;
+	descriptorTests();
+	ioBackendTests();
+	vectoredPageTests();
+	pageIntoTests();
+	allocationMapTests();
+	freeSpaceMapTests();
+	extentTests();
+	checksumTests();
+}
+
+void descriptorTests()
+{
+	std::cout << "Keep at most two descriptors open over three files" << std::endl;
+	const std::size_t limit = FileStream::maxOpenDescriptors();
+	std::vector<std::string> names;
+	for (int i = 0; i < 5; i++)
+	{
+		std::stringstream name;
+		name << relationName << ".fd" << i;
+		names.push_back(name.str());
+		try
+		{
+			File::remove(name.str());
+		}
+		catch (const FileNotFoundException &e)
+		{
+		}
+	}
+
+	FileStream::setMaxOpenDescriptors(2);
+	{
+		PageId pageNos[3];
+		PageFile a(names[0], true);
+		Page page = a.allocatePage(pageNos[0]);
+		const RecordId written = page.insertRecord(names[0]);
+		a.writePage(pageNos[0], page);
+		PageFile b(names[1], true);
+		b.allocatePage(pageNos[1]);
+		PageFile c(names[2], true);
+		c.allocatePage(pageNos[2]);
+
+		// the least recently used descriptor is closed, and reopened without losing what was written
+		checkPassFail((descriptorOf(names[0]) < 0), true)
+		checkPassFail((descriptorOf(names[1]) >= 0), true)
+		checkPassFail((descriptorOf(names[2]) >= 0), true)
+		checkPassFail(a.readPage(pageNos[0]).getRecord(written), names[0])
+		checkPassFail((descriptorOf(names[0]) >= 0), true)
+		checkPassFail((descriptorOf(names[1]) < 0), true)
+		checkPassFail((descriptorOf(names[2]) >= 0), true)
+
+		// a name that stands for another file by the time the descriptor is reopened is not read through
+		{
+			PageFile other(names[3], true);
+			other.allocatePage(pageNos[1]);
+		}
+		checkPassFail(std::rename(names[3].c_str(), names[1].c_str()), 0)
+		try
+		{
+			b.readPage(pageNos[1]);
+			std::cout << "IoErrorException Test 3 Failed." << std::endl;
+		}
+		catch (const IoErrorException &e)
+		{
+			checkPassFail(e.error_code(), ESTALE)
+			std::cout << "IoErrorException Test 3 Passed." << std::endl;
+		}
+	}
+
+	std::cout << "Report a descriptor that could not be closed on the next sync of its file" << std::endl;
+	{
+		PageFile d(names[3], true);
+		PageFile e(names[4], true);
+		PageId pageNo;
+		d.allocatePage(pageNo);
+		e.allocatePage(pageNo);
+
+		// closing the descriptor behind the file's back makes closing it again fail
+		const int fd = descriptorOf(names[3]);
+		checkPassFail((fd >= 0), true)
+		checkPassFail(close(fd), 0)
+		FileStream::setMaxOpenDescriptors(1);
+		checkPassFail((descriptorOf(names[4]) >= 0), true)
+		try
+		{
+			d.sync();
+			std::cout << "IoErrorException Test 4 Failed." << std::endl;
+		}
+		catch (const IoErrorException &e)
+		{
+			checkPassFail(e.error_code(), EBADF)
+			std::cout << "IoErrorException Test 4 Passed." << std::endl;
+		}
+		d.sync();
+		e.sync();
+	}
+
+	FileStream::setMaxOpenDescriptors(limit);
+	for (std::size_t i = 0; i < names.size(); i++)
+	{
+		try
+		{
+			File::remove(names[i]);
+		}
+		catch (const FileNotFoundException &e)
+		{
+		}
+	}
+}
+
+/**
+ * Returns a descriptor the process has open on the given file in the working directory, -1 if there is none.
+ */
+int descriptorOf(const std::string &name)
+{
+	char cwd[PATH_MAX];
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+		return -1;
+	const std::string path = std::string(cwd) + "/" + name;
+	DIR *dir = opendir("/proc/self/fd");
+	if (dir == NULL)
+		return -1;
+	int found = -1;
+	for (struct dirent *entry = readdir(dir); entry != NULL && found < 0; entry = readdir(dir))
+	{
+		char target[PATH_MAX];
+		const std::string link = std::string("/proc/self/fd/") + entry->d_name;
+		const ssize_t length = readlink(link.c_str(), target, sizeof(target) - 1);
+		if (length > 0 && std::string(target, length) == path)
+			found = atoi(entry->d_name);
+	}
+	closedir(dir);
+	return found;
+}
+
+void resizeTests(ReplacementPolicy *policy)
+{
+	std::cout << "Grow and shrink a pool holding pinned and dirty pages" << std::endl;
+	const std::string name = relationName + ".resize";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	{
+		PageFile file(name, true);
+		PoolOptions options;
+		options.maxFrames = 32;
+		BufMgr pool(8, BUF_PARTITIONS, policy, options);
+
+		// fill the pool with dirty pages, two of them pinned
+		std::vector<PageId> pageNos(24);
+		std::vector<RecordId> rids(pageNos.size());
+		std::vector<PageHandle> pinned;
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			if (i == 8)
+			{
+				// growing takes no page out of the pool
+				checkPassFail(pool.resize(24), 24)
+				checkPassFail(pool.size(), 24)
+			}
+			std::stringstream record;
+			record << "page " << i;
+			PageHandle handle = pool.allocPage(&file, pageNos[i]);
+			rids[i] = handle.page->insertRecord(record.str());
+			if (i == 3 || i == 20)
+				pinned.push_back(handle);
+			else
+				pool.unPinPage(handle, true);
+		}
+		checkPassFail(pool.getBufStats().evictions, 0)
+
+		// a shrink stops at the first pinned frame from the end of the pool, writing back the dirty pages it evicts
+		const std::uint32_t shrunk = pool.resize(4);
+		checkPassFail(pool.size(), shrunk)
+		checkPassFail((shrunk >= 4), true)
+		for (std::size_t i = 0; i < pinned.size(); i++)
+		{
+			checkPassFail((pinned[i].frameNo < shrunk), true)
+			pool.markDirty(pinned[i]);
+		}
+		checkPassFail(pool.getBufStats().dirtyEvictions, pool.getBufStats().evictions)
+		checkPassFail(pool.getBufStats().evictions, 24 - shrunk)
+
+		// once the pages are unpinned, the pool shrinks all the way
+		for (std::size_t i = 0; i < pinned.size(); i++)
+			pool.unPinPage(pinned[i], false);
+		checkPassFail(pool.resize(4), 4)
+		checkPassFail(pool.size(), 4)
+
+		// every page reads back with what was written to it, from the pool grown again
+		checkPassFail(pool.resize(12), 12)
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			std::stringstream record;
+			record << "page " << i;
+			PageHandle handle = pool.readPage(&file, pageNos[i]);
+			checkPassFail(handle.page->getRecord(rids[i]), record.str())
+			pool.unPinPage(handle, false);
+		}
+		pool.flushFile(&file);
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			std::stringstream record;
+			record << "page " << i;
+			checkPassFail(file.readPage(pageNos[i]).getRecord(rids[i]), record.str())
+		}
+	}
+	File::remove(name);
+}
+
+void pageHandleTests()
+{
+	std::cout << "Pin pages through handles and guards" << std::endl;
+	const std::string name = "handle.test";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	{
+		PageFile file = PageFile::create(name);
+		BufMgr pool(4);
+
+		// guards marked dirty write their pages back, also through evictions from a pool smaller than the file
+		std::vector<PageId> pageNos(8);
+		std::vector<RecordId> rids(pageNos.size());
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			std::stringstream record;
+			record << "page " << i;
+			PageGuard guard(&pool, pool.allocPage(&file, pageNos[i]));
+			checkPassFail(guard.pageNo(), pageNos[i])
+			rids[i] = guard.page()->insertRecord(record.str());
+			guard.markDirty();
+		}
+		checkPassFail(filePinned(&pool, &file), false)
+		checkPassFail((pool.getBufStats().dirtyEvictions > 0), true)
+
+		// a guard gives its pin back when an exception leaves its scope
+		int thrown = 0;
+		try
+		{
+			PageGuard guard(&pool, pool.readPage(&file, pageNos[0]));
+			throw InvalidPageException(guard.pageNo(), name);
+		}
+		catch (const InvalidPageException &e)
+		{
+			thrown++;
+		}
+		checkPassFail(thrown, 1)
+		checkPassFail(filePinned(&pool, &file), false)
+
+		// a released pin outlives the guard, and a page marked dirty through it is written back
+		PageHandle released;
+		{
+			PageGuard guard(&pool, pool.readPage(&file, pageNos[1]));
+			guard.page()->updateRecord(rids[1], "page one");
+			guard.markDirty();
+			released = guard.release();
+		}
+		checkPassFail(filePinned(&pool, &file), true)
+		pool.unPinPage(released, false);
+		checkPassFail(filePinned(&pool, &file), false)
+		checkPassFail(file.readPage(pageNos[1]).getRecord(rids[1]), "page one")
+
+		// unpinning a page twice, or through a handle whose frame no longer holds it, is refused
+		int refused = 0;
+		try
+		{
+			pool.unPinPage(released, false);
+		}
+		catch (const PageNotPinnedException &e)
+		{
+			refused++;
+		}
+		PageHandle handle = pool.readPage(&file, pageNos[2]);
+		pool.markDirty(handle);
+		pool.unPinPage(handle, false);
+		pool.flushFile(&file);
+		try
+		{
+			pool.unPinPage(handle, false);
+		}
+		catch (const PageNotPinnedException &e)
+		{
+			refused++;
+		}
+		checkPassFail(refused, 2)
+
+		// tryReadPage pins a page only if it is in the pool, without reading anything
+		PageHandle tried;
+		const std::uint64_t diskReads = pool.getBufStats().diskreads;
+		checkPassFail(pool.tryReadPage(&file, pageNos[3], tried), false)
+		checkPassFail((tried.page == NULL), true)
+		checkPassFail(pool.getBufStats().diskreads, diskReads)
+		handle = pool.readPage(&file, pageNos[3]);
+		pool.unPinPage(handle, false);
+		checkPassFail(pool.tryReadPage(&file, pageNos[3], tried), true)
+		checkPassFail(tried.frameNo, handle.frameNo)
+		checkPassFail(tried.page->getRecord(rids[3]), "page 3")
+		checkPassFail(pool.getBufStats().diskreads, diskReads + 1)
+		checkPassFail(filePinned(&pool, &file), true)
+		pool.unPinPage(tried, false);
+		pool.flushFile(&file);
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			std::stringstream record;
+			record << "page " << i;
+			checkPassFail(file.readPage(pageNos[i]).getRecord(rids[i]), (i == 1 ? std::string("page one") : record.str()))
+		}
+	}
+	File::remove(name);
+}
+
+/**
+ * Returns true if a page of the file is pinned in the pool, which makes flushing the file throw.
+ */
+bool filePinned(BufMgr *pool, PageFile *file)
+{
+	try
+	{
+		pool->flushFile(file);
+	}
+	catch (const PagePinnedException &e)
+	{
+		return true;
+	}
+	return false;
+}
+
+void backgroundWriterTests()
+{
+	std::cout << "Clean dirty pages ahead of eviction with a background writer" << std::endl;
+	const std::string name = "writer.test";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	{
+		PageFile file = PageFile::create(name);
+		std::vector<PageId> pageNos(16);
+		std::vector<RecordId> rids(pageNos.size());
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			Page page = file.allocatePage(pageNos[i]);
+			rids[i] = page.insertRecord("clean");
+			file.writePage(pageNos[i], page);
+		}
+
+		const std::uint32_t numFrames = 8;
+		BufMgr pool(numFrames);
+		pool.startWriter(numFrames, 5, 0);
+		pool.startWriter(numFrames, 5, 0);
+
+		// dirty pages referenced since the last sweep are left alone
+		for (std::uint32_t i = 0; i < numFrames; i++)
+		{
+			std::stringstream record;
+			record << "dirty " << i;
+			PageHandle handle = pool.readPage(&file, pageNos[i]);
+			handle.page->updateRecord(rids[i], record.str());
+			pool.unPinPage(handle, true);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		checkPassFail(pool.getBufStats().diskwrites, 0)
+
+		// the first eviction sweeps every reference bit away and has to write its victim itself; the writer then
+		// cleans the other dirty frames, so the evictions after it write nothing
+		PageHandle handle = pool.readPage(&file, pageNos[numFrames]);
+		pool.unPinPage(handle, false);
+		checkPassFail(pool.getBufStats().dirtyEvictions, 1)
+		checkPassFail(awaitDiskWrites(&pool, numFrames), true)
+		for (std::uint32_t i = 0; i < numFrames; i++)
+		{
+			std::stringstream record;
+			record << "dirty " << i;
+			checkPassFail(file.readPage(pageNos[i]).getRecord(rids[i]), record.str())
+		}
+		for (std::size_t i = numFrames + 1; i < pageNos.size(); i++)
+		{
+			handle = pool.readPage(&file, pageNos[i]);
+			pool.unPinPage(handle, false);
+		}
+		checkPassFail(pool.getBufStats().evictions, numFrames)
+		checkPassFail(pool.getBufStats().dirtyEvictions, 1)
+		checkPassFail(pool.getBufStats().diskwrites, numFrames)
+
+		// stopping twice is harmless, and a writer started again is stopped by the destructor
+		pool.stopWriter();
+		pool.stopWriter();
+		pool.startWriter(numFrames, 5, 0);
+		pool.flushFile(&file);
+	}
+	File::remove(name);
+}
+
+/**
+ * Waits up to five seconds for the pool to have written the given number of pages in all.
+ */
+bool awaitDiskWrites(BufMgr *pool, std::uint64_t writes)
+{
+	for (int i = 0; i < 1000; i++)
+	{
+		if (pool->getBufStats().diskwrites >= writes)
+			return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	return false;
+}
+
+void referenceBitmapTests()
+{
+	std::cout << "Sweep reference bits packed 64 to a word" << std::endl;
+	ReferenceBitmap bits;
+	bits.reset(150, 200);
+
+	// the hand stops at the first frame not referenced, in the second word, clearing the bits it passes and
+	// none after it
+	for (FrameId frame = 0; frame < 70; frame++)
+	{
+		if (frame != 65)
+			bits.set(frame);
+	}
+	FrameId victim = bits.sweep();
+	checkPassFail(victim, 65)
+	checkPassFail(bits.hand(), 66)
+	checkPassFail(bits.test(0), false)
+	checkPassFail(bits.test(63), false)
+	checkPassFail(bits.test(64), false)
+	checkPassFail(bits.test(66), true)
+	victim = bits.sweep();
+	checkPassFail(victim, 70)
+	checkPassFail(bits.test(69), false)
+
+	// with every frame referenced, the hand goes once around the pool, through the short last word, clearing
+	// every bit, and takes the frame it started on
+	for (FrameId frame = 0; frame < 150; frame++)
+		bits.set(frame);
+	victim = bits.sweep();
+	checkPassFail(victim, 71)
+	int set = 0;
+	for (FrameId frame = 0; frame < 150; frame++)
+	{
+		if (bits.test(frame))
+			set++;
+	}
+	checkPassFail(set, 0)
+
+	// frames dropped by a shrink lose their bits, and a hand left past the end starts over at frame 0
+	for (FrameId frame = 72; frame < 110; frame++)
+		bits.set(frame);
+	victim = bits.sweep();
+	checkPassFail(victim, 110)
+	bits.set(120);
+	bits.resize(100);
+	checkPassFail(bits.test(120), false)
+	bits.set(0);
+	victim = bits.sweep();
+	checkPassFail(victim, 1)
+	bits.resize(150);
+	checkPassFail(bits.test(120), false)
+	checkPassFail(bits.test(0), false)
+
+	// a sweep never returns a frame past the end of the pool
+	bits.resize(100);
+	int outside = 0;
+	for (int i = 0; i < 300; i++)
+	{
+		bits.set(i % 100);
+		if (bits.sweep() >= 100)
+			outside++;
+	}
+	checkPassFail(outside, 0)
+}
+
+void twoQueueTests()
+{
+	std::cout << "Keep pages read twice in a 2Q pool through scans and one-off reads" << std::endl;
+	const std::string name = relationName + ".2q";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	{
+		PageFile file(name, true);
+		std::vector<PageId> pageNos(100);
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			Page page = file.allocatePage(pageNos[i]);
+			file.writePage(pageNos[i], page);
+		}
+		BufMgr pool(16, BUF_PARTITIONS, new TwoQueuePolicy());
+
+		// a second random read protects the first four pages
+		for (int round = 0; round < 2; round++)
+		{
+			for (std::size_t i = 0; i < 4; i++)
+				pool.unPinPage(pool.readPage(&file, pageNos[i]), false);
+		}
+
+		// a scan through many more pages than the pool holds leaves them in the pool
+		for (std::size_t i = 10; i < pageNos.size(); i++)
+			pool.unPinPage(pool.readPage(&file, pageNos[i], SEQUENTIAL_ACCESS), false);
+		pool.clearBufStats();
+		for (std::size_t i = 0; i < 4; i++)
+			pool.unPinPage(pool.readPage(&file, pageNos[i]), false);
+		checkPassFail(pool.getBufStats().hits, 4)
+		checkPassFail(pool.getBufStats().diskreads, 0)
+
+		// so do pages read once at random, which are evicted oldest first
+		for (std::size_t i = 10; i < 60; i++)
+			pool.unPinPage(pool.readPage(&file, pageNos[i]), false);
+		pool.clearBufStats();
+		for (std::size_t i = 0; i < 4; i++)
+			pool.unPinPage(pool.readPage(&file, pageNos[i]), false);
+		checkPassFail(pool.getBufStats().hits, 4)
+		pool.unPinPage(pool.readPage(&file, pageNos[10]), false);
+		checkPassFail(pool.getBufStats().diskreads, 1)
+	}
+	File::remove(name);
+
+	// promoting every page read leaves its probation entry stale, and evicting it by the sweep its free one; the
+	// queues drop them before they outgrow the pool, driven here the way allocBuf drives the policy
+	const std::uint32_t frames = 16;
+	TwoQueuePolicy policy;
+	policy.reset(frames, frames);
+	std::vector<bool> valid(frames, false);
+	for (int i = 0; i < 2000; i++)
+	{
+		FrameId frame = policy.nextVictim();
+		while (valid[frame] && policy.spare(frame))
+			frame = policy.nextVictim();
+		if (valid[frame])
+			policy.evicted(frame);
+		policy.pinned(frame, true, RANDOM_ACCESS);
+		policy.pinned(frame, false, RANDOM_ACCESS);
+		valid[frame] = true;
+	}
+	checkPassFail((policy.queued() <= 6 * frames), true)
+}
+
+// -----------------------------------------------------------------------------
+// postingTestsSearch
+// -----------------------------------------------------------------------------
+
+void postingTestsSearch()
+{
+	std::cout << "Keep the posting lists of a double index sorted by page and slot" << std::endl;
+	try
+	{
+		File::remove(doubleIndexName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+	{
+		BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+
+		// a new key, its rids inserted out of order, several to a page
+		double key = 0.5;
+		for (int i = 0; i < 300; i++)
+		{
+			const int n = i * 7 % 300;
+			RecordId rid;
+			rid.page_number = 100000 + n / 3;
+			rid.slot_number = 1 + n % 3;
+			rid.padding = 0;
+			index.insertEntry(&key, rid);
+		}
+		std::size_t count = 0;
+		checkPassFail(unsortedRids(&index, 0.5, count), 0)
+		checkPassFail((int)count, 300)
+
+		// a key of the relation, its rids inserted around the one it has, from the last page down
+		key = 10;
+		for (int i = 20; i > 0; i--)
+		{
+			RecordId rid;
+			rid.page_number = 2 * i;
+			rid.slot_number = 5;
+			rid.padding = 0;
+			index.insertEntry(&key, rid);
+		}
+		checkPassFail(unsortedRids(&index, 10, count), 0)
+		checkPassFail((int)count, 21)
+	}
+	File::remove(doubleIndexName);
+}
+
+/**
+ * Looks the key up and returns the number of rids found out of order, counting them all into count.
+ */
+int unsortedRids(BTreeIndex *index, double key, std::size_t &count)
+{
+	std::vector<RecordId> rids(1000);
+	count = index->lookup(&key, &rids[0], rids.size());
+	int unsorted = 0;
+	for (std::size_t i = 1; i < count; i++)
+	{
+		if (!ridLess(rids[i - 1], rids[i]))
+			unsorted++;
+	}
+	return unsorted;
+}
+
+/**
+ * A PosixAioBackend that records the most requests it was handed in one call.
+ */
+class BatchCountingBackend : public PosixAioBackend
+{
+public:
+	BatchCountingBackend() : largestBatch(0)
+	{
+	}
+
+	void submit(IoRequest *requests, const std::size_t count)
+	{
+		largestBatch = std::max(largestBatch, count);
+		PosixAioBackend::submit(requests, count);
+	}
+
+	std::size_t largestBatch;
+};
+
+void ioBackendTests()
+{
+	std::cout << "Run batches of reads and writes through POSIX AIO" << std::endl;
+	const std::string name = relationName + ".aio";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	// requests in flight together, each to its own range, complete with all of their bytes
+	PosixAioBackend backend;
+	const std::size_t count = 8;
+	const std::size_t length = 4096;
+	std::vector<char> written(count * length);
+	std::vector<char> readBack(count * length + length);
+	for (std::size_t i = 0; i < written.size(); i++)
+		written[i] = (char)(i * 31 / length + i);
+	const int fd = open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	checkPassFail((fd >= 0), true)
+	std::vector<IoRequest> requests(count + 1);
+	for (std::size_t i = 0; i < count; i++)
+	{
+		IoRequest request = {fd, true /* write */, i * length, &written[i * length], length, 0 /* transferred */};
+		requests[i] = request;
+	}
+	backend.submit(&requests[0], count);
+	backend.complete(&requests[0], count);
+	bool whole = true;
+	for (std::size_t i = 0; i < count; i++)
+		whole = whole && requests[i].transferred == length;
+	checkPassFail(whole, true)
+
+	// reads come back with what was written, and stop short at the end of the file
+	for (std::size_t i = 0; i <= count; i++)
+	{
+		IoRequest request = {fd, false /* write */, i * length, &readBack[i * length], length, 0 /* transferred */};
+		requests[i] = request;
+	}
+	backend.execute(&requests[0], count + 1);
+	whole = true;
+	for (std::size_t i = 0; i < count; i++)
+		whole = whole && requests[i].transferred == length;
+	checkPassFail(whole, true)
+	checkPassFail(requests[count].transferred, 0)
+	checkPassFail(memcmp(&readBack[0], &written[0], written.size()), 0)
+
+	// a request on a descriptor that is not open raises the error once it is waited for
+	requests[0].fd = -1;
+	bool raised = false;
+	try
+	{
+		backend.execute(&requests[0], 1);
+	}
+	catch (const IoErrorException &e)
+	{
+		raised = e.error_code() == EBADF;
+	}
+	checkPassFail(raised, true)
+	close(fd);
+	File::remove(name);
+
+	// a PageFile opened while the backend is the default reads and writes its pages through it
+	IoBackend::setDefaultBackend(&backend);
+	std::vector<PageId> pageNos(16);
+	std::vector<RecordId> rids(pageNos.size());
+	{
+		PageFile file(name, true);
+		checkPassFail((file.ioBackend() == &backend), true)
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			std::stringstream record;
+			record << "aio page " << i;
+			Page page = file.allocatePage(pageNos[i]);
+			rids[i] = page.insertRecord(record.str());
+			file.writePage(pageNos[i], page);
+		}
+	}
+	IoBackend::setDefaultBackend(NULL);
+	{
+		PageFile file(name, false);
+		file.setIoBackend(&backend);
+		int matches = 0;
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			std::stringstream record;
+			record << "aio page " << i;
+			if (file.readPage(pageNos[i]).getRecord(rids[i]) == record.str())
+				matches++;
+		}
+		checkPassFail(matches, (int)pageNos.size())
+	}
+	File::remove(name);
+
+	// pages that are not consecutive go to the backend in one call, a vectored request per run, and come back whole
+	{
+		BatchCountingBackend counting;
+		PageFile file(name, true);
+		file.setIoBackend(&counting);
+		std::vector<PageId> all(12);
+		for (std::size_t i = 0; i < all.size(); i++)
+			file.allocatePage(all[i]);
+		const std::size_t picks[] = {0, 1, 2, 5, 7, 8, 11};
+		std::vector<PageId> chosen;
+		for (std::size_t i = 0; i < sizeof(picks) / sizeof(picks[0]); i++)
+			chosen.push_back(all[picks[i]]);
+		int runs = 0;
+		for (std::size_t i = 0; i < chosen.size(); i++)
+		{
+			if (i == 0 || chosen[i] != chosen[i - 1] + 1)
+				runs++;
+		}
+		checkPassFail((runs > 1), true)
+
+		std::vector<Page> pages(chosen.size());
+		std::vector<RecordId> batchRids(chosen.size());
+		std::vector<const Page *> written(chosen.size());
+		for (std::size_t i = 0; i < chosen.size(); i++)
+		{
+			pages[i] = file.readPage(chosen[i]);
+			std::stringstream record;
+			record << "batched page " << i;
+			batchRids[i] = pages[i].insertRecord(record.str());
+			written[i] = &pages[i];
+		}
+		counting.largestBatch = 0;
+		file.writePages(&chosen[0], chosen.size(), &written[0]);
+		checkPassFail((int)counting.largestBatch, runs)
+
+		std::vector<Page> readBackPages(chosen.size());
+		std::vector<Page *> readInto(chosen.size());
+		for (std::size_t i = 0; i < chosen.size(); i++)
+			readInto[i] = &readBackPages[i];
+		counting.largestBatch = 0;
+		file.readPages(&chosen[0], chosen.size(), &readInto[0]);
+		checkPassFail((int)counting.largestBatch, runs)
+		int matches = 0;
+		for (std::size_t i = 0; i < chosen.size(); i++)
+		{
+			std::stringstream record;
+			record << "batched page " << i;
+			if (readBackPages[i].getRecord(batchRids[i]) == record.str())
+				matches++;
+		}
+		checkPassFail(matches, (int)chosen.size())
+
+		// the pool writes the dirty pages of a file back with one call too
+		BufMgr pool(32);
+		std::vector<RecordId> pooledRids(chosen.size());
+		for (std::size_t i = 0; i < chosen.size(); i++)
+		{
+			PageHandle handle = pool.readPage(&file, chosen[i]);
+			pooledRids[i] = handle.page->insertRecord("pooled");
+			pool.unPinPage(handle, true);
+		}
+		counting.largestBatch = 0;
+		pool.flushFile(&file);
+		checkPassFail((int)counting.largestBatch, runs)
+		matches = 0;
+		for (std::size_t i = 0; i < chosen.size(); i++)
+		{
+			if (file.readPage(chosen[i]).getRecord(pooledRids[i]) == "pooled")
+				matches++;
+		}
+		checkPassFail(matches, (int)chosen.size())
+	}
+	File::remove(name);
+}
+
+// -----------------------------------------------------------------------------
+// vectoredPageTests
+// -----------------------------------------------------------------------------
+
+void vectoredPageTests()
+{
+	std::cout << "Read and write sets of pages that are not consecutive" << std::endl;
+	const std::string name = "vectored.test";
+	PageId last = Page::INVALID_NUMBER;
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+	{
+		PageFile file(name, true);
+		std::vector<PageId> all(12);
+		for (std::size_t i = 0; i < all.size(); i++)
+			file.allocatePage(all[i]);
+		last = all.back();
+
+		// out of order and with gaps, so every run is one page or two
+		const std::size_t picks[] = {11, 0, 5, 1, 2, 8};
+		const std::size_t numPicks = sizeof(picks) / sizeof(picks[0]);
+		std::vector<PageId> chosen;
+		std::vector<Page> pages(numPicks);
+		std::vector<const Page *> written;
+		std::vector<RecordId> rids;
+		for (std::size_t i = 0; i < numPicks; i++)
+		{
+			chosen.push_back(all[picks[i]]);
+			pages[i] = file.readPage(chosen[i]);
+			std::stringstream record;
+			record << "vectored page " << picks[i];
+			rids.push_back(pages[i].insertRecord(record.str()));
+			written.push_back(&pages[i]);
+		}
+		file.writePages(&chosen[0], numPicks, &written[0]);
+
+		std::vector<Page> readBack(numPicks);
+		std::vector<Page *> readInto;
+		for (std::size_t i = 0; i < numPicks; i++)
+			readInto.push_back(&readBack[i]);
+		file.readPages(&chosen[0], numPicks, &readInto[0]);
+		int matches = 0;
+		for (std::size_t i = 0; i < numPicks; i++)
+		{
+			std::stringstream record;
+			record << "vectored page " << picks[i];
+			if (readBack[i].getRecord(rids[i]) == record.str() && file.readPage(chosen[i]).getRecord(rids[i]) == record.str())
+				matches++;
+		}
+		checkPassFail(matches, (int)numPicks)
+
+		// the pages left out are still empty
+		checkPassFail(file.readPage(all[3]).getFreeSpace(), Page().getFreeSpace())
+		checkPassFail(file.readPage(all[10]).getFreeSpace(), Page().getFreeSpace())
+
+		// a page past the last one fails the whole set before anything is written
+		std::vector<PageId> pastEnd(chosen);
+		pastEnd.push_back(all.back() + 1);
+		std::vector<Page> extra(pastEnd.size());
+		std::vector<const Page *> extraWritten;
+		for (std::size_t i = 0; i < extra.size(); i++)
+		{
+			if (i < chosen.size())
+				extra[i] = pages[i];
+			extra[i].insertRecord("never written");
+			extraWritten.push_back(&extra[i]);
+		}
+		PageId invalid = Page::INVALID_NUMBER;
+		try
+		{
+			file.writePages(&pastEnd[0], pastEnd.size(), &extraWritten[0]);
+		}
+		catch (const InvalidPageException &e)
+		{
+			invalid = e.page_number();
+		}
+		checkPassFail(invalid, all.back() + 1)
+		checkPassFail(file.readPage(chosen[0]).getFreeSpace(), pages[0].getFreeSpace())
+		invalid = Page::INVALID_NUMBER;
+		std::vector<Page *> extraInto;
+		for (std::size_t i = 0; i < extra.size(); i++)
+			extraInto.push_back(&extra[i]);
+		try
+		{
+			file.readPages(&pastEnd[0], pastEnd.size(), &extraInto[0]);
+		}
+		catch (const InvalidPageException &e)
+		{
+			invalid = e.page_number();
+		}
+		checkPassFail(invalid, all.back() + 1)
+	}
+
+	// a file cut off half way through its last page reads short there, which is caught, while the other pages
+	// still read
+	{
+		PageFile file(name, false);
+		checkPassFail(truncate(name.c_str(), sizeof(FileHeader) + (off_t)(last - 1) * Page::SIZE + Page::SIZE / 2), 0)
+		std::vector<PageId> cut;
+		cut.push_back(last - 3);
+		cut.push_back(last - 1);
+		cut.push_back(last);
+		std::vector<Page> readBack(cut.size());
+		std::vector<Page *> readInto;
+		for (std::size_t i = 0; i < cut.size(); i++)
+			readInto.push_back(&readBack[i]);
+		PageId shortPage = Page::INVALID_NUMBER;
+		try
+		{
+			file.readPages(&cut[0], cut.size(), &readInto[0]);
+		}
+		catch (const InvalidPageException &e)
+		{
+			shortPage = e.page_number();
+		}
+		checkPassFail(shortPage, last)
+		file.readPages(&cut[0], cut.size() - 1, &readInto[0]);
+		checkPassFail(readBack[1].getFreeSpace(), Page().getFreeSpace())
+	}
+	File::remove(name);
+}
+
+// -----------------------------------------------------------------------------
+// concurrentPinTests
+// -----------------------------------------------------------------------------
+
+/**
+ * What one thread of concurrentPinTests() works on and what it found.
+ */
+struct PinWorker
+{
+	BufMgr *pool;
+	PageFile *file;
+	const std::vector<PageId> *pageNos;
+	const std::vector<RecordId> *rids;
+	int id;
+	int mismatches;
+	int errors;
+	std::vector<PageId> allocated;
+	std::vector<RecordId> allocatedRids;
+};
+
+/**
+ * Returns the record concurrentPinTests() puts on the ith page of the file, or on the ith page a thread allocates.
+ */
+std::string pinRecord(const int thread, const std::size_t i)
+{
+	std::stringstream record;
+	record << "thread " << thread << " page " << i;
+	return record.str();
+}
+
+/**
+ * Pins two pages of the file at a time, from an order the other threads share in part, checks what they hold and
+ * unpins them, allocating a page of its own every so often.
+ */
+void pinWorkerRun(PinWorker *worker)
+{
+	const std::size_t numPages = worker->pageNos->size();
+	for (std::size_t i = 0; i < 2000; i++)
+	{
+		try
+		{
+			const std::size_t a = (worker->id * 7 + i * 13) % numPages;
+			const std::size_t b = (a + 1 + i % 3) % numPages;
+			PageHandle first = worker->pool->readPage(worker->file, (*worker->pageNos)[a]);
+			PageHandle second = worker->pool->readPage(worker->file, (*worker->pageNos)[b]);
+			if (first.page->getRecord((*worker->rids)[a]) != pinRecord(-1, a))
+				worker->mismatches++;
+			if (second.page->getRecord((*worker->rids)[b]) != pinRecord(-1, b))
+				worker->mismatches++;
+			worker->pool->unPinPage(second, false);
+			worker->pool->unPinPage(first, false);
+
+			if (i % 100 == 0)
+			{
+				PageId pageNo;
+				PageHandle handle = worker->pool->allocPage(worker->file, pageNo);
+				worker->allocatedRids.push_back(handle.page->insertRecord(pinRecord(worker->id, worker->allocated.size())));
+				worker->allocated.push_back(pageNo);
+				worker->pool->unPinPage(handle, true);
+			}
+		}
+		catch (const BadgerDbException &e)
+		{
+			worker->errors++;
+		}
+	}
+}
+
+void concurrentPinTests()
+{
+	std::cout << "Pin, unpin and allocate overlapping pages from several threads" << std::endl;
+	const std::string name = relationName + ".pins";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	{
+		PageFile file(name, true);
+		std::vector<PageId> pageNos(48);
+		std::vector<RecordId> rids(pageNos.size());
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			Page page = file.allocatePage(pageNos[i]);
+			rids[i] = page.insertRecord(pinRecord(-1, i));
+			file.writePage(pageNos[i], page);
+		}
+
+		// fewer frames than pages, so that the threads evict pages others are about to pin
+		BufMgr pool(32);
+		const int numThreads = 8;
+		std::vector<PinWorker> workers(numThreads);
+		std::vector<std::thread> threads;
+		for (int k = 0; k < numThreads; k++)
+		{
+			workers[k].pool = &pool;
+			workers[k].file = &file;
+			workers[k].pageNos = &pageNos;
+			workers[k].rids = &rids;
+			workers[k].id = k;
+			workers[k].mismatches = 0;
+			workers[k].errors = 0;
+			threads.push_back(std::thread(pinWorkerRun, &workers[k]));
+		}
+		for (int k = 0; k < numThreads; k++)
+			threads[k].join();
+
+		int mismatches = 0;
+		int errors = 0;
+		std::set<PageId> allocated;
+		for (int k = 0; k < numThreads; k++)
+		{
+			mismatches += workers[k].mismatches;
+			errors += workers[k].errors;
+			allocated.insert(workers[k].allocated.begin(), workers[k].allocated.end());
+		}
+		checkPassFail(errors, 0)
+		checkPassFail(mismatches, 0)
+		// no two threads were handed the same page
+		checkPassFail((int)allocated.size(), numThreads * 20)
+
+		// every pin was undone, so the file flushes; every page holds what was put on it
+		bool flushed = true;
+		try
+		{
+			pool.flushFile(&file);
+		}
+		catch (const PagePinnedException &e)
+		{
+			flushed = false;
+		}
+		checkPassFail(flushed, true)
+
+		// every pin count is back to 0: a page pinned once more is unpinned by one unpin, and no further
+		int exact = 0;
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			PageHandle handle = pool.readPage(&file, pageNos[i]);
+			pool.unPinPage(handle, false);
+			try
+			{
+				pool.unPinPage(handle, false);
+			}
+			catch (const PageNotPinnedException &e)
+			{
+				exact++;
+			}
+		}
+		checkPassFail(exact, (int)pageNos.size())
+
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			if (file.readPage(pageNos[i]).getRecord(rids[i]) != pinRecord(-1, i))
+				mismatches++;
+		}
+		for (int k = 0; k < numThreads; k++)
+		{
+			for (std::size_t i = 0; i < workers[k].allocated.size(); i++)
+			{
+				if (file.readPage(workers[k].allocated[i]).getRecord(workers[k].allocatedRids[i]) != pinRecord(k, i))
+					mismatches++;
+			}
+		}
+		checkPassFail(mismatches, 0)
+	}
+	File::remove(name);
+}
+
+// -----------------------------------------------------------------------------
+// concurrentMissTests
+// -----------------------------------------------------------------------------
+
+/**
+ * A SyncIoBackend that holds every read for a while and records how many reads it held at once.
+ */
+class SlowReadBackend : public SyncIoBackend
+{
+public:
+	SlowReadBackend() : reading(0), mostReading(0)
+	{
+	}
+
+	void submit(IoRequest *requests, const std::size_t count)
+	{
+		const bool reads = count > 0 && !requests[0].write;
+		if (reads)
+		{
+			const int now = ++reading;
+			int most = mostReading;
+			while (now > most && !mostReading.compare_exchange_weak(most, now))
+			{
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+		SyncIoBackend::submit(requests, count);
+		if (reads)
+			reading--;
+	}
+
+	/**
+	 * Reads held right now, and the most held at once so far.
+	 */
+	std::atomic<int> reading;
+	std::atomic<int> mostReading;
+};
+
+/**
+ * Reads every page of the file whose index is the worker's id modulo 8, each of which misses, and checks what it
+ * holds.
+ */
+void missWorkerRun(PinWorker *worker)
+{
+	for (std::size_t i = worker->id; i < worker->pageNos->size(); i += 8)
+	{
+		try
+		{
+			PageHandle handle = worker->pool->readPage(worker->file, (*worker->pageNos)[i]);
+			if (handle.page->getRecord((*worker->rids)[i]) != pinRecord(-1, i))
+				worker->mismatches++;
+			worker->pool->unPinPage(handle, false);
+		}
+		catch (const BadgerDbException &e)
+		{
+			worker->errors++;
+		}
+	}
+}
+
+void concurrentMissTests()
+{
+	std::cout << "Read missing pages from several threads at once" << std::endl;
+	const std::string name = relationName + ".misses";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	{
+		SlowReadBackend backend;
+		PageFile file(name, true);
+		std::vector<PageId> pageNos(64);
+		std::vector<RecordId> rids(pageNos.size());
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			Page page = file.allocatePage(pageNos[i]);
+			rids[i] = page.insertRecord(pinRecord(-1, i));
+			file.writePage(pageNos[i], page);
+		}
+		file.setIoBackend(&backend);
+
+		// every read misses, and no thread waits for another's read to finish before it starts its own
+		BufMgr pool(128);
+		const int numThreads = 8;
+		std::vector<PinWorker> workers(numThreads);
+		std::vector<std::thread> threads;
+		for (int k = 0; k < numThreads; k++)
+		{
+			workers[k].pool = &pool;
+			workers[k].file = &file;
+			workers[k].pageNos = &pageNos;
+			workers[k].rids = &rids;
+			workers[k].id = k;
+			workers[k].mismatches = 0;
+			workers[k].errors = 0;
+			threads.push_back(std::thread(missWorkerRun, &workers[k]));
+		}
+		int errors = 0;
+		int mismatches = 0;
+		for (int k = 0; k < numThreads; k++)
+		{
+			threads[k].join();
+			errors += workers[k].errors;
+			mismatches += workers[k].mismatches;
+		}
+		checkPassFail(errors, 0)
+		checkPassFail(mismatches, 0)
+		checkPassFail((int)pool.getBufStats().diskreads, (int)pageNos.size())
+		checkPassFail((backend.mostReading > 1), true)
+		pool.flushFile(&file);
+	}
+	File::remove(name);
+}
+
+void pageIntoTests()
+{
+	std::cout << "Read and allocate pages into memory holding other pages" << std::endl;
+	const std::string name = "into.test";
+	const std::string blobName = "into.blob";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+	try
+	{
+		File::remove(blobName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+	const std::uint16_t emptySpace = Page().getFreeSpace();
+
+	{
+		PageFile file = PageFile::create(name);
+		PageId first;
+		Page page = file.allocatePage(first);
+		const RecordId firstRid = page.insertRecord("first page");
+		file.writePage(first, page);
+
+		// a page allocated over one holding records comes out empty, and is so on disk too
+		PageId second;
+		file.allocatePageInto(second, &page);
+		checkPassFail(page.page_number(), second)
+		checkPassFail(page.getFreeSpace(), emptySpace)
+		checkPassFail(file.readPage(second).getFreeSpace(), emptySpace)
+
+		// reading over it brings back the first page whole
+		file.readPageInto(first, &page);
+		checkPassFail(page.page_number(), first)
+		checkPassFail(page.getRecord(firstRid), "first page")
+
+		// a deleted page or one past the end is refused
+		int refused = 0;
+		file.deletePage(second);
+		try
+		{
+			file.readPageInto(second, &page);
+		}
+		catch (const InvalidPageException &e)
+		{
+			refused++;
+		}
+		try
+		{
+			file.readPageInto(second + 100, &page);
+		}
+		catch (const InvalidPageException &e)
+		{
+			refused++;
+		}
+		checkPassFail(refused, 2)
+
+		// the freed page is handed out again, emptied even though the page it is read into is not
+		file.readPageInto(first, &page);
+		PageId reused;
+		file.allocatePageInto(reused, &page);
+		checkPassFail(reused, second)
+		checkPassFail(page.getFreeSpace(), emptySpace)
+	}
+
+	{
+		// blob pages are raw bytes, so the test writes them straight into the page
+		BlobFile file = BlobFile::create(blobName);
+		const Page fresh;
+		const char text[] = "first blob";
+		PageId first;
+		Page page = file.allocatePage(first);
+		memcpy(reinterpret_cast<char *>(&page), text, sizeof(text));
+		file.writePage(first, page);
+
+		PageId second;
+		file.allocatePageInto(second, &page);
+		checkPassFail(second, first + 1)
+		checkPassFail(memcmp(&page, &fresh, sizeof(text)), 0)
+		Page copy = file.readPage(second);
+		checkPassFail(memcmp(&copy, &fresh, sizeof(text)), 0)
+		file.readPageInto(first, &page);
+		checkPassFail(std::string(reinterpret_cast<const char *>(&page)), text)
+	}
+
+	{
+		// with a single frame, every allocation and read reuses the memory of the page before it
+		PageFile file = PageFile::open(name);
+		BufMgr pool(1);
+		PageId pageNo;
+		PageHandle handle = pool.allocPage(&file, pageNo);
+		checkPassFail(handle.page->getFreeSpace(), emptySpace)
+		const RecordId rid = handle.page->insertRecord("third page");
+		pool.unPinPage(handle, true);
+
+		PageId next;
+		handle = pool.allocPage(&file, next);
+		checkPassFail(handle.page->page_number(), next)
+		checkPassFail(handle.page->getFreeSpace(), emptySpace)
+		pool.unPinPage(handle, false);
+
+		handle = pool.readPage(&file, pageNo);
+		checkPassFail(handle.page->page_number(), pageNo)
+		checkPassFail(handle.page->getRecord(rid), "third page")
+		pool.unPinPage(handle, false);
+		pool.flushFile(&file);
+	}
+	File::remove(name);
+	File::remove(blobName);
+}
+
+void allocationMapTests()
+{
+	std::cout << "Allocate and free pages on both sides of an allocation map page" << std::endl;
+	const std::string name = relationName + ".map";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	// pages MAP_SPAN - 1 and MAP_SPAN are the last two the first map page records, the second map page comes after
+	const PageId mapPage = 1 + PageFile::MAP_SPAN;
+	const PageId pageNos[] = {mapPage - 2, mapPage - 1, mapPage + 1, mapPage + 2};
+	{
+		PageFile file = PageFile::create(name);
+		PageId pageNo = 0;
+		bool skipped = true;
+		while (pageNo < mapPage + 2)
+		{
+			Page page = file.allocatePage(pageNo);
+			skipped = skipped && pageNo != mapPage;
+			for (int i = 0; i < 4; i++)
+			{
+				// only the pages looked at are written, the rest of the file stays a hole
+				if (pageNo == pageNos[i])
+				{
+					std::stringstream record;
+					record << "map page " << i;
+					page.insertRecord(record.str());
+					file.writePage(pageNo, page);
+				}
+			}
+		}
+		checkPassFail(skipped, true)
+		checkPassFail(file.pageState(mapPage), PageFile::RESERVED_PAGE)
+
+		// free one page either side of the map page
+		file.deletePage(pageNos[1]);
+		file.deletePage(pageNos[2]);
+	}
+
+	int states = 0;
+	{
+		PageFile file = PageFile::open(name);
+		states += file.pageState(pageNos[0]) == PageFile::USED_PAGE;
+		states += file.pageState(pageNos[1]) == PageFile::FREE_PAGE;
+		states += file.pageState(pageNos[2]) == PageFile::FREE_PAGE;
+		states += file.pageState(pageNos[3]) == PageFile::USED_PAGE;
+		states += file.pageState(mapPage) == PageFile::RESERVED_PAGE;
+		checkPassFail(states, 5)
+		Page page = file.readPage(pageNos[3]);
+		checkPassFail(*page.begin(), "map page 3")
+
+		// the pages freed come back lowest first before the file grows
+		PageId pageNo;
+		file.allocatePage(pageNo);
+		checkPassFail(pageNo, pageNos[1])
+		file.allocatePage(pageNo);
+		checkPassFail(pageNo, pageNos[2])
+		file.allocatePage(pageNo);
+		checkPassFail(pageNo, pageNos[3] + 1)
+	}
+
+	{
+		PageFile file = PageFile::open(name);
+		states = 0;
+		for (int i = 0; i < 4; i++)
+			states += file.pageState(pageNos[i]) == PageFile::USED_PAGE;
+		states += file.pageState(pageNos[3] + 1) == PageFile::USED_PAGE;
+		checkPassFail(states, 5)
+		Page page = file.readPage(pageNos[0]);
+		checkPassFail(*page.begin(), "map page 0")
+	}
+
+	// a file from before the allocation map has no flag for it, and its page 1 holds records
+	{
+		FileHeader header;
+		const int fd = open(name.c_str(), O_RDWR);
+		checkPassFail((pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)), true)
+		header.flags &= ~FileHeader::ALLOCATION_MAP;
+		checkPassFail((pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)), true)
+		close(fd);
+	}
+	bool refused = false;
+	try
+	{
+		PageFile file = PageFile::open(name);
+	}
+	catch (const CorruptPageException &e)
+	{
+		refused = true;
+	}
+	checkPassFail(refused, true)
+	File::remove(name);
+}
+
+// -----------------------------------------------------------------------------
+// blockKeyTestsSearch
+// -----------------------------------------------------------------------------
+
+void blockKeyTestsSearch()
+{
+	std::cout << "Insert, delete and scan across the key blocks of non-leaf nodes" << std::endl;
+	try
+	{
+		File::remove(doubleIndexName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	// enough keys after those of the relation for the leaves to take several blocks of their parent's keys
+	const int block = NodeCapacity<double>::NONLEAF_BLOCK;
+	const int leaf = NodeCapacity<double>::LEAF;
+	const int lowKey = 5000;
+	const int highKey = lowKey + 6 * block * leaf;
+	// a run of keys over several leaves, whose deletion merges them and takes their keys out of the parent
+	const int deletedLow = lowKey + (highKey - lowKey) / 3;
+	const int deletedHigh = deletedLow + 3 * leaf;
+	{
+		BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+		// in an order that splits leaves all over the tree, shifting the parent's keys across its blocks
+		const int count = highKey - lowKey;
+		for (int i = 0; i < count; i++)
+		{
+			const int key = lowKey + (int)((long long)i * 7919 % count);
+			const double value = key;
+			index.insertEntry(&value, blockKeyRid(key));
+		}
+		checkPassFail((index.getStats().leafPages > (std::uint64_t)(4 * block)), true)
+		checkPassFail(blockKeyMismatches(&index, lowKey, highKey, 0, 0), 0)
+
+		int deleted = 0;
+		for (int key = deletedLow; key < deletedHigh; key++)
+		{
+			const double value = key;
+			deleted += index.deleteEntry(&value, blockKeyRid(key));
+		}
+		checkPassFail(deleted, deletedHigh - deletedLow)
+		checkPassFail(blockKeyMismatches(&index, lowKey, highKey, deletedLow, deletedHigh), 0)
+	}
+
+	// the block keys come back from disk with the nodes
+	{
+		BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+		checkPassFail(blockKeyMismatches(&index, lowKey, highKey, deletedLow, deletedHigh), 0)
+		for (int key = deletedHigh - 1; key >= deletedLow; key--)
+		{
+			const double value = key;
+			index.insertEntry(&value, blockKeyRid(key));
+		}
+		checkPassFail(blockKeyMismatches(&index, lowKey, highKey, 0, 0), 0)
+	}
+	File::remove(doubleIndexName);
+}
+
+/**
+ * Returns the rid blockKeyTestsSearch() inserts with a key.
+ */
+RecordId blockKeyRid(int key)
+{
+	RecordId rid;
+	rid.page_number = 300000 + key / 100;
+	rid.slot_number = 1 + key % 100;
+	rid.padding = 0;
+	return rid;
+}
+
+/**
+ * Looks up every key in [lowKey, highKey) and the value halfway to the next, and scans two leaves' worth of keys
+ * from every third of a leaf on. Returns the number of lookups and scans that did not find the keys outside of
+ * [deletedLow, deletedHigh), and only those.
+ */
+int blockKeyMismatches(BTreeIndex *index, int lowKey, int highKey, int deletedLow, int deletedHigh)
+{
+	int mismatches = 0;
+	RecordId rids[2];
+	for (int key = lowKey; key < highKey; key++)
+	{
+		double value = key;
+		const std::size_t expected = (key >= deletedLow && key < deletedHigh) ? 0 : 1;
+		if (index->lookup(&value, rids, 2) != expected)
+			mismatches++;
+		value = key + 0.5;
+		if (index->lookup(&value, rids, 2) != 0)
+			mismatches++;
+	}
+
+	const int span = 2 * NodeCapacity<double>::LEAF;
+	for (int low = lowKey; low < highKey; low += span / 3)
+	{
+		const int high = std::min(low + span, highKey);
+		const int gone = std::max(0, std::min(high, deletedHigh) - std::max(low, deletedLow));
+		if (doubleCount(index, low, high) != high - low - gone)
+			mismatches++;
+	}
+	return mismatches;
+}
+
+/**
+ * Returns the number of entries a scan of [lowVal, highVal) finds.
+ */
+int doubleCount(BTreeIndex *index, double lowVal, double highVal)
+{
+	try
+	{
+		index->startScan(&lowVal, GTE, &highVal, LT);
+	}
+	catch (const NoSuchKeyFoundException &e)
+	{
+		return 0;
+	}
+	int count = 0;
+	RecordId rid;
+	try
+	{
+		while (true)
+		{
+			index->scanNext(rid);
+			count++;
+		}
+	}
+	catch (const IndexScanCompletedException &e)
+	{
+	}
+	index->endScan();
+	return count;
+}
+
+void prefetchTests()
+{
+	std::cout << "Read chains of pages ahead in the background" << std::endl;
+	const std::string name = relationName + ".prefetch";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	{
+		// every page holds the number of the page before it, so the chain runs against the order of the file
+		PageFile file(name, true);
+		std::vector<PageId> pageNos(12);
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			Page page = file.allocatePage(pageNos[i]);
+			std::stringstream next;
+			next << (i == 0 ? Page::INVALID_NUMBER : pageNos[i - 1]);
+			page.insertRecord(next.str());
+			file.writePage(pageNos[i], page);
+		}
+
+		BufMgr pool(32);
+		PageHandle handle;
+
+		// count pages are read along the chain, and left unpinned
+		std::uint64_t reads = pool.getBufStats().diskreads;
+		pool.prefetchPages(&file, pageNos[11], 5, chainNext);
+		checkPassFail(awaitDiskReads(&pool, reads + 5), true)
+		int inPool = 0;
+		int offChain = 0;
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			if (pool.tryReadPage(&file, pageNos[i], handle))
+			{
+				pool.unPinPage(handle, false);
+				inPool++;
+				if (i < 7)
+					offChain++;
+			}
+		}
+		checkPassFail(inPool, 5)
+		checkPassFail(offChain, 0)
+		pool.flushFile(&file);
+		checkPassFail(pool.getBufStats().diskreads - reads, 5)
+
+		// the chain ends where next finds no page
+		reads = pool.getBufStats().diskreads;
+		pool.prefetchPages(&file, pageNos[1], 5, chainNext);
+		checkPassFail(awaitDiskReads(&pool, reads + 2), true)
+		pool.flushFile(&file);
+		checkPassFail(pool.getBufStats().diskreads - reads, 2)
+
+		// a flush drops the requests for the file, or waits for the one being read, so no page comes in after it
+		pool.prefetchPages(&file, pageNos[11], 12, chainNext);
+		pool.flushFile(&file);
+		inPool = 0;
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			if (pool.tryReadPage(&file, pageNos[i], handle))
+			{
+				pool.unPinPage(handle, false);
+				inPool++;
+			}
+		}
+		checkPassFail(inPool, 0)
+	}
+	File::remove(name);
+}
+
+/**
+ * Returns the page number prefetchTests() wrote to the first record of a page.
+ */
+PageId chainNext(const Page &page)
+{
+	RecordId first;
+	first.page_number = page.page_number();
+	first.slot_number = 1;
+	first.padding = 0;
+	std::stringstream next(page.getRecord(first));
+	PageId pageNo = Page::INVALID_NUMBER;
+	next >> pageNo;
+	return pageNo;
+}
+
+/**
+ * Waits up to five seconds for the pool to have read the given number of pages from disk. Returns whether it did.
+ */
+bool awaitDiskReads(BufMgr *pool, std::uint64_t reads)
+{
+	for (int i = 0; i < 1000; i++)
+	{
+		if (pool->getBufStats().diskreads >= reads)
+			return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	return false;
+}
+
+// -----------------------------------------------------------------------------
+// prefetchTestsSearch
+// -----------------------------------------------------------------------------
+
+void prefetchTestsSearch()
+{
+	std::cout << "Read the right siblings of the leaves ahead of a range scan" << std::endl;
+	try
+	{
+		File::remove(doubleIndexName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	const int lowKey = 5000;
+	const int highKey = lowKey + 8 * NodeCapacity<double>::LEAF;
+	{
+		BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+		for (int key = lowKey; key < highKey; key++)
+		{
+			const double value = key;
+			index.insertEntry(&value, blockKeyRid(key));
+		}
+		checkPassFail((index.getStats().leafPages > 8), true)
+	}
+
+	for (int depth = 0; depth <= PREFETCH_DEPTH; depth += PREFETCH_DEPTH)
+	{
+		// a pool of its own, which counts only the reads of this index
+		BufMgr pool(64);
+		BTreeOptions options;
+		options.prefetchDepth = depth;
+		BTreeIndex index(relationName, doubleIndexName, &pool, offsetof(tuple, d), DOUBLE, options);
+
+		const double lowVal = lowKey;
+		const double highVal = highKey;
+		index.startScan(&lowVal, GTE, &highVal, LT);
+		RecordId scanRid;
+		index.scanNext(scanRid);
+		int count = 1;
+
+		// the siblings come in while the scan stays on the first leaf
+		const std::uint64_t reads = pool.getBufStats().diskreads;
+		if (depth > 0)
+		{
+			checkPassFail(awaitDiskReads(&pool, reads + depth), true)
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			checkPassFail(pool.getBufStats().diskreads, reads)
+		}
+
+		try
+		{
+			while (true)
+			{
+				index.scanNext(scanRid);
+				count++;
+			}
+		}
+		catch (const IndexScanCompletedException &e)
+		{
+		}
+		index.endScan();
+		checkPassFail(count, highKey - lowKey)
+	}
+	File::remove(doubleIndexName);
+}
+
+void ringTests()
+{
+	std::cout << "Scan a file through a BufferRing without evicting the pages others use" << std::endl;
+	const std::string hotName = relationName + ".hot";
+	const std::string scanName = relationName + ".ring";
+	try
+	{
+		File::remove(hotName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+	try
+	{
+		File::remove(scanName);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	{
+		PageFile hot(hotName, true);
+		PageFile scan(scanName, true);
+		std::vector<PageId> hotNos(8);
+		std::vector<PageId> scanNos(40);
+		std::vector<RecordId> scanRids(scanNos.size());
+		for (std::size_t i = 0; i < hotNos.size(); i++)
+			hot.writePage(hotNos[i], hot.allocatePage(hotNos[i]));
+		for (std::size_t i = 0; i < scanNos.size(); i++)
+		{
+			Page page = scan.allocatePage(scanNos[i]);
+			scanRids[i] = page.insertRecord(pinRecord(-1, i));
+			scan.writePage(scanNos[i], page);
+		}
+
+		BufMgr pool(16);
+		for (std::size_t i = 0; i < hotNos.size(); i++)
+			pool.unPinPage(pool.readPage(&hot, hotNos[i]), false);
+
+		// once the ring is full, every page the scan reads takes the frame of the page read four reads earlier
+		BufferRing ring(4);
+		std::uint64_t evictions = pool.getBufStats().evictions;
+		int mismatches = 0;
+		for (std::size_t i = 0; i < scanNos.size(); i++)
+		{
+			PageHandle handle = pool.readPage(&scan, scanNos[i], ring);
+			if (handle.page->getRecord(scanRids[i]) != pinRecord(-1, i))
+				mismatches++;
+			pool.unPinPage(handle, false);
+		}
+		checkPassFail(mismatches, 0)
+		checkPassFail(pool.getBufStats().evictions - evictions, scanNos.size() - 4)
+
+		PageHandle handle;
+		int hotInPool = 0;
+		for (std::size_t i = 0; i < hotNos.size(); i++)
+		{
+			if (pool.tryReadPage(&hot, hotNos[i], handle))
+			{
+				pool.unPinPage(handle, false);
+				hotInPool++;
+			}
+		}
+		checkPassFail(hotInPool, (int)hotNos.size())
+		int scanInPool = 0;
+		for (std::size_t i = 0; i < scanNos.size(); i++)
+		{
+			if (pool.tryReadPage(&scan, scanNos[i], handle))
+			{
+				pool.unPinPage(handle, false);
+				scanInPool++;
+			}
+		}
+		checkPassFail(scanInPool, 4)
+		pool.flushFile(&scan);
+
+		// a page of the ring the scan still holds is not taken; the next page goes to a frame of the policy instead
+		BufferRing held(2);
+		PageHandle first = pool.readPage(&scan, scanNos[0], held);
+		for (std::size_t i = 1; i < 6; i++)
+			pool.unPinPage(pool.readPage(&scan, scanNos[i], held), false);
+		checkPassFail(first.page->getRecord(scanRids[0]), pinRecord(-1, 0))
+		pool.unPinPage(first, false);
+
+		// pages already in the pool are used where they are, evicting nothing
+		BufferRing cached(2);
+		evictions = pool.getBufStats().evictions;
+		for (std::size_t i = 0; i < hotNos.size(); i++)
+			pool.unPinPage(pool.readPage(&hot, hotNos[i], cached), false);
+		checkPassFail(pool.getBufStats().evictions, evictions)
+		pool.flushFile(&scan);
+		pool.flushFile(&hot);
+	}
+	File::remove(hotName);
+	File::remove(scanName);
+}
+
+void pagePoolTests()
+{
+	std::cout << "Allocate the frames of the pool with every page and NUMA option" << std::endl;
+	const HugePageMode modes[] = {NO_HUGE_PAGES, TRANSPARENT_HUGE_PAGES, HUGE_PAGES_2MB};
+	const NumaPlacement placements[] = {NUMA_DEFAULT, NUMA_INTERLEAVE, NUMA_PARTITION};
+	const std::string name = relationName + ".pool";
+	for (int m = 0; m < 3; m++)
+	{
+		for (int n = 0; n < 3; n++)
+		{
+			PoolOptions options;
+			options.hugePages = modes[m];
+			options.numa = placements[n];
+			{
+				PagePool pages(40, options);
+				checkPassFail(pages.capacity(), 40)
+				// the pool falls back to smaller pages, never to larger ones
+				checkPassFail((pages.hugePages() <= modes[m]), true)
+				checkPassFail(pagePoolMismatches(pages, 0, 40), 0)
+
+				// partitioned frames lie in blocks of one node each, in the order of the nodes
+				int misplaced = 0;
+				for (FrameId frame = 0; frame < 40; frame++)
+				{
+					const int node = pages.nodeOf(frame);
+					if (placements[n] != NUMA_PARTITION)
+					{
+						if (node != -1)
+							misplaced++;
+					}
+					else if (node < 0 || (frame > 0 && node < pages.nodeOf(frame - 1)))
+					{
+						misplaced++;
+					}
+				}
+				checkPassFail(misplaced, 0)
+			}
+
+			// room to grow is set aside up front, and frames committed later are empty pages
+			options.maxFrames = 80;
+			{
+				PagePool pages(40, options);
+				checkPassFail(pages.capacity(), 80)
+				pages.commit(40, 40);
+				checkPassFail(pagePoolMismatches(pages, 0, 80), 0)
+				pages.release(40, 40);
+				pages.commit(40, 40);
+				checkPassFail(pagePoolMismatches(pages, 40, 40), 0)
+			}
+
+			// a buffer manager on the pool reads and writes pages through it as through one allocated with new
+			try
+			{
+				File::remove(name);
+			}
+			catch (const FileNotFoundException &e)
+			{
+			}
+			{
+				PageFile file(name, true);
+				BufMgr pool(8, BUF_PARTITIONS, NULL, options);
+				std::vector<PageId> pageNos(24);
+				std::vector<RecordId> rids(pageNos.size());
+				for (std::size_t i = 0; i < pageNos.size(); i++)
+				{
+					PageHandle handle = pool.allocPage(&file, pageNos[i]);
+					rids[i] = handle.page->insertRecord(pinRecord(m * 3 + n, i));
+					pool.unPinPage(handle, true);
+				}
+				checkPassFail(pool.resize(16), 16)
+				int mismatches = 0;
+				for (std::size_t i = 0; i < pageNos.size(); i++)
+				{
+					PageHandle handle = pool.readPage(&file, pageNos[i]);
+					if (handle.page->getRecord(rids[i]) != pinRecord(m * 3 + n, i))
+						mismatches++;
+					pool.unPinPage(handle, false);
+				}
+				checkPassFail(mismatches, 0)
+				pool.flushFile(&file);
+			}
+			File::remove(name);
+		}
+	}
+}
+
+/**
+ * Checks that count frames of a PagePool from the first on are empty pages, and that each keeps a record written
+ * to it. Returns the number of frames that did not.
+ */
+int pagePoolMismatches(PagePool &pages, FrameId first, std::uint32_t count)
+{
+	const Page empty;
+	int mismatches = 0;
+	for (FrameId frame = first; frame < first + count; frame++)
+	{
+		Page &page = pages.pages()[frame];
+		if (page.page_number() != Page::INVALID_NUMBER || page.getFreeSpace() != empty.getFreeSpace())
+			mismatches++;
+		std::stringstream record;
+		record << "frame " << frame;
+		const RecordId recordId = page.insertRecord(record.str());
+		if (page.getRecord(recordId) != record.str())
+			mismatches++;
+	}
+	return mismatches;
+}
+
+void freeSpaceMapTests()
+{
+	std::cout << "Place records on pages with room through the free-space map" << std::endl;
+	const std::string name = relationName + ".fsm";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	const std::string record(200, 'r');
+	int perPage = 0;
+	{
+		Page page;
+		while (page.hasSpaceForRecord(record))
+		{
+			page.insertRecord(record);
+			perPage++;
+		}
+	}
+
+	std::vector<RecordId> rids;
+	{
+		// records fill the pages one after another, and the map pages are not among the pages of the file
+		PageFile file(name, true);
+		for (int i = 0; i < 3 * perPage + 1; i++)
+			rids.push_back(file.insertRecord(record));
+		std::set<PageId> pageNos;
+		for (std::size_t i = 0; i < rids.size(); i++)
+			pageNos.insert(rids[i].page_number);
+		checkPassFail(pageNos.size(), 4)
+		checkPassFail(usedPages(file), 4)
+
+		// the space of a deleted record is reused, on the lowest page with room
+		file.deleteRecord(rids[perPage + 1]);
+		const RecordId reused = file.insertRecord(record);
+		checkPassFail(reused.page_number, rids[perPage + 1].page_number)
+		checkPassFail(file.readPage(reused.page_number).getRecord(reused), record)
+	}
+
+	{
+		// the map comes back from disk
+		PageFile file(name, false);
+		const PageId last = rids.back().page_number;
+		checkPassFail(file.findPageWithSpace(record.size()), last)
+		checkPassFail(file.findPageWithSpace(Page::DATA_SIZE - 2 * sizeof(PageSlot)), Page::INVALID_NUMBER)
+
+		// a page filled behind the map's back has its entry corrected by the next insert, which goes elsewhere
+		Page page = file.readPage(last);
+		while (page.hasSpaceForRecord(record))
+			page.insertRecord(record);
+		file.writePage(last, page);
+		const RecordId moved = file.insertRecord(record);
+		checkPassFail((moved.page_number != last), true)
+		checkPassFail((file.findPageWithSpace(record.size()) != last), true)
+		checkPassFail(usedPages(file), 5)
+	}
+	File::remove(name);
+
+	{
+		// through the buffer manager, which keeps the map current with noteFreeSpace()
+		PageFile file(name, true);
+		BufMgr pool(8);
+		rids.clear();
+		for (int i = 0; i < 3 * perPage + 1; i++)
+			rids.push_back(pool.insertRecord(&file, record));
+		std::set<PageId> pageNos;
+		for (std::size_t i = 0; i < rids.size(); i++)
+			pageNos.insert(rids[i].page_number);
+		checkPassFail(pageNos.size(), 4)
+
+		PageHandle handle = pool.readPage(&file, rids[0].page_number);
+		handle.page->deleteRecord(rids[0]);
+		file.noteFreeSpace(*handle.page);
+		pool.unPinPage(handle, true);
+		checkPassFail(pool.insertRecord(&file, record).page_number, rids[0].page_number)
+		pool.flushFile(&file);
+		checkPassFail(usedPages(file), 4)
+	}
+	File::remove(name);
+}
+
+/**
+ * Returns the number of pages a FileIterator visits in a file.
+ */
+int usedPages(PageFile &file)
+{
+	int count = 0;
+	for (FileIterator it = file.begin(); it != file.end(); ++it)
+		count++;
+	return count;
+}
+
+void extentTests()
+{
+	std::cout << "Allocate pages in the extent of the page they are near" << std::endl;
+	const std::string name = relationName + ".extent";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	const PageId extent = BlobFile::EXTENT_PAGES;
+	{
+		BlobFile file = BlobFile::create(name);
+		Page page;
+		PageId pageNo;
+		file.allocatePageNear(pageNo, &page, Page::INVALID_NUMBER);
+		checkPassFail(pageNo, 1)
+
+		// pages near the last one are appended while the tail of the file is in its extent
+		PageId previous = pageNo;
+		for (PageId i = 2; i <= extent; i++)
+		{
+			file.allocatePageNear(pageNo, &page, previous);
+			checkPassFail(pageNo, i)
+			previous = pageNo;
+		}
+
+		// the extent is full, so a whole new one is added, whose other pages are kept free
+		file.allocatePageNear(pageNo, &page, previous);
+		checkPassFail(pageNo, extent + 1)
+		checkPassFail(file.pageInUse(extent + 2), false)
+		checkPassFail(file.pageInUse(2 * extent), false)
+
+		// a free page in the extent is taken, the first after the hint before any before it
+		file.deletePage(5);
+		file.deletePage(20);
+		file.allocatePageNear(pageNo, &page, 10);
+		checkPassFail(pageNo, 20)
+		file.allocatePageNear(pageNo, &page, 10);
+		checkPassFail(pageNo, 5)
+		file.allocatePageNear(pageNo, &page, 10);
+		checkPassFail(pageNo, 2 * extent + 1)
+
+		// the new extent is used for pages near its first page
+		file.allocatePageNear(pageNo, &page, 2 * extent + 1);
+		checkPassFail(pageNo, 2 * extent + 2)
+
+		// without a hint, or with one past the end of the file, the head of the free list is taken
+		file.allocatePageNear(pageNo, &page, Page::INVALID_NUMBER);
+		checkPassFail(pageNo, extent + 2)
+		file.allocatePageNear(pageNo, &page, 100000);
+		checkPassFail(pageNo, extent + 3)
+	}
+
+	{
+		// the free list is kept in page number order on disk, so it comes back sorted
+		BlobFile file = BlobFile::open(name);
+		file.deletePage(extent + 1);
+		file.deletePage(40);
+		Page page;
+		PageId pageNo;
+		file.allocatePageNear(pageNo, &page, 2 * extent + 1);
+		checkPassFail(pageNo, 2 * extent + 3)
+		file.allocatePageNear(pageNo, &page, Page::INVALID_NUMBER);
+		checkPassFail(pageNo, 40)
+		file.allocatePageNear(pageNo, &page, Page::INVALID_NUMBER);
+		checkPassFail(pageNo, extent + 1)
+	}
+
+	{
+		// the buffer manager passes the hint on
+		BlobFile file = BlobFile::open(name);
+		BufMgr pool(4);
+		PageId pageNo;
+		pool.unPinPage(pool.allocPage(&file, pageNo, extent + 1), true);
+		checkPassFail(pageNo, extent + 4)
+		pool.unPinPage(pool.allocPage(&file, pageNo, 2 * extent + 1), true);
+		checkPassFail(pageNo, 2 * extent + 4)
+		pool.flushFile(&file);
+		checkPassFail(file.pageInUse(extent + 4), true)
+		checkPassFail(file.pageInUse(2 * extent + 4), true)
+	}
+	File::remove(name);
+}
+
+void checksumTests()
+{
+	std::cout << "Checksum pages with CRC32C and catch pages corrupted on disk" << std::endl;
+	const char *digits = "123456789";
+	checkPassFail(crc32c(digits, 9), 0xE3069283)
+	checkPassFail(crc32c(digits + 4, 5, crc32c(digits, 4)), 0xE3069283)
+	checkPassFail(crc32c(digits, 0), 0)
+
+	// any start and length, however they fall on the words the instructions take, sums as byte by byte
+	unsigned char bytes[80];
+	for (int i = 0; i < 80; i++)
+		bytes[i] = (unsigned char)(i * 37 + 11);
+	int mismatches = 0;
+	for (int start = 0; start < 8; start++)
+	{
+		for (int length = 0; length <= 72; length++)
+		{
+			std::uint32_t crc = 0;
+			for (int i = 0; i < length; i++)
+				crc = crc32c(bytes + start + i, 1, crc);
+			if (crc32c(bytes + start, length) != crc)
+				mismatches++;
+		}
+	}
+	checkPassFail(mismatches, 0)
+
+	const std::string name = relationName + ".crc";
+	try
+	{
+		File::remove(name);
+	}
+	catch (const FileNotFoundException &e)
+	{
+	}
+
+	// a byte flipped in the free space of a PageFile page is caught when the page is read, directly or into the pool
+	PageId pageNo;
+	RecordId recordId;
+	{
+		PageFile file(name, true);
+		Page page = file.allocatePage(pageNo);
+		recordId = page.insertRecord("checksummed");
+		file.writePage(pageNo, page);
+	}
+	corruptByte(name, sizeof(FileHeader) + (off_t)(pageNo - 1) * Page::SIZE + Page::SIZE / 2);
+	{
+		PageFile file = PageFile::open(name);
+		bool caught = false;
+		try
+		{
+			file.readPage(pageNo);
+		}
+		catch (const CorruptPageException &e)
+		{
+			caught = true;
+		}
+		checkPassFail(caught, true)
+
+		BufMgr pool(4);
+		caught = false;
+		try
+		{
+			pool.readPage(&file, pageNo);
+		}
+		catch (const CorruptPageException &e)
+		{
+			caught = true;
+		}
+		checkPassFail(caught, true)
+
+		// with checksums off the page reads, flipped byte and all, and its record is intact
+		file.setChecksums(false);
+		Page page = file.readPage(pageNo);
+		checkPassFail(page.getRecord(recordId), "checksummed")
+		file.setChecksums(true);
+	}
+	File::remove(name);
+
+	// as is one flipped in a page of a BlobFile
+	{
+		BlobFile file = BlobFile::create(name);
+		Page page;
+		file.allocatePageNear(pageNo, &page, Page::INVALID_NUMBER);
+		page.insertRecord("checksummed");
+		file.writePage(pageNo, page);
+		checkPassFail((file.readPage(pageNo).getFreeSpace() == page.getFreeSpace()), true)
+	}
+	corruptByte(name, sizeof(FileHeader) + (off_t)(pageNo - 1) * Page::SIZE);
+	{
+		BlobFile file = BlobFile::open(name);
+		bool caught = false;
+		try
+		{
+			file.readPage(pageNo);
+		}
+		catch (const CorruptPageException &e)
+		{
+			caught = true;
+		}
+		checkPassFail(caught, true)
+	}
+	File::remove(name);
+}
+
+/**
+ * Flips the bits of the byte at the given position of a file.
+ */
+void corruptByte(const std::string &name, off_t position)
+{
+	const int fd = open(name.c_str(), O_RDWR);
+	unsigned char byte = 0;
+	checkPassFail((pread(fd, &byte, 1, position) == 1), true)
+	byte = ~byte;
+	checkPassFail((pwrite(fd, &byte, 1, position) == 1), true)
+	close(fd);
 }
 
 void deleteRelation()
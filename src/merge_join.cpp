@@ -0,0 +1,214 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "merge_join.h"
+#include "btree.h"
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+
+namespace badgerdb {
+
+/**
+ * KeyCompare of keys of type T, which need not be aligned in the batch.
+ */
+template <class T>
+static int compareKeys(const void *a, const void *b)
+{
+  T x;
+  T y;
+  memcpy(&x, a, sizeof(T));
+  memcpy(&y, b, sizeof(T));
+  if (x < y)
+    return -1;
+  return (y < x) ? 1 : 0;
+}
+
+MergeJoin::MergeJoin(IndexScanCursor &leftCursor, IndexScanCursor &rightCursor, const std::size_t batchSize)
+  : keySize(leftCursor.keySize()), compare(NULL), groupNext(0), numPairs(0), numSkips(0)
+{
+  if (leftCursor.keyType() != rightCursor.keyType())
+    throw BadIndexInfoException("Merge join of indexes on keys of different types");
+
+  if (leftCursor.keyType() == INTEGER)
+    compare = &compareKeys<int>;
+  else if (leftCursor.keyType() == DOUBLE)
+    compare = &compareKeys<double>;
+  else if (leftCursor.keyType() == STRING)
+    compare = &compareKeys<StringKey>;
+  else
+    compare = &compareKeys<CompositeKey>;
+
+  open(left, leftCursor, batchSize);
+  open(right, rightCursor, batchSize);
+  groupKey.resize(keySize);
+  groupLeft.page_number = Page::INVALID_NUMBER;
+  groupLeft.slot_number = 0;
+  groupLeft.padding = 0;
+}
+
+void MergeJoin::open(Input &input, IndexScanCursor &cursor, const std::size_t batchSize)
+{
+  input.cursor = &cursor;
+  input.rids.resize(std::max<std::size_t>(1, batchSize));
+  input.keys.resize(input.rids.size() * keySize);
+  input.pos = 0;
+  input.count = 0;
+  input.exhausted = !cursor.isScanning();
+}
+
+bool MergeJoin::fill(Input &input)
+{
+  if (input.pos < input.count)
+    return true;
+  if (input.exhausted)
+    return false;
+
+  input.pos = 0;
+  input.count = 0;
+  try
+  {
+    input.count = input.cursor->scanNextKeys(&input.rids[0], &input.keys[0], input.rids.size());
+  }
+  catch (const IndexScanCompletedException &e)
+  {
+  }
+  // a short batch means the scan reached the end of its range
+  if (input.count < input.rids.size())
+    finish(input);
+  return input.count > 0;
+}
+
+void MergeJoin::finish(Input &input)
+{
+  if (!input.exhausted)
+  {
+    input.exhausted = true;
+    input.cursor->endScan();
+  }
+}
+
+void MergeJoin::gallop(Input &input, const char *key)
+{
+  if (compare(keyAt(input, input.pos), key) >= 0)
+    return;
+
+  // the key at lo is smaller than key; the first one that is not lies in (lo, hi], hi == count standing for the
+  // entries past the batch
+  std::size_t lo = input.pos;
+  std::size_t step = 1;
+  std::size_t hi = lo + 1;
+  while (hi < input.count && compare(keyAt(input, hi), key) < 0)
+  {
+    lo = hi;
+    step *= 2;
+    hi = lo + step;
+  }
+  hi = std::min(hi, input.count);
+  while (lo + 1 < hi)
+  {
+    const std::size_t mid = lo + (hi - lo) / 2;
+    if (compare(keyAt(input, mid), key) < 0)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  input.pos = hi;
+
+  // the whole batch is behind, have the cursor skip ahead rather than read the entries in between
+  if (input.pos == input.count && !input.exhausted)
+  {
+    input.cursor->skipTo(key);
+    numSkips++;
+  }
+}
+
+bool MergeJoin::advance()
+{
+  while (true)
+  {
+    if (!fill(left))
+      break;
+    const char *leftKey = keyAt(left, left.pos);
+
+    // a left entry with the key of the one before joins the same right entries
+    if (!group.empty() && compare(leftKey, &groupKey[0]) == 0)
+    {
+      groupLeft = left.rids[left.pos++];
+      groupNext = 0;
+      return true;
+    }
+    group.clear();
+
+    if (!fill(right))
+      break;
+    const int order = compare(leftKey, keyAt(right, right.pos));
+    if (order < 0)
+    {
+      gallop(left, keyAt(right, right.pos));
+    }
+    else if (order > 0)
+    {
+      gallop(right, leftKey);
+    }
+    else
+    {
+      memcpy(&groupKey[0], leftKey, keySize);
+      while (fill(right) && compare(keyAt(right, right.pos), &groupKey[0]) == 0)
+        group.push_back(right.rids[right.pos++]);
+      groupLeft = left.rids[left.pos++];
+      groupNext = 0;
+      return true;
+    }
+  }
+
+  finish(left);
+  finish(right);
+  group.clear();
+  groupNext = 0;
+  return false;
+}
+
+void MergeJoin::joinNext(RecordId &leftRid, RecordId &rightRid)
+{
+  while (groupNext >= group.size())
+  {
+    if (!advance())
+      throw IndexScanCompletedException();
+  }
+  leftRid = groupLeft;
+  rightRid = group[groupNext++];
+  numPairs++;
+}
+
+std::size_t MergeJoin::joinNextBatch(RecordId *leftRids, RecordId *rightRids, const std::size_t maxPairs)
+{
+  std::size_t filled = 0;
+  while (filled < maxPairs)
+  {
+    if (groupNext >= group.size())
+    {
+      if (!advance())
+        break;
+      continue;
+    }
+    // the left entry pairs with the rest of its group, as many as fit
+    const std::size_t count = std::min(group.size() - groupNext, maxPairs - filled);
+    std::fill(leftRids + filled, leftRids + filled + count, groupLeft);
+    std::copy(group.begin() + groupNext, group.begin() + groupNext + count, rightRids + filled);
+    groupNext += count;
+    filled += count;
+  }
+  numPairs += filled;
+
+  if (filled == 0 && maxPairs > 0)
+    throw IndexScanCompletedException();
+  return filled;
+}
+
+}
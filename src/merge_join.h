@@ -0,0 +1,191 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "types.h"
+
+namespace badgerdb {
+
+class IndexScanCursor;
+
+/**
+ * @brief Default number of entries a MergeJoin takes from each scan at a time.
+ */
+const std::size_t MERGE_JOIN_BATCH_SIZE = 256;
+
+/**
+ * @brief Equi-join of the entries of two index scans, e.g. to join two relations on indexed attributes without
+ * building a hash table.
+ *
+ * Both scans return their entries in key order, so the join merges them: it takes batches of entries with their
+ * keys from each cursor, and where the keys on one side are smaller than the next key on the other, skips them by
+ * galloping, probing 1, 2, 4, ... entries ahead in the batch and then searching the last gap. When the whole
+ * batch is behind, IndexScanCursor::skipTo() moves the cursor itself forward, so ranges of one index without a
+ * match on the other are mostly passed over without being read.
+ *
+ * A pair is returned for every left entry and right entry with equal keys, grouped by left entry. The join holds
+ * a batch of each side and the right entries of the key it is on, so its memory does not grow with the scans,
+ * only with the number of right entries sharing a key.
+ *
+ * Both indexes must have keys of the same type; COMPOSITE keys are compared by their encoding, so they must also
+ * be made of the same attribute types.
+ */
+class MergeJoin
+{
+ public:
+  /**
+   * Sets up the join of the scans started on two cursors. A cursor with no scan running, e.g. because startScan()
+   * found no key in its range, joins with nothing.
+   *
+   * @param left       Cursor of the outer side, with a scan started on it
+   * @param right      Cursor of the inner side, with a scan started on it
+   * @param batchSize  Number of entries to take from each scan at a time
+   * @throws BadIndexInfoException If the keys of the two indexes are of different types.
+   */
+  MergeJoin(IndexScanCursor &left, IndexScanCursor &right, const std::size_t batchSize = MERGE_JOIN_BATCH_SIZE);
+
+  /**
+   * Returns the record ids of the next pair of entries with equal keys. Both scans are ended once the join is
+   * complete.
+   *
+   * @param leftRid   Record id of the left entry
+   * @param rightRid  Record id of the right entry
+   * @throws IndexScanCompletedException If no pair is left.
+   */
+  void joinNext(RecordId &leftRid, RecordId &rightRid);
+
+  /**
+   * Returns up to maxPairs next pairs, like joinNext(). A batch shorter than maxPairs means the join is complete.
+   *
+   * @return  Number of pairs returned.
+   * @throws IndexScanCompletedException If no pair was left to return.
+   */
+  std::size_t joinNextBatch(RecordId *leftRids, RecordId *rightRids, const std::size_t maxPairs);
+
+  /**
+   * Returns the number of pairs returned so far.
+   */
+  std::size_t pairsJoined() const
+  {
+    return numPairs;
+  }
+
+  /**
+   * Returns the number of times a cursor was moved forward past entries it had not returned yet.
+   */
+  std::size_t cursorSkips() const
+  {
+    return numSkips;
+  }
+
+ private:
+  MergeJoin(const MergeJoin &);
+  MergeJoin &operator=(const MergeJoin &);
+
+  /**
+   * Compares two keys, returning less than, equal to or greater than 0 like memcmp.
+   */
+  typedef int (*KeyCompare)(const void *a, const void *b);
+
+  /**
+   * @brief One side of the join and the batch of entries taken from it.
+   */
+  struct Input
+  {
+    IndexScanCursor *cursor;
+
+    /**
+     * Record ids of the batch.
+     */
+    std::vector<RecordId> rids;
+
+    /**
+     * Keys of the batch, keySize bytes each.
+     */
+    std::vector<char> keys;
+
+    /**
+     * Index in the batch of the next entry.
+     */
+    std::size_t pos;
+
+    /**
+     * Number of entries in the batch.
+     */
+    std::size_t count;
+
+    /**
+     * True once the scan returned its last entry and was ended.
+     */
+    bool exhausted;
+  };
+
+  Input left;
+
+  Input right;
+
+  std::size_t keySize;
+
+  KeyCompare compare;
+
+  /**
+   * Key of the right entries in group.
+   */
+  std::vector<char> groupKey;
+
+  /**
+   * Record ids of the right entries whose key is groupKey, empty if the join is not on a key.
+   */
+  std::vector<RecordId> group;
+
+  /**
+   * Record id of the left entry joined with group.
+   */
+  RecordId groupLeft;
+
+  /**
+   * Index in group of the right entry of the next pair.
+   */
+  std::size_t groupNext;
+
+  std::size_t numPairs;
+
+  std::size_t numSkips;
+
+  void open(Input &input, IndexScanCursor &cursor, const std::size_t batchSize);
+
+  /**
+   * Returns the key of the entry at index i of the batch of input.
+   */
+  const char *keyAt(const Input &input, const std::size_t i) const
+  {
+    return &input.keys[i * keySize];
+  }
+
+  /**
+   * Takes the next batch of input if it has no entry left. Returns false if the scan has no more.
+   */
+  bool fill(Input &input);
+
+  /**
+   * Moves input forward to its first entry whose key is not smaller than key.
+   */
+  void gallop(Input &input, const char *key);
+
+  /**
+   * Moves on to the next left entry that has right entries with its key and collects them in group. Returns false
+   * once either side has no more entries, after ending both scans.
+   */
+  bool advance();
+
+  void finish(Input &input);
+};
+
+}
@@ -0,0 +1,447 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "types.h"
+
+namespace badgerdb
+{
+
+  /**
+   * @brief Version latch for optimistic lock coupling.
+   *
+   * The version is even while the latch is free and odd while a writer holds it. Readers do not write to the
+   * latch at all: they remember the version before reading the protected data and check afterwards that it did
+   * not change, starting over if it did. Writers take the latch by bumping the version to odd, either from a
+   * version they read before (upgrade) or from scratch (writeLock), and bump it again when they are done.
+   */
+  class OptimisticLatch
+  {
+  public:
+    OptimisticLatch() : version(0)
+    {
+    }
+
+    /**
+     * Waits until no writer holds the latch and returns the version to validate the read against.
+     */
+    std::uint64_t readLock() const
+    {
+      std::uint64_t current;
+      while ((current = version.load(std::memory_order_acquire)) & 1)
+      {
+        std::this_thread::yield();
+      }
+      return current;
+    }
+
+    /**
+     * Returns true if nothing was written under the latch since readLock() returned the version.
+     */
+    bool validate(const std::uint64_t readVersion) const
+    {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return version.load(std::memory_order_relaxed) == readVersion;
+    }
+
+    /**
+     * Takes the latch for writing if nothing was written under it since readLock() returned the version.
+     *
+     * @return  False if the version changed; the latch is not taken then.
+     */
+    bool upgrade(std::uint64_t readVersion)
+    {
+      return version.compare_exchange_strong(readVersion, readVersion + 1, std::memory_order_acquire);
+    }
+
+    /**
+     * Takes the latch for writing, waiting for other writers.
+     */
+    void writeLock()
+    {
+      while (!upgrade(readLock()))
+      {
+      }
+    }
+
+    /**
+     * Releases the latch taken by upgrade() or writeLock().
+     */
+    void writeUnlock()
+    {
+      version.fetch_add(1, std::memory_order_release);
+    }
+
+  private:
+    OptimisticLatch(const OptimisticLatch &);
+    OptimisticLatch &operator=(const OptimisticLatch &);
+
+    /**
+     * Number of times the latch was taken and released, times two, plus one while it is held.
+     */
+    std::atomic<std::uint64_t> version;
+  };
+
+  /**
+   * @brief Number of latches allocated at once by NodeLatchTable.
+   */
+  const std::uint32_t NODE_LATCH_CHUNK_SIZE = 1 << 12;
+
+  /**
+   * @brief Number of chunks NodeLatchTable can allocate. Page numbers past NODE_LATCH_CHUNKS * NODE_LATCH_CHUNK_SIZE
+   * wrap around and share latches with lower pages.
+   */
+  const std::uint32_t NODE_LATCH_CHUNKS = 1 << 16;
+
+  /**
+   * @brief One OptimisticLatch per page of a file, allocated in chunks the first time a page in the chunk is latched.
+   * Page numbers of a BlobFile are dense, so the table grows with the file.
+   */
+  class NodeLatchTable
+  {
+  public:
+    NodeLatchTable() : chunks(new std::atomic<OptimisticLatch *>[NODE_LATCH_CHUNKS])
+    {
+      for (std::uint32_t i = 0; i < NODE_LATCH_CHUNKS; i++)
+      {
+        chunks[i] = NULL;
+      }
+    }
+
+    ~NodeLatchTable()
+    {
+      for (std::uint32_t i = 0; i < NODE_LATCH_CHUNKS; i++)
+      {
+        delete[] chunks[i].load();
+      }
+      delete[] chunks;
+    }
+
+    /**
+     * Returns the latch of the given page.
+     */
+    OptimisticLatch &latchFor(const PageId pageNo)
+    {
+      const std::uint32_t slot = pageNo % (NODE_LATCH_CHUNKS * NODE_LATCH_CHUNK_SIZE);
+      std::atomic<OptimisticLatch *> &chunk = chunks[slot / NODE_LATCH_CHUNK_SIZE];
+      OptimisticLatch *latches = chunk.load(std::memory_order_acquire);
+      if (latches == NULL)
+      {
+        // several threads may race to allocate the chunk, the first one wins
+        OptimisticLatch *fresh = new OptimisticLatch[NODE_LATCH_CHUNK_SIZE];
+        if (chunk.compare_exchange_strong(latches, fresh, std::memory_order_acq_rel))
+        {
+          latches = fresh;
+        }
+        else
+        {
+          delete[] fresh;
+        }
+      }
+      return latches[slot % NODE_LATCH_CHUNK_SIZE];
+    }
+
+  private:
+    NodeLatchTable(const NodeLatchTable &);
+    NodeLatchTable &operator=(const NodeLatchTable &);
+
+    /**
+     * Chunks of latches, NULL until first used.
+     */
+    std::atomic<OptimisticLatch *> *chunks;
+  };
+
+  /**
+   * @brief Number of counters OperationTracker spreads the threads over.
+   */
+  const std::uint32_t OPERATION_STRIPES = 16;
+
+  /**
+   * @brief Counts the operations running on a tree by the epoch they started in, so that a page unlinked from it is
+   * freed once every operation that could still reach it has finished.
+   *
+   * Each thread counts in one of OPERATION_STRIPES stripes, picked when it first enters, so threads rarely write
+   * the same cache line. A stripe has a counter for even and one for odd epochs, and an operation counts in the one
+   * of the epoch it started in. The epoch only moves on once every operation of the epoch before has left, so
+   * operations of at most two epochs run at a time. A page retired in epoch e can be freed once the epoch has moved
+   * on to e + 2, see safeEpoch(). An operation leaves through the counter it entered by, even from another thread,
+   * so no counter ever drops below the number of operations in it.
+   */
+  class OperationTracker
+  {
+  public:
+    OperationTracker() : epoch(2)
+    {
+      for (std::uint32_t i = 0; i < OPERATION_STRIPES; i++)
+      {
+        stripes[i].running[0] = 0;
+        stripes[i].running[1] = 0;
+      }
+    }
+
+    /**
+     * Counts an operation starting on the calling thread in the current epoch.
+     *
+     * @return  Counter to hand to leave().
+     */
+    std::uint32_t enter()
+    {
+      static std::atomic<std::uint32_t> nextStripe(0);
+      static thread_local std::uint32_t stripe = nextStripe.fetch_add(1) % OPERATION_STRIPES;
+      while (true)
+      {
+        // the epoch may move on between reading it and counting in it; the count only holds if it did not, since
+        // the epoch that moved on did not wait for it
+        const std::uint64_t current = epoch.load();
+        const std::uint32_t parity = current % 2;
+        stripes[stripe].running[parity].fetch_add(1);
+        if (epoch.load() == current)
+        {
+          return 2 * stripe + parity;
+        }
+        stripes[stripe].running[parity].fetch_sub(1);
+      }
+    }
+
+    /**
+     * Counts an operation as done.
+     *
+     * @param counter  Counter enter() returned for it.
+     */
+    void leave(const std::uint32_t counter)
+    {
+      stripes[counter / 2].running[counter % 2].fetch_sub(1);
+    }
+
+    /**
+     * Returns true if no operation was counted when each counter was read. An operation entering meanwhile may be
+     * missed, so a caller that needs none to run keeps new ones out before it asks, as WriterGate does.
+     */
+    bool idle() const
+    {
+      return drained(0) && drained(1);
+    }
+
+    /**
+     * Returns the epoch operations start in now. A page unlinked from the tree before the call is retired in it.
+     */
+    std::uint64_t currentEpoch() const
+    {
+      return epoch.load();
+    }
+
+    /**
+     * Moves the epoch on as far as the operations running let it and returns the latest epoch every operation that
+     * started in it, or before, has left. Pages retired in it or before can be freed.
+     */
+    std::uint64_t safeEpoch()
+    {
+      // two steps on from an epoch, the operations of the epoch have drained
+      for (int step = 0; step < 2; step++)
+      {
+        std::uint64_t current = epoch.load();
+        // the next epoch counts in the counters of the one before this one
+        if (!drained((current + 1) % 2))
+        {
+          break;
+        }
+        // losing the exchange means another thread moved it on
+        epoch.compare_exchange_strong(current, current + 1);
+      }
+      return epoch.load() - 2;
+    }
+
+  private:
+    OperationTracker(const OperationTracker &);
+    OperationTracker &operator=(const OperationTracker &);
+
+    /**
+     * Returns true if no operation was counted in the counters of the given parity when they were read.
+     */
+    bool drained(const std::uint32_t parity) const
+    {
+      for (std::uint32_t i = 0; i < OPERATION_STRIPES; i++)
+      {
+        if (stripes[i].running[parity].load() != 0)
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /**
+     * Operations counted in one stripe by the parity of their epoch, alone on its cache line.
+     */
+    struct Stripe
+    {
+      std::atomic<std::uint64_t> running[2];
+      char padding[64 - 2 * sizeof(std::atomic<std::uint64_t>)];
+    };
+
+    Stripe stripes[OPERATION_STRIPES];
+
+    /**
+     * Epoch operations start in, from 2 so that safeEpoch() never goes below 0.
+     */
+    std::atomic<std::uint64_t> epoch;
+  };
+
+  /**
+   * @brief Counts an operation in an OperationTracker for as long as the guard lives.
+   */
+  class OperationGuard
+  {
+  public:
+    explicit OperationGuard(OperationTracker &tracker) : tracker(tracker), stripe(tracker.enter())
+    {
+    }
+
+    ~OperationGuard()
+    {
+      tracker.leave(stripe);
+    }
+
+  private:
+    OperationGuard(const OperationGuard &);
+    OperationGuard &operator=(const OperationGuard &);
+
+    OperationTracker &tracker;
+    const std::uint32_t stripe;
+  };
+
+  /**
+   * @brief Lets writers into a tree unless it is closed, and closes it once the writers already in have left.
+   *
+   * Writers count in an OperationTracker before checking that the gate is open and back out to wait if it is not,
+   * so close() returning means no writer is in and none gets in until open(). While the gate is closed, writers
+   * and the thread closing it sleep on a condition variable rather than spin; an open gate costs a writer no more
+   * than the count.
+   */
+  class WriterGate
+  {
+  public:
+    WriterGate() : closed(false)
+    {
+    }
+
+    /**
+     * Counts a writer in, waiting while the gate is closed.
+     *
+     * @return  Counter to hand to leave().
+     */
+    std::uint32_t enter()
+    {
+      while (true)
+      {
+        const std::uint32_t stripe = writers.enter();
+        if (!closed.load())
+        {
+          return stripe;
+        }
+        leave(stripe);
+        std::unique_lock<std::mutex> guard(latch);
+        while (closed.load())
+        {
+          changed.wait(guard);
+        }
+      }
+    }
+
+    /**
+     * Counts a writer out, waking the thread closing the gate if there is one.
+     *
+     * @param stripe  Counter enter() returned for it.
+     */
+    void leave(const std::uint32_t stripe)
+    {
+      writers.leave(stripe);
+      // the count is down before closed is read, and close() sets closed before it reads the count, so either
+      // close() sees the writer gone or the writer sees the gate closing
+      if (closed.load())
+      {
+        std::lock_guard<std::mutex> guard(latch);
+        changed.notify_all();
+      }
+    }
+
+    /**
+     * Keeps new writers out and waits for the ones in to leave. Only one thread may close the gate at a time, and
+     * not while it is in as a writer itself.
+     */
+    void close()
+    {
+      closed = true;
+      std::unique_lock<std::mutex> guard(latch);
+      while (!writers.idle())
+      {
+        changed.wait(guard);
+      }
+    }
+
+    /**
+     * Lets writers in again.
+     */
+    void open()
+    {
+      {
+        std::lock_guard<std::mutex> guard(latch);
+        closed = false;
+      }
+      changed.notify_all();
+    }
+
+  private:
+    WriterGate(const WriterGate &);
+    WriterGate &operator=(const WriterGate &);
+
+    OperationTracker writers;
+
+    std::atomic<bool> closed;
+
+    /**
+     * Guards the waits on changed.
+     */
+    std::mutex latch;
+
+    /**
+     * Signalled when a writer leaves a closing gate and when the gate opens.
+     */
+    std::condition_variable changed;
+  };
+
+  /**
+   * @brief Counts a writer through a WriterGate for as long as the guard lives.
+   */
+  class WriterGuard
+  {
+  public:
+    explicit WriterGuard(WriterGate &gate) : gate(gate), stripe(gate.enter())
+    {
+    }
+
+    ~WriterGuard()
+    {
+      gate.leave(stripe);
+    }
+
+  private:
+    WriterGuard(const WriterGuard &);
+    WriterGuard &operator=(const WriterGuard &);
+
+    WriterGate &gate;
+    const std::uint32_t stripe;
+  };
+
+}
@@ -0,0 +1,213 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb
+{
+
+  /**
+   * @brief Older images of the nodes of a tree, kept for the snapshots open on it.
+   *
+   * Time is counted in epochs. Opening a snapshot gives it the current epoch and starts the next one, so every
+   * change made after the snapshot was taken belongs to a later epoch than the snapshot. Before a node is changed
+   * for the first time in an epoch, its image is saved tagged with that epoch; the image is the node as every
+   * snapshot from the node's previous change on up to the epoch saw it. A snapshot reads a node as the oldest image
+   * tagged with a later epoch than its own, or as the node itself if there is none. Nothing is saved while no
+   * snapshot is open.
+   *
+   * Callers keep writers out while a snapshot is opened, so that no change is half in one epoch and half in the
+   * next, and save images under the latch of the node, before changing it.
+   */
+  class NodeVersionTable
+  {
+  public:
+    NodeVersionTable() : epoch(1), snapshots(0), images(0)
+    {
+    }
+
+    /**
+     * Opens a snapshot at the current epoch and starts the next one.
+     *
+     * @return  Epoch of the snapshot, to hand to read() and closeSnapshot().
+     */
+    std::uint64_t openSnapshot()
+    {
+      std::lock_guard<std::mutex> guard(latch);
+      const std::uint64_t snapshot = epoch++;
+      open.insert(snapshot);
+      snapshots = open.size();
+      return snapshot;
+    }
+
+    /**
+     * Closes a snapshot and drops the images no open snapshot reads any more.
+     *
+     * @param snapshot  Epoch openSnapshot() returned for it.
+     */
+    void closeSnapshot(const std::uint64_t snapshot)
+    {
+      std::lock_guard<std::mutex> guard(latch);
+      open.erase(open.find(snapshot));
+      snapshots = open.size();
+      if (open.empty())
+      {
+        versions.clear();
+        images = 0;
+        return;
+      }
+
+      // an image of an epoch not later than the oldest snapshot was replaced before any of them was taken
+      const std::uint64_t oldest = *open.begin();
+      std::map<PageId, std::vector<NodeImage> >::iterator it = versions.begin();
+      while (it != versions.end())
+      {
+        std::vector<NodeImage> &nodeImages = it->second;
+        std::size_t stale = 0;
+        while (stale < nodeImages.size() && nodeImages[stale].changed <= oldest)
+        {
+          stale++;
+        }
+        nodeImages.erase(nodeImages.begin(), nodeImages.begin() + stale);
+        images -= stale;
+        if (nodeImages.empty())
+        {
+          versions.erase(it++);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+    }
+
+    /**
+     * Saves the image of a node about to be changed, unless it was already saved in this epoch or no snapshot is
+     * open. The caller holds the node's latch for writing.
+     *
+     * @param pageNo  Page number of the node.
+     * @param page    The node as it is before the change.
+     */
+    void preserve(const PageId pageNo, const Page &page)
+    {
+      if (snapshots.load() == 0)
+      {
+        return;
+      }
+      std::lock_guard<std::mutex> guard(latch);
+      if (open.empty())
+      {
+        return;
+      }
+      std::vector<NodeImage> &nodeImages = versions[pageNo];
+      if (!nodeImages.empty() && nodeImages.back().changed == epoch)
+      {
+        return;
+      }
+      NodeImage image;
+      image.changed = epoch;
+      image.page.reset(new Page(page));
+      nodeImages.push_back(image);
+      images++;
+    }
+
+    /**
+     * Copies the node as a snapshot saw it, if it was changed since.
+     *
+     * @param pageNo    Page number of the node.
+     * @param snapshot  Epoch of the snapshot.
+     * @param page      The image is copied to it.
+     * @return  False if the node is as the snapshot saw it, and page was left alone.
+     */
+    bool read(const PageId pageNo, const std::uint64_t snapshot, Page &page) const
+    {
+      std::lock_guard<std::mutex> guard(latch);
+      std::map<PageId, std::vector<NodeImage> >::const_iterator it = versions.find(pageNo);
+      if (it == versions.end())
+      {
+        return false;
+      }
+      for (std::size_t i = 0; i < it->second.size(); i++)
+      {
+        if (it->second[i].changed > snapshot)
+        {
+          page = *it->second[i].page;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * Returns the number of node images kept.
+     */
+    std::uint64_t size() const
+    {
+      std::lock_guard<std::mutex> guard(latch);
+      return images;
+    }
+
+  private:
+    NodeVersionTable(const NodeVersionTable &);
+    NodeVersionTable &operator=(const NodeVersionTable &);
+
+    /**
+     * A node as it was before its first change in an epoch.
+     */
+    struct NodeImage
+    {
+      /**
+       * Epoch of the change.
+       */
+      std::uint64_t changed;
+
+      std::shared_ptr<const Page> page;
+    };
+
+    /**
+     * Guards everything below but snapshots.
+     */
+    mutable std::mutex latch;
+
+    /**
+     * Epoch changes are made in now.
+     */
+    std::uint64_t epoch;
+
+    /**
+     * Epochs of the open snapshots.
+     */
+    std::multiset<std::uint64_t> open;
+
+    /**
+     * Number of open snapshots, read without the latch so that writers skip it while there are none.
+     */
+    std::atomic<std::size_t> snapshots;
+
+    /**
+     * Saved images of each node, oldest first.
+     */
+    std::map<PageId, std::vector<NodeImage> > versions;
+
+    /**
+     * Number of images in versions.
+     */
+    std::uint64_t images;
+  };
+
+}
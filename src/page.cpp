@@ -29,6 +29,7 @@ void Page::initialize() {
   header_.num_free_slots = 0;
   header_.current_page_number = INVALID_NUMBER;
   header_.next_page_number = INVALID_NUMBER;
+  header_.checksum = 0;
   //data_.assign(DATA_SIZE, char());
 	memset(data_, '\0', DATA_SIZE);
 }
@@ -39,16 +40,39 @@ RecordId Page::insertRecord(const std::string& record_data) {
         page_number(), record_data.length(), getFreeSpace());
   }
   const SlotId slot_number = getAvailableSlot();
-  insertRecordInSlot(slot_number, record_data);
+  insertRecordInSlot(slot_number, record_data.data(), record_data.length());
   return {page_number(), slot_number};
 }
 
+std::size_t Page::insertRecords(const char* records,
+                                const std::size_t record_length,
+                                const std::size_t count,
+                                RecordId* record_ids) {
+  std::size_t inserted = 0;
+  while (inserted < count && hasSpaceForRecord(record_length)) {
+    const SlotId slot_number = getAvailableSlot();
+    insertRecordInSlot(slot_number, records + inserted * record_length,
+                       record_length);
+    if (record_ids != NULL) {
+      record_ids[inserted].page_number = page_number();
+      record_ids[inserted].slot_number = slot_number;
+    }
+    ++inserted;
+  }
+  return inserted;
+}
+
 std::string Page::getRecord(const RecordId& record_id) const {
   validateRecordId(record_id);
   const PageSlot& slot = getSlot(record_id.slot_number);
-	std::string retStr = std::string(data_, DATA_SIZE).substr(slot.item_offset, slot.item_length);
+	return std::string(data_ + slot.item_offset, slot.item_length);
+}
 
-	return retStr;
+RecordView Page::viewRecord(const RecordId& record_id) const {
+  validateRecordId(record_id);
+  const PageSlot& slot = getSlot(record_id.slot_number);
+  RecordView view = {data_ + slot.item_offset, slot.item_length};
+  return view;
 }
 
 void Page::updateRecord(const RecordId& record_id,
@@ -65,7 +89,8 @@ void Page::updateRecord(const RecordId& record_id,
   // record data in the same slot, and compaction might delete the slot if we
   // permit it.
   deleteRecord(record_id, false /* allow_slot_compaction */);
-  insertRecordInSlot(record_id.slot_number, record_data);
+  insertRecordInSlot(record_id.slot_number, record_data.data(),
+                     record_data.length());
 }
 
 void Page::deleteRecord(const RecordId& record_id) {
@@ -136,7 +161,11 @@ void Page::deleteRecord(const RecordId& record_id,
 }
 
 bool Page::hasSpaceForRecord(const std::string& record_data) const {
-  std::size_t record_size = record_data.length();
+  return hasSpaceForRecord(record_data.length());
+}
+
+bool Page::hasSpaceForRecord(const std::size_t record_length) const {
+  std::size_t record_size = record_length;
   if (header_.num_free_slots == 0) {
     record_size += sizeof(PageSlot);
   }
@@ -170,13 +199,20 @@ SlotId Page::getAvailableSlot() {
     ++header_.num_slots;
     ++header_.num_free_slots;
     header_.free_space_lower_bound = sizeof(PageSlot) * header_.num_slots;
+    // the slot's bytes were free space, which may still hold stale record
+    // data left behind when deleteRecord() compacted the page
+    PageSlot* slot = getSlot(slot_number);
+    slot->used = false;
+    slot->item_offset = 0;
+    slot->item_length = 0;
   }
   assert(slot_number != INVALID_SLOT);
   return slot_number;
 }
 
 void Page::insertRecordInSlot(const SlotId slot_number,
-                              const std::string& record_data) {
+                              const char* record_data,
+                              const std::size_t record_length) {
   if (slot_number > header_.num_slots ||
       slot_number == INVALID_SLOT) {
     throw InvalidSlotException(page_number(), slot_number);
@@ -185,17 +221,13 @@ void Page::insertRecordInSlot(const SlotId slot_number,
   if (slot->used) {
     throw SlotInUseException(page_number(), slot_number);
   }
-  const int record_length = record_data.length();
   slot->used = true;
   slot->item_length = record_length;
   slot->item_offset = header_.free_space_upper_bound - record_length;
   header_.free_space_upper_bound = slot->item_offset;
   --header_.num_free_slots;
 
-	for(int i = 0; i < slot->item_length; i++)
-		data_[i + slot->item_offset] = record_data[i];
-
-  //data_.replace(slot->item_offset, slot->item_length, record_data);
+	memcpy(&data_[slot->item_offset], record_data, record_length);
 }
 
 void Page::validateRecordId(const RecordId& record_id) const {
@@ -15,6 +15,14 @@
 //#include <gtest/gtest.h>
 #include "types.h"
 
+/**
+ * Page size in bytes, a power of two from 4096 to 65536.  The Makefile sets it
+ * from PAGE_SIZE; every object of a binary has to be built with the same one.
+ */
+#ifndef BADGERDB_PAGE_SIZE
+#define BADGERDB_PAGE_SIZE 8192
+#endif
+
 namespace badgerdb {
 
 /**
@@ -54,10 +62,19 @@ struct PageHeader {
   PageId current_page_number;
 
   /**
-   * Number of the next used page in the file.
+   * Number of the next page in a chain of pages. PageFile finds its used
+   * pages through its allocation map, and only chains free-space map pages
+   * this way.
    */
   PageId next_page_number;
 
+  /**
+   * CRC32C of the page as written, taken with this field set to 0. Zero if the
+   * page was written without one, as pages that are not in use are, since
+   * parts of them are updated in place.
+   */
+  std::uint32_t checksum;
+
   /**
    * Returns true if this page header is equal to the other.
    *
@@ -93,6 +110,29 @@ struct PageSlot {
   std::uint16_t item_length;
 };
 
+/**
+ * @brief Bytes of a record as they sit on a page, without copying them.
+ *
+ * Only valid as long as the page stays where it is (pinned, for a page in the buffer pool) and the record is not
+ * updated or deleted.
+ */
+struct RecordView {
+  /**
+   * First byte of the record.
+   */
+  const char* data;
+
+  /**
+   * Length of the record in bytes.
+   */
+  std::size_t length;
+
+  /**
+   * Returns a copy of the record.
+   */
+  std::string str() const { return std::string(data, length); }
+};
+
 class PageIterator;
 
 /**
@@ -108,10 +148,11 @@ class PageIterator;
 class Page {
  public:
   /**
-   * Page size in bytes.  If this is changed, database files created with a
-   * different page size value will be unreadable by the resulting binaries.
+   * Page size in bytes, set at build time with BADGERDB_PAGE_SIZE.  Files
+   * record the page size they were created with, and binaries built with a
+   * different one refuse to open them.
    */
-  static const std::size_t SIZE = 8192;
+  static const std::size_t SIZE = BADGERDB_PAGE_SIZE;
 
   /**
    * Size of page free space area in bytes.
@@ -141,6 +182,22 @@ class Page {
    */
   RecordId insertRecord(const std::string& record_data);
 
+  /**
+   * Inserts as many records of a packed array of fixed-length records as fit
+   * into the page, in order, stopping at the first one that does not fit.
+   *
+   * @param records        Bytes of the records, one after the other.
+   * @param record_length  Length of each record in bytes.
+   * @param count          Number of records in the array.
+   * @param record_ids     If not NULL, the IDs of the inserted records are
+   *                       stored here, in order.
+   * @return  Number of records inserted, from the start of the array.
+   */
+  std::size_t insertRecords(const char* records,
+                            const std::size_t record_length,
+                            const std::size_t count,
+                            RecordId* record_ids = NULL);
+
   /**
    * Returns the record with the given ID.  Returned data is a copy of what is
    * stored on the page; use updateRecord to change it.
@@ -151,6 +208,15 @@ class Page {
    */
   std::string getRecord(const RecordId& record_id) const;
 
+  /**
+   * Returns the record with the given ID in place on the page, without copying it.
+   *
+   * @see RecordView
+   * @param record_id  ID of the record to return.
+   * @return  View of the record's bytes.
+   */
+  RecordView viewRecord(const RecordId& record_id) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
@@ -302,7 +368,17 @@ class Page {
    * @throws  SlotInUseException  Thrown when given slot is in use.
    */
   void insertRecordInSlot(const SlotId slot_number,
-                          const std::string& record_data);
+                          const char* record_data,
+                          const std::size_t record_length);
+
+  /**
+   * Returns true if there is enough free space on the page for a record of
+   * the given length, counting the slot it may need.
+   *
+   * @param record_length  Length of the record in bytes.
+   * @return  True if the record would fit.
+   */
+  bool hasSpaceForRecord(const std::size_t record_length) const;
 
   /**
    * Throws an exception if the given record ID is not valid for this page
@@ -343,5 +419,11 @@ static_assert(Page::SIZE > sizeof(PageHeader),
               "Page size must be large enough to hold header and data.");
 static_assert(Page::DATA_SIZE > 0,
               "Page must have some space to hold data.");
+static_assert((Page::SIZE & (Page::SIZE - 1)) == 0,
+              "Page size must be a power of two.");
+static_assert(Page::SIZE >= 4096 && Page::SIZE <= 65536,
+              "Page size must be between 4 KB and 64 KB.");
+static_assert(Page::DATA_SIZE < 65536,
+              "Offsets within the page data must fit in 16 bits.");
 
 }
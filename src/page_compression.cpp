@@ -0,0 +1,211 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "page_compression.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace badgerdb {
+
+namespace {
+
+// Shortest match the format can express.
+const std::size_t MIN_MATCH = 4;
+// The last bytes of a block are always literals.
+const std::size_t LAST_LITERALS = 5;
+// The last match starts at least this many bytes before the end of the block.
+const std::size_t MATCH_LIMIT = 12;
+const int HASH_BITS = 12;
+
+std::uint32_t read32(const char* p) {
+  std::uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+std::uint32_t hashSequence(const std::uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Writes the bytes extending a length that did not fit in its 4 bits of the
+// token, 255 at a time.
+bool putLength(char*& out, const char* end, std::size_t length) {
+  while (length >= 255) {
+    if (out == end) {
+      return false;
+    }
+    *out++ = static_cast<char>(255);
+    length -= 255;
+  }
+  if (out == end) {
+    return false;
+  }
+  *out++ = static_cast<char>(length);
+  return true;
+}
+
+// Writes a run of literals followed by a match, or by nothing if matchLength
+// is 0, which ends the block.
+bool putSequence(char*& out, const char* end, const char* literals,
+                 const std::size_t literalLength, const std::size_t offset,
+                 const std::size_t matchLength) {
+  if (out == end) {
+    return false;
+  }
+  const std::size_t matchCode = matchLength > 0 ? matchLength - MIN_MATCH : 0;
+  char* token = out++;
+  *token = static_cast<char>(((literalLength < 15 ? literalLength : 15) << 4) |
+                             (matchCode < 15 ? matchCode : 15));
+  if (literalLength >= 15 && !putLength(out, end, literalLength - 15)) {
+    return false;
+  }
+  if (static_cast<std::size_t>(end - out) < literalLength) {
+    return false;
+  }
+  std::memcpy(out, literals, literalLength);
+  out += literalLength;
+  if (matchLength == 0) {
+    return true;
+  }
+
+  if (end - out < 2) {
+    return false;
+  }
+  *out++ = static_cast<char>(offset & 0xFF);
+  *out++ = static_cast<char>(offset >> 8);
+  return matchCode < 15 || putLength(out, end, matchCode - 15);
+}
+
+// Reads the bytes extending a length of 15 in the token.
+bool getLength(const unsigned char*& in, const unsigned char* end,
+               std::size_t& length) {
+  unsigned char byte;
+  do {
+    if (in == end) {
+      return false;
+    }
+    byte = *in++;
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+}
+
+std::size_t compressBlock(const char* source, const std::size_t length,
+                          char* dest, const std::size_t capacity) {
+  if (length > MAX_COMPRESSED_BLOCK) {
+    return 0;
+  }
+  char* out = dest;
+  const char* end = dest + capacity;
+  std::size_t anchor = 0;
+
+  if (length > MATCH_LIMIT) {
+    // positions fit in 16 bits since blocks are at most 64K; 0 until set,
+    // which only ever matches where a real match is checked
+    std::uint16_t table[1 << HASH_BITS];
+    std::memset(table, 0, sizeof(table));
+    const std::size_t matchEnd = length - LAST_LITERALS;
+    const std::size_t lastStart = length - MATCH_LIMIT;
+    std::size_t pos = 0;
+    std::size_t misses = 0;
+    while (pos <= lastStart) {
+      const std::uint32_t sequence = read32(source + pos);
+      const std::uint32_t hash = hashSequence(sequence);
+      std::size_t ref = table[hash];
+      table[hash] = static_cast<std::uint16_t>(pos);
+      if (ref >= pos || read32(source + ref) != sequence) {
+        // step faster through bytes that do not compress
+        pos += 1 + (misses++ >> 5);
+        continue;
+      }
+      misses = 0;
+
+      while (pos > anchor && ref > 0 && source[pos - 1] == source[ref - 1]) {
+        pos--;
+        ref--;
+      }
+      std::size_t matchLength = MIN_MATCH;
+      while (pos + matchLength < matchEnd &&
+             source[pos + matchLength] == source[ref + matchLength]) {
+        matchLength++;
+      }
+      if (!putSequence(out, end, source + anchor, pos - anchor, pos - ref,
+                       matchLength)) {
+        return 0;
+      }
+      pos += matchLength;
+      anchor = pos;
+      if (pos <= lastStart) {
+        table[hashSequence(read32(source + pos - 2))] =
+            static_cast<std::uint16_t>(pos - 2);
+      }
+    }
+  }
+
+  if (!putSequence(out, end, source + anchor, length - anchor, 0, 0)) {
+    return 0;
+  }
+  return out - dest;
+}
+
+bool decompressBlock(const char* source, const std::size_t length, char* dest,
+                     const std::size_t destLength) {
+  const unsigned char* in = reinterpret_cast<const unsigned char*>(source);
+  const unsigned char* inEnd = in + length;
+  char* out = dest;
+  char* outEnd = dest + destLength;
+
+  while (in < inEnd) {
+    const unsigned char token = *in++;
+    std::size_t literalLength = token >> 4;
+    if (literalLength == 15 && !getLength(in, inEnd, literalLength)) {
+      return false;
+    }
+    if (literalLength > static_cast<std::size_t>(inEnd - in) ||
+        literalLength > static_cast<std::size_t>(outEnd - out)) {
+      return false;
+    }
+    std::memcpy(out, in, literalLength);
+    in += literalLength;
+    out += literalLength;
+    if (in == inEnd) {
+      // the last sequence has no match
+      return out == outEnd;
+    }
+
+    if (inEnd - in < 2) {
+      return false;
+    }
+    const std::size_t offset = in[0] | (in[1] << 8);
+    in += 2;
+    std::size_t matchLength = token & 15;
+    if (matchLength == 15 && !getLength(in, inEnd, matchLength)) {
+      return false;
+    }
+    matchLength += MIN_MATCH;
+    if (offset == 0 || offset > static_cast<std::size_t>(out - dest) ||
+        matchLength > static_cast<std::size_t>(outEnd - out)) {
+      return false;
+    }
+    const char* match = out - offset;
+    if (offset >= matchLength) {
+      std::memcpy(out, match, matchLength);
+      out += matchLength;
+    } else {
+      // the match overlaps the bytes it produces, repeating them
+      for (std::size_t i = 0; i < matchLength; i++) {
+        *out++ = *match++;
+      }
+    }
+  }
+  return false;
+}
+
+}
@@ -0,0 +1,49 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace badgerdb {
+
+/**
+ * Largest number of bytes compressBlock() compresses at once.
+ */
+const std::size_t MAX_COMPRESSED_BLOCK = 65536;
+
+/**
+ * Compresses the given bytes in the LZ4 block format: a sequence of literal
+ * runs, each followed by a match copying at least 4 bytes from up to 65535
+ * bytes back. Matches are found through a hash table of the 4-byte sequences
+ * seen so far, which favors speed over the best ratio; any LZ4 decoder
+ * decompresses the result.
+ *
+ * @param source    Bytes to compress.
+ * @param length    Number of bytes, at most MAX_COMPRESSED_BLOCK.
+ * @param dest      The compressed bytes are written here.
+ * @param capacity  Room at dest.
+ * @return  Number of compressed bytes, or 0 if they do not fit in capacity.
+ */
+std::size_t compressBlock(const char* source, const std::size_t length,
+                          char* dest, const std::size_t capacity);
+
+/**
+ * Decompresses bytes in the LZ4 block format, checking every length and
+ * offset against the bounds of the input and the output.
+ *
+ * @param source      Compressed bytes.
+ * @param length      Number of compressed bytes.
+ * @param dest        The decompressed bytes are written here.
+ * @param destLength  Number of bytes they must decompress to.
+ * @return  False if the input is malformed or does not decompress to exactly
+ *          destLength bytes.
+ */
+bool decompressBlock(const char* source, const std::size_t length, char* dest,
+                     const std::size_t destLength);
+
+}
@@ -101,6 +101,15 @@ class PageIterator {
 		return page_->getRecord(current_record_); 
 	}
 
+  /**
+   * Returns the current record in place on the page, without copying it.
+   *
+   * @return  View of the record, valid while the page stays pinned.
+   */
+	inline RecordView view() const {
+		return page_->viewRecord(current_record_);
+	}
+
   /**
    * Returns the next used slot in the page after the given slot or
    * Page::INVALID_SLOT if no slots are used after the given slot.
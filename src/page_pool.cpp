@@ -0,0 +1,206 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "page_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include <linux/mempolicy.h>
+#include <linux/mman.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace badgerdb {
+
+namespace {
+
+const std::size_t HUGE_PAGE_2MB = std::size_t(1) << 21;
+const std::size_t HUGE_PAGE_1GB = std::size_t(1) << 30;
+
+/**
+ * Highest NUMA node number mbind() is handed a mask for.
+ */
+const int MAX_NUMA_NODE = 63;
+
+/**
+ * Returns the NUMA nodes that are online, at least node 0.
+ */
+std::vector<int> onlineNodes() {
+  // the list looks like "0-3" or "0,2-3"
+  std::vector<int> nodes;
+  std::ifstream list("/sys/devices/system/node/online");
+  std::string ranges;
+  if (list >> ranges) {
+    std::size_t pos = 0;
+    while (pos < ranges.size()) {
+      std::size_t end = ranges.find(',', pos);
+      if (end == std::string::npos) {
+        end = ranges.size();
+      }
+      const std::string range = ranges.substr(pos, end - pos);
+      const std::size_t dash = range.find('-');
+      const int first = std::atoi(range.c_str());
+      const int last = (dash == std::string::npos)
+                           ? first
+                           : std::atoi(range.c_str() + dash + 1);
+      for (int node = first; node <= last && node <= MAX_NUMA_NODE; node++) {
+        nodes.push_back(node);
+      }
+      pos = end + 1;
+    }
+  }
+  if (nodes.empty()) {
+    nodes.push_back(0);
+  }
+  return nodes;
+}
+
+/**
+ * Sets the NUMA policy of a range of the mapping. Failures are ignored, the
+ * placement is only a hint.
+ */
+void bindRange(void* address, const std::size_t length, const int mode,
+               const std::vector<int>& nodes) {
+  unsigned long mask = 0;
+  for (std::size_t i = 0; i < nodes.size(); i++) {
+    mask |= 1UL << nodes[i];
+  }
+  syscall(SYS_mbind, address, length, mode, &mask, MAX_NUMA_NODE + 2, 0);
+}
+
+}
+
+PagePool::PagePool(const std::uint32_t frames, const PoolOptions& options)
+    : capacity_(std::max(frames, options.maxFrames)),
+      pageSize_(sysconf(_SC_PAGESIZE)),
+      pages_(NULL),
+      mappedLength_(0),
+      hugePages_(NO_HUGE_PAGES),
+      framesPerNode_(0) {
+  if (options.hugePages == NO_HUGE_PAGES && options.numa == NUMA_DEFAULT &&
+      capacity_ == frames) {
+    pages_ = new Page[frames];
+    return;
+  }
+
+  // room for frames the pool may grow to is only backed once it is touched
+  const int reserve = (capacity_ > frames) ? MAP_NORESERVE : 0;
+  std::size_t alignment = pageSize_;
+  const std::size_t length = std::max<std::size_t>(1, capacity_) * sizeof(Page);
+  void* memory = MAP_FAILED;
+  if (options.hugePages == HUGE_PAGES_2MB ||
+      options.hugePages == HUGE_PAGES_1GB) {
+    const bool gigantic = options.hugePages == HUGE_PAGES_1GB;
+    const std::size_t hugeSize = gigantic ? HUGE_PAGE_1GB : HUGE_PAGE_2MB;
+    mappedLength_ = (length + hugeSize - 1) / hugeSize * hugeSize;
+    // always reserved: without reserved pages to back it, a hugetlb mapping
+    // made with MAP_NORESERVE succeeds, and faults with SIGBUS when touched
+    memory = mmap(NULL, mappedLength_, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                      (gigantic ? MAP_HUGE_1GB : MAP_HUGE_2MB),
+                  -1, 0);
+    if (memory != MAP_FAILED) {
+      hugePages_ = options.hugePages;
+      alignment = hugeSize;
+    }
+  }
+  if (memory == MAP_FAILED) {
+    // no hugetlb pages reserved, or none asked for
+    mappedLength_ = (length + alignment - 1) / alignment * alignment;
+    memory = mmap(NULL, mappedLength_, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | reserve, -1, 0);
+    if (memory == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    if (options.hugePages != NO_HUGE_PAGES &&
+        madvise(memory, mappedLength_, MADV_HUGEPAGE) == 0) {
+      hugePages_ = TRANSPARENT_HUGE_PAGES;
+    }
+  }
+  pages_ = static_cast<Page*>(memory);
+  pageSize_ = alignment;
+
+  // the policy only applies to pages not touched yet, so bind before
+  // constructing the frames
+  place(options.numa, alignment);
+  commit(0, frames);
+}
+
+void PagePool::commit(const FrameId first, const std::uint32_t count) {
+  for (std::uint32_t i = 0; i < count; i++) {
+    new (&pages_[first + i]) Page();
+  }
+}
+
+void PagePool::release(const FrameId first, const std::uint32_t count) {
+  if (mappedLength_ == 0) {
+    return;
+  }
+  // only pages of the mapping that lie entirely within the frames
+  const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(pages_);
+  const std::uintptr_t start = base + std::size_t(first) * sizeof(Page);
+  const std::uintptr_t end = start + std::size_t(count) * sizeof(Page);
+  const std::uintptr_t alignedStart =
+      (start - base + pageSize_ - 1) / pageSize_ * pageSize_ + base;
+  const std::uintptr_t alignedEnd = (end - base) / pageSize_ * pageSize_ + base;
+  if (alignedStart < alignedEnd) {
+    madvise(reinterpret_cast<void*>(alignedStart), alignedEnd - alignedStart,
+            MADV_DONTNEED);
+  }
+}
+
+PagePool::~PagePool() {
+  if (mappedLength_ == 0) {
+    delete[] pages_;
+  } else {
+    munmap(pages_, mappedLength_);
+  }
+}
+
+void PagePool::place(const NumaPlacement numa, const std::size_t alignment) {
+  if (numa == NUMA_DEFAULT) {
+    return;
+  }
+  const std::vector<int> online = onlineNodes();
+  if (numa == NUMA_INTERLEAVE) {
+    bindRange(pages_, mappedLength_, MPOL_INTERLEAVE, online);
+    return;
+  }
+
+  // blocks start on a page boundary (a huge page boundary for a hugetlb pool)
+  // so each can be bound on its own
+  const std::uint32_t framesPerPage =
+      std::max<std::size_t>(1, alignment / sizeof(Page));
+  const std::uint32_t share = (capacity_ + online.size() - 1) / online.size();
+  framesPerNode_ = std::max<std::uint32_t>(
+      framesPerPage, (share + framesPerPage - 1) / framesPerPage * framesPerPage);
+  nodes_ = online;
+  for (std::size_t i = 0; i < nodes_.size(); i++) {
+    const std::size_t start = std::size_t(i) * framesPerNode_ * sizeof(Page);
+    if (start >= mappedLength_) {
+      break;
+    }
+    const std::size_t end = std::min(
+        mappedLength_, start + std::size_t(framesPerNode_) * sizeof(Page));
+    bindRange(reinterpret_cast<char*>(pages_) + start, end - start, MPOL_BIND,
+              std::vector<int>(1, nodes_[i]));
+  }
+}
+
+int PagePool::nodeOf(const FrameId frame) const {
+  if (nodes_.empty()) {
+    return -1;
+  }
+  return nodes_[std::min<std::size_t>(frame / framesPerNode_,
+                                      nodes_.size() - 1)];
+}
+
+}
@@ -0,0 +1,205 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Pages the memory of a PagePool is backed with.
+ */
+enum HugePageMode {
+  /**
+   * Regular pages of the system.
+   */
+  NO_HUGE_PAGES,
+
+  /**
+   * Regular pages the kernel is asked to merge into transparent huge pages
+   * (madvise MADV_HUGEPAGE).
+   */
+  TRANSPARENT_HUGE_PAGES,
+
+  /**
+   * 2 MB pages from the hugetlb pool, which the administrator has to reserve.
+   */
+  HUGE_PAGES_2MB,
+
+  /**
+   * 1 GB pages from the hugetlb pool, which the administrator has to reserve.
+   */
+  HUGE_PAGES_1GB
+};
+
+/**
+ * @brief How the frames of a PagePool are spread over the NUMA nodes.
+ */
+enum NumaPlacement {
+  /**
+   * Wherever the kernel puts them, usually the node of the thread that
+   * touches a frame first.
+   */
+  NUMA_DEFAULT,
+
+  /**
+   * Interleaved page by page over all nodes, so every node sees the same
+   * share of remote accesses.
+   */
+  NUMA_INTERLEAVE,
+
+  /**
+   * Split into one contiguous block of frames per node; see
+   * PagePool::nodeOf().
+   */
+  NUMA_PARTITION
+};
+
+/**
+ * @brief How BufMgr allocates its pool of frames.
+ */
+struct PoolOptions {
+  /**
+   * Pages to back the pool with.
+   */
+  HugePageMode hugePages;
+
+  /**
+   * Spread of the frames over the NUMA nodes.
+   */
+  NumaPlacement numa;
+
+  /**
+   * Number of frames BufMgr::resize() may grow the pool to. Address space for
+   * them is set aside up front, but memory is only taken for the frames in
+   * use, except on hugetlb pages, which are reserved for all of them. 0, or a
+   * number below the initial size, keeps the pool from growing.
+   */
+  std::uint32_t maxFrames;
+
+  PoolOptions() : hugePages(NO_HUGE_PAGES), numa(NUMA_DEFAULT), maxFrames(0) {}
+};
+
+/**
+ * @brief Memory holding the frames of a buffer pool.
+ *
+ * With the default options the frames are allocated with new like any other
+ * array. Otherwise they are mapped anonymously with mmap, on hugetlb pages if
+ * asked to, and bound to NUMA nodes with mbind before they are first touched.
+ * A pool that may grow maps room for all the frames it may grow to and only
+ * constructs, and so touches, the ones in use; frames it shrinks away are
+ * given back to the system.
+ * Huge pages cut the TLB misses of a large pool. Both are best effort: without
+ * reserved hugetlb pages the pool falls back to transparent huge pages, and a
+ * system that refuses the NUMA policy, or has a single node, just ignores it.
+ */
+class PagePool {
+ public:
+  /**
+   * Allocates the frames.
+   *
+   * @param frames    Number of frames in use at first.
+   * @param options   How to allocate them.
+   * @throws  std::bad_alloc  If there is not enough memory.
+   */
+  PagePool(const std::uint32_t frames, const PoolOptions& options);
+
+  ~PagePool();
+
+  /**
+   * Returns the first of the frames.
+   */
+  Page* pages() const { return pages_; }
+
+  /**
+   * Returns the number of frames the pool has room for.
+   */
+  std::uint32_t capacity() const { return capacity_; }
+
+  /**
+   * Constructs frames that were not in use, as empty pages.
+   *
+   * @param first   First frame.
+   * @param count   Number of frames, up to capacity().
+   */
+  void commit(const FrameId first, const std::uint32_t count);
+
+  /**
+   * Gives the memory of frames that are no longer in use back to the system,
+   * as far as they cover whole pages of it.
+   *
+   * @param first   First frame.
+   * @param count   Number of frames.
+   */
+  void release(const FrameId first, const std::uint32_t count);
+
+  /**
+   * Returns the pages the pool actually got, which may be smaller than the
+   * ones it was asked for.
+   */
+  HugePageMode hugePages() const { return hugePages_; }
+
+  /**
+   * Returns the NUMA node a frame was placed on with NUMA_PARTITION, or -1 if
+   * the frames were not partitioned.
+   *
+   * @param frame   Frame number.
+   */
+  int nodeOf(const FrameId frame) const;
+
+ private:
+  PagePool(const PagePool&);
+  PagePool& operator=(const PagePool&);
+
+  /**
+   * Binds the mapping to the NUMA nodes as the options ask.
+   */
+  void place(const NumaPlacement numa, const std::size_t alignment);
+
+  /**
+   * Number of frames the pool has room for.
+   */
+  std::uint32_t capacity_;
+
+  /**
+   * Size of the pages the mapping is made of.
+   */
+  std::size_t pageSize_;
+
+  /**
+   * First frame.
+   */
+  Page* pages_;
+
+  /**
+   * Length of the mapping in bytes, 0 if the frames were allocated with new.
+   */
+  std::size_t mappedLength_;
+
+  /**
+   * Pages the pool got.
+   */
+  HugePageMode hugePages_;
+
+  /**
+   * NUMA nodes the frames were partitioned over, empty if they were not.
+   */
+  std::vector<int> nodes_;
+
+  /**
+   * Number of frames of each block of a partitioned pool.
+   */
+  std::uint32_t framesPerNode_;
+};
+
+}
@@ -0,0 +1,736 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "partitioned_index.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "external_sort.h"
+#include "filescan.h"
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_scanrange_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/scan_not_initialized_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/io_error_exception.h"
+
+namespace badgerdb
+{
+
+	// -----------------------------------------------------------------------------
+	// Sorted entry sources
+	// -----------------------------------------------------------------------------
+
+	/**
+	 * Entries of the sorted stream of an ExternalSort, cut into the ranges of the partitions: a range ends once it
+	 * holds its share of the entries and the key changes, so two equal keys never end up in different ranges.
+	 * next() returns the entries of the current range, nextPartition() moves on to the next one.
+	 */
+	template <class T>
+	class SortedCut : public SortedEntrySource
+	{
+	public:
+		SortedCut(ExternalSort<RIDKeyPair<T> > *sorter, const std::size_t total, const std::size_t wanted)
+			: sorter(sorter), total(total), wanted(wanted), partition(0), start(0), position(0), atCut(false),
+			  lastKey()
+		{
+			pending = sorter->next(head);
+			target = targetOf(0);
+		}
+
+		bool next(void *outKey, RecordId &outRid)
+		{
+			if (!pending || atCut)
+			{
+				return false;
+			}
+			if (position >= target && lastKey < head.key)
+			{
+				atCut = true;
+				return false;
+			}
+			if (outKey != NULL)
+			{
+				memcpy(outKey, &head.key, sizeof(T));
+			}
+			outRid = head.rid;
+			lastKey = head.key;
+			position++;
+			pending = sorter->next(head);
+			return true;
+		}
+
+		/**
+		 * Moves on to the next range once the current one ended at a cut. Returns false if the stream ended
+		 * instead.
+		 */
+		bool nextPartition()
+		{
+			if (!atCut)
+			{
+				return false;
+			}
+			atCut = false;
+			partition++;
+			start = position;
+			target = targetOf(partition);
+			return true;
+		}
+
+		/**
+		 * Lower bound of the range nextPartition() moved on to: the key of its first entry.
+		 */
+		const T &bound() const
+		{
+			return head.key;
+		}
+
+	private:
+		/**
+		 * Position in the stream from which the given range may end, past the end of the stream for the last one.
+		 */
+		std::size_t targetOf(const std::size_t k) const
+		{
+			if (k + 1 >= wanted)
+			{
+				return total + 1;
+			}
+			return std::max(start + 1, total * (k + 1) / wanted);
+		}
+
+		ExternalSort<RIDKeyPair<T> > *sorter;
+		const std::size_t total;
+		const std::size_t wanted;
+		std::size_t partition;
+		std::size_t start;
+		std::size_t target;
+		std::size_t position;
+		bool atCut;
+		bool pending;
+		RIDKeyPair<T> head;
+		T lastKey;
+	};
+
+	/**
+	 * Entries of an ExternalSort, in order.
+	 */
+	template <class T>
+	class SorterEntries : public SortedEntrySource
+	{
+	public:
+		SorterEntries(ExternalSort<RIDKeyPair<T> > *sorter) : sorter(sorter)
+		{
+		}
+
+		bool next(void *outKey, RecordId &outRid)
+		{
+			RIDKeyPair<T> pair;
+			if (!sorter->next(pair))
+			{
+				return false;
+			}
+			if (outKey != NULL)
+			{
+				memcpy(outKey, &pair.key, sizeof(T));
+			}
+			outRid = pair.rid;
+			return true;
+		}
+
+	private:
+		ExternalSort<RIDKeyPair<T> > *sorter;
+	};
+
+	/**
+	 * Stands in for the entries of a partition that already exists, which BTreeIndex opens without reading its
+	 * source.
+	 */
+	class NoPartitionEntries : public SortedEntrySource
+	{
+	public:
+		bool next(void *outKey, RecordId &outRid)
+		{
+			return false;
+		}
+	};
+
+	/**
+	 * Wait for the threads working on the partitions and rethrow the first exception one of them stored.
+	 */
+	static void joinPartitionThreads(std::vector<std::thread> &workers, const std::vector<std::exception_ptr> &errors)
+	{
+		for (std::size_t k = 0; k < workers.size(); k++)
+		{
+			workers[k].join();
+		}
+		for (std::size_t k = 0; k < errors.size(); k++)
+		{
+			if (errors[k])
+			{
+				std::rethrow_exception(errors[k]);
+			}
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// PartitionedIndex::PartitionedIndex -- Constructor
+	// -----------------------------------------------------------------------------
+
+	PartitionedIndex::PartitionedIndex(const std::string &relationName,
+									   std::string &outIndexName,
+									   BufMgr *bufMgrIn,
+									   const int attrByteOffset,
+									   const Datatype attrType,
+									   const PartitionOptions &options)
+		: bufMgr(bufMgrIn), relationName(relationName), attributeType(attrType), attrByteOffset(attrByteOffset),
+		  options(options), scanPartition(0), scanLastPartition(0), scanExecuting(false), scanLowOp(GTE),
+		  scanHighOp(LTE)
+	{
+		if (attrType != INTEGER && attrType != DOUBLE && attrType != STRING)
+		{
+			throw BadIndexInfoException("A partitioned index takes INTEGER, DOUBLE or STRING keys");
+		}
+
+		std::ostringstream idxStr;
+		idxStr << relationName << '.' << attrByteOffset << ".part";
+		outIndexName = idxStr.str();
+		indexName = outIndexName;
+
+		if (File::exists(indexName))
+		{
+			readManifest();
+			return;
+		}
+		if (attributeType == INTEGER)
+		{
+			build<int>();
+		}
+		else if (attributeType == DOUBLE)
+		{
+			build<double>();
+		}
+		else
+		{
+			build<StringKey>();
+		}
+		// only once every partition is complete, so a build cut short leaves no manifest to open
+		writeManifest();
+	}
+
+	template <class T>
+	void PartitionedIndex::build()
+	{
+		// the pairs spill to sorted runs on disk once they outgrow memory; the partitions are cut from the merged
+		// stream as it comes out
+		const std::size_t runSize = options.indexOptions.sortRunSize;
+		ExternalSort<RIDKeyPair<T> > sorter(bufMgr, indexName + ".sort", runSize);
+		std::size_t total = 0;
+		{
+			FileScan scanner(relationName, bufMgr);
+			RecordId rid;
+			while (true)
+			{
+				try
+				{
+					scanner.scanNext(rid);
+				}
+				catch (EndOfFileException &e)
+				{
+					break;
+				}
+				RIDKeyPair<T> pair;
+				pair.set(rid, loadKey<T>(scanner.viewRecord().data + attrByteOffset));
+				sorter.add(pair);
+				total++;
+			}
+		}
+		sorter.finish();
+
+		const std::size_t wanted = std::max<std::size_t>(1, options.partitions);
+		SortedCut<T> cut(&sorter, total, wanted);
+		if (!options.parallel)
+		{
+			// every partition is bulk loaded straight from the stream before the next one is cut
+			while (true)
+			{
+				std::exception_ptr error;
+				buildPartition(addPartition(), &cut, &error);
+				if (error)
+				{
+					std::rethrow_exception(error);
+				}
+				if (!cut.nextPartition())
+				{
+					return;
+				}
+				const char *bound = reinterpret_cast<const char *>(&cut.bound());
+				bounds.insert(bounds.end(), bound, bound + sizeof(T));
+			}
+		}
+
+		// the stream can only be read in order, so the ranges are spooled into sorters of their own, next to their
+		// partitions, to be bulk loaded side by side
+		std::vector<std::unique_ptr<ExternalSort<RIDKeyPair<T> > > > spools;
+		while (true)
+		{
+			const std::size_t k = addPartition();
+			spools.push_back(std::unique_ptr<ExternalSort<RIDKeyPair<T> > >(
+				new ExternalSort<RIDKeyPair<T> >(bufMgr, names[k] + ".sort", std::max<std::size_t>(1, runSize / wanted))));
+			RIDKeyPair<T> pair;
+			while (cut.next(&pair.key, pair.rid))
+			{
+				spools[k]->add(pair);
+			}
+			spools[k]->finish();
+			if (!cut.nextPartition())
+			{
+				break;
+			}
+			const char *bound = reinterpret_cast<const char *>(&cut.bound());
+			bounds.insert(bounds.end(), bound, bound + sizeof(T));
+		}
+
+		const std::size_t count = spools.size();
+		std::vector<std::unique_ptr<SorterEntries<T> > > sources;
+		for (std::size_t k = 0; k < count; k++)
+		{
+			sources.push_back(std::unique_ptr<SorterEntries<T> >(new SorterEntries<T>(spools[k].get())));
+		}
+		std::vector<std::exception_ptr> errors(count);
+		std::vector<std::thread> workers;
+		for (std::size_t k = 1; k < count; k++)
+		{
+			workers.push_back(std::thread(&PartitionedIndex::buildPartition, this, k, sources[k].get(), &errors[k]));
+		}
+		buildPartition(0, sources[0].get(), &errors[0]);
+		joinPartitionThreads(workers, errors);
+	}
+
+	std::size_t PartitionedIndex::addPartition()
+	{
+		const std::size_t k = names.size();
+		names.push_back(partitionName(k));
+		// a file of that name can only be left over from a build cut short, BTreeIndex would open it
+		if (File::exists(names[k]))
+		{
+			File::remove(names[k]);
+		}
+		partitions.resize(k + 1);
+		return k;
+	}
+
+	void PartitionedIndex::buildPartition(const std::size_t k, SortedEntrySource *source, std::exception_ptr *error)
+	{
+		try
+		{
+			partitions[k].reset(new BTreeIndex(relationName, names[k], bufMgr, attrByteOffset, attributeType, *source,
+											   options.indexOptions));
+		}
+		catch (...)
+		{
+			*error = std::current_exception();
+		}
+	}
+
+	std::string PartitionedIndex::partitionName(const std::size_t k) const
+	{
+		std::ostringstream name;
+		if (!options.directories.empty())
+		{
+			const std::string &directory = options.directories[k % options.directories.size()];
+			name << directory;
+			if (!directory.empty() && directory[directory.size() - 1] != '/')
+			{
+				name << '/';
+			}
+		}
+		name << indexName << '.' << k;
+		return name.str();
+	}
+
+	// -----------------------------------------------------------------------------
+	// PartitionedIndex::~PartitionedIndex -- destructor
+	// -----------------------------------------------------------------------------
+
+	PartitionedIndex::~PartitionedIndex()
+	{
+		scanCursor.reset();
+		partitions.clear();
+	}
+
+	// -----------------------------------------------------------------------------
+	// PartitionedIndex manifest
+	// -----------------------------------------------------------------------------
+	// The manifest holds the number of partitions on its first line, then the name of the file of each partition,
+	// in key order, one partition per line. The name of every partition but the first is followed by its lower
+	// bound, the bytes of the key in hex.
+
+	void PartitionedIndex::readManifest()
+	{
+		std::ifstream in(indexName.c_str());
+		std::size_t count = 0;
+		in >> count;
+		std::string line;
+		std::getline(in, line);
+		for (std::size_t k = 0; k < count && std::getline(in, line); k++)
+		{
+			std::istringstream fields(line);
+			std::string name;
+			std::string bound;
+			fields >> name >> bound;
+			if (k > 0)
+			{
+				if (bound.size() != 2 * keySize())
+				{
+					throw BadIndexInfoException("Malformed partition manifest " + indexName);
+				}
+				for (std::size_t i = 0; i < bound.size(); i += 2)
+				{
+					bounds.push_back((char)strtol(bound.substr(i, 2).c_str(), NULL, 16));
+				}
+			}
+			names.push_back(name);
+			NoPartitionEntries none;
+			partitions.push_back(std::unique_ptr<BTreeIndex>(
+				new BTreeIndex(relationName, name, bufMgr, attrByteOffset, attributeType, none, options.indexOptions)));
+		}
+		if (partitions.empty() || partitions.size() != count)
+		{
+			throw BadIndexInfoException("Malformed partition manifest " + indexName);
+		}
+	}
+
+	void PartitionedIndex::writeManifest()
+	{
+		// write a new manifest next to the old one and move it over, so a crash leaves one or the other
+		const std::string tmpName = indexName + ".tmp";
+		{
+			std::ofstream out(tmpName.c_str(), std::ios::out | std::ios::trunc);
+			out << names.size() << '\n';
+			for (std::size_t k = 0; k < names.size(); k++)
+			{
+				out << names[k];
+				if (k > 0)
+				{
+					out << ' ';
+					const char *bound = &bounds[(k - 1) * keySize()];
+					for (std::size_t i = 0; i < keySize(); i++)
+					{
+						static const char digits[] = "0123456789abcdef";
+						out << digits[(unsigned char)bound[i] >> 4] << digits[(unsigned char)bound[i] & 15];
+					}
+				}
+				out << '\n';
+			}
+			out.close();
+			if (out.fail())
+			{
+				throw IoErrorException("write", errno);
+			}
+		}
+		if (std::rename(tmpName.c_str(), indexName.c_str()) != 0)
+		{
+			throw IoErrorException("rename", errno);
+		}
+	}
+
+	void PartitionedIndex::remove(const std::string &indexName)
+	{
+		if (!File::exists(indexName))
+		{
+			throw FileNotFoundException(indexName);
+		}
+		std::ifstream in(indexName.c_str());
+		std::size_t count = 0;
+		in >> count;
+		std::string line;
+		std::getline(in, line);
+		for (std::size_t k = 0; k < count && std::getline(in, line); k++)
+		{
+			std::istringstream fields(line);
+			std::string name;
+			fields >> name;
+			if (File::exists(name))
+			{
+				File::remove(name);
+			}
+		}
+		in.close();
+		std::remove(indexName.c_str());
+	}
+
+	// -----------------------------------------------------------------------------
+	// PartitionedIndex routing
+	// -----------------------------------------------------------------------------
+
+	std::size_t PartitionedIndex::keySize() const
+	{
+		if (attributeType == INTEGER)
+		{
+			return sizeof(int);
+		}
+		else if (attributeType == DOUBLE)
+		{
+			return sizeof(double);
+		}
+		return sizeof(StringKey);
+	}
+
+	template <class T>
+	std::size_t PartitionedIndex::findPartition(const T &key) const
+	{
+		// the number of lower bounds not larger than the key
+		std::size_t lo = 0;
+		std::size_t hi = bounds.size() / sizeof(T);
+		while (lo < hi)
+		{
+			const std::size_t mid = lo + (hi - lo) / 2;
+			if (key < loadKey<T>(&bounds[mid * sizeof(T)]))
+			{
+				hi = mid;
+			}
+			else
+			{
+				lo = mid + 1;
+			}
+		}
+		return lo;
+	}
+
+	std::size_t PartitionedIndex::partitionOf(const void *key) const
+	{
+		if (attributeType == INTEGER)
+		{
+			return findPartition<int>(loadKey<int>(key));
+		}
+		else if (attributeType == DOUBLE)
+		{
+			return findPartition<double>(loadKey<double>(key));
+		}
+		return findPartition<StringKey>(loadKey<StringKey>(key));
+	}
+
+	void PartitionedIndex::insertEntry(const void *key, const RecordId rid)
+	{
+		partitions[partitionOf(key)]->insertEntry(key, rid);
+	}
+
+	bool PartitionedIndex::deleteEntry(const void *key, const RecordId rid)
+	{
+		return partitions[partitionOf(key)]->deleteEntry(key, rid);
+	}
+
+	std::size_t PartitionedIndex::lookup(const void *key, RecordId *outRids, const std::size_t maxRids)
+	{
+		counters.lookups.fetch_add(1, std::memory_order_relaxed);
+		return partitions[partitionOf(key)]->lookup(key, outRids, maxRids);
+	}
+
+	// -----------------------------------------------------------------------------
+	// PartitionedIndex::compact
+	// -----------------------------------------------------------------------------
+
+	void PartitionedIndex::compact(const double fillFactor)
+	{
+		std::vector<std::exception_ptr> errors(partitions.size());
+		std::vector<std::thread> workers;
+		for (std::size_t k = 1; k < partitions.size() && options.parallel; k++)
+		{
+			workers.push_back(std::thread(&PartitionedIndex::compactPartition, this, k, fillFactor, &errors[k]));
+		}
+		for (std::size_t k = 0; k < partitions.size(); k++)
+		{
+			if (k == 0 || !options.parallel)
+			{
+				compactPartition(k, fillFactor, &errors[k]);
+			}
+		}
+		joinPartitionThreads(workers, errors);
+	}
+
+	void PartitionedIndex::compactPartition(const std::size_t k, const double fillFactor, std::exception_ptr *error)
+	{
+		try
+		{
+			partitions[k]->compact(fillFactor);
+		}
+		catch (...)
+		{
+			*error = std::current_exception();
+		}
+	}
+
+	// -----------------------------------------------------------------------------
+	// PartitionedIndex::startScan
+	// -----------------------------------------------------------------------------
+
+	void PartitionedIndex::startScan(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp)
+	{
+		if (scanExecuting)
+		{
+			endScan();
+		}
+		if ((highOp != LTE && highOp != LT) || (lowOp != GTE && lowOp != GT))
+		{
+			throw BadOpcodesException();
+		}
+		if (attributeType == INTEGER)
+		{
+			startScanRange<int>(lowVal, lowOp, highVal, highOp);
+		}
+		else if (attributeType == DOUBLE)
+		{
+			startScanRange<double>(lowVal, lowOp, highVal, highOp);
+		}
+		else
+		{
+			startScanRange<StringKey>(lowVal, lowOp, highVal, highOp);
+		}
+	}
+
+	template <class T>
+	void PartitionedIndex::startScanRange(const void *lowVal, const Operator lowOp, const void *highVal,
+										  const Operator highOp)
+	{
+		const T low = loadKey<T>(lowVal);
+		const T high = loadKey<T>(highVal);
+		if (high < low)
+		{
+			throw BadScanrangeException();
+		}
+
+		// the partitions of the two ends and the ones between them are all the range can overlap
+		const std::size_t first = findPartition(low);
+		const std::size_t last = findPartition(high);
+		counters.scans.fetch_add(1, std::memory_order_relaxed);
+		counters.partitionsPruned.fetch_add(partitions.size() - (last - first + 1), std::memory_order_relaxed);
+
+		const char *lowBytes = reinterpret_cast<const char *>(&low);
+		const char *highBytes = reinterpret_cast<const char *>(&high);
+		scanLowVal.assign(lowBytes, lowBytes + sizeof(T));
+		scanHighVal.assign(highBytes, highBytes + sizeof(T));
+		scanLowOp = lowOp;
+		scanHighOp = highOp;
+		scanLastPartition = last;
+		if (!openPartition(first))
+		{
+			throw NoSuchKeyFoundException();
+		}
+		scanExecuting = true;
+	}
+
+	bool PartitionedIndex::openPartition(std::size_t k)
+	{
+		for (; k <= scanLastPartition; k++)
+		{
+			counters.partitionsScanned.fetch_add(1, std::memory_order_relaxed);
+			std::unique_ptr<IndexScanCursor> cursor(new IndexScanCursor(partitions[k].get()));
+			try
+			{
+				cursor->startScan(&scanLowVal[0], scanLowOp, &scanHighVal[0], scanHighOp);
+			}
+			catch (NoSuchKeyFoundException &e)
+			{
+				continue;
+			}
+			scanCursor.swap(cursor);
+			scanPartition = k;
+			return true;
+		}
+		scanCursor.reset();
+		return false;
+	}
+
+	// -----------------------------------------------------------------------------
+	// PartitionedIndex::scanNext
+	// -----------------------------------------------------------------------------
+
+	void PartitionedIndex::scanNext(RecordId &outRid)
+	{
+		if (!scanExecuting)
+		{
+			throw ScanNotInitializedException();
+		}
+		while (scanCursor)
+		{
+			try
+			{
+				scanCursor->scanNext(outRid);
+				return;
+			}
+			catch (IndexScanCompletedException &e)
+			{
+			}
+			// the partition is done, the next one in the range goes on with larger keys
+			openPartition(scanPartition + 1);
+		}
+		throw IndexScanCompletedException();
+	}
+
+	std::size_t PartitionedIndex::scanNextBatch(RecordId *outRids, const std::size_t maxRids)
+	{
+		if (!scanExecuting)
+		{
+			throw ScanNotInitializedException();
+		}
+		// a partition that runs out part way through the batch hands over to the next one in the range
+		std::size_t filled = 0;
+		while (scanCursor && filled < maxRids)
+		{
+			try
+			{
+				filled += scanCursor->scanNextBatch(outRids + filled, maxRids - filled);
+				continue;
+			}
+			catch (IndexScanCompletedException &e)
+			{
+			}
+			openPartition(scanPartition + 1);
+		}
+		if (filled == 0 && maxRids > 0)
+		{
+			throw IndexScanCompletedException();
+		}
+		return filled;
+	}
+
+	// -----------------------------------------------------------------------------
+	// PartitionedIndex::endScan
+	// -----------------------------------------------------------------------------
+
+	void PartitionedIndex::endScan()
+	{
+		if (!scanExecuting)
+		{
+			throw ScanNotInitializedException();
+		}
+		scanCursor.reset();
+		scanExecuting = false;
+	}
+
+	// -----------------------------------------------------------------------------
+	// PartitionedIndex::getStats
+	// -----------------------------------------------------------------------------
+
+	PartitionStats PartitionedIndex::getStats() const
+	{
+		PartitionStats stats;
+		stats.partitions = partitions.size();
+		stats.scans = counters.scans.load(std::memory_order_relaxed);
+		stats.partitionsScanned = counters.partitionsScanned.load(std::memory_order_relaxed);
+		stats.partitionsPruned = counters.partitionsPruned.load(std::memory_order_relaxed);
+		stats.lookups = counters.lookups.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+}
@@ -0,0 +1,393 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "btree.h"
+
+namespace badgerdb
+{
+
+  /**
+   * @brief Default number of key ranges a new PartitionedIndex is split into.
+   */
+  const std::size_t PARTITION_COUNT = 4;
+
+  /**
+   * @brief Options controlling a PartitionedIndex. Passed to the PartitionedIndex constructor.
+   */
+  struct PartitionOptions
+  {
+    /**
+     * Number of key ranges a new index is split into, each holding about as many entries as the others. Fewer are
+     * made if the relation has fewer distinct keys.
+     */
+    std::size_t partitions;
+
+    /**
+     * Directories the files of the partitions of a new index are put in, partition k in directory k modulo their
+     * number, e.g. one directory per device so that the partitions do not queue for the same disk. Empty puts
+     * them next to the manifest. An index opened again finds its files where the manifest says they are.
+     */
+    std::vector<std::string> directories;
+
+    /**
+     * Options of the BTreeIndex of every partition.
+     */
+    BTreeOptions indexOptions;
+
+    /**
+     * If true, the partitions of a new index are bulk loaded, and compact() rebuilds them, each on its own thread.
+     */
+    bool parallel;
+
+    PartitionOptions() : partitions(PARTITION_COUNT), parallel(true)
+    {
+    }
+  };
+
+  /**
+   * @brief Shape of a PartitionedIndex and counts of the work its router did, as returned by
+   * PartitionedIndex::getStats().
+   */
+  struct PartitionStats
+  {
+    /**
+     * Number of partitions.
+     */
+    std::size_t partitions;
+
+    /**
+     * Number of scans started.
+     */
+    std::uint64_t scans;
+
+    /**
+     * Number of partitions scans started a scan on.
+     */
+    std::uint64_t partitionsScanned;
+
+    /**
+     * Number of partitions scans skipped because their key range lies outside the range of the scan.
+     */
+    std::uint64_t partitionsPruned;
+
+    /**
+     * Number of lookup() calls, each of which reads one partition.
+     */
+    std::uint64_t lookups;
+
+    PartitionStats() : partitions(0), scans(0), partitionsScanned(0), partitionsPruned(0), lookups(0)
+    {
+    }
+  };
+
+  /**
+   * @brief Secondary index on an INTEGER, DOUBLE or STRING attribute of a relation, split by key range into
+   * partitions that are each a BTreeIndex in a file of its own, with the scan interface of BTreeIndex.
+   *
+   * A new index reads the keys of the relation once, sorts them with an ExternalSort, which spills sorted runs to
+   * disk past BTreeOptions::sortRunSize entries, and cuts the sorted stream into PartitionOptions::partitions
+   * ranges of about as many entries each, never between two equal keys. Every partition is bulk loaded from its
+   * range as it comes out of the stream or, if PartitionOptions::parallel is set, from a sorter its range is
+   * spooled into, all partitions at once. Partition k holds the keys from its lower
+   * bound up to the lower bound of partition k + 1; the first one takes every key below and the last one every
+   * key above. The bounds and the names of the files are kept in a manifest file named after the index, which
+   * the index opens again when constructed over an existing manifest. The bounds never move, so a partition
+   * takes all inserts into its range and grows with them.
+   *
+   * A router sends an insert, delete or lookup to the partition of its key, and a scan to the partitions its
+   * range overlaps, one after the other, skipping the rest. The ranges of the partitions do not overlap, so the
+   * entries come in key order without a merge. partition() hands out the BTreeIndex of a partition, to scan or
+   * maintain the partitions on threads of their own.
+   *
+   * Inserts, deletes and lookups may run concurrently, like on a BTreeIndex. The scan of the index is used by one
+   * thread at a time.
+   */
+  class PartitionedIndex
+  {
+  public:
+    /**
+     * PartitionedIndex Constructor.
+     * If the manifest of the index exists, open the partitions it names. If not, split the keys of the base
+     * relation into ranges, bulk load a partition for each and write the manifest.
+     *
+     * @param relationName        Name of the base relation.
+     * @param outIndexName        Returns the name of the manifest, which the partition files are named after.
+     * @param bufMgrIn            Buffer Manager Instance
+     * @param attrByteOffset      Offset of the key attribute in the records
+     * @param attrType            Datatype of the key, INTEGER, DOUBLE or STRING
+     * @param options             Options of the index
+     * @throws  BadIndexInfoException  If the key is COMPOSITE.
+     */
+    PartitionedIndex(const std::string &relationName, std::string &outIndexName, BufMgr *bufMgrIn,
+                     const int attrByteOffset, const Datatype attrType,
+                     const PartitionOptions &options = PartitionOptions());
+
+    /**
+     * PartitionedIndex Destructor.
+     * Ends the running scan and closes the partitions. Throws no exceptions.
+     */
+    ~PartitionedIndex();
+
+    /**
+     * Insert the entry <key, rid> into the partition of the key.
+     * @see BTreeIndex::insertEntry
+     */
+    void insertEntry(const void *key, const RecordId rid);
+
+    /**
+     * Delete the entry <key, rid> from the partition of the key.
+     * @see BTreeIndex::deleteEntry
+     */
+    bool deleteEntry(const void *key, const RecordId rid);
+
+    /**
+     * Find the record ids of the entries whose key equals the given one in the partition of the key.
+     * @see BTreeIndex::lookup
+     */
+    std::size_t lookup(const void *key, RecordId *outRids, const std::size_t maxRids);
+
+    /**
+     * Begin a scan of the entries in a range of keys on the partitions the range overlaps, ending the scan that
+     * was running.
+     * @see BTreeIndex::startScan
+     * @throws  BadOpcodesException If lowOp and highOp do not contain one of their expected values
+     * @throws  BadScanrangeException If lowVal > highval
+     * @throws  NoSuchKeyFoundException If there is no key in the index that satisfies the scan criteria.
+     */
+    void startScan(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp);
+
+    /**
+     * Fetch the record id of the next entry of the scan, in key order.
+     * @param outRid  RecordId of next record found that satisfies the scan criteria returned in this
+     * @throws ScanNotInitializedException If no scan has been initialized.
+     * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+     */
+    void scanNext(RecordId &outRid);
+
+    /**
+     * Fetch the record ids of up to maxRids next entries of the scan, in key order. A batch goes on into the next
+     * partition of the range where one runs out, so it is only short at the end of the scan.
+     * @return  Number of record ids written to outRids, at least 1 if maxRids is.
+     * @throws ScanNotInitializedException If no scan has been initialized.
+     * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+     */
+    std::size_t scanNextBatch(RecordId *outRids, const std::size_t maxRids);
+
+    /**
+     * Terminate the current scan.
+     * @throws ScanNotInitializedException If no scan has been initialized.
+     */
+    void endScan();
+
+    /**
+     * Compact every partition, in parallel if PartitionOptions::parallel is set.
+     * @see BTreeIndex::compact
+     */
+    void compact(const double fillFactor = BULKLOAD_FILL_FACTOR);
+
+    /**
+     * Returns the number of partitions.
+     */
+    std::size_t partitionCount() const
+    {
+      return partitions.size();
+    }
+
+    /**
+     * Returns the index of partition k, for scans and maintenance of that partition alone. It stays owned by the
+     * PartitionedIndex.
+     */
+    BTreeIndex *partition(const std::size_t k)
+    {
+      return partitions[k].get();
+    }
+
+    /**
+     * Returns the number of the partition whose range holds the key.
+     *
+     * @param key   Key, pointer to integer / double / char string
+     */
+    std::size_t partitionOf(const void *key) const;
+
+    /**
+     * Returns the number of partitions and counters of the work the router did.
+     */
+    PartitionStats getStats() const;
+
+    /**
+     * Remove the manifest of an index that is not open and the files of the partitions it names.
+     *
+     * @param indexName  Name of the manifest, as returned by the constructor.
+     * @throws  FileNotFoundException  If there is no such manifest.
+     */
+    static void remove(const std::string &indexName);
+
+  private:
+    PartitionedIndex(const PartitionedIndex &);
+    PartitionedIndex &operator=(const PartitionedIndex &);
+
+    /**
+     * Buffer Manager Instance.
+     */
+    BufMgr *bufMgr;
+
+    /**
+     * Name of the base relation.
+     */
+    std::string relationName;
+
+    /**
+     * Name of the manifest.
+     */
+    std::string indexName;
+
+    /**
+     * Datatype of the key.
+     */
+    Datatype attributeType;
+
+    /**
+     * Offset of the key attribute in the records.
+     */
+    int attrByteOffset;
+
+    /**
+     * Options of the index.
+     */
+    PartitionOptions options;
+
+    /**
+     * Names of the files of the partitions.
+     */
+    std::vector<std::string> names;
+
+    /**
+     * The partitions, in key order.
+     */
+    std::vector<std::unique_ptr<BTreeIndex> > partitions;
+
+    /**
+     * Lower bounds of the partitions but the first, one key of the key type after the other.
+     */
+    std::vector<char> bounds;
+
+    /**
+     * Scan on the partition the running scan is on, NULL if no scan is running.
+     */
+    std::unique_ptr<IndexScanCursor> scanCursor;
+
+    /**
+     * Partition the running scan is on.
+     */
+    std::size_t scanPartition;
+
+    /**
+     * Last partition the range of the running scan overlaps.
+     */
+    std::size_t scanLastPartition;
+
+    /**
+     * True from startScan() until endScan(), even after the scan reached its end.
+     */
+    bool scanExecuting;
+
+    /**
+     * Range of the running scan, as passed to startScan().
+     */
+    std::vector<char> scanLowVal;
+    std::vector<char> scanHighVal;
+    Operator scanLowOp;
+    Operator scanHighOp;
+
+    /**
+     * @brief Counters of PartitionStats, updated without ordering.
+     */
+    struct Counters
+    {
+      std::atomic<std::uint64_t> scans;
+      std::atomic<std::uint64_t> partitionsScanned;
+      std::atomic<std::uint64_t> partitionsPruned;
+      std::atomic<std::uint64_t> lookups;
+
+      Counters() : scans(0), partitionsScanned(0), partitionsPruned(0), lookups(0)
+      {
+      }
+    };
+
+    Counters counters;
+
+    /**
+     * Sort the keys of the base relation with an ExternalSort, cut the sorted stream into ranges and bulk load a
+     * partition for each.
+     */
+    template <class T>
+    void build();
+
+    /**
+     * Name the next partition and remove a file of that name left over from a build cut short.
+     * @return  Number of the partition.
+     */
+    std::size_t addPartition();
+
+    /**
+     * Bulk load partition k from its range of the sorted entries. Stores what it throws in error, to run on a
+     * thread of its own.
+     */
+    void buildPartition(const std::size_t k, SortedEntrySource *source, std::exception_ptr *error);
+
+    /**
+     * Compact partition k. Stores what it throws in error, to run on a thread of its own.
+     */
+    void compactPartition(const std::size_t k, const double fillFactor, std::exception_ptr *error);
+
+    /**
+     * Open the partitions named in the manifest.
+     */
+    void readManifest();
+
+    /**
+     * Record the bounds and the files of the partitions in the manifest.
+     */
+    void writeManifest();
+
+    /**
+     * Returns the name of the file of partition k of a new index.
+     */
+    std::string partitionName(const std::size_t k) const;
+
+    /**
+     * Returns the number of bytes of a key of the index.
+     */
+    std::size_t keySize() const;
+
+    /**
+     * Returns the number of the partition whose range holds the key.
+     */
+    template <class T>
+    std::size_t findPartition(const T &key) const;
+
+    template <class T>
+    void startScanRange(const void *lowVal, const Operator lowOp, const void *highVal, const Operator highOp);
+
+    /**
+     * Start the scan on the next partition in its range that has an entry in it, from partition k on.
+     *
+     * @return  False if there is none left.
+     */
+    bool openPartition(std::size_t k);
+  };
+
+}
@@ -0,0 +1,606 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "redo_log.h"
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checksum.h"
+#include "file.h"
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/io_error_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * First bytes of every log file.
+ */
+const char LOG_MAGIC[8] = {'B', 'D', 'G', 'R', 'E', 'D', 'O', '1'};
+
+/**
+ * Header at the start of the log file.
+ */
+struct LogHeader {
+  char magic[8];
+
+  /**
+   * LSN of the first byte after the header.
+   */
+  Lsn baseLsn;
+
+  /**
+   * LSN of the first group recovery replays, set by the last checkpoint.
+   */
+  Lsn redoLsn;
+};
+
+/**
+ * Size of the blocks the file system gives back when the groups before a
+ * checkpoint are dropped.
+ */
+const off_t LOG_BLOCK = 4096;
+
+/**
+ * Header in front of the records of each group.
+ */
+struct GroupHeader {
+  /**
+   * Length of the records of the group in bytes.
+   */
+  std::uint32_t length;
+
+  /**
+   * CRC32C of the length followed by the records.
+   */
+  std::uint32_t checksum;
+};
+
+/**
+ * What a record holds.
+ */
+enum RecordKind {
+  PAGE_IMAGE = 1,   //!< The whole page
+  PAGE_CHANGES = 2  //!< Ranges of the page, each an offset, a length and the bytes
+};
+
+/**
+ * Kind of the file a record belongs to, so that recovery opens it as such.
+ */
+enum FileKind {
+  PAGE_FILE = 1,
+  BLOB_FILE = 2
+};
+
+/**
+ * Header of a record, followed by the name of the file and the body.
+ */
+struct RecordHeader {
+  std::uint8_t kind;
+  std::uint8_t fileKind;
+  std::uint16_t nameLength;
+  PageId pageNo;
+  std::uint32_t bodyLength;
+};
+
+/**
+ * Header of one changed range in the body of a PAGE_CHANGES record.
+ */
+struct RangeHeader {
+  std::uint16_t offset;
+  std::uint16_t length;
+};
+
+/**
+ * Number of equal bytes between two changed ranges below which they are logged
+ * as one, since a range header costs about as much.
+ */
+const std::size_t RANGE_MERGE_GAP = 8;
+
+/**
+ * Longest range one RangeHeader describes. A 64 KB page that changed whole
+ * is logged as two ranges.
+ */
+const std::size_t RANGE_MAX_LENGTH = 65535;
+
+/**
+ * Number of bytes compared at a time while looking for the next change.
+ */
+const std::size_t COMPARE_BLOCK = 64;
+
+/**
+ * Appends a record header and the name of the file to a group, and returns
+ * the offset of the header.
+ */
+std::size_t beginRecord(std::vector<char>& records, const std::uint8_t kind,
+                        const File* file, const PageId pageNo) {
+  RecordHeader header;
+  header.kind = kind;
+  header.fileKind = dynamic_cast<const PageFile*>(file) != NULL ? PAGE_FILE : BLOB_FILE;
+  header.nameLength = static_cast<std::uint16_t>(file->filename().length());
+  header.pageNo = pageNo;
+  header.bodyLength = 0;
+  const std::size_t start = records.size();
+  records.insert(records.end(), reinterpret_cast<const char*>(&header),
+                 reinterpret_cast<const char*>(&header) + sizeof(header));
+  records.insert(records.end(), file->filename().begin(), file->filename().end());
+  return start;
+}
+
+/**
+ * Sets the body length of the record begun at the given offset to the bytes
+ * appended since its name.
+ */
+void endRecord(std::vector<char>& records, const std::size_t start) {
+  RecordHeader header;
+  memcpy(&header, &records[start], sizeof(header));
+  header.bodyLength = static_cast<std::uint32_t>(
+      records.size() - start - sizeof(header) - header.nameLength);
+  memcpy(&records[start], &header, sizeof(header));
+}
+
+/**
+ * Writes all of the buffer at the given offset of a file.
+ */
+void writeFully(const int fd, const char* buffer, std::size_t length,
+                off_t offset) {
+  while (length > 0) {
+    const ssize_t n = pwrite(fd, buffer, length, offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw IoErrorException("write", errno);
+    }
+    buffer += n;
+    length -= n;
+    offset += n;
+  }
+}
+
+/**
+ * Reads the header of the log with the given name and the groups from its
+ * checkpoint on. Returns false if the log does not exist; a log too short for
+ * a header reads as one with no groups.
+ */
+bool readLog(const std::string& name, LogHeader& header, std::vector<char>& groups) {
+  const int fd = ::open(name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return false;
+    }
+    throw IoErrorException("open", errno);
+  }
+  memset(&header, 0, sizeof(header));
+  groups.clear();
+  char buffer[1 << 16];
+  off_t offset = 0;
+  bool haveHeader = false;
+  while (true) {
+    const ssize_t n = pread(fd, buffer, sizeof(buffer), offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      const int error = errno;
+      ::close(fd);
+      throw IoErrorException("read", error);
+    }
+    if (n == 0) {
+      break;
+    }
+    groups.insert(groups.end(), buffer, buffer + n);
+    offset += n;
+    if (!haveHeader && groups.size() >= sizeof(header)) {
+      // skip what the checkpoint dropped
+      memcpy(&header, &groups[0], sizeof(header));
+      haveHeader = true;
+      if (memcmp(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 ||
+          header.redoLsn < header.baseLsn) {
+        break;
+      }
+      const std::size_t skip = sizeof(header) + (header.redoLsn - header.baseLsn);
+      if (groups.size() >= skip) {
+        groups.erase(groups.begin(), groups.begin() + skip);
+      } else {
+        groups.clear();
+        offset = static_cast<off_t>(skip);
+      }
+    }
+  }
+  ::close(fd);
+  if (!haveHeader) {
+    groups.clear();
+  }
+  return true;
+}
+
+/**
+ * Applies the complete groups of a log read with readLog() to the files they
+ * name and syncs the files. Returns the number of groups applied; the LSN of
+ * the end of the last one is returned in endLsn.
+ */
+std::size_t replay(const LogHeader& logHeader, const std::vector<char>& contents,
+                   Lsn& endLsn) {
+  if (memcmp(logHeader.magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 ||
+      logHeader.redoLsn < logHeader.baseLsn) {
+    endLsn = 0;
+    return 0;
+  }
+
+  // pages are rebuilt in memory and written once at the end
+  typedef std::pair<std::string, PageId> PageKey;
+  std::map<std::string, std::shared_ptr<File> > files;
+  std::map<PageKey, Page> pages;
+  std::set<PageKey> skipped;
+
+  std::size_t groups = 0;
+  std::size_t position = 0;
+  while (position + sizeof(GroupHeader) <= contents.size()) {
+    GroupHeader group;
+    memcpy(&group, &contents[position], sizeof(group));
+    const std::size_t begin = position + sizeof(group);
+    if (group.length > contents.size() - begin ||
+        crc32c(&contents[begin], group.length,
+               crc32c(&group.length, sizeof(group.length))) != group.checksum) {
+      // cut short by the crash, or never completely written
+      break;
+    }
+
+    std::size_t offset = begin;
+    const std::size_t end = begin + group.length;
+    while (offset + sizeof(RecordHeader) <= end) {
+      RecordHeader record;
+      memcpy(&record, &contents[offset], sizeof(record));
+      const std::string name(&contents[offset + sizeof(record)], record.nameLength);
+      const char* body = &contents[offset + sizeof(record) + record.nameLength];
+      offset += sizeof(record) + record.nameLength + record.bodyLength;
+      const PageKey key(name, record.pageNo);
+
+      std::map<std::string, std::shared_ptr<File> >::iterator fileIt = files.find(name);
+      if (fileIt == files.end()) {
+        std::shared_ptr<File> file;
+        if (File::exists(name)) {
+          if (record.fileKind == PAGE_FILE) {
+            file.reset(new PageFile(name, false));
+          } else {
+            file.reset(new BlobFile(name, false));
+          }
+        }
+        fileIt = files.insert(std::make_pair(name, file)).first;
+      }
+      if (!fileIt->second) {
+        continue;
+      }
+
+      if (record.kind == PAGE_IMAGE) {
+        memcpy(&pages[key], body, Page::SIZE);
+        skipped.erase(key);
+        continue;
+      }
+      if (skipped.count(key) > 0) {
+        continue;
+      }
+      std::map<PageKey, Page>::iterator pageIt = pages.find(key);
+      if (pageIt == pages.end()) {
+        // changes with no image before them start from the page on disk
+        try {
+          pageIt = pages.insert(std::make_pair(key, fileIt->second->readPage(record.pageNo))).first;
+        } catch (const BadgerDbException&) {
+          skipped.insert(key);
+          continue;
+        }
+      }
+      char* page = reinterpret_cast<char*>(&pageIt->second);
+      const char* range = body;
+      while (range < body + record.bodyLength) {
+        RangeHeader header;
+        memcpy(&header, range, sizeof(header));
+        memcpy(page + header.offset, range + sizeof(header), header.length);
+        range += sizeof(header) + header.length;
+      }
+    }
+    position = end;
+    groups++;
+  }
+  endLsn = logHeader.redoLsn + position;
+
+  for (std::map<PageKey, Page>::const_iterator it = pages.begin(); it != pages.end(); ++it) {
+    File* file = files[it->first.first].get();
+    PageFile* pageFile = dynamic_cast<PageFile*>(file);
+    const bool inUse = pageFile != NULL
+        ? pageFile->pageState(it->first.second) == PageFile::USED_PAGE
+        : static_cast<BlobFile*>(file)->pageInUse(it->first.second);
+    if (inUse) {
+      file->writePage(it->first.second, it->second);
+    }
+  }
+  for (std::map<std::string, std::shared_ptr<File> >::const_iterator it = files.begin();
+       it != files.end(); ++it) {
+    if (it->second) {
+      it->second->sync();
+    }
+  }
+  return groups;
+}
+
+}
+
+const std::size_t RedoLog::REDO_BUFFER_BYTES;
+
+RedoLog::RedoLog(const std::string& name, const bool syncCommits)
+    : filename_(name), fd_(-1), syncCommits_(syncCommits), baseLsn_(0),
+      redoLsn_(0), appendLsn_(0), writtenLsn_(0), durableLsn_(0),
+      flushing_(false) {
+  LogHeader header;
+  std::vector<char> contents;
+  if (readLog(name, header, contents)) {
+    Lsn endLsn;
+    replay(header, contents, endLsn);
+    baseLsn_ = endLsn;
+  }
+
+  // start over empty, numbering on from where the old log ended
+  fd_ = ::open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd_ < 0) {
+    throw IoErrorException("open", errno);
+  }
+  try {
+    writeHeader(baseLsn_, baseLsn_);
+  } catch (...) {
+    ::close(fd_);
+    throw;
+  }
+  redoLsn_ = appendLsn_ = writtenLsn_ = durableLsn_ = baseLsn_;
+}
+
+RedoLog::~RedoLog() {
+  try {
+    flush(endLsn());
+  } catch (const BadgerDbException&) {
+  }
+  ::close(fd_);
+}
+
+Lsn RedoLog::append(const char* records, const std::size_t length) {
+  GroupHeader group;
+  group.length = static_cast<std::uint32_t>(length);
+  group.checksum = crc32c(records, length, crc32c(&group.length, sizeof(group.length)));
+
+  std::lock_guard<std::mutex> guard(latch_);
+  pending_.insert(pending_.end(), reinterpret_cast<const char*>(&group),
+                  reinterpret_cast<const char*>(&group) + sizeof(group));
+  pending_.insert(pending_.end(), records, records + length);
+  appendLsn_ += sizeof(group) + length;
+  return appendLsn_;
+}
+
+void RedoLog::flush(const Lsn lsn) {
+  std::unique_lock<std::mutex> guard(latch_);
+  while (durableLsn_ < lsn) {
+    if (flushing_) {
+      // the thread flushing covers everything appended before it started;
+      // whoever is left over goes next
+      flushed_.wait(guard);
+      continue;
+    }
+    flushing_ = true;
+    std::vector<char> batch;
+    batch.swap(pending_);
+    std::set<const File*> files;
+    files.swap(unsyncedFiles_);
+    const Lsn start = writtenLsn_;
+    const Lsn target = appendLsn_;
+    const Lsn base = baseLsn_;
+    writtenLsn_ = target;
+    guard.unlock();
+
+    try {
+      // pages the groups refer to must be allocated on disk before recovery
+      // can find them there
+      for (std::set<const File*>::const_iterator it = files.begin(); it != files.end(); ++it) {
+        (*it)->sync();
+      }
+      if (!batch.empty()) {
+        writeFully(fd_, &batch[0], batch.size(),
+                   sizeof(LogHeader) + (start - base));
+      }
+      if (fdatasync(fd_) != 0) {
+        throw IoErrorException("sync", errno);
+      }
+    } catch (...) {
+      // hand the groups and files back so that the next flush tries again
+      guard.lock();
+      batch.insert(batch.end(), pending_.begin(), pending_.end());
+      pending_.swap(batch);
+      unsyncedFiles_.insert(files.begin(), files.end());
+      writtenLsn_ = start;
+      flushing_ = false;
+      flushed_.notify_all();
+      throw;
+    }
+
+    guard.lock();
+    durableLsn_ = target;
+    flushing_ = false;
+    flushed_.notify_all();
+  }
+}
+
+void RedoLog::commit(const Lsn lsn) {
+  if (syncCommits_) {
+    flush(lsn);
+    return;
+  }
+  bool full;
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    full = pending_.size() > REDO_BUFFER_BYTES;
+  }
+  if (full) {
+    flush(lsn);
+  }
+}
+
+void RedoLog::requireSynced(const File* file) {
+  std::lock_guard<std::mutex> guard(latch_);
+  unsyncedFiles_.insert(file);
+}
+
+bool RedoLog::needsImage(const File* file, const PageId pageNo) {
+  std::lock_guard<std::mutex> guard(latch_);
+  return imagedPages_.insert(std::make_pair(file->filename(), pageNo)).second;
+}
+
+void RedoLog::forgetImages() {
+  std::lock_guard<std::mutex> guard(latch_);
+  imagedPages_.clear();
+}
+
+Lsn RedoLog::beginCheckpoint() {
+  std::lock_guard<std::mutex> guard(latch_);
+  imagedPages_.clear();
+  return appendLsn_;
+}
+
+void RedoLog::endCheckpoint(const Lsn redoLsn) {
+  std::lock_guard<std::mutex> headerGuard(headerLatch_);
+  Lsn baseLsn;
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    if (redoLsn <= redoLsn_) {
+      return;
+    }
+    if (!flushing_ && appendLsn_ == redoLsn) {
+      // nothing was logged since the checkpoint began, so the log starts over
+      // empty from there
+      if (ftruncate(fd_, sizeof(LogHeader)) != 0) {
+        throw IoErrorException("truncate", errno);
+      }
+      writeHeader(redoLsn, redoLsn);
+      pending_.clear();
+      baseLsn_ = redoLsn_ = writtenLsn_ = durableLsn_ = redoLsn;
+      return;
+    }
+    baseLsn = baseLsn_;
+  }
+
+  writeHeader(baseLsn, redoLsn);
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    redoLsn_ = redoLsn;
+  }
+#if defined(FALLOC_FL_PUNCH_HOLE)
+  // give the blocks before the checkpoint back, keeping the offsets of the
+  // groups after it; a file system that cannot do so only keeps the space
+  const off_t end = static_cast<off_t>(sizeof(LogHeader) + (redoLsn - baseLsn)) / LOG_BLOCK * LOG_BLOCK;
+  if (end > LOG_BLOCK) {
+    fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, LOG_BLOCK, end - LOG_BLOCK);
+  }
+#endif
+}
+
+Lsn RedoLog::checkpointLsn() const {
+  std::lock_guard<std::mutex> guard(latch_);
+  return redoLsn_;
+}
+
+Lsn RedoLog::endLsn() const {
+  std::lock_guard<std::mutex> guard(latch_);
+  return appendLsn_;
+}
+
+Lsn RedoLog::durableLsn() const {
+  std::lock_guard<std::mutex> guard(latch_);
+  return durableLsn_;
+}
+
+std::size_t RedoLog::recover(const std::string& name) {
+  LogHeader header;
+  std::vector<char> contents;
+  if (!readLog(name, header, contents)) {
+    return 0;
+  }
+  Lsn endLsn;
+  return replay(header, contents, endLsn);
+}
+
+void RedoLog::writeHeader(const Lsn baseLsn, const Lsn redoLsn) {
+  LogHeader header;
+  memcpy(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC));
+  header.baseLsn = baseLsn;
+  header.redoLsn = redoLsn;
+  writeFully(fd_, reinterpret_cast<const char*>(&header), sizeof(header), 0);
+  if (fdatasync(fd_) != 0) {
+    throw IoErrorException("sync", errno);
+  }
+}
+
+void RedoLog::addPageImage(std::vector<char>& records, const File* file,
+                           const PageId pageNo, const Page& page) {
+  const std::size_t start = beginRecord(records, PAGE_IMAGE, file, pageNo);
+  const char* bytes = reinterpret_cast<const char*>(&page);
+  records.insert(records.end(), bytes, bytes + Page::SIZE);
+  endRecord(records, start);
+}
+
+bool RedoLog::addPageChanges(std::vector<char>& records, const File* file,
+                             const PageId pageNo, Page& logged,
+                             const Page& page) {
+  char* old = reinterpret_cast<char*>(&logged);
+  const char* now = reinterpret_cast<const char*>(&page);
+  std::size_t start = 0;
+  std::size_t i = 0;
+  bool changed = false;
+  while (i < Page::SIZE) {
+    // skip equal blocks whole
+    if (i % COMPARE_BLOCK == 0 && i + COMPARE_BLOCK <= Page::SIZE &&
+        memcmp(old + i, now + i, COMPARE_BLOCK) == 0) {
+      i += COMPARE_BLOCK;
+      continue;
+    }
+    if (old[i] == now[i]) {
+      i++;
+      continue;
+    }
+
+    // a changed range runs on until RANGE_MERGE_GAP equal bytes in a row
+    const std::size_t first = i;
+    std::size_t last = i + 1;
+    for (std::size_t j = last; j < Page::SIZE && j < last + RANGE_MERGE_GAP &&
+                               j < first + RANGE_MAX_LENGTH; j++) {
+      if (old[j] != now[j]) {
+        last = j + 1;
+      }
+    }
+    if (!changed) {
+      start = beginRecord(records, PAGE_CHANGES, file, pageNo);
+      changed = true;
+    }
+    RangeHeader range;
+    range.offset = static_cast<std::uint16_t>(first);
+    range.length = static_cast<std::uint16_t>(last - first);
+    records.insert(records.end(), reinterpret_cast<const char*>(&range),
+                   reinterpret_cast<const char*>(&range) + sizeof(range));
+    records.insert(records.end(), now + first, now + last);
+    memcpy(old + first, now + first, last - first);
+    i = last;
+  }
+  if (changed) {
+    endRecord(records, start);
+  }
+  return changed;
+}
+
+}
@@ -0,0 +1,304 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+class File;
+
+/**
+ * @brief Log sequence number: the position in the redo log just past the end
+ *        of a group. LSNs only grow, across restarts too; 0 stands for none.
+ */
+typedef std::uint64_t Lsn;
+
+/**
+ * @brief Redo log of changes to pages, written ahead of the pages themselves.
+ *
+ * Changes are appended in groups. A group holds the changes one operation made
+ * to one or more pages, each either as a full image of the page or as the byte
+ * ranges that changed, and is applied by recovery completely or not at all.
+ * The first change to a page logged since the log was started, or since the
+ * last checkpoint began, carries a full image, so that recovery never needs
+ * the page as it is on disk, which a write cut short by the crash may have
+ * torn.
+ *
+ * Appending only buffers a group. flush() makes groups durable; concurrent
+ * calls are committed together, one thread writing and syncing everything
+ * appended so far while the others wait for it.
+ *
+ * A checkpoint is fuzzy: beginCheckpoint() marks where the log stands while
+ * changes go on, the caller writes back and syncs every page that was dirty
+ * then, and endCheckpoint() records the mark in the log header. Recovery only
+ * replays the groups from the mark of the last checkpoint on, so it takes as
+ * long as the activity since then, and the space of the groups before the
+ * mark is given back to the file system.
+ *
+ * Opening a log that already exists recovers from it: the complete groups in
+ * it are applied to the files they name, which are synced, and the log starts
+ * over empty.
+ */
+class RedoLog {
+ public:
+  /**
+   * Opens the redo log with the given name, creating it if it does not exist
+   * and recovering from it if it does.
+   *
+   * @param name          Name of the log file.
+   * @param syncCommits   True if commit() waits until the group is durable;
+   *                      false to let commits return right away and reach the
+   *                      disk with a later flush.
+   * @throws  IoErrorException  If the log could not be opened, read or written.
+   */
+  explicit RedoLog(const std::string& name, const bool syncCommits = true);
+
+  /**
+   * Flushes what was appended and closes the log.
+   */
+  ~RedoLog();
+
+  /**
+   * Appends a group of records built with addPageImage() and addPageChanges().
+   *
+   * @param records   Records of the group.
+   * @param length    Length of the records in bytes.
+   * @return  LSN of the group.
+   */
+  Lsn append(const char* records, const std::size_t length);
+
+  /**
+   * Returns once every group up to the given LSN is durable, writing and
+   * syncing them if no other thread is already doing it. Files passed to
+   * requireSynced() are synced first.
+   *
+   * @param lsn   LSN to make durable.
+   * @throws  IoErrorException  If the log or a file could not be written.
+   */
+  void flush(const Lsn lsn);
+
+  /**
+   * Commits the group with the given LSN: flushes it if the log syncs commits,
+   * and otherwise only once more than REDO_BUFFER_BYTES are waiting.
+   *
+   * @param lsn   LSN of the group.
+   */
+  void commit(const Lsn lsn);
+
+  /**
+   * Makes the log sync the given file before the groups appended after this
+   * call are made durable, e.g. because they change a page whose allocation
+   * the file has not synced yet. The file must stay open until the next flush.
+   *
+   * @param file  File to sync.
+   */
+  void requireSynced(const File* file);
+
+  /**
+   * Returns true the first time it is asked about a page since the log was
+   * started or the last checkpoint began. The caller must then log a full image of the page rather than
+   * its changes.
+   *
+   * @param file    File of the page.
+   * @param pageNo  Number of the page.
+   */
+  bool needsImage(const File* file, const PageId pageNo);
+
+  /**
+   * Makes the next change logged to every page carry a full image again, e.g.
+   * once pages changed without logging were written and synced.
+   */
+  void forgetImages();
+
+  /**
+   * Begins a checkpoint: the next change logged to every page carries a full
+   * image again. Every page dirty at this point must be written back and its
+   * file synced before endCheckpoint() is called with the LSN returned.
+   * Changes logged meanwhile go on as usual.
+   *
+   * @return  LSN recovery replays from once the checkpoint ends.
+   */
+  Lsn beginCheckpoint();
+
+  /**
+   * Ends a checkpoint begun with beginCheckpoint(): records in the log header
+   * that recovery starts at the given LSN, and drops the groups before it.
+   *
+   * @param redoLsn   LSN returned by beginCheckpoint().
+   * @throws  IoErrorException  If the log header could not be written.
+   */
+  void endCheckpoint(const Lsn redoLsn);
+
+  /**
+   * Returns the LSN recovery replays from, i.e. that of the last checkpoint.
+   */
+  Lsn checkpointLsn() const;
+
+  /**
+   * Returns the LSN of the last group appended.
+   */
+  Lsn endLsn() const;
+
+  /**
+   * Returns the LSN up to which the log is durable.
+   */
+  Lsn durableLsn() const;
+
+  /**
+   * Returns true if commit() waits for the group to be durable.
+   */
+  bool syncsCommits() const { return syncCommits_; }
+
+  /**
+   * Returns the name of the log file.
+   */
+  const std::string& filename() const { return filename_; }
+
+  /**
+   * Applies the complete groups of the given log from its last checkpoint on
+   * to the files they name and syncs the files. Stops at the first group that is cut short or does not
+   * match its checksum. Records of files that no longer exist are skipped, as
+   * are those of PageFile pages that are no longer in use.
+   *
+   * @param name  Name of the log file.
+   * @return  Number of groups applied; 0 if there is no such log.
+   * @throws  IoErrorException  If the log could not be read or a file written.
+   */
+  static std::size_t recover(const std::string& name);
+
+  /**
+   * Adds a record holding a full image of the given page to a group.
+   *
+   * @param records   Records of the group.
+   * @param file      File of the page.
+   * @param pageNo    Number of the page.
+   * @param page      The page as it is now.
+   */
+  static void addPageImage(std::vector<char>& records, const File* file,
+                           const PageId pageNo, const Page& page);
+
+  /**
+   * Adds a record holding the byte ranges in which a page differs from an older
+   * copy of it to a group, and brings those ranges of the copy up to date.
+   * Adds nothing if the page did not change.
+   *
+   * @param records   Records of the group.
+   * @param file      File of the page.
+   * @param pageNo    Number of the page.
+   * @param logged    Copy of the page as of its last record.
+   * @param page      The page as it is now.
+   * @return  True if the page changed.
+   */
+  static bool addPageChanges(std::vector<char>& records, const File* file,
+                             const PageId pageNo, Page& logged,
+                             const Page& page);
+
+  /**
+   * Number of bytes commit() lets wait for a flush when the log does not sync
+   * commits.
+   */
+  static const std::size_t REDO_BUFFER_BYTES = 1 << 20;
+
+ private:
+  RedoLog(const RedoLog&);
+  RedoLog& operator=(const RedoLog&);
+
+  /**
+   * Name of the log file.
+   */
+  const std::string filename_;
+
+  /**
+   * Descriptor of the log file.
+   */
+  int fd_;
+
+  /**
+   * Whether commit() flushes.
+   */
+  const bool syncCommits_;
+
+  /**
+   * LSN of the first byte after the log file header.
+   */
+  Lsn baseLsn_;
+
+  /**
+   * LSN recovery replays from, recorded in the log header by endCheckpoint().
+   */
+  Lsn redoLsn_;
+
+  /**
+   * LSN of the end of the last group appended.
+   */
+  Lsn appendLsn_;
+
+  /**
+   * LSN up to which groups have been taken out of pending_ to be written.
+   */
+  Lsn writtenLsn_;
+
+  /**
+   * LSN up to which the log is durable.
+   */
+  Lsn durableLsn_;
+
+  /**
+   * Groups appended and not yet taken to be written, from writtenLsn_ on.
+   */
+  std::vector<char> pending_;
+
+  /**
+   * Files to sync before the groups in pending_ are made durable.
+   */
+  std::set<const File*> unsyncedFiles_;
+
+  /**
+   * Pages a full image was logged of since the log was started or the last
+   * checkpoint began, by file name.
+   */
+  std::set<std::pair<std::string, PageId> > imagedPages_;
+
+  /**
+   * True while a thread is writing and syncing the log.
+   */
+  bool flushing_;
+
+  /**
+   * Guards everything above that changes.
+   */
+  mutable std::mutex latch_;
+
+  /**
+   * Signalled when a flush finishes.
+   */
+  std::condition_variable flushed_;
+
+  /**
+   * Serializes endCheckpoint(), which writes the log header without latch_.
+   */
+  std::mutex headerLatch_;
+
+  /**
+   * Writes the log header with the given LSNs and syncs the log.
+   */
+  void writeHeader(const Lsn baseLsn, const Lsn redoLsn);
+};
+
+}
@@ -0,0 +1,285 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "replacement_policy.h"
+
+#include <algorithm>
+
+namespace badgerdb {
+
+void ReferenceBitmap::reset(const std::uint32_t numFrames,
+                            const std::uint32_t maxFrames) {
+  const std::uint32_t numWords = (std::max(numFrames, maxFrames) + 63) / 64;
+  hand_ = 0;
+  words_.reset(new std::atomic<std::uint64_t>[numWords]);
+  for (std::uint32_t i = 0; i < numWords; i++) {
+    words_[i] = 0;
+  }
+  numFrames_.store(numFrames, std::memory_order_release);
+}
+
+void ReferenceBitmap::resize(const std::uint32_t numFrames) {
+  // the bits of the frames dropped are cleared before the count is published,
+  // so a sweep that sees them again after a later grow finds them clear
+  const std::uint32_t oldFrames = numFrames_.load(std::memory_order_acquire);
+  for (std::uint32_t frame = numFrames; frame < oldFrames; frame++) {
+    testAndClear(frame);
+  }
+  numFrames_.store(numFrames, std::memory_order_release);
+}
+
+FrameId ReferenceBitmap::sweep() {
+  // every word is passed at most twice: once clearing its bits, once finding
+  // one of them still clear
+  const std::uint32_t numFrames = numFrames_.load(std::memory_order_acquire);
+  const std::uint32_t maxSteps = 2 * ((numFrames + 63) / 64 + 1);
+  for (std::uint32_t step = 0; step < maxSteps; step++) {
+    std::uint32_t frame = hand_.load();
+    if (frame >= numFrames) {
+      // the pool shrank under the hand
+      hand_.compare_exchange_strong(frame, 0);
+      continue;
+    }
+    const std::uint32_t wordEnd = std::min<std::uint32_t>(
+        (frame / 64 + 1) * 64, numFrames);
+
+    // bits of the frames from the hand to the end of its word
+    std::uint64_t ahead = ~std::uint64_t(0) << (frame % 64);
+    if (wordEnd % 64 != 0) {
+      ahead &= (std::uint64_t(1) << (wordEnd % 64)) - 1;
+    }
+
+    std::atomic<std::uint64_t>& word = words_[frame / 64];
+    const std::uint64_t unreferenced = ~word.load() & ahead;
+    if (unreferenced != 0) {
+      const FrameId victim =
+          (frame / 64) * 64 + __builtin_ctzll(unreferenced);
+      // clear what the hand passes on the way; another thread getting there
+      // first just means trying again from where it left the hand
+      const std::uint64_t passed =
+          ahead & ((std::uint64_t(1) << (victim % 64)) - 1);
+      if (hand_.compare_exchange_strong(frame, (victim + 1) % numFrames)) {
+        word.fetch_and(~passed);
+        return victim;
+      }
+      continue;
+    }
+
+    // every frame left in the word was referenced: give them all their
+    // second chance at once
+    if (hand_.compare_exchange_strong(frame, wordEnd % numFrames)) {
+      word.fetch_and(~ahead);
+    }
+  }
+
+  std::uint32_t frame = hand_.load() % numFrames;
+  hand_.compare_exchange_strong(frame, (frame + 1) % numFrames);
+  return frame;
+}
+
+void ClockPolicy::reset(const std::uint32_t numFrames,
+                        const std::uint32_t maxFrames) {
+  referenced_.reset(numFrames, maxFrames);
+}
+
+void ClockPolicy::resize(const std::uint32_t numFrames) {
+  referenced_.resize(numFrames);
+}
+
+void ClockPolicy::pinned(const FrameId frame, const bool loaded,
+                         const AccessPattern pattern) {
+  referenced_.set(frame);
+}
+
+FrameId ClockPolicy::nextVictim() {
+  return referenced_.sweep();
+}
+
+bool ClockPolicy::spare(const FrameId frame) {
+  return referenced_.testAndClear(frame);
+}
+
+void ClockPolicy::evicted(const FrameId frame) {
+  referenced_.testAndClear(frame);
+}
+
+bool ClockPolicy::referenced(const FrameId frame) const {
+  return referenced_.test(frame);
+}
+
+FrameId ClockPolicy::sweepPosition() const {
+  return referenced_.hand();
+}
+
+void TwoQueuePolicy::reset(const std::uint32_t numFrames,
+                           const std::uint32_t maxFrames) {
+  std::lock_guard<std::mutex> guard(latch_);
+  const std::uint32_t capacity = std::max(numFrames, maxFrames);
+  numFrames_ = 0;
+  probationCount_ = 0;
+  state_.reset(new std::atomic<int>[capacity]);
+  referenced_.reset(numFrames, capacity);
+  generation_.reset(new std::atomic<std::uint32_t>[capacity]);
+  free_.clear();
+  scanned_.clear();
+  probation_.clear();
+  for (std::uint32_t i = 0; i < capacity; i++) {
+    state_[i] = UNUSED_FRAME;
+    generation_[i] = 0;
+  }
+  resizeLocked(numFrames);
+}
+
+void TwoQueuePolicy::resize(const std::uint32_t numFrames) {
+  std::lock_guard<std::mutex> guard(latch_);
+  resizeLocked(numFrames);
+}
+
+void TwoQueuePolicy::resizeLocked(const std::uint32_t numFrames) {
+  // retiring the frames dropped turns their queue entries stale
+  for (std::uint32_t i = numFrames; i < numFrames_; i++) {
+    if (state_[i] == PROBATION_FRAME) {
+      probationCount_--;
+    }
+    state_[i] = UNUSED_FRAME;
+    generation_[i]++;
+  }
+  const std::uint32_t previous = numFrames_;
+  // set first so that the frames added are queued against the new size
+  numFrames_ = numFrames;
+  for (std::uint32_t i = previous; i < numFrames; i++) {
+    state_[i] = FREE_FRAME;
+    generation_[i]++;
+    enqueue(free_, FREE_FRAME, i);
+  }
+  probationLimit_ = std::max<std::uint32_t>(
+      1, static_cast<std::uint64_t>(numFrames) * probationPercent_ / 100);
+  referenced_.resize(numFrames);
+}
+
+void TwoQueuePolicy::enqueue(std::deque<QueueEntry>& queue,
+                             const FrameState state, const FrameId frame) {
+  // a frame has at most one entry in its current generation, so compacting
+  // leaves no more entries than frames, and the next compaction is as many
+  // enqueues away
+  if (queue.size() >= 2 * static_cast<std::size_t>(numFrames_)) {
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < queue.size(); i++) {
+      const QueueEntry& entry = queue[i];
+      if (state_[entry.frame] == state &&
+          generation_[entry.frame] == entry.generation) {
+        queue[kept++] = entry;
+      }
+    }
+    queue.resize(kept);
+  }
+  QueueEntry entry;
+  entry.frame = frame;
+  entry.generation = generation_[frame];
+  queue.push_back(entry);
+}
+
+bool TwoQueuePolicy::dequeue(std::deque<QueueEntry>& queue,
+                             const FrameState state, FrameId& frame) {
+  while (!queue.empty()) {
+    const QueueEntry entry = queue.front();
+    queue.pop_front();
+    if (state_[entry.frame] == state &&
+        generation_[entry.frame] == entry.generation) {
+      frame = entry.frame;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TwoQueuePolicy::pinned(const FrameId frame, const bool loaded,
+                            const AccessPattern pattern) {
+  if (loaded) {
+    std::lock_guard<std::mutex> guard(latch_);
+    generation_[frame]++;
+    referenced_.testAndClear(frame);
+    if (pattern == SEQUENTIAL_ACCESS) {
+      state_[frame] = SCANNED_FRAME;
+      enqueue(scanned_, SCANNED_FRAME, frame);
+    } else {
+      state_[frame] = PROBATION_FRAME;
+      probationCount_++;
+      enqueue(probation_, PROBATION_FRAME, frame);
+    }
+    return;
+  }
+
+  if (pattern == SEQUENTIAL_ACCESS) {
+    return;
+  }
+
+  // a second random read protects the page; whichever thread wins the
+  // exchange moves it, the queue entry it leaves behind turns stale
+  int state = state_[frame];
+  while (state == SCANNED_FRAME || state == PROBATION_FRAME) {
+    if (state_[frame].compare_exchange_weak(state, PROTECTED_FRAME)) {
+      generation_[frame]++;
+      if (state == PROBATION_FRAME) {
+        probationCount_--;
+      }
+      break;
+    }
+  }
+  referenced_.set(frame);
+}
+
+FrameId TwoQueuePolicy::nextVictim() {
+  FrameId frame;
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    if (dequeue(free_, FREE_FRAME, frame) ||
+        dequeue(scanned_, SCANNED_FRAME, frame)) {
+      return frame;
+    }
+    if (probationCount_ > probationLimit_ &&
+        dequeue(probation_, PROBATION_FRAME, frame)) {
+      return frame;
+    }
+  }
+  return referenced_.sweep();
+}
+
+bool TwoQueuePolicy::spare(const FrameId frame) {
+  // pages met by the sweep that are not protected go right away
+  return state_[frame] == PROTECTED_FRAME && referenced_.testAndClear(frame);
+}
+
+void TwoQueuePolicy::evicted(const FrameId frame) {
+  std::lock_guard<std::mutex> guard(latch_);
+  if (frame >= numFrames_) {
+    // a shrink of the pool retired the frame
+    return;
+  }
+  if (state_[frame] == PROBATION_FRAME) {
+    probationCount_--;
+  }
+  state_[frame] = FREE_FRAME;
+  referenced_.testAndClear(frame);
+  generation_[frame]++;
+  enqueue(free_, FREE_FRAME, frame);
+}
+
+bool TwoQueuePolicy::referenced(const FrameId frame) const {
+  return referenced_.test(frame);
+}
+
+FrameId TwoQueuePolicy::sweepPosition() const {
+  return referenced_.hand();
+}
+
+std::size_t TwoQueuePolicy::queued() {
+  std::lock_guard<std::mutex> guard(latch_);
+  return free_.size() + scanned_.size() + probation_.size();
+}
+
+}
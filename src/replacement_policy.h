@@ -0,0 +1,406 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief How a page is being read, as told to BufMgr::readPage().
+ */
+enum AccessPattern {
+  /**
+   * Point accesses, e.g. a B+ tree descent; pages read this way are expected
+   * to be read again.
+   */
+  RANDOM_ACCESS,
+
+  /**
+   * Part of a scan that reads every page once, e.g. a FileScan or a B+ tree
+   * range scan walking its leaves.
+   */
+  SEQUENTIAL_ACCESS
+};
+
+/**
+ * @brief Decides which frame of the buffer pool BufMgr evicts next.
+ *
+ * BufMgr asks for candidates with nextVictim() and takes a candidate if it is
+ * free, or if it is unpinned and spare() turns it down. It tells the policy
+ * about every pin and every frame it frees. All calls but reset() and
+ * resize() may come from several threads at once; spare() and evicted() are
+ * only called with the frame latched. resize() may run alongside the others,
+ * and a candidate past the end of a pool that was just shrunk is skipped by
+ * BufMgr.
+ */
+class ReplacementPolicy {
+ public:
+  virtual ~ReplacementPolicy() {}
+
+  /**
+   * Forgets all frames and sizes the policy for a pool of the given number
+   * of frames, all of them free. Called by BufMgr before any other call.
+   *
+   * @param numFrames   Number of frames in the buffer pool.
+   * @param maxFrames   Number of frames the pool may grow to.
+   */
+  virtual void reset(const std::uint32_t numFrames,
+                     const std::uint32_t maxFrames) = 0;
+
+  /**
+   * Grows or shrinks the pool to frames 0 to numFrames - 1. Frames added are
+   * free. Frames dropped are no longer handed out; BufMgr evicts their pages
+   * afterwards, and evicted() leaves them be. It may give a frame back with
+   * another resize() if its page cannot be evicted. Calls to resize() do not
+   * overlap.
+   *
+   * @param numFrames   New number of frames, at most maxFrames of reset().
+   */
+  virtual void resize(const std::uint32_t numFrames) = 0;
+
+  /**
+   * Notes that a page was pinned in a frame.
+   *
+   * @param frame     Frame holding the page.
+   * @param loaded    True if the page was just read or allocated into the
+   *                  frame, false if it was already there.
+   * @param pattern   How the page is being read.
+   */
+  virtual void pinned(const FrameId frame, const bool loaded,
+                      const AccessPattern pattern) = 0;
+
+  /**
+   * Returns the next frame to consider for eviction.
+   */
+  virtual FrameId nextVictim() = 0;
+
+  /**
+   * Asked about a candidate that holds an unpinned page, before evicting it.
+   *
+   * @param frame   Frame returned by nextVictim().
+   * @return  True to keep the page for now, false to evict it.
+   */
+  virtual bool spare(const FrameId frame) = 0;
+
+  /**
+   * Notes that the page in a frame was evicted, flushed or disposed of, or
+   * could not be read, leaving the frame free.
+   *
+   * @param frame   Frame that is free now.
+   */
+  virtual void evicted(const FrameId frame) = 0;
+
+  /**
+   * Returns true if the page in the frame was referenced since the policy
+   * last looked at it.
+   */
+  virtual bool referenced(const FrameId frame) const = 0;
+
+  /**
+   * Returns the frame the sweep for victims gets to next. The frames from
+   * there on are the ones the background writer of BufMgr cleans.
+   */
+  virtual FrameId sweepPosition() const = 0;
+};
+
+/**
+ * @brief Reference bits of the frames of a pool, packed 64 to a word, with a
+ *        clock hand sweeping them.
+ *
+ * The sweep looks at a word at a time: it clears the bits of the referenced
+ * frames it passes with one atomic and stops at the first frame not
+ * referenced, so it never touches the frames themselves and passes 64
+ * referenced frames for the price of one.
+ */
+class ReferenceBitmap {
+ public:
+  ReferenceBitmap() : numFrames_(0), hand_(0) {}
+
+  /**
+   * Sizes the bitmap for the given number of frames, all of them not
+   * referenced, with room for maxFrames, and puts the hand on frame 0.
+   */
+  void reset(const std::uint32_t numFrames, const std::uint32_t maxFrames);
+
+  /**
+   * Changes the number of frames the hand sweeps, at most maxFrames of
+   * reset(), clearing the bits of frames dropped.
+   */
+  void resize(const std::uint32_t numFrames);
+
+  /**
+   * Marks the frame referenced.
+   */
+  void set(const FrameId frame) {
+    const std::uint64_t bit = bitOf(frame);
+    std::atomic<std::uint64_t>& word = words_[frame / 64];
+    // hot frames are referenced already; skip the write that would bounce the
+    // cache line between threads
+    if ((word.load(std::memory_order_relaxed) & bit) == 0) {
+      word.fetch_or(bit);
+    }
+  }
+
+  /**
+   * Clears the bit of the frame and returns it.
+   */
+  bool testAndClear(const FrameId frame) {
+    const std::uint64_t bit = bitOf(frame);
+    return (words_[frame / 64].fetch_and(~bit) & bit) != 0;
+  }
+
+  /**
+   * Returns the bit of the frame.
+   */
+  bool test(const FrameId frame) const {
+    return (words_[frame / 64].load() & bitOf(frame)) != 0;
+  }
+
+  /**
+   * Moves the hand to the first frame not referenced, clearing the bits of
+   * the frames it passes, and returns that frame; the hand stops right after
+   * it. Gives up after two times around the pool and returns the frame under
+   * the hand then, if other threads keep setting bits ahead of it.
+   */
+  FrameId sweep();
+
+  /**
+   * Returns the frame under the hand.
+   */
+  FrameId hand() const { return hand_; }
+
+ private:
+  ReferenceBitmap(const ReferenceBitmap&);
+  ReferenceBitmap& operator=(const ReferenceBitmap&);
+
+  static std::uint64_t bitOf(const FrameId frame) {
+    return std::uint64_t(1) << (frame % 64);
+  }
+
+  /**
+   * Number of frames. Stored with release once the bits of frames dropped
+   * are cleared, and loaded with acquire by sweep(), which reads it once and
+   * keeps to it.
+   */
+  std::atomic<std::uint32_t> numFrames_;
+
+  /**
+   * Frame under the hand, below numFrames_ unless the pool just shrank.
+   */
+  std::atomic<std::uint32_t> hand_;
+
+  /**
+   * Bits of frames 64 * i to 64 * i + 63 in word i.
+   */
+  std::unique_ptr<std::atomic<std::uint64_t>[]> words_;
+};
+
+/**
+ * @brief Clock replacement: a hand sweeps the frames and evicts the first one
+ *        not referenced since it was last passed. Ignores access patterns.
+ */
+class ClockPolicy : public ReplacementPolicy {
+ public:
+  ClockPolicy() {}
+
+  void reset(const std::uint32_t numFrames,
+             const std::uint32_t maxFrames) override;
+
+  void resize(const std::uint32_t numFrames) override;
+
+  void pinned(const FrameId frame, const bool loaded,
+              const AccessPattern pattern) override;
+
+  FrameId nextVictim() override;
+
+  bool spare(const FrameId frame) override;
+
+  void evicted(const FrameId frame) override;
+
+  bool referenced(const FrameId frame) const override;
+
+  FrameId sweepPosition() const override;
+
+ private:
+  ClockPolicy(const ClockPolicy&);
+  ClockPolicy& operator=(const ClockPolicy&);
+
+  /**
+   * Reference bits of the frames and the hand.
+   */
+  ReferenceBitmap referenced_;
+};
+
+/**
+ * @brief Default share of the pool, in percent, pages read once may take up
+ *        before TwoQueuePolicy evicts them ahead of pages read again.
+ */
+const std::uint32_t PROBATION_PERCENT = 25;
+
+/**
+ * @brief Scan-resistant replacement after 2Q.
+ *
+ * A page read into the pool is on probation until it is read again, which
+ * moves it to a protected set replaced by a clock sweep. Pages on probation
+ * are evicted first-in first-out as soon as they take up more than their
+ * share of the pool, and pages read by a scan are evicted before anything
+ * else, so one pass over a large file or index leaves the pages that are
+ * read over and over, such as the inner nodes of a B+ tree, in the pool. A
+ * page a scan reads again stays where it is; only random reads protect a
+ * page.
+ */
+class TwoQueuePolicy : public ReplacementPolicy {
+ public:
+  /**
+   * @param probationPercent  Share of the pool, in percent, pages on
+   *                          probation may take up.
+   */
+  explicit TwoQueuePolicy(
+      const std::uint32_t probationPercent = PROBATION_PERCENT)
+      : probationPercent_(probationPercent),
+        numFrames_(0),
+        probationLimit_(0),
+        probationCount_(0) {}
+
+  void reset(const std::uint32_t numFrames,
+             const std::uint32_t maxFrames) override;
+
+  void resize(const std::uint32_t numFrames) override;
+
+  void pinned(const FrameId frame, const bool loaded,
+              const AccessPattern pattern) override;
+
+  FrameId nextVictim() override;
+
+  bool spare(const FrameId frame) override;
+
+  void evicted(const FrameId frame) override;
+
+  bool referenced(const FrameId frame) const override;
+
+  FrameId sweepPosition() const override;
+
+  /**
+   * Returns the number of entries in the queues, stale ones included.
+   */
+  std::size_t queued();
+
+ private:
+  TwoQueuePolicy(const TwoQueuePolicy&);
+  TwoQueuePolicy& operator=(const TwoQueuePolicy&);
+
+  /**
+   * What a frame holds.
+   */
+  enum FrameState {
+    UNUSED_FRAME,
+    FREE_FRAME,
+    SCANNED_FRAME,
+    PROBATION_FRAME,
+    PROTECTED_FRAME
+  };
+
+  /**
+   * Entry of one of the queues. It is stale, and skipped, if the frame was
+   * reused or its page changed state since the entry was queued.
+   */
+  struct QueueEntry {
+    FrameId frame;
+    std::uint32_t generation;
+  };
+
+  /**
+   * Queues the frame in its current generation, dropping the stale entries
+   * of the queue once they could make it outgrow the pool. The caller holds
+   * latch_.
+   *
+   * @param state  State of the frames the queue holds.
+   */
+  void enqueue(std::deque<QueueEntry>& queue, const FrameState state,
+               const FrameId frame);
+
+  /**
+   * Does the work of resize(). The caller holds latch_.
+   */
+  void resizeLocked(const std::uint32_t numFrames);
+
+  /**
+   * Takes the first entry still valid for the given state off a queue.
+   * Returns false if there is none. The caller holds latch_.
+   */
+  bool dequeue(std::deque<QueueEntry>& queue, const FrameState state,
+               FrameId& frame);
+
+  /**
+   * Share of the pool, in percent, pages on probation may take up.
+   */
+  const std::uint32_t probationPercent_;
+
+  /**
+   * Number of frames in the pool. Guarded by latch_.
+   */
+  std::uint32_t numFrames_;
+
+  /**
+   * Number of pages on probation past which they are evicted first. Guarded
+   * by latch_.
+   */
+  std::uint32_t probationLimit_;
+
+  /**
+   * Number of pages on probation.
+   */
+  std::atomic<std::uint32_t> probationCount_;
+
+  /**
+   * FrameState of every frame.
+   */
+  std::unique_ptr<std::atomic<int>[]> state_;
+
+  /**
+   * Reference bits of the protected frames and the hand sweeping all frames.
+   */
+  ReferenceBitmap referenced_;
+
+  /**
+   * Number of times every frame changed state, to tell stale queue entries.
+   */
+  std::unique_ptr<std::atomic<std::uint32_t>[]> generation_;
+
+  /**
+   * Free frames, handed out before any page is evicted.
+   */
+  std::deque<QueueEntry> free_;
+
+  /**
+   * Frames holding pages read by scans, oldest first.
+   */
+  std::deque<QueueEntry> scanned_;
+
+  /**
+   * Frames holding pages on probation, oldest first. Like the other queues it
+   * keeps the entries that turned stale until they reach its front or it is
+   * compacted, which happens once it holds twice as many entries as the pool
+   * has frames.
+   */
+  std::deque<QueueEntry> probation_;
+
+  /**
+   * Guards the queues.
+   */
+  std::mutex latch_;
+};
+
+}
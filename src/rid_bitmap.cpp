@@ -0,0 +1,459 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include "rid_bitmap.h"
+#include "btree.h"
+#include "exceptions/index_scan_completed_exception.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace badgerdb {
+
+/**
+ * Orders record ids by page, then by slot.
+ */
+static bool ridLess(const RecordId &a, const RecordId &b)
+{
+  return a.page_number < b.page_number || (a.page_number == b.page_number && a.slot_number < b.slot_number);
+}
+
+/**
+ * Writes the slots in both of the sorted arrays a and b to out, which has room for the shorter of them. Returns
+ * the number written.
+ */
+static std::size_t intersectArrays(const std::uint16_t *a, const std::size_t na, const std::uint16_t *b,
+                                   const std::size_t nb, std::uint16_t *out)
+{
+  std::size_t i = 0;
+  std::size_t j = 0;
+  std::size_t k = 0;
+#if defined(__SSE2__)
+  // compare a block of 8 slots of a with every rotation of a block of 8 slots of b, then move on past the block
+  // with the smaller last slot, or past both if their last slots are equal
+  while (i + 8 <= na && j + 8 <= nb)
+  {
+    const __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b + j));
+    __m128i eq = _mm_cmpeq_epi16(va, vb);
+    for (int r = 1; r < 8; r++)
+    {
+      vb = _mm_or_si128(_mm_srli_si128(vb, 2), _mm_slli_si128(vb, 14));
+      eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, vb));
+    }
+    const int mask = _mm_movemask_epi8(eq);
+    for (int l = 0; l < 8; l++)
+    {
+      if (mask & (1 << (2 * l)))
+        out[k++] = a[i + l];
+    }
+    const std::uint16_t lastA = a[i + 7];
+    const std::uint16_t lastB = b[j + 7];
+    if (lastA <= lastB)
+      i += 8;
+    if (lastB <= lastA)
+      j += 8;
+  }
+#endif
+  while (i < na && j < nb)
+  {
+    if (a[i] < b[j])
+      i++;
+    else if (b[j] < a[i])
+      j++;
+    else
+    {
+      out[k++] = a[i];
+      i++;
+      j++;
+    }
+  }
+  return k;
+}
+
+/**
+ * Sets out to the bitwise and, or the bitwise or if unite is true, of the n words of a and b. Returns the number
+ * of bits set in out.
+ */
+static std::size_t combineWords(const std::uint64_t *a, const std::uint64_t *b, std::uint64_t *out,
+                                const std::size_t n, const bool unite)
+{
+  std::size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+    const __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+    _mm256_storeu_si256((__m256i *)(out + i), unite ? _mm256_or_si256(va, vb) : _mm256_and_si256(va, vb));
+  }
+#elif defined(__SSE2__)
+  for (; i + 2 <= n; i += 2)
+  {
+    const __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+    const __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+    _mm_storeu_si128((__m128i *)(out + i), unite ? _mm_or_si128(va, vb) : _mm_and_si128(va, vb));
+  }
+#endif
+  for (; i < n; i++)
+    out[i] = unite ? (a[i] | b[i]) : (a[i] & b[i]);
+
+  std::size_t count = 0;
+  for (i = 0; i < n; i++)
+    count += __builtin_popcountll(out[i]);
+  return count;
+}
+
+static bool testBit(const std::vector<std::uint64_t> &bits, const std::uint16_t slot)
+{
+  return (bits[slot >> 6] >> (slot & 63)) & 1;
+}
+
+RidBitmap::RidBitmap()
+{
+}
+
+void RidBitmap::fill(Container &container, const RecordId *rids, const std::size_t count)
+{
+  container.slots.resize(count);
+  for (std::size_t i = 0; i < count; i++)
+    container.slots[i] = rids[i].slot_number;
+  container.bits.clear();
+  container.count = count;
+  normalize(container);
+}
+
+void RidBitmap::normalize(Container &container)
+{
+  if (!container.isBitmap() && container.count > ARRAY_LIMIT)
+  {
+    container.bits.assign(BITMAP_WORDS, 0);
+    for (std::size_t i = 0; i < container.slots.size(); i++)
+      container.bits[container.slots[i] >> 6] |= std::uint64_t(1) << (container.slots[i] & 63);
+    container.slots.clear();
+  }
+  else if (container.isBitmap() && container.count <= ARRAY_LIMIT)
+  {
+    container.slots.clear();
+    for (std::size_t w = 0; w < BITMAP_WORDS; w++)
+    {
+      for (std::uint64_t word = container.bits[w]; word != 0; word &= word - 1)
+        container.slots.push_back(w * 64 + __builtin_ctzll(word));
+    }
+    container.bits.clear();
+  }
+}
+
+void RidBitmap::intersect(const Container &a, const Container &b, Container &out)
+{
+  out.slots.clear();
+  out.bits.clear();
+  if (a.isBitmap() && b.isBitmap())
+  {
+    out.bits.resize(BITMAP_WORDS);
+    out.count = combineWords(&a.bits[0], &b.bits[0], &out.bits[0], BITMAP_WORDS, false);
+  }
+  else if (a.isBitmap() || b.isBitmap())
+  {
+    const Container &array = a.isBitmap() ? b : a;
+    const Container &bitmap = a.isBitmap() ? a : b;
+    for (std::size_t i = 0; i < array.slots.size(); i++)
+    {
+      if (testBit(bitmap.bits, array.slots[i]))
+        out.slots.push_back(array.slots[i]);
+    }
+    out.count = out.slots.size();
+  }
+  else
+  {
+    out.slots.resize(std::min(a.slots.size(), b.slots.size()));
+    out.count = intersectArrays(a.slots.data(), a.slots.size(), b.slots.data(), b.slots.size(), out.slots.data());
+    out.slots.resize(out.count);
+  }
+  normalize(out);
+}
+
+void RidBitmap::unite(const Container &a, const Container &b, Container &out)
+{
+  out.slots.clear();
+  out.bits.clear();
+  if (a.isBitmap() && b.isBitmap())
+  {
+    out.bits.resize(BITMAP_WORDS);
+    out.count = combineWords(&a.bits[0], &b.bits[0], &out.bits[0], BITMAP_WORDS, true);
+  }
+  else if (a.isBitmap() || b.isBitmap())
+  {
+    const Container &array = a.isBitmap() ? b : a;
+    const Container &bitmap = a.isBitmap() ? a : b;
+    out.bits = bitmap.bits;
+    out.count = bitmap.count;
+    for (std::size_t i = 0; i < array.slots.size(); i++)
+    {
+      const std::uint16_t slot = array.slots[i];
+      if (!testBit(out.bits, slot))
+      {
+        out.bits[slot >> 6] |= std::uint64_t(1) << (slot & 63);
+        out.count++;
+      }
+    }
+  }
+  else
+  {
+    out.slots.resize(a.slots.size() + b.slots.size());
+    out.slots.erase(std::set_union(a.slots.begin(), a.slots.end(), b.slots.begin(), b.slots.end(), out.slots.begin()),
+                    out.slots.end());
+    out.count = out.slots.size();
+  }
+  normalize(out);
+}
+
+void RidBitmap::add(const RecordId &rid)
+{
+  const std::vector<PageId>::iterator it = std::lower_bound(pages.begin(), pages.end(), rid.page_number);
+  const std::size_t index = it - pages.begin();
+  if (it == pages.end() || *it != rid.page_number)
+  {
+    pages.insert(it, rid.page_number);
+    containers.insert(containers.begin() + index, Container());
+  }
+
+  Container &container = containers[index];
+  const std::uint16_t slot = rid.slot_number;
+  if (container.isBitmap())
+  {
+    if (!testBit(container.bits, slot))
+    {
+      container.bits[slot >> 6] |= std::uint64_t(1) << (slot & 63);
+      container.count++;
+    }
+    return;
+  }
+  const std::vector<std::uint16_t>::iterator pos = std::lower_bound(container.slots.begin(), container.slots.end(), slot);
+  if (pos == container.slots.end() || *pos != slot)
+  {
+    container.slots.insert(pos, slot);
+    container.count++;
+    normalize(container);
+  }
+}
+
+void RidBitmap::add(const RecordId *rids, const std::size_t count)
+{
+  std::vector<RecordId> sorted(rids, rids + count);
+  std::sort(sorted.begin(), sorted.end(), ridLess);
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+  RidBitmap added;
+  for (std::size_t first = 0; first < sorted.size();)
+  {
+    std::size_t end = first + 1;
+    while (end < sorted.size() && sorted[end].page_number == sorted[first].page_number)
+      end++;
+    added.pages.push_back(sorted[first].page_number);
+    added.containers.push_back(Container());
+    fill(added.containers.back(), &sorted[first], end - first);
+    first = end;
+  }
+
+  if (empty())
+  {
+    pages.swap(added.pages);
+    containers.swap(added.containers);
+  }
+  else
+    unionWith(added);
+}
+
+std::size_t RidBitmap::addScan(IndexScanCursor &cursor, const std::size_t batchSize)
+{
+  // a cursor whose scan found no key in its range has no scan running
+  if (!cursor.isScanning())
+    return 0;
+
+  std::vector<RecordId> rids;
+  std::vector<RecordId> batch(std::max<std::size_t>(1, batchSize));
+  try
+  {
+    // a short batch means the scan reached the end of its range
+    std::size_t count;
+    do
+    {
+      count = cursor.scanNextBatch(&batch[0], batch.size());
+      rids.insert(rids.end(), batch.begin(), batch.begin() + count);
+    } while (count == batch.size());
+  }
+  catch (const IndexScanCompletedException &e)
+  {
+  }
+  cursor.endScan();
+  add(rids.data(), rids.size());
+  return rids.size();
+}
+
+bool RidBitmap::contains(const RecordId &rid) const
+{
+  const std::vector<PageId>::const_iterator it = std::lower_bound(pages.begin(), pages.end(), rid.page_number);
+  if (it == pages.end() || *it != rid.page_number)
+    return false;
+  const Container &container = containers[it - pages.begin()];
+  if (container.isBitmap())
+    return testBit(container.bits, rid.slot_number);
+  return std::binary_search(container.slots.begin(), container.slots.end(), rid.slot_number);
+}
+
+std::size_t RidBitmap::cardinality() const
+{
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < containers.size(); i++)
+    count += containers[i].count;
+  return count;
+}
+
+void RidBitmap::intersectWith(const RidBitmap &other)
+{
+  std::vector<PageId> keptPages;
+  std::vector<Container> kept;
+  std::size_t i = 0;
+  std::size_t j = 0;
+  while (i < pages.size() && j < other.pages.size())
+  {
+    if (pages[i] < other.pages[j])
+      i++;
+    else if (other.pages[j] < pages[i])
+      j++;
+    else
+    {
+      Container both;
+      intersect(containers[i], other.containers[j], both);
+      if (both.count > 0)
+      {
+        keptPages.push_back(pages[i]);
+        kept.push_back(Container());
+        kept.back().slots.swap(both.slots);
+        kept.back().bits.swap(both.bits);
+        kept.back().count = both.count;
+      }
+      i++;
+      j++;
+    }
+  }
+  pages.swap(keptPages);
+  containers.swap(kept);
+}
+
+void RidBitmap::unionWith(const RidBitmap &other)
+{
+  std::vector<PageId> allPages;
+  std::vector<Container> all;
+  allPages.reserve(pages.size() + other.pages.size());
+  all.reserve(pages.size() + other.pages.size());
+  std::size_t i = 0;
+  std::size_t j = 0;
+  while (i < pages.size() || j < other.pages.size())
+  {
+    if (j == other.pages.size() || (i < pages.size() && pages[i] < other.pages[j]))
+    {
+      allPages.push_back(pages[i]);
+      all.push_back(Container());
+      all.back().slots.swap(containers[i].slots);
+      all.back().bits.swap(containers[i].bits);
+      all.back().count = containers[i].count;
+      i++;
+    }
+    else if (i == pages.size() || other.pages[j] < pages[i])
+    {
+      allPages.push_back(other.pages[j]);
+      all.push_back(other.containers[j]);
+      j++;
+    }
+    else
+    {
+      allPages.push_back(pages[i]);
+      all.push_back(Container());
+      unite(containers[i], other.containers[j], all.back());
+      i++;
+      j++;
+    }
+  }
+  pages.swap(allPages);
+  containers.swap(all);
+}
+
+void RidBitmap::toRids(std::vector<RecordId> &out) const
+{
+  out.reserve(out.size() + cardinality());
+  RecordId rid;
+  rid.padding = 0;
+  for (std::size_t i = 0; i < pages.size(); i++)
+  {
+    rid.page_number = pages[i];
+    const Container &container = containers[i];
+    if (container.isBitmap())
+    {
+      for (std::size_t w = 0; w < BITMAP_WORDS; w++)
+      {
+        for (std::uint64_t word = container.bits[w]; word != 0; word &= word - 1)
+        {
+          rid.slot_number = w * 64 + __builtin_ctzll(word);
+          out.push_back(rid);
+        }
+      }
+    }
+    else
+    {
+      for (std::size_t k = 0; k < container.slots.size(); k++)
+      {
+        rid.slot_number = container.slots[k];
+        out.push_back(rid);
+      }
+    }
+  }
+}
+
+void RidBitmap::clear()
+{
+  pages.clear();
+  containers.clear();
+}
+
+void RidBitmap::intersectScans(IndexScanCursor *const *cursors, const std::size_t count, RidBitmap &out)
+{
+  out.clear();
+  for (std::size_t k = 0; k < count; k++)
+  {
+    if (k > 0 && out.empty())
+    {
+      // nothing is left to intersect with, so the scan is not run
+      if (cursors[k]->isScanning())
+        cursors[k]->endScan();
+      continue;
+    }
+    if (k == 0)
+      out.addScan(*cursors[k]);
+    else
+    {
+      RidBitmap found;
+      found.addScan(*cursors[k]);
+      out.intersectWith(found);
+    }
+  }
+}
+
+void RidBitmap::unionScans(IndexScanCursor *const *cursors, const std::size_t count, RidBitmap &out)
+{
+  out.clear();
+  for (std::size_t k = 0; k < count; k++)
+  {
+    RidBitmap found;
+    found.addScan(*cursors[k]);
+    out.unionWith(found);
+  }
+}
+
+}
@@ -0,0 +1,193 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "types.h"
+
+namespace badgerdb {
+
+class IndexScanCursor;
+
+/**
+ * @brief Default number of record ids RidBitmap::addScan() takes from the scan at a time.
+ */
+const std::size_t RID_BITMAP_BATCH_SIZE = 256;
+
+/**
+ * @brief Compressed set of record ids, after Roaring bitmaps, e.g. to intersect or unite the results of scans on
+ * several indexes of a relation before fetching the records with a HeapFetch.
+ *
+ * The set keeps a container of slot numbers for every page that has record ids in it, ordered by page number. A
+ * container holding up to ARRAY_LIMIT slots is a sorted array of them; a fuller one is a bitmap over all 65536 slot
+ * numbers, which takes less room. Intersections and unions work a container pair at a time. With SSE2 or AVX2
+ * they compare blocks of array entries and combine bitmap words with vector instructions.
+ */
+class RidBitmap
+{
+ public:
+  /**
+   * Most slots a container holds as a sorted array; one with more is a bitmap.
+   */
+  static const std::size_t ARRAY_LIMIT = 4096;
+
+  /**
+   * Constructs an empty set.
+   */
+  RidBitmap();
+
+  /**
+   * Adds a record id.
+   */
+  void add(const RecordId &rid);
+
+  /**
+   * Adds count record ids, in any order.
+   */
+  void add(const RecordId *rids, const std::size_t count);
+
+  /**
+   * Adds the record ids of the remaining entries of the scan running on a cursor, taking them batchSize at a
+   * time, and ends the cursor's scan. A cursor with no scan running, e.g. because startScan() found no key in
+   * its range, adds nothing.
+   *
+   * @param cursor     Cursor with a scan started on it
+   * @param batchSize  Number of record ids to take at a time
+   * @return  Number of entries the scan returned.
+   */
+  std::size_t addScan(IndexScanCursor &cursor, const std::size_t batchSize = RID_BITMAP_BATCH_SIZE);
+
+  /**
+   * Returns true if the set holds the record id.
+   */
+  bool contains(const RecordId &rid) const;
+
+  /**
+   * Returns the number of record ids in the set.
+   */
+  std::size_t cardinality() const;
+
+  /**
+   * Returns true if the set holds no record id.
+   */
+  bool empty() const
+  {
+    return pages.empty();
+  }
+
+  /**
+   * Returns the number of pages with record ids in the set.
+   */
+  std::size_t numPages() const
+  {
+    return pages.size();
+  }
+
+  /**
+   * Keeps only the record ids that are in other as well.
+   */
+  void intersectWith(const RidBitmap &other);
+
+  /**
+   * Adds the record ids of other.
+   */
+  void unionWith(const RidBitmap &other);
+
+  /**
+   * Appends the record ids of the set to out, ordered by page and slot, e.g. for HeapFetch::add().
+   */
+  void toRids(std::vector<RecordId> &out) const;
+
+  /**
+   * Removes every record id.
+   */
+  void clear();
+
+  /**
+   * Runs the scans started on the cursors and returns the record ids all of them found. A scan is not run once
+   * the ones before it left nothing to intersect with; all scans are ended.
+   *
+   * @param cursors  Cursors with a scan started on each
+   * @param count    Number of cursors
+   * @param out      Set the record ids are returned in, replacing what it held
+   */
+  static void intersectScans(IndexScanCursor *const *cursors, const std::size_t count, RidBitmap &out);
+
+  /**
+   * Runs the scans started on the cursors and returns the record ids any of them found.
+   *
+   * @param cursors  Cursors with a scan started on each
+   * @param count    Number of cursors
+   * @param out      Set the record ids are returned in, replacing what it held
+   */
+  static void unionScans(IndexScanCursor *const *cursors, const std::size_t count, RidBitmap &out);
+
+ private:
+  /**
+   * @brief Slots of the record ids on one page.
+   */
+  struct Container
+  {
+    /**
+     * Sorted slot numbers, if the container is an array.
+     */
+    std::vector<std::uint16_t> slots;
+
+    /**
+     * BITMAP_WORDS words with the bit of every slot set, if the container is a bitmap; empty otherwise.
+     */
+    std::vector<std::uint64_t> bits;
+
+    /**
+     * Number of slots in the container.
+     */
+    std::size_t count;
+
+    Container() : count(0)
+    {
+    }
+
+    bool isBitmap() const
+    {
+      return !bits.empty();
+    }
+  };
+
+  /**
+   * Number of words of a bitmap container.
+   */
+  static const std::size_t BITMAP_WORDS = 65536 / 64;
+
+  /**
+   * Pages with record ids in the set, in ascending order.
+   */
+  std::vector<PageId> pages;
+
+  /**
+   * Container of each page of pages.
+   */
+  std::vector<Container> containers;
+
+  /**
+   * Sets the container to the slots of the sorted record ids, all on one page.
+   */
+  static void fill(Container &container, const RecordId *rids, const std::size_t count);
+
+  /**
+   * Turns an array container with more than ARRAY_LIMIT slots into a bitmap, and a bitmap with no more than that
+   * into an array.
+   */
+  static void normalize(Container &container);
+
+  static void intersect(const Container &a, const Container &b, Container &out);
+
+  static void unite(const Container &a, const Container &b, Container &out);
+};
+
+}
@@ -0,0 +1,180 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "secondary_cache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bufHashTbl.h"
+#include "checksum.h"
+#include "exceptions/io_error_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Returns the position of a slot in the cache file.
+ */
+off_t slotPosition(const std::uint32_t slot) {
+  return static_cast<off_t>(slot) * Page::SIZE;
+}
+
+}
+
+SecondaryCache::SecondaryCache(const std::string& name,
+                               const std::uint32_t pages,
+                               const bool admitScans)
+    : filename_(name), fd_(-1), admitScans_(admitScans), table_(NULL),
+      slots_(pages > 0 ? pages : 1), hand_(0) {
+  fd_ = ::open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd_ < 0) {
+    throw IoErrorException("open", errno);
+  }
+  table_ = new BufHashTbl(static_cast<int>(slots_.size()));
+  // handed out from the front of the file first
+  freeSlots_.reserve(slots_.size());
+  for (std::uint32_t i = static_cast<std::uint32_t>(slots_.size()); i > 0; i--) {
+    freeSlots_.push_back(i - 1);
+  }
+}
+
+SecondaryCache::~SecondaryCache() {
+  delete table_;
+  ::close(fd_);
+  std::remove(filename_.c_str());
+}
+
+bool SecondaryCache::read(const File* file, const PageId pageNo, Page* page) {
+  std::lock_guard<std::mutex> guard(latch_);
+  FrameId slot;
+  if (!table_->lookup(file, pageNo, slot)) {
+    stats_.misses++;
+    return false;
+  }
+
+  char* buffer = reinterpret_cast<char*>(page);
+  std::size_t done = 0;
+  while (done < Page::SIZE) {
+    const ssize_t n = pread(fd_, buffer + done, Page::SIZE - done,
+                            slotPosition(slot) + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      throw IoErrorException("read", errno);
+    }
+    if (n == 0) {
+      break;
+    }
+    done += n;
+  }
+  if (done < Page::SIZE || crc32c(buffer, Page::SIZE) != slots_[slot].checksum) {
+    // the device lost or damaged the copy; the file still has the page
+    release(slot);
+    stats_.invalidations++;
+    stats_.misses++;
+    return false;
+  }
+  slots_[slot].referenced = true;
+  stats_.hits++;
+  return true;
+}
+
+void SecondaryCache::admit(const File* file, const PageId pageNo,
+                           const Page& page, const bool scanned) {
+  std::lock_guard<std::mutex> guard(latch_);
+  FrameId existing;
+  if (table_->lookup(file, pageNo, existing)) {
+    return;
+  }
+  if (scanned && !admitScans_) {
+    stats_.rejections++;
+    return;
+  }
+
+  const std::uint32_t slot = takeSlot();
+  const char* buffer = reinterpret_cast<const char*>(&page);
+  std::size_t done = 0;
+  while (done < Page::SIZE) {
+    const ssize_t n = pwrite(fd_, buffer + done, Page::SIZE - done,
+                             slotPosition(slot) + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      const int error = errno;
+      freeSlots_.push_back(slot);
+      throw IoErrorException("write", error);
+    }
+    done += n;
+  }
+
+  Slot& entry = slots_[slot];
+  entry.file = file;
+  entry.pageNo = pageNo;
+  entry.checksum = crc32c(buffer, Page::SIZE);
+  entry.referenced = false;
+  table_->insert(file, pageNo, slot);
+  stats_.admissions++;
+}
+
+void SecondaryCache::invalidate(const File* file, const PageId pageNo) {
+  std::lock_guard<std::mutex> guard(latch_);
+  FrameId slot;
+  if (table_->lookup(file, pageNo, slot)) {
+    release(slot);
+    stats_.invalidations++;
+  }
+}
+
+void SecondaryCache::dropFile(const File* file) {
+  std::lock_guard<std::mutex> guard(latch_);
+  for (std::uint32_t i = 0; i < slots_.size(); i++) {
+    if (slots_[i].file == file) {
+      release(i);
+    }
+  }
+}
+
+std::uint32_t SecondaryCache::size() const {
+  std::lock_guard<std::mutex> guard(latch_);
+  return static_cast<std::uint32_t>(slots_.size() - freeSlots_.size());
+}
+
+SecondaryCacheStats SecondaryCache::getStats() const {
+  std::lock_guard<std::mutex> guard(latch_);
+  return stats_;
+}
+
+void SecondaryCache::release(const std::uint32_t slot) {
+  Slot& entry = slots_[slot];
+  table_->remove(entry.file, entry.pageNo);
+  entry = Slot();
+  freeSlots_.push_back(slot);
+}
+
+std::uint32_t SecondaryCache::takeSlot() {
+  if (freeSlots_.empty()) {
+    // every slot is taken, so the sweep finds one within two rounds
+    while (slots_[hand_].referenced) {
+      slots_[hand_].referenced = false;
+      hand_ = (hand_ + 1) % slots_.size();
+    }
+    release(hand_);
+    hand_ = (hand_ + 1) % slots_.size();
+  }
+  const std::uint32_t slot = freeSlots_.back();
+  freeSlots_.pop_back();
+  return slot;
+}
+
+}
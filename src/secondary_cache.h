@@ -0,0 +1,243 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+class BufHashTbl;
+class File;
+
+/**
+ * @brief Counts of what a SecondaryCache did since it was created.
+ */
+struct SecondaryCacheStats {
+  /**
+   * Pages found in the cache and read from it.
+   */
+  std::uint64_t hits;
+
+  /**
+   * Pages looked up and not found.
+   */
+  std::uint64_t misses;
+
+  /**
+   * Pages written to the cache.
+   */
+  std::uint64_t admissions;
+
+  /**
+   * Pages offered to the cache and turned away because they were only read
+   * by scans.
+   */
+  std::uint64_t rejections;
+
+  /**
+   * Cached pages dropped because they were written to their file, or failed
+   * their checksum when read back.
+   */
+  std::uint64_t invalidations;
+
+  SecondaryCacheStats()
+      : hits(0), misses(0), admissions(0), rejections(0), invalidations(0) {}
+};
+
+/**
+ * @brief Second tier of page cache behind a BufMgr, in a file on a faster
+ *        device than the files it caches, e.g. a local SSD in front of
+ *        network storage.
+ *
+ * BufMgr::setSecondaryCache() attaches it. Pages evicted clean from the pool
+ * are offered to the cache with admit(), and a page that is not in the pool
+ * is read from the cache before its file. The cache file holds a fixed number
+ * of page slots, recycled by a clock sweep: a hit sets the reference bit of
+ * its slot, and the sweep clears set bits and takes the first slot whose bit
+ * is clear.
+ *
+ * Admission keeps scans out: a page that was only ever read with
+ * SEQUENTIAL_ACCESS while it was in the pool, e.g. by a FileScan, through a
+ * BufferRing or by read-ahead, is turned away unless the cache was created to
+ * admit scans, so a large scan does not flush the pages that are read
+ * again and again.
+ *
+ * The cache only holds copies of pages as they are in their file. BufMgr
+ * invalidates the copy of a page whenever it writes the page back, and drops
+ * all pages of a file when the file is flushed, since a File object may be
+ * destroyed afterwards and another one take its address. Every slot is
+ * checked against a CRC32C kept in memory when it is read back; a slot that
+ * fails is dropped and the page read from its file. Nothing of the cache
+ * survives the object: the file is created empty and removed again.
+ *
+ * The cache is threadsafe. Reads and writes of the cache file are serialized
+ * like BufMgr serializes those of the files it caches.
+ */
+class SecondaryCache {
+ public:
+  /**
+   * Creates the cache file, replacing any file of the same name.
+   *
+   * @param name          Name of the cache file.
+   * @param pages         Number of pages the cache holds.
+   * @param admitScans    True to admit pages that were only read by scans
+   *                      too.
+   * @throws  IoErrorException  If the file could not be created.
+   */
+  SecondaryCache(const std::string& name, const std::uint32_t pages,
+                 const bool admitScans = false);
+
+  /**
+   * Closes and removes the cache file.
+   */
+  ~SecondaryCache();
+
+  /**
+   * Reads a page from the cache if it holds it.
+   *
+   * @param file    File of the page.
+   * @param pageNo  Number of the page.
+   * @param page    The page is read into it.
+   * @return  True if the page was in the cache.
+   * @throws  IoErrorException  If the cache file could not be read.
+   */
+  bool read(const File* file, const PageId pageNo, Page* page);
+
+  /**
+   * Offers the cache a clean page evicted from the pool. A page it already
+   * holds is left as it is.
+   *
+   * @param file      File of the page.
+   * @param pageNo    Number of the page.
+   * @param page      The page, which must be as it is in its file.
+   * @param scanned   True if the page was only read by scans while in the
+   *                  pool.
+   * @throws  IoErrorException  If the cache file could not be written.
+   */
+  void admit(const File* file, const PageId pageNo, const Page& page,
+             const bool scanned);
+
+  /**
+   * Drops the copy of a page, if there is one, because the page changed in
+   * its file.
+   *
+   * @param file    File of the page.
+   * @param pageNo  Number of the page.
+   */
+  void invalidate(const File* file, const PageId pageNo);
+
+  /**
+   * Drops the copies of all pages of a file.
+   *
+   * @param file  File of the pages.
+   */
+  void dropFile(const File* file);
+
+  /**
+   * Returns the number of pages the cache holds now.
+   */
+  std::uint32_t size() const;
+
+  /**
+   * Returns the number of pages the cache can hold.
+   */
+  std::uint32_t capacity() const {
+    return static_cast<std::uint32_t>(slots_.size());
+  }
+
+  /**
+   * Returns the counts so far.
+   */
+  SecondaryCacheStats getStats() const;
+
+ private:
+  SecondaryCache(const SecondaryCache&);
+  SecondaryCache& operator=(const SecondaryCache&);
+
+  /**
+   * Page held in a slot of the cache file.
+   */
+  struct Slot {
+    /**
+     * File of the page, NULL if the slot is free.
+     */
+    const File* file;
+
+    PageId pageNo;
+
+    /**
+     * CRC32C of the page as it was written to the slot.
+     */
+    std::uint32_t checksum;
+
+    /**
+     * Set by a hit, cleared by the clock sweep passing over the slot.
+     */
+    bool referenced;
+
+    Slot() : file(NULL), pageNo(Page::INVALID_NUMBER), checksum(0),
+             referenced(false) {}
+  };
+
+  /**
+   * Frees a slot and removes its page from the table. The caller holds
+   * latch_.
+   */
+  void release(const std::uint32_t slot);
+
+  /**
+   * Returns a free slot, freeing the first one the clock sweep finds
+   * unreferenced if there is none. The caller holds latch_.
+   */
+  std::uint32_t takeSlot();
+
+  /**
+   * Name of the cache file.
+   */
+  const std::string filename_;
+
+  /**
+   * Descriptor of the cache file.
+   */
+  int fd_;
+
+  const bool admitScans_;
+
+  /**
+   * Guards everything below, and is held while the cache file is read or
+   * written.
+   */
+  mutable std::mutex latch_;
+
+  /**
+   * Maps the (File, page) pairs in the cache to their slots.
+   */
+  BufHashTbl* table_;
+
+  std::vector<Slot> slots_;
+
+  /**
+   * Slots that hold no page.
+   */
+  std::vector<std::uint32_t> freeSlots_;
+
+  /**
+   * Slot the clock sweep looks at next.
+   */
+  std::uint32_t hand_;
+
+  SecondaryCacheStats stats_;
+};
+
+}
@@ -0,0 +1,158 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "trace.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Hands out the numbers of the threads.
+ */
+std::atomic<std::uint32_t> nextThread(1);
+
+/**
+ * Tag of the calling thread.
+ */
+thread_local std::uint64_t currentTag = 0;
+
+/**
+ * Returns the number of the calling thread.
+ */
+std::uint32_t threadNumber() {
+  static thread_local std::uint32_t number = nextThread.fetch_add(1);
+  return number;
+}
+
+}
+
+std::atomic<Tracer*> Tracer::current_(NULL);
+
+const char* traceEventName(const TraceEvent event) {
+  switch (event) {
+    case TRACE_BUFFER_HIT:
+      return "buffer-hit";
+    case TRACE_BUFFER_MISS:
+      return "buffer-miss";
+    case TRACE_BUFFER_EVICT:
+      return "buffer-evict";
+    case TRACE_FILE_READ:
+      return "file-read";
+    case TRACE_FILE_WRITE:
+      return "file-write";
+    case TRACE_INDEX_DESCENT:
+      return "index-descent";
+    case TRACE_INDEX_LEAF_SPLIT:
+      return "index-leaf-split";
+    case TRACE_INDEX_NONLEAF_SPLIT:
+      return "index-nonleaf-split";
+    case TRACE_INDEX_ROOT_SPLIT:
+      return "index-root-split";
+  }
+  return "unknown";
+}
+
+Tracer::Tracer(const std::size_t capacity) : mask_(0), next_(0) {
+  std::size_t size = 1;
+  while (size < capacity) {
+    size *= 2;
+  }
+  mask_ = size - 1;
+  slots_.reset(new Slot[size]);
+  for (std::size_t i = 0; i < size; i++) {
+    slots_[i].sequence.store(0, std::memory_order_relaxed);
+  }
+}
+
+Tracer::~Tracer() {
+  Tracer* self = this;
+  current_.compare_exchange_strong(self, NULL);
+}
+
+void Tracer::install(Tracer* tracer) {
+  current_.store(tracer, std::memory_order_release);
+}
+
+std::uint64_t Tracer::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::uint64_t Tracer::threadTag() {
+  return currentTag;
+}
+
+void Tracer::setThreadTag(const std::uint64_t tag) {
+  currentTag = tag;
+}
+
+void Tracer::record(const TraceEvent event, const void* source,
+                    const PageId pageNo, const std::uint32_t count,
+                    const std::uint32_t bytes, const std::uint64_t start,
+                    const std::uint64_t duration) {
+  const std::uint64_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+  Slot& slot = slots_[ticket & mask_];
+  slot.sequence.store(2 * ticket + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.record.time = start;
+  slot.record.duration = duration;
+  slot.record.tag = currentTag;
+  slot.record.source = source;
+  slot.record.pageNo = pageNo;
+  slot.record.count = count;
+  slot.record.bytes = bytes;
+  slot.record.thread = threadNumber();
+  slot.record.event = event;
+  slot.sequence.store(2 * ticket + 2, std::memory_order_release);
+}
+
+std::vector<TraceRecord> Tracer::records() const {
+  const std::uint64_t end = next_.load(std::memory_order_acquire);
+  const std::uint64_t begin = end > capacity() ? end - capacity() : 0;
+  std::vector<TraceRecord> out;
+  out.reserve(end - begin);
+  for (std::uint64_t ticket = begin; ticket < end; ticket++) {
+    const Slot& slot = slots_[ticket & mask_];
+    // a slot still being written, or already taken by a later ticket, is left
+    // out
+    if (slot.sequence.load(std::memory_order_acquire) != 2 * ticket + 2) {
+      continue;
+    }
+    TraceRecord copy;
+    memcpy(&copy, &slot.record, sizeof(copy));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != 2 * ticket + 2) {
+      continue;
+    }
+    out.push_back(copy);
+  }
+  return out;
+}
+
+void Tracer::dump(std::ostream& out) const {
+  const std::vector<TraceRecord> trace = records();
+  out << "time_us thread tag event source page count bytes duration_us\n";
+  const std::uint64_t first = trace.empty() ? 0 : trace[0].time;
+  for (std::size_t i = 0; i < trace.size(); i++) {
+    const TraceRecord& record = trace[i];
+    // records are ordered by when they were made, which for a timed event is
+    // its end, so one may have started before the first
+    const double time = record.time >= first
+        ? (record.time - first) / 1000.0
+        : -((first - record.time) / 1000.0);
+    out << time << " " << record.thread << " " << record.tag << " "
+        << traceEventName(static_cast<TraceEvent>(record.event)) << " "
+        << record.source << " " << record.pageNo << " " << record.count << " "
+        << record.bytes << " " << record.duration / 1000.0 << "\n";
+  }
+}
+
+}
@@ -0,0 +1,304 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "types.h"
+
+/**
+ * 1 to compile the trace points in, 0 to leave them out. The Makefile sets it
+ * from TRACING.
+ */
+#ifndef BADGERDB_TRACING
+#define BADGERDB_TRACING 1
+#endif
+
+namespace badgerdb {
+
+/**
+ * @brief Default number of records a Tracer keeps.
+ */
+const std::size_t TRACE_CAPACITY = 65536;
+
+/**
+ * @brief What a trace record stands for, and what its fields hold.
+ */
+enum TraceEvent {
+  TRACE_BUFFER_HIT = 1,       //!< BufMgr found a page in the pool; source is the File
+  TRACE_BUFFER_MISS,          //!< BufMgr read a page into the pool; source is the File
+  TRACE_BUFFER_EVICT,         //!< BufMgr evicted a page; bytes are those written back if it was dirty
+  TRACE_FILE_READ,            //!< count pages from pageNo on were read from the File, taking duration
+  TRACE_FILE_WRITE,           //!< count pages from pageNo on were written to the File, taking duration
+  TRACE_INDEX_DESCENT,        //!< An operation of the BTreeIndex went from the root to a leaf; count nodes visited
+  TRACE_INDEX_LEAF_SPLIT,     //!< A leaf split; pageNo is the new one
+  TRACE_INDEX_NONLEAF_SPLIT,  //!< A non-leaf node split; pageNo is the new one
+  TRACE_INDEX_ROOT_SPLIT      //!< The root split; pageNo is the new root
+};
+
+/**
+ * Returns the name of an event, as dump() prints it.
+ */
+const char* traceEventName(const TraceEvent event);
+
+/**
+ * @brief One event, as kept by a Tracer.
+ */
+struct TraceRecord {
+  /**
+   * Time of the event, or of its start if it has a duration, in nanoseconds
+   * of the steady clock.
+   */
+  std::uint64_t time;
+
+  /**
+   * Nanoseconds the event took, 0 for one that takes no time of its own.
+   */
+  std::uint64_t duration;
+
+  /**
+   * Tag of the thread when the event happened; see TraceTag.
+   */
+  std::uint64_t tag;
+
+  /**
+   * The File or BTreeIndex the event happened to. Only compared, never
+   * followed, since the object may be gone by the time the trace is read.
+   */
+  const void* source;
+
+  PageId pageNo;
+
+  /**
+   * Number of pages or nodes; see TraceEvent.
+   */
+  std::uint32_t count;
+
+  /**
+   * Number of bytes read or written.
+   */
+  std::uint32_t bytes;
+
+  /**
+   * Number of the thread, counted from 1 in the order threads first traced
+   * something.
+   */
+  std::uint32_t thread;
+
+  /**
+   * A TraceEvent.
+   */
+  std::uint32_t event;
+};
+
+/**
+ * @brief Lock-free ring of the most recent trace records.
+ *
+ * The trace points in the buffer manager, the files and the B+ tree hand their
+ * events to the tracer installed with install(), and do nothing but look at
+ * an atomic pointer while none is. Every thread takes the next slot of the
+ * ring with one fetch_add and fills it in place, so threads never wait for one
+ * another; once the ring is full the newest records overwrite the oldest.
+ * Each slot carries a sequence number that is odd while the slot is written,
+ * so records() skips a slot being written rather than copying half of it.
+ *
+ * Events carry the tag of the thread they happened on. A query that sets its
+ * own tag with TraceTag finds the I/O it caused in the trace by that tag.
+ *
+ * Building with BADGERDB_TRACING set to 0 leaves the trace points out of the
+ * code altogether; a tracer can then be installed, but records nothing.
+ */
+class Tracer {
+ public:
+  /**
+   * Creates a tracer, not yet installed.
+   *
+   * @param capacity  Number of records kept, rounded up to a power of two.
+   */
+  explicit Tracer(const std::size_t capacity = TRACE_CAPACITY);
+
+  /**
+   * Uninstalls the tracer if it is installed. Trace points still running on
+   * other threads must be done with it before it is destroyed.
+   */
+  ~Tracer();
+
+  /**
+   * Makes a tracer the one the trace points record to, replacing the one
+   * installed before.
+   *
+   * @param tracer  Tracer to install, NULL to stop tracing.
+   */
+  static void install(Tracer* tracer);
+
+  /**
+   * Returns the installed tracer, NULL if there is none.
+   */
+  static Tracer* installed() {
+    return current_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Returns the time now in nanoseconds of the steady clock.
+   */
+  static std::uint64_t now();
+
+  /**
+   * Records an event with the installed tracer, if there is one.
+   */
+  static void emit(const TraceEvent event, const void* source,
+                   const PageId pageNo, const std::uint32_t count,
+                   const std::uint32_t bytes) {
+    Tracer* tracer = installed();
+    if (tracer != NULL) {
+      tracer->record(event, source, pageNo, count, bytes, now(), 0);
+    }
+  }
+
+  /**
+   * Records an event.
+   *
+   * @param start     Time the event started, from now().
+   * @param duration  Nanoseconds it took.
+   */
+  void record(const TraceEvent event, const void* source, const PageId pageNo,
+              const std::uint32_t count, const std::uint32_t bytes,
+              const std::uint64_t start, const std::uint64_t duration);
+
+  /**
+   * Returns the records the ring holds, oldest first. Records written while
+   * this runs may be missing.
+   */
+  std::vector<TraceRecord> records() const;
+
+  /**
+   * Returns the number of records made since the tracer was created,
+   * including those overwritten since.
+   */
+  std::uint64_t recorded() const {
+    return next_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the number of records the ring holds at most.
+   */
+  std::size_t capacity() const { return mask_ + 1; }
+
+  /**
+   * Prints records() one per line, with times in microseconds since the
+   * first of them.
+   */
+  void dump(std::ostream& out) const;
+
+  /**
+   * Returns the tag of the calling thread, 0 if it set none.
+   */
+  static std::uint64_t threadTag();
+
+  /**
+   * Sets the tag of the calling thread.
+   */
+  static void setThreadTag(const std::uint64_t tag);
+
+ private:
+  Tracer(const Tracer&);
+  Tracer& operator=(const Tracer&);
+
+  /**
+   * A record and the sequence number guarding it: 2 * ticket + 1 while the
+   * record of a ticket is written, 2 * ticket + 2 once it is complete.
+   */
+  struct Slot {
+    std::atomic<std::uint64_t> sequence;
+    TraceRecord record;
+  };
+
+  /**
+   * The installed tracer.
+   */
+  static std::atomic<Tracer*> current_;
+
+  std::unique_ptr<Slot[]> slots_;
+
+  /**
+   * Capacity minus 1, to take tickets modulo the capacity.
+   */
+  std::size_t mask_;
+
+  /**
+   * Ticket of the next record.
+   */
+  std::atomic<std::uint64_t> next_;
+};
+
+/**
+ * @brief Times an event from its construction until end(), if a tracer was
+ *        installed when it was constructed. One that is not ended, e.g.
+ *        because the I/O threw, records nothing.
+ */
+class TraceSpan {
+ public:
+  TraceSpan() : start_(Tracer::installed() != NULL ? Tracer::now() : 0) {}
+
+  /**
+   * Records the event with the installed tracer.
+   */
+  void end(const TraceEvent event, const void* source, const PageId pageNo,
+           const std::uint32_t count, const std::uint32_t bytes) const {
+    Tracer* tracer = Tracer::installed();
+    if (tracer != NULL && start_ != 0) {
+      const std::uint64_t finish = Tracer::now();
+      tracer->record(event, source, pageNo, count, bytes, start_,
+                     finish - start_);
+    }
+  }
+
+ private:
+  const std::uint64_t start_;
+};
+
+/**
+ * @brief Sets the tag of the calling thread for as long as it exists, e.g.
+ *        to the number of a query, and restores the tag before it.
+ */
+class TraceTag {
+ public:
+  explicit TraceTag(const std::uint64_t tag) : previous_(Tracer::threadTag()) {
+    Tracer::setThreadTag(tag);
+  }
+
+  ~TraceTag() { Tracer::setThreadTag(previous_); }
+
+ private:
+  TraceTag(const TraceTag&);
+  TraceTag& operator=(const TraceTag&);
+
+  const std::uint64_t previous_;
+};
+
+}
+
+/**
+ * Trace points. With BADGERDB_TRACING set to 0 they compile to nothing, and
+ * their arguments are not evaluated.
+ */
+#if BADGERDB_TRACING
+#define BADGERDB_TRACE(event, source, pageNo, count, bytes) \
+  ::badgerdb::Tracer::emit(event, source, pageNo, count, bytes)
+#define BADGERDB_TRACE_SPAN(span) const ::badgerdb::TraceSpan span
+#define BADGERDB_TRACE_END(span, event, source, pageNo, count, bytes) \
+  span.end(event, source, pageNo, count, bytes)
+#else
+#define BADGERDB_TRACE(event, source, pageNo, count, bytes) ((void)0)
+#define BADGERDB_TRACE_SPAN(span) ((void)0)
+#define BADGERDB_TRACE_END(span, event, source, pageNo, count, bytes) ((void)0)
+#endif